@@ -3,6 +3,18 @@
 
 #include <math.h>
 
+/* The matrix and quaternion products, the inverse and the transpose use SSE
+ * or NEON when the compiler targets them, with the same results as the plain
+ * C versions up to rounding.  Define LINMATH_NO_SIMD to use plain C anyway.
+ * Matrices and vectors need no particular alignment either way. */
+#if !defined(LINMATH_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define LINMATH_SSE
+#include <xmmintrin.h>
+#elif !defined(LINMATH_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define LINMATH_NEON
+#include <arm_neon.h>
+#endif
+
 #ifdef _MSC_VER 
 #define inline __inline
 #endif
@@ -81,6 +93,50 @@ static inline void vec4_reflect(vec4 r, vec4 v, vec4 n)
 }
 
 typedef vec4 mat4x4[4];
+
+#if defined(LINMATH_SSE)
+#define LINMATH_SSE_SPLAT(v, i) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(i, i, i, i))
+/* The columns a0..a3 times the vector v */
+static inline __m128 linmath_sse_mul_vec4(__m128 a0, __m128 a1, __m128 a2, __m128 a3, __m128 v)
+{
+	return _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(a0, LINMATH_SSE_SPLAT(v, 0)), _mm_mul_ps(a1, LINMATH_SSE_SPLAT(v, 1))),
+		_mm_add_ps(_mm_mul_ps(a2, LINMATH_SSE_SPLAT(v, 2)), _mm_mul_ps(a3, LINMATH_SSE_SPLAT(v, 3))));
+}
+#elif defined(LINMATH_NEON)
+static inline float32x4_t linmath_neon_mul_vec4(float32x4_t a0, float32x4_t a1, float32x4_t a2, float32x4_t a3, float32x4_t v)
+{
+	float32x2_t lo = vget_low_f32(v);
+	float32x2_t hi = vget_high_f32(v);
+	float32x4_t r = vmulq_lane_f32(a0, lo, 0);
+	r = vmlaq_lane_f32(r, a1, lo, 1);
+	r = vmlaq_lane_f32(r, a2, hi, 0);
+	return vmlaq_lane_f32(r, a3, hi, 1);
+}
+#endif
+
+#if defined(LINMATH_SSE)
+#define LINMATH_SSE_SWIZZLE(v, x, y, z, w) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(w, z, y, x))
+#define LINMATH_SSE_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps((a), (b), _MM_SHUFFLE(w, z, y, x))
+/* For mat4x4_invert: products of 2x2 blocks, each held in a vector as
+ * (m00, m01, m10, m11), as a*b, adj(a)*b and a*adj(b) */
+static inline __m128 linmath_sse_mat2_mul(__m128 a, __m128 b)
+{
+	return _mm_add_ps(_mm_mul_ps(a, LINMATH_SSE_SWIZZLE(b, 0, 3, 0, 3)),
+		_mm_mul_ps(LINMATH_SSE_SWIZZLE(a, 1, 0, 3, 2), LINMATH_SSE_SWIZZLE(b, 2, 1, 2, 1)));
+}
+static inline __m128 linmath_sse_mat2_adj_mul(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(LINMATH_SSE_SWIZZLE(a, 3, 3, 0, 0), b),
+		_mm_mul_ps(LINMATH_SSE_SWIZZLE(a, 1, 1, 2, 2), LINMATH_SSE_SWIZZLE(b, 2, 3, 0, 1)));
+}
+static inline __m128 linmath_sse_mat2_mul_adj(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(a, LINMATH_SSE_SWIZZLE(b, 3, 0, 3, 0)),
+		_mm_mul_ps(LINMATH_SSE_SWIZZLE(a, 1, 0, 3, 2), LINMATH_SSE_SWIZZLE(b, 2, 1, 2, 1)));
+}
+#endif
+
 static inline void mat4x4_identity(mat4x4 M)
 {
 	int i, j;
@@ -109,10 +165,30 @@ static inline void mat4x4_col(vec4 r, mat4x4 M, int i)
 }
 static inline void mat4x4_transpose(mat4x4 M, mat4x4 N)
 {
+#if defined(LINMATH_SSE)
+	__m128 c0 = _mm_loadu_ps(N[0]);
+	__m128 c1 = _mm_loadu_ps(N[1]);
+	__m128 c2 = _mm_loadu_ps(N[2]);
+	__m128 c3 = _mm_loadu_ps(N[3]);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	_mm_storeu_ps(M[0], c0);
+	_mm_storeu_ps(M[1], c1);
+	_mm_storeu_ps(M[2], c2);
+	_mm_storeu_ps(M[3], c3);
+#elif defined(LINMATH_NEON)
+	float32x4x4_t t = vld4q_f32(&N[0][0]);
+	vst1q_f32(M[0], t.val[0]);
+	vst1q_f32(M[1], t.val[1]);
+	vst1q_f32(M[2], t.val[2]);
+	vst1q_f32(M[3], t.val[3]);
+#else
 	int i, j;
+	mat4x4 temp;
 	for(j=0; j<4; ++j)
 		for(i=0; i<4; ++i)
-			M[i][j] = N[j][i];
+			temp[i][j] = N[j][i];
+	mat4x4_dup(M, temp);
+#endif
 }
 static inline void mat4x4_add(mat4x4 M, mat4x4 a, mat4x4 b)
 {
@@ -144,6 +220,27 @@ static inline void mat4x4_scale_aniso(mat4x4 M, mat4x4 a, float x, float y, floa
 }
 static inline void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b)
 {
+#if defined(LINMATH_SSE)
+	__m128 a0 = _mm_loadu_ps(a[0]), a1 = _mm_loadu_ps(a[1]), a2 = _mm_loadu_ps(a[2]), a3 = _mm_loadu_ps(a[3]);
+	__m128 r0 = linmath_sse_mul_vec4(a0, a1, a2, a3, _mm_loadu_ps(b[0]));
+	__m128 r1 = linmath_sse_mul_vec4(a0, a1, a2, a3, _mm_loadu_ps(b[1]));
+	__m128 r2 = linmath_sse_mul_vec4(a0, a1, a2, a3, _mm_loadu_ps(b[2]));
+	__m128 r3 = linmath_sse_mul_vec4(a0, a1, a2, a3, _mm_loadu_ps(b[3]));
+	_mm_storeu_ps(M[0], r0);
+	_mm_storeu_ps(M[1], r1);
+	_mm_storeu_ps(M[2], r2);
+	_mm_storeu_ps(M[3], r3);
+#elif defined(LINMATH_NEON)
+	float32x4_t a0 = vld1q_f32(a[0]), a1 = vld1q_f32(a[1]), a2 = vld1q_f32(a[2]), a3 = vld1q_f32(a[3]);
+	float32x4_t r0 = linmath_neon_mul_vec4(a0, a1, a2, a3, vld1q_f32(b[0]));
+	float32x4_t r1 = linmath_neon_mul_vec4(a0, a1, a2, a3, vld1q_f32(b[1]));
+	float32x4_t r2 = linmath_neon_mul_vec4(a0, a1, a2, a3, vld1q_f32(b[2]));
+	float32x4_t r3 = linmath_neon_mul_vec4(a0, a1, a2, a3, vld1q_f32(b[3]));
+	vst1q_f32(M[0], r0);
+	vst1q_f32(M[1], r1);
+	vst1q_f32(M[2], r2);
+	vst1q_f32(M[3], r3);
+#else
 	mat4x4 temp;
 	int k, r, c;
 	for(c=0; c<4; ++c) for(r=0; r<4; ++r) {
@@ -152,15 +249,76 @@ static inline void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b)
 			temp[c][r] += a[k][r] * b[c][k];
 	}
 	mat4x4_dup(M, temp);
+#endif
 }
 static inline void mat4x4_mul_vec4(vec4 r, mat4x4 M, vec4 v)
 {
+#if defined(LINMATH_SSE)
+	_mm_storeu_ps(r, linmath_sse_mul_vec4(_mm_loadu_ps(M[0]), _mm_loadu_ps(M[1]), _mm_loadu_ps(M[2]), _mm_loadu_ps(M[3]), _mm_loadu_ps(v)));
+#elif defined(LINMATH_NEON)
+	vst1q_f32(r, linmath_neon_mul_vec4(vld1q_f32(M[0]), vld1q_f32(M[1]), vld1q_f32(M[2]), vld1q_f32(M[3]), vld1q_f32(v)));
+#else
+	vec4 temp;
 	int i, j;
 	for(j=0; j<4; ++j) {
-		r[j] = 0.f;
+		temp[j] = 0.f;
 		for(i=0; i<4; ++i)
-			r[j] += M[i][j] * v[i];
+			temp[j] += M[i][j] * v[i];
 	}
+	for(j=0; j<4; ++j)
+		r[j] = temp[j];
+#endif
+}
+/* Batched versions: R[i] = M * N[i], and r[i] = M * v[i], for i in [0, n).
+ * M is only loaded once, so these are quicker than calling the above in a
+ * loop.  Each output may be the same as its input, but not M. */
+static inline void mat4x4_mul_n(mat4x4 *R, mat4x4 M, mat4x4 *N, int n)
+{
+	int i;
+#if defined(LINMATH_SSE)
+	__m128 m0 = _mm_loadu_ps(M[0]), m1 = _mm_loadu_ps(M[1]), m2 = _mm_loadu_ps(M[2]), m3 = _mm_loadu_ps(M[3]);
+	for(i=0; i<n; ++i) {
+		__m128 r0 = linmath_sse_mul_vec4(m0, m1, m2, m3, _mm_loadu_ps(N[i][0]));
+		__m128 r1 = linmath_sse_mul_vec4(m0, m1, m2, m3, _mm_loadu_ps(N[i][1]));
+		__m128 r2 = linmath_sse_mul_vec4(m0, m1, m2, m3, _mm_loadu_ps(N[i][2]));
+		__m128 r3 = linmath_sse_mul_vec4(m0, m1, m2, m3, _mm_loadu_ps(N[i][3]));
+		_mm_storeu_ps(R[i][0], r0);
+		_mm_storeu_ps(R[i][1], r1);
+		_mm_storeu_ps(R[i][2], r2);
+		_mm_storeu_ps(R[i][3], r3);
+	}
+#elif defined(LINMATH_NEON)
+	float32x4_t m0 = vld1q_f32(M[0]), m1 = vld1q_f32(M[1]), m2 = vld1q_f32(M[2]), m3 = vld1q_f32(M[3]);
+	for(i=0; i<n; ++i) {
+		float32x4_t r0 = linmath_neon_mul_vec4(m0, m1, m2, m3, vld1q_f32(N[i][0]));
+		float32x4_t r1 = linmath_neon_mul_vec4(m0, m1, m2, m3, vld1q_f32(N[i][1]));
+		float32x4_t r2 = linmath_neon_mul_vec4(m0, m1, m2, m3, vld1q_f32(N[i][2]));
+		float32x4_t r3 = linmath_neon_mul_vec4(m0, m1, m2, m3, vld1q_f32(N[i][3]));
+		vst1q_f32(R[i][0], r0);
+		vst1q_f32(R[i][1], r1);
+		vst1q_f32(R[i][2], r2);
+		vst1q_f32(R[i][3], r3);
+	}
+#else
+	for(i=0; i<n; ++i)
+		mat4x4_mul(R[i], M, N[i]);
+#endif
+}
+static inline void mat4x4_mul_vec4_n(vec4 *r, mat4x4 M, vec4 *v, int n)
+{
+	int i;
+#if defined(LINMATH_SSE)
+	__m128 m0 = _mm_loadu_ps(M[0]), m1 = _mm_loadu_ps(M[1]), m2 = _mm_loadu_ps(M[2]), m3 = _mm_loadu_ps(M[3]);
+	for(i=0; i<n; ++i)
+		_mm_storeu_ps(r[i], linmath_sse_mul_vec4(m0, m1, m2, m3, _mm_loadu_ps(v[i])));
+#elif defined(LINMATH_NEON)
+	float32x4_t m0 = vld1q_f32(M[0]), m1 = vld1q_f32(M[1]), m2 = vld1q_f32(M[2]), m3 = vld1q_f32(M[3]);
+	for(i=0; i<n; ++i)
+		vst1q_f32(r[i], linmath_neon_mul_vec4(m0, m1, m2, m3, vld1q_f32(v[i])));
+#else
+	for(i=0; i<n; ++i)
+		mat4x4_mul_vec4(r[i], M, v[i]);
+#endif
 }
 static inline void mat4x4_translate(mat4x4 T, float x, float y, float z)
 {
@@ -257,6 +415,52 @@ static inline void mat4x4_rotate_Z(mat4x4 Q, mat4x4 M, float angle)
 }
 static inline void mat4x4_invert(mat4x4 T, mat4x4 M)
 {
+#if defined(LINMATH_SSE)
+	/* Blockwise, treating M as 2x2 blocks A B / C D of 2x2 matrices.  The
+	 * inverse of the transpose is the transpose of the inverse, so it comes
+	 * out the same whichever way round the blocks are read. */
+	__m128 m0 = _mm_loadu_ps(M[0]), m1 = _mm_loadu_ps(M[1]), m2 = _mm_loadu_ps(M[2]), m3 = _mm_loadu_ps(M[3]);
+	__m128 A = _mm_movelh_ps(m0, m1);
+	__m128 B = _mm_movehl_ps(m1, m0);
+	__m128 C = _mm_movelh_ps(m2, m3);
+	__m128 D = _mm_movehl_ps(m3, m2);
+
+	/* The blocks' determinants, as (|A|, |B|, |C|, |D|) */
+	__m128 det_sub = _mm_sub_ps(
+		_mm_mul_ps(LINMATH_SSE_SHUFFLE(m0, m2, 0, 2, 0, 2), LINMATH_SSE_SHUFFLE(m1, m3, 1, 3, 1, 3)),
+		_mm_mul_ps(LINMATH_SSE_SHUFFLE(m0, m2, 1, 3, 1, 3), LINMATH_SSE_SHUFFLE(m1, m3, 0, 2, 0, 2)));
+	__m128 det_A = LINMATH_SSE_SPLAT(det_sub, 0);
+	__m128 det_B = LINMATH_SSE_SPLAT(det_sub, 1);
+	__m128 det_C = LINMATH_SSE_SPLAT(det_sub, 2);
+	__m128 det_D = LINMATH_SSE_SPLAT(det_sub, 3);
+
+	/* The inverse is X Y / Z W over |M|; these are the blocks' adjugates */
+	__m128 D_C = linmath_sse_mat2_adj_mul(D, C);
+	__m128 A_B = linmath_sse_mat2_adj_mul(A, B);
+	__m128 X = _mm_sub_ps(_mm_mul_ps(det_D, A), linmath_sse_mat2_mul(B, D_C));
+	__m128 W = _mm_sub_ps(_mm_mul_ps(det_A, D), linmath_sse_mat2_mul(C, A_B));
+	__m128 Y = _mm_sub_ps(_mm_mul_ps(det_B, C), linmath_sse_mat2_mul_adj(D, A_B));
+	__m128 Z = _mm_sub_ps(_mm_mul_ps(det_C, B), linmath_sse_mat2_mul_adj(A, D_C));
+
+	/* |M| = |A||D| + |B||C| - tr(adj(A) B adj(D) C) */
+	__m128 tr = _mm_mul_ps(A_B, LINMATH_SSE_SWIZZLE(D_C, 0, 2, 1, 3));
+	__m128 det_M;
+	tr = _mm_add_ps(tr, LINMATH_SSE_SWIZZLE(tr, 2, 3, 0, 1));
+	tr = _mm_add_ps(tr, LINMATH_SSE_SWIZZLE(tr, 1, 0, 3, 2));
+	det_M = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_A, det_D), _mm_mul_ps(det_B, det_C)), tr);
+
+	/* Assumes it is invertible.  The signs turn the blocks' adjugates back
+	 * into the blocks, and the shuffles put them in place. */
+	det_M = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), det_M);
+	X = _mm_mul_ps(X, det_M);
+	Y = _mm_mul_ps(Y, det_M);
+	Z = _mm_mul_ps(Z, det_M);
+	W = _mm_mul_ps(W, det_M);
+	_mm_storeu_ps(T[0], LINMATH_SSE_SHUFFLE(X, Y, 3, 1, 3, 1));
+	_mm_storeu_ps(T[1], LINMATH_SSE_SHUFFLE(X, Y, 2, 0, 2, 0));
+	_mm_storeu_ps(T[2], LINMATH_SSE_SHUFFLE(Z, W, 3, 1, 3, 1));
+	_mm_storeu_ps(T[3], LINMATH_SSE_SHUFFLE(Z, W, 2, 0, 2, 0));
+#else
 	float s[6];
 	float c[6];
 	s[0] = M[0][0]*M[1][1] - M[1][0]*M[0][1];
@@ -295,6 +499,7 @@ static inline void mat4x4_invert(mat4x4 T, mat4x4 M)
 	T[3][1] = ( M[0][0] * c[3] - M[0][1] * c[1] + M[0][2] * c[0]) * idet;
 	T[3][2] = (-M[3][0] * s[3] + M[3][1] * s[1] - M[3][2] * s[0]) * idet;
 	T[3][3] = ( M[2][0] * s[3] - M[2][1] * s[1] + M[2][2] * s[0]) * idet;
+#endif
 }
 static inline void mat4x4_orthonormalize(mat4x4 R, mat4x4 M)
 {
@@ -440,13 +645,27 @@ static inline void quat_sub(quat r, quat a, quat b)
 }
 static inline void quat_mul(quat r, quat p, quat q)
 {
+#if defined(LINMATH_SSE)
+	/* Each of p's components times q, shuffled and with the signs the
+	 * product gives it */
+	__m128 vp = _mm_loadu_ps(p);
+	__m128 vq = _mm_loadu_ps(q);
+	__m128 x = _mm_mul_ps(_mm_mul_ps(LINMATH_SSE_SPLAT(vp, 0), LINMATH_SSE_SWIZZLE(vq, 3, 2, 1, 0)), _mm_setr_ps(1.f, -1.f, 1.f, -1.f));
+	__m128 y = _mm_mul_ps(_mm_mul_ps(LINMATH_SSE_SPLAT(vp, 1), LINMATH_SSE_SWIZZLE(vq, 2, 3, 0, 1)), _mm_setr_ps(1.f, 1.f, -1.f, -1.f));
+	__m128 z = _mm_mul_ps(_mm_mul_ps(LINMATH_SSE_SPLAT(vp, 2), LINMATH_SSE_SWIZZLE(vq, 1, 0, 3, 2)), _mm_setr_ps(-1.f, 1.f, 1.f, -1.f));
+	__m128 w = _mm_mul_ps(LINMATH_SSE_SPLAT(vp, 3), vq);
+	_mm_storeu_ps(r, _mm_add_ps(_mm_add_ps(w, x), _mm_add_ps(y, z)));
+#else
 	vec3 w;
-	vec3_mul_cross(r, p, q);
+	float r3 = p[3]*q[3] - vec3_mul_inner(p, q);
+	vec3 c;
+	vec3_mul_cross(c, p, q);
 	vec3_scale(w, p, q[3]);
-	vec3_add(r, r, w);
+	vec3_add(c, c, w);
 	vec3_scale(w, q, p[3]);
-	vec3_add(r, r, w);
-	r[3] = p[3]*q[3] - vec3_mul_inner(p, q);
+	vec3_add(r, c, w);
+	r[3] = r3;
+#endif
 }
 static inline void quat_scale(quat r, quat v, float s)
 {
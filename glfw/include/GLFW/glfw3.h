@@ -672,6 +672,8 @@ extern "C" {
 #define GLFW_CURSOR                 0x00033001
 #define GLFW_STICKY_KEYS            0x00033002
 #define GLFW_STICKY_MOUSE_BUTTONS   0x00033003
+#define GLFW_EVENT_QUEUE            0x00033004
+#define GLFW_RAW_MOUSE_MOTION       0x00033005
 
 #define GLFW_CURSOR_NORMAL          0x00034001
 #define GLFW_CURSOR_HIDDEN          0x00034002
@@ -684,6 +686,13 @@ extern "C" {
 #define GLFW_NATIVE_CONTEXT_API     0x00036001
 #define GLFW_EGL_CONTEXT_API        0x00036002
 
+#define GLFW_EVENT_KEY              0x00037001
+#define GLFW_EVENT_CHAR             0x00037002
+#define GLFW_EVENT_MOUSE_BUTTON     0x00037003
+#define GLFW_EVENT_CURSOR_POS       0x00037004
+#define GLFW_EVENT_CURSOR_ENTER     0x00037005
+#define GLFW_EVENT_SCROLL           0x00037006
+
 /*! @defgroup shapes Standard cursor shapes
  *
  *  See [standard cursor creation](@ref cursor_standard) for how these are used.
@@ -882,6 +891,21 @@ typedef void (* GLFWwindowclosefun)(GLFWwindow*);
  */
 typedef void (* GLFWwindowrefreshfun)(GLFWwindow*);
 
+/*! @brief The function signature for window frame request callbacks.
+ *
+ *  This is the function signature for window frame callback functions.
+ *
+ *  @param[in] window The window that should render a new frame.
+ *
+ *  @sa @ref window_frame
+ *  @sa glfwSetWindowFrameCallback
+ *
+ *  @since Added in version 3.2.
+ *
+ *  @ingroup window
+ */
+typedef void (* GLFWwindowframefun)(GLFWwindow*);
+
 /*! @brief The function signature for window focus/defocus callbacks.
  *
  *  This is the function signature for window focus callback functions.
@@ -1199,6 +1223,62 @@ typedef struct GLFWimage
     unsigned char* pixels;
 } GLFWimage;
 
+/*! @brief Input event.
+ *
+ *  This describes an input event taken from the input event queue of a window.
+ *  Only the members that apply to the type of the event are set, and the rest
+ *  are zero.
+ *
+ *  @sa @ref input_queue
+ *  @sa glfwGetInputEvents
+ *
+ *  @since Added in version 3.2.
+ *
+ *  @ingroup input
+ */
+typedef struct GLFWinputevent
+{
+    /*! The type of the event, one of `GLFW_EVENT_KEY`, `GLFW_EVENT_CHAR`,
+     *  `GLFW_EVENT_MOUSE_BUTTON`, `GLFW_EVENT_CURSOR_POS`,
+     *  `GLFW_EVENT_CURSOR_ENTER` or `GLFW_EVENT_SCROLL`.
+     */
+    int type;
+    /*! When the event happened, in seconds, in the same timebase as @ref
+     *  glfwGetTime.
+     */
+    double time;
+    /*! The [keyboard key](@ref keys) of a key event.
+     */
+    int key;
+    /*! The system-specific scancode of a key event.
+     */
+    int scancode;
+    /*! The [mouse button](@ref buttons) of a mouse button event.
+     */
+    int button;
+    /*! `GLFW_PRESS`, `GLFW_RELEASE` or `GLFW_REPEAT` for a key event,
+     *  `GLFW_PRESS` or `GLFW_RELEASE` for a mouse button event, or `GLFW_TRUE`
+     *  if the cursor entered the client area and `GLFW_FALSE` if it left it for
+     *  a cursor enter event.
+     */
+    int action;
+    /*! Bit field describing which [modifier keys](@ref mods) were held down,
+     *  for a key, character or mouse button event.
+     */
+    int mods;
+    /*! The Unicode code point of a character event.
+     */
+    unsigned int codepoint;
+    /*! The new cursor x-coordinate of a cursor position event, or the scroll
+     *  offset along the x-axis of a scroll event.
+     */
+    double x;
+    /*! The new cursor y-coordinate of a cursor position event, or the scroll
+     *  offset along the y-axis of a scroll event.
+     */
+    double y;
+} GLFWinputevent;
+
 
 /*************************************************************************
  * GLFW API functions
@@ -2643,6 +2723,43 @@ GLFWAPI GLFWwindowclosefun glfwSetWindowCloseCallback(GLFWwindow* window, GLFWwi
  */
 GLFWAPI GLFWwindowrefreshfun glfwSetWindowRefreshCallback(GLFWwindow* window, GLFWwindowrefreshfun cbfun);
 
+/*! @brief Sets the frame request callback for the specified window.
+ *
+ *  This function sets the frame callback of the specified window, which is
+ *  called when the window system wants a new frame of the window.  Rendering
+ *  and swapping buffers once each time it is called, and not otherwise, paces
+ *  rendering to what the window system can show.
+ *
+ *  The callback is first called by the next event processing function after it
+ *  is set, and then after each @ref glfwSwapBuffers of the window, once the
+ *  window system wants the next frame.  On Wayland this is when the compositor
+ *  asks for it, which it does not do while the window is hidden or not visible
+ *  on any output.  On other platforms it is as soon as events are next
+ *  processed, unless the window is hidden or iconified.  In both cases, @ref
+ *  glfwWaitEvents returns when the frame is requested, so a main loop of just
+ *  @ref glfwWaitEvents renders only when frames are requested.
+ *
+ *  @param[in] window The window whose callback to set.
+ *  @param[in] cbfun The new callback, or `NULL` to remove the currently set
+ *  callback.
+ *  @return The previously set callback, or `NULL` if no callback was set or the
+ *  library had not been [initialized](@ref intro_init).
+ *
+ *  @errors Possible errors include @ref GLFW_NOT_INITIALIZED.
+ *
+ *  @thread_safety This function must only be called from the main thread.
+ *  While a frame callback is set, the buffers of the window must also only be
+ *  swapped from the main thread.
+ *
+ *  @sa @ref window_frame
+ *  @sa glfwGetFrameTiming
+ *
+ *  @since Added in version 3.2.
+ *
+ *  @ingroup window
+ */
+GLFWAPI GLFWwindowframefun glfwSetWindowFrameCallback(GLFWwindow* window, GLFWwindowframefun cbfun);
+
 /*! @brief Sets the focus callback for the specified window.
  *
  *  This function sets the focus callback of the specified window, which is
@@ -2869,12 +2986,12 @@ GLFWAPI void glfwPostEmptyEvent(void);
 /*! @brief Returns the value of an input option for the specified window.
  *
  *  This function returns the value of an input option for the specified window.
- *  The mode must be one of `GLFW_CURSOR`, `GLFW_STICKY_KEYS` or
- *  `GLFW_STICKY_MOUSE_BUTTONS`.
+ *  The mode must be one of `GLFW_CURSOR`, `GLFW_STICKY_KEYS`,
+ *  `GLFW_STICKY_MOUSE_BUTTONS`, `GLFW_EVENT_QUEUE` or `GLFW_RAW_MOUSE_MOTION`.
  *
  *  @param[in] window The window to query.
- *  @param[in] mode One of `GLFW_CURSOR`, `GLFW_STICKY_KEYS` or
- *  `GLFW_STICKY_MOUSE_BUTTONS`.
+ *  @param[in] mode One of `GLFW_CURSOR`, `GLFW_STICKY_KEYS`,
+ *  `GLFW_STICKY_MOUSE_BUTTONS`, `GLFW_EVENT_QUEUE` or `GLFW_RAW_MOUSE_MOTION`.
  *
  *  @errors Possible errors include @ref GLFW_NOT_INITIALIZED and @ref
  *  GLFW_INVALID_ENUM.
@@ -2892,8 +3009,8 @@ GLFWAPI int glfwGetInputMode(GLFWwindow* window, int mode);
 /*! @brief Sets an input option for the specified window.
  *
  *  This function sets an input mode option for the specified window.  The mode
- *  must be one of `GLFW_CURSOR`, `GLFW_STICKY_KEYS` or
- *  `GLFW_STICKY_MOUSE_BUTTONS`.
+ *  must be one of `GLFW_CURSOR`, `GLFW_STICKY_KEYS`,
+ *  `GLFW_STICKY_MOUSE_BUTTONS`, `GLFW_EVENT_QUEUE` or `GLFW_RAW_MOUSE_MOTION`.
  *
  *  If the mode is `GLFW_CURSOR`, the value must be one of the following cursor
  *  modes:
@@ -2919,13 +3036,30 @@ GLFWAPI int glfwGetInputMode(GLFWwindow* window, int mode);
  *  you are only interested in whether mouse buttons have been pressed but not
  *  when or in which order.
  *
+ *  If the mode is `GLFW_EVENT_QUEUE`, the value must be either `GLFW_TRUE` to
+ *  enable the input event queue, or `GLFW_FALSE` to disable it.  While the
+ *  queue is enabled, key, character, mouse button, cursor position, cursor
+ *  enter/leave and scroll events are added to it, with when they happened,
+ *  instead of being passed to their callbacks, and another thread can take
+ *  them with @ref glfwGetInputEvents.  Disabling the queue discards any events
+ *  still in it.
+ *
+ *  If the mode is `GLFW_RAW_MOUSE_MOTION`, the value must be either `GLFW_TRUE`
+ *  to enable raw (unscaled and unaccelerated) mouse motion when the cursor is
+ *  disabled, or `GLFW_FALSE` to disable it.  Raw motion is reported through the
+ *  cursor position callback and the input event queue like other cursor
+ *  motion, one event per motion reported by the device, and the cursor is not
+ *  warped back to the window each time events are processed.  If raw motion is
+ *  not supported, attempting to set this will emit @ref GLFW_PLATFORM_ERROR.
+ *  Call @ref glfwRawMouseMotionSupported to check for support.
+ *
  *  @param[in] window The window whose input mode to set.
- *  @param[in] mode One of `GLFW_CURSOR`, `GLFW_STICKY_KEYS` or
- *  `GLFW_STICKY_MOUSE_BUTTONS`.
+ *  @param[in] mode One of `GLFW_CURSOR`, `GLFW_STICKY_KEYS`,
+ *  `GLFW_STICKY_MOUSE_BUTTONS`, `GLFW_EVENT_QUEUE` or `GLFW_RAW_MOUSE_MOTION`.
  *  @param[in] value The new value of the specified input mode.
  *
  *  @errors Possible errors include @ref GLFW_NOT_INITIALIZED, @ref
- *  GLFW_INVALID_ENUM and @ref GLFW_PLATFORM_ERROR.
+ *  GLFW_INVALID_ENUM, @ref GLFW_OUT_OF_MEMORY and @ref GLFW_PLATFORM_ERROR.
  *
  *  @thread_safety This function must only be called from the main thread.
  *
@@ -2937,6 +3071,70 @@ GLFWAPI int glfwGetInputMode(GLFWwindow* window, int mode);
  */
 GLFWAPI void glfwSetInputMode(GLFWwindow* window, int mode, int value);
 
+/*! @brief Takes events from the input event queue of the specified window.
+ *
+ *  This function moves up to `count` of the oldest events in the input event
+ *  queue of the specified window into the `events` array, and returns how many
+ *  it moved.  Events are only queued while the `GLFW_EVENT_QUEUE` input mode is
+ *  enabled, and if the queue fills up, new events are dropped until some are
+ *  taken, so take them at least once a frame.
+ *
+ *  Each event has the time it happened, according to the window system where
+ *  it says, which it does on X11, and otherwise when it was processed by @ref
+ *  glfwPollEvents or a similar function.
+ *
+ *  @param[in] window The window whose events to take.
+ *  @param[out] events Where to store the events.
+ *  @param[in] count The size of the `events` array.
+ *  @return The number of events stored, or zero if there were none or an
+ *  [error](@ref error_handling) occurred.
+ *
+ *  @errors Possible errors include @ref GLFW_NOT_INITIALIZED.
+ *
+ *  @thread_safety This function may be called from any thread, but only from
+ *  one thread at a time for a given window.  The window must not be destroyed
+ *  and its input event queue must not be disabled while it is running.
+ *
+ *  @sa @ref input_queue
+ *  @sa glfwSetInputMode
+ *
+ *  @since Added in version 3.2.
+ *
+ *  @ingroup input
+ */
+GLFWAPI int glfwGetInputEvents(GLFWwindow* window, GLFWinputevent* events, int count);
+
+/*! @brief Returns whether raw mouse motion is supported.
+ *
+ *  This function returns whether raw mouse motion is supported on the current
+ *  system.  This status does not change after GLFW has been initialized so you
+ *  only need to check this once.  If you attempt to enable raw motion on
+ *  a system that does not support it, @ref GLFW_PLATFORM_ERROR will be emitted.
+ *
+ *  Raw mouse motion is closer to the actual motion of the mouse across
+ *  a surface.  It is not affected by the scaling and acceleration applied to
+ *  the motion of the desktop cursor.  That processing is suitable for a cursor
+ *  while raw motion is better for controlling for example a 3D camera.  Because
+ *  of this, raw mouse motion is only provided when the cursor is disabled.
+ *
+ *  @return `GLFW_TRUE` if raw mouse motion is supported on the current machine,
+ *  or `GLFW_FALSE` otherwise.
+ *
+ *  @errors Possible errors include @ref GLFW_NOT_INITIALIZED.
+ *
+ *  @remark This is currently only supported on X11 with the XInput2 extension.
+ *
+ *  @thread_safety This function must only be called from the main thread.
+ *
+ *  @sa @ref raw_mouse_motion
+ *  @sa glfwSetInputMode
+ *
+ *  @since Added in version 3.2.
+ *
+ *  @ingroup input
+ */
+GLFWAPI int glfwRawMouseMotionSupported(void);
+
 /*! @brief Returns the localized name of the specified printable key.
  *
  *  This function returns the localized name of the specified printable key.
@@ -3895,7 +4093,8 @@ GLFWAPI void glfwSwapBuffers(GLFWwindow* window);
  *  which allow the driver to swap even if a frame arrives a little bit late.
  *  You can check for the presence of these extensions using @ref
  *  glfwExtensionSupported.  For more information about swap tearing, see the
- *  extension specifications.
+ *  extension specifications.  On other contexts, a negative swap interval is
+ *  treated as its absolute value.
  *
  *  A context must be current on the calling thread.  Calling this function
  *  without a current context will cause a @ref GLFW_NO_CURRENT_CONTEXT error.
@@ -3929,6 +4128,54 @@ GLFWAPI void glfwSwapBuffers(GLFWwindow* window);
  */
 GLFWAPI void glfwSwapInterval(int interval);
 
+/*! @brief Retrieves when the last frame of the specified window was presented.
+ *
+ *  This function retrieves the time, in seconds on the GLFW timer, at which the
+ *  most recently completed buffer swap of the specified window became visible,
+ *  and the refresh period of the display showing it.  Subsequent refreshes
+ *  happen a whole number of periods later, which can be used to pace frames and
+ *  to start time-critical work just before the next one.
+ *
+ *  If presentation timing is not available, this function returns `GLFW_FALSE`
+ *  and sets both times to zero.
+ *
+ *  @param[in] window The window whose frame timing to retrieve.
+ *  @param[out] present Where to store the time the last frame was presented,
+ *  or `NULL`.
+ *  @param[out] period Where to store the refresh period, in seconds, or `NULL`.
+ *  @return `GLFW_TRUE` if the timing was retrieved, or `GLFW_FALSE` otherwise.
+ *
+ *  @errors Possible errors include @ref GLFW_NOT_INITIALIZED and @ref
+ *  GLFW_NO_WINDOW_CONTEXT.
+ *
+ *  @remark @x11 This requires the `GLX_OML_sync_control` extension.  If no
+ *  swap has completed yet, this function waits for the first one.
+ *
+ *  @remark @win32 This is the timing of the desktop compositor, so it is only
+ *  available for windowed mode windows while desktop composition is enabled.
+ *  The present time is that of the last vertical blank.
+ *
+ *  @remark @osx Presentation timing is not available.
+ *
+ *  @remark @wayland This requires the compositor to support the
+ *  `wp_presentation` protocol.  The timing is that of the last frame the
+ *  compositor reported as presented.
+ *
+ *  @remark Presentation timing is not available for EGL contexts on other
+ *  platforms.
+ *
+ *  @thread_safety This function may be called from any thread.
+ *
+ *  @sa @ref buffer_swap
+ *  @sa glfwSwapBuffers
+ *  @sa glfwSwapInterval
+ *
+ *  @since Added in version 3.2.
+ *
+ *  @ingroup context
+ */
+GLFWAPI int glfwGetFrameTiming(GLFWwindow* window, double* present, double* period);
+
 /*! @brief Returns whether the specified extension is available.
  *
  *  This function returns whether the specified
@@ -602,6 +602,14 @@ GLFWAPI void glfwSwapBuffers(GLFWwindow* handle)
         return;
     }
 
+    // The request for the next frame has to go with this one on some window
+    // systems, and without one the next frame is wanted straight away
+    if (window->callbacks.frame)
+    {
+        if (!_glfwPlatformRequestWindowFrame(window))
+            window->framePending = GLFW_TRUE;
+    }
+
     window->context.swapBuffers(window);
 }
 
@@ -621,6 +629,42 @@ GLFWAPI void glfwSwapInterval(int interval)
     window->context.swapInterval(interval);
 }
 
+GLFWAPI int glfwGetFrameTiming(GLFWwindow* handle, double* present, double* period)
+{
+    _GLFWwindow* window = (_GLFWwindow*) handle;
+    uint64_t presentValue, periodValue;
+    assert(window != NULL);
+
+    if (present)
+        *present = 0.0;
+    if (period)
+        *period = 0.0;
+
+    _GLFW_REQUIRE_INIT_OR_RETURN(GLFW_FALSE);
+
+    if (window->context.client == GLFW_NO_API)
+    {
+        _glfwInputError(GLFW_NO_WINDOW_CONTEXT, NULL);
+        return GLFW_FALSE;
+    }
+
+    if (!window->context.getFrameTiming)
+        return GLFW_FALSE;
+
+    if (!window->context.getFrameTiming(window, &presentValue, &periodValue))
+        return GLFW_FALSE;
+
+    if (present)
+    {
+        *present = (double) (int64_t) (presentValue - _glfw.timerOffset) /
+            _glfwPlatformGetTimerFrequency();
+    }
+    if (period)
+        *period = (double) periodValue / _glfwPlatformGetTimerFrequency();
+
+    return GLFW_TRUE;
+}
+
 GLFWAPI int glfwExtensionSupported(const char* extension)
 {
     _GLFWwindow* window;
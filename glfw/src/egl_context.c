@@ -215,7 +215,8 @@ static void swapBuffers(_GLFWwindow* window)
 
 static void swapInterval(int interval)
 {
-    eglSwapInterval(_glfw.egl.display, interval);
+    // There is no late swap tearing with EGL, so adaptive vsync is just vsync
+    eglSwapInterval(_glfw.egl.display, abs(interval));
 }
 
 static int extensionSupported(const char* extension)
@@ -171,12 +171,17 @@ static void makeContextCurrent(_GLFWwindow* window)
 static void swapBuffers(_GLFWwindow* window)
 {
     glXSwapBuffers(_glfw.x11.display, window->context.glx.window);
+    window->context.glx.swapped = GLFW_TRUE;
 }
 
 static void swapInterval(int interval)
 {
     _GLFWwindow* window = _glfwPlatformGetCurrentContext();
 
+    // Without late swap tearing, adaptive vsync is just vsync
+    if (interval < 0 && !_glfw.glx.EXT_swap_control_tear)
+        interval = -interval;
+
     if (_glfw.glx.EXT_swap_control)
     {
         _glfw.glx.SwapIntervalEXT(_glfw.x11.display,
@@ -192,6 +197,40 @@ static void swapInterval(int interval)
     }
 }
 
+static GLFWbool getFrameTiming(_GLFWwindow* window,
+                               uint64_t* present, uint64_t* period)
+{
+    int64_t ust, msc, sbc;
+    int32_t numerator, denominator;
+
+    // NOTE: UST is taken to be CLOCK_MONOTONIC in microseconds, as it is with
+    //       both Mesa and the NVIDIA driver
+    if (!_glfw.glx.OML_sync_control || !_glfw.posix_time.monotonic)
+        return GLFW_FALSE;
+
+    if (!window->context.glx.swapped)
+        return GLFW_FALSE;
+
+    // Waiting for the first swap returns at once if any swap has completed,
+    // with when the most recent one was presented
+    if (!_glfw.glx.WaitForSbcOML(_glfw.x11.display, window->context.glx.window,
+                                 1, &ust, &msc, &sbc))
+    {
+        return GLFW_FALSE;
+    }
+
+    if (!_glfw.glx.GetMscRateOML(_glfw.x11.display, window->context.glx.window,
+                                 &numerator, &denominator) ||
+        numerator <= 0 || denominator <= 0)
+    {
+        return GLFW_FALSE;
+    }
+
+    *present = (uint64_t) ust * 1000;
+    *period = (uint64_t) denominator * 1000000000 / (uint64_t) numerator;
+    return GLFW_TRUE;
+}
+
 static int extensionSupported(const char* extension)
 {
     const char* extensions =
@@ -328,6 +367,9 @@ GLFWbool _glfwInitGLX(void)
             _glfw.glx.EXT_swap_control = GLFW_TRUE;
     }
 
+    if (extensionSupported("GLX_EXT_swap_control_tear"))
+        _glfw.glx.EXT_swap_control_tear = GLFW_TRUE;
+
     if (extensionSupported("GLX_SGI_swap_control"))
     {
         _glfw.glx.SwapIntervalSGI = (PFNGLXSWAPINTERVALSGIPROC)
@@ -346,6 +388,17 @@ GLFWbool _glfwInitGLX(void)
             _glfw.glx.MESA_swap_control = GLFW_TRUE;
     }
 
+    if (extensionSupported("GLX_OML_sync_control"))
+    {
+        _glfw.glx.GetMscRateOML = (PFNGLXGETMSCRATEOMLPROC)
+            getProcAddress("glXGetMscRateOML");
+        _glfw.glx.WaitForSbcOML = (PFNGLXWAITFORSBCOMLPROC)
+            getProcAddress("glXWaitForSbcOML");
+
+        if (_glfw.glx.GetMscRateOML && _glfw.glx.WaitForSbcOML)
+            _glfw.glx.OML_sync_control = GLFW_TRUE;
+    }
+
     if (extensionSupported("GLX_ARB_multisample"))
         _glfw.glx.ARB_multisample = GLFW_TRUE;
 
@@ -575,6 +628,7 @@ GLFWbool _glfwCreateContextGLX(_GLFWwindow* window,
     window->context.makeCurrent = makeContextCurrent;
     window->context.swapBuffers = swapBuffers;
     window->context.swapInterval = swapInterval;
+    window->context.getFrameTiming = getFrameTiming;
     window->context.extensionSupported = extensionSupported;
     window->context.getProcAddress = getProcAddress;
     window->context.destroy = destroyContext;
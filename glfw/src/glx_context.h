@@ -88,6 +88,8 @@ typedef __GLXextproc (* PFNGLXGETPROCADDRESSPROC) (const GLubyte *procName);
 typedef int (*PFNGLXSWAPINTERVALMESAPROC)(int);
 typedef int (*PFNGLXSWAPINTERVALSGIPROC)(int);
 typedef void (*PFNGLXSWAPINTERVALEXTPROC)(Display*,GLXDrawable,int);
+typedef Bool (*PFNGLXGETMSCRATEOMLPROC)(Display*,GLXDrawable,int32_t*,int32_t*);
+typedef Bool (*PFNGLXWAITFORSBCOMLPROC)(Display*,GLXDrawable,int64_t,int64_t*,int64_t*,int64_t*);
 typedef GLXContext (*PFNGLXCREATECONTEXTATTRIBSARBPROC)(Display*,GLXFBConfig,GLXContext,Bool,const int*);
 typedef XVisualInfo* (*PFNGLXGETVISUALFROMFBCONFIGPROC)(Display*,GLXFBConfig);
 typedef GLXWindow (*PFNGLXCREATEWINDOWPROC)(Display*,GLXFBConfig,Window,const int*);
@@ -118,6 +120,8 @@ typedef struct _GLFWcontextGLX
 {
     GLXContext      handle;
     GLXWindow       window;
+    // Whether the buffers have been swapped at least once
+    GLFWbool        swapped;
 
 } _GLFWcontextGLX;
 
@@ -154,10 +158,14 @@ typedef struct _GLFWlibraryGLX
     PFNGLXSWAPINTERVALSGIPROC           SwapIntervalSGI;
     PFNGLXSWAPINTERVALEXTPROC           SwapIntervalEXT;
     PFNGLXSWAPINTERVALMESAPROC          SwapIntervalMESA;
+    PFNGLXGETMSCRATEOMLPROC             GetMscRateOML;
+    PFNGLXWAITFORSBCOMLPROC             WaitForSbcOML;
     PFNGLXCREATECONTEXTATTRIBSARBPROC   CreateContextAttribsARB;
     GLFWbool        SGI_swap_control;
     GLFWbool        EXT_swap_control;
+    GLFWbool        EXT_swap_control_tear;
     GLFWbool        MESA_swap_control;
+    GLFWbool        OML_sync_control;
     GLFWbool        ARB_multisample;
     GLFWbool        ARB_framebuffer_sRGB;
     GLFWbool        EXT_framebuffer_sRGB;
@@ -30,15 +30,61 @@
 #include <assert.h>
 #include <float.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+ #include <intrin.h>
+#endif
 
 // Internal key state used for sticky keys
 #define _GLFW_STICK 3
 
+// Number of slots in an input event queue, which must be a power of two
+#define _GLFW_EVENT_QUEUE_SIZE 1024
+
+// Accesses to the head and tail indices of an input event queue that the other
+// thread may be accessing, ordered so that an event is written before it is
+// published and read before its slot is given back
+#if defined(_MSC_VER)
+ #define _GLFW_LOAD_ACQUIRE(p) _InterlockedOr((volatile long*) (p), 0)
+ #define _GLFW_STORE_RELEASE(p, v) _InterlockedExchange((volatile long*) (p), (v))
+#else
+ #define _GLFW_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+ #define _GLFW_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+// Adds an event to the input event queue of the specified window, or drops it
+// if the queue is full
+//
+static void queueEvent(_GLFWwindow* window, GLFWinputevent* event)
+{
+    const long head = window->eventHead;
+    const long next = (head + 1) & (_GLFW_EVENT_QUEUE_SIZE - 1);
+    uint64_t time = _glfw.eventTime;
+
+    if (next == _GLFW_LOAD_ACQUIRE(&window->eventTail))
+        return;
+
+    if (!time)
+        time = _glfwPlatformGetTimerValue();
+
+    event->time = (double) (int64_t) (time - _glfw.timerOffset) /
+        _glfwPlatformGetTimerFrequency();
+
+    window->events[head] = *event;
+    _GLFW_STORE_RELEASE(&window->eventHead, next);
+}
+
 
 //////////////////////////////////////////////////////////////////////////
 //////                         GLFW event API                       //////
 //////////////////////////////////////////////////////////////////////////
 
+void _glfwInputEventTime(uint64_t time)
+{
+    _glfw.eventTime = time;
+}
+
 void _glfwInputKey(_GLFWwindow* window, int key, int scancode, int action, int mods)
 {
     if (key >= 0 && key <= GLFW_KEY_LAST)
@@ -60,6 +106,19 @@ void _glfwInputKey(_GLFWwindow* window, int key, int scancode, int action, int m
             action = GLFW_REPEAT;
     }
 
+    if (window->events)
+    {
+        GLFWinputevent event;
+        memset(&event, 0, sizeof(event));
+        event.type = GLFW_EVENT_KEY;
+        event.key = key;
+        event.scancode = scancode;
+        event.action = action;
+        event.mods = mods;
+        queueEvent(window, &event);
+        return;
+    }
+
     if (window->callbacks.key)
         window->callbacks.key((GLFWwindow*) window, key, scancode, action, mods);
 }
@@ -69,6 +128,17 @@ void _glfwInputChar(_GLFWwindow* window, unsigned int codepoint, int mods, GLFWb
     if (codepoint < 32 || (codepoint > 126 && codepoint < 160))
         return;
 
+    if (window->events)
+    {
+        GLFWinputevent event;
+        memset(&event, 0, sizeof(event));
+        event.type = GLFW_EVENT_CHAR;
+        event.codepoint = codepoint;
+        event.mods = mods;
+        queueEvent(window, &event);
+        return;
+    }
+
     if (window->callbacks.charmods)
         window->callbacks.charmods((GLFWwindow*) window, codepoint, mods);
 
@@ -81,6 +151,17 @@ void _glfwInputChar(_GLFWwindow* window, unsigned int codepoint, int mods, GLFWb
 
 void _glfwInputScroll(_GLFWwindow* window, double xoffset, double yoffset)
 {
+    if (window->events)
+    {
+        GLFWinputevent event;
+        memset(&event, 0, sizeof(event));
+        event.type = GLFW_EVENT_SCROLL;
+        event.x = xoffset;
+        event.y = yoffset;
+        queueEvent(window, &event);
+        return;
+    }
+
     if (window->callbacks.scroll)
         window->callbacks.scroll((GLFWwindow*) window, xoffset, yoffset);
 }
@@ -96,6 +177,18 @@ void _glfwInputMouseClick(_GLFWwindow* window, int button, int action, int mods)
     else
         window->mouseButtons[button] = (char) action;
 
+    if (window->events)
+    {
+        GLFWinputevent event;
+        memset(&event, 0, sizeof(event));
+        event.type = GLFW_EVENT_MOUSE_BUTTON;
+        event.button = button;
+        event.action = action;
+        event.mods = mods;
+        queueEvent(window, &event);
+        return;
+    }
+
     if (window->callbacks.mouseButton)
         window->callbacks.mouseButton((GLFWwindow*) window, button, action, mods);
 }
@@ -108,12 +201,33 @@ void _glfwInputCursorPos(_GLFWwindow* window, double xpos, double ypos)
     window->virtualCursorPosX = xpos;
     window->virtualCursorPosY = ypos;
 
+    if (window->events)
+    {
+        GLFWinputevent event;
+        memset(&event, 0, sizeof(event));
+        event.type = GLFW_EVENT_CURSOR_POS;
+        event.x = xpos;
+        event.y = ypos;
+        queueEvent(window, &event);
+        return;
+    }
+
     if (window->callbacks.cursorPos)
         window->callbacks.cursorPos((GLFWwindow*) window, xpos, ypos);
 }
 
 void _glfwInputCursorEnter(_GLFWwindow* window, GLFWbool entered)
 {
+    if (window->events)
+    {
+        GLFWinputevent event;
+        memset(&event, 0, sizeof(event));
+        event.type = GLFW_EVENT_CURSOR_ENTER;
+        event.action = entered;
+        queueEvent(window, &event);
+        return;
+    }
+
     if (window->callbacks.cursorEnter)
         window->callbacks.cursorEnter((GLFWwindow*) window, entered);
 }
@@ -162,6 +276,10 @@ GLFWAPI int glfwGetInputMode(GLFWwindow* handle, int mode)
             return window->stickyKeys;
         case GLFW_STICKY_MOUSE_BUTTONS:
             return window->stickyMouseButtons;
+        case GLFW_EVENT_QUEUE:
+            return window->events != NULL;
+        case GLFW_RAW_MOUSE_MOTION:
+            return window->rawMouseMotion;
         default:
             _glfwInputError(GLFW_INVALID_ENUM, "Invalid input mode %i", mode);
             return 0;
@@ -245,11 +363,88 @@ GLFWAPI void glfwSetInputMode(GLFWwindow* handle, int mode, int value)
             window->stickyMouseButtons = value ? GLFW_TRUE : GLFW_FALSE;
             return;
         }
+
+        case GLFW_EVENT_QUEUE:
+        {
+            if ((window->events != NULL) == (value != 0))
+                return;
+
+            if (value)
+            {
+                window->events = calloc(_GLFW_EVENT_QUEUE_SIZE,
+                                        sizeof(GLFWinputevent));
+                if (!window->events)
+                {
+                    _glfwInputError(GLFW_OUT_OF_MEMORY,
+                                    "Failed to allocate input event queue");
+                    return;
+                }
+
+                window->eventHead = window->eventTail = 0;
+            }
+            else
+            {
+                free(window->events);
+                window->events = NULL;
+            }
+
+            return;
+        }
+
+        case GLFW_RAW_MOUSE_MOTION:
+        {
+            if (!_glfwPlatformRawMouseMotionSupported())
+            {
+                _glfwInputError(GLFW_PLATFORM_ERROR,
+                                "Raw mouse motion is not supported on this system");
+                return;
+            }
+
+            value = value ? GLFW_TRUE : GLFW_FALSE;
+            if (window->rawMouseMotion == value)
+                return;
+
+            window->rawMouseMotion = value;
+            _glfwPlatformSetRawMouseMotion(window, value);
+            return;
+        }
     }
 
     _glfwInputError(GLFW_INVALID_ENUM, "Invalid input mode %i", mode);
 }
 
+GLFWAPI int glfwGetInputEvents(GLFWwindow* handle, GLFWinputevent* events, int count)
+{
+    _GLFWwindow* window = (_GLFWwindow*) handle;
+    long head, tail;
+    int taken = 0;
+    assert(window != NULL);
+    assert(events != NULL || count == 0);
+
+    _GLFW_REQUIRE_INIT_OR_RETURN(0);
+
+    if (!window->events)
+        return 0;
+
+    head = _GLFW_LOAD_ACQUIRE(&window->eventHead);
+    tail = window->eventTail;
+
+    while (tail != head && taken < count)
+    {
+        events[taken++] = window->events[tail];
+        tail = (tail + 1) & (_GLFW_EVENT_QUEUE_SIZE - 1);
+    }
+
+    _GLFW_STORE_RELEASE(&window->eventTail, tail);
+    return taken;
+}
+
+GLFWAPI int glfwRawMouseMotionSupported(void)
+{
+    _GLFW_REQUIRE_INIT_OR_RETURN(GLFW_FALSE);
+    return _glfwPlatformRawMouseMotionSupported();
+}
+
 GLFWAPI const char* glfwGetKeyName(int key, int scancode)
 {
     _GLFW_REQUIRE_INIT_OR_RETURN(NULL);
@@ -47,6 +47,16 @@
 #define GLFW_INCLUDE_NONE
 #include "../include/GLFW/glfw3.h"
 
+#if defined(_GLFW_USE_NATIVE_TLS)
+ #if defined(_MSC_VER)
+  #define _GLFW_THREAD_LOCAL __declspec(thread)
+ #elif defined(__GNUC__)
+  #define _GLFW_THREAD_LOCAL __thread
+ #else
+  #define _GLFW_THREAD_LOCAL _Thread_local
+ #endif
+#endif
+
 typedef int GLFWbool;
 
 typedef struct _GLFWwndconfig   _GLFWwndconfig;
@@ -61,6 +71,7 @@ typedef struct _GLFWcursor      _GLFWcursor;
 typedef void (* _GLFWmakecontextcurrentfun)(_GLFWwindow*);
 typedef void (* _GLFWswapbuffersfun)(_GLFWwindow*);
 typedef void (* _GLFWswapintervalfun)(int);
+typedef GLFWbool (* _GLFWgetframetimingfun)(_GLFWwindow*,uint64_t*,uint64_t*);
 typedef int (* _GLFWextensionsupportedfun)(const char*);
 typedef GLFWglproc (* _GLFWgetprocaddressfun)(const char*);
 typedef void (* _GLFWdestroycontextfun)(_GLFWwindow*);
@@ -327,6 +338,8 @@ struct _GLFWcontext
     _GLFWmakecontextcurrentfun  makeCurrent;
     _GLFWswapbuffersfun         swapBuffers;
     _GLFWswapintervalfun        swapInterval;
+    // This is NULL if the context API cannot tell when frames are presented
+    _GLFWgetframetimingfun      getFrameTiming;
     _GLFWextensionsupportedfun  extensionSupported;
     _GLFWgetprocaddressfun      getProcAddress;
     _GLFWdestroycontextfun      destroy;
@@ -362,10 +375,21 @@ struct _GLFWwindow
     GLFWbool            stickyKeys;
     GLFWbool            stickyMouseButtons;
     int                 cursorMode;
+    GLFWbool            rawMouseMotion;
     char                mouseButtons[GLFW_MOUSE_BUTTON_LAST + 1];
     char                keys[GLFW_KEY_LAST + 1];
     // Virtual cursor position when cursor is disabled
     double              virtualCursorPosX, virtualCursorPosY;
+    // Input event queue, added to by the main thread and taken from by one
+    // other thread, or NULL if the GLFW_EVENT_QUEUE input mode is disabled
+    GLFWinputevent*     events;
+    long                eventHead, eventTail;
+
+    // Whether a frame has been requested for the window by shared code, which
+    // stands in for window systems that do not request frames themselves
+    GLFWbool            framePending;
+    // Whether the window is iconified, as last reported by the window system
+    GLFWbool            iconified;
 
     _GLFWcontext        context;
 
@@ -374,6 +398,7 @@ struct _GLFWwindow
         GLFWwindowsizefun       size;
         GLFWwindowclosefun      close;
         GLFWwindowrefreshfun    refresh;
+        GLFWwindowframefun      frame;
         GLFWwindowfocusfun      focus;
         GLFWwindowiconifyfun    iconify;
         GLFWframebuffersizefun  fbsize;
@@ -445,6 +470,9 @@ struct _GLFWlibrary
     int                 monitorCount;
 
     uint64_t            timerOffset;
+    // When the event being reported happened, as a timer value, or zero if the
+    // platform doesn't know
+    uint64_t            eventTime;
 
     struct {
         GLFWbool        available;
@@ -536,6 +564,18 @@ void _glfwPlatformSetCursorPos(_GLFWwindow* window, double xpos, double ypos);
  */
 void _glfwPlatformSetCursorMode(_GLFWwindow* window, int mode);
 
+/*! @copydoc glfwRawMouseMotionSupported
+ *  @ingroup platform
+ */
+GLFWbool _glfwPlatformRawMouseMotionSupported(void);
+
+/*! @brief Enables or disables raw mouse motion for the specified window.
+ *  @param[in] window The window whose raw mouse motion to set.
+ *  @param[in] enabled Whether to enable raw mouse motion.
+ *  @ingroup platform
+ */
+void _glfwPlatformSetRawMouseMotion(_GLFWwindow* window, GLFWbool enabled);
+
 /*! @copydoc glfwGetKeyName
  *  @ingroup platform
  */
@@ -744,6 +784,15 @@ int _glfwPlatformWindowMaximized(_GLFWwindow* window);
  */
 void _glfwPlatformPollEvents(void);
 
+/*! @brief Asks the window system to request the next frame of the window.
+ *  @param[in] window The window whose next frame to request.
+ *  @return `GLFW_TRUE` if the window system will request the frame with @ref
+ *  _glfwInputWindowFrame, or `GLFW_FALSE` if it does not request frames.
+ *  @remark This is called before the buffers of the window are swapped.
+ *  @ingroup platform
+ */
+GLFWbool _glfwPlatformRequestWindowFrame(_GLFWwindow* window);
+
 /*! @copydoc glfwWaitEvents
  *  @ingroup platform
  */
@@ -850,6 +899,12 @@ void _glfwInputWindowIconify(_GLFWwindow* window, GLFWbool iconified);
  */
 void _glfwInputWindowDamage(_GLFWwindow* window);
 
+/*! @brief Notifies shared code that the window system wants a new frame.
+ *  @param[in] window The window whose frame was requested.
+ *  @ingroup event
+ */
+void _glfwInputWindowFrame(_GLFWwindow* window);
+
 /*! @brief Notifies shared code of a window close request event
  *  @param[in] window The window that received the event.
  *  @ingroup event
@@ -858,6 +913,14 @@ void _glfwInputWindowCloseRequest(_GLFWwindow* window);
 
 void _glfwInputWindowMonitorChange(_GLFWwindow* window, _GLFWmonitor* monitor);
 
+/*! @brief Notifies shared code of when the events it is about to be notified
+ *  of happened.
+ *  @param[in] time The timer value when they happened, or zero if they should
+ *  be taken to have happened when they are reported.
+ *  @ingroup event
+ */
+void _glfwInputEventTime(uint64_t time);
+
 /*! @brief Notifies shared code of a physical key event.
  *  @param[in] window The window that received the event.
  *  @param[in] key The key that was pressed or released.
@@ -33,6 +33,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <dirent.h>
@@ -40,40 +42,121 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+
+// The epoll data of the descriptors that aren't joysticks
+#define _GLFW_EPOLL_INOTIFY (GLFW_JOYSTICK_LAST + 1)
+#define _GLFW_EPOLL_WAKEUP  (GLFW_JOYSTICK_LAST + 2)
 #endif // __linux__
 
 
-// Attempt to open the specified joystick device
-//
 #if defined(__linux__)
-static GLFWbool openJoystickDevice(const char* path)
+
+// Signals the specified eventfd
+//
+static void signalEventFD(int fd)
+{
+    const uint64_t value = 1;
+    while (write(fd, &value, sizeof(value)) == -1 && errno == EINTR)
+        ;
+}
+
+// Begins changing the live state of the specified joystick
+//
+static void beginWrite(_GLFWjoystickLinux* js)
+{
+    __atomic_store_n(&js->sequence, js->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+// Publishes the changes to the live state of the specified joystick
+//
+static void endWrite(_GLFWjoystickLinux* js)
+{
+    __atomic_store_n(&js->sequence, js->sequence + 1, __ATOMIC_RELEASE);
+}
+
+// Tells the main thread that a joystick was connected or disconnected
+//
+static void notifyChange(void)
+{
+    signalEventFD(_glfw.linux_js.changed);
+    __atomic_add_fetch(&_glfw.linux_js.changes, 1, __ATOMIC_RELEASE);
+}
+
+// Reads and applies all queued events of the specified joystick
+//
+static GLFWbool readJoystickEvents(_GLFWjoystickLinux* js)
 {
-    char axisCount, buttonCount;
+    for (;;)
+    {
+        struct js_event events[64];
+        ssize_t i, count;
+
+        count = read(js->fd, events, sizeof(events));
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // The device was disconnected if it's gone, and otherwise there
+            // are just no more events
+            return errno != ENODEV;
+        }
+
+        count /= sizeof(struct js_event);
+
+        beginWrite(js);
+
+        for (i = 0;  i < count;  i++)
+        {
+            // Clear the initial-state bit
+            const int type = events[i].type & ~JS_EVENT_INIT;
+            const int number = events[i].number;
+
+            if (type == JS_EVENT_AXIS && number < js->live.axisCount)
+                js->live.axes[number] = (float) events[i].value / 32767.0f;
+            else if (type == JS_EVENT_BUTTON && number < js->live.buttonCount)
+                js->live.buttons[number] = events[i].value ? GLFW_PRESS : GLFW_RELEASE;
+        }
+
+        endWrite(js);
+
+        if (count < (ssize_t) (sizeof(events) / sizeof(events[0])))
+            return GLFW_TRUE;
+    }
+}
+
+// Attempt to open the specified joystick device, returning the slot it was
+// given or -1
+//
+static int openJoystickDevice(const char* path)
+{
+    unsigned char axisCount = 0, buttonCount = 0;
     char name[256];
     int joy, fd, version;
     _GLFWjoystickLinux* js;
 
     for (joy = GLFW_JOYSTICK_1;  joy <= GLFW_JOYSTICK_LAST;  joy++)
     {
-        if (!_glfw.linux_js.js[joy].present)
+        if (!_glfw.linux_js.js[joy].live.present)
             continue;
 
         if (strcmp(_glfw.linux_js.js[joy].path, path) == 0)
-            return GLFW_FALSE;
+            return -1;
     }
 
     for (joy = GLFW_JOYSTICK_1;  joy <= GLFW_JOYSTICK_LAST;  joy++)
     {
-        if (!_glfw.linux_js.js[joy].present)
+        if (!_glfw.linux_js.js[joy].live.present)
             break;
     }
 
     if (joy > GLFW_JOYSTICK_LAST)
-        return GLFW_FALSE;
+        return -1;
 
-    fd = open(path, O_RDONLY | O_NONBLOCK);
+    fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
     if (fd == -1)
-        return GLFW_FALSE;
+        return -1;
 
     // Verify that the joystick driver version is at least 1.0
     ioctl(fd, JSIOCGVERSION, &version);
@@ -81,81 +164,150 @@ static GLFWbool openJoystickDevice(const char* path)
     {
         // It's an old 0.x interface (we don't support it)
         close(fd);
-        return GLFW_FALSE;
+        return -1;
     }
 
     if (ioctl(fd, JSIOCGNAME(sizeof(name)), name) < 0)
         strncpy(name, "Unknown", sizeof(name));
 
+    name[sizeof(name) - 1] = '\0';
+
+    ioctl(fd, JSIOCGAXES, &axisCount);
+    ioctl(fd, JSIOCGBUTTONS, &buttonCount);
+
     js = _glfw.linux_js.js + joy;
-    js->present = GLFW_TRUE;
-    js->name = strdup(name);
-    js->path = strdup(path);
     js->fd = fd;
+    js->path = strdup(path);
 
-    ioctl(fd, JSIOCGAXES, &axisCount);
-    js->axisCount = (int) axisCount;
-    js->axes = calloc(axisCount, sizeof(float));
+    beginWrite(js);
+    js->live.serial++;
+    js->live.axisCount = (int) axisCount;
+    js->live.buttonCount = (int) buttonCount;
+    memset(js->live.axes, 0, sizeof(js->live.axes));
+    memset(js->live.buttons, 0, sizeof(js->live.buttons));
+    strcpy(js->live.name, name);
+    endWrite(js);
 
-    ioctl(fd, JSIOCGBUTTONS, &buttonCount);
-    js->buttonCount = (int) buttonCount;
-    js->buttons = calloc(buttonCount, 1);
+    // Read the initial state before the joystick is published as present
+    readJoystickEvents(js);
 
-    _glfwInputJoystickChange(joy, GLFW_CONNECTED);
-    return GLFW_TRUE;
+    beginWrite(js);
+    js->live.present = GLFW_TRUE;
+    endWrite(js);
+
+    return joy;
 }
-#endif // __linux__
 
-// Polls for and processes events the specified joystick
+// Has the joystick thread wait for events of the joystick in the specified
+// slot
 //
-static GLFWbool pollJoystickEvents(_GLFWjoystickLinux* js)
+static void watchJoystickDevice(int joy)
 {
-#if defined(__linux__)
-    _glfwPollJoystickEvents();
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = joy;
+    epoll_ctl(_glfw.linux_js.epoll, EPOLL_CTL_ADD,
+              _glfw.linux_js.js[joy].fd, &event);
+}
 
-    if (!js->present)
-        return GLFW_FALSE;
+// Closes the specified disconnected joystick device
+//
+static void closeJoystickDevice(_GLFWjoystickLinux* js)
+{
+    epoll_ctl(_glfw.linux_js.epoll, EPOLL_CTL_DEL, js->fd, NULL);
+    close(js->fd);
+    free(js->path);
+    js->path = NULL;
 
-    // Read all queued events (non-blocking)
-    for (;;)
+    beginWrite(js);
+    js->live.present = GLFW_FALSE;
+    endWrite(js);
+
+    notifyChange();
+}
+
+// Opens any joystick devices inotify says have appeared
+//
+static void readInotifyEvents(void)
+{
+    ssize_t offset = 0;
+    char buffer[16384];
+
+    const ssize_t size = read(_glfw.linux_js.inotify, buffer, sizeof(buffer));
+
+    while (size > offset)
     {
-        struct js_event e;
+        regmatch_t match;
+        const struct inotify_event* e = (struct inotify_event*) (buffer + offset);
 
-        errno = 0;
-        if (read(js->fd, &e, sizeof(e)) < 0)
+        if (regexec(&_glfw.linux_js.regex, e->name, 1, &match, 0) == 0)
         {
-            // Reset the joystick slot if the device was disconnected
-            if (errno == ENODEV)
-            {
-                free(js->axes);
-                free(js->buttons);
-                free(js->name);
-                free(js->path);
+            char path[20];
+            int joy;
 
-                memset(js, 0, sizeof(_GLFWjoystickLinux));
+            snprintf(path, sizeof(path), "/dev/input/%s", e->name);
 
-                _glfwInputJoystickChange(js - _glfw.linux_js.js,
-                                         GLFW_DISCONNECTED);
+            joy = openJoystickDevice(path);
+            if (joy != -1)
+            {
+                watchJoystickDevice(joy);
+                notifyChange();
             }
+        }
 
-            break;
+        offset += sizeof(struct inotify_event) + e->len;
+    }
+}
+
+// Reads joystick events and connections as they arrive, until woken up to
+// exit
+//
+static void* joystickThreadMain(void* arg)
+{
+    for (;;)
+    {
+        struct epoll_event events[GLFW_JOYSTICK_LAST + 3];
+        int i, count;
+
+        count = epoll_wait(_glfw.linux_js.epoll, events,
+                           sizeof(events) / sizeof(events[0]), -1);
+        if (count == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return NULL;
         }
 
-        // Clear the initial-state bit
-        e.type &= ~JS_EVENT_INIT;
+        for (i = 0;  i < count;  i++)
+        {
+            const uint32_t id = events[i].data.u32;
+
+            if (id == _GLFW_EPOLL_WAKEUP)
+                return NULL;
+            else if (id == _GLFW_EPOLL_INOTIFY)
+                readInotifyEvents();
+            else
+            {
+                _GLFWjoystickLinux* js = _glfw.linux_js.js + id;
+
+                // It may have been closed by an earlier event of this batch
+                if (!js->live.present)
+                    continue;
 
-        if (e.type == JS_EVENT_AXIS)
-            js->axes[e.number] = (float) e.value / 32767.0f;
-        else if (e.type == JS_EVENT_BUTTON)
-            js->buttons[e.number] = e.value ? GLFW_PRESS : GLFW_RELEASE;
+                if (!readJoystickEvents(js) ||
+                    (events[i].events & (EPOLLERR | EPOLLHUP)))
+                {
+                    closeJoystickDevice(js);
+                }
+            }
+        }
     }
-#endif // __linux__
-    return js->present;
 }
 
 // Lexically compare joysticks, used by quicksort
 //
-#if defined(__linux__)
 static int compareJoysticks(const void* fp, const void* sp)
 {
     const _GLFWjoystickLinux* fj = fp;
@@ -164,6 +316,45 @@ static int compareJoysticks(const void* fp, const void* sp)
 }
 #endif // __linux__
 
+// Takes the state of the specified joystick as last published by the joystick
+// thread, and reports whether it was connected or disconnected since
+//
+static GLFWbool pollJoystick(int joy)
+{
+#if defined(__linux__)
+    _GLFWjoystickLinux* js = _glfw.linux_js.js + joy;
+    const GLFWbool present = js->state.present;
+    const unsigned int serial = js->state.serial;
+    unsigned int sequence;
+
+    do
+    {
+        sequence = __atomic_load_n(&js->sequence, __ATOMIC_ACQUIRE);
+
+        js->state.present = js->live.present;
+        js->state.serial = js->live.serial;
+        js->state.axisCount = js->live.axisCount;
+        js->state.buttonCount = js->live.buttonCount;
+        memcpy(js->state.axes, js->live.axes,
+               js->state.axisCount * sizeof(float));
+        memcpy(js->state.buttons, js->live.buttons, js->state.buttonCount);
+        if (js->state.serial != serial)
+            memcpy(js->state.name, js->live.name, sizeof(js->state.name));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    }
+    while ((sequence & 1) ||
+           sequence != __atomic_load_n(&js->sequence, __ATOMIC_RELAXED));
+
+    if (present && (!js->state.present || js->state.serial != serial))
+        _glfwInputJoystickChange(joy, GLFW_DISCONNECTED);
+
+    if (js->state.present && (!present || js->state.serial != serial))
+        _glfwInputJoystickChange(joy, GLFW_CONNECTED);
+#endif // __linux__
+    return _glfw.linux_js.js[joy].state.present;
+}
+
 
 //////////////////////////////////////////////////////////////////////////
 //////                       GLFW internal API                      //////
@@ -175,8 +366,9 @@ GLFWbool _glfwInitJoysticksLinux(void)
 {
 #if defined(__linux__)
     DIR* dir;
-    int count = 0;
+    int joy, count = 0;
     const char* dirname = "/dev/input";
+    struct epoll_event event;
 
     _glfw.linux_js.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
     if (_glfw.linux_js.inotify == -1)
@@ -208,6 +400,19 @@ GLFWbool _glfwInitJoysticksLinux(void)
         return GLFW_FALSE;
     }
 
+    _glfw.linux_js.epoll = epoll_create1(EPOLL_CLOEXEC);
+    _glfw.linux_js.wakeup = eventfd(0, EFD_CLOEXEC);
+    _glfw.linux_js.changed = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_glfw.linux_js.epoll == -1 ||
+        _glfw.linux_js.wakeup == -1 ||
+        _glfw.linux_js.changed == -1)
+    {
+        _glfwInputError(GLFW_PLATFORM_ERROR,
+                        "Linux: Failed to create joystick thread descriptors: %s",
+                        strerror(errno));
+        return GLFW_FALSE;
+    }
+
     dir = opendir(dirname);
     if (dir)
     {
@@ -222,7 +427,7 @@ GLFWbool _glfwInitJoysticksLinux(void)
                 continue;
 
             snprintf(path, sizeof(path), "%s/%s", dirname, entry->d_name);
-            if (openJoystickDevice(path))
+            if (openJoystickDevice(path) != -1)
                 count++;
         }
 
@@ -238,6 +443,36 @@ GLFWbool _glfwInitJoysticksLinux(void)
     }
 
     qsort(_glfw.linux_js.js, count, sizeof(_GLFWjoystickLinux), compareJoysticks);
+
+    for (joy = 0;  joy < count;  joy++)
+    {
+        watchJoystickDevice(joy);
+        pollJoystick(joy);
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+
+    if (_glfw.linux_js.watch != -1)
+    {
+        event.data.u32 = _GLFW_EPOLL_INOTIFY;
+        epoll_ctl(_glfw.linux_js.epoll, EPOLL_CTL_ADD,
+                  _glfw.linux_js.inotify, &event);
+    }
+
+    event.data.u32 = _GLFW_EPOLL_WAKEUP;
+    epoll_ctl(_glfw.linux_js.epoll, EPOLL_CTL_ADD,
+              _glfw.linux_js.wakeup, &event);
+
+    if (pthread_create(&_glfw.linux_js.thread, NULL,
+                       joystickThreadMain, NULL) != 0)
+    {
+        _glfwInputError(GLFW_PLATFORM_ERROR,
+                        "Linux: Failed to create joystick thread");
+        return GLFW_FALSE;
+    }
+
+    _glfw.linux_js.threadRunning = GLFW_TRUE;
 #endif // __linux__
 
     return GLFW_TRUE;
@@ -250,14 +485,18 @@ void _glfwTerminateJoysticksLinux(void)
 #if defined(__linux__)
     int i;
 
+    if (_glfw.linux_js.threadRunning)
+    {
+        signalEventFD(_glfw.linux_js.wakeup);
+        pthread_join(_glfw.linux_js.thread, NULL);
+        _glfw.linux_js.threadRunning = GLFW_FALSE;
+    }
+
     for (i = 0;  i <= GLFW_JOYSTICK_LAST;  i++)
     {
-        if (_glfw.linux_js.js[i].present)
+        if (_glfw.linux_js.js[i].live.present)
         {
             close(_glfw.linux_js.js[i].fd);
-            free(_glfw.linux_js.js[i].axes);
-            free(_glfw.linux_js.js[i].buttons);
-            free(_glfw.linux_js.js[i].name);
             free(_glfw.linux_js.js[i].path);
         }
     }
@@ -271,31 +510,39 @@ void _glfwTerminateJoysticksLinux(void)
 
         close(_glfw.linux_js.inotify);
     }
+
+    if (_glfw.linux_js.epoll > 0)
+        close(_glfw.linux_js.epoll);
+    if (_glfw.linux_js.wakeup > 0)
+        close(_glfw.linux_js.wakeup);
+    if (_glfw.linux_js.changed > 0)
+        close(_glfw.linux_js.changed);
 #endif // __linux__
 }
 
+// Reports any joystick connections or disconnections since the last time,
+// which costs a memory read if there were none
+//
 void _glfwPollJoystickEvents(void)
 {
 #if defined(__linux__)
-    ssize_t offset = 0;
-    char buffer[16384];
+    int joy;
+    uint64_t value;
+    const unsigned int changes = __atomic_load_n(&_glfw.linux_js.changes,
+                                                 __ATOMIC_ACQUIRE);
 
-    const ssize_t size = read(_glfw.linux_js.inotify, buffer, sizeof(buffer));
+    if (changes == _glfw.linux_js.changesSeen)
+        return;
 
-    while (size > offset)
-    {
-        regmatch_t match;
-        const struct inotify_event* e = (struct inotify_event*) (buffer + offset);
+    _glfw.linux_js.changesSeen = changes;
 
-        if (regexec(&_glfw.linux_js.regex, e->name, 1, &match, 0) == 0)
-        {
-            char path[20];
-            snprintf(path, sizeof(path), "/dev/input/%s", e->name);
-            openJoystickDevice(path);
-        }
+    // Clear the eventfd, which was signalled before each of those changes
+    while (read(_glfw.linux_js.changed, &value, sizeof(value)) == -1 &&
+           errno == EINTR)
+        ;
 
-        offset += sizeof(struct inotify_event) + e->len;
-    }
+    for (joy = GLFW_JOYSTICK_1;  joy <= GLFW_JOYSTICK_LAST;  joy++)
+        pollJoystick(joy);
 #endif
 }
 
@@ -306,36 +553,38 @@ void _glfwPollJoystickEvents(void)
 
 int _glfwPlatformJoystickPresent(int joy)
 {
-    _GLFWjoystickLinux* js = _glfw.linux_js.js + joy;
-    return pollJoystickEvents(js);
+    _glfwPollJoystickEvents();
+    return pollJoystick(joy);
 }
 
 const float* _glfwPlatformGetJoystickAxes(int joy, int* count)
 {
     _GLFWjoystickLinux* js = _glfw.linux_js.js + joy;
-    if (!pollJoystickEvents(js))
+    _glfwPollJoystickEvents();
+    if (!pollJoystick(joy))
         return NULL;
 
-    *count = js->axisCount;
-    return js->axes;
+    *count = js->state.axisCount;
+    return js->state.axes;
 }
 
 const unsigned char* _glfwPlatformGetJoystickButtons(int joy, int* count)
 {
     _GLFWjoystickLinux* js = _glfw.linux_js.js + joy;
-    if (!pollJoystickEvents(js))
+    _glfwPollJoystickEvents();
+    if (!pollJoystick(joy))
         return NULL;
 
-    *count = js->buttonCount;
-    return js->buttons;
+    *count = js->state.buttonCount;
+    return js->state.buttons;
 }
 
 const char* _glfwPlatformGetJoystickName(int joy)
 {
     _GLFWjoystickLinux* js = _glfw.linux_js.js + joy;
-    if (!pollJoystickEvents(js))
+    _glfwPollJoystickEvents();
+    if (!pollJoystick(joy))
         return NULL;
 
-    return js->name;
+    return js->state.name;
 }
-
@@ -28,21 +28,42 @@
 #define _glfw3_linux_joystick_h_
 
 #include <regex.h>
+#include <pthread.h>
 
 #define _GLFW_PLATFORM_LIBRARY_JOYSTICK_STATE _GLFWjoylistLinux linux_js
 
+// The joystick API reports the number of each as a byte
+#define _GLFW_JOYSTICK_MAX_AXES     256
+#define _GLFW_JOYSTICK_MAX_BUTTONS  256
 
-// Linux-specific joystick data
+
+// Linux-specific joystick state
 //
-typedef struct _GLFWjoystickLinux
+typedef struct _GLFWjoystateLinux
 {
     GLFWbool        present;
-    int             fd;
-    float*          axes;
+    // Distinguishes this connection from earlier ones to the same slot
+    unsigned int    serial;
+    float           axes[_GLFW_JOYSTICK_MAX_AXES];
     int             axisCount;
-    unsigned char*  buttons;
+    unsigned char   buttons[_GLFW_JOYSTICK_MAX_BUTTONS];
     int             buttonCount;
-    char*           name;
+    char            name[256];
+} _GLFWjoystateLinux;
+
+// Linux-specific joystick data
+//
+typedef struct _GLFWjoystickLinux
+{
+    // The state as of the last time it was polled, which is what the joystick
+    // functions return
+    _GLFWjoystateLinux state;
+    // The state as the joystick thread last read it, published to other
+    // threads through the sequence number, which is odd while it is written
+    _GLFWjoystateLinux live;
+    unsigned int    sequence;
+    // These are only used by the joystick thread
+    int             fd;
     char*           path;
 } _GLFWjoystickLinux;
 
@@ -57,6 +78,18 @@ typedef struct _GLFWjoylistLinux
     int             inotify;
     int             watch;
     regex_t         regex;
+    // The joystick thread waits on epoll for joystick and inotify events, or
+    // for the wakeup eventfd to be written when it is to exit
+    pthread_t       thread;
+    GLFWbool        threadRunning;
+    int             epoll;
+    int             wakeup;
+    // Incremented by the joystick thread when a joystick is connected or
+    // disconnected, after writing the changed eventfd, which is readable
+    // until the main thread catches up
+    unsigned int    changes;
+    unsigned int    changesSeen;
+    int             changed;
 #endif /*__linux__*/
 } _GLFWjoylistLinux;
 
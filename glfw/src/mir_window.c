@@ -596,6 +596,11 @@ void _glfwPlatformPostEmptyEvent(void)
 {
 }
 
+GLFWbool _glfwPlatformRequestWindowFrame(_GLFWwindow* window)
+{
+    return GLFW_FALSE;
+}
+
 void _glfwPlatformGetFramebufferSize(_GLFWwindow* window, int* width, int* height)
 {
     if (width)
@@ -735,6 +740,15 @@ void _glfwPlatformSetCursorMode(_GLFWwindow* window, int mode)
                     "Mir: Unsupported function %s", __PRETTY_FUNCTION__);
 }
 
+GLFWbool _glfwPlatformRawMouseMotionSupported(void)
+{
+    return GLFW_FALSE;
+}
+
+void _glfwPlatformSetRawMouseMotion(_GLFWwindow* window, GLFWbool enabled)
+{
+}
+
 const char* _glfwPlatformGetKeyName(int key, int scancode)
 {
     _glfwInputError(GLFW_PLATFORM_ERROR,
@@ -47,7 +47,8 @@ static void swapInterval(int interval)
 {
     _GLFWwindow* window = _glfwPlatformGetCurrentContext();
 
-    GLint sync = interval;
+    // There is no late swap tearing with NSGL, so adaptive vsync is just vsync
+    GLint sync = abs(interval);
     [window->context.nsgl.object setValues:&sync
                               forParameter:NSOpenGLCPSwapInterval];
 }
@@ -28,12 +28,23 @@
 #include "internal.h"
 
 
+#if defined(_GLFW_USE_NATIVE_TLS)
+// The current context, in compiler thread-local storage, so that looking it up
+// is a plain load instead of a call into the threading library
+//
+static _GLFW_THREAD_LOCAL _GLFWwindow* _glfwCurrentContext = NULL;
+#endif
+
+
 //////////////////////////////////////////////////////////////////////////
 //////                       GLFW internal API                      //////
 //////////////////////////////////////////////////////////////////////////
 
 GLFWbool _glfwInitThreadLocalStoragePOSIX(void)
 {
+#if defined(_GLFW_USE_NATIVE_TLS)
+    return GLFW_TRUE;
+#else
     if (pthread_key_create(&_glfw.posix_tls.context, NULL) != 0)
     {
         _glfwInputError(GLFW_PLATFORM_ERROR,
@@ -43,12 +54,18 @@ GLFWbool _glfwInitThreadLocalStoragePOSIX(void)
 
     _glfw.posix_tls.allocated = GLFW_TRUE;
     return GLFW_TRUE;
+#endif
 }
 
 void _glfwTerminateThreadLocalStoragePOSIX(void)
 {
+#if defined(_GLFW_USE_NATIVE_TLS)
+    // Other threads' contexts will have been destroyed along with their windows
+    _glfwCurrentContext = NULL;
+#else
     if (_glfw.posix_tls.allocated)
         pthread_key_delete(_glfw.posix_tls.context);
+#endif
 }
 
 
@@ -58,11 +75,19 @@ void _glfwTerminateThreadLocalStoragePOSIX(void)
 
 void _glfwPlatformSetCurrentContext(_GLFWwindow* context)
 {
+#if defined(_GLFW_USE_NATIVE_TLS)
+    _glfwCurrentContext = context;
+#else
     pthread_setspecific(_glfw.posix_tls.context, context);
+#endif
 }
 
 _GLFWwindow* _glfwPlatformGetCurrentContext(void)
 {
+#if defined(_GLFW_USE_NATIVE_TLS)
+    return _glfwCurrentContext;
+#else
     return pthread_getspecific(_glfw.posix_tls.context);
+#endif
 }
 
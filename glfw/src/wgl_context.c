@@ -273,6 +273,10 @@ static void swapInterval(int interval)
 {
     _GLFWwindow* window = _glfwPlatformGetCurrentContext();
 
+    // Without late swap tearing, adaptive vsync is just vsync
+    if (interval < 0 && !_glfw.wgl.EXT_swap_control_tear)
+        interval = -interval;
+
     window->context.wgl.interval = interval;
 
     // HACK: Disable WGL swap interval when desktop composition is enabled to
@@ -284,6 +288,33 @@ static void swapInterval(int interval)
         _glfw.wgl.SwapIntervalEXT(interval);
 }
 
+static GLFWbool getFrameTiming(_GLFWwindow* window,
+                               uint64_t* present, uint64_t* period)
+{
+    DWM_TIMING_INFO info;
+
+    // NOTE: Only the compositor's timing is available, and only while it is
+    //       presenting the window, which it does at each of its vertical blanks
+    if (!_glfw_DwmGetCompositionTimingInfo || !_glfw.win32_time.hasPC)
+        return GLFW_FALSE;
+
+    if (!isCompositionEnabled() || window->monitor)
+        return GLFW_FALSE;
+
+    ZeroMemory(&info, sizeof(info));
+    info.cbSize = sizeof(info);
+
+    if (FAILED(_glfw_DwmGetCompositionTimingInfo(NULL, &info)))
+        return GLFW_FALSE;
+
+    if (!info.qpcVBlank || !info.qpcRefreshPeriod)
+        return GLFW_FALSE;
+
+    *present = info.qpcVBlank;
+    *period = info.qpcRefreshPeriod;
+    return GLFW_TRUE;
+}
+
 static int extensionSupported(const char* extension)
 {
     const char* extensions;
@@ -374,6 +405,8 @@ static void loadExtensions(void)
         extensionSupported("WGL_ARB_create_context_robustness");
     _glfw.wgl.EXT_swap_control =
         extensionSupported("WGL_EXT_swap_control");
+    _glfw.wgl.EXT_swap_control_tear =
+        extensionSupported("WGL_EXT_swap_control_tear");
     _glfw.wgl.ARB_pixel_format =
         extensionSupported("WGL_ARB_pixel_format");
     _glfw.wgl.ARB_context_flush_control =
@@ -579,6 +612,7 @@ GLFWbool _glfwCreateContextWGL(_GLFWwindow* window,
     window->context.makeCurrent = makeContextCurrent;
     window->context.swapBuffers = swapBuffers;
     window->context.swapInterval = swapInterval;
+    window->context.getFrameTiming = getFrameTiming;
     window->context.extensionSupported = extensionSupported;
     window->context.getProcAddress = getProcAddress;
     window->context.destroy = destroyContext;
@@ -130,6 +130,7 @@ typedef struct _GLFWlibraryWGL
     PFNWGLGETEXTENSIONSSTRINGARBPROC    GetExtensionsStringARB;
     PFNWGLCREATECONTEXTATTRIBSARBPROC   CreateContextAttribsARB;
     GLFWbool                            EXT_swap_control;
+    GLFWbool                            EXT_swap_control_tear;
     GLFWbool                            ARB_multisample;
     GLFWbool                            ARB_framebuffer_sRGB;
     GLFWbool                            EXT_framebuffer_sRGB;
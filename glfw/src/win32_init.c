@@ -127,6 +127,8 @@ static GLFWbool loadLibraries(void)
             GetProcAddress(_glfw.win32.dwmapi.instance, "DwmIsCompositionEnabled");
         _glfw.win32.dwmapi.DwmFlush = (DWMFLUSH_T)
             GetProcAddress(_glfw.win32.dwmapi.instance, "DwmFlush");
+        _glfw.win32.dwmapi.DwmGetCompositionTimingInfo = (DWMGETCOMPOSITIONTIMINGINFO_T)
+            GetProcAddress(_glfw.win32.dwmapi.instance, "DwmGetCompositionTimingInfo");
     }
 
     _glfw.win32.shcore.instance = LoadLibraryA("shcore.dll");
@@ -126,6 +126,61 @@ typedef enum PROCESS_DPI_AWARENESS
 } PROCESS_DPI_AWARENESS;
 #endif /*DPI_ENUMS_DECLARED*/
 
+#ifndef _DWMAPI_H_
+#include <pshpack1.h>
+typedef ULONGLONG DWM_FRAME_COUNT;
+typedef ULONGLONG QPC_TIME;
+typedef struct _UNSIGNED_RATIO
+{
+    UINT32 uiNumerator;
+    UINT32 uiDenominator;
+} UNSIGNED_RATIO;
+typedef struct _DWM_TIMING_INFO
+{
+    UINT32          cbSize;
+    UNSIGNED_RATIO  rateRefresh;
+    QPC_TIME        qpcRefreshPeriod;
+    UNSIGNED_RATIO  rateCompose;
+    QPC_TIME        qpcVBlank;
+    DWM_FRAME_COUNT cRefresh;
+    UINT            cDXRefresh;
+    QPC_TIME        qpcCompose;
+    DWM_FRAME_COUNT cFrame;
+    UINT            cDXPresent;
+    DWM_FRAME_COUNT cRefreshFrame;
+    DWM_FRAME_COUNT cFrameSubmitted;
+    UINT            cDXPresentSubmitted;
+    DWM_FRAME_COUNT cFrameConfirmed;
+    UINT            cDXPresentConfirmed;
+    DWM_FRAME_COUNT cRefreshConfirmed;
+    UINT            cDXRefreshConfirmed;
+    DWM_FRAME_COUNT cFramesLate;
+    UINT            cFramesOutstanding;
+    DWM_FRAME_COUNT cFrameDisplayed;
+    QPC_TIME        qpcFrameDisplayed;
+    DWM_FRAME_COUNT cRefreshFrameDisplayed;
+    DWM_FRAME_COUNT cFrameComplete;
+    QPC_TIME        qpcFrameComplete;
+    DWM_FRAME_COUNT cFramePending;
+    QPC_TIME        qpcFramePending;
+    DWM_FRAME_COUNT cFramesDisplayed;
+    DWM_FRAME_COUNT cFramesComplete;
+    DWM_FRAME_COUNT cFramesPending;
+    DWM_FRAME_COUNT cFramesAvailable;
+    DWM_FRAME_COUNT cFramesDropped;
+    DWM_FRAME_COUNT cFramesMissed;
+    DWM_FRAME_COUNT cRefreshNextDisplayed;
+    DWM_FRAME_COUNT cRefreshNextPresented;
+    DWM_FRAME_COUNT cRefreshesDisplayed;
+    DWM_FRAME_COUNT cRefreshesPresented;
+    DWM_FRAME_COUNT cRefreshStarted;
+    ULONGLONG       cPixelsReceived;
+    ULONGLONG       cPixelsDrawn;
+    DWM_FRAME_COUNT cBuffersEmpty;
+} DWM_TIMING_INFO;
+#include <poppack.h>
+#endif /*_DWMAPI_H_*/
+
 // HACK: Define macros that some xinput.h variants don't
 #ifndef XINPUT_CAPS_WIRELESS
  #define XINPUT_CAPS_WIRELESS 0x0002
@@ -183,8 +238,10 @@ typedef BOOL (WINAPI * CHANGEWINDOWMESSAGEFILTEREX_T)(HWND,UINT,DWORD,PCHANGEFIL
 // dwmapi.dll function pointer typedefs
 typedef HRESULT (WINAPI * DWMISCOMPOSITIONENABLED_T)(BOOL*);
 typedef HRESULT (WINAPI * DWMFLUSH_T)(VOID);
+typedef HRESULT (WINAPI * DWMGETCOMPOSITIONTIMINGINFO_T)(HWND,DWM_TIMING_INFO*);
 #define _glfw_DwmIsCompositionEnabled _glfw.win32.dwmapi.DwmIsCompositionEnabled
 #define _glfw_DwmFlush _glfw.win32.dwmapi.DwmFlush
+#define _glfw_DwmGetCompositionTimingInfo _glfw.win32.dwmapi.DwmGetCompositionTimingInfo
 
 // shcore.dll function pointer typedefs
 typedef HRESULT (WINAPI * SETPROCESSDPIAWARENESS_T)(PROCESS_DPI_AWARENESS);
@@ -284,6 +341,7 @@ typedef struct _GLFWlibraryWin32
         HINSTANCE       instance;
         DWMISCOMPOSITIONENABLED_T DwmIsCompositionEnabled;
         DWMFLUSH_T      DwmFlush;
+        DWMGETCOMPOSITIONTIMINGINFO_T DwmGetCompositionTimingInfo;
     } dwmapi;
 
     struct {
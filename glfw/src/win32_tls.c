@@ -28,12 +28,23 @@
 #include "internal.h"
 
 
+#if defined(_GLFW_USE_NATIVE_TLS)
+// The current context, in compiler thread-local storage, so that looking it up
+// is a plain load instead of a call into the threading library
+//
+static _GLFW_THREAD_LOCAL _GLFWwindow* _glfwCurrentContext = NULL;
+#endif
+
+
 //////////////////////////////////////////////////////////////////////////
 //////                       GLFW internal API                      //////
 //////////////////////////////////////////////////////////////////////////
 
 GLFWbool _glfwInitThreadLocalStorageWin32(void)
 {
+#if defined(_GLFW_USE_NATIVE_TLS)
+    return GLFW_TRUE;
+#else
     _glfw.win32_tls.context = TlsAlloc();
     if (_glfw.win32_tls.context == TLS_OUT_OF_INDEXES)
     {
@@ -44,12 +55,18 @@ GLFWbool _glfwInitThreadLocalStorageWin32(void)
 
     _glfw.win32_tls.allocated = GLFW_TRUE;
     return GLFW_TRUE;
+#endif
 }
 
 void _glfwTerminateThreadLocalStorageWin32(void)
 {
+#if defined(_GLFW_USE_NATIVE_TLS)
+    // Other threads' contexts will have been destroyed along with their windows
+    _glfwCurrentContext = NULL;
+#else
     if (_glfw.win32_tls.allocated)
         TlsFree(_glfw.win32_tls.context);
+#endif
 }
 
 
@@ -59,11 +76,19 @@ void _glfwTerminateThreadLocalStorageWin32(void)
 
 void _glfwPlatformSetCurrentContext(_GLFWwindow* context)
 {
+#if defined(_GLFW_USE_NATIVE_TLS)
+    _glfwCurrentContext = context;
+#else
     TlsSetValue(_glfw.win32_tls.context, context);
+#endif
 }
 
 _GLFWwindow* _glfwPlatformGetCurrentContext(void)
 {
+#if defined(_GLFW_USE_NATIVE_TLS)
+    return _glfwCurrentContext;
+#else
     return TlsGetValue(_glfw.win32_tls.context);
+#endif
 }
 
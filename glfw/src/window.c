@@ -34,6 +34,54 @@
 #include <float.h>
 
 
+// Returns whether the frame shared code requested for the window, if any, can
+// be delivered now
+//
+static GLFWbool framePendingFor(_GLFWwindow* window)
+{
+    return window->framePending &&
+           !window->iconified &&
+           _glfwPlatformWindowVisible(window);
+}
+
+// Returns whether any window has a frame from shared code that can be delivered
+//
+static GLFWbool framesPending(void)
+{
+    _GLFWwindow* window;
+
+    for (window = _glfw.windowListHead;  window;  window = window->next)
+    {
+        if (framePendingFor(window))
+            return GLFW_TRUE;
+    }
+
+    return GLFW_FALSE;
+}
+
+// Delivers the frames requested by shared code to the windows that can show
+// them
+//
+static void inputPendingFrames(void)
+{
+    _GLFWwindow* window = _glfw.windowListHead;
+
+    while (window)
+    {
+        // The callback may destroy the window
+        _GLFWwindow* next = window->next;
+
+        if (framePendingFor(window))
+        {
+            window->framePending = GLFW_FALSE;
+            _glfwInputWindowFrame(window);
+        }
+
+        window = next;
+    }
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 //////                         GLFW event API                       //////
 //////////////////////////////////////////////////////////////////////////
@@ -82,6 +130,8 @@ void _glfwInputWindowSize(_GLFWwindow* window, int width, int height)
 
 void _glfwInputWindowIconify(_GLFWwindow* window, GLFWbool iconified)
 {
+    window->iconified = iconified;
+
     if (window->callbacks.iconify)
         window->callbacks.iconify((GLFWwindow*) window, iconified);
 }
@@ -98,6 +148,12 @@ void _glfwInputWindowDamage(_GLFWwindow* window)
         window->callbacks.refresh((GLFWwindow*) window);
 }
 
+void _glfwInputWindowFrame(_GLFWwindow* window)
+{
+    if (window->callbacks.frame)
+        window->callbacks.frame((GLFWwindow*) window);
+}
+
 void _glfwInputWindowCloseRequest(_GLFWwindow* window)
 {
     window->closed = GLFW_TRUE;
@@ -402,6 +458,7 @@ GLFWAPI void glfwDestroyWindow(GLFWwindow* handle)
         *prev = window->next;
     }
 
+    free(window->events);
     free(window);
 }
 
@@ -827,6 +884,24 @@ GLFWAPI GLFWwindowrefreshfun glfwSetWindowRefreshCallback(GLFWwindow* handle,
     return cbfun;
 }
 
+GLFWAPI GLFWwindowframefun glfwSetWindowFrameCallback(GLFWwindow* handle,
+                                                      GLFWwindowframefun cbfun)
+{
+    _GLFWwindow* window = (_GLFWwindow*) handle;
+    assert(window != NULL);
+
+    _GLFW_REQUIRE_INIT_OR_RETURN(NULL);
+
+    // The first frame is wanted straight away, as nothing has been shown yet
+    if (!window->callbacks.frame && cbfun)
+        window->framePending = GLFW_TRUE;
+    else if (!cbfun)
+        window->framePending = GLFW_FALSE;
+
+    _GLFW_SWAP_POINTERS(window->callbacks.frame, cbfun);
+    return cbfun;
+}
+
 GLFWAPI GLFWwindowfocusfun glfwSetWindowFocusCallback(GLFWwindow* handle,
                                                       GLFWwindowfocusfun cbfun)
 {
@@ -864,6 +939,7 @@ GLFWAPI void glfwPollEvents(void)
 {
     _GLFW_REQUIRE_INIT();
     _glfwPlatformPollEvents();
+    inputPendingFrames();
 }
 
 GLFWAPI void glfwWaitEvents(void)
@@ -873,7 +949,12 @@ GLFWAPI void glfwWaitEvents(void)
     if (!_glfw.windowListHead)
         return;
 
-    _glfwPlatformWaitEvents();
+    if (framesPending())
+        _glfwPlatformPollEvents();
+    else
+        _glfwPlatformWaitEvents();
+
+    inputPendingFrames();
 }
 
 GLFWAPI void glfwWaitEventsTimeout(double timeout)
@@ -886,7 +967,12 @@ GLFWAPI void glfwWaitEventsTimeout(double timeout)
         return;
     }
 
-    _glfwPlatformWaitEventsTimeout(timeout);
+    if (framesPending())
+        _glfwPlatformPollEvents();
+    else
+        _glfwPlatformWaitEventsTimeout(timeout);
+
+    inputPendingFrames();
 }
 
 GLFWAPI void glfwPostEmptyEvent(void)
@@ -372,6 +372,17 @@ static const struct wl_seat_listener seatListener = {
     seatHandleCapabilities
 };
 
+static void presentationHandleClockId(void* data,
+                                      struct wp_presentation* presentation,
+                                      uint32_t clock)
+{
+    _glfw.wl.presentationClock = clock;
+}
+
+static const struct wp_presentation_listener presentationListener = {
+    presentationHandleClockId
+};
+
 static void registryHandleGlobal(void* data,
                                  struct wl_registry* registry,
                                  uint32_t name,
@@ -422,6 +433,13 @@ static void registryHandleGlobal(void* data,
                              &zwp_pointer_constraints_v1_interface,
                              1);
     }
+    else if (strcmp(interface, "wp_presentation") == 0)
+    {
+        _glfw.wl.presentation =
+            wl_registry_bind(registry, name, &wp_presentation_interface, 1);
+        wp_presentation_add_listener(_glfw.wl.presentation,
+                                     &presentationListener, NULL);
+    }
 }
 
 static void registryHandleGlobalRemove(void *data,
@@ -634,6 +652,8 @@ void _glfwPlatformTerminate(void)
         wl_cursor_theme_destroy(_glfw.wl.cursorTheme);
     if (_glfw.wl.cursorSurface)
         wl_surface_destroy(_glfw.wl.cursorSurface);
+    if (_glfw.wl.presentation)
+        wp_presentation_destroy(_glfw.wl.presentation);
     if (_glfw.wl.registry)
         wl_registry_destroy(_glfw.wl.registry);
     if (_glfw.wl.display)
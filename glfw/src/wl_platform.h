@@ -53,6 +53,7 @@ typedef VkBool32 (APIENTRY *PFN_vkGetPhysicalDeviceWaylandPresentationSupportKHR
 
 #include "wayland-relative-pointer-unstable-v1-client-protocol.h"
 #include "wayland-pointer-constraints-unstable-v1-client-protocol.h"
+#include "wayland-presentation-time-client-protocol.h"
 
 #define _glfw_dlopen(name) dlopen(name, RTLD_LAZY | RTLD_LOCAL)
 #define _glfw_dlclose(handle) dlclose(handle)
@@ -85,7 +86,15 @@ typedef struct _GLFWwindowWayland
     struct wl_surface*          surface;
     struct wl_egl_window*       native;
     struct wl_shell_surface*    shell_surface;
-    struct wl_callback*         callback;
+    struct wl_callback*         frameCallback;
+
+    // The swap function of the context, which ours calls
+    _GLFWswapbuffersfun         swapBuffers;
+    // Presentation feedback for the latest swap, if still outstanding, and the
+    // results of the last feedback that arrived, in timer ticks
+    struct wp_presentation_feedback* feedback;
+    uint64_t                    presentTime;
+    uint64_t                    refreshPeriod;
 
     _GLFWcursor*                currentCursor;
     double                      cursorPosX, cursorPosY;
@@ -120,6 +129,8 @@ typedef struct _GLFWlibraryWayland
     struct wl_keyboard*         keyboard;
     struct zwp_relative_pointer_manager_v1* relativePointerManager;
     struct zwp_pointer_constraints_v1*      pointerConstraints;
+    struct wp_presentation*     presentation;
+    uint32_t                    presentationClock;
 
     int                         wl_compositor_version;
 
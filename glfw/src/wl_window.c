@@ -36,6 +36,7 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <poll.h>
+#include <time.h>
 
 #include <wayland-egl.h>
 #include <wayland-cursor.h>
@@ -97,6 +98,96 @@ static const struct wl_shell_surface_listener shellSurfaceListener = {
     handlePopupDone
 };
 
+static void handleFrameDone(void* data,
+                            struct wl_callback* callback,
+                            uint32_t time)
+{
+    _GLFWwindow* window = data;
+
+    wl_callback_destroy(callback);
+    window->wl.frameCallback = NULL;
+
+    _glfwInputWindowFrame(window);
+}
+
+static const struct wl_callback_listener frameListener = {
+    handleFrameDone
+};
+
+static void handleFeedbackSyncOutput(void* data,
+                                     struct wp_presentation_feedback* feedback,
+                                     struct wl_output* output)
+{
+}
+
+static void handleFeedbackPresented(void* data,
+                                    struct wp_presentation_feedback* feedback,
+                                    uint32_t secondsHi,
+                                    uint32_t secondsLo,
+                                    uint32_t nanoseconds,
+                                    uint32_t refresh,
+                                    uint32_t sequenceHi,
+                                    uint32_t sequenceLo,
+                                    uint32_t flags)
+{
+    _GLFWwindow* window = data;
+    const uint64_t seconds = ((uint64_t) secondsHi << 32) | secondsLo;
+
+    // The presentation clock is the monotonic clock, as is the timer
+    window->wl.presentTime = seconds * 1000000000 + nanoseconds;
+    window->wl.refreshPeriod = refresh;
+
+    wp_presentation_feedback_destroy(feedback);
+    window->wl.feedback = NULL;
+}
+
+static void handleFeedbackDiscarded(void* data,
+                                    struct wp_presentation_feedback* feedback)
+{
+    _GLFWwindow* window = data;
+
+    wp_presentation_feedback_destroy(feedback);
+    window->wl.feedback = NULL;
+}
+
+static const struct wp_presentation_feedback_listener feedbackListener = {
+    handleFeedbackSyncOutput,
+    handleFeedbackPresented,
+    handleFeedbackDiscarded
+};
+
+// Asks for feedback on when the frame being swapped is presented, if none is
+// outstanding, before swapping the buffers with the context
+//
+static void swapBuffers(_GLFWwindow* window)
+{
+    if (_glfw.wl.presentation &&
+        _glfw.wl.presentationClock == CLOCK_MONOTONIC &&
+        _glfw.posix_time.monotonic &&
+        !window->wl.feedback)
+    {
+        window->wl.feedback =
+            wp_presentation_feedback(_glfw.wl.presentation, window->wl.surface);
+        wp_presentation_feedback_add_listener(window->wl.feedback,
+                                              &feedbackListener,
+                                              window);
+    }
+
+    window->wl.swapBuffers(window);
+}
+
+static GLFWbool getFrameTiming(_GLFWwindow* window,
+                               uint64_t* present, uint64_t* period)
+{
+    // The refresh period is zero if the compositor does not know it
+    if (!window->wl.presentTime || !window->wl.refreshPeriod)
+        return GLFW_FALSE;
+
+    *present = window->wl.presentTime;
+    *period = window->wl.refreshPeriod;
+    return GLFW_TRUE;
+}
+
 static void checkScaleChange(_GLFWwindow* window)
 {
     int scaledWidth, scaledHeight;
@@ -395,6 +486,12 @@ int _glfwPlatformCreateWindow(_GLFWwindow* window,
     {
         if (!_glfwCreateContextEGL(window, ctxconfig, fbconfig))
             return GLFW_FALSE;
+
+        // The compositor can say when frames were presented, whatever the
+        // context, if asked before each swap
+        window->wl.swapBuffers = window->context.swapBuffers;
+        window->context.swapBuffers = swapBuffers;
+        window->context.getFrameTiming = getFrameTiming;
     }
 
     if (wndconfig->title)
@@ -438,6 +535,12 @@ void _glfwPlatformDestroyWindow(_GLFWwindow* window)
     if (window->context.client != GLFW_NO_API)
         window->context.destroy(window);
 
+    if (window->wl.frameCallback)
+        wl_callback_destroy(window->wl.frameCallback);
+
+    if (window->wl.feedback)
+        wp_presentation_feedback_destroy(window->wl.feedback);
+
     if (window->wl.native)
         wl_egl_window_destroy(window->wl.native);
 
@@ -652,6 +755,20 @@ void _glfwPlatformPostEmptyEvent(void)
     wl_display_sync(_glfw.wl.display);
 }
 
+GLFWbool _glfwPlatformRequestWindowFrame(_GLFWwindow* window)
+{
+    // The request goes with the next commit of the surface, which is the swap
+    if (!window->wl.frameCallback)
+    {
+        window->wl.frameCallback = wl_surface_frame(window->wl.surface);
+        wl_callback_add_listener(window->wl.frameCallback,
+                                 &frameListener,
+                                 window);
+    }
+
+    return GLFW_TRUE;
+}
+
 void _glfwPlatformGetCursorPos(_GLFWwindow* window, double* xpos, double* ypos)
 {
     if (xpos)
@@ -678,6 +795,15 @@ void _glfwPlatformSetCursorMode(_GLFWwindow* window, int mode)
     _glfwPlatformSetCursor(window, window->wl.currentCursor);
 }
 
+GLFWbool _glfwPlatformRawMouseMotionSupported(void)
+{
+    return GLFW_FALSE;
+}
+
+void _glfwPlatformSetRawMouseMotion(_GLFWwindow* window, GLFWbool enabled)
+{
+}
+
 const char* _glfwPlatformGetKeyName(int key, int scancode)
 {
     // TODO
@@ -550,6 +550,35 @@ static GLFWbool initExtensions(void)
             dlsym(_glfw.x11.x11xcb.handle, "XGetXCBConnection");
     }
 
+    _glfw.x11.xi.handle = dlopen("libXi.so.6", RTLD_LAZY | RTLD_LOCAL);
+    if (_glfw.x11.xi.handle)
+    {
+        _glfw.x11.xi.XIQueryVersion = (XIQUERYVERSION_T)
+            dlsym(_glfw.x11.xi.handle, "XIQueryVersion");
+        _glfw.x11.xi.XISelectEvents = (XISELECTEVENTS_T)
+            dlsym(_glfw.x11.xi.handle, "XISelectEvents");
+
+        // Raw events need XInput 2.0, so ask for that version
+        if (_glfw.x11.xi.XIQueryVersion &&
+            _glfw.x11.xi.XISelectEvents &&
+            XQueryExtension(_glfw.x11.display,
+                            "XInputExtension",
+                            &_glfw.x11.xi.majorOpcode,
+                            &_glfw.x11.xi.eventBase,
+                            &_glfw.x11.xi.errorBase))
+        {
+            _glfw.x11.xi.major = 2;
+            _glfw.x11.xi.minor = 0;
+
+            if (_glfw.x11.xi.XIQueryVersion(_glfw.x11.display,
+                                            &_glfw.x11.xi.major,
+                                            &_glfw.x11.xi.minor) == Success)
+            {
+                _glfw.x11.xi.available = GLFW_TRUE;
+            }
+        }
+    }
+
     // Update the key code LUT
     // FIXME: We should listen to XkbMapNotify events to track changes to
     // the keyboard mapping.
@@ -812,6 +841,13 @@ void _glfwPlatformTerminate(void)
     //       cleanup callbacks that get called by it
     _glfwTerminateGLX();
 
+    // NOTE: The same goes for libXi, which registers a close display callback
+    if (_glfw.x11.xi.handle)
+    {
+        dlclose(_glfw.x11.xi.handle);
+        _glfw.x11.xi.handle = NULL;
+    }
+
     _glfwTerminateJoysticksLinux();
     _glfwTerminateThreadLocalStoragePOSIX();
 }
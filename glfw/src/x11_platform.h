@@ -47,6 +47,9 @@
 // The Xinerama extension provides legacy monitor indices
 #include <X11/extensions/Xinerama.h>
 
+// The XInput2 extension provides raw mouse motion input
+#include <X11/extensions/XInput2.h>
+
 #if defined(_GLFW_HAS_XF86VM)
  // The Xf86VidMode extension provides fallback gamma control
  #include <X11/extensions/xf86vmode.h>
@@ -57,6 +60,9 @@ typedef XID xcb_visualid_t;
 typedef struct xcb_connection_t xcb_connection_t;
 typedef xcb_connection_t* (* XGETXCBCONNECTION_T)(Display*);
 
+typedef Status (* XIQUERYVERSION_T)(Display*,int*,int*);
+typedef int (* XISELECTEVENTS_T)(Display*,Window,XIEventMask*,int);
+
 typedef VkFlags VkXlibSurfaceCreateFlagsKHR;
 typedef VkFlags VkXcbSurfaceCreateFlagsKHR;
 
@@ -159,6 +165,9 @@ typedef struct _GLFWlibraryX11
     double          restoreCursorPosX, restoreCursorPosY;
     // The window whose disabled cursor mode is active
     _GLFWwindow*    disabledCursorWindow;
+    // Timer value minus X server time, in timer ticks, if known
+    int64_t         serverTimeOffset;
+    GLFWbool        serverTimeKnown;
 
     // Window manager atoms
     Atom            WM_PROTOCOLS;
@@ -249,6 +258,18 @@ typedef struct _GLFWlibraryX11
         XGETXCBCONNECTION_T XGetXCBConnection;
     } x11xcb;
 
+    struct {
+        void*       handle;
+        GLFWbool    available;
+        int         majorOpcode;
+        int         eventBase;
+        int         errorBase;
+        int         major;
+        int         minor;
+        XIQUERYVERSION_T XIQueryVersion;
+        XISELECTEVENTS_T XISelectEvents;
+    } xi;
+
 #if defined(_GLFW_HAS_XF86VM)
     struct {
         GLFWbool    available;
@@ -62,10 +62,10 @@ void selectDisplayConnection(struct timeval* timeout)
     FD_ZERO(&fds);
     FD_SET(fd, &fds);
 #if defined(__linux__)
-    FD_SET(_glfw.linux_js.inotify, &fds);
+    FD_SET(_glfw.linux_js.changed, &fds);
 
-    if (fd < _glfw.linux_js.inotify)
-        count = _glfw.linux_js.inotify + 1;
+    if (fd < _glfw.linux_js.changed)
+        count = _glfw.linux_js.changed + 1;
 #endif
 
     // NOTE: We use select instead of an X function like XNextEvent, as the
@@ -396,6 +396,23 @@ static void centerCursor(_GLFWwindow* window)
     _glfwPlatformSetCursorPos(window, width / 2.0, height / 2.0);
 }
 
+// Selects or deselects XI2 raw motion events on the root window
+//
+static void selectRawMouseMotion(GLFWbool enabled)
+{
+    XIEventMask em;
+    unsigned char mask[XIMaskLen(XI_RawMotion)] = { 0 };
+
+    em.deviceid = XIAllMasterDevices;
+    em.mask_len = sizeof(mask);
+    em.mask = mask;
+
+    if (enabled)
+        XISetMask(mask, XI_RawMotion);
+
+    _glfw.x11.xi.XISelectEvents(_glfw.x11.display, _glfw.x11.root, &em, 1);
+}
+
 // Updates the cursor image according to its cursor mode
 //
 static void updateCursorImage(_GLFWwindow* window)
@@ -909,6 +926,52 @@ static unsigned int decodeUTF8(const char** s)
 }
 #endif /*X_HAVE_UTF8_STRING*/
 
+// Returns the X server timestamp of the specified input event, or zero if it
+// is not an input event
+//
+static Time getEventTime(const XEvent* event)
+{
+    switch (event->type)
+    {
+        case KeyPress:
+        case KeyRelease:
+            return event->xkey.time;
+        case ButtonPress:
+        case ButtonRelease:
+            return event->xbutton.time;
+        case MotionNotify:
+            return event->xmotion.time;
+        case EnterNotify:
+        case LeaveNotify:
+            return event->xcrossing.time;
+    }
+
+    return 0;
+}
+
+// Translates an X server timestamp to a timer value
+//
+static uint64_t translateTime(Time time)
+{
+    const uint64_t frequency = _glfwPlatformGetTimerFrequency();
+    const uint64_t server = (uint64_t) (time & 0xffffffff) * frequency / 1000;
+    const int64_t offset = (int64_t) (_glfwPlatformGetTimerValue() - server);
+
+    // The clocks are taken to be as far apart as they seem to be for the least
+    // delayed event so far, unless this event seems to be delayed by over
+    // a second more than that, in which case the server time has most likely
+    // wrapped around
+    if (!_glfw.x11.serverTimeKnown ||
+        offset < _glfw.x11.serverTimeOffset ||
+        offset - _glfw.x11.serverTimeOffset > (int64_t) frequency)
+    {
+        _glfw.x11.serverTimeOffset = offset;
+        _glfw.x11.serverTimeKnown = GLFW_TRUE;
+    }
+
+    return server + _glfw.x11.serverTimeOffset;
+}
+
 // Process the specified X event
 //
 static void processEvent(XEvent *event)
@@ -916,6 +979,9 @@ static void processEvent(XEvent *event)
     _GLFWwindow* window = NULL;
     int keycode = 0;
     Bool filtered = False;
+    const Time time = getEventTime(event);
+
+    _glfwInputEventTime(time ? translateTime(time) : 0);
 
     // HACK: Save scancode as some IMs clear the field in XFilterEvent
     if (event->type == KeyPress || event->type == KeyRelease)
@@ -934,14 +1000,51 @@ static void processEvent(XEvent *event)
         }
     }
 
-    if (event->type != GenericEvent)
+    if (event->type == GenericEvent)
     {
-        window = findWindowByHandle(event->xany.window);
-        if (window == NULL)
+        if (_glfw.x11.xi.available &&
+            event->xcookie.extension == _glfw.x11.xi.majorOpcode &&
+            XGetEventData(_glfw.x11.display, &event->xcookie))
         {
-            // This is an event for a window that has already been destroyed
-            return;
+            window = _glfw.x11.disabledCursorWindow;
+
+            if (window &&
+                window->rawMouseMotion &&
+                event->xcookie.evtype == XI_RawMotion)
+            {
+                XIRawEvent* re = event->xcookie.data;
+                if (re->valuators.mask_len)
+                {
+                    const double* values = re->raw_values;
+                    double xpos = window->virtualCursorPosX;
+                    double ypos = window->virtualCursorPosY;
+
+                    // Only the axes that moved have values, in axis order
+                    if (XIMaskIsSet(re->valuators.mask, 0))
+                    {
+                        xpos += *values;
+                        values++;
+                    }
+
+                    if (XIMaskIsSet(re->valuators.mask, 1))
+                        ypos += *values;
+
+                    _glfwInputEventTime(translateTime(re->time));
+                    _glfwInputCursorPos(window, xpos, ypos);
+                }
+            }
+
+            XFreeEventData(_glfw.x11.display, &event->xcookie);
         }
+
+        return;
+    }
+
+    window = findWindowByHandle(event->xany.window);
+    if (window == NULL)
+    {
+        // This is an event for a window that has already been destroyed
+        return;
     }
 
     switch (event->type)
@@ -1184,6 +1287,8 @@ static void processEvent(XEvent *event)
                 {
                     if (_glfw.x11.disabledCursorWindow != window)
                         return;
+                    if (window->rawMouseMotion)
+                        return;
 
                     const int dx = x - window->x11.lastCursorPosX;
                     const int dy = y - window->x11.lastCursorPosY;
@@ -1558,7 +1663,12 @@ int _glfwPlatformCreateWindow(_GLFWwindow* window,
 void _glfwPlatformDestroyWindow(_GLFWwindow* window)
 {
     if (_glfw.x11.disabledCursorWindow == window)
+    {
+        if (window->rawMouseMotion)
+            selectRawMouseMotion(GLFW_FALSE);
+
         _glfw.x11.disabledCursorWindow = NULL;
+    }
 
     if (window->monitor)
         releaseMonitor(window);
@@ -2033,8 +2143,15 @@ void _glfwPlatformPollEvents(void)
         processEvent(&event);
     }
 
-    if (_glfw.x11.disabledCursorWindow)
+    _glfwInputEventTime(0);
+
+    // Raw motion does not depend on where the cursor is, so it is only
+    // re-centered for motion taken from core events
+    if (_glfw.x11.disabledCursorWindow &&
+        !_glfw.x11.disabledCursorWindow->rawMouseMotion)
+    {
         centerCursor(_glfw.x11.disabledCursorWindow);
+    }
 
     XFlush(_glfw.x11.display);
 }
@@ -2084,6 +2201,11 @@ void _glfwPlatformPostEmptyEvent(void)
     XFlush(_glfw.x11.display);
 }
 
+GLFWbool _glfwPlatformRequestWindowFrame(_GLFWwindow* window)
+{
+    return GLFW_FALSE;
+}
+
 void _glfwPlatformGetCursorPos(_GLFWwindow* window, double* xpos, double* ypos)
 {
     Window root, child;
@@ -2125,9 +2247,15 @@ void _glfwPlatformSetCursorMode(_GLFWwindow* window, int mode)
                      ButtonPressMask | ButtonReleaseMask | PointerMotionMask,
                      GrabModeAsync, GrabModeAsync,
                      window->x11.handle, _glfw.x11.cursor, CurrentTime);
+
+        if (window->rawMouseMotion)
+            selectRawMouseMotion(GLFW_TRUE);
     }
     else if (_glfw.x11.disabledCursorWindow == window)
     {
+        if (window->rawMouseMotion)
+            selectRawMouseMotion(GLFW_FALSE);
+
         _glfw.x11.disabledCursorWindow = NULL;
         XUngrabPointer(_glfw.x11.display, CurrentTime);
         _glfwPlatformSetCursorPos(window,
@@ -2139,6 +2267,25 @@ void _glfwPlatformSetCursorMode(_GLFWwindow* window, int mode)
     XFlush(_glfw.x11.display);
 }
 
+GLFWbool _glfwPlatformRawMouseMotionSupported(void)
+{
+    return _glfw.x11.xi.available;
+}
+
+void _glfwPlatformSetRawMouseMotion(_GLFWwindow* window, GLFWbool enabled)
+{
+    if (_glfw.x11.disabledCursorWindow != window)
+        return;
+
+    selectRawMouseMotion(enabled);
+
+    // Core motion needs the cursor kept at the center again
+    if (!enabled)
+        centerCursor(window);
+
+    XFlush(_glfw.x11.display);
+}
+
 const char* _glfwPlatformGetKeyName(int key, int scancode)
 {
     KeySym keysym;
@@ -0,0 +1,203 @@
+// Asynchronous log: messages go into a lock-free ring, and a background thread writes them to the console
+
+#include "async_log.h"
+#include "cpu_profiler.h"
+#include "thread_config.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <thread>
+#include <unordered_map>
+
+// A slot in the ring. Its sequence number says whose turn it is: when it equals the position
+// being written, it's free for that writer, and when it's one past, it's ready for the reader.
+// (The positions count up forever, so a slot's sequence goes up by the ring's size each time round.)
+struct log_entry
+{
+	std::atomic<uint32_t>	sequence;
+	uint32_t				id;
+	log_severity			severity;
+	double					time;
+	char					text[max_log_message];
+};
+
+// Plenty for a frame's worth of even a chatty driver's messages, between the writer's looks
+static const uint32_t log_ring_size = 1024;
+
+static log_entry log_ring[log_ring_size];
+static std::atomic<uint32_t> log_write_position(0);
+static uint32_t log_read_position = 0;				// only the writer thread touches this
+static std::atomic<uint32_t> log_dropped(0);
+static std::atomic<bool> log_writer_running(false);
+static std::atomic<bool> log_writer_quitting(false);
+static std::thread log_writer;
+static std::chrono::steady_clock::time_point log_start_time;
+
+static const char* const log_severity_names[num_log_severities] = { "info", "warning", "error" };
+
+// How long after printing a message others with the same id are held back, and only counted
+static const double log_repeat_window = 1.0;
+
+// What the writer remembers about each id it's seen, for holding back repeats
+struct log_repeats
+{
+	double			printed_time;
+	double			skipped_time;		// when the latest one that was held back came in
+	uint32_t		skipped;
+	log_severity	severity;
+};
+
+// FNV-1a, for ids made from format strings
+static uint32_t hash_string(const char* text)
+{
+	uint32_t hash = 2166136261u;
+	for (; *text; ++text)
+		hash = (hash ^ uint8_t(*text)) * 16777619u;
+	return hash;
+}
+
+static double log_time_now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - log_start_time).count();
+}
+
+static void print_repeats(uint32_t id, const log_repeats& repeats)
+{
+	printf("[%9.3f] (%u more %s messages like that, id %08x)\n", repeats.skipped_time, repeats.skipped, log_severity_names[repeats.severity], id);
+}
+
+// Print everything that's in the ring, apart from repeats, which are counted
+static void drain_log_ring(std::unordered_map<uint32_t, log_repeats>* repeats)
+{
+	for (;;)
+	{
+		log_entry& entry = log_ring[log_read_position % log_ring_size];
+		if (entry.sequence.load(std::memory_order_acquire) != log_read_position + 1)
+			break;
+
+		log_repeats& seen = (*repeats)[entry.id];
+		if (seen.printed_time > 0.0 && entry.time < seen.printed_time + log_repeat_window)
+		{
+			++seen.skipped;
+			seen.skipped_time = entry.time;
+			seen.severity = entry.severity;
+		}
+		else
+		{
+			if (seen.skipped > 0)
+				print_repeats(entry.id, seen);
+			printf("[%9.3f] %s\n", entry.time, entry.text);
+			seen = log_repeats{ entry.time, 0.0, 0, entry.severity };
+		}
+
+		// Hand the slot back to the writers, for their next time round the ring
+		entry.sequence.store(log_read_position + log_ring_size, std::memory_order_release);
+		++log_read_position;
+	}
+
+	uint32_t dropped = log_dropped.exchange(0, std::memory_order_relaxed);
+	if (dropped > 0)
+		printf("[%9.3f] Warning: the log was full, so %u messages were dropped!\n", log_time_now(), dropped);
+}
+
+// Say how many repeats were held back for the ids whose windows are over, or all of them at the end
+static void flush_log_repeats(std::unordered_map<uint32_t, log_repeats>* repeats, bool all)
+{
+	double now = log_time_now();
+	for (auto& id_repeats : *repeats)
+	{
+		log_repeats& seen = id_repeats.second;
+		if (seen.skipped > 0 && (all || now >= seen.printed_time + log_repeat_window))
+		{
+			print_repeats(id_repeats.first, seen);
+			seen.skipped = 0;
+		}
+	}
+}
+
+static void log_writer_main()
+{
+	set_cpu_profiler_thread_name("log writer");
+	set_thread_role(thread_role_background, 0);
+	std::unordered_map<uint32_t, log_repeats> repeats;
+	while (!log_writer_quitting.load(std::memory_order_acquire))
+	{
+		drain_log_ring(&repeats);
+		flush_log_repeats(&repeats, false);
+		fflush(stdout);
+
+		// The writers never wake this, since that could mean waiting on a lock; it just looks
+		// often enough that messages still come out as good as straight away
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	drain_log_ring(&repeats);
+	flush_log_repeats(&repeats, true);
+	fflush(stdout);
+}
+
+void init_async_log()
+{
+	for (uint32_t i = 0; i < log_ring_size; ++i)
+		log_ring[i].sequence.store(i, std::memory_order_relaxed);
+	log_write_position.store(0, std::memory_order_relaxed);
+	log_read_position = 0;
+	log_start_time = std::chrono::steady_clock::now();
+	log_writer_quitting.store(false, std::memory_order_relaxed);
+	log_writer = std::thread(log_writer_main);
+	log_writer_running.store(true, std::memory_order_release);
+}
+
+void shutdown_async_log()
+{
+	if (!log_writer_running.exchange(false, std::memory_order_acq_rel))
+		return;
+	log_writer_quitting.store(true, std::memory_order_release);
+	log_writer.join();
+}
+
+void log_message(log_severity severity, uint32_t id, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	if (!log_writer_running.load(std::memory_order_acquire))
+	{
+		vprintf(format, args);
+		printf("\n");
+		va_end(args);
+		return;
+	}
+
+	// Claim the next slot, unless the reader's still a whole ring behind, in which case the
+	// message is dropped rather than waiting for it
+	uint32_t position = log_write_position.load(std::memory_order_relaxed);
+	log_entry* entry;
+	for (;;)
+	{
+		entry = &log_ring[position % log_ring_size];
+		int32_t lag = int32_t(entry->sequence.load(std::memory_order_acquire) - position);
+		if (lag == 0)
+		{
+			if (log_write_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (lag < 0)
+		{
+			log_dropped.fetch_add(1, std::memory_order_relaxed);
+			va_end(args);
+			return;
+		}
+		else
+		{
+			position = log_write_position.load(std::memory_order_relaxed);
+		}
+	}
+
+	entry->id = id ? id : hash_string(format);
+	entry->severity = severity;
+	entry->time = log_time_now();
+	vsnprintf(entry->text, sizeof(entry->text), format, args);
+	va_end(args);
+	entry->sequence.store(position + 1, std::memory_order_release);
+}
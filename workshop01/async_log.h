@@ -0,0 +1,28 @@
+// Asynchronous log: messages go into a lock-free ring, and a background thread writes them to the console
+#pragma once
+
+#include <cstdint>
+
+enum log_severity
+{
+	log_info,
+	log_warning,
+	log_error,
+	num_log_severities,
+};
+
+// Start the thread that writes the messages out. Until it's running, and after it's stopped, they
+// go straight to the console.
+void init_async_log();
+
+// Write out whatever's still in the ring, and stop the writer thread
+void shutdown_async_log();
+
+// Log a message, formatted like printf, from any thread, without ever waiting on the console or
+// on another thread. The writer thread prints it with when it was logged. Messages with the same
+// id that come in thick and fast are only printed once a second, with how many were skipped
+// meanwhile; 0 means use the format string as the id. If the ring's full, the message is dropped,
+// and the writer says how many were. Messages longer than max_log_message are cut short.
+void log_message(log_severity severity, uint32_t id, const char* format, ...);
+
+static const int max_log_message = 256;
@@ -0,0 +1,131 @@
+// Counter-based random numbers, generated in bulk with SIMD
+
+#include "batch_random.h"
+#include "cpu_features.h"
+
+#if WORKSHOP_X86
+#	include <emmintrin.h>
+#endif
+#if WORKSHOP_NEON
+#	include <arm_neon.h>
+#endif
+
+random_stream make_random_stream(uint32_t seed, uint32_t stream_id)
+{
+	return random_stream{ random_hash(random_hash(seed) ^ (stream_id * 0x9e3779b9u)) };
+}
+
+void fill_random_floats_scalar(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out)
+{
+	for (int i = 0; i < count; ++i)
+		out[i] = random_float(stream, first_counter + uint32_t(i), min, max);
+}
+
+#if WORKSHOP_X86
+// SSE2 has no 32-bit low multiply, so build one from the two 32x32->64 multiplies it does have
+static inline __m128i mullo_epi32_sse2(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128i random_hash_sse2(__m128i x)
+{
+	const __m128i m0 = _mm_set1_epi32(0x7feb352d);
+	const __m128i m1 = _mm_set1_epi32(int(0x846ca68bu));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+	x = mullo_epi32_sse2(x, m0);
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+	x = mullo_epi32_sse2(x, m1);
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+	return x;
+}
+
+void fill_random_floats_sse2(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out)
+{
+	const __m128i key = _mm_set1_epi32(int(stream.key));
+	const __m128 scale = _mm_set1_ps((max - min) * (1.0f / 16777216.0f));
+	const __m128 offset = _mm_set1_ps(min);
+	__m128i counter = _mm_add_epi32(_mm_set1_epi32(int(first_counter)), _mm_setr_epi32(0, 1, 2, 3));
+	const __m128i counter_step = _mm_set1_epi32(4);
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i bits = random_hash_sse2(_mm_xor_si128(random_hash_sse2(counter), key));
+		__m128 value = _mm_cvtepi32_ps(_mm_srli_epi32(bits, 8));
+		_mm_storeu_ps(out + i, _mm_add_ps(offset, _mm_mul_ps(value, scale)));
+		counter = _mm_add_epi32(counter, counter_step);
+	}
+	fill_random_floats_scalar(stream, first_counter + uint32_t(i), count - i, min, max, out + i);
+}
+#else
+void fill_random_floats_sse2(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out)
+{
+	fill_random_floats_scalar(stream, first_counter, count, min, max, out);
+}
+
+void fill_random_floats_avx2(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out)
+{
+	fill_random_floats_scalar(stream, first_counter, count, min, max, out);
+}
+#endif
+
+#if WORKSHOP_NEON
+static inline uint32x4_t random_hash_neon(uint32x4_t x)
+{
+	x = veorq_u32(x, vshrq_n_u32(x, 16));
+	x = vmulq_n_u32(x, 0x7feb352du);
+	x = veorq_u32(x, vshrq_n_u32(x, 15));
+	x = vmulq_n_u32(x, 0x846ca68bu);
+	x = veorq_u32(x, vshrq_n_u32(x, 16));
+	return x;
+}
+
+void fill_random_floats_neon(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out)
+{
+	const uint32x4_t key = vdupq_n_u32(stream.key);
+	const float32x4_t scale = vdupq_n_f32((max - min) * (1.0f / 16777216.0f));
+	const float32x4_t offset = vdupq_n_f32(min);
+	static const uint32_t lane_offsets[4] = { 0, 1, 2, 3 };
+	uint32x4_t counter = vaddq_u32(vdupq_n_u32(first_counter), vld1q_u32(lane_offsets));
+	const uint32x4_t counter_step = vdupq_n_u32(4);
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		uint32x4_t bits = random_hash_neon(veorq_u32(random_hash_neon(counter), key));
+		float32x4_t value = vcvtq_f32_u32(vshrq_n_u32(bits, 8));
+		vst1q_f32(out + i, vmlaq_f32(offset, value, scale));
+		counter = vaddq_u32(counter, counter_step);
+	}
+	fill_random_floats_scalar(stream, first_counter + uint32_t(i), count - i, min, max, out + i);
+}
+#else
+void fill_random_floats_neon(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out)
+{
+	fill_random_floats_scalar(stream, first_counter, count, min, max, out);
+}
+#endif
+
+typedef void (*fill_random_floats_function)(random_stream, uint32_t, int, float, float, float*);
+
+static fill_random_floats_function select_fill_random_floats()
+{
+	const cpu_features& features = get_cpu_features();
+	if (features.avx2)
+		return &fill_random_floats_avx2;
+	if (features.sse2)
+		return &fill_random_floats_sse2;
+	if (features.neon)
+		return &fill_random_floats_neon;
+	return &fill_random_floats_scalar;
+}
+
+void fill_random_floats(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out)
+{
+	// Picked once, the first time through; C++11 makes this initialization thread-safe
+	static const fill_random_floats_function fill = select_fill_random_floats();
+	fill(stream, first_counter, count, min, max, out);
+}
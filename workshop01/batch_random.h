@@ -0,0 +1,50 @@
+// Counter-based random numbers, generated in bulk with SIMD. Each number is a pure function of a
+// stream key and a counter, so there's no hidden state: any thread can generate any part of a
+// stream, and the results are the same however the work is split up.
+#pragma once
+
+#include <cstdint>
+
+// A stream of random numbers. Different streams (different seeds or stream ids) are independent.
+struct random_stream
+{
+	uint32_t key;
+};
+
+// Make a stream from a seed (e.g. per run) and a stream id (e.g. per emitter, per field)
+random_stream make_random_stream(uint32_t seed, uint32_t stream_id);
+
+// Integer hash with good avalanche (Chris Wellons' "lowbias32"). The SIMD versions do exactly this.
+inline uint32_t random_hash(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// The random bits for one counter value in a stream
+inline uint32_t random_bits(random_stream stream, uint32_t counter)
+{
+	return random_hash(random_hash(counter) ^ stream.key);
+}
+
+// A single random float in [min, max), using the top 24 bits. This is written to round the same
+// way as the SIMD versions.
+inline float random_float(random_stream stream, uint32_t counter, float min, float max)
+{
+	float scale = (max - min) * (1.0f / 16777216.0f);
+	return min + float(random_bits(stream, counter) >> 8) * scale;
+}
+
+// Fill out[0, count) with random floats in [min, max): out[i] gets the number for counter
+// first_counter + i, the same as random_float() would compute it. Uses the widest SIMD available.
+void fill_random_floats(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out);
+
+// The individual implementations, for testing and dispatch
+void fill_random_floats_scalar(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out);
+void fill_random_floats_sse2(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out);
+void fill_random_floats_avx2(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out);
+void fill_random_floats_neon(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out);
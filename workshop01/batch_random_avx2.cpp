@@ -0,0 +1,45 @@
+// AVX2 bulk random number generation. This file is compiled with AVX2 code generation enabled
+// (see CMakeLists.txt), so nothing in here may run unless get_cpu_features().avx2 is set.
+
+#include "batch_random.h"
+#include "cpu_features.h"
+
+#if WORKSHOP_X86
+
+#include <immintrin.h>
+
+static inline __m256i random_hash_avx2(__m256i x)
+{
+	const __m256i m0 = _mm256_set1_epi32(0x7feb352d);
+	const __m256i m1 = _mm256_set1_epi32(int(0x846ca68bu));
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+	x = _mm256_mullo_epi32(x, m0);
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+	x = _mm256_mullo_epi32(x, m1);
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+	return x;
+}
+
+void fill_random_floats_avx2(random_stream stream, uint32_t first_counter, int count, float min, float max, float* out)
+{
+	const __m256i key = _mm256_set1_epi32(int(stream.key));
+	const __m256 scale = _mm256_set1_ps((max - min) * (1.0f / 16777216.0f));
+	const __m256 offset = _mm256_set1_ps(min);
+	__m256i counter = _mm256_add_epi32(_mm256_set1_epi32(int(first_counter)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	const __m256i counter_step = _mm256_set1_epi32(8);
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i bits = random_hash_avx2(_mm256_xor_si256(random_hash_avx2(counter), key));
+		__m256 value = _mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 8));
+		_mm256_storeu_ps(out + i, _mm256_add_ps(offset, _mm256_mul_ps(value, scale)));
+		counter = _mm256_add_epi32(counter, counter_step);
+	}
+
+	// Avoid AVX-SSE transition penalties in the scalar tail and whatever runs next
+	_mm256_zeroupper();
+	fill_random_floats_scalar(stream, first_counter + uint32_t(i), count - i, min, max, out + i);
+}
+
+#endif // WORKSHOP_X86
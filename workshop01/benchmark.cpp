@@ -0,0 +1,118 @@
+// Benchmark mode: records timings for every frame of a fixed run, and reports their percentiles as JSON
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+int add_benchmark_series(benchmark_recorder* recorder, const char* group, const char* name)
+{
+	benchmark_series series;
+	series.group = group;
+	series.name = name;
+	recorder->series.push_back(series);
+	return int(recorder->series.size()) - 1;
+}
+
+// Write a string as a JSON string literal. The GL strings are the only ones that come from
+// outside, but it doesn't hurt to escape everything.
+static void write_json_string(FILE* file, const char* text)
+{
+	fputc('"', file);
+	for (const char* c = text ? text : ""; *c; ++c)
+	{
+		if (*c == '"' || *c == '\\')
+			fprintf(file, "\\%c", *c);
+		else if ((unsigned char)(*c) < 0x20)
+			fprintf(file, "\\u%04x", unsigned(*c));
+		else
+			fputc(*c, file);
+	}
+	fputc('"', file);
+}
+
+// Nearest-rank percentile of samples that are already sorted
+static float sorted_percentile(const std::vector<float>& sorted, double percentile)
+{
+	size_t rank = size_t(ceil(percentile / 100.0 * double(sorted.size())));
+	return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+}
+
+static void write_series_stats(FILE* file, const benchmark_series& series)
+{
+	std::vector<float> sorted = series.samples_ms;
+	std::sort(sorted.begin(), sorted.end());
+	double total = 0.0;
+	for (float ms : sorted)
+		total += ms;
+
+	fprintf(file, "{ \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"mean\": %.4f, \"max\": %.4f, \"samples\": %d }",
+		sorted_percentile(sorted, 50.0), sorted_percentile(sorted, 95.0), sorted_percentile(sorted, 99.0),
+		total / double(sorted.size()), sorted.back(), int(sorted.size()));
+}
+
+bool write_benchmark_report(const benchmark_recorder& recorder, const benchmark_settings& settings, const char* filename)
+{
+	FILE* file = fopen(filename, "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "{\n\t\"settings\": {\n");
+	fprintf(file, "\t\t\"frames\": %d,\n", settings.frames);
+	fprintf(file, "\t\t\"warmup_frames\": %d,\n", settings.warmup_frames);
+	fprintf(file, "\t\t\"particles\": %d,\n", settings.particles);
+	fprintf(file, "\t\t\"particles_per_second\": %g,\n", settings.particles_per_second);
+	fprintf(file, "\t\t\"emitters\": %d,\n", settings.emitters);
+	fprintf(file, "\t\t\"seed\": %u,\n", settings.seed);
+	fprintf(file, "\t\t\"sim_rate\": %g,\n", settings.sim_rate);
+	fprintf(file, "\t\t\"sim_mode\": ");
+	write_json_string(file, settings.sim_mode);
+	fprintf(file, ",\n\t\t\"sort\": ");
+	write_json_string(file, settings.sort_order);
+	fprintf(file, ",\n\t\t\"threads\": %d,\n", settings.threads);
+	fprintf(file, "\t\t\"framebuffer\": [%d, %d],\n", settings.framebuffer_width, settings.framebuffer_height);
+	fprintf(file, "\t\t\"gl_renderer\": ");
+	write_json_string(file, settings.gl_renderer);
+	fprintf(file, ",\n\t\t\"gl_version\": ");
+	write_json_string(file, settings.gl_version);
+	fprintf(file, ",\n\t\t\"wall_seconds\": %.4f\n\t}", settings.wall_seconds);
+
+	// Ungrouped series go at the top level, as "<name>_ms"; the rest are gathered into an object
+	// per group, "<group>_ms", in the order the groups first appear
+	std::vector<std::string> groups;
+	for (const benchmark_series& series : recorder.series)
+	{
+		if (series.samples_ms.empty())
+			continue;
+		if (series.group.empty())
+		{
+			fprintf(file, ",\n\t\"%s_ms\": ", series.name.c_str());
+			write_series_stats(file, series);
+		}
+		else if (std::find(groups.begin(), groups.end(), series.group) == groups.end())
+		{
+			groups.push_back(series.group);
+		}
+	}
+
+	for (const std::string& group : groups)
+	{
+		fprintf(file, ",\n\t\"%s_ms\": {", group.c_str());
+		bool first = true;
+		for (const benchmark_series& series : recorder.series)
+		{
+			if (series.group != group || series.samples_ms.empty())
+				continue;
+			fprintf(file, "%s\n\t\t\"%s\": ", first ? "" : ",", series.name.c_str());
+			write_series_stats(file, series);
+			first = false;
+		}
+		fprintf(file, "\n\t}");
+	}
+	fprintf(file, "\n}\n");
+
+	bool ok = !ferror(file);
+	ok = (fclose(file) == 0) && ok;
+	return ok;
+}
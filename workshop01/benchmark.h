@@ -0,0 +1,52 @@
+// Benchmark mode: records timings for every frame of a fixed run, and reports their percentiles as JSON
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One timing recorded every frame, such as a frame's length or a pass's time on the GPU
+struct benchmark_series
+{
+	std::string			group;		// "cpu" or "gpu"; the frame time itself has no group
+	std::string			name;
+	std::vector<float>	samples_ms;
+};
+
+struct benchmark_recorder
+{
+	std::vector<benchmark_series>	series;
+};
+
+// What the run was, to go in the report alongside its timings
+struct benchmark_settings
+{
+	int			frames;				// recorded, after the warmup
+	int			warmup_frames;
+	int			particles;			// capacity
+	float		particles_per_second;
+	int			emitters;
+	uint32_t	seed;
+	double		sim_rate;			// steps per second, and the run takes exactly one step a frame
+	const char*	sim_mode;
+	const char*	sort_order;
+	int			threads;
+	int			framebuffer_width;
+	int			framebuffer_height;
+	const char*	gl_renderer;
+	const char*	gl_version;
+	double		wall_seconds;		// how long the recorded frames took in all
+};
+
+// Add a series to record, returning its index for add_benchmark_sample()
+int add_benchmark_series(benchmark_recorder* recorder, const char* group, const char* name);
+
+inline void add_benchmark_sample(benchmark_recorder* recorder, int series, float ms)
+{
+	recorder->series[series].samples_ms.push_back(ms);
+}
+
+// Write the settings, then the p50, p95, p99, mean and max of every series, as a JSON object.
+// Series with no samples (say, GPU passes that never ran) are left out. Returns false if the
+// file couldn't be written.
+bool write_benchmark_report(const benchmark_recorder& recorder, const benchmark_settings& settings, const char* filename);
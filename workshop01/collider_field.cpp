@@ -0,0 +1,215 @@
+// Static colliders: simple shapes baked into a signed distance field, which the particles bounce off
+
+#include "collider_field.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Jobs below this many items aren't worth handing to another thread
+static const int field_job_alignment = 1024;
+
+bool load_collider_shapes(const char* filename, std::vector<collider_shape>* o_shapes)
+{
+	FILE* file = fopen(filename, "r");
+	if (!file)
+	{
+		printf("Warning: couldn't open collider file %s!\n", filename);
+		return false;
+	}
+
+	std::vector<collider_shape> shapes;
+	char line[256];
+	int line_number = 0;
+	bool ok = true;
+	while (fgets(line, sizeof(line), file))
+	{
+		++line_number;
+		if (char* comment = strchr(line, '#'))
+			*comment = '\0';
+
+		char type[16];
+		collider_shape shape = {};
+		int num_read = sscanf(line, "%15s %f %f %f %f", type, &shape.center[0], &shape.center[1], &shape.extent[0], &shape.extent[1]);
+		if (num_read <= 0)
+			continue;
+		if (strcmp(type, "circle") == 0 && num_read == 4)
+			shape.type = collider_circle;
+		else if (strcmp(type, "box") == 0 && num_read == 5)
+			shape.type = collider_box;
+		else if (strcmp(type, "plane") == 0 && num_read == 5 && (shape.extent[0] != 0.0f || shape.extent[1] != 0.0f))
+			shape.type = collider_plane;
+		else
+		{
+			printf("Warning: %s(%d): expected circle x y radius, box x y half_width half_height, or plane x y normal_x normal_y!\n", filename, line_number);
+			ok = false;
+			break;
+		}
+		shapes.push_back(shape);
+	}
+	fclose(file);
+
+	if (ok)
+		o_shapes->swap(shapes);
+	return ok;
+}
+
+static float shape_distance(const collider_shape& shape, float x, float y)
+{
+	float dx = x - shape.center[0];
+	float dy = y - shape.center[1];
+	switch (shape.type)
+	{
+	case collider_circle:
+		return sqrtf(dx * dx + dy * dy) - shape.extent[0];
+	case collider_box:
+	{
+		// Outside, the distance to the nearest point on the box; inside, to the nearest side
+		float qx = fabsf(dx) - shape.extent[0];
+		float qy = fabsf(dy) - shape.extent[1];
+		float outside_x = std::max(qx, 0.0f);
+		float outside_y = std::max(qy, 0.0f);
+		return sqrtf(outside_x * outside_x + outside_y * outside_y) + std::min(std::max(qx, qy), 0.0f);
+	}
+	case collider_plane:
+	{
+		float length = sqrtf(shape.extent[0] * shape.extent[0] + shape.extent[1] * shape.extent[1]);
+		return (dx * shape.extent[0] + dy * shape.extent[1]) / length;
+	}
+	}
+	return INFINITY;
+}
+
+// What the bake jobs share
+struct field_bake
+{
+	collider_field*			field;
+	const collider_shape*	shapes;
+	int						num_shapes;
+};
+
+static void bake_rows_job(void* data, int begin, int end)
+{
+	const field_bake* bake = (const field_bake*)data;
+	collider_field* field = bake->field;
+	for (int row = begin; row < end; ++row)
+	{
+		float y = field->origin[1] + float(row) * field->cell_size;
+		float* distances = &field->distances[size_t(row) * field->width];
+		for (int column = 0; column < field->width; ++column)
+		{
+			float x = field->origin[0] + float(column) * field->cell_size;
+			float distance = INFINITY;
+			for (int shape = 0; shape < bake->num_shapes; ++shape)
+				distance = std::min(distance, shape_distance(bake->shapes[shape], x, y));
+			distances[column] = distance;
+		}
+	}
+}
+
+bool bake_collider_field(collider_field* field, const collider_shape* shapes, int num_shapes, const float min[2], const float max[2], float cell_size)
+{
+	free_collider_field(field);
+	int width = int(ceilf((max[0] - min[0]) / cell_size)) + 1;
+	int height = int(ceilf((max[1] - min[1]) / cell_size)) + 1;
+	field->distances = (float*)malloc(size_t(width) * size_t(height) * sizeof(float));
+	if (!field->distances)
+		return false;
+	field->width = width;
+	field->height = height;
+	field->origin[0] = min[0];
+	field->origin[1] = min[1];
+	field->cell_size = cell_size;
+
+	// A row is plenty of work for a job
+	field_bake bake = { field, shapes, num_shapes };
+	parallel_for(height, 1, &bake_rows_job, &bake);
+	return true;
+}
+
+void free_collider_field(collider_field* field)
+{
+	free(field->distances);
+	*field = collider_field{};
+}
+
+// Bilinearly filter the samples around (x, y), in sample units, which has to be inside the field
+static inline float sample_field(const collider_field& field, float x, float y)
+{
+	int column = std::min(int(x), field.width - 2);
+	int row = std::min(int(y), field.height - 2);
+	float fx = x - float(column);
+	float fy = y - float(row);
+	const float* below = &field.distances[size_t(row) * field.width + column];
+	const float* above = below + field.width;
+	float bottom = below[0] + fx * (below[1] - below[0]);
+	float top = above[0] + fx * (above[1] - above[0]);
+	return bottom + fy * (top - bottom);
+}
+
+// What the collision jobs share
+struct field_collision
+{
+	const collider_field*	field;
+	particle_store*			store;
+	int						first;
+	float					restitution;
+};
+
+static void collide_with_field_job(void* data, int begin, int end)
+{
+	const field_collision* collision = (const field_collision*)data;
+	const collider_field& field = *collision->field;
+	particle_store* store = collision->store;
+	float inv_cell_size = 1.0f / field.cell_size;
+	for (int i = collision->first + begin, last = collision->first + end; i < last; ++i)
+	{
+		float size = store->size[i];
+		if (size == 0.0f)
+			continue;
+
+		// Leave room for a sample either side, for the gradient
+		float x = (store->position_x[i] - field.origin[0]) * inv_cell_size;
+		float y = (store->position_y[i] - field.origin[1]) * inv_cell_size;
+		if (!(x >= 1.0f && x <= float(field.width - 2) && y >= 1.0f && y <= float(field.height - 2)))
+			continue;
+		float distance = sample_field(field, x, y) - size;
+		if (distance >= 0.0f)
+			continue;
+
+		// The way out is up the gradient
+		float normal_x = sample_field(field, x + 1.0f, y) - sample_field(field, x - 1.0f, y);
+		float normal_y = sample_field(field, x, y + 1.0f) - sample_field(field, x, y - 1.0f);
+		float length = sqrtf(normal_x * normal_x + normal_y * normal_y);
+		if (length == 0.0f)
+			continue;
+		normal_x /= length;
+		normal_y /= length;
+
+		store->position_x[i] -= normal_x * distance;
+		store->position_y[i] -= normal_y * distance;
+		float approach = store->velocity_x[i] * normal_x + store->velocity_y[i] * normal_y;
+		if (approach < 0.0f)
+		{
+			store->velocity_x[i] -= (1.0f + collision->restitution) * approach * normal_x;
+			store->velocity_y[i] -= (1.0f + collision->restitution) * approach * normal_y;
+		}
+	}
+}
+
+void collide_particles_with_field(const collider_field& field, particle_store* store, float restitution)
+{
+	if (!field.distances)
+		return;
+
+	particle_range ranges[2];
+	int num_ranges = get_live_particle_ranges(*store, ranges);
+	for (int range = 0; range < num_ranges; ++range)
+	{
+		field_collision collision = { &field, store, ranges[range].first, restitution };
+		parallel_for(ranges[range].count, field_job_alignment, &collide_with_field_job, &collision);
+	}
+}
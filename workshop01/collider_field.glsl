@@ -0,0 +1,38 @@
+// The static colliders' signed distance field (see collider_field.h), for the GPU simulations.
+// This bounces particles off them the same way collide_particles_with_field() does on the CPU.
+
+uniform bool use_collider_field;
+uniform sampler2D collider_field;		// a texel per sample, linearly filtered
+uniform vec2 collider_field_origin;		// where the first sample is, in world space
+uniform float collider_field_scale;		// samples per world unit
+uniform float collider_restitution;
+
+float sample_collider_field(vec2 samples)
+{
+	return texture(collider_field, (samples + 0.5) / vec2(textureSize(collider_field, 0))).r;
+}
+
+void collide_with_field(inout vec2 position, inout vec2 velocity, float size)
+{
+	// Leave room for a sample either side, for the gradient
+	vec2 samples = (position - collider_field_origin) * collider_field_scale;
+	vec2 field_size = vec2(textureSize(collider_field, 0));
+	if (!use_collider_field || size == 0.0 || any(lessThan(samples, vec2(1.0))) || any(greaterThan(samples, field_size - 2.0)))
+		return;
+	float distance = sample_collider_field(samples) - size;
+	if (distance >= 0.0)
+		return;
+
+	// The way out is up the gradient
+	vec2 normal = vec2(
+		sample_collider_field(samples + vec2(1.0, 0.0)) - sample_collider_field(samples - vec2(1.0, 0.0)),
+		sample_collider_field(samples + vec2(0.0, 1.0)) - sample_collider_field(samples - vec2(0.0, 1.0)));
+	if (normal == vec2(0.0))
+		return;
+	normal = normalize(normal);
+
+	position -= normal * distance;
+	float approach = dot(velocity, normal);
+	if (approach < 0.0)
+		velocity -= (1.0 + collider_restitution) * approach * normal;
+}
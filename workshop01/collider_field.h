@@ -0,0 +1,51 @@
+// Static colliders: simple shapes baked into a signed distance field, which the particles bounce off
+#pragma once
+
+#include "particle_store.h"
+
+#include <vector>
+
+enum collider_shape_type
+{
+	collider_circle,	// center, and the radius in extent[0]
+	collider_box,		// center, and half the size along each axis in extent
+	collider_plane,		// a point on the line in center, and the normal, pointing out of the solid side, in extent
+};
+
+struct collider_shape
+{
+	collider_shape_type	type;
+	float				center[2];
+	float				extent[2];
+};
+
+// Distances to the nearest shape's surface, sampled on a grid, negative inside them. However many
+// shapes there are, a particle only ever takes a few samples, so they're free to add. The same
+// samples go to the GPU simulations as a texture, in collider_field.glsl, which samples them the
+// same way collide_with_collider_field() does.
+struct collider_field
+{
+	float*	distances;		// width * height of them, a row at a time from the bottom
+	int		width;
+	int		height;
+	float	origin[2];		// where the first sample is, in world space
+	float	cell_size;		// world units between samples
+};
+
+// Read shapes from a text file, a line each: "circle x y radius", "box x y half_width half_height",
+// or "plane x y normal_x normal_y". Blank lines, and anything after a #, are ignored. Returns false,
+// and says why, if the file can't be read or has something else in it.
+bool load_collider_shapes(const char* filename, std::vector<collider_shape>* o_shapes);
+
+// Sample the shapes' distance field over the box from 'min' to 'max', 'cell_size' apart, spreading
+// the rows across the job system's threads. Returns false, leaving the field empty, if it couldn't
+// allocate the samples.
+bool bake_collider_field(collider_field* field, const collider_shape* shapes, int num_shapes, const float min[2], const float max[2], float cell_size);
+
+// Release the samples and reset the field to empty
+void free_collider_field(collider_field* field);
+
+// Push every live particle whose bounding circle is inside a collider back out to its surface, and
+// bounce it off with the given coefficient of restitution. Particles outside the field's box are
+// left alone.
+void collide_particles_with_field(const collider_field& field, particle_store* store, float restitution);
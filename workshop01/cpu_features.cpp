@@ -0,0 +1,80 @@
+// Runtime detection of the SIMD instruction sets supported by the CPU we're running on
+
+#include "cpu_features.h"
+
+#if WORKSHOP_X86
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#	else
+#		include <cpuid.h>
+#	endif
+#endif
+
+#if WORKSHOP_X86
+static void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4])
+{
+#ifdef _MSC_VER
+	int msvc_regs[4];
+	__cpuidex(msvc_regs, int(leaf), int(subleaf));
+	for (int i = 0; i < 4; ++i)
+		regs[i] = unsigned(msvc_regs[i]);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Read extended control register 0, which says which register sets the OS preserves
+static unsigned long long xgetbv0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (unsigned long long)edx << 32 | eax;
+#endif
+}
+
+static cpu_features detect_cpu_features()
+{
+	cpu_features features = {};
+
+	unsigned regs[4];
+	cpuid(0, 0, regs);
+	unsigned max_leaf = regs[0];
+	if (max_leaf < 1)
+		return features;
+
+	cpuid(1, 0, regs);
+	features.sse2 = (regs[3] & (1u << 26)) != 0;
+
+	// AVX2 needs the CPU to support it *and* the OS to save the upper halves of the YMM
+	// registers (XCR0 bits 1 and 2), otherwise using it would corrupt other threads' state.
+	bool osxsave = (regs[2] & (1u << 27)) != 0;
+	bool avx = (regs[2] & (1u << 28)) != 0;
+	if (osxsave && avx && (xgetbv0() & 0x6) == 0x6 && max_leaf >= 7)
+	{
+		cpuid(7, 0, regs);
+		features.avx2 = (regs[1] & (1u << 5)) != 0;
+	}
+
+	return features;
+}
+#else
+static cpu_features detect_cpu_features()
+{
+	cpu_features features = {};
+#if WORKSHOP_NEON
+	// NEON is a mandatory part of ARMv8, and we only build the NEON kernels when the compiler
+	// is already targeting it, so there's nothing to check at runtime.
+	features.neon = true;
+#endif
+	return features;
+}
+#endif
+
+const cpu_features& get_cpu_features()
+{
+	static const cpu_features features = detect_cpu_features();
+	return features;
+}
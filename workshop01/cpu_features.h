@@ -0,0 +1,20 @@
+// Runtime detection of the SIMD instruction sets supported by the CPU we're running on
+#pragma once
+
+// Which instruction set family we're compiling for. This decides which kernels get built at all;
+// cpu_features then decides at startup which of the built kernels this particular CPU can run.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define WORKSHOP_X86 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#	define WORKSHOP_NEON 1
+#endif
+
+struct cpu_features
+{
+	bool sse2;
+	bool avx2;			// only set if the OS also saves the YMM registers on context switches
+	bool neon;
+};
+
+// Query the CPU (via CPUID on x86). The result doesn't change, so it's computed once and cached.
+const cpu_features& get_cpu_features();
@@ -0,0 +1,189 @@
+// CPU profiler: scoped markers recorded into a lock-free ring per thread, dumped as a Chrome trace
+
+#include "cpu_profiler.h"
+
+#if CPU_PROFILER
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The fields are atomic so that writing the trace can read a ring while its thread is still
+// recording into it. Relaxed loads and stores of these are plain moves, so recording stays cheap.
+struct cpu_profiler_sample
+{
+	std::atomic<const char*>	name;
+	std::atomic<uint64_t>		begin_ns;
+	std::atomic<uint64_t>		end_ns;
+};
+
+// One thread's samples. Only the owning thread writes to it; it publishes each sample by
+// bumping 'head' once the sample's written.
+struct cpu_profiler_ring
+{
+	cpu_profiler_sample		samples[cpu_profiler_ring_size];
+	std::atomic<uint64_t>	head;			// how many samples have ever been recorded
+	char					name[32];
+	int						id;
+	bool					in_use;			// owned by a running thread (under rings_lock)
+};
+
+// Every ring ever made. They outlive their threads, so the trace still has the samples from
+// threads that have exited.
+static std::mutex										rings_lock;
+static std::vector<std::unique_ptr<cpu_profiler_ring>>	rings;
+
+// Hands the current thread's ring back when the thread exits, so another can take it on
+struct cpu_profiler_thread
+{
+	cpu_profiler_ring* ring = nullptr;
+
+	~cpu_profiler_thread()
+	{
+		if (ring)
+		{
+			std::lock_guard<std::mutex> guard(rings_lock);
+			ring->in_use = false;
+		}
+	}
+};
+
+static thread_local cpu_profiler_thread this_thread;
+
+// Find or make the ring for a thread with the given name; one that's free and already has that
+// name is reused. Called with rings_lock held.
+static cpu_profiler_ring* claim_cpu_profiler_ring(const char* name)
+{
+	for (const std::unique_ptr<cpu_profiler_ring>& ring : rings)
+	{
+		if (!ring->in_use && strcmp(ring->name, name) == 0)
+		{
+			ring->in_use = true;
+			return ring.get();
+		}
+	}
+
+	std::unique_ptr<cpu_profiler_ring> ring(new cpu_profiler_ring);
+	ring->head.store(0, std::memory_order_relaxed);
+	snprintf(ring->name, sizeof(ring->name), "%s", name);
+	ring->id = int(rings.size()) + 1;
+	ring->in_use = true;
+	rings.push_back(std::move(ring));
+	return rings.back().get();
+}
+
+void set_cpu_profiler_thread_name(const char* name)
+{
+	std::lock_guard<std::mutex> guard(rings_lock);
+	if (this_thread.ring)
+	{
+		if (strcmp(this_thread.ring->name, name) == 0)
+			return;
+		this_thread.ring->in_use = false;
+	}
+	this_thread.ring = claim_cpu_profiler_ring(name);
+}
+
+void record_cpu_profiler_sample(const char* name, uint64_t begin_ns, uint64_t end_ns)
+{
+	// Threads that never named themselves get a ring the first time they record anything
+	cpu_profiler_ring* ring = this_thread.ring;
+	if (!ring)
+	{
+		std::lock_guard<std::mutex> guard(rings_lock);
+		char thread_name[32];
+		snprintf(thread_name, sizeof(thread_name), "thread %d", int(rings.size()) + 1);
+		ring = this_thread.ring = claim_cpu_profiler_ring(thread_name);
+	}
+
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	cpu_profiler_sample& sample = ring->samples[head % cpu_profiler_ring_size];
+	sample.name.store(name, std::memory_order_relaxed);
+	sample.begin_ns.store(begin_ns, std::memory_order_relaxed);
+	sample.end_ns.store(end_ns, std::memory_order_relaxed);
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+struct cpu_trace_event
+{
+	const char*	name;
+	uint64_t	begin_ns;
+	uint64_t	end_ns;
+	int			thread_id;
+};
+
+// Copy out a ring's samples. The thread may overwrite the oldest ones while we're copying, so
+// we check how far it got afterwards and throw away any it could have been writing over.
+static void copy_cpu_profiler_ring(const cpu_profiler_ring& ring, std::vector<cpu_trace_event>* out)
+{
+	uint64_t head = ring.head.load(std::memory_order_acquire);
+	uint64_t first = (head > uint64_t(cpu_profiler_ring_size)) ? head - cpu_profiler_ring_size : 0;
+	size_t out_begin = out->size();
+	for (uint64_t i = first; i < head; ++i)
+	{
+		const cpu_profiler_sample& sample = ring.samples[i % cpu_profiler_ring_size];
+		cpu_trace_event event =
+		{
+			sample.name.load(std::memory_order_relaxed),
+			sample.begin_ns.load(std::memory_order_relaxed),
+			sample.end_ns.load(std::memory_order_relaxed),
+			ring.id,
+		};
+		out->push_back(event);
+	}
+
+	// Sample i is intact unless the thread has since started on sample i + ring size
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t new_head = ring.head.load(std::memory_order_relaxed);
+	uint64_t first_intact = (new_head + 1 > uint64_t(cpu_profiler_ring_size)) ? new_head + 1 - cpu_profiler_ring_size : 0;
+	if (first_intact > first)
+	{
+		size_t num_torn = size_t(std::min(first_intact, head) - first);
+		out->erase(out->begin() + out_begin, out->begin() + out_begin + num_torn);
+	}
+}
+
+bool write_cpu_trace(const char* filename)
+{
+	std::vector<cpu_trace_event> events;
+	std::vector<std::pair<int, std::string>> thread_names;
+	{
+		std::lock_guard<std::mutex> guard(rings_lock);
+		for (const std::unique_ptr<cpu_profiler_ring>& ring : rings)
+		{
+			copy_cpu_profiler_ring(*ring, &events);
+			thread_names.emplace_back(ring->id, ring->name);
+		}
+	}
+
+	FILE* file = fopen(filename, "w");
+	if (!file)
+		return false;
+
+	// Times are in microseconds in the trace, relative to the earliest sample
+	uint64_t start_ns = UINT64_MAX;
+	for (const cpu_trace_event& event : events)
+		start_ns = std::min(start_ns, event.begin_ns);
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"workshop01\"}}");
+	for (const std::pair<int, std::string>& thread_name : thread_names)
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", thread_name.first, thread_name.second.c_str());
+	for (const cpu_trace_event& event : events)
+	{
+		fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			event.name, event.thread_id, double(event.begin_ns - start_ns) * 1e-3, double(event.end_ns - event.begin_ns) * 1e-3);
+	}
+	fprintf(file, "\n]}\n");
+
+	bool ok = !ferror(file);
+	ok = (fclose(file) == 0) && ok;
+	return ok;
+}
+
+#endif
@@ -0,0 +1,52 @@
+// CPU profiler: scoped markers recorded into a lock-free ring per thread, dumped as a Chrome trace
+#pragma once
+
+// Everything here compiles away to nothing unless the build turns on CPU_PROFILER (see the
+// WORKSHOP01_CPU_PROFILER option in CMakeLists.txt), so the markers can stay in the code for good.
+#if CPU_PROFILER
+
+#include <chrono>
+#include <cstdint>
+
+// Each thread keeps its most recent samples, overwriting the oldest ones once its ring is full
+static const int cpu_profiler_ring_size = 1 << 15;
+
+inline uint64_t cpu_profiler_now()
+{
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Record a sample on the current thread. The name must be a string literal (or otherwise live
+// until the trace is written), and is written into the JSON as is.
+void record_cpu_profiler_sample(const char* name, uint64_t begin_ns, uint64_t end_ns);
+
+// Times the rest of the enclosing scope; use it through CPU_PROFILE_SCOPE()
+struct cpu_profile_scope
+{
+	const char*	name;
+	uint64_t	begin_ns;
+
+	explicit cpu_profile_scope(const char* name) : name(name), begin_ns(cpu_profiler_now()) {}
+	~cpu_profile_scope() { record_cpu_profiler_sample(name, begin_ns, cpu_profiler_now()); }
+};
+
+#define CPU_PROFILE_CONCAT_INNER(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_INNER(a, b)
+#define CPU_PROFILE_SCOPE(name) cpu_profile_scope CPU_PROFILE_CONCAT(cpu_profile_scope_, __LINE__)(name)
+
+// Name the current thread in the trace. A thread that takes the name of one that's exited
+// carries on its ring, so a thread that's restarted stays on one row of the timeline.
+void set_cpu_profiler_thread_name(const char* name);
+
+// Write every thread's samples to a file in the Chrome trace event format, which
+// chrome://tracing and ui.perfetto.dev can both open. Threads can go on recording meanwhile.
+// Returns false if the file couldn't be written.
+bool write_cpu_trace(const char* filename);
+
+#else
+
+#define CPU_PROFILE_SCOPE(name) ((void)0)
+
+inline void set_cpu_profiler_thread_name(const char*) {}
+
+#endif
@@ -0,0 +1,302 @@
+// CPU raytracer: traces the raytraced scene in packets of rays across the job system, for machines with no GPU to do it
+
+#include "cpu_raytracer.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+// Deep enough for any tree the BVH builder makes, as in fragment_shader_raytrace.glsl
+static const int max_bvh_stack = 64;
+
+// The most jobs a frame's tiles are split into. The particles are usually bunched up in a few of
+// them, so there are plenty of jobs for the threads to steal from each other.
+static const int max_raytrace_jobs = 256;
+
+// The particles' golden yellow, in linear color, as in raytrace_shading.glsl
+static const float particle_color[3] = { 1.0f, powf(0.79f, 2.2f), powf(0.03f, 2.2f) };
+
+// The sky, already gamma corrected: it's the same as the color the GL raytracer clears to
+static const uint8_t sky_pixel[4] = { 0, 153, 255, 255 };
+
+// Gamma correction, from linear color to 8 bits, through a table, as powf() for every channel of
+// every pixel would cost more than tracing them
+static const int gamma_table_size = 4096;
+
+struct gamma_table
+{
+	uint8_t	values[gamma_table_size + 1];
+
+	gamma_table()
+	{
+		for (int i = 0; i <= gamma_table_size; ++i)
+			values[i] = uint8_t(powf(float(i) / float(gamma_table_size), 1.0f / 2.2f) * 255.0f + 0.5f);
+	}
+};
+
+static uint8_t gamma_correct(float linear)
+{
+	static const gamma_table table;
+	return table.values[int(std::min(std::max(linear, 0.0f), 1.0f) * float(gamma_table_size) + 0.5f)];
+}
+
+bool resize_cpu_raytrace_image(cpu_raytrace_image* image, int width, int height)
+{
+	int size = width * height;
+	if (size > image->capacity)
+	{
+		free(image->pixels);
+		image->pixels = (uint8_t*)malloc(size_t(size) * 4);
+		if (!image->pixels)
+		{
+			free_cpu_raytrace_image(image);
+			return false;
+		}
+		image->capacity = size;
+	}
+	image->width = width;
+	image->height = height;
+	return true;
+}
+
+void free_cpu_raytrace_image(cpu_raytrace_image* image)
+{
+	free(image->pixels);
+	*image = cpu_raytrace_image{};
+}
+
+// A packet of rays, all from the camera, with each of their components in an array of its own, so
+// the loops over them are over contiguous floats
+struct ray_packet
+{
+	float	origin[3];
+	float	direction[3][cpu_raytrace_packet_size];			// normalized, so hit distances are along them
+	float	inv_direction[3][cpu_raytrace_packet_size];
+	float	closest[cpu_raytrace_packet_size];				// the nearest hit so far; negative for rays not traced
+	int32_t	sphere[cpu_raytrace_packet_size];				// which sphere that is, or -1 for none
+};
+
+// Find the closest sphere each ray hits, walking the BVH once for the whole packet. A box is
+// opened if any ray hits it nearer than what that ray's already hit, and a sphere's tested against
+// every ray; the ones that miss it, or have nearer hits, keep what they had.
+static void trace_packet(const particle_bvh& bvh, ray_packet* packet)
+{
+	const float* origin = packet->origin;
+	int stack[max_bvh_stack];
+	int stack_size = 0;
+	stack[stack_size++] = (bvh.num_spheres == 1) ? ~0 : 0;
+	while (stack_size > 0)
+	{
+		int node = stack[--stack_size];
+		if (node < 0)
+		{
+			const particle_bvh_sphere& sphere = bvh.spheres[~node];
+			float to_origin[3] = { origin[0] - sphere.center[0], origin[1] - sphere.center[1], origin[2] - sphere.center[2] };
+			float c = to_origin[0] * to_origin[0] + to_origin[1] * to_origin[1] + to_origin[2] * to_origin[2] - sphere.radius * sphere.radius;
+			for (int lane = 0; lane < cpu_raytrace_packet_size; ++lane)
+			{
+				// The nearer root of the quadratic, as ray_sphere_intersect() solves it
+				float b = packet->direction[0][lane] * to_origin[0] + packet->direction[1][lane] * to_origin[1] + packet->direction[2][lane] * to_origin[2];
+				float discriminant = b * b - c;
+				float distance = -b - sqrtf(std::max(discriminant, 0.0f));
+				bool hit = discriminant >= 0.0f && distance > 0.0f && distance < packet->closest[lane];
+				packet->closest[lane] = hit ? distance : packet->closest[lane];
+				packet->sphere[lane] = hit ? ~node : packet->sphere[lane];
+			}
+			continue;
+		}
+
+		const particle_bvh_node& box = bvh.nodes[node];
+		int hits = 0;
+		for (int lane = 0; lane < cpu_raytrace_packet_size; ++lane)
+		{
+			float enter = 0.0f;
+			float leave = packet->closest[lane];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				float t0 = (box.min[axis] - origin[axis]) * packet->inv_direction[axis][lane];
+				float t1 = (box.max[axis] - origin[axis]) * packet->inv_direction[axis][lane];
+				enter = std::max(enter, std::min(t0, t1));
+				leave = std::min(leave, std::max(t0, t1));
+			}
+			hits += (enter <= leave) ? 1 : 0;
+		}
+		if (hits == 0)
+			continue;
+		if (stack_size + 2 <= max_bvh_stack)
+		{
+			stack[stack_size++] = box.right;
+			stack[stack_size++] = box.left;
+		}
+	}
+}
+
+// Add the light from every point light reaching a point, as point_lights.glsl does
+static void add_point_lighting(const light_clusters& lights, const float position[3], const float normal[3], float io_lighting[3])
+{
+	int cell_x = int(floorf((position[0] - lights.origin[0]) / lights.cell_size));
+	int cell_y = int(floorf((position[1] - lights.origin[1]) / lights.cell_size));
+	if (cell_x < 0 || cell_y < 0 || cell_x >= lights.width || cell_y >= lights.height)
+		return;
+
+	int cell = cell_y * lights.width + cell_x;
+	uint32_t first = lights.cells[2 * cell];
+	uint32_t count = lights.cells[2 * cell + 1];
+	for (uint32_t i = first; i < first + count; ++i)
+	{
+		const point_light& light = lights.lights[lights.indices[i]];
+		float to_light[3] = { light.position[0] - position[0], light.position[1] - position[1], light.position[2] - position[2] };
+		float distance_squared = to_light[0] * to_light[0] + to_light[1] * to_light[1] + to_light[2] * to_light[2];
+		float radius_squared = light.radius * light.radius;
+		if (distance_squared >= radius_squared)
+			continue;
+
+		float falloff = 1.0f - distance_squared / radius_squared;
+		falloff *= falloff;
+		float facing = std::max((normal[0] * to_light[0] + normal[1] * to_light[1] + normal[2] * to_light[2]) / sqrtf(std::max(distance_squared, 1e-8f)), 0.0f);
+		for (int channel = 0; channel < 3; ++channel)
+			io_lighting[channel] += light.color[channel] * falloff * facing;
+	}
+}
+
+// What the tracing jobs share. Job items are tiles, a row at a time from the bottom.
+struct cpu_raytrace_job_data
+{
+	const particle_bvh*			bvh;
+	const light_clusters*		lights;			// null if there are none
+	const cpu_raytrace_view*	view;
+	const int*					rect;
+	cpu_raytrace_image*			image;
+	int							tiles_across;
+};
+
+// Trace a packet's worth of a row, from x, and write its pixels
+static void trace_packet_row(const cpu_raytrace_job_data& job_data, int x, int y)
+{
+	const cpu_raytrace_view& view = *job_data.view;
+	const int* rect = job_data.rect;
+	cpu_raytrace_image* image = job_data.image;
+	uint8_t* out = image->pixels + (size_t(y) * image->width + x) * 4;
+	int count = std::min(cpu_raytrace_packet_size, image->width - x);
+	if (job_data.bvh->num_spheres == 0 || y < rect[1] || y >= rect[1] + rect[3] || x + count <= rect[0] || x >= rect[0] + rect[2])
+	{
+		for (int i = 0; i < count; ++i)
+			std::copy_n(sky_pixel, 4, out + i * 4);
+		return;
+	}
+
+	// The same camera as fragment_shader_raytrace.glsl, looking down at z = 0, through each
+	// pixel's center. Rays outside the rectangle, or past the image's edge, aren't traced.
+	ray_packet packet;
+	float camera_distance = view.window_size[1];
+	packet.origin[0] = view.window_center[0];
+	packet.origin[1] = view.window_center[1];
+	packet.origin[2] = camera_distance;
+	float ndc_y = (float(y) + 0.5f) * 2.0f / float(image->height) - 1.0f;
+	float plane_y = view.window_center[1] + ndc_y * 0.5f * view.window_size[1];
+	for (int lane = 0; lane < cpu_raytrace_packet_size; ++lane)
+	{
+		float ndc_x = (float(x + lane) + 0.5f) * 2.0f / float(image->width) - 1.0f;
+		float ray[3] = { ndc_x * 0.5f * view.window_size[0], plane_y - packet.origin[1], -camera_distance };
+		float inv_length = 1.0f / sqrtf(ray[0] * ray[0] + ray[1] * ray[1] + ray[2] * ray[2]);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			packet.direction[axis][lane] = ray[axis] * inv_length;
+			packet.inv_direction[axis][lane] = 1.0f / packet.direction[axis][lane];
+		}
+		bool traced = lane < count && x + lane >= rect[0] && x + lane < rect[0] + rect[2];
+		packet.closest[lane] = traced ? 1e30f : -1.0f;
+		packet.sphere[lane] = -1;
+	}
+	trace_packet(*job_data.bvh, &packet);
+
+	// Light what they hit as shade_particle() does, with nothing in the way of the light
+	for (int lane = 0; lane < count; ++lane)
+	{
+		uint8_t* pixel = out + lane * 4;
+		if (packet.sphere[lane] < 0)
+		{
+			std::copy_n(sky_pixel, 4, pixel);
+			continue;
+		}
+		const particle_bvh_sphere& sphere = job_data.bvh->spheres[packet.sphere[lane]];
+		float position[3], normal[3];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			position[axis] = packet.origin[axis] + packet.closest[lane] * packet.direction[axis][lane];
+			normal[axis] = (position[axis] - sphere.center[axis]) / sphere.radius;
+		}
+		float diffuse = std::max(normal[0] * view.light_dir[0] + normal[1] * view.light_dir[1] + normal[2] * view.light_dir[2], 0.0f) * 0.8f + 0.2f;
+		float lighting[3] = { diffuse, diffuse, diffuse };
+		if (job_data.lights)
+			add_point_lighting(*job_data.lights, position, normal, lighting);
+		for (int channel = 0; channel < 3; ++channel)
+			pixel[channel] = gamma_correct(lighting[channel] * particle_color[channel]);
+		pixel[3] = 255;
+	}
+}
+
+static void trace_tiles_job(void* data, int begin, int end)
+{
+	const cpu_raytrace_job_data* job_data = (const cpu_raytrace_job_data*)data;
+	int height = job_data->image->height;
+	for (int tile = begin; tile < end; ++tile)
+	{
+		int x = (tile % job_data->tiles_across) * cpu_raytrace_packet_size;
+		int y = (tile / job_data->tiles_across) * cpu_raytrace_tile_rows;
+		for (int row = y, row_end = std::min(y + cpu_raytrace_tile_rows, height); row < row_end; ++row)
+			trace_packet_row(*job_data, x, row);
+	}
+}
+
+void cpu_raytrace_scene(const particle_bvh& bvh, const light_clusters* lights, const cpu_raytrace_view& view, const int rect[4], cpu_raytrace_image* image)
+{
+	cpu_raytrace_job_data job_data;
+	job_data.bvh = &bvh;
+	job_data.lights = (lights && !lights->lights.empty()) ? lights : nullptr;
+	job_data.view = &view;
+	job_data.rect = rect;
+	job_data.image = image;
+	job_data.tiles_across = (image->width + cpu_raytrace_packet_size - 1) / cpu_raytrace_packet_size;
+	int tiles_up = (image->height + cpu_raytrace_tile_rows - 1) / cpu_raytrace_tile_rows;
+	int num_tiles = job_data.tiles_across * tiles_up;
+
+	// Each job's a run of tiles. parallel_for() would only split them up once there were thousands,
+	// but a tile full of particles is a lot of work.
+	int num_jobs = std::min(num_tiles, max_raytrace_jobs);
+	if (num_jobs <= 1)
+	{
+		trace_tiles_job(&job_data, 0, num_tiles);
+		return;
+	}
+	job jobs[max_raytrace_jobs];
+	for (int i = 0; i < num_jobs; ++i)
+		jobs[i] = job{ &trace_tiles_job, &job_data, int(int64_t(num_tiles) * i / num_jobs), int(int64_t(num_tiles) * (i + 1) / num_jobs), nullptr };
+
+	std::atomic<int> counter(0);
+	submit_jobs(jobs, num_jobs, &counter);
+	wait_for_counter(&counter);
+}
+
+bool write_cpu_raytrace_image(const cpu_raytrace_image& image, const char* filename)
+{
+	FILE* file = fopen(filename, "wb");
+	if (!file)
+		return false;
+
+	// PPMs go from the top row down, and have no alpha
+	fprintf(file, "P6\n%d %d\n255\n", image.width, image.height);
+	uint8_t* row = (uint8_t*)malloc(size_t(image.width) * 3);
+	bool written = row != nullptr;
+	for (int y = image.height - 1; y >= 0 && written; --y)
+	{
+		const uint8_t* pixels = image.pixels + size_t(y) * image.width * 4;
+		for (int x = 0; x < image.width; ++x)
+			std::copy_n(pixels + x * 4, 3, row + x * 3);
+		written = fwrite(row, 3, size_t(image.width), file) == size_t(image.width);
+	}
+	free(row);
+	return (fclose(file) == 0) && written;
+}
@@ -0,0 +1,48 @@
+// CPU raytracer: traces the raytraced scene in packets of rays across the job system, for machines with no GPU to do it
+#pragma once
+
+#include "light_clusters.h"
+#include "particle_bvh.h"
+
+#include <cstdint>
+
+// Rays are traced in packets of this many, a row of a tile's pixels, which walk the BVH together:
+// a node's visited if any of them hit its box. Neighbouring pixels' rays mostly visit the same
+// nodes anyway, so each node's read once for all of them, and the math is done for all the rays in
+// loops over them that the compiler turns into SIMD.
+static const int cpu_raytrace_packet_size = 8;
+
+// The image is traced a tile at a time, each a packet wide and this many packets high
+static const int cpu_raytrace_tile_rows = 8;
+
+// What the CPU raytracer draws into: RGBA8, with the bottom row first, as glTexSubImage2D() takes it
+struct cpu_raytrace_image
+{
+	uint8_t*	pixels;
+	int			width;
+	int			height;
+	int			capacity;		// in pixels
+};
+
+// Where the scene's seen from and lit from: what fragment_shader_raytrace.glsl gets from uniform_data
+struct cpu_raytrace_view
+{
+	float	window_size[2];		// in world space
+	float	window_center[2];
+	float	light_dir[3];
+};
+
+// Make the image width x height, only reallocating it if it's grown. Returns false on failure.
+bool resize_cpu_raytrace_image(cpu_raytrace_image* image, int width, int height);
+
+// Release the image and reset it to empty
+void free_cpu_raytrace_image(cpu_raytrace_image* image);
+
+// Trace the particles the way fragment_shader_raytrace.glsl's plain variant does, with one ray per
+// pixel, lit by the light and the point lights ('lights' may be null) with no shadows. Only the
+// pixels in 'rect' (x, y, width, height, as glScissor() takes it) are traced, and the rest are sky.
+// The tiles are spread across the job system's threads.
+void cpu_raytrace_scene(const particle_bvh& bvh, const light_clusters* lights, const cpu_raytrace_view& view, const int rect[4], cpu_raytrace_image* image);
+
+// Write the image out as a binary PPM, the right way up. Returns false if it couldn't be written.
+bool write_cpu_raytrace_image(const cpu_raytrace_image& image, const char* filename);
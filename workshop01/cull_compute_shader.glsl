@@ -0,0 +1,96 @@
+// Compute shader for culling the particles before drawing them. Appends the sort key and index of
+// each particle that's alive and overlaps the visible part of the world to a compacted list, and
+// counts how many there are at each LOD. gather_compute_shader.glsl then turns the list into the
+// instance data for one indirect draw per LOD.
+#version 430
+
+layout(local_size_x = 256) in;
+
+#include "particle_data.glsl"
+
+layout(std430, binding = 0) readonly buffer particle_buffer
+{
+	particle particles[];
+};
+
+// Sort keys and particle indices, for sort_compute_shader.glsl and gather_compute_shader.glsl
+layout(std430, binding = 2) writeonly buffer sort_buffer
+{
+	uvec2 sort_items[];
+};
+
+// Counts of the particles appended to sort_buffer: at each LOD, and in total. These live in the
+// draw commands buffer (struct gpu_particle_draws in the C++ code), so the draws can be built
+// from them without a round trip through the CPU.
+layout(binding = 0, offset = 60) uniform atomic_uint star_count;
+layout(binding = 0, offset = 64) uniform atomic_uint pentagon_count;
+layout(binding = 0, offset = 68) uniform atomic_uint point_count;
+layout(binding = 0, offset = 84) uniform atomic_uint total_count;
+
+// Culling parameters passed from main app
+uniform int first_index;		// the range of particle_buffer to cull
+uniform int count;
+uniform vec2 visible_min;		// the visible rectangle in world space, already grown to allow
+uniform vec2 visible_max;		// for how far particles can move when interpolated
+uniform bool analytic_motion;	// particles hold their state at creation, and move ballistically from there
+uniform float time;				// the time we're rendering at
+uniform float gravity;			// acceleration along y
+uniform float kill_height;		// particles that fall below this are dead
+uniform int sort_order;			// 0 for no sorting, otherwise a particle_sort_order from particle_sort.h
+uniform float max_age;			// the oldest particles can get
+uniform vec2 lod_min_size;		// smallest sizes to draw as a star, and as a pentagon (struct particle_lod_sizes)
+
+// Must match particle_sort.h
+const int particle_sort_oldest_first = 1;
+const int particle_sort_smallest_first = 2;
+const int num_particle_lods = 3;
+const uint particle_lod_key_shift = 14u;
+const float max_packed_size = 2.0;
+const float max_sort_key = 16383.0;
+
+void main()
+{
+	int i = int(gl_GlobalInvocationID.x);
+	if (i >= count)
+		return;
+
+	// Skip slots that were never spawned or whose particle has already died (both zero size)
+	particle p = particles[first_index + i];
+	if (p.size == 0.0)
+		return;
+
+	// Find where the particle actually is, the same way vertex_shader.glsl will
+	vec2 position = p.position;
+	if (analytic_motion)
+	{
+		float age = time - p.creation_time;
+		position += age * p.velocity + vec2(0.0, 0.5 * gravity * age * age);
+		if (position.y < kill_height)
+			return;
+	}
+
+	// Test the particle's bounding circle against the visible rectangle
+	if (any(lessThan(position + p.size, visible_min)) || any(greaterThan(position - p.size, visible_max)))
+		return;
+
+	// Pick its LOD, the same way select_particle_lod() does
+	int lod = 0;
+	if (p.size < lod_min_size.x)
+		lod = (p.size < lod_min_size.y) ? 2 : 1;
+	if (lod == 0)
+		atomicCounterIncrement(star_count);
+	else if (lod == 1)
+		atomicCounterIncrement(pentagon_count);
+	else
+		atomicCounterIncrement(point_count);
+
+	// Make its sort key the same way gather_particle_sort_items() does: grouped by LOD, coarsest first
+	uint key = 0u;
+	if (sort_order == particle_sort_oldest_first)
+		key = uint(max_sort_key) - uint(clamp((time - p.creation_time) / max_age, 0.0, 1.0) * max_sort_key + 0.5);
+	else if (sort_order == particle_sort_smallest_first)
+		key = uint(clamp(p.size / max_packed_size, 0.0, 1.0) * max_sort_key + 0.5);
+	key |= uint(num_particle_lods - 1 - lod) << particle_lod_key_shift;
+
+	sort_items[atomicCounterIncrement(total_count)] = uvec2(key, uint(first_index + i));
+}
@@ -0,0 +1,10 @@
+// One indirect draw's arguments (struct draw_elements_indirect_command in the C++ code). The
+// particle_draws buffer holds one per LOD, matching struct gpu_particle_draws.
+struct draw_command
+{
+	uint count;
+	uint instance_count;
+	uint first_index;
+	uint base_vertex;
+	uint base_instance;
+};
@@ -0,0 +1,31 @@
+// Compute shader for filling in a draw per LOD from the culling pass's counts. The particles are
+// laid out for drawing grouped by LOD, coarsest first, so each LOD's instances start where the
+// coarser ones' end. Split into views, each instance is drawn once per view, one after another,
+// which the vertex attributes' divisor (or the shader, pulling them) undoes, so only the counts
+// are multiplied.
+#version 430
+
+layout(local_size_x = 1) in;
+
+#include "draw_command.glsl"
+
+layout(std430, binding = 3) buffer particle_draws
+{
+	draw_command draws[3];
+	uint lod_counts[3];
+	uint lod_cursors[3];
+	uint total_count;
+};
+
+uniform uint num_views;
+
+void main()
+{
+	uint first_instance = 0u;
+	for (int lod = 2; lod >= 0; --lod)
+	{
+		draws[lod].instance_count = lod_counts[lod] * num_views;
+		draws[lod].base_instance = first_instance;
+		first_instance += lod_counts[lod];
+	}
+}
@@ -0,0 +1,33 @@
+# Writes a C++ source file with the contents of some files compiled in, for embedded_files.h.
+# Run as a script: cmake -DOUTPUT=<file.cpp> -DFILES=<file;file;...> -P embed_files.cmake
+# The files are named in the table by their file names alone.
+
+set(contents "// Generated by embed_files.cmake; don't edit\n\n#include \"embedded_files.h\"\n\n#include <cstring>\n\n")
+set(table "")
+set(index 0)
+foreach (file ${FILES})
+	get_filename_component(name "${file}" NAME)
+	file(READ "${file}" hex HEX)
+	string(LENGTH "${hex}" hex_length)
+	math(EXPR size "${hex_length} / 2")
+
+	# Byte arrays rather than string literals, which some compilers limit the length of. They're
+	# unsigned, so bytes over 0x7f aren't narrowing conversions.
+	string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+	string(REGEX REPLACE "(0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,)" "\\1\n\t" bytes "${bytes}")
+	string(APPEND contents "// ${name}\nstatic const unsigned char file_${index}[] =\n{\n\t${bytes}0x00\n};\n\n")
+	string(APPEND table "\t{ \"${name}\", (const char*)file_${index}, ${size} },\n")
+	math(EXPR index "${index} + 1")
+endforeach()
+
+string(APPEND contents "const embedded_file embedded_files[] =\n{\n${table}\t{ nullptr, nullptr, 0 },\n};\n\n")
+string(APPEND contents "const int num_embedded_files = ${index};\n\n")
+string(APPEND contents "const embedded_file* find_embedded_file(const char* filename)\n{\n\tfor (int i = 0; i < num_embedded_files; ++i)\n\t{\n\t\tif (strcmp(embedded_files[i].filename, filename) == 0)\n\t\t\treturn &embedded_files[i];\n\t}\n\treturn nullptr;\n}\n")
+
+# Only touch the output if it's changed, so it doesn't get recompiled for nothing
+if (EXISTS "${OUTPUT}")
+	file(READ "${OUTPUT}" old_contents)
+endif()
+if (NOT "${old_contents}" STREQUAL "${contents}")
+	file(WRITE "${OUTPUT}" "${contents}")
+endif()
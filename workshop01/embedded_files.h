@@ -0,0 +1,16 @@
+// Embedded files: data files compiled into the executable by the build, so they load without touching the file system
+#pragma once
+
+struct embedded_file
+{
+	const char*		filename;		// as it would be opened, relative to the source directory
+	const char*		data;			// null-terminated, though the terminator isn't counted in size
+	int				size;
+};
+
+// Generated by embed_files.cmake, in embedded_files.cpp in the build directory
+extern const embedded_file embedded_files[];
+extern const int num_embedded_files;
+
+// Returns null if there's no such file
+const embedded_file* find_embedded_file(const char* filename);
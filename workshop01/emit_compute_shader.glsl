@@ -0,0 +1,86 @@
+// Compute shader for emitting new particles directly into the GPU particle buffer. Each emitter
+// spawns a run of particles, and all the runs are emitted together, one after another in the ring.
+#version 430
+
+layout(local_size_x = 64) in;
+
+#include "particle_data.glsl"
+
+layout(std430, binding = 0) buffer particle_buffer
+{
+	particle particles[];
+};
+
+// One emitter's run of new particles. Matches struct compute_emit_batch in the C++ code.
+struct emit_batch
+{
+	vec2 position;
+	vec2 velocity_min;
+	vec2 velocity_max;
+	vec2 spin_range;
+	vec2 log2_size_range;
+	int first;		// index of the run's first particle within this frame's emission
+	int count;
+};
+
+layout(std430, binding = 1) readonly buffer emit_batch_buffer
+{
+	emit_batch batches[];
+};
+
+// Emission parameters passed from main app
+uniform int first_index;	// first slot in the particle ring to write to
+uniform int emit_count;		// how many particles to emit this frame
+uniform int num_batches;	// how many runs they're split into
+uniform int capacity;		// size of the particle ring
+uniform float time;			// creation time for the new particles
+uniform uint seed;			// changes every frame, so each frame's particles are different
+
+const float two_pi = 6.283185308;
+
+// PCG-style integer hash, used as a stateless random number generator
+uint hash(uint x)
+{
+	uint state = x * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+float random_in_range(inout uint rng_state, float min_value, float max_value)
+{
+	rng_state = hash(rng_state);
+	return mix(min_value, max_value, float(rng_state) * (1.0 / 4294967296.0));
+}
+
+void main()
+{
+	int i = int(gl_GlobalInvocationID.x);
+	if (i >= emit_count)
+		return;
+
+	// Find which run this particle is in: the last one starting at or before it
+	int low = 0;
+	int high = num_batches - 1;
+	while (low < high)
+	{
+		int middle = (low + high + 1) / 2;
+		if (batches[middle].first <= i)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+	emit_batch batch = batches[low];
+
+	// Set up a particle with random starting values from its emitter's ranges (as in generate_particles())
+	uint rng_state = hash(seed ^ uint(i));
+	particle p;
+	p.position = batch.position;
+	p.velocity.x = random_in_range(rng_state, batch.velocity_min.x, batch.velocity_max.x);
+	p.velocity.y = random_in_range(rng_state, batch.velocity_min.y, batch.velocity_max.y);
+	p.angle = random_in_range(rng_state, 0.0, two_pi);
+	p.spin = random_in_range(rng_state, batch.spin_range.x, batch.spin_range.y);
+	p.size = exp2(random_in_range(rng_state, batch.log2_size_range.x, batch.log2_size_range.y));
+	p.creation_time = time;
+
+	particles[(first_index + i) % capacity] = p;
+}
@@ -0,0 +1,151 @@
+// Particle emitters: any number of them, all spawning into the one shared particle store
+
+#include "emitters.h"
+#include "batch_random.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+static const float two_pi = 6.283185308f;
+
+// Each randomized particle field gets its own random stream. The counter within each stream is
+// the particle's spawn number, so a particle's starting values depend only on the seed and how
+// many particles came before it.
+enum spawn_random_stream
+{
+	spawn_random_velocity_x,
+	spawn_random_velocity_y,
+	spawn_random_angle,
+	spawn_random_spin,
+	spawn_random_size,
+	spawn_random_shape,
+	spawn_random_sprite,
+};
+
+bool init_emitter_set(emitter_set* set, int count)
+{
+	*set = emitter_set{};
+	set->emitters = (particle_emitter*)calloc(size_t(count), sizeof(particle_emitter));
+	if (!set->emitters)
+		return false;
+	set->count = count;
+	return true;
+}
+
+void free_emitter_set(emitter_set* set)
+{
+	free(set->emitters);
+	*set = emitter_set{};
+}
+
+void make_fountain_emitters(emitter_set* set, float min_x, float max_x, float total_particles_per_second)
+{
+	for (int i = 0; i < set->count; ++i)
+	{
+		particle_emitter* emitter = &set->emitters[i];
+		*emitter = particle_emitter{};
+		emitter->particles_per_second = total_particles_per_second / float(set->count);
+		emitter->spin_min = -5.0f;
+		emitter->spin_max = 5.0f;
+
+		if (set->count == 1)
+		{
+			// The big fountain
+			emitter->velocity_min[0] = -12.0f;
+			emitter->velocity_min[1] = 24.0f;
+			emitter->velocity_max[0] = 12.0f;
+			emitter->velocity_max[1] = 48.0f;
+			emitter->log2_size_min = -2.0f;
+			emitter->log2_size_max = 0.5f;
+		}
+		else
+		{
+			// Lots of little ones. These go less high, so they're still all in view.
+			emitter->position[0] = min_x + (max_x - min_x) * float(i) / float(set->count - 1);
+			emitter->velocity_min[0] = -4.0f;
+			emitter->velocity_min[1] = 12.0f;
+			emitter->velocity_max[0] = 4.0f;
+			emitter->velocity_max[1] = 30.0f;
+			emitter->log2_size_min = -3.0f;
+			emitter->log2_size_max = -1.0f;
+		}
+	}
+}
+
+void get_emitter_bounds(const particle_emitter& emitter, float gravity, float max_age, float min_y, float o_min[2], float o_max[2])
+{
+	// Particles that go highest fall below min_y last, so none live longer than that
+	float drop = emitter.position[1] - min_y;
+	if (drop > 0.0f)
+	{
+		float speed_up = emitter.velocity_max[1];
+		max_age = std::min(max_age, (speed_up + sqrtf(speed_up * speed_up - 2.0f * gravity * drop)) / -gravity);
+	}
+
+	// Across, a particle goes steadily one way, so it gets furthest at the end of its life
+	o_min[0] = emitter.position[0] + std::min(emitter.velocity_min[0] * max_age, 0.0f);
+	o_max[0] = emitter.position[0] + std::max(emitter.velocity_max[0] * max_age, 0.0f);
+
+	// The fastest up goes highest, at the top of its arc, unless it dies on the way up. Height's a
+	// parabola in time, which is lowest at one end or the other, so the slowest up goes lowest.
+	float rise_time = (emitter.velocity_max[1] > 0.0f) ? std::min(-emitter.velocity_max[1] / gravity, max_age) : 0.0f;
+	o_max[1] = emitter.position[1] + (emitter.velocity_max[1] + 0.5f * gravity * rise_time) * rise_time;
+	float lowest = emitter.position[1] + std::min((emitter.velocity_min[1] + 0.5f * gravity * max_age) * max_age, 0.0f);
+	o_min[1] = std::max(lowest, std::min(min_y, emitter.position[1]));
+
+	float size = exp2f(std::max(emitter.log2_size_min, emitter.log2_size_max));
+	for (int axis = 0; axis < 2; ++axis)
+	{
+		o_min[axis] -= size;
+		o_max[axis] += size;
+	}
+}
+
+int update_emitters(emitter_set* set, float dt)
+{
+	// Calculate how many particles each emitter generates, based on its emission rate
+	int total = 0;
+	for (int i = 0; i < set->count; ++i)
+	{
+		particle_emitter* emitter = &set->emitters[i];
+		emitter->accumulator += emitter->particles_per_second * dt;
+		emitter->spawn_count = int(floor(emitter->accumulator));
+		emitter->accumulator -= emitter->spawn_count;
+		total += emitter->spawn_count;
+	}
+	return total;
+}
+
+// Pick one of 'num' values from 'first' on evenly at random for each particle, as a byte
+static void fill_random_picks(random_stream stream, uint32_t first_counter, int count, int first, int num, uint8_t* out)
+{
+	if (num <= 1)
+	{
+		std::fill_n(out, count, uint8_t(first));
+		return;
+	}
+	for (int i = 0; i < count; ++i)
+		out[i] = uint8_t(first + int(random_bits(stream, first_counter + uint32_t(i)) % uint32_t(num)));
+}
+
+void spawn_particles(particle_store* store, const particle_emitter& emitter, uint32_t seed, int first, int count, uint32_t first_counter, float time)
+{
+	// Set up particles with random starting values from the emitter's ranges, a field at a time
+	std::fill_n(store->position_x + first, count, emitter.position[0]);
+	std::fill_n(store->position_y + first, count, emitter.position[1]);
+	fill_random_floats(make_random_stream(seed, spawn_random_velocity_x), first_counter, count, emitter.velocity_min[0], emitter.velocity_max[0], store->velocity_x + first);
+	fill_random_floats(make_random_stream(seed, spawn_random_velocity_y), first_counter, count, emitter.velocity_min[1], emitter.velocity_max[1], store->velocity_y + first);
+	fill_random_floats(make_random_stream(seed, spawn_random_angle), first_counter, count, 0.0f, two_pi, store->angle + first);
+	fill_random_floats(make_random_stream(seed, spawn_random_spin), first_counter, count, emitter.spin_min, emitter.spin_max, store->spin + first);
+	std::fill_n(store->creation_time + first, count, time);
+
+	// Sizes are spread evenly on a log scale
+	float* size = store->size + first;
+	fill_random_floats(make_random_stream(seed, spawn_random_size), first_counter, count, emitter.log2_size_min, emitter.log2_size_max, size);
+	for (int i = 0; i < count; ++i)
+		size[i] = exp2f(size[i]);
+
+	fill_random_picks(make_random_stream(seed, spawn_random_shape), first_counter, count, emitter.first_shape, emitter.num_shapes, store->shape + first);
+	fill_random_picks(make_random_stream(seed, spawn_random_sprite), first_counter, count, emitter.first_sprite, emitter.num_sprites, store->sprite + first);
+}
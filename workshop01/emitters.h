@@ -0,0 +1,62 @@
+// Particle emitters: any number of them, all spawning into the one shared particle store
+#pragma once
+
+#include "particle_store.h"
+
+#include <cstdint>
+
+// One emitter. Each particle it spawns gets random starting values from these ranges.
+struct particle_emitter
+{
+	float	position[2];			// where its particles are spawned, in world space
+	float	velocity_min[2];		// range of starting velocities
+	float	velocity_max[2];
+	float	spin_min;				// range of spin speeds, in radians per second
+	float	spin_max;
+	float	log2_size_min;			// range of sizes; these are spread evenly on a log scale
+	float	log2_size_max;
+	float	particles_per_second;	// emission rate
+	int		first_shape;			// range of shapes its particles are drawn as (see particle_shapes.h), picked
+	int		num_shapes;				// evenly at random; 0 or 1 shapes means they're all first_shape
+	int		first_sprite;			// the same for the sprites they're textured with (layers of the sprite
+	int		num_sprites;			// array; see sprite_array.h), independently of their shapes
+
+	// Updated by update_emitters()
+	float	accumulator;			// fraction of a particle built up towards the next one
+	int		spawn_count;			// how many particles to spawn this frame
+};
+
+// All the emitters in the scene. They spawn in array order, so each frame's new particles are
+// in runs, one per emitter, one after another in the particle ring.
+struct emitter_set
+{
+	particle_emitter*	emitters;
+	int					count;
+};
+
+// Allocate (zero-initialized) space for the given number of emitters. Returns false on failure.
+bool init_emitter_set(emitter_set* set, int count);
+
+// Release the emitters and reset the set to empty
+void free_emitter_set(emitter_set* set);
+
+// Set up the emitters as fountains sharing the given total emission rate. A single one is the
+// original demo's big fountain at the origin; more than that are smaller ones spread evenly
+// along the x axis from min_x to max_x.
+void make_fountain_emitters(emitter_set* set, float min_x, float max_x, float total_particles_per_second);
+
+// The box that every particle from the emitter stays inside, as long as gravity (pulling down, so
+// negative) is all that moves it: around every path its range of velocities can launch it on, up
+// to max_age seconds, and no lower than min_y, where particles die. It's grown by the emitter's
+// biggest particles' size, so it covers them whole, as far as they're drawn.
+void get_emitter_bounds(const particle_emitter& emitter, float gravity, float max_age, float min_y, float o_min[2], float o_max[2]);
+
+// Advance the emitters by dt seconds, filling in how many particles each one spawns.
+// Returns the total.
+int update_emitters(emitter_set* set, float dt);
+
+// Write count new particles from the emitter into store slots [first, first + count), with random
+// starting values from its ranges, all created at the given time. first_counter is the first one's
+// spawn number: a particle's starting values depend only on the seed and its spawn number, so
+// spawns can be split up across threads without changing the results. The range can't wrap.
+void spawn_particles(particle_store* store, const particle_emitter& emitter, uint32_t seed, int first, int count, uint32_t first_counter, float time);
@@ -0,0 +1,320 @@
+// File watcher: a background thread that waits on the OS's change notifications for a few directories
+
+#include "file_watcher.h"
+#include "thread_config.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#elif defined(__linux__)
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <poll.h>
+#	include <sys/inotify.h>
+#	include <unistd.h>
+#endif
+
+static bool has_suffix(const char* name, size_t name_length, const char* suffix)
+{
+	size_t suffix_length = strlen(suffix);
+	return name_length >= suffix_length && memcmp(name + name_length - suffix_length, suffix, suffix_length) == 0;
+}
+
+static void add_changed_file(file_watcher* watcher, const char* name, size_t name_length)
+{
+	{
+		std::lock_guard<std::mutex> guard(watcher->lock);
+		std::string file(name, name_length);
+		if (std::find(watcher->changed_files.begin(), watcher->changed_files.end(), file) == watcher->changed_files.end())
+			watcher->changed_files.push_back(file);
+	}
+	watcher->changed.store(true, std::memory_order_release);
+	if (watcher->on_change)
+		watcher->on_change();
+}
+
+static void lose_track(file_watcher* watcher)
+{
+	{
+		std::lock_guard<std::mutex> guard(watcher->lock);
+		watcher->lost_track = true;
+	}
+	watcher->changed.store(true, std::memory_order_release);
+	if (watcher->on_change)
+		watcher->on_change();
+}
+
+#if defined(_WIN32)
+
+struct file_watcher_platform
+{
+	HANDLE		directories[max_watched_directories];
+	OVERLAPPED	overlapped[max_watched_directories];
+	DWORD		buffers[max_watched_directories][4096];		// FILE_NOTIFY_INFORMATION records, which must be DWORD aligned
+	int			num_directories;
+	HANDLE		quit_event;
+};
+
+static bool start_reading_changes(file_watcher_platform* platform, int i)
+{
+	return ReadDirectoryChangesW(platform->directories[i], platform->buffers[i], sizeof(platform->buffers[i]), FALSE,
+		FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &platform->overlapped[i], nullptr) != 0;
+}
+
+static void file_watcher_main(file_watcher* watcher)
+{
+	set_thread_role(thread_role_background, 0);
+	file_watcher_platform* platform = watcher->platform;
+	HANDLE events[max_watched_directories + 1];
+	for (int i = 0; i < platform->num_directories; ++i)
+		events[i] = platform->overlapped[i].hEvent;
+	events[platform->num_directories] = platform->quit_event;
+
+	for (;;)
+	{
+		DWORD result = WaitForMultipleObjects(DWORD(platform->num_directories + 1), events, FALSE, INFINITE);
+		int i = int(result - WAIT_OBJECT_0);
+		if (i < 0 || i >= platform->num_directories)
+			return;
+
+		DWORD bytes = 0;
+		if (GetOverlappedResult(platform->directories[i], &platform->overlapped[i], &bytes, FALSE))
+		{
+			// No bytes means the buffer overflowed, and we don't know what changed; assume it was one of ours
+			if (bytes == 0)
+				lose_track(watcher);
+
+			const char* record = (const char*)platform->buffers[i];
+			for (;;)
+			{
+				const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)record;
+				if (bytes != 0 && info->Action != FILE_ACTION_REMOVED && info->Action != FILE_ACTION_RENAMED_OLD_NAME)
+				{
+					// The names are UTF-16, and the ones we care about are ASCII, so narrow them (keeping the end, if it's too long)
+					char name[MAX_PATH];
+					size_t length = std::min(size_t(info->FileNameLength / sizeof(WCHAR)), size_t(MAX_PATH));
+					size_t skip = (info->FileNameLength / sizeof(WCHAR)) - length;
+					for (size_t c = 0; c < length; ++c)
+					{
+						WCHAR wide = info->FileName[skip + c];
+						name[c] = (wide < 128) ? char(wide) : '?';
+					}
+					if (has_suffix(name, length, watcher->suffix))
+						add_changed_file(watcher, name, length);
+				}
+				if (bytes == 0 || info->NextEntryOffset == 0)
+					break;
+				record += info->NextEntryOffset;
+			}
+		}
+
+		if (!start_reading_changes(platform, i))
+			return;
+	}
+}
+
+static bool start_file_watcher_platform(file_watcher* watcher, const char* const* directories, int num_directories)
+{
+	file_watcher_platform* platform = new file_watcher_platform{};
+	watcher->platform = platform;
+	platform->quit_event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+	if (!platform->quit_event)
+		return false;
+
+	for (int i = 0; i < num_directories; ++i)
+	{
+		HANDLE directory = CreateFileA(directories[i], FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+		if (directory == INVALID_HANDLE_VALUE)
+			continue;
+
+		int index = platform->num_directories;
+		platform->directories[index] = directory;
+		platform->overlapped[index].hEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+		if (!platform->overlapped[index].hEvent || !start_reading_changes(platform, index))
+		{
+			if (platform->overlapped[index].hEvent)
+				CloseHandle(platform->overlapped[index].hEvent);
+			CloseHandle(directory);
+			continue;
+		}
+		++platform->num_directories;
+	}
+	return platform->num_directories > 0;
+}
+
+static void stop_file_watcher_platform(file_watcher* watcher)
+{
+	file_watcher_platform* platform = watcher->platform;
+	if (platform->quit_event)
+		SetEvent(platform->quit_event);
+	if (watcher->thread.joinable())
+		watcher->thread.join();
+
+	for (int i = 0; i < platform->num_directories; ++i)
+	{
+		CancelIo(platform->directories[i]);
+		DWORD bytes = 0;
+		GetOverlappedResult(platform->directories[i], &platform->overlapped[i], &bytes, TRUE);
+		CloseHandle(platform->overlapped[i].hEvent);
+		CloseHandle(platform->directories[i]);
+	}
+	if (platform->quit_event)
+		CloseHandle(platform->quit_event);
+}
+
+#elif defined(__linux__)
+
+struct file_watcher_platform
+{
+	int		inotify_fd;
+	int		quit_pipe[2];		// written to from free_file_watcher() to wake the thread up
+};
+
+static void file_watcher_main(file_watcher* watcher)
+{
+	set_thread_role(thread_role_background, 0);
+	file_watcher_platform* platform = watcher->platform;
+	pollfd fds[2] = { { platform->inotify_fd, POLLIN, 0 }, { platform->quit_pipe[0], POLLIN, 0 } };
+
+	// Room for a few events at a time, aligned as inotify requires
+	alignas(inotify_event) char buffer[4096];
+
+	for (;;)
+	{
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		if (fds[1].revents)
+			return;
+
+		for (;;)
+		{
+			ssize_t bytes = read(platform->inotify_fd, buffer, sizeof(buffer));
+			if (bytes <= 0)
+				break;
+			for (const char* record = buffer; record < buffer + bytes; )
+			{
+				const inotify_event* event = (const inotify_event*)record;
+				if (event->mask & IN_Q_OVERFLOW)
+					lose_track(watcher);
+				else if (event->len && has_suffix(event->name, strlen(event->name), watcher->suffix))
+					add_changed_file(watcher, event->name, strlen(event->name));
+				record += sizeof(inotify_event) + event->len;
+			}
+		}
+	}
+}
+
+static bool start_file_watcher_platform(file_watcher* watcher, const char* const* directories, int num_directories)
+{
+	file_watcher_platform* platform = new file_watcher_platform{ -1, { -1, -1 } };
+	watcher->platform = platform;
+	platform->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (platform->inotify_fd < 0 || pipe(platform->quit_pipe) != 0)
+		return false;
+
+	// Saves either write the file in place (close-after-write), or write a new one and rename it over
+	// the old one (moved-to). Either way, by then the file's complete.
+	int num_watched = 0;
+	for (int i = 0; i < num_directories; ++i)
+	{
+		if (inotify_add_watch(platform->inotify_fd, directories[i], IN_CLOSE_WRITE | IN_MOVED_TO) >= 0)
+			++num_watched;
+	}
+	return num_watched > 0;
+}
+
+static void stop_file_watcher_platform(file_watcher* watcher)
+{
+	file_watcher_platform* platform = watcher->platform;
+	if (platform->quit_pipe[1] >= 0)
+	{
+		char quit = 0;
+		ssize_t written = write(platform->quit_pipe[1], &quit, 1);
+		(void)written;
+	}
+	if (watcher->thread.joinable())
+		watcher->thread.join();
+
+	if (platform->inotify_fd >= 0)
+		close(platform->inotify_fd);
+	if (platform->quit_pipe[0] >= 0)
+		close(platform->quit_pipe[0]);
+	if (platform->quit_pipe[1] >= 0)
+		close(platform->quit_pipe[1]);
+}
+
+#else
+
+// No change notifications here. (macOS has FSEvents, but that needs the CoreServices framework and
+// a run loop; the polling fallback does well enough there for now.)
+struct file_watcher_platform
+{
+};
+
+static void file_watcher_main(file_watcher*)
+{
+}
+
+static bool start_file_watcher_platform(file_watcher* watcher, const char* const*, int)
+{
+	watcher->platform = new file_watcher_platform{};
+	return false;
+}
+
+static void stop_file_watcher_platform(file_watcher*)
+{
+}
+
+#endif
+
+bool init_file_watcher(file_watcher* watcher, const char* const* directories, int num_directories, const char* suffix, void (*on_change)())
+{
+	watcher->changed.store(false);
+	watcher->changed_files.clear();
+	watcher->lost_track = false;
+	watcher->on_change = on_change;
+	snprintf(watcher->suffix, sizeof(watcher->suffix), "%s", suffix);
+	watcher->platform = nullptr;
+	if (num_directories > max_watched_directories)
+		num_directories = max_watched_directories;
+
+	if (!start_file_watcher_platform(watcher, directories, num_directories))
+	{
+		free_file_watcher(watcher);
+		return false;
+	}
+
+	watcher->thread = std::thread(&file_watcher_main, watcher);
+	return true;
+}
+
+void free_file_watcher(file_watcher* watcher)
+{
+	if (!watcher->platform)
+		return;
+
+	stop_file_watcher_platform(watcher);
+	delete watcher->platform;
+	watcher->platform = nullptr;
+}
+
+bool take_changed_files(file_watcher* watcher, std::vector<std::string>* o_files, bool* o_all_changed)
+{
+	std::lock_guard<std::mutex> guard(watcher->lock);
+	watcher->changed.store(false, std::memory_order_relaxed);
+	o_files->swap(watcher->changed_files);
+	watcher->changed_files.clear();
+	*o_all_changed = watcher->lost_track;
+	watcher->lost_track = false;
+	return !o_files->empty() || *o_all_changed;
+}
@@ -0,0 +1,46 @@
+// File watcher: a background thread that waits on the OS's change notifications for a few directories
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int max_watched_directories = 4;
+
+// The OS handles, which only the implementation needs to know the types of
+struct file_watcher_platform;
+
+struct file_watcher
+{
+	std::thread					thread;
+	std::atomic<bool>			changed;		// set by the thread, cleared by take_file_changes()
+	char						suffix[16];		// only files whose names end with this count
+	std::mutex					lock;			// protects the two below
+	std::vector<std::string>	changed_files;	// names, relative to their directory, without duplicates
+	bool						lost_track;		// the OS dropped some notifications, so anything might have changed
+	void						(*on_change)();	// called on the thread after 'changed' is set, if not null
+	file_watcher_platform*		platform;
+};
+
+// Start watching the directories for files ending in 'suffix' being written, or moved into place
+// (which is how a lot of editors save). Returns false if this platform has no change notifications
+// we can use, or none of the directories could be watched, and the watcher is left empty; poll
+// the files instead. Uses inotify on Linux and ReadDirectoryChangesW on Windows. 'on_change', if
+// given, is called from the watcher's thread whenever a change comes in, to wake whoever's waiting.
+bool init_file_watcher(file_watcher* watcher, const char* const* directories, int num_directories, const char* suffix, void (*on_change)());
+
+// Stop the thread and close everything. Safe on a watcher that failed to start.
+void free_file_watcher(file_watcher* watcher);
+
+// Whether any watched file has changed since the last call, and if so, which. If the OS lost
+// track, 'o_all_changed' is set, and the names may be incomplete. When nothing's changed, this
+// only reads a flag, so it's fine to call every frame.
+bool take_changed_files(file_watcher* watcher, std::vector<std::string>* o_files, bool* o_all_changed);
+inline bool take_file_changes(file_watcher* watcher, std::vector<std::string>* o_files, bool* o_all_changed)
+{
+	if (!watcher->changed.load(std::memory_order_relaxed))
+		return false;
+	return take_changed_files(watcher, o_files, o_all_changed);
+}
@@ -0,0 +1,182 @@
+// Force fields: swirling forces baked into a repeating grid, which push the particles along for one sample each
+
+#include "force_field.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+static const float two_pi = 6.283185308f;
+
+// The noise's coarsest lattice has this many cells across the field; each octave after it has
+// twice as many, at half the strength
+static const int base_lattice_size = 8;
+static const int num_octaves = 3;
+
+// A random number for each lattice point, the same every bake for the same seed
+static uint32_t hash_lattice_point(uint32_t seed, int octave, int x, int y)
+{
+	uint32_t h = seed ^ (uint32_t(octave) * 0x27d4eb2du);
+	h = (h ^ (uint32_t(x) * 0x85ebca6bu)) * 0xcc9e2d51u;
+	h = (h ^ (h >> 15) ^ (uint32_t(y) * 0xc2b2ae35u)) * 0x1b873593u;
+	return h ^ (h >> 16);
+}
+
+// Gradient noise at (x, y), in lattice cells, which repeats every 'period' of them. Each lattice
+// point has a random gradient, and the noise blends between them smoothly enough that its
+// derivatives, which the curl is made from, are continuous too.
+static float gradient_noise(float x, float y, int period, int octave, uint32_t seed)
+{
+	int x0 = int(floorf(x));
+	int y0 = int(floorf(y));
+	float fx = x - float(x0);
+	float fy = y - float(y0);
+	float corners[2][2];
+	for (int dy = 0; dy < 2; ++dy)
+	{
+		for (int dx = 0; dx < 2; ++dx)
+		{
+			uint32_t h = hash_lattice_point(seed, octave, (x0 + dx) % period, (y0 + dy) % period);
+			float angle = float(h >> 8) * (two_pi / 16777216.0f);
+			corners[dy][dx] = cosf(angle) * (fx - float(dx)) + sinf(angle) * (fy - float(dy));
+		}
+	}
+	float u = fx * fx * fx * (fx * (fx * 6.0f - 15.0f) + 10.0f);
+	float v = fy * fy * fy * (fy * (fy * 6.0f - 15.0f) + 10.0f);
+	float bottom = corners[0][0] + u * (corners[0][1] - corners[0][0]);
+	float top = corners[1][0] + u * (corners[1][1] - corners[1][0]);
+	return bottom + v * (top - bottom);
+}
+
+// What the bake jobs share
+struct curl_noise_bake
+{
+	force_field*	field;
+	float*			potential;		// the noise the forces are the curl of, a sample per force
+	uint32_t		seed;
+};
+
+static void bake_potential_rows_job(void* data, int begin, int end)
+{
+	const curl_noise_bake* bake = (const curl_noise_bake*)data;
+	const force_field& field = *bake->field;
+	for (int row = begin; row < end; ++row)
+	{
+		for (int column = 0; column < field.width; ++column)
+		{
+			float potential = 0.0f;
+			float amplitude = 1.0f;
+			int lattice_size = base_lattice_size;
+			for (int octave = 0; octave < num_octaves; ++octave)
+			{
+				float x = float(column) * float(lattice_size) / float(field.width);
+				float y = float(row) * float(lattice_size) / float(field.height);
+				potential += amplitude * gradient_noise(x, y, lattice_size, octave, bake->seed);
+				amplitude *= 0.5f;
+				lattice_size *= 2;
+			}
+			bake->potential[size_t(row) * field.width + column] = potential;
+		}
+	}
+}
+
+// The curl of a 2D potential is its gradient turned a quarter turn, so it runs along the contours
+static void bake_curl_rows_job(void* data, int begin, int end)
+{
+	const curl_noise_bake* bake = (const curl_noise_bake*)data;
+	force_field* field = bake->field;
+	int column_mask = field->width - 1;
+	int row_mask = field->height - 1;
+	for (int row = begin; row < end; ++row)
+	{
+		const float* below = &bake->potential[size_t((row - 1) & row_mask) * field->width];
+		const float* here = &bake->potential[size_t(row) * field->width];
+		const float* above = &bake->potential[size_t((row + 1) & row_mask) * field->width];
+		float* forces = &field->forces[size_t(row) * field->width * 2];
+		for (int column = 0; column < field->width; ++column)
+		{
+			forces[column * 2] = 0.5f * (above[column] - below[column]);
+			forces[column * 2 + 1] = -0.5f * (here[(column + 1) & column_mask] - here[(column - 1) & column_mask]);
+		}
+	}
+}
+
+bool bake_curl_noise_field(force_field* field, int size, float cell_size, uint32_t seed)
+{
+	free_force_field(field);
+	size_t num_samples = size_t(size) * size_t(size);
+	float* potential = (float*)malloc(num_samples * sizeof(float));
+	field->forces = (float*)malloc(num_samples * 2 * sizeof(float));
+	if (!potential || !field->forces)
+	{
+		free(potential);
+		free_force_field(field);
+		return false;
+	}
+	field->width = size;
+	field->height = size;
+	field->cell_size = cell_size;
+
+	// A row is plenty of work for a job
+	curl_noise_bake bake = { field, potential, seed };
+	parallel_for(size, 1, &bake_potential_rows_job, &bake);
+	parallel_for(size, 1, &bake_curl_rows_job, &bake);
+	free(potential);
+
+	// Scale them so the strongest is 1, so the strength they're applied with means the same
+	// whatever the seed
+	float max_length_squared = 0.0f;
+	for (size_t i = 0; i < num_samples; ++i)
+		max_length_squared = std::max(max_length_squared, field->forces[i * 2] * field->forces[i * 2] + field->forces[i * 2 + 1] * field->forces[i * 2 + 1]);
+	if (max_length_squared > 0.0f)
+	{
+		float scale = 1.0f / sqrtf(max_length_squared);
+		for (size_t i = 0; i < num_samples * 2; ++i)
+			field->forces[i] *= scale;
+	}
+	return true;
+}
+
+void free_force_field(force_field* field)
+{
+	free(field->forces);
+	*field = force_field{};
+}
+
+void apply_force_field(const force_field& field, particle_store* store, int first, int count, float strength, const float offset[2], float timestep)
+{
+	const float* position_x = store->position_x;
+	const float* position_y = store->position_y;
+	float* velocity_x = store->velocity_x;
+	float* velocity_y = store->velocity_y;
+
+	float inv_cell_size = 1.0f / field.cell_size;
+	float scale = strength * timestep;
+	int column_mask = field.width - 1;
+	int row_mask = field.height - 1;
+	for (int i = first, end = first + count; i < end; ++i)
+	{
+		// Bilinearly filter the four samples around it, wrapping round the tile's edges
+		float x = (position_x[i] - offset[0]) * inv_cell_size;
+		float y = (position_y[i] - offset[1]) * inv_cell_size;
+		float column = floorf(x);
+		float row = floorf(y);
+		float fx = x - column;
+		float fy = y - row;
+		int column0 = int(column) & column_mask;
+		int column1 = (column0 + 1) & column_mask;
+		const float* below = &field.forces[size_t(int(row) & row_mask) * field.width * 2];
+		const float* above = &field.forces[size_t((int(row) + 1) & row_mask) * field.width * 2];
+		const float* corners[4] = { below + column0 * 2, below + column1 * 2, above + column0 * 2, above + column1 * 2 };
+		float weights[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+		float force_x = 0.0f, force_y = 0.0f;
+		for (int corner = 0; corner < 4; ++corner)
+		{
+			force_x += weights[corner] * corners[corner][0];
+			force_y += weights[corner] * corners[corner][1];
+		}
+		velocity_x[i] += scale * force_x;
+		velocity_y[i] += scale * force_y;
+	}
+}
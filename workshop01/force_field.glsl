@@ -0,0 +1,18 @@
+// The force field (see force_field.h), for the GPU simulations. This pushes particles along the
+// same way apply_force_field() does on the CPU.
+
+uniform bool use_force_field;
+uniform sampler2D force_field;			// a texel per sample, linearly filtered, repeating
+uniform float force_field_scale;		// samples per world unit
+uniform vec2 force_field_offset;		// how far the pattern's drifted by the end of the first step, in world units
+uniform vec2 force_field_step_offset;	// and how much further it goes each step after that
+uniform float force_field_strength;
+
+void apply_force_field(inout vec2 velocity, vec2 position, float timestep, int step)
+{
+	if (!use_force_field)
+		return;
+	vec2 samples = (position - force_field_offset - float(step) * force_field_step_offset) * force_field_scale;
+	vec2 force = texture(force_field, (samples + 0.5) / vec2(textureSize(force_field, 0))).rg;
+	velocity += timestep * force_field_strength * force;
+}
@@ -0,0 +1,33 @@
+// Force fields: swirling forces baked into a repeating grid, which push the particles along for one sample each
+#pragma once
+
+#include "particle_store.h"
+
+#include <cstdint>
+
+// Accelerations sampled on a grid that tiles the plane, so however small it is, it covers
+// everywhere particles can get to. They're up to 1 long, and scaled by the strength they're
+// applied with. Evaluating noise for every particle every step would take dozens of operations
+// per octave; this takes one bilinear sample. The same samples go to the GPU simulations as a
+// texture, in force_field.glsl, which samples them the same way apply_force_field() does.
+struct force_field
+{
+	float*	forces;		// x and y, width * height of them, a row at a time from the bottom
+	int		width;		// both powers of two, so the tiling's a mask
+	int		height;
+	float	cell_size;	// world units between samples
+};
+
+// Bake curl noise: the curl of a few octaves of smooth noise, which swirls without ever bunching
+// particles up or spreading them out, having no divergence. The field is 'size' samples each way,
+// a power of two, and the biggest swirls are an eighth of that across. Rows are spread across the
+// job system's threads. Returns false, leaving the field empty, if it couldn't allocate the samples.
+bool bake_curl_noise_field(force_field* field, int size, float cell_size, uint32_t seed);
+
+// Release the samples and reset the field to empty
+void free_force_field(force_field* field);
+
+// Accelerate particles [first, first + count) by the force where they are, times 'strength', for
+// 'timestep' seconds. The pattern's moved along by 'offset' world units, so it can drift over
+// time. Dead particles are pushed too, which does them no harm, rather than checked for.
+void apply_force_field(const force_field& field, particle_store* store, int first, int count, float strength, const float offset[2], float timestep);
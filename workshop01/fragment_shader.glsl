@@ -1,26 +1,61 @@
 // Fragment shader for simple particle system
 #version 410
 
-// Uniforms passed from main app: this matches struct uniform_data in the C++ code
-layout(std140) uniform uniform_data
-{
-	vec2 window_size;		// window size in world space
-	vec2 window_center;		// window center in world space	
-    vec3 light_dir;         // direction of a light source
-	float time;				// current simulation time in seconds
-};
+#include "uniform_data.glsl"
+#include "point_lights.glsl"
 
-// Input data from vertex shader
+// Input data from vertex shader. Only what's read here is passed through; the vertex shader has the
+// particle's velocity, angle, spin, size and creation time too, if they're ever needed.
 layout(location = 0) in vec2 v_vertex_position;
 layout(location = 1) in vec2 v_particle_position;
-layout(location = 2) in vec2 v_particle_velocity;
-layout(location = 3) in vec4 v_particle_angle_spin_size_creationtime;	// Four values packed together in a vec4
+layout(location = 2) flat in float v_sprite;
+layout(location = 3) in vec2 v_world_position;
+layout(location = 4) in float v_trail;
+
+// Every particle sprite, a layer each (see sprite_array.h), so however many there are, particles
+// with different ones still draw together. Layers whose sprites aren't in yet are white.
+uniform sampler2DArray particle_sprites;
 
-// Output data to the framebuffer
+// Output data to the framebuffer. With weighted transparency, that's the weighted, premultiplied
+// color and its weight, summed, and the particle's opacity, which what's behind is multiplied by
+// one minus.
 layout(location = 0) out vec4 o_color;
+#ifdef WEIGHTED_TRANSPARENCY
+layout(location = 1) out float o_revealage;
+
+uniform float transparent_opacity;
+#endif
 
 void main()
 {
-	// Set the output color to a nice golden yellow
-	o_color = vec4(1.0, 0.79, 0.03, 1.0);
+	// The sprite covers the particle's mesh at size 1, the same way up as the particle. Its
+	// transparent parts are cut out, since particles aren't blended, except for motion trails,
+	// and with weighted transparency, when they fade out with the sprite.
+	vec2 sprite_uv = v_vertex_position * vec2(0.5, -0.5) + 0.5;
+	vec4 sprite = texture(particle_sprites, vec3(sprite_uv, v_sprite));
+#ifdef WEIGHTED_TRANSPARENCY
+	if (sprite.a <= 0.0)
+		discard;
+#else
+	if (sprite.a < 0.5)
+		discard;
+#endif
+
+	// Tint it a nice golden yellow, and add whatever the point lights nearby shine on it. The
+	// particles are flat, facing the camera.
+	vec3 color = vec3(1.0, 0.79, 0.03) * sprite.rgb;
+	color += color * point_lighting(vec3(v_world_position, 0.0), vec3(0.0, 0.0, 1.0));
+
+	// Motion trails fade out towards their tails; they're blended, so this is how much shows.
+	// Without them, it's always 1.
+#ifdef WEIGHTED_TRANSPARENCY
+	// Every particle's at the same depth, so the usual weighting by it would be the same for all
+	// of them. They're weighted by their opacity instead, so the more opaque ones show most.
+	float alpha = sprite.a * transparent_opacity * (1.0 - v_trail);
+	float weight = clamp(alpha, 0.01, 1.0);
+	o_color = vec4(color * alpha, alpha) * weight;
+	o_revealage = alpha;
+#else
+	o_color = vec4(color, 1.0 - v_trail);
+#endif
 }
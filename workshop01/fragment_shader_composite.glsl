@@ -0,0 +1,18 @@
+// Fragment shader for laying the particles, drawn at a reduced resolution, over the scene
+#version 410
+
+// Input data from vertex shader
+layout(location = 0) in vec2 o_vertex_position;
+
+// Composite parameters passed from main app
+uniform sampler2D particles;		// colors premultiplied by how much they cover, which is in alpha
+
+// Output data to the framebuffer
+layout(location = 0) out vec4 o_color;
+
+void main()
+{
+	// Bilinear filtering does the scaling. With the colors premultiplied, the particles' edges fade
+	// into nothing, rather than into the black of the empty texels around them.
+	o_color = texture(particles, o_vertex_position * 0.5 + 0.5);
+}
@@ -0,0 +1,56 @@
+// Fragment shader for the text overlay: a grid of characters in a tiny 3x5 font, over a dark background
+#version 410
+
+// Input data from vertex shader
+layout(location = 0) in vec2 v_overlay_position;
+
+// Overlay parameters passed from main app
+uniform vec2 overlay_size;			// in pixels
+uniform float glyph_scale;			// pixels per font pixel
+uniform uvec4 overlay_text[32];		// the characters, four to a uint: see pack_text_overlay()
+
+// Must match text_overlay.h
+const int overlay_columns = 32;
+const int overlay_rows = 16;
+
+// Each character is 3x5 font pixels in a 4x6 cell, leaving a gap to the next one
+const ivec2 glyph_size = ivec2(3, 5);
+const ivec2 cell_size = ivec2(4, 6);
+
+// The font, for ASCII 32 (space) to 95 (underscore). Bit (row * 3 + column) of each is set where
+// the character is lit, from the top left. The characters we don't need are left blank.
+const uint font[64] = uint[64](
+	0x0000u, 0x0000u, 0x0000u, 0x0000u, 0x0000u, 0x52a5u, 0x0000u, 0x0000u,
+	0x224au, 0x2922u, 0x0000u, 0x05d0u, 0x1400u, 0x01c0u, 0x2000u, 0x12a4u,
+	0x7b6fu, 0x749au, 0x73e7u, 0x79a7u, 0x49edu, 0x79cfu, 0x7bcfu, 0x2527u,
+	0x7befu, 0x79efu, 0x0410u, 0x0000u, 0x0000u, 0x0e38u, 0x0000u, 0x0000u,
+	0x0000u, 0x5beau, 0x3aebu, 0x624eu, 0x3b6bu, 0x72cfu, 0x12cfu, 0x6b4eu,
+	0x5bedu, 0x7497u, 0x2b24u, 0x5aedu, 0x7249u, 0x5bfdu, 0x5b6bu, 0x2b6au,
+	0x12ebu, 0x676au, 0x5aebu, 0x388eu, 0x2497u, 0x7b6du, 0x2b6du, 0x5fedu,
+	0x5aadu, 0x24adu, 0x72a7u, 0x324bu, 0x0000u, 0x6926u, 0x0000u, 0x7000u
+);
+
+// Output data to the framebuffer
+layout(location = 0) out vec4 o_color;
+
+void main()
+{
+	o_color = vec4(0.0, 0.0, 0.0, 0.6);
+
+	// Find the cell we're in, leaving a font pixel of margin around the edge
+	ivec2 font_pixel = ivec2(v_overlay_position * overlay_size / glyph_scale) - ivec2(1);
+	if (font_pixel.x < 0 || font_pixel.y < 0)
+		return;
+	ivec2 cell = font_pixel / cell_size;
+	ivec2 glyph_pixel = font_pixel - cell * cell_size;
+	if (cell.x >= overlay_columns || cell.y >= overlay_rows || any(greaterThanEqual(glyph_pixel, glyph_size)))
+		return;
+
+	// Look up the character, and then whether its glyph is lit here
+	int index = cell.y * overlay_columns + cell.x;
+	uint character = (overlay_text[index / 16][(index / 4) % 4] >> uint(8 * (index % 4))) & 0xffu;
+	if (character < 32u || character >= 96u)
+		return;
+	if (((font[character - 32u] >> uint(glyph_pixel.y * 3 + glyph_pixel.x)) & 1u) != 0u)
+		o_color = vec4(1.0);
+}
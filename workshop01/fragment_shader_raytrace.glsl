@@ -1,18 +1,45 @@
 // Fragment shader for simple particle system
 #version 410
 
-// Uniforms passed from main app: this matches struct uniform_data in the C++ code
-layout(std140) uniform uniform_data
-{
-	vec2 window_size;		// window size in world space
-	vec2 window_center;		// window center in world space	
-    vec3 light_dir;         // direction of a light source
-	float time;				// current simulation time in seconds
-};
+#include "uniform_data.glsl"
+#include "raytrace_shading.glsl"
+#include "point_lights.glsl"
 
 // Input data from vertex shader
 layout(location = 0) in vec2 o_vertex_position;
 
+// This is built in variants, with this defined or not, as the C++ code asks for them:
+//  - BALL_WITH_DEPTH for the hybrid scene, where this traces only a ball, and writes its depth, for
+//    the rasterized particles drawn after it to be depth tested against. Misses are discarded,
+//    leaving the sky that was cleared to.
+//  - PROGRESSIVE to add more samples to the ones accumulated over the last few frames, each with
+//    its ray jittered within the pixel, and with soft shadows from a random point on the light.
+//    The sums are in linear color, with how many samples went into them in alpha, and
+//    fragment_shader_resolve.glsl averages them for display.
+//  - GEOMETRY_ONLY to write what the ray hit instead of a color: the normal, and the distance to
+//    it, or all zeros if it hit nothing. fragment_shader_shade.glsl lights it from there, for as
+//    many frames as the particles and camera hold still.
+#ifdef BALL_WITH_DEPTH
+uniform vec4 ball;		// center, radius
+#endif
+#ifdef PROGRESSIVE
+uniform sampler2D accumulation;		// the sums so far, the same size as the framebuffer
+uniform int sample_index;			// how many samples the sums have in them; 0 to start afresh
+uniform int num_samples;			// how many to add to them
+uniform vec2 pixel_size;			// in normalized device coordinates, for jittering across a pixel
+uniform float light_radius;			// the size of the light's disc, relative to its distance
+#endif
+
+// The particles, as spheres, and the BVH over them (see particle_bvh.h). Each node is two texels:
+// its box's min corner and left child, then its max corner and right child. The children are
+// stored as int bits; an internal node is its index, and a leaf is ~ its sphere's index.
+uniform samplerBuffer bvh_nodes;
+uniform samplerBuffer bvh_spheres;		// center, radius
+uniform int bvh_num_spheres;
+
+// Deep enough for any tree the BVH builder makes; it's about the number of bits in its keys
+const int max_bvh_stack = 64;
+
 // Output data to the framebuffer
 layout(location = 0) out vec4 o_color;
 
@@ -43,49 +70,172 @@ bool ray_sphere_intersect (in vec3 raydir, in vec3 rayorig, in vec3 pos,
     return true;
 }
 
-// Gamma correction for proper linear lighting
-vec3 gamma_correct(vec3 linear_color)
+// Test a ray against a box, for whether it hits it closer than max_distance
+bool ray_box_intersect (in vec3 inv_raydir, in vec3 rayorig, in vec3 box_min, in vec3 box_max, in float max_distance)
+{
+    vec3 t0 = (box_min - rayorig) * inv_raydir;
+    vec3 t1 = (box_max - rayorig) * inv_raydir;
+    vec3 t_near = min(t0, t1);
+    vec3 t_far = max(t0, t1);
+    float enter = max(max(t_near.x, t_near.y), max(t_near.z, 0.0f));
+    float leave = min(min(t_far.x, t_far.y), min(t_far.z, max_distance));
+    return enter <= leave;
+}
+
+
+// Find the closest particle a ray hits, nearer than max_distance, by walking the BVH, skipping
+// every box that the ray misses or only hits further away than what it's already hit. For shadow
+// rays, it's enough to know there's anything in the way, so any_hit stops at the first hit.
+bool trace_particles (in vec3 rayorig, in vec3 raydir, in float max_distance, in bool any_hit,
+    out float closest_distance, out vec3 closest_normal)
+{
+    vec3 inv_raydir = 1.0f / raydir;
+    closest_distance = max_distance;
+    closest_normal = vec3(0.0f);
+    bool intersects_sphere = false;
+    int stack[max_bvh_stack];
+    int stack_size = 0;
+    if (bvh_num_spheres > 0)
+        stack[stack_size++] = (bvh_num_spheres == 1) ? ~0 : 0;
+    while (stack_size > 0)
+    {
+        int node = stack[--stack_size];
+        if (node < 0)
+        {
+            vec4 sphere = texelFetch(bvh_spheres, ~node);
+            vec3 hit_point;
+            float hit_distance;
+            vec3 hit_normal;
+            if (ray_sphere_intersect(raydir, rayorig, sphere.xyz, sphere.w, hit_point, hit_distance, hit_normal) &&
+                hit_distance < closest_distance)
+            {
+                closest_distance = hit_distance;
+                closest_normal = hit_normal;
+                intersects_sphere = true;
+                if (any_hit)
+                    break;
+            }
+            continue;
+        }
+
+        vec4 min_left = texelFetch(bvh_nodes, 2 * node);
+        vec4 max_right = texelFetch(bvh_nodes, 2 * node + 1);
+        if (!ray_box_intersect(inv_raydir, rayorig, min_left.xyz, max_right.xyz, closest_distance))
+            continue;
+        if (stack_size + 2 <= max_bvh_stack)
+        {
+            stack[stack_size++] = floatBitsToInt(max_right.w);
+            stack[stack_size++] = floatBitsToInt(min_left.w);
+        }
+    }
+    return intersects_sphere;
+}
+
+#ifdef PROGRESSIVE
+// A cheap integer hash, for random numbers that differ per pixel and per sample
+uint hash (in uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// A random number in [0, 1), moving the state on
+float random (inout uint state)
 {
-    return vec3(pow(linear_color.x, 1.0f / 2.2f),
-                pow(linear_color.y, 1.0f / 2.2f),
-                pow(linear_color.z, 1.0f / 2.2f));
+    state = hash(state);
+    return float(state >> 8) * (1.0f / 16777216.0f);
 }
+#endif
 
 void main()
 {
-    // Set up sphere
-    float sphere_radius = 4.0f;
-    vec3 sphere_center = vec3(0.0f, 0.0f, 0.0f);
-    vec3 camera_position = vec3(-10.0f, 0.0f, 0.0f);
-    vec3 sphere_base_color = vec3(0.3f, 0.7f, 1.0f);
-    
-    // Set up camera
-    vec3 camera_facing = vec3(1.0f, 0.0f, 0.0f);
-    vec3 camera_up = vec3(0.0f, 1.0f, 0.0f);
-    vec3 camera_right = vec3(0.0f, 0.0f, 1.0f);
-    
-    // Calculate our ray vector
-    vec3 camera_ray = camera_facing +
-                      camera_up * o_vertex_position.y +
-                      camera_right * o_vertex_position.x * window_size.x / window_size.y;
-	
-    
-    // Perform the ray/sphere intersection
-    vec3 hit_point;
-    float hit_distance;
-    vec3 hit_normal;
-    bool intersects_sphere = ray_sphere_intersect(camera_ray, camera_position, sphere_center, sphere_radius, hit_point, hit_distance, hit_normal);
-    
-    // Output color based on hit result
-    if (intersects_sphere)
+    // Set up camera: it looks straight down at the particles' plane, z = 0, from far enough back
+    // that the part of the plane in view is the same as the rasterized scene's. (The C++ code's
+    // get_raytrace_scissor() projects with this camera too, so keep them in step.)
+    float camera_distance = window_size.y;
+    vec3 camera_position = vec3(window_center, camera_distance);
+    vec3 plane_point = vec3(window_center + o_vertex_position * 0.5f * window_size, 0.0f);
+
+    // Calculate our ray vector. It's normalized, so hit distances are along it.
+    vec3 camera_ray = normalize(plane_point - camera_position);
+
+#if defined(BALL_WITH_DEPTH)
+    vec3 ball_hit_point;
+    float ball_hit_distance;
+    vec3 ball_hit_normal;
+    if (!ray_sphere_intersect(camera_ray, camera_position, ball.xyz, ball.w, ball_hit_point, ball_hit_distance, ball_hit_normal))
+        discard;
+    vec3 ball_color = (max(dot(ball_hit_normal, light_dir), 0.0) * 0.8f + 0.2f + point_lighting(ball_hit_point, ball_hit_normal)) * vec3(0.3f, 0.7f, 1.0f);
+    o_color = vec4(gamma_correct(ball_color), 1.0f);
+
+    // The particles are rasterized flat, at depth 0.5, which is z = 0 here. The rest of z maps to
+    // depth either side of that, nearer the camera being less.
+    gl_FragDepth = 0.5f - 0.5f * ball_hit_point.z / camera_distance;
+#elif defined(PROGRESSIVE)
+    // A different sequence of random numbers for every pixel and every sample
+    uint random_state = hash(uint(gl_FragCoord.x) | (uint(gl_FragCoord.y) << 16)) ^ hash(uint(sample_index));
+
+    // A basis around the light's direction, for picking points on its disc
+    vec3 light_axis = normalize(light_dir);
+    vec3 light_tangent = normalize(cross(light_axis, abs(light_axis.y) < 0.9f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f)));
+    vec3 light_bitangent = cross(light_axis, light_tangent);
+
+    vec3 sum = vec3(0.0f);
+    for (int i = 0; i < num_samples; ++i)
     {
-        // Simple light calculation
-        vec3 linear_out = max(dot(hit_normal, light_dir), 0.0) * sphere_base_color;
-        o_color = vec4(gamma_correct(linear_out), 0.0f);
+        // Jitter the ray across the pixel, so the average is antialiased
+        vec2 jitter = vec2(random(random_state), random(random_state)) - 0.5f;
+        vec3 sample_point = plane_point + vec3(jitter * pixel_size * 0.5f * window_size, 0.0f);
+        vec3 sample_ray = normalize(sample_point - camera_position);
+
+        float hit_distance;
+        vec3 hit_normal;
+        if (!trace_particles(camera_position, sample_ray, 1e30f, false, hit_distance, hit_normal))
+        {
+            sum += sky_color();
+            continue;
+        }
+
+        // Light it from a random point on the light's disc, if there's nothing in the way. Over
+        // enough samples, the shadows' edges blur by how much of the disc each point can see.
+        float disc_angle = 6.283185f * random(random_state);
+        float disc_radius = light_radius * sqrt(random(random_state));
+        vec3 to_light = normalize(light_axis + disc_radius * (cos(disc_angle) * light_tangent + sin(disc_angle) * light_bitangent));
+        float light_visibility = 0.0f;
+        if (dot(hit_normal, to_light) > 0.0f)
+        {
+            vec3 shadow_origin = camera_position + hit_distance * sample_ray + hit_normal * 1e-3f;
+            float shadow_distance;
+            vec3 shadow_normal;
+            light_visibility = trace_particles(shadow_origin, to_light, 1e30f, true, shadow_distance, shadow_normal) ? 0.0f : 1.0f;
+        }
+        sum += shade_particle(hit_normal, to_light, light_visibility);
+        sum += particle_base_color() * point_lighting(camera_position + hit_distance * sample_ray, hit_normal);
     }
+
+    vec4 accumulated = (sample_index > 0) ? texelFetch(accumulation, ivec2(gl_FragCoord.xy), 0) : vec4(0.0f);
+    o_color = accumulated + vec4(sum, float(num_samples));
+#elif defined(GEOMETRY_ONLY)
+    float hit_distance;
+    vec3 hit_normal;
+    if (trace_particles(camera_position, camera_ray, 1e30f, false, hit_distance, hit_normal))
+        o_color = vec4(hit_normal, hit_distance);
     else
+        o_color = vec4(0.0f);
+#else
+    // One ray per pixel, with no shadows
+    float hit_distance;
+    vec3 hit_normal;
+    if (trace_particles(camera_position, camera_ray, 1e30f, false, hit_distance, hit_normal))
     {
-        // Solid color elsewhere
-        o_color = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+        vec3 lighting = particle_base_color() * point_lighting(camera_position + hit_distance * camera_ray, hit_normal);
+        o_color = vec4(gamma_correct(shade_particle(hit_normal, light_dir, 1.0f) + lighting), 1.0f);
     }
+    else
+        o_color = vec4(gamma_correct(sky_color()), 1.0f);
+#endif
 }
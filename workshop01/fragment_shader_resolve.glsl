@@ -0,0 +1,21 @@
+// Fragment shader for showing the progressive raytracer's samples: the average of every pixel's so far
+#version 410
+
+// Input data from vertex shader
+layout(location = 0) in vec2 o_vertex_position;
+
+// Resolve parameters passed from main app
+uniform sampler2D accumulation;		// sums of linear colors, with how many samples are in each in alpha
+
+// Output data to the framebuffer
+layout(location = 0) out vec4 o_color;
+
+void main()
+{
+	// Pixels that were never traced, being outside everything the raytracer could hit, are sky
+	vec4 sum = texelFetch(accumulation, ivec2(gl_FragCoord.xy), 0);
+	if (sum.a > 0.0)
+		o_color = vec4(pow(sum.rgb / sum.a, vec3(1.0 / 2.2)), 1.0);
+	else
+		o_color = vec4(0.0, 0.6, 1.0, 1.0);
+}
@@ -0,0 +1,33 @@
+// Fragment shader for lighting what the raytracer hit last time it traced, without tracing again
+#version 410
+
+#include "uniform_data.glsl"
+#include "raytrace_shading.glsl"
+#include "point_lights.glsl"
+
+// Input data from vertex shader
+layout(location = 0) in vec2 o_vertex_position;
+
+// Shading parameters passed from main app
+uniform sampler2D geometry;		// the normal and hit distance per pixel, or zeros for a miss; the same size as what's drawn here
+
+// Output data to the framebuffer
+layout(location = 0) out vec4 o_color;
+
+void main()
+{
+	vec4 hit = texelFetch(geometry, ivec2(gl_FragCoord.xy), 0);
+	if (hit.w > 0.0)
+	{
+		// Where it hit, for the point lights, from the same camera as fragment_shader_raytrace.glsl's
+		float camera_distance = window_size.y;
+		vec3 camera_position = vec3(window_center, camera_distance);
+		vec3 plane_point = vec3(window_center + o_vertex_position * 0.5 * window_size, 0.0);
+		vec3 hit_position = camera_position + hit.w * normalize(plane_point - camera_position);
+		vec3 normal = normalize(hit.xyz);
+		vec3 lighting = particle_base_color() * point_lighting(hit_position, normal);
+		o_color = vec4(gamma_correct(shade_particle(normal, light_dir, 1.0) + lighting), 1.0);
+	}
+	else
+		o_color = vec4(gamma_correct(sky_color()), 1.0);
+}
@@ -0,0 +1,26 @@
+// Fragment shader for laying the particles, drawn with weighted blended transparency, over the scene
+#version 410
+
+// Input data from vertex shader
+layout(location = 0) in vec2 o_vertex_position;
+
+// Resolve parameters passed from main app
+uniform sampler2D accumulation;		// the particles' weighted, premultiplied colors, and their weights, summed
+uniform sampler2D revealage;		// how much of the scene shows through all of them
+
+// Output data to the framebuffer
+layout(location = 0) out vec4 o_color;
+
+void main()
+{
+	vec2 uv = o_vertex_position * 0.5 + 0.5;
+	float revealed = texture(revealage, uv).r;
+	if (revealed >= 1.0)
+		discard;
+
+	// The weighted average of the colors over the pixel, premultiplied by how much they cover
+	// between them, however many there were and whatever order they came in
+	vec4 sum = texture(accumulation, uv);
+	vec3 average = sum.rgb / max(sum.a, 1e-5);
+	o_color = vec4(average * (1.0 - revealed), 1.0 - revealed);
+}
@@ -0,0 +1,21 @@
+// Fragment shader for scaling the raytraced scene up from the resolution it was rendered at
+#version 410
+
+// Input data from vertex shader
+layout(location = 0) in vec2 o_vertex_position;
+
+// Upscale parameters passed from main app
+uniform sampler2D scene;			// rendered into the bottom left corner
+uniform vec2 scene_uv_scale;		// the rendered part's size, as a fraction of the texture's
+uniform vec2 scene_uv_max;			// half a texel in from the rendered part's far edges
+
+// Output data to the framebuffer
+layout(location = 0) out vec4 o_color;
+
+void main()
+{
+	// Bilinear filtering does the actual scaling. Clamping keeps it from blending in the stale
+	// texels past the rendered part, off its top and right edges.
+	vec2 uv = min((o_vertex_position * 0.5 + 0.5) * scene_uv_scale, scene_uv_max);
+	o_color = texture(scene, uv);
+}
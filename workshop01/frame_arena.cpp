@@ -0,0 +1,139 @@
+// Frame arena: a bump allocator per thread for things that only last the frame, so steady frames never go to the heap
+
+#include "frame_arena.h"
+#include "perf_counters.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+// Memory a frame needed beyond what the arena had, from the heap. The blocks are chained, latest
+// first, and the memory handed out follows the header.
+struct overflow_block
+{
+	overflow_block*	next;
+	size_t			bytes;
+};
+
+struct frame_arena
+{
+	char*				memory = nullptr;
+	size_t				capacity = 0;
+	size_t				used = 0;
+	overflow_block*		overflow = nullptr;
+	size_t				overflow_bytes = 0;
+	size_t				wanted = 0;			// the most the thread has had out at once, overflow and all
+
+	~frame_arena();
+};
+
+static thread_local frame_arena this_thread_arena;
+
+static void free_overflow(frame_arena* arena, overflow_block* until)
+{
+	while (arena->overflow != until)
+	{
+		overflow_block* block = arena->overflow;
+		arena->overflow = block->next;
+		arena->overflow_bytes -= block->bytes;
+		free(block);
+	}
+}
+
+// Once the arena's empty, make it big enough for what it's been asked for, so the heap's only
+// used again if a later frame needs more still
+static void grow_to_fit(frame_arena* arena)
+{
+	if (arena->wanted <= arena->capacity)
+		return;
+
+	size_t capacity = frame_arena_initial_size;
+	while (capacity < arena->wanted)
+		capacity *= 2;
+	free(arena->memory);
+	arena->memory = (char*)malloc(capacity);
+	arena->capacity = arena->memory ? capacity : 0;
+}
+
+frame_arena::~frame_arena()
+{
+	free_overflow(this, nullptr);
+	free(memory);
+}
+
+static void* alloc_overflow(frame_arena* arena, size_t bytes, size_t alignment)
+{
+	static int heap_allocs_counter = register_perf_counter("frame arena heap allocs", perf_counter_per_frame);
+	add_perf_counter(heap_allocs_counter, 1);
+
+	size_t block_bytes = sizeof(overflow_block) + alignment + bytes;
+	overflow_block* block = (overflow_block*)malloc(block_bytes);
+	if (!block)
+		return nullptr;
+	block->next = arena->overflow;
+	block->bytes = block_bytes;
+	arena->overflow = block;
+	arena->overflow_bytes += block_bytes;
+	if (arena->used + arena->overflow_bytes > arena->wanted)
+		arena->wanted = arena->used + arena->overflow_bytes;
+
+	uintptr_t address = uintptr_t(block + 1);
+	return (void*)((address + alignment - 1) & ~uintptr_t(alignment - 1));
+}
+
+void* frame_alloc(size_t bytes, size_t alignment)
+{
+	frame_arena* arena = &this_thread_arena;
+	if (!arena->memory)
+	{
+		arena->memory = (char*)malloc(frame_arena_initial_size);
+		arena->capacity = arena->memory ? frame_arena_initial_size : 0;
+	}
+
+	if (!arena->memory)
+		return alloc_overflow(arena, bytes, alignment);
+
+	uintptr_t address = uintptr_t(arena->memory + arena->used);
+	size_t start = size_t(((address + alignment - 1) & ~uintptr_t(alignment - 1)) - uintptr_t(arena->memory));
+	if (start + bytes > arena->capacity)
+		return alloc_overflow(arena, bytes, alignment);
+
+	arena->used = start + bytes;
+	if (arena->used + arena->overflow_bytes > arena->wanted)
+		arena->wanted = arena->used + arena->overflow_bytes;
+	return arena->memory + start;
+}
+
+void frame_free(void* memory, size_t bytes)
+{
+	frame_arena* arena = &this_thread_arena;
+	char* start = (char*)memory;
+	if (arena->memory && start >= arena->memory && start + bytes == arena->memory + arena->used)
+		arena->used = size_t(start - arena->memory);
+}
+
+void reset_frame_arena()
+{
+	frame_arena* arena = &this_thread_arena;
+	free_overflow(arena, nullptr);
+	arena->used = 0;
+	grow_to_fit(arena);
+}
+
+frame_arena_scope::frame_arena_scope()
+{
+	frame_arena* arena = &this_thread_arena;
+	mark = arena->used;
+	overflow = arena->overflow;
+}
+
+frame_arena_scope::~frame_arena_scope()
+{
+	// Something from before the scope may have been freed while it was open, taking the arena
+	// back past the mark
+	frame_arena* arena = &this_thread_arena;
+	free_overflow(arena, (overflow_block*)overflow);
+	if (arena->used > mark)
+		arena->used = mark;
+	if (arena->used == 0 && !arena->overflow)
+		grow_to_fit(arena);
+}
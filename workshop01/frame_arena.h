@@ -0,0 +1,53 @@
+// Frame arena: a bump allocator per thread for things that only last the frame, so steady frames never go to the heap
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// What a thread's arena starts with. If a frame needs more, the rest comes from the heap, and the
+// arena grows to fit at the next reset.
+static const size_t frame_arena_initial_size = 256 * 1024;
+
+// Take memory from this thread's arena. It lasts until reset_frame_arena(), or the end of the
+// frame_arena_scope it was taken in, so nothing taken from it should be kept beyond that.
+void* frame_alloc(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+// Hand memory back. Only the latest allocation is really freed, so strings and vectors that
+// grow, or are made and dropped in a loop, keep reusing the same space; the rest waits for the
+// reset. Memory from another thread's arena is left alone.
+void frame_free(void* memory, size_t bytes);
+
+// Free everything taken from this thread's arena at once. Call at the end of each frame, on each
+// thread that has frames.
+void reset_frame_arena();
+
+// For threads that don't have frames, such as the workers: everything taken from the thread's
+// arena while the scope's open is freed when it closes
+struct frame_arena_scope
+{
+	frame_arena_scope();
+	~frame_arena_scope();
+
+	size_t	mark;			// how much of the arena was in use when the scope opened
+	void*	overflow;		// the latest heap block by then
+};
+
+// For standard containers to allocate from the arena
+template <typename T>
+struct frame_allocator
+{
+	typedef T value_type;
+
+	frame_allocator() {}
+	template <typename U> frame_allocator(const frame_allocator<U>&) {}
+
+	T* allocate(size_t count) { return (T*)frame_alloc(count * sizeof(T), alignof(T)); }
+	void deallocate(T* memory, size_t count) { frame_free(memory, count * sizeof(T)); }
+};
+
+template <typename T, typename U> bool operator==(const frame_allocator<T>&, const frame_allocator<U>&) { return true; }
+template <typename T, typename U> bool operator!=(const frame_allocator<T>&, const frame_allocator<U>&) { return false; }
+
+typedef std::basic_string<char, std::char_traits<char>, frame_allocator<char>> frame_string;
+template <typename T> using frame_vector = std::vector<T, frame_allocator<T>>;
@@ -0,0 +1,408 @@
+// Frame capture: reads frames back through a ring of pixel pack buffers, and encodes them on a background thread, so recording never stalls the render
+
+#include "frame_capture.h"
+#include "cpu_profiler.h"
+#include "gl_debug.h"
+#include "gl_state.h"
+#include "gpu_memory.h"
+#include "thread_config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+const char* const capture_format_names[num_capture_formats] = { "raw", "png", "ffmpeg" };
+
+// Where a buffer is in its round trip. Only the render thread moves it on, as the GL calls that
+// do are on its context; the encoder just says when it's done with the pixels.
+enum capture_buffer_state
+{
+	capture_buffer_free,
+	capture_buffer_reading,		// the GPU's copying a frame into it, up to its fence
+	capture_buffer_encoding,	// mapped, and queued for the encoder, or with it
+};
+
+struct capture_buffer
+{
+	GLuint					buffer;
+	GLsync					fence;
+	capture_buffer_state	state;
+	const uint8_t*			pixels;			// the mapping, while it's encoding
+	int						frame;			// which frame of the capture it is
+	std::atomic<bool>		encoded;		// the encoder's finished with the pixels
+};
+
+static capture_buffer					capture_buffers[num_capture_buffers];
+static int								capture_next_buffer = 0;	// the next to read into; they're used in turn
+static capture_format					capture_output_format = capture_format_raw;
+static std::string						capture_filename;
+static std::string						capture_png_prefix;			// the file name without ".png"
+static FILE*							capture_file = nullptr;		// the raw file, or the pipe to ffmpeg
+static int								capture_width = 0;
+static int								capture_height = 0;
+static int								capture_frames_read = 0;
+static int								capture_frames_dropped = 0;
+static std::atomic<int>					capture_frames_failed(0);	// the encoder couldn't write them
+static bool								capture_running = false;
+
+static std::thread						capture_encoder;
+static std::mutex						capture_lock;
+static std::condition_variable			capture_wake;				// there's a frame queued, or it's time to quit
+static std::deque<capture_buffer*>		capture_queue;
+static bool								capture_quitting = false;
+
+capture_format get_capture_format(const char* filename)
+{
+	const char* extension = strrchr(filename, '.');
+	if (extension && (strcmp(extension, ".rgba") == 0 || strcmp(extension, ".raw") == 0))
+		return capture_format_raw;
+	if (extension && strcmp(extension, ".png") == 0)
+		return capture_format_png;
+	return capture_format_ffmpeg;
+}
+
+// CRC-32, which every PNG chunk ends with, through the usual table
+struct crc_table
+{
+	uint32_t	values[256];
+
+	crc_table()
+	{
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; ++bit)
+				crc = (crc & 1) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+			values[i] = crc;
+		}
+	}
+};
+
+static uint32_t update_crc(uint32_t crc, const uint8_t* data, size_t size)
+{
+	static const crc_table table;
+	for (size_t i = 0; i < size; ++i)
+		crc = table.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static void put_big_endian(uint8_t* out, uint32_t value)
+{
+	out[0] = uint8_t(value >> 24);
+	out[1] = uint8_t(value >> 16);
+	out[2] = uint8_t(value >> 8);
+	out[3] = uint8_t(value);
+}
+
+static bool write_png_chunk(FILE* file, const char* type, const uint8_t* data, size_t size)
+{
+	uint8_t header[8];
+	put_big_endian(header, uint32_t(size));
+	memcpy(header + 4, type, 4);
+	uint8_t footer[4];
+	put_big_endian(footer, update_crc(update_crc(0xffffffffu, header + 4, 4), data, size) ^ 0xffffffffu);
+	return fwrite(header, 1, 8, file) == 8 && fwrite(data, 1, size, file) == size && fwrite(footer, 1, 4, file) == 4;
+}
+
+// Write a frame as a PNG, the right way up. It isn't compressed: the zlib stream is all stored
+// blocks, which cost next to nothing to make, so the encoder keeps up with the frames; they can
+// be squeezed down afterwards. Only the encoder thread calls this, so it keeps its scratch space.
+static bool write_png(const char* filename, const uint8_t* pixels, int width, int height)
+{
+	static std::vector<uint8_t> scanlines;
+	static std::vector<uint8_t> stream;
+
+	// Each row's a filter type, none, then its pixels, from the top
+	size_t row_size = size_t(width) * 4;
+	scanlines.resize((row_size + 1) * height);
+	for (int y = 0; y < height; ++y)
+	{
+		uint8_t* scanline = &scanlines[(row_size + 1) * y];
+		scanline[0] = 0;
+		memcpy(scanline + 1, pixels + row_size * (height - 1 - y), row_size);
+	}
+
+	// Stored blocks of up to 65535 bytes, each with its length and that inverted, between the zlib
+	// header and the Adler-32 of the lot
+	static const size_t max_stored_block = 65535;
+	size_t num_blocks = (scanlines.size() + max_stored_block - 1) / max_stored_block;
+	stream.resize(2 + num_blocks * 5 + scanlines.size() + 4);
+	uint8_t* out = stream.data();
+	*out++ = 0x78;
+	*out++ = 0x01;
+	uint32_t adler_low = 1, adler_high = 0;
+	for (size_t first = 0; first < scanlines.size(); first += max_stored_block)
+	{
+		size_t size = std::min(max_stored_block, scanlines.size() - first);
+		*out++ = (first + size == scanlines.size()) ? 1 : 0;
+		*out++ = uint8_t(size);
+		*out++ = uint8_t(size >> 8);
+		*out++ = uint8_t(~size);
+		*out++ = uint8_t(~size >> 8);
+		memcpy(out, &scanlines[first], size);
+		out += size;
+		for (size_t i = first; i < first + size; ++i)
+		{
+			adler_low = (adler_low + scanlines[i]) % 65521;
+			adler_high = (adler_high + adler_low) % 65521;
+		}
+	}
+	put_big_endian(out, (adler_high << 16) | adler_low);
+
+	FILE* file = fopen(filename, "wb");
+	if (!file)
+		return false;
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	uint8_t header[13] = {};
+	put_big_endian(header, uint32_t(width));
+	put_big_endian(header + 4, uint32_t(height));
+	header[8] = 8;		// bits per channel
+	header[9] = 6;		// RGBA
+	bool written =
+		fwrite(signature, 1, 8, file) == 8 &&
+		write_png_chunk(file, "IHDR", header, sizeof(header)) &&
+		write_png_chunk(file, "IDAT", stream.data(), stream.size()) &&
+		write_png_chunk(file, "IEND", nullptr, 0);
+	return (fclose(file) == 0) && written;
+}
+
+static bool encode_captured_frame(const capture_buffer& buffer)
+{
+	if (capture_output_format == capture_format_png)
+	{
+		char filename[1024];
+		snprintf(filename, sizeof(filename), "%s_%05d.png", capture_png_prefix.c_str(), buffer.frame);
+		return write_png(filename, buffer.pixels, capture_width, capture_height);
+	}
+
+	// GL reads the bottom row first, and everything else wants the top
+	size_t row_size = size_t(capture_width) * 4;
+	for (int y = capture_height - 1; y >= 0; --y)
+	{
+		if (fwrite(buffer.pixels + row_size * y, 1, row_size, capture_file) != row_size)
+			return false;
+	}
+	return true;
+}
+
+static void capture_encoder_main()
+{
+	set_cpu_profiler_thread_name("capture encoder");
+	set_thread_role(thread_role_background, 0);
+	for (;;)
+	{
+		capture_buffer* buffer = nullptr;
+		{
+			std::unique_lock<std::mutex> guard(capture_lock);
+			capture_wake.wait(guard, [] { return capture_quitting || !capture_queue.empty(); });
+			if (capture_queue.empty())
+				break;
+			buffer = capture_queue.front();
+			capture_queue.pop_front();
+		}
+
+		{
+			CPU_PROFILE_SCOPE("encode frame");
+			if (!encode_captured_frame(*buffer))
+				capture_frames_failed.fetch_add(1, std::memory_order_relaxed);
+		}
+		buffer->encoded.store(true, std::memory_order_release);
+	}
+}
+
+// Unmap the buffers the encoder's done with, then map the frames the GPU's finished reading back
+// and queue them for it, in the order they were read. With 'wait', this waits for the GPU to
+// finish them all; otherwise it stops at the first that isn't ready.
+static void collect_capture_buffers(bool wait)
+{
+	for (capture_buffer& buffer : capture_buffers)
+	{
+		if (buffer.state == capture_buffer_encoding && buffer.encoded.load(std::memory_order_acquire))
+		{
+			state_bind_buffer(GL_PIXEL_PACK_BUFFER, buffer.buffer);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			buffer.pixels = nullptr;
+			buffer.state = capture_buffer_free;
+		}
+	}
+
+	// They're read into in turn, so the oldest is the one that'll be read into next
+	size_t size = size_t(capture_width) * capture_height * 4;
+	for (int i = 0; i < num_capture_buffers; ++i)
+	{
+		capture_buffer& buffer = capture_buffers[(capture_next_buffer + i) % num_capture_buffers];
+		if (buffer.state != capture_buffer_reading)
+			continue;
+		GLenum status = glClientWaitSync(buffer.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000 : 0);	// 1 second, in nanoseconds
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(buffer.fence);
+		buffer.fence = nullptr;
+
+		state_bind_buffer(GL_PIXEL_PACK_BUFFER, buffer.buffer);
+		buffer.pixels = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(size), GL_MAP_READ_BIT);
+		if (!buffer.pixels)
+		{
+			++capture_frames_dropped;
+			buffer.state = capture_buffer_free;
+			continue;
+		}
+		buffer.encoded.store(false, std::memory_order_relaxed);
+		buffer.state = capture_buffer_encoding;
+		{
+			std::lock_guard<std::mutex> guard(capture_lock);
+			capture_queue.push_back(&buffer);
+		}
+		capture_wake.notify_one();
+	}
+	state_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool start_frame_capture(const char* filename, int width, int height, int frame_rate)
+{
+	stop_frame_capture();
+	capture_output_format = get_capture_format(filename);
+	capture_filename = filename;
+	capture_width = width;
+	capture_height = height;
+	if (capture_output_format == capture_format_png)
+	{
+		capture_png_prefix = capture_filename.substr(0, capture_filename.size() - 4);
+	}
+	else if (capture_output_format == capture_format_raw)
+	{
+		capture_file = fopen(filename, "wb");
+	}
+	else
+	{
+		// If ffmpeg isn't there, or gives up, writing to the pipe fails, rather than killing us.
+		// yuv420p, which players expect, needs an even width and height.
+#ifndef _WIN32
+		signal(SIGPIPE, SIG_IGN);
+#endif
+		char command[1024];
+		snprintf(command, sizeof(command),
+			"ffmpeg -loglevel error -y -f rawvideo -pixel_format rgba -video_size %dx%d -framerate %d -i - "
+			"-vf \"crop=trunc(iw/2)*2:trunc(ih/2)*2\" -pix_fmt yuv420p \"%s\"", width, height, frame_rate, filename);
+#ifdef _WIN32
+		capture_file = popen(command, "wb");
+#else
+		capture_file = popen(command, "w");
+#endif
+	}
+	if (capture_output_format != capture_format_png && !capture_file)
+	{
+		printf("Error: couldn't open %s to capture frames to :(\n", filename);
+		return false;
+	}
+
+	// GL_STREAM_READ has the driver put them where the CPU can read them quickly
+	size_t size = size_t(width) * height * 4;
+	for (capture_buffer& buffer : capture_buffers)
+	{
+		glGenBuffers(1, &buffer.buffer);
+		state_bind_buffer(GL_PIXEL_PACK_BUFFER, buffer.buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(size), nullptr, GL_STREAM_READ);
+		label_gl_object(GL_BUFFER, buffer.buffer, "capture buffer");
+		set_gpu_memory(gpu_memory_buffer, buffer.buffer, int64_t(size));
+		buffer.fence = nullptr;
+		buffer.state = capture_buffer_free;
+		buffer.pixels = nullptr;
+	}
+	state_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+	capture_next_buffer = 0;
+	capture_frames_read = 0;
+	capture_frames_dropped = 0;
+	capture_frames_failed.store(0, std::memory_order_relaxed);
+
+	capture_quitting = false;
+	capture_encoder = std::thread(&capture_encoder_main);
+	capture_running = true;
+	printf("Capturing %dx%d frames to %s, as %s\n", width, height, filename, capture_format_names[capture_output_format]);
+	return true;
+}
+
+void capture_frame(int width, int height)
+{
+	if (!capture_running)
+		return;
+	CPU_PROFILE_SCOPE("capture frame");
+	collect_capture_buffers(false);
+
+	capture_buffer& buffer = capture_buffers[capture_next_buffer];
+	if (width != capture_width || height != capture_height || buffer.state != capture_buffer_free)
+	{
+		++capture_frames_dropped;
+		return;
+	}
+
+	// The back buffer holds the frame until it's swapped. With a pack buffer bound, this only
+	// queues up the copy, and the fence says when it's done.
+	state_bind_buffer(GL_PIXEL_PACK_BUFFER, buffer.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadBuffer(GL_BACK);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	state_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+	buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	buffer.frame = capture_frames_read++;
+	buffer.state = capture_buffer_reading;
+	capture_next_buffer = (capture_next_buffer + 1) % num_capture_buffers;
+}
+
+void stop_frame_capture()
+{
+	if (!capture_running)
+		return;
+
+	// Hand over everything that's still on its way back, and let the encoder finish it all
+	collect_capture_buffers(true);
+	{
+		std::lock_guard<std::mutex> guard(capture_lock);
+		capture_quitting = true;
+	}
+	capture_wake.notify_all();
+	capture_encoder.join();
+	collect_capture_buffers(false);
+
+	for (capture_buffer& buffer : capture_buffers)
+	{
+		if (buffer.fence)
+			glDeleteSync(buffer.fence);
+		buffer.fence = nullptr;
+		set_gpu_memory(gpu_memory_buffer, buffer.buffer, 0);
+		state_delete_buffers(1, &buffer.buffer);
+		buffer.buffer = 0;
+	}
+	if (capture_output_format == capture_format_ffmpeg)
+		pclose(capture_file);
+	else if (capture_file)
+		fclose(capture_file);
+	capture_file = nullptr;
+	capture_running = false;
+
+	int failed = capture_frames_failed.load(std::memory_order_relaxed);
+	printf("Captured %d frames to %s, and dropped %d\n", capture_frames_read - failed, capture_filename.c_str(), capture_frames_dropped);
+	if (failed > 0)
+		printf("Warning: %d captured frames couldn't be written!\n", failed);
+}
+
+bool frame_capture_running()
+{
+	return capture_running;
+}
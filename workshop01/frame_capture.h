@@ -0,0 +1,38 @@
+// Frame capture: reads frames back through a ring of pixel pack buffers, and encodes them on a background thread, so recording never stalls the render
+#pragma once
+
+// How many frames can be on their way back from the GPU, or with the encoder, at once. A frame's
+// read into a buffer, and mapped a frame or two later, once the GPU's finished it; the encoder
+// reads the pixels straight out of the mapping, and the buffer's only read into again once it's
+// done. If every buffer's still busy, the frame is dropped, rather than waiting for one.
+static const int num_capture_buffers = 4;
+
+enum capture_format
+{
+	capture_format_raw,			// every frame's RGBA8 pixels, top row first, one after another in one file
+	capture_format_png,			// a PNG per frame, numbered
+	capture_format_ffmpeg,		// piped into ffmpeg, which encodes it however the file's name says
+	num_capture_formats,
+};
+
+extern const char* const capture_format_names[num_capture_formats];
+
+// Which format a file name's for: .rgba or .raw for raw, .png for a PNG per frame (named like
+// "name_00000.png"), and anything else goes to ffmpeg
+capture_format get_capture_format(const char* filename);
+
+// Start capturing frames of width x height to the file, with the encoder thread; 'frame_rate' is
+// what ffmpeg's told the frames are at. Call from the main thread, with the GL context current.
+// Returns false if it couldn't start, such as when ffmpeg isn't there.
+bool start_frame_capture(const char* filename, int width, int height, int frame_rate);
+
+// Read back the frame just rendered, from the back buffer, before it's swapped. This never waits:
+// it maps the frames the GPU's finished and hands them to the encoder, and if the ring's full, or
+// the back buffer isn't the size the capture started at, drops this one.
+void capture_frame(int width, int height);
+
+// Wait for the frames in flight to be read back and encoded, then stop the encoder and release the
+// buffers. Says how many frames were captured, and how many were dropped.
+void stop_frame_capture();
+
+bool frame_capture_running();
@@ -0,0 +1,45 @@
+// Frame clock: samples the wall clock once per frame, and turns the time that has passed into a
+// whole number of fixed-length simulation steps
+
+#include "frame_clock.h"
+
+void init_frame_clock(frame_clock* clock, double step_rate_hz, int max_steps)
+{
+	*clock = frame_clock{};
+	clock->step = 1.0 / step_rate_hz;
+	clock->max_steps = max_steps;
+}
+
+void tick_frame_clock(frame_clock* clock, double wall_time)
+{
+	// The first frame has nothing to simulate yet
+	double elapsed = clock->started ? wall_time - clock->wall_time : 0.0;
+	clock->started = true;
+	clock->wall_time = wall_time;
+	if (elapsed > 0.0)
+		clock->accumulator += elapsed;
+
+	// Take as many whole steps as have built up, within the per-frame limit
+	int num_steps = int(clock->accumulator / clock->step);
+	if (num_steps > clock->max_steps)
+	{
+		num_steps = clock->max_steps;
+		clock->accumulator = num_steps * clock->step;
+	}
+	clock->accumulator -= num_steps * clock->step;
+	if (clock->accumulator < 0.0)
+		clock->accumulator = 0.0;
+
+	clock->num_steps = num_steps;
+	clock->sim_time += num_steps * clock->step;
+	clock->alpha = float(clock->accumulator / clock->step);
+	if (clock->alpha >= 1.0f)
+		clock->alpha = 0.99999f;
+}
+
+void tick_paused_frame_clock(frame_clock* clock, double wall_time)
+{
+	clock->started = true;
+	clock->wall_time = wall_time;
+	clock->num_steps = 0;
+}
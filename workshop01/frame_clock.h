@@ -0,0 +1,40 @@
+// Frame clock: samples the wall clock once per frame, and turns the time that has passed into a
+// whole number of fixed-length simulation steps
+#pragma once
+
+struct frame_clock
+{
+	double	step;				// length of one simulation step, in seconds
+	int		max_steps;			// most steps to run in one frame; time beyond that is dropped, so a long hitch can't snowball
+	double	wall_time;			// wall clock time this frame started, as passed to tick_frame_clock()
+	double	sim_time;			// simulation time once this frame's steps have run
+	double	accumulator;		// wall time that hasn't been simulated yet; always less than a step after a tick
+	int		num_steps;			// simulation steps to run this frame
+	float	alpha;				// how far the render time is between the previous step and the current one, in [0, 1)
+	bool	started;			// whether we've had a first tick
+};
+
+// Set up the clock to run the simulation at step_rate_hz steps per second
+void init_frame_clock(frame_clock* clock, double step_rate_hz, int max_steps);
+
+// Start a new frame at the given wall clock time. Everything in the frame should use the times
+// in the clock from here on, rather than reading the wall clock again.
+void tick_frame_clock(frame_clock* clock, double wall_time);
+
+// Start a new frame while paused: no steps, and the same render time as the last frame, so
+// everything drawn stays put. The wall clock's still followed, so unpausing doesn't try to catch
+// up on the time spent paused.
+void tick_paused_frame_clock(frame_clock* clock, double wall_time);
+
+// Simulation time at the start of this frame's steps
+inline double frame_start_sim_time(const frame_clock& clock)
+{
+	return clock.sim_time - clock.num_steps * clock.step;
+}
+
+// Time to render the frame at: between the last two simulation steps, by alpha. This trails
+// the wall clock by less than a step, and advances smoothly even though the steps don't.
+inline double frame_render_time(const frame_clock& clock)
+{
+	return clock.sim_time - (1.0 - clock.alpha) * clock.step;
+}
@@ -0,0 +1,122 @@
+// Frame replay: records each frame's clock reading and input to a file, and feeds them back, so a run can be repeated exactly
+
+#include "frame_replay.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const char frame_replay_magic[8] = { 'P', 'R', 'E', 'P', 'L', 'A', 'Y', '\0' };
+
+// The file's a header, then each frame as a record followed by its key events
+struct replay_file_header
+{
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	seed;
+};
+
+struct replay_file_frame
+{
+	double		wall_time;
+	float		raytrace_scale;
+	uint16_t	framebuffer_width;
+	uint16_t	framebuffer_height;
+	uint32_t	num_key_events;
+	uint16_t	particle_divisor;	// 0 in recordings from before there was one
+	uint16_t	unused;
+};
+
+bool start_replay_recording(frame_replay* replay, const char* filename, uint32_t seed)
+{
+	*replay = frame_replay{};
+	replay->file = fopen(filename, "wb");
+	if (!replay->file)
+		return false;
+
+	replay_file_header header = {};
+	memcpy(header.magic, frame_replay_magic, sizeof(header.magic));
+	header.version = frame_replay_version;
+	header.seed = seed;
+	fwrite(&header, sizeof(header), 1, replay->file);
+	replay->recording = true;
+	replay->seed = seed;
+	return true;
+}
+
+void record_replay_key_event(frame_replay* replay, int key, int scancode, int action, int mods)
+{
+	if (!replay->recording)
+		return;
+	replay_key_event event = { int16_t(key), int16_t(scancode), uint8_t(action), uint8_t(mods), 0 };
+	replay->key_events.push_back(event);
+}
+
+void record_replay_frame(frame_replay* replay, double wall_time, float raytrace_scale, int particle_divisor, int framebuffer_width, int framebuffer_height)
+{
+	if (!replay->recording)
+		return;
+	replay_file_frame frame = { wall_time, raytrace_scale, uint16_t(framebuffer_width), uint16_t(framebuffer_height), uint32_t(replay->key_events.size()), uint16_t(particle_divisor), 0 };
+	fwrite(&frame, sizeof(frame), 1, replay->file);
+	if (!replay->key_events.empty())
+		fwrite(replay->key_events.data(), sizeof(replay_key_event), replay->key_events.size(), replay->file);
+	replay->key_events.clear();
+}
+
+bool load_replay(frame_replay* replay, const char* filename)
+{
+	*replay = frame_replay{};
+	FILE* file = fopen(filename, "rb");
+	if (!file)
+	{
+		printf("Error: couldn't open replay %s :(\n", filename);
+		return false;
+	}
+
+	replay_file_header header = {};
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, frame_replay_magic, sizeof(header.magic)) != 0)
+	{
+		printf("Error: %s isn't a replay :(\n", filename);
+		fclose(file);
+		return false;
+	}
+	if (header.version != frame_replay_version)
+	{
+		printf("Error: %s is from a different version (%u, where this is %u) :(\n", filename, header.version, frame_replay_version);
+		fclose(file);
+		return false;
+	}
+
+	// A recording that was cut off part way through a frame just ends at the frame before
+	replay_file_frame record;
+	while (fread(&record, sizeof(record), 1, file) == 1)
+	{
+		size_t first_key_event = replay->key_events.size();
+		replay->key_events.resize(first_key_event + record.num_key_events);
+		if (record.num_key_events > 0 && fread(&replay->key_events[first_key_event], sizeof(replay_key_event), record.num_key_events, file) != record.num_key_events)
+		{
+			replay->key_events.resize(first_key_event);
+			break;
+		}
+		replay_frame frame = { record.wall_time, record.raytrace_scale, std::max(int(record.particle_divisor), 1), record.framebuffer_width, record.framebuffer_height, uint32_t(first_key_event), record.num_key_events };
+		replay->frames.push_back(frame);
+	}
+	fclose(file);
+
+	replay->playing = true;
+	replay->seed = header.seed;
+	return true;
+}
+
+const replay_frame* next_replay_frame(frame_replay* replay)
+{
+	if (!replay->playing || replay->next_frame == replay->frames.size())
+		return nullptr;
+	return &replay->frames[replay->next_frame++];
+}
+
+void free_frame_replay(frame_replay* replay)
+{
+	if (replay->file)
+		fclose(replay->file);
+	*replay = frame_replay{};
+}
@@ -0,0 +1,61 @@
+// Frame replay: records each frame's clock reading and input to a file, and feeds them back, so a run can be repeated exactly
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+static const uint32_t frame_replay_version = 1;
+
+// A key press, release or repeat, as GLFW gave it to the key callback
+struct replay_key_event
+{
+	int16_t		key;
+	int16_t		scancode;
+	uint8_t		action;
+	uint8_t		mods;
+	uint16_t	unused;
+};
+
+// What a frame depended on that isn't the same from one run to the next
+struct replay_frame
+{
+	double		wall_time;				// what the frame clock was ticked to
+	float		raytrace_scale;			// which the dynamic resolution picked from the GPU's timings
+	int			particle_divisor;		// and the reduced resolution the particles were drawn at
+	uint16_t	framebuffer_width;
+	uint16_t	framebuffer_height;
+	uint32_t	first_key_event;		// into frame_replay::key_events; the keys that came in before the frame
+	uint32_t	num_key_events;
+};
+
+struct frame_replay
+{
+	bool							recording;
+	bool							playing;
+	uint32_t						seed;				// random_seed, which the whole run's randomness comes from
+	FILE*							file;				// being recorded to
+	std::vector<replay_frame>		frames;				// played back; while recording, only ever the one being built
+	std::vector<replay_key_event>	key_events;
+	size_t							next_frame;			// to play back
+};
+
+// Start writing a recording. Returns false if the file couldn't be opened.
+bool start_replay_recording(frame_replay* replay, const char* filename, uint32_t seed);
+
+// Note a key event, for the frame that's about to be recorded
+void record_replay_key_event(frame_replay* replay, int key, int scancode, int action, int mods);
+
+// Write out a frame, with the key events since the last one. Frames are written as they go,
+// rather than kept, so a long run's recording needn't fit in memory.
+void record_replay_frame(frame_replay* replay, double wall_time, float raytrace_scale, int particle_divisor, int framebuffer_width, int framebuffer_height);
+
+// Read a whole recording in, to be played back. Returns false, having said why, if it can't be
+// read, or is a different version.
+bool load_replay(frame_replay* replay, const char* filename);
+
+// The next frame to play back, or null once they've all been played
+const replay_frame* next_replay_frame(frame_replay* replay);
+
+// Close the recording, or drop the one being played back
+void free_frame_replay(frame_replay* replay);
@@ -0,0 +1,55 @@
+// Compute shader for copying the particles to draw into the draw buffer, grouped by LOD
+#version 430
+
+layout(local_size_x = 256) in;
+
+#include "particle_data.glsl"
+
+layout(std430, binding = 0) readonly buffer particle_buffer
+{
+	particle particles[];
+};
+
+layout(std430, binding = 1) writeonly buffer draw_buffer
+{
+	particle draw_particles[];
+};
+
+// The items from cull_compute_shader.glsl: x is the sort key, and y the particle's index
+layout(std430, binding = 2) readonly buffer sort_buffer
+{
+	uvec2 items[];
+};
+
+#include "draw_command.glsl"
+
+layout(std430, binding = 3) buffer particle_draws
+{
+	draw_command draws[3];
+	uint lod_counts[3];
+	uint lod_cursors[3];
+	uint total_count;
+};
+
+// Set when sort_compute_shader.glsl has put the items in order, which groups them by LOD too.
+// Otherwise, they're in whatever order the culling found them, and we group them here.
+uniform bool sorted;
+
+// Must match particle_sort.h
+const int num_particle_lods = 3;
+const uint particle_lod_key_shift = 14u;
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= total_count)
+		return;
+
+	uint draw_index = i;
+	if (!sorted)
+	{
+		uint lod = uint(num_particle_lods - 1) - (items[i].x >> particle_lod_key_shift);
+		draw_index = draws[lod].base_instance + atomicAdd(lod_cursors[lod], 1u);
+	}
+	draw_particles[draw_index] = particles[items[i].y];
+}
@@ -0,0 +1,28 @@
+// GL debugging aids: a debug context with labeled objects and passes in debug builds, and none of it in release
+
+#include "gl_debug.h"
+
+static bool gl_debug_usable = false;
+
+void init_gl_debug()
+{
+	gl_debug_usable = use_gl_debug_context && GLAD_GL_KHR_debug;
+}
+
+void label_gl_object(GLenum identifier, GLuint name, const char* label)
+{
+	if (gl_debug_usable && name)
+		glObjectLabel(identifier, name, -1, label);
+}
+
+void push_gl_debug_group(const char* name)
+{
+	if (gl_debug_usable)
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+}
+
+void pop_gl_debug_group()
+{
+	if (gl_debug_usable)
+		glPopDebugGroup();
+}
@@ -0,0 +1,24 @@
+// GL debugging aids: a debug context with labeled objects and passes in debug builds, and none of it in release
+#pragma once
+
+#include <glad/glad.h>
+
+// Debug builds ask for a debug context, and print its messages. Release builds ask for a
+// no-error context instead, which lets the driver skip validating every call.
+#ifdef NDEBUG
+static const bool use_gl_debug_context = false;
+#else
+static const bool use_gl_debug_context = true;
+#endif
+
+// Call once the GL functions are loaded, to find out whether labels and debug groups are usable.
+// They need a debug context with KHR_debug; otherwise the calls below do nothing.
+void init_gl_debug();
+
+// Name an object, so graphics debuggers such as RenderDoc and Nsight show it by name. Buffers and
+// vertex arrays only become objects once they've been bound, so label them after that.
+void label_gl_object(GLenum identifier, GLuint name, const char* label);
+
+// Bracket a pass's GL calls, so captures of a frame show them grouped and named. These nest.
+void push_gl_debug_group(const char* name);
+void pop_gl_debug_group();
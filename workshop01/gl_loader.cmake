@@ -0,0 +1,124 @@
+# Writes a C source file that loads only the GL functions and extensions the sources use, in place of
+# glad.c, which loads every one glad.h declares.
+# Run as a script: cmake -DOUTPUT=<file.c> -DGLAD_HEADER=<glad.h> -DSOURCES=<file;file;...> -P gl_loader.cmake
+# Functions are found by name, so one that's only mentioned in a comment gets loaded too, which is
+# harmless; one that's never mentioned isn't defined, so using it without regenerating won't link.
+
+# What glad.h has to offer: function pointers, and flags for versions and extensions
+file(READ "${GLAD_HEADER}" header)
+string(REGEX MATCHALL "GLAPI PFN[A-Z0-9_]+PROC glad_gl[A-Za-z0-9_]+" header_functions "${header}")
+string(REGEX MATCHALL "GLAPI int GLAD_GL_[A-Za-z0-9_]+" header_flags "${header}")
+
+# What the sources mention
+set(used_names "")
+foreach (source ${SOURCES})
+	file(READ "${source}" text)
+	string(REGEX MATCHALL "GLAD_GL_[A-Za-z0-9_]+|gl[A-Z][A-Za-z0-9_]*" names "${text}")
+	list(APPEND used_names ${names})
+endforeach()
+
+# The loader itself needs these to check the version and list the extensions
+list(APPEND used_names glGetString glGetStringi glGetIntegerv)
+list(REMOVE_DUPLICATES used_names)
+
+set(definitions "")
+set(names "")
+set(pointers "")
+set(num_functions 0)
+foreach (declaration ${header_functions})
+	string(REGEX REPLACE "GLAPI (PFN[A-Z0-9_]+PROC) glad_(gl[A-Za-z0-9_]+)" "\\1;\\2" parts "${declaration}")
+	list(GET parts 0 type)
+	list(GET parts 1 name)
+	list(FIND used_names ${name} found)
+	if (NOT found EQUAL -1)
+		string(APPEND definitions "${type} glad_${name} = NULL;\n")
+		string(APPEND names "\t\"${name}\\0\"\n")
+		string(APPEND pointers "\t(void**)&glad_${name},\n")
+		math(EXPR num_functions "${num_functions} + 1")
+	endif()
+endforeach()
+
+set(flag_definitions "")
+set(version_checks "")
+set(extension_names "")
+set(extension_flags "")
+set(num_extensions 0)
+foreach (declaration ${header_flags})
+	string(REGEX REPLACE "GLAPI int (GLAD_GL_[A-Za-z0-9_]+)" "\\1" flag "${declaration}")
+	list(FIND used_names ${flag} found)
+	if (NOT found EQUAL -1)
+		string(APPEND flag_definitions "int ${flag} = 0;\n")
+		if (flag MATCHES "^GLAD_GL_VERSION_([0-9]+)_([0-9]+)$")
+			string(APPEND version_checks "\t${flag} = GLVersion.major > ${CMAKE_MATCH_1} || (GLVersion.major == ${CMAKE_MATCH_1} && GLVersion.minor >= ${CMAKE_MATCH_2});\n")
+		else()
+			string(REGEX REPLACE "^GLAD_" "" extension "${flag}")
+			string(APPEND extension_names "\t\"${extension}\",\n")
+			string(APPEND extension_flags "\t&${flag},\n")
+			math(EXPR num_extensions "${num_extensions} + 1")
+		endif()
+	endif()
+endforeach()
+
+# Empty arrays aren't allowed, so the extension tables always have a null at the end
+set(contents "/* Generated by gl_loader.cmake; don't edit */\n\n#include <stdio.h>\n#include <string.h>\n#include <glad/glad.h>\n\n")
+string(APPEND contents "struct gladGLversionStruct GLVersion;\n\n${flag_definitions}\n${definitions}\n")
+string(APPEND contents "/* The names, one after another, in the same order as the pointers */\n#define NUM_FUNCTIONS ${num_functions}\nstatic const char function_names[] =\n${names};\nstatic void** const function_pointers[NUM_FUNCTIONS] =\n{\n${pointers}};\n\n")
+string(APPEND contents "#define NUM_EXTENSIONS ${num_extensions}\nstatic const char* const extension_names[NUM_EXTENSIONS + 1] =\n{\n${extension_names}\tNULL\n};\nstatic int* const extension_flags[NUM_EXTENSIONS + 1] =\n{\n${extension_flags}\tNULL\n};\n\n")
+string(APPEND contents "static void find_version(void)
+{
+	const char* version = (const char*)glGetString(GL_VERSION);
+	GLVersion.major = 0;
+	GLVersion.minor = 0;
+	if (version)
+		sscanf(version, \"%d.%d\", &GLVersion.major, &GLVersion.minor);
+${version_checks}}
+
+/* One pass over the driver's extensions, looking each up among the few we want */
+static void find_extensions(void)
+{
+	GLint num_driver_extensions = 0;
+	GLint i;
+	int j;
+	if (!glGetStringi)
+		return;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &num_driver_extensions);
+	for (i = 0; i < num_driver_extensions; ++i)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		for (j = 0; extension && j < NUM_EXTENSIONS; ++j)
+		{
+			if (strcmp(extension, extension_names[j]) == 0)
+				*extension_flags[j] = 1;
+		}
+	}
+}
+
+int gladLoadGLLoader(GLADloadproc load)
+{
+	const char* name = function_names;
+	int i;
+	for (i = 0; i < NUM_FUNCTIONS; ++i)
+	{
+		*function_pointers[i] = load(name);
+#ifdef GL_LOADER_CHECK_MISSING
+		if (!*function_pointers[i])
+			printf(\"Warning: GL function %s isn't available!\\n\", name);
+#endif
+		name += strlen(name) + 1;
+	}
+
+	if (!glGetString)
+		return 0;
+	find_version();
+	find_extensions();
+	return GLVersion.major != 0 || GLVersion.minor != 0;
+}
+")
+
+# Only touch the output if it's changed, so it doesn't get recompiled for nothing
+if (EXISTS "${OUTPUT}")
+	file(READ "${OUTPUT}" old_contents)
+endif()
+if (NOT "${old_contents}" STREQUAL "${contents}")
+	file(WRITE "${OUTPUT}" "${contents}")
+endif()
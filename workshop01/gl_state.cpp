@@ -0,0 +1,191 @@
+// Render state tracker: shadows the GL bindings so calls that wouldn't change anything are skipped
+
+#include "gl_state.h"
+
+// Shadowed values start out unknown, so the first call for each always goes through
+static const GLuint unknown_binding = ~0u;
+
+// The buffer targets that are tracked, and how many indexed binding points of each
+// (for the targets that have them)
+enum tracked_buffer_target
+{
+	tracked_array_buffer,
+	tracked_element_array_buffer,
+	tracked_copy_read_buffer,
+	tracked_copy_write_buffer,
+	tracked_draw_indirect_buffer,
+	tracked_dispatch_indirect_buffer,
+	tracked_uniform_buffer,
+	tracked_shader_storage_buffer,
+	tracked_atomic_counter_buffer,
+	tracked_transform_feedback_buffer,
+	num_tracked_buffer_targets,
+	untracked_buffer_target = num_tracked_buffer_targets,
+};
+static const int max_tracked_buffer_indices = 8;
+
+struct indexed_buffer_binding
+{
+	GLuint		buffer;
+	GLintptr	offset;
+	GLsizeiptr	size;		// 0 for the whole buffer, from glBindBufferBase
+};
+
+struct gl_state_shadow
+{
+	GLuint					buffers[num_tracked_buffer_targets];
+	indexed_buffer_binding	indexed_buffers[num_tracked_buffer_targets][max_tracked_buffer_indices];
+	GLuint					vertex_array;
+	GLuint					program;
+	gl_state_stats			stats;
+};
+static gl_state_shadow state = {};
+static bool state_initialized = false;
+
+static tracked_buffer_target find_buffer_target(GLenum target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER:				return tracked_array_buffer;
+	case GL_ELEMENT_ARRAY_BUFFER:		return tracked_element_array_buffer;
+	case GL_COPY_READ_BUFFER:			return tracked_copy_read_buffer;
+	case GL_COPY_WRITE_BUFFER:			return tracked_copy_write_buffer;
+	case GL_DRAW_INDIRECT_BUFFER:		return tracked_draw_indirect_buffer;
+	case GL_DISPATCH_INDIRECT_BUFFER:	return tracked_dispatch_indirect_buffer;
+	case GL_UNIFORM_BUFFER:				return tracked_uniform_buffer;
+	case GL_SHADER_STORAGE_BUFFER:		return tracked_shader_storage_buffer;
+	case GL_ATOMIC_COUNTER_BUFFER:		return tracked_atomic_counter_buffer;
+	case GL_TRANSFORM_FEEDBACK_BUFFER:	return tracked_transform_feedback_buffer;
+	default:							return untracked_buffer_target;
+	}
+}
+
+// Returns true if the call should go through, counting it either way
+static bool changes_state(GLuint* shadow, GLuint value)
+{
+	if (!state_initialized)
+		invalidate_gl_state();
+	if (*shadow == value)
+	{
+		++state.stats.elided;
+		return false;
+	}
+	*shadow = value;
+	++state.stats.issued;
+	return true;
+}
+
+void state_bind_buffer(GLenum target, GLuint buffer)
+{
+	tracked_buffer_target tracked = find_buffer_target(target);
+	if (tracked == untracked_buffer_target)
+	{
+		++state.stats.issued;
+		glBindBuffer(target, buffer);
+		return;
+	}
+	if (changes_state(&state.buffers[tracked], buffer))
+		glBindBuffer(target, buffer);
+}
+
+// Both kinds of indexed bind also replace the target's generic binding
+static bool changes_indexed_binding(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (!state_initialized)
+		invalidate_gl_state();
+	tracked_buffer_target tracked = find_buffer_target(target);
+	if (tracked == untracked_buffer_target || index >= GLuint(max_tracked_buffer_indices))
+	{
+		if (tracked != untracked_buffer_target)
+			state.buffers[tracked] = buffer;
+		++state.stats.issued;
+		return true;
+	}
+
+	indexed_buffer_binding& binding = state.indexed_buffers[tracked][index];
+	if (binding.buffer == buffer && binding.offset == offset && binding.size == size && state.buffers[tracked] == buffer)
+	{
+		++state.stats.elided;
+		return false;
+	}
+	binding = indexed_buffer_binding{ buffer, offset, size };
+	state.buffers[tracked] = buffer;
+	++state.stats.issued;
+	return true;
+}
+
+void state_bind_buffer_base(GLenum target, GLuint index, GLuint buffer)
+{
+	if (changes_indexed_binding(target, index, buffer, 0, 0))
+		glBindBufferBase(target, index, buffer);
+}
+
+void state_bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (changes_indexed_binding(target, index, buffer, offset, size))
+		glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void state_bind_vertex_array(GLuint vertex_array)
+{
+	// The element array buffer binding belongs to the vertex array, and we don't know the new one's
+	if (changes_state(&state.vertex_array, vertex_array))
+	{
+		glBindVertexArray(vertex_array);
+		state.buffers[tracked_element_array_buffer] = unknown_binding;
+	}
+}
+
+void state_use_program(GLuint program)
+{
+	if (changes_state(&state.program, program))
+		glUseProgram(program);
+}
+
+void state_delete_buffers(GLsizei count, const GLuint* buffers)
+{
+	if (!state_initialized)
+		invalidate_gl_state();
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		if (buffers[i] == 0)
+			continue;
+
+		// GL reverts these to 0. The element array binding might be held by some other vertex
+		// array too, which we can't see, so that one's just marked unknown.
+		for (int target = 0; target < num_tracked_buffer_targets; ++target)
+		{
+			if (state.buffers[target] == buffers[i])
+				state.buffers[target] = (target == tracked_element_array_buffer) ? unknown_binding : 0;
+			for (indexed_buffer_binding& binding : state.indexed_buffers[target])
+			{
+				if (binding.buffer == buffers[i])
+					binding = indexed_buffer_binding{ unknown_binding, 0, 0 };
+			}
+		}
+	}
+	glDeleteBuffers(count, buffers);
+}
+
+void invalidate_gl_state()
+{
+	gl_state_stats stats = state.stats;
+	for (GLuint& buffer : state.buffers)
+		buffer = unknown_binding;
+	for (auto& bindings : state.indexed_buffers)
+	{
+		for (indexed_buffer_binding& binding : bindings)
+			binding = indexed_buffer_binding{ unknown_binding, 0, 0 };
+	}
+	state.vertex_array = unknown_binding;
+	state.program = unknown_binding;
+	state.stats = stats;
+	state_initialized = true;
+}
+
+gl_state_stats take_gl_state_stats()
+{
+	gl_state_stats stats = state.stats;
+	state.stats = gl_state_stats{};
+	return stats;
+}
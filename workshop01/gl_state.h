@@ -0,0 +1,30 @@
+// Render state tracker: shadows the GL bindings so calls that wouldn't change anything are skipped
+#pragma once
+
+#include <glad/glad.h>
+
+// How many of the tracked calls went through to GL, and how many were dropped as redundant
+struct gl_state_stats
+{
+	int		issued;
+	int		elided;
+};
+
+// Drop-in replacements for the GL calls of the same names. These skip the call if the binding is
+// already what's asked for, so every bind in the app should go through them, or the shadow copy
+// will go stale. Targets and binding indices that aren't tracked are passed straight through.
+void state_bind_buffer(GLenum target, GLuint buffer);
+void state_bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+void state_bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+void state_bind_vertex_array(GLuint vertex_array);
+void state_use_program(GLuint program);
+
+// Delete buffers and forget any bindings of them, since GL unbinds them and may hand their names
+// out again
+void state_delete_buffers(GLsizei count, const GLuint* buffers);
+
+// Forget everything, for when the GL state has been changed behind the tracker's back
+void invalidate_gl_state();
+
+// Get the counts since the last call, and start counting again. Called once a frame.
+gl_state_stats take_gl_state_stats();
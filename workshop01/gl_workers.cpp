@@ -0,0 +1,154 @@
+// GL workers: threads with hidden windows of their own, whose contexts share objects with the main one, for making GL objects off the render thread
+
+#include "gl_workers.h"
+#include "cpu_profiler.h"
+#include "thread_config.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+
+static std::vector<GLFWwindow*>		worker_windows;
+static std::vector<std::thread>		workers;
+static std::mutex					worker_lock;
+static std::condition_variable		worker_wake;		// there's a task queued, or it's time to quit
+static std::condition_variable		task_submitted;		// a task's submitted flag has been set
+static std::deque<gl_task*>			worker_queue;
+static bool							worker_quitting = false;
+
+static void run_gl_task(gl_task* task)
+{
+	task->function(task->data);
+
+	// Flushing gets the fence to the GPU, so it's sure to signal, and other contexts can wait on it
+	task->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+}
+
+static void gl_worker_main(GLFWwindow* worker_window, int worker_index)
+{
+	char thread_name[32];
+	snprintf(thread_name, sizeof(thread_name), "gl worker %d", worker_index);
+	set_cpu_profiler_thread_name(thread_name);
+	set_thread_role(thread_role_upload, worker_index);
+	glfwMakeContextCurrent(worker_window);
+
+	for (;;)
+	{
+		gl_task* task = nullptr;
+		{
+			std::unique_lock<std::mutex> guard(worker_lock);
+			worker_wake.wait(guard, [] { return worker_quitting || !worker_queue.empty(); });
+			if (worker_queue.empty())
+				break;
+			task = worker_queue.front();
+			worker_queue.pop_front();
+		}
+
+		{
+			CPU_PROFILE_SCOPE("gl task");
+			run_gl_task(task);
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(worker_lock);
+			task->submitted.store(true, std::memory_order_release);
+		}
+		task_submitted.notify_all();
+	}
+
+	glfwMakeContextCurrent(nullptr);
+}
+
+int init_gl_workers(GLFWwindow* main_window, int num_workers)
+{
+	// Each context has to come with a window. The other hints are left as they were for the main
+	// window, so the contexts match it.
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	worker_quitting = false;
+	for (int i = 0; i < num_workers; ++i)
+	{
+		GLFWwindow* worker_window = glfwCreateWindow(1, 1, "GL worker", nullptr, main_window);
+		if (!worker_window)
+			break;
+		worker_windows.push_back(worker_window);
+		workers.emplace_back(&gl_worker_main, worker_window, i);
+	}
+	return int(workers.size());
+}
+
+void shutdown_gl_workers()
+{
+	{
+		std::lock_guard<std::mutex> guard(worker_lock);
+		worker_quitting = true;
+	}
+	worker_wake.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+
+	for (GLFWwindow* worker_window : worker_windows)
+		glfwDestroyWindow(worker_window);
+	worker_windows.clear();
+}
+
+int gl_worker_count()
+{
+	return int(workers.size());
+}
+
+void start_gl_task(gl_task* task, gl_task_function function, void* data)
+{
+	task->function = function;
+	task->data = data;
+	task->fence = nullptr;
+	task->submitted.store(false, std::memory_order_relaxed);
+
+	// Without workers, it's all in the one context, which keeps the commands in order anyway
+	if (workers.empty())
+	{
+		function(data);
+		task->submitted.store(true, std::memory_order_relaxed);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(worker_lock);
+		worker_queue.push_back(task);
+	}
+	worker_wake.notify_one();
+}
+
+bool is_gl_task_complete(gl_task* task)
+{
+	if (!task->submitted.load(std::memory_order_acquire))
+		return false;
+	if (!task->fence)
+		return true;
+
+	GLenum status = glClientWaitSync(task->fence, 0, 0);
+	return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void finish_gl_task(gl_task* task)
+{
+	if (!task->submitted.load(std::memory_order_acquire))
+	{
+		std::unique_lock<std::mutex> guard(worker_lock);
+		task_submitted.wait(guard, [task] { return task->submitted.load(std::memory_order_acquire); });
+	}
+
+	// This only holds up the GPU, and only if it hasn't got there yet; the CPU carries on
+	if (task->fence)
+	{
+		glWaitSync(task->fence, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(task->fence);
+		task->fence = nullptr;
+	}
+}
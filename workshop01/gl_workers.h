@@ -0,0 +1,44 @@
+// GL workers: threads with hidden windows of their own, whose contexts share objects with the main one, for making GL objects off the render thread
+#pragma once
+
+#include <atomic>
+#include <glad/glad.h>
+
+struct GLFWwindow;
+
+// A task runs function(data) on a worker, with its context current, to create or fill some GL
+// objects. The worker fences the commands it issued, and the main context waits on that fence
+// before it touches the objects, so it never sees them half made.
+typedef void (*gl_task_function)(void* data);
+
+struct gl_task
+{
+	gl_task_function	function;
+	void*				data;
+	GLsync				fence;			// after the function's commands, in the worker's context
+	std::atomic<bool>	submitted;		// the function's run, and the fence has been flushed
+};
+
+// Make the workers' windows, which are never shown, and start their threads. Call from the main
+// thread, once the GL functions are loaded. Returns how many started; if none did, tasks run as
+// soon as they're started, in whatever context is current on the thread that starts them.
+int init_gl_workers(GLFWwindow* main_window, int num_workers);
+
+// Run whatever's still queued, then stop the threads and destroy the windows. Call from the main
+// thread, after finishing any tasks whose objects it still wants.
+void shutdown_gl_workers();
+
+int gl_worker_count();
+
+// Queue a task to run on the next free worker. Any thread can start one. Don't move or change the
+// task until it's finished.
+void start_gl_task(gl_task* task, gl_task_function function, void* data);
+
+// Whether the GPU has done the task's commands, so finish_gl_task() would return straight away.
+// Call from the main thread.
+bool is_gl_task_complete(gl_task* task);
+
+// Wait for a worker to have run the task, then make the main context's later commands wait for
+// the GPU to finish its commands, after which its objects are safe to use (once they're bound
+// again, if they were bound before). Call from the main thread.
+void finish_gl_task(gl_task* task);
@@ -0,0 +1,181 @@
+// GPU memory: keeps count of what every buffer and texture takes up, against a budget from the driver or the command line, so the managers can evict to stay within it
+
+#include "gpu_memory.h"
+#include "perf_counters.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+// The extensions' enums, which glad wasn't generated with. Both give sizes in kilobytes.
+static const GLenum gpu_memory_info_total_available_memory_nvx = 0x9048;
+static const GLenum gpu_memory_info_current_available_vidmem_nvx = 0x9049;
+static const GLenum texture_free_memory_ati = 0x87FC;		// four values, the first the pool's total free
+
+// Where the free memory's read from, if anywhere
+enum gpu_memory_source
+{
+	gpu_memory_source_none,
+	gpu_memory_source_nvx,
+	gpu_memory_source_ati,
+};
+
+static std::mutex sizes_lock;
+static std::unordered_map<GLuint, int64_t> object_sizes[num_gpu_memory_kinds];	// by name, with sizes_lock held
+static std::atomic<int64_t> kind_totals[num_gpu_memory_kinds];
+static gpu_memory_source source = gpu_memory_source_none;
+static int64_t budget = 0;
+static int64_t driver_total = 0;		// what the NVX extension says the GPU has
+static int buffer_bytes_counter = -1;
+static int texture_bytes_counter = -1;
+static int budget_counter = -1;
+static int free_counter = -1;			// as the driver tells it
+static int evicted_bytes_counter = -1;
+
+static bool has_gl_extension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, GLuint(i));
+		if (extension && strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+// What the driver says is free right now, or -1 if it doesn't say
+static int64_t get_driver_free_memory()
+{
+	GLint kilobytes[4] = {};
+	if (source == gpu_memory_source_nvx)
+		glGetIntegerv(gpu_memory_info_current_available_vidmem_nvx, kilobytes);
+	else if (source == gpu_memory_source_ati)
+		glGetIntegerv(texture_free_memory_ati, kilobytes);
+	else
+		return -1;
+	return int64_t(kilobytes[0]) * 1024;
+}
+
+void init_gpu_memory(int64_t budget_bytes)
+{
+	buffer_bytes_counter = register_perf_counter("gpu buffer bytes", perf_counter_level);
+	texture_bytes_counter = register_perf_counter("gpu texture bytes", perf_counter_level);
+	budget_counter = register_perf_counter("gpu memory budget", perf_counter_level);
+	free_counter = register_perf_counter("gpu memory free", perf_counter_level);
+	evicted_bytes_counter = register_perf_counter("gpu memory evicted bytes", perf_counter_per_frame);
+
+	// The driver's free memory is read either way, if it says, for the counter
+	if (has_gl_extension("GL_NVX_gpu_memory_info"))
+	{
+		source = gpu_memory_source_nvx;
+		GLint kilobytes = 0;
+		glGetIntegerv(gpu_memory_info_total_available_memory_nvx, &kilobytes);
+		driver_total = int64_t(kilobytes) * 1024;
+		budget = int64_t(double(driver_total) * (1.0 - gpu_memory_headroom));
+	}
+	else if (has_gl_extension("GL_ATI_meminfo"))
+	{
+		// This only says what's free, so what we've made already counts too
+		source = gpu_memory_source_ati;
+		budget = int64_t(double(get_driver_free_memory() + get_gpu_memory_used()) * (1.0 - gpu_memory_headroom));
+	}
+	if (budget_bytes > 0)
+		budget = budget_bytes;
+
+	if (budget > 0)
+		printf("Keeping to %lld MB of GPU memory%s\n", (long long)(budget >> 20), (budget_bytes > 0) ? "" : ", going by what the driver says there is");
+	else
+		printf("The driver doesn't say how much GPU memory there is, so there's no budget for it (set one with --gpu-memory-budget)\n");
+}
+
+void set_gpu_memory(gpu_memory_kind kind, GLuint name, int64_t bytes)
+{
+	if (name == 0)
+		return;
+	std::lock_guard<std::mutex> guard(sizes_lock);
+	int64_t change = bytes;
+	std::unordered_map<GLuint, int64_t>::iterator found = object_sizes[kind].find(name);
+	if (found != object_sizes[kind].end())
+	{
+		change -= found->second;
+		if (bytes > 0)
+			found->second = bytes;
+		else
+			object_sizes[kind].erase(found);
+	}
+	else if (bytes > 0)
+	{
+		object_sizes[kind].emplace(name, bytes);
+	}
+	kind_totals[kind].fetch_add(change, std::memory_order_relaxed);
+}
+
+int gpu_texel_bytes(GLenum internal_format)
+{
+	switch (internal_format)
+	{
+	case GL_R8:			return 1;
+	case GL_R16F:		return 2;
+	case GL_R32F:
+	case GL_R32UI:
+	case GL_RGBA8:		return 4;
+	case GL_RG32F:
+	case GL_RGBA16F:	return 8;
+	case GL_RGBA32F:	return 16;
+	default:			return 4;
+	}
+}
+
+int64_t gpu_texture_bytes(GLenum internal_format, int width, int height, int layers, bool mipmapped)
+{
+	int64_t texels = 0;
+	for (;;)
+	{
+		texels += int64_t(width) * height;
+		if (!mipmapped || (width == 1 && height == 1))
+			break;
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+	return texels * layers * gpu_texel_bytes(internal_format);
+}
+
+int64_t update_gpu_memory()
+{
+	int64_t buffers = kind_totals[gpu_memory_buffer].load(std::memory_order_relaxed);
+	int64_t textures = kind_totals[gpu_memory_texture].load(std::memory_order_relaxed);
+	int64_t used = buffers + textures;
+	int64_t free_bytes = get_driver_free_memory();
+	set_perf_counter(buffer_bytes_counter, buffers);
+	set_perf_counter(texture_bytes_counter, textures);
+	set_perf_counter(budget_counter, budget);
+	set_perf_counter(free_counter, std::max(free_bytes, int64_t(0)));
+
+	int64_t over = (budget > 0) ? std::max(used - budget, int64_t(0)) : 0;
+	if (source == gpu_memory_source_nvx && free_bytes >= 0)
+	{
+		int64_t headroom = int64_t(double(driver_total) * gpu_memory_headroom);
+		over = std::max(over, headroom - free_bytes);
+	}
+	return over;
+}
+
+void add_gpu_memory_evicted(int64_t bytes)
+{
+	add_perf_counter(evicted_bytes_counter, bytes);
+}
+
+int64_t get_gpu_memory_used()
+{
+	return kind_totals[gpu_memory_buffer].load(std::memory_order_relaxed) + kind_totals[gpu_memory_texture].load(std::memory_order_relaxed);
+}
+
+int64_t get_gpu_memory_budget()
+{
+	return budget;
+}
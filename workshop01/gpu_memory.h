@@ -0,0 +1,47 @@
+// GPU memory: keeps count of what every buffer and texture takes up, against a budget from the driver or the command line, so the managers can evict to stay within it
+#pragma once
+
+#include <cstdint>
+
+#include <glad/glad.h>
+
+// Buffers and textures are named separately by GL, so they're counted separately
+enum gpu_memory_kind
+{
+	gpu_memory_buffer,
+	gpu_memory_texture,
+	num_gpu_memory_kinds,
+};
+
+// How much of what the driver says there is to keep for everything else: the window's buffers,
+// the driver itself, and other programs
+static const float gpu_memory_headroom = 0.2f;
+
+// Find the budget: 'budget_bytes', if it's not 0, or else what the driver says there is, less the
+// headroom, through GL_NVX_gpu_memory_info or GL_ATI_meminfo. With neither, there's no budget,
+// and nothing's ever over it. Registers the counters. Call on the GL thread once the GL functions
+// are loaded; what's been set before then is counted already.
+void init_gpu_memory(int64_t budget_bytes);
+
+// Note how many bytes a buffer's or texture's storage takes up now, replacing whatever it took up
+// before, or 0 once it's deleted. Call whenever its storage is (re)specified. From any thread.
+void set_gpu_memory(gpu_memory_kind kind, GLuint name, int64_t bytes);
+
+// The bytes per texel of the uncompressed formats we make textures in
+int gpu_texel_bytes(GLenum internal_format);
+
+// What a width x height texture of the format takes up, with its mipmaps if it has them, and
+// 'layers' of it for an array
+int64_t gpu_texture_bytes(GLenum internal_format, int width, int height, int layers, bool mipmapped);
+
+// Total up what's in use, and work out how much over the budget that is, or 0. With
+// GL_NVX_gpu_memory_info, it's also over by however far the driver's free memory has dropped below
+// the headroom, whatever we think we're using, since something else may have taken it. Call once
+// a frame on the GL thread, which also updates the counters.
+int64_t update_gpu_memory();
+
+// Count bytes that a manager gave back to get under the budget
+void add_gpu_memory_evicted(int64_t bytes);
+
+int64_t get_gpu_memory_used();
+int64_t get_gpu_memory_budget();		// 0 if there isn't one
@@ -0,0 +1,104 @@
+// GPU profiler: times passes on the GPU with timestamp queries, without ever waiting on the results
+
+#include "gpu_profiler.h"
+
+#include <algorithm>
+
+void init_gpu_profiler(gpu_profiler* profiler, int num_timers, const char* const* names)
+{
+	*profiler = gpu_profiler{};
+	profiler->num_timers = std::min(num_timers, max_gpu_timers);
+	for (int timer = 0; timer < profiler->num_timers; ++timer)
+		profiler->names[timer] = names[timer];
+
+	for (int frame = 0; frame < gpu_profiler_frames; ++frame)
+		glGenQueries(profiler->num_timers * 2, &profiler->queries[frame][0][0]);
+}
+
+void free_gpu_profiler(gpu_profiler* profiler)
+{
+	for (int frame = 0; frame < gpu_profiler_frames; ++frame)
+		glDeleteQueries(profiler->num_timers * 2, &profiler->queries[frame][0][0]);
+	*profiler = gpu_profiler{};
+}
+
+static void add_gpu_timer_sample(gpu_profiler* profiler, int timer, float ms)
+{
+	profiler->history[timer][profiler->history_next[timer]] = ms;
+	profiler->history_next[timer] = (profiler->history_next[timer] + 1) % gpu_timer_history;
+	profiler->history_count[timer] = std::min(profiler->history_count[timer] + 1, gpu_timer_history);
+}
+
+void begin_gpu_profiler_frame(gpu_profiler* profiler)
+{
+	// The frame we're about to reuse is the oldest one, so its results should be in by now.
+	// Checking the end query is enough, since the begin one was issued before it.
+	profiler->current_frame = (profiler->current_frame + 1) % gpu_profiler_frames;
+	int frame = profiler->current_frame;
+	for (int timer = 0; timer < profiler->num_timers; ++timer)
+	{
+		profiler->collected[timer] = false;
+
+		// A pass that didn't run (say, the raytrace while rasterizing) starts its stats afresh next time
+		if (!profiler->issued[frame][timer])
+		{
+			profiler->history_count[timer] = 0;
+			continue;
+		}
+		profiler->issued[frame][timer] = false;
+
+		GLuint available = 0;
+		glGetQueryObjectuiv(profiler->queries[frame][timer][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+
+		GLuint64 begin_time = 0, end_time = 0;
+		glGetQueryObjectui64v(profiler->queries[frame][timer][0], GL_QUERY_RESULT, &begin_time);
+		glGetQueryObjectui64v(profiler->queries[frame][timer][1], GL_QUERY_RESULT, &end_time);
+		float ms = float(double(end_time - begin_time) * 1e-6);
+		add_gpu_timer_sample(profiler, timer, ms);
+		profiler->collected_ms[timer] = ms;
+		profiler->collected[timer] = true;
+	}
+}
+
+void begin_gpu_timer(gpu_profiler* profiler, int timer)
+{
+	glQueryCounter(profiler->queries[profiler->current_frame][timer][0], GL_TIMESTAMP);
+}
+
+void end_gpu_timer(gpu_profiler* profiler, int timer)
+{
+	glQueryCounter(profiler->queries[profiler->current_frame][timer][1], GL_TIMESTAMP);
+	profiler->issued[profiler->current_frame][timer] = true;
+}
+
+bool get_collected_gpu_timer_sample(const gpu_profiler& profiler, int timer, float* out_ms)
+{
+	if (!profiler.collected[timer])
+		return false;
+	*out_ms = profiler.collected_ms[timer];
+	return true;
+}
+
+gpu_timer_stats get_gpu_timer_stats(const gpu_profiler& profiler, int timer)
+{
+	gpu_timer_stats stats = {};
+	int count = profiler.history_count[timer];
+	if (count == 0)
+		return stats;
+
+	const float* history = profiler.history[timer];
+	stats.min_ms = history[0];
+	stats.max_ms = history[0];
+	float total = 0.0f;
+	for (int i = 0; i < count; ++i)
+	{
+		stats.min_ms = std::min(stats.min_ms, history[i]);
+		stats.max_ms = std::max(stats.max_ms, history[i]);
+		total += history[i];
+	}
+	stats.avg_ms = total / float(count);
+	stats.num_samples = count;
+	return stats;
+}
@@ -0,0 +1,63 @@
+// GPU profiler: times passes on the GPU with timestamp queries, without ever waiting on the results
+#pragma once
+
+#include <glad/glad.h>
+
+// Each frame's queries are read back this many frames later, by which time the GPU has long
+// finished them. If one still isn't ready, its sample is dropped rather than waited for.
+static const int gpu_profiler_frames = 4;
+static const int max_gpu_timers = 16;
+
+// Stats are over this many of each timer's most recent samples
+static const int gpu_timer_history = 64;
+
+struct gpu_timer_stats
+{
+	float	min_ms;
+	float	avg_ms;
+	float	max_ms;
+	int		num_samples;	// 0 if the timer didn't run in the last frame collected, and the rest are meaningless
+};
+
+struct gpu_profiler
+{
+	int			num_timers;
+	const char*	names[max_gpu_timers];
+
+	// A pair of timestamp queries per timer (begin and end) for each frame in flight, and which
+	// of them were issued in that frame
+	GLuint		queries[gpu_profiler_frames][max_gpu_timers][2];
+	bool		issued[gpu_profiler_frames][max_gpu_timers];
+	int			current_frame;
+
+	// Each timer's recent samples in milliseconds, as a ring
+	float		history[max_gpu_timers][gpu_timer_history];
+	int			history_count[max_gpu_timers];
+	int			history_next[max_gpu_timers];
+
+	// The samples collected by the last begin_gpu_profiler_frame(), if there were any
+	float		collected_ms[max_gpu_timers];
+	bool		collected[max_gpu_timers];
+};
+
+// Set up the profiler to time the given passes, which are then identified by index. Needs a
+// current GL context.
+void init_gpu_profiler(gpu_profiler* profiler, int num_timers, const char* const* names);
+
+// Delete the queries and reset the profiler to empty
+void free_gpu_profiler(gpu_profiler* profiler);
+
+// Start a new frame of queries, first collecting the results of the oldest frame's
+void begin_gpu_profiler_frame(gpu_profiler* profiler);
+
+// Time the GPU work submitted between these two calls. Each timer can run once per frame, but
+// they can overlap and nest, since they're timestamps rather than GL_TIME_ELAPSED queries.
+void begin_gpu_timer(gpu_profiler* profiler, int timer);
+void end_gpu_timer(gpu_profiler* profiler, int timer);
+
+// The sample for the timer that the last begin_gpu_profiler_frame() collected, from a few frames
+// back. Returns false if there wasn't one.
+bool get_collected_gpu_timer_sample(const gpu_profiler& profiler, int timer, float* out_ms);
+
+// Min, average and max over the timer's recent samples
+gpu_timer_stats get_gpu_timer_stats(const gpu_profiler& profiler, int timer);
@@ -0,0 +1,221 @@
+// Small job system: a pool of worker threads, each with its own job deque, that steal from each
+// other when they run out of work
+
+#include "job_system.h"
+#include "cpu_profiler.h"
+#include "thread_config.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Each thread's queue is padded out so that neighbouring queues don't share a cache line,
+// and threads pushing and popping their own queues don't contend with each other.
+struct worker_queue
+{
+	std::mutex			lock;
+	std::deque<job>		jobs;
+	std::atomic<int>	size;		// lets thieves skip empty queues without taking the lock
+	char				padding[64];
+};
+
+static int								thread_count = 1;
+static std::unique_ptr<worker_queue[]>	queues;
+static std::vector<std::thread>			workers;
+static std::atomic<int>					queued_jobs(0);
+static std::atomic<bool>				quitting(false);
+
+// Idle workers sleep here until jobs are submitted
+static std::mutex						sleep_lock;
+static std::condition_variable			wake_workers;
+
+// Which queue belongs to the current thread. The main thread is 0; workers are 1 and up.
+static thread_local int					this_thread_index = 0;
+
+static bool pop_job(int thread_index, job* out_job)
+{
+	// Try our own queue first, taking the newest job, since its data is most likely still in cache
+	{
+		worker_queue& queue = queues[thread_index];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if (!queue.jobs.empty())
+		{
+			*out_job = queue.jobs.back();
+			queue.jobs.pop_back();
+			queue.size.fetch_sub(1, std::memory_order_relaxed);
+			queued_jobs.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// Otherwise, steal the oldest job from someone else's queue
+	for (int i = 1; i < thread_count; ++i)
+	{
+		worker_queue& victim = queues[(thread_index + i) % thread_count];
+		if (victim.size.load(std::memory_order_relaxed) == 0)
+			continue;
+
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.jobs.empty())
+		{
+			*out_job = victim.jobs.front();
+			victim.jobs.pop_front();
+			victim.size.fetch_sub(1, std::memory_order_relaxed);
+			queued_jobs.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void run_job(const job& j)
+{
+	{
+		CPU_PROFILE_SCOPE("job");
+		j.function(j.data, j.begin, j.end);
+	}
+	j.counter->fetch_sub(1, std::memory_order_release);
+}
+
+static void worker_main(int thread_index)
+{
+	this_thread_index = thread_index;
+
+	char thread_name[32];
+	snprintf(thread_name, sizeof(thread_name), "job worker %d", thread_index);
+	set_cpu_profiler_thread_name(thread_name);
+	set_thread_role(thread_role_jobs, thread_index - 1);
+
+	for (;;)
+	{
+		job j;
+		if (pop_job(thread_index, &j))
+		{
+			run_job(j);
+			continue;
+		}
+
+		// Nothing to do; sleep until more jobs are submitted. We only quit once the queues
+		// are drained, so nobody is left waiting on a job that never runs.
+		std::unique_lock<std::mutex> lock(sleep_lock);
+		wake_workers.wait(lock, [] { return queued_jobs.load() > 0 || quitting.load(); });
+		if (quitting.load() && queued_jobs.load() == 0)
+			return;
+	}
+}
+
+void init_job_system(int num_threads)
+{
+	if (num_threads <= 0)
+		num_threads = std::max(1, int(std::thread::hardware_concurrency()));
+
+	thread_count = num_threads;
+	queues.reset(new worker_queue[thread_count]);
+	for (int i = 0; i < thread_count; ++i)
+		queues[i].size.store(0);
+
+	quitting.store(false);
+	for (int i = 1; i < thread_count; ++i)
+		workers.emplace_back(&worker_main, i);
+}
+
+void shutdown_job_system()
+{
+	{
+		std::lock_guard<std::mutex> guard(sleep_lock);
+		quitting.store(true);
+	}
+	wake_workers.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+
+	// The main thread's queue isn't drained by the workers once they've quit
+	job j;
+	while (pop_job(0, &j))
+		run_job(j);
+
+	queues.reset();
+	thread_count = 1;
+}
+
+int job_thread_count()
+{
+	return thread_count;
+}
+
+void submit_jobs(const job* jobs, int num_jobs, std::atomic<int>* counter)
+{
+	counter->fetch_add(num_jobs, std::memory_order_relaxed);
+
+	// Deal the jobs out across all queues, so the workers can start on them without all
+	// having to steal from the same one
+	for (int i = 0; i < num_jobs; ++i)
+	{
+		job j = jobs[i];
+		j.counter = counter;
+
+		worker_queue& queue = queues[(this_thread_index + i) % thread_count];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		queue.jobs.push_back(j);
+		queue.size.fetch_add(1, std::memory_order_relaxed);
+		queued_jobs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Taking the lock here means a worker can't miss the wakeup between checking
+	// queued_jobs and going to sleep
+	{
+		std::lock_guard<std::mutex> guard(sleep_lock);
+	}
+	wake_workers.notify_all();
+}
+
+void wait_for_counter(std::atomic<int>* counter)
+{
+	while (counter->load(std::memory_order_acquire) > 0)
+	{
+		job j;
+		if (pop_job(this_thread_index, &j))
+			run_job(j);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void parallel_for(int count, int alignment, job_function function, void* data)
+{
+	// Below this many items per chunk, the overhead of handing out jobs outweighs the work
+	static const int min_chunk_size = 4096;
+
+	// Aim for a few chunks per thread, so that stealing can even out any imbalance
+	static const int max_jobs = 256;
+	int target_jobs = std::min(max_jobs, thread_count * 4);
+	int chunk_size = std::max(min_chunk_size, (count + target_jobs - 1) / target_jobs);
+	chunk_size = (chunk_size + alignment - 1) / alignment * alignment;
+
+	// Not worth splitting up at all? Just run it here.
+	if (thread_count == 1 || count <= chunk_size)
+	{
+		if (count > 0)
+			function(data, 0, count);
+		return;
+	}
+
+	job jobs[max_jobs];
+	int num_jobs = 0;
+	for (int begin = 0; begin < count; begin += chunk_size)
+	{
+		jobs[num_jobs++] = job{ function, data, begin, std::min(count, begin + chunk_size), nullptr };
+	}
+
+	std::atomic<int> counter(0);
+	submit_jobs(jobs, num_jobs, &counter);
+	wait_for_counter(&counter);
+}
@@ -0,0 +1,41 @@
+// Small job system: a pool of worker threads, each with its own job deque, that steal from each
+// other when they run out of work
+#pragma once
+
+#include <atomic>
+
+// A job runs function(data, begin, end) over some range of items. When it finishes, it decrements
+// the counter it was submitted with, so whoever submitted it can wait for a batch to complete.
+typedef void (*job_function)(void* data, int begin, int end);
+
+struct job
+{
+	job_function		function;
+	void*				data;
+	int					begin;
+	int					end;
+	std::atomic<int>*	counter;
+};
+
+// Start the worker threads. num_threads counts the main thread too, since it helps run jobs while
+// waiting on them; pass 0 to use one thread per hardware thread.
+void init_job_system(int num_threads);
+
+// Stop and join the worker threads. Any jobs still queued are run first.
+void shutdown_job_system();
+
+// Number of threads that run jobs, including the main thread
+int job_thread_count();
+
+// Queue up jobs to run. The counter is incremented by the number of jobs before any of them can
+// start, so it's safe to wait on it as soon as this returns. Any thread can submit and wait on
+// jobs; threads other than the workers share the main thread's queue.
+void submit_jobs(const job* jobs, int num_jobs, std::atomic<int>* counter);
+
+// Block until the counter reaches zero, running queued jobs on this thread in the meantime
+void wait_for_counter(std::atomic<int>* counter);
+
+// Split [0, count) into chunks and run them across all threads, returning when all are done.
+// Chunk boundaries are kept to multiples of 'alignment' items, so that jobs working on
+// structure-of-arrays data don't share cache lines with each other.
+void parallel_for(int count, int alignment, job_function function, void* data);
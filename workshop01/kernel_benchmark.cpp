@@ -0,0 +1,290 @@
+// kernel_benchmark: times the particle spawning and simulation kernels on their own, with no window
+// or GL context, across particle counts, memory layouts, instruction sets and thread counts, and
+// compares their memory traffic with the bandwidth the machine can actually sustain
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "particle_store.h"
+#include "simulate_kernels.h"
+#include "emitters.h"
+#include "job_system.h"
+
+static const float two_pi = 6.283185308f;
+static const float timestep = 1.0f / 120.0f;
+static const float gravity = -9.8f;
+
+// Sweep options; set on the command line
+static const int max_sweep_particles = 1 << 26;
+int min_particles = 1 << 10;
+int max_particles = 1 << 24;
+int max_threads = 0;				// 0 for one per hardware thread
+double min_seconds = 0.25;			// how long to keep repeating each measurement for
+
+// Bytes each kernel moves per particle: what it reads plus what it writes. The SoA simulation
+// reads 6 of the hot arrays and writes back 4; the AoS one has to pull whole particle_data structs
+// through the cache and write them back; spawning writes all 8 arrays.
+static const double simulate_soa_bytes = (6 + 4) * sizeof(float);
+static const double simulate_aos_bytes = 2 * sizeof(particle_data);
+static const double spawn_bytes = 8 * sizeof(float);
+
+// The bandwidth test copies between two buffers this big, far bigger than any cache
+static const size_t bandwidth_floats = size_t(32) << 20;
+
+// The same integration as simulate_particles_scalar(), but over an array of particle_data structs
+// rather than the particle store's separate arrays, to see what the layout buys us
+static void simulate_particles_aos(particle_data* particles, int first, int count, float dt, float g, int num_steps)
+{
+	for (int i = first, end = first + count; i < end; ++i)
+	{
+		particle_data& p = particles[i];
+		for (int step = 0; step < num_steps; ++step)
+		{
+			p.position[0] += dt * p.velocity[0];
+			p.position[1] += dt * p.velocity[1];
+			p.velocity[1] += dt * g;
+			p.angle = fmodf(p.angle + dt * p.spin, two_pi);
+		}
+	}
+}
+
+// What one measurement runs: a kernel over particles [0, count), on however many threads the job
+// system has
+struct kernel_run
+{
+	simulate_kernel				soa_kernel;		// one of these three is set
+	bool						aos;
+	bool						spawn;
+	particle_store*				store;
+	particle_data*				aos_particles;
+	const particle_emitter*		emitter;
+	int							count;
+};
+
+static void kernel_run_job(void* data, int begin, int end)
+{
+	const kernel_run* run = (const kernel_run*)data;
+	if (run->soa_kernel)
+		run->soa_kernel(run->store, begin, end - begin, timestep, gravity, 1);
+	else if (run->aos)
+		simulate_particles_aos(run->aos_particles, begin, end - begin, timestep, gravity, 1);
+	else
+		spawn_particles(run->store, *run->emitter, 1, begin, end - begin, uint32_t(begin), 0.0f);
+}
+
+static void run_kernel(kernel_run* run)
+{
+	// Keep the jobs' chunks to whole cache lines of whichever layout we're going through
+	int alignment = run->aos ? int(particle_array_alignment / sizeof(particle_data)) : int(particle_array_alignment / sizeof(float));
+	parallel_for(run->count, alignment, &kernel_run_job, run);
+}
+
+struct copy_job_data
+{
+	const float*	source;
+	float*			destination;
+};
+
+static void copy_job(void* data, int begin, int end)
+{
+	const copy_job_data* job_data = (const copy_job_data*)data;
+	memcpy(job_data->destination + begin, job_data->source + begin, size_t(end - begin) * sizeof(float));
+}
+
+// Time how long a call to 'function' takes, repeating it for at least min_seconds (and at least
+// three times) after a first run to warm the caches, and averaging
+template <typename function_type>
+static double time_per_call(function_type function)
+{
+	function();
+
+	typedef std::chrono::steady_clock clock;
+	clock::time_point start = clock::now();
+	double elapsed = 0.0;
+	int calls = 0;
+	do
+	{
+		function();
+		++calls;
+		elapsed = std::chrono::duration<double>(clock::now() - start).count();
+	} while (elapsed < min_seconds || calls < 3);
+	return elapsed / calls;
+}
+
+// The memory bandwidth we can get with this many threads, in GB/s, from a plain copy between two
+// big buffers. This is the roofline the kernels are compared against: once a kernel is moving
+// this many bytes a second, it's as fast as memory lets it go.
+static double measure_bandwidth(float* source, float* destination)
+{
+	copy_job_data job_data = { source, destination };
+	double seconds = time_per_call([&] { parallel_for(int(bandwidth_floats), 16, &copy_job, &job_data); });
+	return 2.0 * double(bandwidth_floats * sizeof(float)) / seconds * 1e-9;
+}
+
+static void print_result(const char* kernel, const char* layout, const char* isa, int threads, int count, double seconds, double bytes_per_particle, double roofline)
+{
+	double particles_per_second = double(count) / seconds;
+	double gb_per_second = particles_per_second * bytes_per_particle * 1e-9;
+	printf("%-9s %-6s %-7s %7d %10d %12.1f %9.2f %9.0f%%\n", kernel, layout, isa, threads, count, particles_per_second * 1e-6, gb_per_second, 100.0 * gb_per_second / roofline);
+}
+
+static bool parse_command_line(int argc, const char** argv)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* option = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		char* value_end = nullptr;
+
+		if ((strcmp(option, "--min-particles") == 0 || strcmp(option, "--max-particles") == 0) && value)
+		{
+			long count = strtol(value, &value_end, 10);
+			if (*value_end != '\0' || count < 1 || count > max_sweep_particles)
+			{
+				printf("Error: %s must be between 1 and %d :(\n", option, max_sweep_particles);
+				return false;
+			}
+			if (strcmp(option, "--min-particles") == 0)
+				min_particles = int(count);
+			else
+				max_particles = int(count);
+			++i;
+		}
+		else if (strcmp(option, "--max-threads") == 0 && value)
+		{
+			long threads = strtol(value, &value_end, 10);
+			if (*value_end != '\0' || threads < 1)
+			{
+				printf("Error: --max-threads must be at least 1 :(\n");
+				return false;
+			}
+			max_threads = int(threads);
+			++i;
+		}
+		else if (strcmp(option, "--seconds") == 0 && value)
+		{
+			double seconds = strtod(value, &value_end);
+			if (*value_end != '\0' || !(seconds > 0.0))
+			{
+				printf("Error: --seconds must be a positive number :(\n");
+				return false;
+			}
+			min_seconds = seconds;
+			++i;
+		}
+		else
+		{
+			printf("Error: unrecognized option %s :(\n", option);
+			printf("Usage: kernel_benchmark [--min-particles <n>] [--max-particles <n>] [--max-threads <n>] [--seconds <per measurement>]\n");
+			return false;
+		}
+	}
+	if (min_particles > max_particles)
+	{
+		printf("Error: --min-particles can't be more than --max-particles :(\n");
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, const char** argv)
+{
+	if (!parse_command_line(argc, argv))
+		return -1;
+
+	// The SoA kernels we can run on this CPU
+	struct isa_kernel
+	{
+		const char*		name;
+		simulate_kernel	kernel;
+	};
+	std::vector<isa_kernel> kernels;
+	const cpu_features& features = get_cpu_features();
+	(void)features;
+	kernels.push_back(isa_kernel{ "scalar", &simulate_particles_scalar });
+#if WORKSHOP_X86
+	if (features.sse2)
+		kernels.push_back(isa_kernel{ "sse2", &simulate_particles_sse2 });
+	if (features.avx2)
+		kernels.push_back(isa_kernel{ "avx2", &simulate_particles_avx2 });
+#endif
+#if WORKSHOP_NEON
+	if (features.neon)
+		kernels.push_back(isa_kernel{ "neon", &simulate_particles_neon });
+#endif
+
+	// Thread counts double, up to the maximum, which is always included too
+	if (max_threads == 0)
+		max_threads = std::max(1, int(std::thread::hardware_concurrency()));
+	std::vector<int> thread_counts;
+	for (int threads = 1; threads < max_threads; threads *= 2)
+		thread_counts.push_back(threads);
+	thread_counts.push_back(max_threads);
+
+	// Particle counts go up by 4x, up to the maximum, which is always included too
+	std::vector<int> particle_counts;
+	for (int count = min_particles; count < max_particles; count *= 4)
+		particle_counts.push_back(count);
+	particle_counts.push_back(max_particles);
+
+	// Everything's allocated once at the biggest size, and the sweep works over the front of it
+	particle_store store = {};
+	std::vector<particle_data> aos_particles;
+	std::vector<float> bandwidth_source, bandwidth_destination;
+	emitter_set emitters = {};
+	if (!init_particle_store(&store, max_particles) || !init_emitter_set(&emitters, 1))
+	{
+		printf("Error: couldn't allocate %d particles :(\n", max_particles);
+		return -1;
+	}
+	aos_particles.resize(size_t(max_particles));
+	bandwidth_source.resize(bandwidth_floats, 1.0f);
+	bandwidth_destination.resize(bandwidth_floats, 0.0f);
+	make_fountain_emitters(&emitters, -20.0f, 20.0f, 1.0f);
+
+	// Start from a real fountain's worth of particles, in both layouts
+	spawn_particles(&store, emitters.emitters[0], 1, 0, max_particles, 0, 0.0f);
+	pack_particle_instances(store, 0, max_particles, aos_particles.data());
+
+	printf("%-9s %-6s %-7s %7s %10s %12s %9s %10s\n", "kernel", "layout", "isa", "threads", "particles", "Mparticles/s", "GB/s", "roofline");
+	for (int threads : thread_counts)
+	{
+		init_job_system(threads);
+		double roofline = measure_bandwidth(bandwidth_source.data(), bandwidth_destination.data());
+		printf("# %d thread%s: copy bandwidth %.2f GB/s\n", threads, (threads == 1) ? "" : "s", roofline);
+
+		for (int count : particle_counts)
+		{
+			kernel_run run = {};
+			run.store = &store;
+			run.aos_particles = aos_particles.data();
+			run.emitter = &emitters.emitters[0];
+			run.count = count;
+
+			run.spawn = true;
+			print_result("spawn", "soa", "auto", threads, count, time_per_call([&] { run_kernel(&run); }), spawn_bytes, roofline);
+			run.spawn = false;
+
+			for (const isa_kernel& kernel : kernels)
+			{
+				run.soa_kernel = kernel.kernel;
+				print_result("simulate", "soa", kernel.name, threads, count, time_per_call([&] { run_kernel(&run); }), simulate_soa_bytes, roofline);
+			}
+			run.soa_kernel = nullptr;
+
+			run.aos = true;
+			print_result("simulate", "aos", "scalar", threads, count, time_per_call([&] { run_kernel(&run); }), simulate_aos_bytes, roofline);
+		}
+		shutdown_job_system();
+	}
+
+	free_emitter_set(&emitters);
+	free_particle_store(&store);
+	return 0;
+}
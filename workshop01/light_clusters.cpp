@@ -0,0 +1,92 @@
+// Clustered point lights: lights binned into a grid over the view, so shading only loops over the few near each pixel
+
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+int gather_particle_lights(light_clusters* clusters, const particle_store& store, int spacing, int max_lights, float radius_scale, const float color[3])
+{
+	clusters->lights.clear();
+	particle_range ranges[2];
+	int num_ranges = get_live_particle_ranges(store, ranges);
+	spacing = std::max(spacing, 1);
+	for (int r = 0; r < num_ranges; ++r)
+	{
+		// Slots rather than live particles, so each light stays with its particle for its whole life
+		int first = (ranges[r].first + spacing - 1) / spacing * spacing;
+		for (int i = first; i < ranges[r].first + ranges[r].count && int(clusters->lights.size()) < max_lights; i += spacing)
+		{
+			float size = store.size[i];
+			if (size == 0.0f)
+				continue;
+
+			// Just in front of the particle, towards the camera, so it lights the particle's face as
+			// well as its neighbours'
+			point_light light = { { store.position_x[i], store.position_y[i], size }, size * radius_scale, { color[0], color[1], color[2] }, 0.0f };
+			clusters->lights.push_back(light);
+		}
+	}
+	return int(clusters->lights.size());
+}
+
+// The cells a light reaches, as a range along each axis; empty if it's off the grid
+static void get_light_cells(const light_clusters& clusters, const point_light& light, int o_min[2], int o_max[2])
+{
+	int size[2] = { clusters.width, clusters.height };
+	for (int axis = 0; axis < 2; ++axis)
+	{
+		float low = (light.position[axis] - light.radius - clusters.origin[axis]) / clusters.cell_size;
+		float high = (light.position[axis] + light.radius - clusters.origin[axis]) / clusters.cell_size;
+		o_min[axis] = int(std::max(floorf(low), 0.0f));
+		o_max[axis] = int(std::min(floorf(high), float(size[axis] - 1)));
+	}
+}
+
+void build_light_clusters(light_clusters* clusters, const float min[2], const float max[2], float cell_size)
+{
+	clusters->origin[0] = min[0];
+	clusters->origin[1] = min[1];
+	clusters->cell_size = cell_size;
+	clusters->width = std::max(int(ceilf((max[0] - min[0]) / cell_size)), 1);
+	clusters->height = std::max(int(ceilf((max[1] - min[1]) / cell_size)), 1);
+	int num_cells = clusters->width * clusters->height;
+
+	// Count how many lights reach each cell, then turn the counts into where each cell's list
+	// starts, and go round again filling them in. The counts double as how far each list's got.
+	clusters->cells.assign(size_t(num_cells) * 2, 0);
+	uint32_t* cells = clusters->cells.data();
+	for (const point_light& light : clusters->lights)
+	{
+		int cell_min[2], cell_max[2];
+		get_light_cells(*clusters, light, cell_min, cell_max);
+		for (int y = cell_min[1]; y <= cell_max[1]; ++y)
+		{
+			for (int x = cell_min[0]; x <= cell_max[0]; ++x)
+				++cells[2 * (y * clusters->width + x) + 1];
+		}
+	}
+
+	uint32_t total = 0;
+	for (int cell = 0; cell < num_cells; ++cell)
+	{
+		cells[2 * cell] = total;
+		total += cells[2 * cell + 1];
+		cells[2 * cell + 1] = 0;
+	}
+
+	clusters->indices.resize(total);
+	for (size_t light = 0; light < clusters->lights.size(); ++light)
+	{
+		int cell_min[2], cell_max[2];
+		get_light_cells(*clusters, clusters->lights[light], cell_min, cell_max);
+		for (int y = cell_min[1]; y <= cell_max[1]; ++y)
+		{
+			for (int x = cell_min[0]; x <= cell_max[0]; ++x)
+			{
+				uint32_t* cell = cells + 2 * (y * clusters->width + x);
+				clusters->indices[cell[0] + cell[1]++] = uint32_t(light);
+			}
+		}
+	}
+}
@@ -0,0 +1,42 @@
+// Clustered point lights: lights binned into a grid over the view, so shading only loops over the few near each pixel
+#pragma once
+
+#include "particle_store.h"
+
+#include <cstdint>
+#include <vector>
+
+// A point light, laid out as two RGBA32F texels, which is how point_lights.glsl reads it. Its light
+// falls off smoothly to nothing at 'radius', so it only reaches the grid cells that overlap that.
+struct point_light
+{
+	float	position[3];
+	float	radius;
+	float	color[3];		// linear, and how bright it is at its center
+	float	unused;
+};
+
+// The lights, and which of them reach each cell of a grid over the part of the z = 0 plane in view.
+// The camera looks straight down on that plane, so the cells are tiles of the screen for the
+// rasterized particles, and nearly so for the raytracer, whose hits are all close to it. Each cell
+// is two uints, where its list starts in 'indices' and how long it is, and each list holds indices
+// into 'lights'.
+struct light_clusters
+{
+	std::vector<point_light>	lights;
+	std::vector<uint32_t>		cells;			// width * height of them, a row at a time from the bottom
+	std::vector<uint32_t>		indices;
+	float						origin[2];		// the bottom left corner of the grid, in world space
+	float						cell_size;		// world units across a cell
+	int							width;
+	int							height;
+};
+
+// Make a light at every 'spacing'th particle slot in the ring that has a live particle in it, up
+// to 'max_lights', like sparks that light what's around them. They're as big as the particle times
+// 'radius_scale', and all 'color'. Returns how many there are.
+int gather_particle_lights(light_clusters* clusters, const particle_store& store, int spacing, int max_lights, float radius_scale, const float color[3]);
+
+// Bin the lights into a grid of cells 'cell_size' across, covering the box from 'min' to 'max'.
+// Lights that reach none of the cells are left out of every list.
+void build_light_clusters(light_clusters* clusters, const float min[2], const float max[2], float cell_size);
@@ -0,0 +1,90 @@
+// Mip generator: makes RGBA8 mip chains on the CPU, averaging colors in linear light, so textures don't need glGenerateMipmap
+
+#include "mip_generator.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Converting each way is a table lookup. Going back, the linear value's quantized to 12 bits, which
+// is finer than 8-bit sRGB's smallest step everywhere.
+static const int linear_steps = 4095;
+
+struct srgb_tables
+{
+	float			to_linear[256];				// scaled to [0, 1]
+	unsigned char	to_srgb[linear_steps + 1];
+
+	srgb_tables()
+	{
+		for (int i = 0; i < 256; ++i)
+		{
+			float srgb = float(i) / 255.0f;
+			to_linear[i] = (srgb <= 0.04045f) ? srgb / 12.92f : powf((srgb + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i <= linear_steps; ++i)
+		{
+			float linear = float(i) / float(linear_steps);
+			float srgb = (linear <= 0.0031308f) ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+			to_srgb[i] = (unsigned char)std::min(std::max(int(srgb * 255.0f + 0.5f), 0), 255);
+		}
+	}
+};
+
+// Made the first time they're needed, which is safe from any thread
+static const srgb_tables& get_srgb_tables()
+{
+	static const srgb_tables tables;
+	return tables;
+}
+
+int get_mip_chain_layout(int width, int height, texture_level o_levels[max_texture_levels], size_t* o_size)
+{
+	int num_levels = 0;
+	size_t size = 0;
+	for (;;)
+	{
+		texture_level& level = o_levels[num_levels++];
+		level.width = width;
+		level.height = height;
+		level.offset = size;
+		level.size = size_t(width) * height * 4;
+		size += level.size;
+		if ((width == 1 && height == 1) || num_levels == max_texture_levels)
+			break;
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+	*o_size = size;
+	return num_levels;
+}
+
+void downsample_rows(const unsigned char* source, int source_width, int source_height, unsigned char* destination, int first_row, int end_row)
+{
+	const srgb_tables& tables = get_srgb_tables();
+	int width = std::max(source_width / 2, 1);
+	for (int y = first_row; y < end_row; ++y)
+	{
+		const unsigned char* row0 = source + size_t(std::min(y * 2, source_height - 1)) * source_width * 4;
+		const unsigned char* row1 = source + size_t(std::min(y * 2 + 1, source_height - 1)) * source_width * 4;
+		unsigned char* out = destination + size_t(y) * width * 4;
+		for (int x = 0; x < width; ++x, out += 4)
+		{
+			int x0 = std::min(x * 2, source_width - 1) * 4, x1 = std::min(x * 2 + 1, source_width - 1) * 4;
+			for (int c = 0; c < 3; ++c)
+			{
+				float sum = tables.to_linear[row0[x0 + c]] + tables.to_linear[row0[x1 + c]] + tables.to_linear[row1[x0 + c]] + tables.to_linear[row1[x1 + c]];
+				out[c] = tables.to_srgb[int(sum * (0.25f * float(linear_steps)) + 0.5f)];
+			}
+			out[3] = (unsigned char)((row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] + 2) / 4);
+		}
+	}
+}
+
+void generate_mip_chain(unsigned char* pixels, const texture_level* levels, int num_levels)
+{
+	for (int level = 1; level < num_levels; ++level)
+	{
+		const texture_level& above = levels[level - 1];
+		downsample_rows(pixels + above.offset, above.width, above.height, pixels + levels[level].offset, 0, levels[level].height);
+	}
+}
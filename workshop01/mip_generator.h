@@ -0,0 +1,21 @@
+// Mip generator: makes RGBA8 mip chains on the CPU, averaging colors in linear light, so textures don't need glGenerateMipmap
+#pragma once
+
+#include <cstddef>
+
+#include "texture_compression.h"
+
+// Lay out an RGBA8 texture's whole mip chain, down to 1x1, in one buffer: the top level at the
+// start, and each smaller one straight after the last. Returns how many levels there are, and sets
+// the buffer's size. Textures too big for max_texture_levels to reach 1x1 stop short.
+int get_mip_chain_layout(int width, int height, texture_level o_levels[max_texture_levels], size_t* o_size);
+
+// Make rows [first_row, end_row) of a level from the one above it, each texel the average of a
+// 2x2 box; at an odd edge, the last row or column is used twice. Colors are taken as sRGB, which
+// images almost always are, so they're averaged as linear and converted back, rather than coming
+// out darker than they should; alpha's averaged as it is. Rows can be made in bands on different
+// threads.
+void downsample_rows(const unsigned char* source, int source_width, int source_height, unsigned char* destination, int first_row, int end_row);
+
+// Make every level of a chain laid out by get_mip_chain_layout(), from the top one, on this thread
+void generate_mip_chain(unsigned char* pixels, const texture_level* levels, int num_levels);
@@ -0,0 +1,292 @@
+// Output windows: a fullscreen window on each of the other monitors, sharing objects with the main context, each with a thread of its own that shows the main window's frame and swaps, so one display's vsync never holds up another's
+
+#include "output_windows.h"
+#include "cpu_profiler.h"
+#include "gpu_memory.h"
+#include "thread_config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+// Where an output window's frame is up to. The main thread only touches the texture while it's
+// idle, and the window's thread only while it's ready or presenting.
+enum output_state
+{
+	output_idle,
+	output_ready,		// a frame's been copied, and the copy's fenced
+	output_presenting,
+};
+
+struct output_window
+{
+	GLFWwindow*			window;
+	std::thread			thread;
+	GLuint				texture;			// shared, holding the frame to show
+	GLuint				framebuffer;		// in the main context, for copying into the texture
+	int					texture_width;
+	int					texture_height;
+	GLsync				copied;				// after the copy, in the main context
+	GLsync				shown;				// after the window's thread has read the texture, in its context
+	output_state		state;				// with output_lock held
+	std::atomic<int>	framebuffer_width;
+	std::atomic<int>	framebuffer_height;
+};
+
+static GLFWwindow*									main_window = nullptr;
+static GLFWkeyfun									main_key_callback = nullptr;
+static std::vector<std::unique_ptr<output_window>>	outputs;
+static std::mutex									output_lock;
+static std::condition_variable						output_wake;		// a frame's ready, or it's time to quit
+static bool											output_quitting = false;
+
+static void output_window_main(output_window* output, int index)
+{
+	char thread_name[32];
+	snprintf(thread_name, sizeof(thread_name), "output window %d", index);
+	set_cpu_profiler_thread_name(thread_name);
+	set_thread_role(thread_role_present, index);
+	glfwMakeContextCurrent(output->window);
+	glfwSwapInterval(1);
+
+	// Framebuffers are the one thing contexts don't share, so reading the texture needs one here
+	GLuint read_framebuffer = 0;
+	glGenFramebuffers(1, &read_framebuffer);
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard(output_lock);
+			output_wake.wait(guard, [output] { return output_quitting || output->state == output_ready; });
+			if (output->state != output_ready)
+				break;
+			output->state = output_presenting;
+		}
+
+		{
+			CPU_PROFILE_SCOPE("present output");
+
+			// Have the GPU wait for the copy, rather than us
+			glWaitSync(output->copied, 0, GL_TIMEOUT_IGNORED);
+			glDeleteSync(output->copied);
+			output->copied = nullptr;
+
+			// Scale it to fit, keeping its shape, with black bars at the sides or top and bottom
+			int width = output->framebuffer_width.load(std::memory_order_relaxed);
+			int height = output->framebuffer_height.load(std::memory_order_relaxed);
+			float scale = std::min(float(width) / float(output->texture_width), float(height) / float(output->texture_height));
+			int shown_width = int(float(output->texture_width) * scale);
+			int shown_height = int(float(output->texture_height) * scale);
+			int x = (width - shown_width) / 2;
+			int y = (height - shown_height) / 2;
+
+			// Attaching the texture again picks up any change the main context's made to its storage
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
+			glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, output->texture, 0);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			glViewport(0, 0, width, height);
+			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+			glBlitFramebuffer(0, 0, output->texture_width, output->texture_height, x, y, x + shown_width, y + shown_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+			// The main context waits on this before copying the next frame over the texture
+			output->shown = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+
+			CPU_PROFILE_SCOPE("glfwSwapBuffers");
+			glfwSwapBuffers(output->window);
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(output_lock);
+			output->state = output_idle;
+		}
+	}
+
+	glDeleteFramebuffers(1, &read_framebuffer);
+	glfwMakeContextCurrent(nullptr);
+}
+
+static output_window* find_output_window(GLFWwindow* window)
+{
+	for (std::unique_ptr<output_window>& output : outputs)
+	{
+		if (output->window == window)
+			return output.get();
+	}
+	return nullptr;
+}
+
+static void output_framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+	output_window* output = find_output_window(window);
+	output->framebuffer_width.store(width, std::memory_order_relaxed);
+	output->framebuffer_height.store(height, std::memory_order_relaxed);
+}
+
+static void output_key_callback(GLFWwindow*, int key, int scancode, int action, int mods)
+{
+	// Whatever the main window does with keys, so they work whichever window has the focus
+	if (main_key_callback)
+		main_key_callback(main_window, key, scancode, action, mods);
+}
+
+static void output_close_callback(GLFWwindow*)
+{
+	glfwSetWindowShouldClose(main_window, true);
+}
+
+int init_output_windows(GLFWwindow* window)
+{
+	main_window = window;
+	output_quitting = false;
+
+	// GLFW only says what a window's key callback was by setting another
+	main_key_callback = glfwSetKeyCallback(main_window, nullptr);
+	glfwSetKeyCallback(main_window, main_key_callback);
+
+	// Fullscreen windows minimize themselves when they lose the focus, which they would, to each other.
+	// The other hints are left as they were for the main window, so the contexts match it.
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	glfwWindowHint(GLFW_FOCUSED, GLFW_FALSE);
+	glfwWindowHint(GLFW_AUTO_ICONIFY, GLFW_FALSE);
+
+	int num_monitors = 0;
+	GLFWmonitor** monitors = glfwGetMonitors(&num_monitors);
+	GLFWmonitor* primary = glfwGetPrimaryMonitor();
+	for (int i = 0; i < num_monitors; ++i)
+	{
+		if (monitors[i] == primary)
+			continue;
+		const GLFWvidmode* mode = glfwGetVideoMode(monitors[i]);
+		glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate);
+		GLFWwindow* output_window_handle = glfwCreateWindow(mode->width, mode->height, glfwGetMonitorName(monitors[i]), monitors[i], main_window);
+		if (!output_window_handle)
+		{
+			printf("Warning: couldn't open a window on monitor %s!\n", glfwGetMonitorName(monitors[i]));
+			continue;
+		}
+
+		std::unique_ptr<output_window> output(new output_window());
+		output->window = output_window_handle;
+		output->state = output_idle;
+		int width = 0, height = 0;
+		glfwGetFramebufferSize(output_window_handle, &width, &height);
+		output->framebuffer_width.store(width, std::memory_order_relaxed);
+		output->framebuffer_height.store(height, std::memory_order_relaxed);
+		glGenTextures(1, &output->texture);
+		glGenFramebuffers(1, &output->framebuffer);
+		glfwSetFramebufferSizeCallback(output_window_handle, &output_framebuffer_size_callback);
+		glfwSetKeyCallback(output_window_handle, &output_key_callback);
+		glfwSetWindowCloseCallback(output_window_handle, &output_close_callback);
+		outputs.push_back(std::move(output));
+	}
+
+	// Only once they're all in the list, which the callbacks look through
+	for (size_t i = 0; i < outputs.size(); ++i)
+		outputs[i]->thread = std::thread(&output_window_main, outputs[i].get(), int(i));
+	return int(outputs.size());
+}
+
+void shutdown_output_windows()
+{
+	{
+		std::lock_guard<std::mutex> guard(output_lock);
+		output_quitting = true;
+	}
+	output_wake.notify_all();
+	for (std::unique_ptr<output_window>& output : outputs)
+	{
+		output->thread.join();
+		if (output->copied)
+			glDeleteSync(output->copied);
+		if (output->shown)
+			glDeleteSync(output->shown);
+		set_gpu_memory(gpu_memory_texture, output->texture, 0);
+		glDeleteTextures(1, &output->texture);
+		glDeleteFramebuffers(1, &output->framebuffer);
+		glfwDestroyWindow(output->window);
+	}
+	outputs.clear();
+}
+
+int output_window_count()
+{
+	return int(outputs.size());
+}
+
+void present_output_windows(const output_region* regions, int num_regions)
+{
+	if (outputs.empty())
+		return;
+	CPU_PROFILE_SCOPE("present_output_windows");
+
+	std::vector<bool> copied(outputs.size(), false);
+	bool any_copied = false;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	for (size_t i = 0; i < outputs.size(); ++i)
+	{
+		output_window* output = outputs[i].get();
+		{
+			std::lock_guard<std::mutex> guard(output_lock);
+			if (output->state != output_idle)
+				continue;
+		}
+
+		// The window's thread may not have read the last frame yet, as far as the GPU's concerned
+		if (output->shown)
+		{
+			glWaitSync(output->shown, 0, GL_TIMEOUT_IGNORED);
+			glDeleteSync(output->shown);
+			output->shown = nullptr;
+		}
+
+		const output_region& region = regions[i % size_t(num_regions)];
+		if (region.width <= 0 || region.height <= 0)
+			continue;
+		if (region.width != output->texture_width || region.height != output->texture_height)
+		{
+			glBindTexture(GL_TEXTURE_2D, output->texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, region.width, region.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output->framebuffer);
+			glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, output->texture, 0);
+			output->texture_width = region.width;
+			output->texture_height = region.height;
+			set_gpu_memory(gpu_memory_texture, output->texture, gpu_texture_bytes(GL_RGBA8, region.width, region.height, 1, false));
+		}
+
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output->framebuffer);
+		glBlitFramebuffer(region.x, region.y, region.x + region.width, region.y + region.height, 0, 0, region.width, region.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		output->copied = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		copied[i] = true;
+		any_copied = true;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!any_copied)
+		return;
+
+	// Flushing gets the fences to the GPU, so they're sure to signal, before the other contexts
+	// can wait on them
+	glFlush();
+	{
+		std::lock_guard<std::mutex> guard(output_lock);
+		for (size_t i = 0; i < outputs.size(); ++i)
+		{
+			if (copied[i])
+				outputs[i]->state = output_ready;
+		}
+	}
+	output_wake.notify_all();
+}
@@ -0,0 +1,32 @@
+// Output windows: a fullscreen window on each of the other monitors, sharing objects with the main context, each with a thread of its own that shows the main window's frame and swaps, so one display's vsync never holds up another's
+#pragma once
+
+struct GLFWwindow;
+
+// A part of the main window's frame, in pixels from its bottom left
+struct output_region
+{
+	int		x;
+	int		y;
+	int		width;
+	int		height;
+};
+
+// Open a fullscreen window, at its current video mode, on every monitor but the primary one, which
+// the main window's on, with a context sharing objects with the main window's, and start each
+// one's thread. Keys and closing in them go to the main window. Call from the main thread, once
+// the GL functions are loaded. Returns how many opened.
+int init_output_windows(GLFWwindow* main_window);
+
+// Stop the threads and destroy the windows. Call from the main thread, with the main context
+// current.
+void shutdown_output_windows();
+
+int output_window_count();
+
+// Hand this frame, in the main window's back buffer, to the output windows: the i-th shows
+// regions[i % num_regions], scaled to fit. Each one that's done showing the last gets a copy in a
+// texture of its own, made on the main context, so it's in order with the frame's commands; its
+// thread waits for the GPU to finish that, then draws it and swaps. One that's still busy skips
+// the frame. Call from the main thread, after rendering and before swapping.
+void present_output_windows(const output_region* regions, int num_regions);
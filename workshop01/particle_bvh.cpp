@@ -0,0 +1,286 @@
+// Bounding volume hierarchy over the particles, built on the CPU every frame, for raytracing them as spheres
+
+#include "particle_bvh.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef _MSC_VER
+#	include <intrin.h>
+#endif
+
+// Jobs below this many items aren't worth handing to another thread
+static const int bvh_job_alignment = 1024;
+
+static bool resize_particle_bvh(particle_bvh* bvh, int capacity)
+{
+	free_particle_bvh(bvh);
+	bvh->nodes = (particle_bvh_node*)malloc(size_t(capacity) * sizeof(particle_bvh_node));
+	bvh->spheres = (particle_bvh_sphere*)malloc(size_t(capacity) * sizeof(particle_bvh_sphere));
+	bvh->gathered = (particle_bvh_sphere*)malloc(size_t(capacity) * sizeof(particle_bvh_sphere));
+	bvh->codes = (uint32_t*)malloc(size_t(capacity) * sizeof(uint32_t));
+	bvh->node_parents = (int32_t*)malloc(size_t(capacity) * sizeof(int32_t));
+	bvh->leaf_parents = (int32_t*)malloc(size_t(capacity) * sizeof(int32_t));
+	bvh->node_visits = new std::atomic<int>[size_t(capacity)];
+	if (!bvh->nodes || !bvh->spheres || !bvh->gathered || !bvh->codes || !bvh->node_parents || !bvh->leaf_parents ||
+		!resize_particle_sort_buffers(&bvh->sort_buffers, capacity))
+	{
+		free_particle_bvh(bvh);
+		return false;
+	}
+	bvh->capacity = capacity;
+	return true;
+}
+
+void free_particle_bvh(particle_bvh* bvh)
+{
+	free(bvh->nodes);
+	free(bvh->spheres);
+	free(bvh->gathered);
+	free(bvh->codes);
+	free(bvh->node_parents);
+	free(bvh->leaf_parents);
+	delete[] bvh->node_visits;
+	free_particle_sort_buffers(&bvh->sort_buffers);
+	*bvh = particle_bvh{};
+}
+
+// Number of leading zero bits; x can't be 0
+static inline int count_leading_zeros(uint32_t x)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, x);
+	return 31 - int(index);
+#else
+	return __builtin_clz(x);
+#endif
+}
+
+// Spread the low 16 bits of x out into the even bits
+static inline uint32_t spread_bits(uint32_t x)
+{
+	x &= 0xffff;
+	x = (x | (x << 8)) & 0x00ff00ff;
+	x = (x | (x << 4)) & 0x0f0f0f0f;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+	return x;
+}
+
+// What the build's jobs share
+struct bvh_build
+{
+	particle_bvh*	bvh;
+	float			origin[2];		// the corner of the box around the spheres' centers
+	float			scale[2];		// from there to Morton code coordinates, which go up to 65535
+};
+
+// Morton code each gathered sphere: its center's coordinates in the box, with their bits interleaved
+static void morton_code_job(void* data, int begin, int end)
+{
+	const bvh_build* build = (const bvh_build*)data;
+	const particle_bvh_sphere* gathered = build->bvh->gathered;
+	particle_sort_item* items = build->bvh->sort_buffers.items;
+	for (int i = begin; i < end; ++i)
+	{
+		uint32_t x = uint32_t((gathered[i].center[0] - build->origin[0]) * build->scale[0]);
+		uint32_t y = uint32_t((gathered[i].center[1] - build->origin[1]) * build->scale[1]);
+		uint32_t code = spread_bits(x) | (spread_bits(y) << 1);
+		items[i] = (particle_sort_item(code) << 32) | uint32_t(i);
+	}
+}
+
+// Put the spheres, and their codes, into sorted order
+static void sort_spheres_job(void* data, int begin, int end)
+{
+	const bvh_build* build = (const bvh_build*)data;
+	particle_bvh* bvh = build->bvh;
+	for (int i = begin; i < end; ++i)
+	{
+		const particle_bvh_sphere& sphere = bvh->gathered[bvh->sort_buffers.indices[i]];
+		bvh->spheres[i] = sphere;
+		uint32_t x = uint32_t((sphere.center[0] - build->origin[0]) * build->scale[0]);
+		uint32_t y = uint32_t((sphere.center[1] - build->origin[1]) * build->scale[1]);
+		bvh->codes[i] = spread_bits(x) | (spread_bits(y) << 1);
+	}
+}
+
+// How many leading bits the codes of sorted spheres i and j have in common, or -1 if j is out of
+// range. Equal codes fall back on the spheres' indices, so every sphere's key is unique.
+static inline int common_prefix(const uint32_t* codes, int count, int i, int j)
+{
+	if (j < 0 || j >= count)
+		return -1;
+	if (codes[i] == codes[j])
+		return 32 + count_leading_zeros(uint32_t(i ^ j));
+	return count_leading_zeros(codes[i] ^ codes[j]);
+}
+
+// Find each internal node's children. Node i covers a range of sorted spheres with i at one end,
+// and it splits where the other spheres' codes stop sharing the range's common prefix.
+static void build_nodes_job(void* data, int begin, int end)
+{
+	particle_bvh* bvh = ((const bvh_build*)data)->bvh;
+	const uint32_t* codes = bvh->codes;
+	int count = bvh->num_spheres;
+	for (int i = begin; i < end; ++i)
+	{
+		// Which way the range goes from i: towards the neighbour it has more in common with
+		int direction = (common_prefix(codes, count, i, i + 1) - common_prefix(codes, count, i, i - 1)) >= 0 ? 1 : -1;
+		int min_prefix = common_prefix(codes, count, i, i - direction);
+
+		// Find the other end, by exponential then binary search
+		int max_length = 2;
+		while (common_prefix(codes, count, i, i + max_length * direction) > min_prefix)
+			max_length *= 2;
+		int length = 0;
+		for (int step = max_length / 2; step >= 1; step /= 2)
+		{
+			if (common_prefix(codes, count, i, i + (length + step) * direction) > min_prefix)
+				length += step;
+		}
+		int j = i + length * direction;
+
+		// Find the split: the last sphere, going from i, that shares more than the whole range does
+		int node_prefix = common_prefix(codes, count, i, j);
+		int split = 0;
+		for (int divisor = 2; ; divisor *= 2)
+		{
+			int step = (length + divisor - 1) / divisor;
+			if (common_prefix(codes, count, i, i + (split + step) * direction) > node_prefix)
+				split += step;
+			if (step <= 1)
+				break;
+		}
+		int gamma = i + split * direction + std::min(direction, 0);
+
+		// Each child is a leaf if it's a single sphere
+		particle_bvh_node& node = bvh->nodes[i];
+		if (std::min(i, j) == gamma)
+		{
+			node.left = ~gamma;
+			bvh->leaf_parents[gamma] = i;
+		}
+		else
+		{
+			node.left = gamma;
+			bvh->node_parents[gamma] = i;
+		}
+		if (std::max(i, j) == gamma + 1)
+		{
+			node.right = ~(gamma + 1);
+			bvh->leaf_parents[gamma + 1] = i;
+		}
+		else
+		{
+			node.right = gamma + 1;
+			bvh->node_parents[gamma + 1] = i;
+		}
+		bvh->node_visits[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+static inline void get_child_bounds(const particle_bvh* bvh, int32_t child, float o_min[3], float o_max[3])
+{
+	if (child < 0)
+	{
+		const particle_bvh_sphere& sphere = bvh->spheres[~child];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			o_min[axis] = sphere.center[axis] - sphere.radius;
+			o_max[axis] = sphere.center[axis] + sphere.radius;
+		}
+	}
+	else
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			o_min[axis] = bvh->nodes[child].min[axis];
+			o_max[axis] = bvh->nodes[child].max[axis];
+		}
+	}
+}
+
+// Fill in the nodes' bounds, from the leaves up. Each leaf walks up towards the root, and at each
+// node, the first child to get there stops, and the second (whose sibling is done, then) carries on.
+static void build_bounds_job(void* data, int begin, int end)
+{
+	particle_bvh* bvh = ((const bvh_build*)data)->bvh;
+	for (int i = begin; i < end; ++i)
+	{
+		int32_t node = bvh->leaf_parents[i];
+		while (node >= 0 && bvh->node_visits[node].fetch_add(1, std::memory_order_acq_rel) == 1)
+		{
+			float left_min[3], left_max[3], right_min[3], right_max[3];
+			get_child_bounds(bvh, bvh->nodes[node].left, left_min, left_max);
+			get_child_bounds(bvh, bvh->nodes[node].right, right_min, right_max);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				bvh->nodes[node].min[axis] = std::min(left_min[axis], right_min[axis]);
+				bvh->nodes[node].max[axis] = std::max(left_max[axis], right_max[axis]);
+			}
+			node = bvh->node_parents[node];
+		}
+	}
+}
+
+bool build_particle_bvh(particle_bvh* bvh, const particle_store& store, const cull_rect& visible, float step_back, float step, float gravity)
+{
+	bvh->num_spheres = 0;
+	if (bvh->capacity < store.capacity && !resize_particle_bvh(bvh, store.capacity))
+		return false;
+
+	// Gather the visible particles, where they were at the render time, and the box around them
+	bvh_build build = { bvh };
+	float center_min[2] = { 0.0f, 0.0f };
+	float center_max[2] = { 0.0f, 0.0f };
+	particle_range ranges[2];
+	int num_ranges = get_live_particle_ranges(store, ranges);
+	int count = 0;
+	for (int range = 0; range < num_ranges; ++range)
+	{
+		for (int i = ranges[range].first, end = ranges[range].first + ranges[range].count; i < end; ++i)
+		{
+			if (!is_particle_visible(store, i, visible))
+				continue;
+
+			// The last step moved the particle by the velocity it had before gravity was applied
+			particle_bvh_sphere& sphere = bvh->gathered[count];
+			sphere.center[0] = store.position_x[i] - step_back * store.velocity_x[i];
+			sphere.center[1] = store.position_y[i] - step_back * (store.velocity_y[i] - step * gravity);
+			sphere.center[2] = 0.0f;
+			sphere.radius = store.size[i];
+			for (int axis = 0; axis < 2; ++axis)
+			{
+				center_min[axis] = (count == 0) ? sphere.center[axis] : std::min(center_min[axis], sphere.center[axis]);
+				center_max[axis] = (count == 0) ? sphere.center[axis] : std::max(center_max[axis], sphere.center[axis]);
+			}
+			++count;
+		}
+	}
+	bvh->num_spheres = count;
+	if (count == 0)
+		return true;
+
+	// Sort them along the Morton curve
+	for (int axis = 0; axis < 2; ++axis)
+	{
+		build.origin[axis] = center_min[axis];
+		float extent = center_max[axis] - center_min[axis];
+		build.scale[axis] = (extent > 0.0f) ? 65535.0f / extent : 0.0f;
+	}
+	parallel_for(count, bvh_job_alignment, &morton_code_job, &build);
+	sort_particle_items(&bvh->sort_buffers, count, 32);
+	parallel_for(count, bvh_job_alignment, &sort_spheres_job, &build);
+
+	// With a single sphere, there are no internal nodes; the root is the leaf
+	if (count == 1)
+		return true;
+
+	bvh->node_parents[0] = -1;
+	parallel_for(count - 1, bvh_job_alignment, &build_nodes_job, &build);
+	parallel_for(count, bvh_job_alignment, &build_bounds_job, &build);
+	return true;
+}
@@ -0,0 +1,55 @@
+// Bounding volume hierarchy over the particles, built on the CPU every frame, for raytracing them as spheres
+#pragma once
+
+#include "particle_store.h"
+#include "particle_sort.h"
+
+#include <atomic>
+#include <cstdint>
+
+// A sphere for each particle, at its center in the z = 0 plane, as big as its bounding circle
+struct particle_bvh_sphere
+{
+	float	center[3];
+	float	radius;
+};
+
+// An internal node: the box around everything under it, and its two children. A child that's an
+// internal node is its index, and a leaf is ~ the index of its sphere, so it's negative. This is
+// laid out as two RGBA32F texels, which is how fragment_shader_raytrace.glsl reads it.
+struct particle_bvh_node
+{
+	float	min[3];
+	int32_t	left;
+	float	max[3];
+	int32_t	right;
+};
+
+// It's a linear BVH (LBVH): the spheres are sorted along a Morton curve through the scene, and the
+// tree falls out of the bits the neighbouring spheres' codes have in common. Every step of the
+// build is either a radix sort or independent per node, so it all spreads across the job system.
+// See Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees" (2012).
+struct particle_bvh
+{
+	particle_bvh_node*		nodes;			// num_spheres - 1 of them, with the root first
+	particle_bvh_sphere*	spheres;		// in Morton order
+	int						num_spheres;
+	int						capacity;
+
+	// Scratch space for the build
+	particle_bvh_sphere*	gathered;		// the spheres in ring order, before sorting
+	uint32_t*				codes;			// Morton codes, in sorted order
+	int32_t*				node_parents;	// -1 for the root
+	int32_t*				leaf_parents;
+	std::atomic<int>*		node_visits;	// how many of each node's children have their bounds yet
+	particle_sort_buffers	sort_buffers;
+};
+
+// Build the BVH over the live particles that overlap 'visible'. The store holds the particles as
+// of the last simulation step, of length 'step'; they're spheres where they were 'step_back'
+// seconds before it, undoing the step the same way vertex_shader.glsl does. Returns false, and
+// leaves the BVH empty, if it couldn't allocate space for them all.
+bool build_particle_bvh(particle_bvh* bvh, const particle_store& store, const cull_rect& visible, float step_back, float step, float gravity);
+
+// Release the storage and reset the BVH to empty
+void free_particle_bvh(particle_bvh* bvh);
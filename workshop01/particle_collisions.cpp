@@ -0,0 +1,293 @@
+// Particle-particle collisions: a spatial hash grid over the particles, rebuilt every step, and a resolve between each particle and its neighbours
+
+#include "particle_collisions.h"
+#include "job_system.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// Jobs below this many items aren't worth handing to another thread
+static const int collision_job_alignment = 1024;
+
+static bool resize_particle_collision_grid(particle_collision_grid* grid, int capacity)
+{
+	free_particle_collision_grid(grid);
+
+	// A power of two at least as big as the capacity, so there are one to two slots per particle
+	uint32_t num_slots = 1;
+	while (num_slots < uint32_t(capacity))
+		num_slots *= 2;
+
+	grid->slots = (particle_grid_slot*)calloc(num_slots, sizeof(particle_grid_slot));
+	grid->keys = (uint32_t*)malloc(size_t(capacity) * sizeof(uint32_t));
+	grid->changes = (float*)malloc(size_t(capacity) * 4 * sizeof(float));
+	if (!grid->slots || !grid->keys || !grid->changes || !resize_particle_sort_buffers(&grid->sort_buffers, capacity))
+	{
+		free_particle_collision_grid(grid);
+		return false;
+	}
+	grid->slot_mask = num_slots - 1;
+	grid->capacity = capacity;
+	return true;
+}
+
+void free_particle_collision_grid(particle_collision_grid* grid)
+{
+	free(grid->slots);
+	free(grid->keys);
+	free(grid->changes);
+	free_particle_sort_buffers(&grid->sort_buffers);
+	*grid = particle_collision_grid{};
+}
+
+// What the collision jobs share
+struct collision_step
+{
+	particle_collision_grid*	grid;
+	particle_store*				store;
+	particle_range				ranges[2];
+	float						restitution;
+	float						inv_cell_size;
+	uint32_t					dead_key;		// sorts after every slot, so the dead particles end up last
+	int							num_items;		// every particle in the live window, dead or alive
+	std::atomic<uint32_t>		max_size_bits;	// sizes are positive, so their bits compare like they do
+	std::atomic<int>			num_alive;
+};
+
+// Items are numbered through the live window's ranges, one after the other
+static inline int item_particle(const collision_step* step, int item)
+{
+	if (item < step->ranges[0].count)
+		return step->ranges[0].first + item;
+	return step->ranges[1].first + item - step->ranges[0].count;
+}
+
+static inline int cell_coordinate(float position, float inv_cell_size)
+{
+	return int(floorf(position * inv_cell_size));
+}
+
+static inline uint32_t cell_slot(const particle_collision_grid* grid, int cell_x, int cell_y)
+{
+	return ((uint32_t(cell_x) * 73856093u) ^ (uint32_t(cell_y) * 19349663u)) & grid->slot_mask;
+}
+
+static inline uint32_t particle_key(const collision_step* step, int particle)
+{
+	const particle_store* store = step->store;
+	if (store->size[particle] == 0.0f)
+		return step->dead_key;
+	return cell_slot(step->grid, cell_coordinate(store->position_x[particle], step->inv_cell_size),
+		cell_coordinate(store->position_y[particle], step->inv_cell_size));
+}
+
+// Find the biggest particle, which sets the cell size, and count the live ones
+static void measure_particles_job(void* data, int begin, int end)
+{
+	collision_step* step = (collision_step*)data;
+	float max_size = 0.0f;
+	int num_alive = 0;
+	for (int item = begin; item < end; ++item)
+	{
+		float size = step->store->size[item_particle(step, item)];
+		max_size = (size > max_size) ? size : max_size;
+		num_alive += (size > 0.0f) ? 1 : 0;
+	}
+
+	uint32_t max_size_bits;
+	memcpy(&max_size_bits, &max_size, sizeof(max_size_bits));
+	uint32_t seen = step->max_size_bits.load(std::memory_order_relaxed);
+	while (seen < max_size_bits && !step->max_size_bits.compare_exchange_weak(seen, max_size_bits, std::memory_order_relaxed))
+	{
+	}
+	step->num_alive.fetch_add(num_alive, std::memory_order_relaxed);
+}
+
+// Key each particle by the slot its cell hashes to
+static void hash_particles_job(void* data, int begin, int end)
+{
+	collision_step* step = (collision_step*)data;
+	particle_sort_item* items = step->grid->sort_buffers.items;
+	for (int item = begin; item < end; ++item)
+	{
+		int particle = item_particle(step, item);
+		items[item] = (particle_sort_item(particle_key(step, particle)) << 32) | uint32_t(particle);
+	}
+}
+
+// The sort only leaves the indices, so find the keys again, in sorted order
+static void sorted_keys_job(void* data, int begin, int end)
+{
+	collision_step* step = (collision_step*)data;
+	const uint32_t* indices = step->grid->sort_buffers.indices;
+	for (int sorted = begin; sorted < end; ++sorted)
+		step->grid->keys[sorted] = particle_key(step, int(indices[sorted]));
+}
+
+// Each run of equal keys is a slot's particles; its ends are wherever the key changes
+static void find_slots_job(void* data, int begin, int end)
+{
+	collision_step* step = (collision_step*)data;
+	particle_collision_grid* grid = step->grid;
+	int num_alive = step->num_alive.load(std::memory_order_relaxed);
+	for (int sorted = begin; sorted < end; ++sorted)
+	{
+		uint32_t key = grid->keys[sorted];
+		if (sorted == 0 || grid->keys[sorted - 1] != key)
+		{
+			grid->slots[key].first = uint32_t(sorted);
+			grid->slots[key].stamp = grid->stamp;
+		}
+		if (sorted == num_alive - 1 || grid->keys[sorted + 1] != key)
+			grid->slots[key].end = uint32_t(sorted + 1);
+	}
+}
+
+// Work out each particle's response to everything it overlaps, from where they all are now. The
+// other particle in a pair works out the opposite response, so momentum is kept.
+static void resolve_particles_job(void* data, int begin, int end)
+{
+	collision_step* step = (collision_step*)data;
+	const particle_collision_grid* grid = step->grid;
+	const particle_store* store = step->store;
+	const uint32_t* indices = grid->sort_buffers.indices;
+	for (int sorted = begin; sorted < end; ++sorted)
+	{
+		int i = int(indices[sorted]);
+		float x = store->position_x[i], y = store->position_y[i];
+		float vx = store->velocity_x[i], vy = store->velocity_y[i];
+		float size = store->size[i];
+		float change[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+		// Neighbouring cells can hash to the same slot, which mustn't be visited twice
+		int cell_x = cell_coordinate(x, step->inv_cell_size);
+		int cell_y = cell_coordinate(y, step->inv_cell_size);
+		uint32_t visited[9];
+		int num_visited = 0;
+		for (int dy = -1; dy <= 1; ++dy)
+		{
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				uint32_t slot = cell_slot(grid, cell_x + dx, cell_y + dy);
+				bool seen = false;
+				for (int v = 0; v < num_visited; ++v)
+					seen = seen || (visited[v] == slot);
+				if (seen || grid->slots[slot].stamp != grid->stamp)
+					continue;
+				visited[num_visited++] = slot;
+
+				for (uint32_t other = grid->slots[slot].first; other < grid->slots[slot].end; ++other)
+				{
+					int j = int(indices[other]);
+					if (j == i)
+						continue;
+
+					float reach = size + store->size[j];
+					float normal_x = x - store->position_x[j];
+					float normal_y = y - store->position_y[j];
+					float distance_sq = normal_x * normal_x + normal_y * normal_y;
+					if (distance_sq >= reach * reach)
+						continue;
+
+					// Particles right on top of each other are pushed apart sideways, in index order
+					float distance = sqrtf(distance_sq);
+					if (distance > 0.0f)
+					{
+						normal_x /= distance;
+						normal_y /= distance;
+					}
+					else
+					{
+						normal_x = (i < j) ? -1.0f : 1.0f;
+						normal_y = 0.0f;
+					}
+
+					// This particle takes the other's share of the mass's worth of the response
+					float other_mass = store->size[j] * store->size[j];
+					float share = other_mass / (size * size + other_mass);
+					change[0] += normal_x * (reach - distance) * share;
+					change[1] += normal_y * (reach - distance) * share;
+
+					// Only bounce if they're moving together
+					float approach = (vx - store->velocity_x[j]) * normal_x + (vy - store->velocity_y[j]) * normal_y;
+					if (approach < 0.0f)
+					{
+						float impulse = -(1.0f + step->restitution) * approach * share;
+						change[2] += normal_x * impulse;
+						change[3] += normal_y * impulse;
+					}
+				}
+			}
+		}
+
+		memcpy(&grid->changes[sorted * 4], change, sizeof(change));
+	}
+}
+
+static void apply_changes_job(void* data, int begin, int end)
+{
+	collision_step* step = (collision_step*)data;
+	const particle_collision_grid* grid = step->grid;
+	particle_store* store = step->store;
+	for (int sorted = begin; sorted < end; ++sorted)
+	{
+		int i = int(grid->sort_buffers.indices[sorted]);
+		const float* change = &grid->changes[sorted * 4];
+		store->position_x[i] += change[0];
+		store->position_y[i] += change[1];
+		store->velocity_x[i] += change[2];
+		store->velocity_y[i] += change[3];
+	}
+}
+
+bool collide_particles(particle_collision_grid* grid, particle_store* store, float restitution)
+{
+	if (grid->capacity < store->capacity && !resize_particle_collision_grid(grid, store->capacity))
+		return false;
+
+	collision_step step;
+	step.grid = grid;
+	step.store = store;
+	step.ranges[1] = particle_range{ 0, 0 };
+	int num_ranges = get_live_particle_ranges(*store, step.ranges);
+	step.num_items = 0;
+	for (int range = 0; range < num_ranges; ++range)
+		step.num_items += step.ranges[range].count;
+	step.restitution = restitution;
+	step.dead_key = grid->slot_mask + 1;
+	step.max_size_bits.store(0, std::memory_order_relaxed);
+	step.num_alive.store(0, std::memory_order_relaxed);
+
+	parallel_for(step.num_items, collision_job_alignment, &measure_particles_job, &step);
+	int num_alive = step.num_alive.load(std::memory_order_relaxed);
+	if (num_alive < 2)
+		return true;
+
+	// Cells as wide as the biggest particle's bounding circle
+	uint32_t max_size_bits = step.max_size_bits.load(std::memory_order_relaxed);
+	float max_size;
+	memcpy(&max_size, &max_size_bits, sizeof(max_size));
+	step.inv_cell_size = 0.5f / max_size;
+
+	// Slots written before the stamp came back round would look current, so start afresh then
+	if (++grid->stamp == 0)
+	{
+		memset(grid->slots, 0, (size_t(grid->slot_mask) + 1) * sizeof(particle_grid_slot));
+		grid->stamp = 1;
+	}
+
+	// The dead key needs a bit above the slots', and the sort takes whole bytes
+	int key_bits = 8;
+	while (key_bits < 32 && (step.dead_key >> key_bits) != 0)
+		key_bits += 8;
+
+	parallel_for(step.num_items, collision_job_alignment, &hash_particles_job, &step);
+	sort_particle_items(&grid->sort_buffers, step.num_items, key_bits);
+	parallel_for(num_alive, collision_job_alignment, &sorted_keys_job, &step);
+	parallel_for(num_alive, collision_job_alignment, &find_slots_job, &step);
+	parallel_for(num_alive, collision_job_alignment, &resolve_particles_job, &step);
+	parallel_for(num_alive, collision_job_alignment, &apply_changes_job, &step);
+	return true;
+}
@@ -0,0 +1,46 @@
+// Particle-particle collisions: a spatial hash grid over the particles, rebuilt every step, and a resolve between each particle and its neighbours
+#pragma once
+
+#include "particle_store.h"
+#include "particle_sort.h"
+
+#include <cstdint>
+
+// One slot of the grid's hash table: the run of sorted particles whose cells hash to it. It's only
+// current if its stamp matches the grid's, so the table never has to be cleared between steps.
+struct particle_grid_slot
+{
+	uint32_t	first;
+	uint32_t	end;
+	uint32_t	stamp;
+};
+
+// The grid's cells are squares as wide as the biggest particle, so two particles can only touch if
+// they're in the same cell or neighbouring ones. The cells are hashed into a table with a slot or
+// two per particle, so the grid covers the whole world in O(n) space; particles are counting
+// sorted by slot, with the same parallel radix sort the draw order uses, so each slot's particles
+// are a contiguous run. Different cells can share a slot, which only costs a few wasted tests.
+// See Teschner et al., "Optimized Spatial Hashing for Collision Detection of Deformable Objects" (2003).
+struct particle_collision_grid
+{
+	particle_grid_slot*		slots;
+	uint32_t				slot_mask;		// the table's size is a power of two
+	uint32_t				stamp;			// bumped every build
+	int						capacity;
+
+	// Scratch space for each step, in sorted order
+	uint32_t*				keys;			// the particle's slot
+	float*					changes;		// how much to move the particle, and change its velocity: x, y, vx, vy
+	particle_sort_buffers	sort_buffers;
+};
+
+// Push apart every pair of live particles whose bounding circles overlap, treating them as discs
+// with mass in proportion to their area, and bounce them off each other with the given coefficient
+// of restitution (0 stops them dead along the line between them, 1 is perfectly elastic). Each
+// particle's response is worked out from where its neighbours were before any of them moved, so the
+// jobs don't race, and the result doesn't depend on how they were split up; a crowd takes a few
+// steps to settle. Returns false, leaving the particles as they were, if it couldn't allocate the grid.
+bool collide_particles(particle_collision_grid* grid, particle_store* store, float restitution);
+
+// Release the storage and reset the grid to empty
+void free_particle_collision_grid(particle_collision_grid* grid);
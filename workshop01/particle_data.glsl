@@ -0,0 +1,10 @@
+// Matches struct particle_data in the C++ code
+struct particle
+{
+	vec2 position;
+	vec2 velocity;
+	float angle;
+	float spin;
+	float size;
+	float creation_time;
+};
@@ -0,0 +1,252 @@
+// Particle shapes: the meshes particles can be drawn as, all packed into one vertex and index buffer
+
+#include "particle_shapes.h"
+#include "batch_random.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const float two_pi = 6.283185308f;
+
+// Start a new shape at the end of the library. Every shape's first vertex is its center, which is
+// what the point LOD draws. Returns null if the library's full.
+static particle_shape* begin_shape(particle_shape_library* library)
+{
+	if (int(library->shapes.size()) >= max_particle_shapes)
+		return nullptr;
+	library->shapes.push_back(particle_shape{});
+	particle_shape* shape = &library->shapes.back();
+	shape->first_vertex = int(library->vertices.size() / 2);
+	library->vertices.push_back(0.0f);
+	library->vertices.push_back(0.0f);
+	shape->num_vertices = 1;
+	return shape;
+}
+
+// Add a vertex to the shape being built, returning its index within the shape
+static uint16_t add_shape_vertex(particle_shape_library* library, particle_shape* shape, float x, float y)
+{
+	library->vertices.push_back(x);
+	library->vertices.push_back(y);
+	return uint16_t(shape->num_vertices++);
+}
+
+// Set one of the shape's LODs to the given triangles, a list of indices within the shape
+static void set_shape_lod(particle_shape_library* library, particle_shape* shape, particle_lod lod, const uint16_t* indices, int num_indices)
+{
+	shape->lods[lod] = particle_shape_lod{ int(library->indices.size()), num_indices, false };
+	library->indices.insert(library->indices.end(), indices, indices + num_indices);
+}
+
+// Finish the shape: its smallest LOD is a point at its center, and the LODs between the first and
+// last that weren't set are the same as the next more detailed one
+static int end_shape(particle_shape_library* library, particle_shape* shape)
+{
+	shape->lods[particle_lod_point] = particle_shape_lod{ int(library->indices.size()), 1, true };
+	library->indices.push_back(0);
+	for (int lod = 1; lod < num_particle_lods - 1; ++lod)
+	{
+		if (shape->lods[lod].num_indices == 0)
+			shape->lods[lod] = shape->lods[lod - 1];
+	}
+	return int(shape - library->shapes.data());
+}
+
+// A fan of triangles from the center to each edge of the outline, in the given corners' order
+static std::vector<uint16_t> make_fan(const uint16_t* corners, int num_corners)
+{
+	std::vector<uint16_t> indices;
+	for (int i = 0; i < num_corners; ++i)
+	{
+		indices.push_back(0);
+		indices.push_back(corners[i]);
+		indices.push_back(corners[(i + 1) % num_corners]);
+	}
+	return indices;
+}
+
+int add_star_shape(particle_shape_library* library, int points)
+{
+	particle_shape* shape = begin_shape(library);
+	if (!shape)
+		return -1;
+
+	// The star's points, then its inner corners, then the polygon's corners. The polygon's about the
+	// same area as the star.
+	static const float inner_radius = 0.5f;
+	static const float outer_radius = 1.0f;
+	static const float polygon_radius = 0.8f;
+	std::vector<uint16_t> point_vertices, corner_vertices, polygon_vertices;
+	for (int i = 0; i < points; ++i)
+	{
+		float angle_middle = two_pi * float(i) / float(points);
+		point_vertices.push_back(add_shape_vertex(library, shape, -sinf(angle_middle) * outer_radius, cosf(angle_middle) * outer_radius));
+	}
+	for (int i = 0; i < points; ++i)
+	{
+		float angle_left = two_pi * float(2*i + 1) / float(2*points);
+		corner_vertices.push_back(add_shape_vertex(library, shape, -sinf(angle_left) * inner_radius, cosf(angle_left) * inner_radius));
+	}
+	for (int i = 0; i < points; ++i)
+	{
+		float angle_middle = two_pi * float(i) / float(points);
+		polygon_vertices.push_back(add_shape_vertex(library, shape, -sinf(angle_middle) * polygon_radius, cosf(angle_middle) * polygon_radius));
+	}
+
+	// Two triangles for each point of the star, and a fan of triangles for the polygon
+	std::vector<uint16_t> star_indices;
+	for (int i = 0; i < points; ++i)
+	{
+		uint16_t corner_right = corner_vertices[(i + points - 1) % points];
+		uint16_t star_triangles[6] = { 0, corner_right, point_vertices[i], 0, point_vertices[i], corner_vertices[i] };
+		star_indices.insert(star_indices.end(), star_triangles, star_triangles + 6);
+	}
+	std::vector<uint16_t> polygon_indices;
+	for (int i = 0; i < points - 2; ++i)
+	{
+		uint16_t polygon_triangle[3] = { polygon_vertices[0], polygon_vertices[i + 1], polygon_vertices[i + 2] };
+		polygon_indices.insert(polygon_indices.end(), polygon_triangle, polygon_triangle + 3);
+	}
+
+	set_shape_lod(library, shape, particle_lod_star, star_indices.data(), int(star_indices.size()));
+	set_shape_lod(library, shape, particle_lod_pentagon, polygon_indices.data(), int(polygon_indices.size()));
+	return end_shape(library, shape);
+}
+
+int add_spark_shape(particle_shape_library* library)
+{
+	particle_shape* shape = begin_shape(library);
+	if (!shape)
+		return -1;
+
+	static const float half_width = 0.12f;
+	uint16_t corners[4] =
+	{
+		add_shape_vertex(library, shape, 0.0f, 1.0f),
+		add_shape_vertex(library, shape, -half_width, 0.0f),
+		add_shape_vertex(library, shape, 0.0f, -1.0f),
+		add_shape_vertex(library, shape, half_width, 0.0f),
+	};
+	std::vector<uint16_t> indices = make_fan(corners, 4);
+	set_shape_lod(library, shape, particle_lod_star, indices.data(), int(indices.size()));
+	return end_shape(library, shape);
+}
+
+int add_debris_shape(particle_shape_library* library, uint32_t seed)
+{
+	particle_shape* shape = begin_shape(library);
+	if (!shape)
+		return -1;
+
+	// Corners around the center, at jittered angles and distances
+	static const int num_corners = 7;
+	random_stream stream = make_random_stream(seed, 0);
+	uint16_t corners[num_corners];
+	for (int i = 0; i < num_corners; ++i)
+	{
+		float angle = two_pi * (float(i) + random_float(stream, 2*i, -0.3f, 0.3f)) / float(num_corners);
+		float radius = random_float(stream, 2*i + 1, 0.55f, 1.0f);
+		corners[i] = add_shape_vertex(library, shape, -sinf(angle) * radius, cosf(angle) * radius);
+	}
+	std::vector<uint16_t> indices = make_fan(corners, num_corners);
+	uint16_t triangle[3] = { corners[0], corners[num_corners / 3], corners[2 * num_corners / 3] };
+	set_shape_lod(library, shape, particle_lod_star, indices.data(), int(indices.size()));
+	set_shape_lod(library, shape, particle_lod_pentagon, triangle, 3);
+	return end_shape(library, shape);
+}
+
+// Read a face's vertex index out of a token like "3", "3/1" or "3//2", as an index into 'vertices'.
+// Negative ones count back from the latest vertex. Returns -1 if it's not a vertex there is.
+static int parse_face_vertex(const char* token, int num_vertices)
+{
+	char* end;
+	long index = strtol(token, &end, 10);
+	if (end == token || (*end != '\0' && *end != '/'))
+		return -1;
+	if (index < 0)
+		index += num_vertices + 1;
+	return (index >= 1 && index <= num_vertices) ? int(index - 1) : -1;
+}
+
+int load_particle_shape(particle_shape_library* library, const char* filename)
+{
+	FILE* file = fopen(filename, "r");
+	if (!file)
+	{
+		printf("Warning: couldn't open shape file %s!\n", filename);
+		return -1;
+	}
+
+	std::vector<float> vertices;
+	std::vector<uint16_t> indices;
+	char line[1024];
+	int line_number = 0;
+	bool ok = true;
+	while (ok && fgets(line, sizeof(line), file))
+	{
+		++line_number;
+		char* token = strtok(line, " \t\r\n");
+		if (!token)
+			continue;
+
+		if (strcmp(token, "v") == 0)
+		{
+			const char* x = strtok(nullptr, " \t\r\n");
+			const char* y = strtok(nullptr, " \t\r\n");
+			ok = (x && y && vertices.size() / 2 < 65535);
+			if (ok)
+			{
+				vertices.push_back(float(atof(x)));
+				vertices.push_back(float(atof(y)));
+			}
+		}
+		else if (strcmp(token, "f") == 0)
+		{
+			// A fan of triangles from the first corner. The shape's own vertex 0 is its center, so
+			// the file's vertices come after it.
+			int num_vertices = int(vertices.size() / 2);
+			int corners[3];
+			int num_corners = 0;
+			while (ok && (token = strtok(nullptr, " \t\r\n")) != nullptr)
+			{
+				int corner = parse_face_vertex(token, num_vertices);
+				ok = (corner >= 0);
+				corners[num_corners < 2 ? num_corners : 2] = corner;
+				if (++num_corners >= 3)
+				{
+					indices.push_back(uint16_t(corners[0] + 1));
+					indices.push_back(uint16_t(corners[1] + 1));
+					indices.push_back(uint16_t(corners[2] + 1));
+					corners[1] = corners[2];
+				}
+			}
+			ok = ok && (num_corners >= 3);
+		}
+		// Anything else (normals, texture coordinates, groups, materials) doesn't matter here
+	}
+	fclose(file);
+
+	if (!ok)
+	{
+		printf("Warning: %s(%d): expected v x y, or f with at least three vertices that have been defined!\n", filename, line_number);
+		return -1;
+	}
+	if (indices.empty())
+	{
+		printf("Warning: %s has no faces!\n", filename);
+		return -1;
+	}
+
+	particle_shape* shape = begin_shape(library);
+	if (!shape)
+	{
+		printf("Warning: there are too many shapes to add %s!\n", filename);
+		return -1;
+	}
+	for (size_t i = 0; i < vertices.size(); i += 2)
+		add_shape_vertex(library, shape, vertices[i], vertices[i + 1]);
+	set_shape_lod(library, shape, particle_lod_star, indices.data(), int(indices.size()));
+	return end_shape(library, shape);
+}
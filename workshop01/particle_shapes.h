@@ -0,0 +1,51 @@
+// Particle shapes: the meshes particles can be drawn as, all packed into one vertex and index buffer
+#pragma once
+
+#include "particle_sort.h"
+
+#include <cstdint>
+#include <vector>
+
+// One of a shape's LODs (see particle_lod): a run of indices in the library. The indices count
+// from the shape's first vertex, so they're drawn with that as the base vertex.
+struct particle_shape_lod
+{
+	int		first_index;
+	int		num_indices;
+	bool	points;			// a single point sprite, rather than triangles
+};
+
+struct particle_shape
+{
+	int					first_vertex;		// where its vertices start in the library
+	int					num_vertices;
+	particle_shape_lod	lods[num_particle_lods];
+};
+
+// Every shape's vertices and indices, back to back, so they go up to the GPU as one buffer each,
+// and any shape can be drawn from them without binding anything else. The vertices are offsets
+// from the particle's center, for a particle of size 1. A particle picks its shape by its index
+// in 'shapes' (particle_store::shape).
+struct particle_shape_library
+{
+	std::vector<float>			vertices;	// x and y of each
+	std::vector<uint16_t>		indices;
+	std::vector<particle_shape>	shapes;
+};
+
+// These each add a shape to the library and return its index, or -1 if the library's full.
+// A star with the given number of points, with a polygon for its middle LOD.
+int add_star_shape(particle_shape_library* library, int points);
+
+// A spark: a thin streak along the particle's y axis, which is the same at the first two LODs
+int add_spark_shape(particle_shape_library* library);
+
+// A chunk of debris: an irregular polygon, whose outline is picked by the seed, with a triangle
+// for its middle LOD
+int add_debris_shape(particle_shape_library* library, uint32_t seed);
+
+// Load a shape from a Wavefront .obj file. Only the x and y of its vertices ("v") and its faces
+// ("f", which are split into fans of triangles) are read, and it's drawn the same at the first two
+// LODs. The vertices should be within about a unit of the origin, like the other shapes'. Says
+// why, and returns -1, if it can't be read or the library's full.
+int load_particle_shape(particle_shape_library* library, const char* filename);
@@ -0,0 +1,98 @@
+// Particle snapshots: finished simulation frames, handed from the simulation thread to the render thread
+
+#include "particle_snapshot.h"
+#include "job_system.h"
+
+#include <cstring>
+
+// Set in particle_snapshot_buffer::ready alongside the slot index
+static const int snapshot_ready_fresh = 4;
+static const int snapshot_index_mask = 3;
+
+// Copying all the fields of one linear range of the ring, split across jobs
+struct snapshot_copy_job_data
+{
+	particle_store*			dest;
+	const particle_store*	source;
+	int						first;
+};
+
+static void snapshot_copy_job(void* data, int begin, int end)
+{
+	const snapshot_copy_job_data* job_data = (const snapshot_copy_job_data*)data;
+	float* const dest_arrays[] =
+	{
+		job_data->dest->position_x, job_data->dest->position_y, job_data->dest->velocity_x, job_data->dest->velocity_y,
+		job_data->dest->angle, job_data->dest->spin, job_data->dest->size, job_data->dest->creation_time,
+	};
+	const float* const source_arrays[] =
+	{
+		job_data->source->position_x, job_data->source->position_y, job_data->source->velocity_x, job_data->source->velocity_y,
+		job_data->source->angle, job_data->source->spin, job_data->source->size, job_data->source->creation_time,
+	};
+
+	int first = job_data->first + begin;
+	size_t bytes = size_t(end - begin) * sizeof(float);
+	for (int i = 0; i < 8; ++i)
+		memcpy(dest_arrays[i] + first, source_arrays[i] + first, bytes);
+	memcpy(job_data->dest->shape + first, job_data->source->shape + first, size_t(end - begin));
+	memcpy(job_data->dest->sprite + first, job_data->source->sprite + first, size_t(end - begin));
+}
+
+void take_particle_snapshot(particle_snapshot* snapshot, const particle_store& particles, const frame_clock& clock)
+{
+	particle_range ranges[2];
+	int num_ranges = get_live_particle_ranges(particles, ranges);
+	for (int i = 0; i < num_ranges; ++i)
+	{
+		snapshot_copy_job_data job_data = { &snapshot->particles, &particles, ranges[i].first };
+		parallel_for(ranges[i].count, int(particle_array_alignment / sizeof(float)), &snapshot_copy_job, &job_data);
+	}
+
+	snapshot->particles.live_first = particles.live_first;
+	snapshot->particles.live_count = particles.live_count;
+	snapshot->clock = clock;
+}
+
+bool init_particle_snapshot_buffer(particle_snapshot_buffer* buffer, int capacity)
+{
+	free_particle_snapshot_buffer(buffer);
+	for (particle_snapshot& snapshot : buffer->snapshots)
+	{
+		snapshot.clock = frame_clock{};
+		if (!init_particle_store(&snapshot.particles, capacity))
+		{
+			free_particle_snapshot_buffer(buffer);
+			return false;
+		}
+	}
+	buffer->back = 0;
+	buffer->ready.store(1);
+	buffer->front = 2;
+	return true;
+}
+
+void free_particle_snapshot_buffer(particle_snapshot_buffer* buffer)
+{
+	for (particle_snapshot& snapshot : buffer->snapshots)
+		free_particle_store(&snapshot.particles);
+}
+
+void publish_particle_snapshot(particle_snapshot_buffer* buffer)
+{
+	// Release, so the consumer sees everything written into the snapshot
+	int previous = buffer->ready.exchange(buffer->back | snapshot_ready_fresh, std::memory_order_acq_rel);
+	buffer->back = previous & snapshot_index_mask;
+}
+
+const particle_snapshot* acquire_particle_snapshot(particle_snapshot_buffer* buffer, bool* out_new)
+{
+	*out_new = (buffer->ready.load(std::memory_order_relaxed) & snapshot_ready_fresh) != 0;
+	if (*out_new)
+	{
+		// Acquire, to see everything the producer wrote before publishing it
+		int latest = buffer->ready.exchange(buffer->front, std::memory_order_acq_rel);
+		buffer->front = latest & snapshot_index_mask;
+	}
+	return &buffer->snapshots[buffer->front];
+}
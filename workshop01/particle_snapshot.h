@@ -0,0 +1,52 @@
+// Particle snapshots: finished simulation frames, handed from the simulation thread to the render thread
+#pragma once
+
+#include "particle_store.h"
+#include "frame_clock.h"
+
+#include <atomic>
+
+// A copy of the particles' live window, and the clock as of the frame that produced them,
+// which the render takes its time and interpolation from
+struct particle_snapshot
+{
+	particle_store	particles;
+	frame_clock		clock;
+};
+
+// Copy the live part of 'particles' into the snapshot, along with the clock. The snapshot must have
+// the same capacity. Everything outside the live window is left stale, since it's never drawn.
+void take_particle_snapshot(particle_snapshot* snapshot, const particle_store& particles, const frame_clock& clock);
+
+// A lock-free triple buffer of snapshots, between one producer and one consumer. The producer
+// fills in the back snapshot while the consumer reads the front one, and the third holds the
+// latest finished frame. Handing a snapshot over, in either direction, is a single atomic
+// exchange of slot indices, so neither side ever waits for the other.
+struct particle_snapshot_buffer
+{
+	particle_snapshot	snapshots[3];
+	std::atomic<int>	ready;		// the latest finished snapshot, plus snapshot_ready_fresh if the consumer hasn't seen it
+	int					back;		// only touched by the producer
+	int					front;		// only touched by the consumer
+};
+
+// Allocate all three snapshots for the given particle capacity, with nothing in them. Returns false
+// on failure, leaving the buffer empty. Neither side may be using the buffer while it's (re)initialized.
+bool init_particle_snapshot_buffer(particle_snapshot_buffer* buffer, int capacity);
+
+// Release the snapshots' storage
+void free_particle_snapshot_buffer(particle_snapshot_buffer* buffer);
+
+// Producer: the snapshot to fill in next, which nobody else is looking at
+inline particle_snapshot* back_particle_snapshot(particle_snapshot_buffer* buffer)
+{
+	return &buffer->snapshots[buffer->back];
+}
+
+// Producer: hand over the back snapshot as the latest finished frame, and get a new back one.
+// If the consumer never saw the previous latest frame, that's the one that gets reused.
+void publish_particle_snapshot(particle_snapshot_buffer* buffer);
+
+// Consumer: swap in the latest finished frame, if there's been one since last time, and return the
+// front snapshot, which stays put until the next call. Sets *out_new to whether it changed.
+const particle_snapshot* acquire_particle_snapshot(particle_snapshot_buffer* buffer, bool* out_new);
@@ -0,0 +1,208 @@
+// Sorting particles into the order they're drawn in, so blending comes out right
+
+#include "particle_sort.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// The radix sort goes a byte of the key at a time
+static const int radix_bits = 8;
+static const int radix_size = 1 << radix_bits;
+
+// Each pass splits the items into blocks, one job each. Below this many items a block isn't
+// worth handing to another thread.
+static const int max_sort_blocks = 64;
+static const int min_sort_block_size = 16384;
+
+// State for one pass of the radix sort, shared by all its jobs
+struct radix_pass
+{
+	const particle_sort_item*	in;
+	particle_sort_item*			out;			// where the pass writes the items, or
+	uint32_t*					out_indices;	// on the last pass, just their particle indices
+	int							count;
+	int							block_size;
+	int							shift;			// bit position of the digit this pass sorts on
+
+	// First, how many of each digit there are in each block; then, where each block's
+	// items with each digit go in the output
+	uint32_t					offsets[max_sort_blocks][radix_size];
+};
+
+bool resize_particle_sort_buffers(particle_sort_buffers* buffers, int capacity)
+{
+	free_particle_sort_buffers(buffers);
+	buffers->items = (particle_sort_item*)malloc(size_t(capacity) * sizeof(particle_sort_item));
+	buffers->scratch = (particle_sort_item*)malloc(size_t(capacity) * sizeof(particle_sort_item));
+	buffers->indices = (uint32_t*)malloc(size_t(capacity) * sizeof(uint32_t));
+	buffers->pass = (radix_pass*)malloc(sizeof(radix_pass));
+	if (!buffers->items || !buffers->scratch || !buffers->indices || !buffers->pass)
+	{
+		free_particle_sort_buffers(buffers);
+		return false;
+	}
+	buffers->capacity = capacity;
+	return true;
+}
+
+void free_particle_sort_buffers(particle_sort_buffers* buffers)
+{
+	free(buffers->items);
+	free(buffers->scratch);
+	free(buffers->indices);
+	free(buffers->pass);
+	*buffers = particle_sort_buffers{};
+}
+
+// Map [0, 1] onto the whole range of particle_sort_order keys, clamping anything outside it
+static inline uint32_t quantize_sort_key(float value)
+{
+	static const float max_key = float((1 << particle_lod_key_shift) - 1);
+	value = std::min(std::max(value, 0.0f), 1.0f);
+	return uint32_t(value * max_key + 0.5f);
+}
+
+int gather_particle_sort_items(const particle_store& store, int first, int count, const cull_rect& visible, particle_sort_order order, const particle_lod_sizes& lod_sizes, float time, float max_age, particle_sort_item* out, int bucket_counts[num_particle_draw_buckets])
+{
+	static const uint32_t max_key = (1 << particle_lod_key_shift) - 1;
+	particle_sort_item* out_begin = out;
+	for (int i = first, end = first + count; i < end; ++i)
+	{
+		if (!is_particle_visible(store, i, visible))
+			continue;
+
+		uint32_t key = 0;
+		if (order == particle_sort_oldest_first)
+			key = max_key - quantize_sort_key((time - store.creation_time[i]) / max_age);
+		else if (order == particle_sort_smallest_first)
+			key = quantize_sort_key(store.size[i] * (1.0f / max_packed_size));
+
+		particle_lod lod = select_particle_lod(store.size[i], lod_sizes);
+		++bucket_counts[particle_draw_bucket(store.shape[i], lod)];
+		key |= uint32_t(particle_lod_group(lod)) << particle_lod_key_shift;
+		key |= uint32_t(store.shape[i]) << particle_shape_key_shift;
+
+		*out++ = (particle_sort_item(key) << 32) | uint32_t(i);
+	}
+	return int(out - out_begin);
+}
+
+static void radix_histogram_job(void* data, int begin, int end)
+{
+	radix_pass* pass = (radix_pass*)data;
+	for (int block = begin; block < end; ++block)
+	{
+		uint32_t* counts = pass->offsets[block];
+		std::fill_n(counts, radix_size, 0u);
+
+		const particle_sort_item* in = pass->in;
+		for (int i = block * pass->block_size, i_end = std::min(pass->count, i + pass->block_size); i < i_end; ++i)
+			++counts[(in[i] >> pass->shift) & (radix_size - 1)];
+	}
+}
+
+static void radix_scatter_job(void* data, int begin, int end)
+{
+	radix_pass* pass = (radix_pass*)data;
+	for (int block = begin; block < end; ++block)
+	{
+		uint32_t offsets[radix_size];
+		std::copy_n(pass->offsets[block], radix_size, offsets);
+
+		// Going through the block in order, and the blocks being in order in the output, is
+		// what makes each pass stable
+		const particle_sort_item* in = pass->in;
+		int i = block * pass->block_size;
+		int i_end = std::min(pass->count, i + pass->block_size);
+		if (pass->out)
+		{
+			for (; i < i_end; ++i)
+				pass->out[offsets[(in[i] >> pass->shift) & (radix_size - 1)]++] = in[i];
+		}
+		else
+		{
+			for (; i < i_end; ++i)
+				pass->out_indices[offsets[(in[i] >> pass->shift) & (radix_size - 1)]++] = uint32_t(in[i]);
+		}
+	}
+}
+
+// Run a job per block, across all the threads
+static void run_radix_blocks(job_function function, radix_pass* pass, int num_blocks)
+{
+	if (num_blocks == 1)
+	{
+		function(pass, 0, 1);
+		return;
+	}
+
+	job jobs[max_sort_blocks];
+	for (int block = 0; block < num_blocks; ++block)
+		jobs[block] = job{ function, pass, block, block + 1, nullptr };
+
+	std::atomic<int> counter(0);
+	submit_jobs(jobs, num_blocks, &counter);
+	wait_for_counter(&counter);
+}
+
+void sort_particle_items(particle_sort_buffers* buffers, int count, int key_bits)
+{
+	if (count <= 0)
+		return;
+
+	// One block per thread, unless that would make them too small
+	int num_blocks = std::min(job_thread_count(), max_sort_blocks);
+	num_blocks = std::max(1, std::min(num_blocks, count / min_sort_block_size));
+
+	radix_pass& pass = *buffers->pass;
+	pass.count = count;
+	pass.block_size = (count + num_blocks - 1) / num_blocks;
+
+	// Sort on each digit of the key, least significant first, ping-ponging between the buffers.
+	// The key is in the upper 32 bits of each item.
+	particle_sort_item* in = buffers->items;
+	particle_sort_item* out = buffers->scratch;
+	int num_radix_passes = key_bits / radix_bits;
+	for (int pass_index = 0; pass_index < num_radix_passes; ++pass_index)
+	{
+		bool last_pass = (pass_index == num_radix_passes - 1);
+		pass.in = in;
+		pass.out = last_pass ? nullptr : out;
+		pass.out_indices = last_pass ? buffers->indices : nullptr;
+		pass.shift = 32 + pass_index * radix_bits;
+
+		run_radix_blocks(&radix_histogram_job, &pass, num_blocks);
+
+		// If every item has the same digit, the pass wouldn't change anything
+		uint32_t first_digit = (in[0] >> pass.shift) & (radix_size - 1);
+		uint32_t num_with_first_digit = 0;
+		for (int block = 0; block < num_blocks; ++block)
+			num_with_first_digit += pass.offsets[block][first_digit];
+		if (num_with_first_digit == uint32_t(count))
+		{
+			if (last_pass)
+			{
+				for (int i = 0; i < count; ++i)
+					buffers->indices[i] = uint32_t(in[i]);
+			}
+			continue;
+		}
+
+		// Turn the counts into output offsets: all the items with smaller digits come first, then
+		// the items with this digit from the earlier blocks
+		uint32_t total = 0;
+		for (int digit = 0; digit < radix_size; ++digit)
+		{
+			for (int block = 0; block < num_blocks; ++block)
+			{
+				uint32_t block_count = pass.offsets[block][digit];
+				pass.offsets[block][digit] = total;
+				total += block_count;
+			}
+		}
+
+		run_radix_blocks(&radix_scatter_job, &pass, num_blocks);
+		std::swap(in, out);
+	}
+}
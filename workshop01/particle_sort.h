@@ -0,0 +1,102 @@
+// Sorting particles into the order they're drawn in, so blending comes out right
+#pragma once
+
+#include "particle_store.h"
+
+#include <cstdint>
+
+// What to sort the particles by
+enum particle_sort_order
+{
+	particle_sort_none,				// leave them in the order they are in the ring
+	particle_sort_oldest_first,		// by age, so the newest are drawn on top
+	particle_sort_smallest_first,	// by size, treating small ones as further away: back to front
+	num_particle_sort_orders,
+};
+
+// The levels of detail particles are drawn at, from most to least detailed. Each is a separate
+// instanced draw, so the list of particles to draw is grouped by LOD, coarsest first.
+enum particle_lod
+{
+	particle_lod_star,			// the full star
+	particle_lod_pentagon,		// a pentagon, for when it's too small to make out the points
+	particle_lod_point,			// a point sprite, for when it's only a pixel or two across
+	num_particle_lods,
+};
+
+// The smallest size a particle can be, in world units, to be drawn at each LOD but the last.
+// This is the projected size picked per frame, so it follows the window and its resolution.
+struct particle_lod_sizes
+{
+	float	min_size[num_particle_lods - 1];
+};
+
+inline particle_lod select_particle_lod(float size, const particle_lod_sizes& lod_sizes)
+{
+	int lod = 0;
+	while (lod < num_particle_lods - 1 && size < lod_sizes.min_size[lod])
+		++lod;
+	return particle_lod(lod);
+}
+
+// Sort keys are 16 bits, so they only take two radix sort passes. The top bits group the particles
+// by LOD, and the rest are the particle_sort_order key, which is plenty to put them in order visually.
+static const int particle_sort_key_bits = 16;
+static const int particle_lod_key_shift = 14;
+
+// When there's more than one shape (see particle_shapes.h), they're grouped by shape as well, above
+// the LOD, which takes a third pass
+static const int particle_shape_key_shift = 16;
+static const int particle_shape_sort_key_bits = 24;
+
+// The LODs' groups, in drawing order, which is coarsest first
+inline int particle_lod_group(particle_lod lod)
+{
+	return num_particle_lods - 1 - int(lod);
+}
+
+// Each shape at each LOD is a separate draw. These index the counts of particles in each.
+static const int num_particle_draw_buckets = max_particle_shapes * num_particle_lods;
+inline int particle_draw_bucket(int shape, particle_lod lod)
+{
+	return shape * num_particle_lods + int(lod);
+}
+
+// A particle's sort key and index, packed together with the key in the upper half, so sorting
+// items by value sorts the particles by key. The sort is stable, so particles with equal keys
+// stay in ring order.
+typedef uint64_t particle_sort_item;
+
+struct radix_pass;
+
+// Scratch space for sorting, big enough for the whole particle store. Sorts with different
+// buffers can run at the same time.
+struct particle_sort_buffers
+{
+	particle_sort_item*	items;		// filled in by gather_particle_sort_items()
+	particle_sort_item*	scratch;	// ping-pong buffer for the radix sort
+	uint32_t*			indices;	// sort_particle_items() leaves the sorted particle indices here
+	radix_pass*			pass;		// the radix sort's state for the pass it's on, which is too big for the stack
+	int					capacity;
+};
+
+// Allocate (or reallocate) space to sort the given number of particles. Returns false on failure,
+// leaving the buffers empty.
+bool resize_particle_sort_buffers(particle_sort_buffers* buffers, int capacity);
+
+// Release the space and reset the buffers to empty
+void free_particle_sort_buffers(particle_sort_buffers* buffers);
+
+// Make a key for every particle in [first, first + count) that's alive and overlaps 'visible',
+// writing them to 'out' in ring order, and returning how many. Ages are measured from 'time',
+// and go up to max_age. How many there are of each shape at each LOD is added to bucket_counts.
+// The keys group them by shape, but that only comes out in the sort if it's told to sort on
+// particle_shape_sort_key_bits.
+int gather_particle_sort_items(const particle_store& store, int first, int count, const cull_rect& visible, particle_sort_order order, const particle_lod_sizes& lod_sizes, float time, float max_age, particle_sort_item* out, int bucket_counts[num_particle_draw_buckets]);
+
+// Sort buffers->items[0, count) by key, with an LSD radix sort spread across the job system's
+// threads, and write the particle indices in the sorted order to buffers->indices. Passes whose
+// digit is the same for every item are skipped, so grouping by LOD alone is a single pass.
+// Only the low key_bits of the key are sorted on; other users of the sort (such as the BVH's
+// Morton codes) can use up to all 32, a multiple of 8 at a time.
+void sort_particle_items(particle_sort_buffers* buffers, int count, int key_bits = particle_sort_key_bits);
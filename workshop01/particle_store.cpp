@@ -0,0 +1,594 @@
+// Structure-of-arrays storage for the particle system
+
+#include "particle_store.h"
+#include "cpu_features.h"
+#include "job_system.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+#if WORKSHOP_X86
+#	include <emmintrin.h>
+#endif
+
+// Stores come straight from the OS, in whole pages, rather than from the heap. Big ones are lined
+// up on 2 MB boundaries and asked for huge pages, so streaming through hundreds of MB of arrays
+// doesn't take a TLB miss every 4 KB. Pages from the OS come zeroed, and aren't given any physical
+// memory until they're first touched.
+static const size_t huge_page_size = size_t(2) << 20;
+
+static void* allocate_pages(size_t size, size_t* o_allocated)
+{
+#ifdef _WIN32
+	// Large pages need the "lock pages in memory" privilege, which most accounts don't have, so
+	// without it, it's ordinary ones
+	size_t large_page_size = GetLargePageMinimum();
+	if (large_page_size && size >= large_page_size)
+	{
+		size_t rounded = (size + large_page_size - 1) & ~(large_page_size - 1);
+		void* memory = VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (memory)
+		{
+			*o_allocated = rounded;
+			return memory;
+		}
+	}
+	*o_allocated = size;
+	return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	if (size < huge_page_size)
+	{
+		void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		*o_allocated = size;
+		return (memory == MAP_FAILED) ? nullptr : memory;
+	}
+
+	// Map a huge page more than it needs, then trim it down to whole huge pages on a boundary
+	size_t rounded = (size + huge_page_size - 1) & ~(huge_page_size - 1);
+	char* memory = (char*)mmap(nullptr, rounded + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		return nullptr;
+	char* aligned = (char*)((uintptr_t(memory) + huge_page_size - 1) & ~uintptr_t(huge_page_size - 1));
+	if (aligned != memory)
+		munmap(memory, size_t(aligned - memory));
+	munmap(aligned + rounded, size_t(memory + huge_page_size - aligned));
+#	ifdef MADV_HUGEPAGE
+	madvise(aligned, rounded, MADV_HUGEPAGE);
+#	endif
+	*o_allocated = rounded;
+	return aligned;
+#endif
+}
+
+static void free_pages(void* memory, size_t allocated)
+{
+#ifdef _WIN32
+	VirtualFree(memory, 0, MEM_RELEASE);
+#else
+	munmap(memory, allocated);
+#endif
+}
+
+// Round each array's size up to a whole number of cache lines, so that every array starts on its
+// own cache line within the single allocation
+static size_t float_array_bytes(int capacity)
+{
+	return (size_t(capacity) * sizeof(float) + particle_array_alignment - 1) & ~(particle_array_alignment - 1);
+}
+
+static size_t byte_array_bytes(int capacity)
+{
+	return (size_t(capacity) + particle_array_alignment - 1) & ~(particle_array_alignment - 1);
+}
+
+size_t particle_store_bytes(int capacity)
+{
+	// Eight arrays of floats, then the shapes and sprites, which are bytes, so they get smaller
+	// arrays, at the end
+	return float_array_bytes(capacity) * 8 + byte_array_bytes(capacity) * 2;
+}
+
+// Point the arrays into memory laid out for the capacity
+static void place_particle_arrays(particle_store* store, int capacity, char* memory)
+{
+	size_t array_bytes = float_array_bytes(capacity);
+	store->position_x		= (float*)(memory + 0 * array_bytes);
+	store->position_y		= (float*)(memory + 1 * array_bytes);
+	store->velocity_x		= (float*)(memory + 2 * array_bytes);
+	store->velocity_y		= (float*)(memory + 3 * array_bytes);
+	store->angle			= (float*)(memory + 4 * array_bytes);
+	store->spin				= (float*)(memory + 5 * array_bytes);
+	store->size				= (float*)(memory + 6 * array_bytes);
+	store->creation_time	= (float*)(memory + 7 * array_bytes);
+	store->shape			= (uint8_t*)(memory + 8 * array_bytes);
+	store->sprite			= (uint8_t*)(memory + 8 * array_bytes + byte_array_bytes(capacity));
+	store->capacity = capacity;
+	store->memory = memory;
+}
+
+// Zero particles [begin, end) of every array, which is what first touches their pages
+static void touch_particles_job(void* data, int begin, int end)
+{
+	particle_store* store = (particle_store*)data;
+	size_t float_offset = size_t(begin) * sizeof(float), float_bytes = size_t(end - begin) * sizeof(float);
+	float* float_arrays[] = { store->position_x, store->position_y, store->velocity_x, store->velocity_y, store->angle, store->spin, store->size, store->creation_time };
+	for (float* array : float_arrays)
+		memset((char*)array + float_offset, 0, float_bytes);
+	memset(store->shape + begin, 0, size_t(end - begin));
+	memset(store->sprite + begin, 0, size_t(end - begin));
+}
+
+bool init_particle_store(particle_store* store, int capacity)
+{
+	*store = particle_store{};
+	size_t total_bytes = particle_store_bytes(capacity);
+	size_t allocated_bytes = 0;
+	char* memory = (char*)allocate_pages(total_bytes, &allocated_bytes);
+	if (!memory)
+		return false;
+	place_particle_arrays(store, capacity, memory);
+	store->allocated_bytes = allocated_bytes;
+
+	// The pages go wherever they're first touched: on a machine with more than one NUMA node, in
+	// the memory of the node the touching thread's running on. Touching them all from here would
+	// put the whole store on this thread's node, and every other node's workers would reach across
+	// for it. Touched in chunks across the job threads, as the simulation goes through them, they're
+	// spread over all the nodes, and the page faults are taken in parallel too.
+	parallel_for(capacity, int(particle_array_alignment / sizeof(float)), &touch_particles_job, store);
+	return true;
+}
+
+bool map_particle_store(particle_store* store, int capacity, const char* filename, size_t offset)
+{
+	*store = particle_store{};
+	size_t total_bytes = particle_store_bytes(capacity);
+	void* memory = nullptr;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	// A copy-on-write view; the handles can go once it's made, as the view keeps the file open
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	if (mapping)
+	{
+		uint64_t offset64 = offset;
+		memory = MapViewOfFile(mapping, FILE_MAP_COPY, DWORD(offset64 >> 32), DWORD(offset64), total_bytes);
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+#else
+	int file = open(filename, O_RDONLY);
+	if (file < 0)
+		return false;
+	memory = mmap(nullptr, total_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, off_t(offset));
+	close(file);
+	if (memory == MAP_FAILED)
+		memory = nullptr;
+#endif
+	if (!memory)
+		return false;
+
+	place_particle_arrays(store, capacity, (char*)memory);
+	store->mapped_bytes = total_bytes;
+	return true;
+}
+
+bool resize_particle_store(particle_store* store, int new_capacity)
+{
+	particle_store new_store;
+	if (!init_particle_store(&new_store, new_capacity))
+		return false;
+
+	int num_to_keep = (store->capacity < new_capacity) ? store->capacity : new_capacity;
+	size_t bytes_to_keep = size_t(num_to_keep) * sizeof(float);
+	memcpy(new_store.position_x,	store->position_x,		bytes_to_keep);
+	memcpy(new_store.position_y,	store->position_y,		bytes_to_keep);
+	memcpy(new_store.velocity_x,	store->velocity_x,		bytes_to_keep);
+	memcpy(new_store.velocity_y,	store->velocity_y,		bytes_to_keep);
+	memcpy(new_store.angle,			store->angle,			bytes_to_keep);
+	memcpy(new_store.spin,			store->spin,			bytes_to_keep);
+	memcpy(new_store.size,			store->size,			bytes_to_keep);
+	memcpy(new_store.creation_time,	store->creation_time,	bytes_to_keep);
+	memcpy(new_store.shape,			store->shape,			size_t(num_to_keep));
+	memcpy(new_store.sprite,		store->sprite,			size_t(num_to_keep));
+
+	free_particle_store(store);
+	*store = new_store;
+	return true;
+}
+
+void free_particle_store(particle_store* store)
+{
+	if (store->mapped_bytes)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(store->memory);
+#else
+		munmap(store->memory, store->mapped_bytes);
+#endif
+	}
+	else if (store->memory)
+	{
+		free_pages(store->memory, store->allocated_bytes);
+	}
+	*store = particle_store{};
+}
+
+void write_particle(particle_store* store, int index, const particle_data& particle)
+{
+	store->position_x[index]	= particle.position[0];
+	store->position_y[index]	= particle.position[1];
+	store->velocity_x[index]	= particle.velocity[0];
+	store->velocity_y[index]	= particle.velocity[1];
+	store->angle[index]			= particle.angle;
+	store->spin[index]			= particle.spin;
+	store->size[index]			= particle.size;
+	store->creation_time[index]	= particle.creation_time;
+}
+
+void mark_particles_dirty(particle_store* store, int first, int count)
+{
+	if (count <= 0)
+		return;
+
+	if (store->dirty_count == 0)
+	{
+		store->dirty_first = first;
+		store->dirty_count = count;
+	}
+	else if (first == (store->dirty_first + store->dirty_count) % store->capacity)
+	{
+		store->dirty_count += count;
+	}
+	else
+	{
+		store->dirty_first = 0;
+		store->dirty_count = store->capacity;
+	}
+
+	// Once the whole ring is dirty, there's nothing more to track
+	if (store->dirty_count >= store->capacity)
+	{
+		store->dirty_first = 0;
+		store->dirty_count = store->capacity;
+	}
+}
+
+// Split a range in the ring where it wraps around the end of the arrays
+static int split_ring_range(int capacity, int first, int count, particle_range out_ranges[2])
+{
+	if (count <= 0)
+		return 0;
+
+	int first_count = capacity - first;
+	if (first_count >= count)
+	{
+		out_ranges[0] = particle_range{ first, count };
+		return 1;
+	}
+	out_ranges[0] = particle_range{ first, first_count };
+	out_ranges[1] = particle_range{ 0, count - first_count };
+	return 2;
+}
+
+int take_dirty_particle_ranges(particle_store* store, particle_range out_ranges[2])
+{
+	int num_ranges = split_ring_range(store->capacity, store->dirty_first, store->dirty_count, out_ranges);
+	clear_dirty_particles(store);
+	return num_ranges;
+}
+
+void clear_dirty_particles(particle_store* store)
+{
+	store->dirty_first = 0;
+	store->dirty_count = 0;
+}
+
+void spawn_live_particles(particle_store* store, int end_index, int count)
+{
+	// If we've wrapped all the way around, the newest particles overwrote the oldest
+	store->live_count += count;
+	if (store->live_count > store->capacity)
+		store->live_count = store->capacity;
+	store->live_first = (end_index - store->live_count + store->capacity) % store->capacity;
+}
+
+void reset_live_particles(particle_store* store, int end_index)
+{
+	store->live_count = 0;
+	spawn_live_particles(store, end_index, store->capacity);
+}
+
+int get_live_particle_ranges(const particle_store& store, particle_range out_ranges[2])
+{
+	return split_ring_range(store.capacity, store.live_first, store.live_count, out_ranges);
+}
+
+void kill_particles(particle_store* store, float time, float max_age, float kill_height)
+{
+	// Particles die anywhere in the window, as they fall out of the world...
+	float oldest_creation_time = time - max_age;
+	particle_range ranges[2];
+	int num_ranges = get_live_particle_ranges(*store, ranges);
+	for (int r = 0; r < num_ranges; ++r)
+	{
+		for (int i = ranges[r].first, end = ranges[r].first + ranges[r].count; i < end; ++i)
+		{
+			if (store->position_y[i] < kill_height || store->creation_time[i] < oldest_creation_time)
+				store->size[i] = 0.0f;
+		}
+	}
+
+	// ...but the window can only shrink from its oldest end. Since everything dies of old age eventually,
+	// that's never far behind.
+	while (store->live_count > 0 && store->size[store->live_first] == 0.0f)
+	{
+		store->live_first = (store->live_first + 1) % store->capacity;
+		--store->live_count;
+	}
+}
+
+// Move each live particle along its ballistic path by some multiple of its age
+static void move_particles_by_age(particle_store* store, float time, float gravity, float age_scale)
+{
+	particle_range ranges[2];
+	int num_ranges = get_live_particle_ranges(*store, ranges);
+	for (int r = 0; r < num_ranges; ++r)
+	{
+		for (int i = ranges[r].first, end = ranges[r].first + ranges[r].count; i < end; ++i)
+		{
+			float dt = (time - store->creation_time[i]) * age_scale;
+			store->position_x[i] += dt * store->velocity_x[i];
+			store->position_y[i] += dt * store->velocity_y[i] + 0.5f * gravity * dt * dt;
+			store->velocity_y[i] += dt * gravity;
+			store->angle[i] = fmodf(store->angle[i] + dt * store->spin[i], 6.283185308f);
+			if (store->angle[i] < 0.0f)
+				store->angle[i] += 6.283185308f;
+		}
+	}
+}
+
+void rewind_particles_to_creation(particle_store* store, float time, float gravity)
+{
+	move_particles_by_age(store, time, gravity, -1.0f);
+}
+
+void advance_particles_from_creation(particle_store* store, float time, float gravity)
+{
+	move_particles_by_age(store, time, gravity, 1.0f);
+}
+
+void pack_particle_instances(const particle_store& store, int first, int count, particle_data* out)
+{
+	for (int i = first, end = first + count; i < end; ++i, ++out)
+	{
+		out->position[0]	= store.position_x[i];
+		out->position[1]	= store.position_y[i];
+		out->velocity[0]	= store.velocity_x[i];
+		out->velocity[1]	= store.velocity_y[i];
+		out->angle			= store.angle[i];
+		out->spin			= store.spin[i];
+		out->size			= store.size[i];
+		out->creation_time	= store.creation_time[i];
+	}
+}
+
+void stream_particle_instances(const particle_store& store, int first, int count, float oldest_creation_time, float kill_height, particle_data* out)
+{
+	int i = first, end = first + count;
+#if WORKSHOP_X86
+	// 4 particles at a time: transposing the arrays' rows gives each particle's two halves
+	const __m128 kill_y = _mm_set1_ps(kill_height);
+	const __m128 oldest = _mm_set1_ps(oldest_creation_time);
+	for (; i + 4 <= end; i += 4, out += 4)
+	{
+		__m128 px = _mm_loadu_ps(store.position_x + i);
+		__m128 py = _mm_loadu_ps(store.position_y + i);
+		__m128 vx = _mm_loadu_ps(store.velocity_x + i);
+		__m128 vy = _mm_loadu_ps(store.velocity_y + i);
+		__m128 angle = _mm_loadu_ps(store.angle + i);
+		__m128 spin = _mm_loadu_ps(store.spin + i);
+		__m128 size = _mm_loadu_ps(store.size + i);
+		__m128 creation_time = _mm_loadu_ps(store.creation_time + i);
+		__m128 dying = _mm_or_ps(_mm_cmplt_ps(py, kill_y), _mm_cmplt_ps(creation_time, oldest));
+		size = _mm_andnot_ps(dying, size);
+		_MM_TRANSPOSE4_PS(px, py, vx, vy);
+		_MM_TRANSPOSE4_PS(angle, spin, size, creation_time);
+
+		float* o = &out->position[0];
+		_mm_stream_ps(o, px);
+		_mm_stream_ps(o + 4, angle);
+		_mm_stream_ps(o + 8, py);
+		_mm_stream_ps(o + 12, spin);
+		_mm_stream_ps(o + 16, vx);
+		_mm_stream_ps(o + 20, size);
+		_mm_stream_ps(o + 24, vy);
+		_mm_stream_ps(o + 28, creation_time);
+	}
+#endif
+
+	for (; i < end; ++i, ++out)
+	{
+		bool dying = store.position_y[i] < kill_height || store.creation_time[i] < oldest_creation_time;
+		out->position[0]	= store.position_x[i];
+		out->position[1]	= store.position_y[i];
+		out->velocity[0]	= store.velocity_x[i];
+		out->velocity[1]	= store.velocity_y[i];
+		out->angle			= store.angle[i];
+		out->spin			= store.spin[i];
+		out->size			= dying ? 0.0f : store.size[i];
+		out->creation_time	= store.creation_time[i];
+	}
+
+#if WORKSHOP_X86
+	// Streaming stores aren't ordered with other stores, so they have to be done before anyone's told
+	_mm_sfence();
+#endif
+}
+
+int pack_live_particle_instances(const particle_store& store, int first, int count, const cull_rect& visible, particle_data* out)
+{
+	particle_data* out_begin = out;
+	for (int i = first, end = first + count; i < end; ++i)
+	{
+		if (!is_particle_visible(store, i, visible))
+			continue;
+
+		out->position[0]	= store.position_x[i];
+		out->position[1]	= store.position_y[i];
+		out->velocity[0]	= store.velocity_x[i];
+		out->velocity[1]	= store.velocity_y[i];
+		out->angle			= store.angle[i];
+		out->spin			= store.spin[i];
+		out->size			= store.size[i];
+		out->creation_time	= store.creation_time[i];
+		++out;
+	}
+	return int(out - out_begin);
+}
+
+// Convert to a half float, rounding to nearest even. Out-of-range values become infinity.
+static inline uint16_t float_to_half(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	bits &= 0x7fffffff;
+
+	uint32_t half;
+	if (bits >= 0x47800000)
+	{
+		// Too big for a half (or already inf/NaN)
+		half = (bits > 0x7f800000) ? 0x7e00 : 0x7c00;
+	}
+	else if (bits < 0x38800000)
+	{
+		// Too small for a normal half: let float addition do the denormal rounding for us
+		const uint32_t denorm_magic_bits = ((127 - 15) + (23 - 10) + 1) << 23;
+		float denorm_magic;
+		memcpy(&denorm_magic, &denorm_magic_bits, sizeof(denorm_magic));
+		float rounded;
+		memcpy(&rounded, &bits, sizeof(rounded));
+		rounded += denorm_magic;
+		memcpy(&half, &rounded, sizeof(half));
+		half -= denorm_magic_bits;
+	}
+	else
+	{
+		// Rebias the exponent and round the mantissa, ties to even
+		uint32_t mantissa_odd = (bits >> 13) & 1;
+		bits += (uint32_t(15 - 127) << 23) + 0xfff + mantissa_odd;
+		half = bits >> 13;
+	}
+	return uint16_t(half | sign);
+}
+
+static inline int16_t float_to_snorm16(float value)
+{
+	value = (value < -1.0f) ? -1.0f : (value > 1.0f) ? 1.0f : value;
+	return int16_t(lroundf(value * 32767.0f));
+}
+
+static inline uint16_t float_to_unorm16(float value)
+{
+	value = (value < 0.0f) ? 0.0f : (value > 1.0f) ? 1.0f : value;
+	return uint16_t(lroundf(value * 65535.0f));
+}
+
+// The simulation only keeps angles within (-two_pi, two_pi), wrapping them toward zero, so they're
+// wrapped into [0, two_pi) here, which maps onto [-1, 1] for snorm
+static inline int16_t angle_to_snorm16(float angle)
+{
+	static const float two_pi = 6.283185308f;
+	angle -= two_pi * floorf(angle * (1.0f / two_pi));
+	return float_to_snorm16(angle * (2.0f / two_pi) - 1.0f);
+}
+
+int pack_live_particle_instances_compact(const particle_store& store, int first, int count, const cull_rect& visible, float time, packed_particle_data* out)
+{
+	packed_particle_data* out_begin = out;
+	for (int i = first, end = first + count; i < end; ++i)
+	{
+		if (!is_particle_visible(store, i, visible))
+			continue;
+
+		out->position[0]	= float_to_half(store.position_x[i]);
+		out->position[1]	= float_to_half(store.position_y[i]);
+		out->velocity[0]	= float_to_half(store.velocity_x[i]);
+		out->velocity[1]	= float_to_half(store.velocity_y[i]);
+		out->angle			= angle_to_snorm16(store.angle[i]);
+		out->spin			= float_to_snorm16(store.spin[i] * (1.0f / max_packed_spin));
+		out->size			= float_to_unorm16(store.size[i] * (1.0f / max_packed_size));
+		out->age			= float_to_unorm16((time - store.creation_time[i]) * (1.0f / max_packed_age));
+		++out;
+	}
+	return int(out - out_begin);
+}
+
+void pack_indexed_particle_instances(const particle_store& store, const uint32_t* indices, int count, particle_data* out)
+{
+	for (int j = 0; j < count; ++j, ++out)
+	{
+		uint32_t i = indices[j];
+		out->position[0]	= store.position_x[i];
+		out->position[1]	= store.position_y[i];
+		out->velocity[0]	= store.velocity_x[i];
+		out->velocity[1]	= store.velocity_y[i];
+		out->angle			= store.angle[i];
+		out->spin			= store.spin[i];
+		out->size			= store.size[i];
+		out->creation_time	= store.creation_time[i];
+	}
+}
+
+void pack_indexed_particle_instances_compact(const particle_store& store, const uint32_t* indices, int count, float time, packed_particle_data* out)
+{
+	for (int j = 0; j < count; ++j, ++out)
+	{
+		uint32_t i = indices[j];
+		out->position[0]	= float_to_half(store.position_x[i]);
+		out->position[1]	= float_to_half(store.position_y[i]);
+		out->velocity[0]	= float_to_half(store.velocity_x[i]);
+		out->velocity[1]	= float_to_half(store.velocity_y[i]);
+		out->angle			= angle_to_snorm16(store.angle[i]);
+		out->spin			= float_to_snorm16(store.spin[i] * (1.0f / max_packed_spin));
+		out->size			= float_to_unorm16(store.size[i] * (1.0f / max_packed_size));
+		out->age			= float_to_unorm16((time - store.creation_time[i]) * (1.0f / max_packed_age));
+	}
+}
+
+void copy_particle_fields(const particle_store& store, int first, int count, size_t field_stride, float* out)
+{
+	const float* fields[num_particle_fields] =
+	{
+		store.position_x, store.position_y, store.velocity_x, store.velocity_y,
+		store.angle, store.spin, store.size, store.creation_time,
+	};
+	for (int field = 0; field < num_particle_fields; ++field)
+		memcpy(out + field * field_stride, fields[field] + first, size_t(count) * sizeof(float));
+}
+
+void pack_indexed_particle_sprites(const particle_store& store, const uint32_t* indices, int count, uint8_t* out)
+{
+	for (int j = 0; j < count; ++j)
+		out[j] = store.sprite[indices[j]];
+}
+
+void unpack_particle_instances(particle_store* store, int first, int count, const particle_data* in)
+{
+	for (int i = first, end = first + count; i < end; ++i, ++in)
+	{
+		write_particle(store, i, *in);
+	}
+}
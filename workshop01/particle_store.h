@@ -0,0 +1,208 @@
+// Structure-of-arrays storage for the particle system
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Alignment for each per-field array. 64 bytes is a cache line on all the CPUs we care about,
+// and is also enough for the widest SIMD loads we'll do over these arrays.
+static const size_t particle_array_alignment = 64;
+
+// Particles keep their shape in a byte, so that's how many shapes there can be
+static const int max_particle_shapes = 256;
+
+// Definition of the data for a single particle, as laid out in the GPU instance buffer.
+// This is what render_frame() binds as vertex attributes 1-3; it's produced from the
+// particle_store by pack_particle_instances().
+struct particle_data
+{
+	float position[2];		// current position of the particle's center in world space
+	float velocity[2];		// velocity vector
+	float angle;			// current rotation angle
+	float spin;				// how fast it's rotating
+	float size;				// particle size
+	float creation_time;	// when the particle was created
+};
+
+// A compact version of particle_data, for when upload bandwidth and vertex fetch are the limit.
+// render_frame() binds this as attributes 1-4, and vertex_shader.glsl decodes it:
+//  - position and velocity are half floats
+//  - angle is wrapped into [0, two_pi), and then snorm16 over that, and spin is snorm16 over [-max_packed_spin, max_packed_spin]
+//  - size is unorm16 over [0, max_packed_size]
+//  - age is unorm16 over [0, max_packed_age] seconds before the time the instances were packed,
+//    which takes the place of creation_time
+struct packed_particle_data
+{
+	uint16_t	position[2];
+	uint16_t	velocity[2];
+	int16_t		angle;
+	int16_t		spin;
+	uint16_t	size;
+	uint16_t	age;
+};
+
+// Ranges for the quantized fields; these match the constants in vertex_shader.glsl
+static const float max_packed_spin = 8.0f;
+static const float max_packed_size = 2.0f;
+static const float max_packed_age = 8.0f;
+
+// The particles themselves, stored as one contiguous, aligned array per field. The simulation
+// only needs to stream through the fields it actually updates, rather than pulling whole
+// particle_data structs through the cache.
+struct particle_store
+{
+	// Hot fields: read and/or written by every simulation step
+	float*	position_x;
+	float*	position_y;
+	float*	velocity_x;
+	float*	velocity_y;
+	float*	angle;
+	float*	spin;
+
+	// Cold fields: written at spawn time, only read when packing instances for the GPU
+	float*	size;
+	float*	creation_time;
+	uint8_t*	shape;		// which of the shape library's shapes it's drawn as (see particle_shapes.h)
+	uint8_t*	sprite;		// which layer of the sprite array it's textured with (see sprite_array.h)
+
+	int		capacity;		// number of particles each array can hold
+	void*	memory;			// single allocation backing all of the arrays above
+	size_t	mapped_bytes;	// if 'memory' is a view of a file (see map_particle_store()), how big it is; otherwise 0
+	size_t	allocated_bytes;	// otherwise, how many bytes of pages it's at the start of
+
+	// Particles written since the GPU copy was last brought up to date. This is a range in the
+	// ring, so it can wrap around the end of the arrays.
+	int		dirty_first;
+	int		dirty_count;
+
+	// The part of the ring that can contain live particles: everything else has died or was never
+	// spawned. Particles are spawned in order at the end of this window, so the oldest is at the
+	// start, and the window shrinks from there as they die. Dead particles inside it have zero size.
+	int		live_first;
+	int		live_count;
+};
+
+// A linear (non-wrapping) range of particles
+struct particle_range
+{
+	int		first;
+	int		count;
+};
+
+// An axis-aligned rectangle in world space, used for culling particles against the visible area
+struct cull_rect
+{
+	float	min[2];
+	float	max[2];
+};
+
+// Allocate (zero-initialized) storage for the given number of particles, in huge pages where the
+// OS will give them, and first touched across the job system's threads. Returns false on failure.
+bool init_particle_store(particle_store* store, int capacity);
+
+// How big the single allocation behind a store of the given capacity is
+size_t particle_store_bytes(int capacity);
+
+// Where map_particle_store() can map from in a file: a multiple of this many bytes in, which is
+// Windows' allocation granularity, and a whole number of pages everywhere
+static const size_t particle_store_map_alignment = 65536;
+
+// Make a store whose arrays are a file's copy of them, as init_particle_store() lays them out in
+// memory, 'offset' bytes into the file (a multiple of particle_store_map_alignment). It's mapped
+// copy-on-write, so nothing's read until it's touched, and writing to the particles never changes
+// the file. The rest of the store starts out zeroed. Returns false if the file couldn't be mapped.
+bool map_particle_store(particle_store* store, int capacity, const char* filename, size_t offset);
+
+// Change the capacity of the store, keeping the particles that still fit. Slots beyond the old
+// capacity are zero-initialized. Returns false on failure, leaving the store untouched.
+bool resize_particle_store(particle_store* store, int new_capacity);
+
+// Release the storage and reset the store to empty
+void free_particle_store(particle_store* store);
+
+// Write a single particle into the store at the given index
+void write_particle(particle_store* store, int index, const particle_data& particle);
+
+// Note that particles [first, first + count) have changed and need to be sent to the GPU. The range
+// may wrap around. Ranges that continue on from the current dirty range (as spawning into the ring
+// does) just extend it; anything else conservatively marks the whole store dirty.
+void mark_particles_dirty(particle_store* store, int first, int count);
+
+// Get the dirty range as up to two linear ranges, returning how many, and mark the store clean
+int take_dirty_particle_ranges(particle_store* store, particle_range out_ranges[2]);
+
+// Mark the store clean, e.g. after the whole thing has been sent to the GPU
+void clear_dirty_particles(particle_store* store);
+
+// Extend the live window to cover count particles just spawned, ending at end_index (exclusive)
+void spawn_live_particles(particle_store* store, int end_index, int count);
+
+// Make the live window the whole ring, ending at end_index. Use this when we no longer know which
+// particles are alive, e.g. after reading them back from a GPU simulation. Dead ones will be
+// trimmed off again by kill_particles().
+void reset_live_particles(particle_store* store, int end_index);
+
+// Get the live window as up to two linear ranges, returning how many
+int get_live_particle_ranges(const particle_store& store, particle_range out_ranges[2]);
+
+// Kill particles in the live window that are older than max_age or have fallen below kill_height,
+// by setting their size to zero, then shrink the window past the oldest dead ones.
+// Set kill_height to -infinity to only kill by age, when the positions aren't up to date.
+void kill_particles(particle_store* store, float time, float max_age, float kill_height);
+
+// For simulating analytically: the motion of a particle is ballistic, so its state at any time
+// follows from its state when it was created. These convert the live particles between their
+// state at 'time' and their state at creation.
+void rewind_particles_to_creation(particle_store* store, float time, float gravity);
+void advance_particles_from_creation(particle_store* store, float time, float gravity);
+
+// Is particle i alive, and does its bounding circle (of radius size, around the position) overlap
+// the visible rectangle?
+inline bool is_particle_visible(const particle_store& store, int i, const cull_rect& visible)
+{
+	float radius = store.size[i];
+	float x = store.position_x[i];
+	float y = store.position_y[i];
+	return radius != 0.0f &&
+		x + radius >= visible.min[0] && x - radius <= visible.max[0] &&
+		y + radius >= visible.min[1] && y - radius <= visible.max[1];
+}
+
+// Interleave particles [first, first + count) into the GPU instance layout. The output can be
+// a mapped GPU buffer; it's only ever written to, never read.
+void pack_particle_instances(const particle_store& store, int first, int count, particle_data* out);
+
+// Like pack_particle_instances(), but for a GPU buffer the CPU's never going to look at again. The
+// instances go out with non-temporal stores where there are any, so they don't push the particles
+// out of the cache, and 'out' has to be 16-byte aligned. Particles that kill_particles() is about
+// to kill, with the same 'time - max_age' and kill_height, are written as dead.
+void stream_particle_instances(const particle_store& store, int first, int count, float oldest_creation_time, float kill_height, particle_data* out);
+
+// Like pack_particle_instances(), but skip dead particles, and ones that can't be seen because
+// their bounding circle is entirely outside 'visible'. Returns how many were written.
+int pack_live_particle_instances(const particle_store& store, int first, int count, const cull_rect& visible, particle_data* out);
+
+// Like pack_live_particle_instances(), but writing the compact format. Ages are measured from 'time'.
+int pack_live_particle_instances_compact(const particle_store& store, int first, int count, const cull_rect& visible, float time, packed_particle_data* out);
+
+// Interleave the particles at the given indices, in that order, into the GPU instance layout
+void pack_indexed_particle_instances(const particle_store& store, const uint32_t* indices, int count, particle_data* out);
+
+// Like pack_indexed_particle_instances(), but writing the compact format. Ages are measured from 'time'.
+void pack_indexed_particle_instances_compact(const particle_store& store, const uint32_t* indices, int count, float time, packed_particle_data* out);
+
+// How many fields each particle has, as separate arrays in the store or interleaved in particle_data
+static const int num_particle_fields = 8;
+
+// Copy particles [first, first + count) out as they are, without interleaving them: each field's
+// values go to out + field * field_stride, with the fields in the order they're in particle_data.
+// This is the layout vertex_shader.glsl reads when it fetches the instances itself.
+void copy_particle_fields(const particle_store& store, int first, int count, size_t field_stride, float* out);
+
+// Write out the sprites of the particles at the given indices, a byte each, in the same order as
+// pack_indexed_particle_instances() writes the instances. They go up alongside them as another
+// per-instance vertex attribute, since there's no room for them in particle_data.
+void pack_indexed_particle_sprites(const particle_store& store, const uint32_t* indices, int count, uint8_t* out);
+
+// The reverse: split interleaved instances back out into particles [first, first + count) of the store
+void unpack_particle_instances(particle_store* store, int first, int count, const particle_data* in);
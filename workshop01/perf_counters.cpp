@@ -0,0 +1,287 @@
+// Performance counters: named counts bumped cheaply from any thread, totted up once a frame, and exported as CSV or shared memory
+
+#include "perf_counters.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+// The registry. Counters are only ever added, so the names and kinds of the first num_counters
+// never change once they're there.
+static std::mutex						registry_lock;
+static char								counter_names[max_perf_counters][max_perf_counter_name];
+static perf_counter_kind				counter_kinds[max_perf_counters];
+static std::atomic<int>					num_counters(0);
+static std::atomic<int64_t>				counter_levels[max_perf_counters];
+
+// One thread's running totals. Only the owning thread writes to it; end_perf_counter_frame() reads
+// them all. The padding keeps the next block's counters off this one's last cache line.
+struct perf_counter_block
+{
+	std::atomic<int64_t>	totals[max_perf_counters];
+	bool					in_use;			// owned by a running thread (under blocks_lock)
+	char					padding[64];
+};
+
+// Every block ever made. A thread that exits hands its block on to the next one that starts, so
+// the totals carry on, and there are never more blocks than threads running at once.
+static std::mutex										blocks_lock;
+static std::vector<std::unique_ptr<perf_counter_block>>	blocks;
+
+struct perf_counter_thread
+{
+	perf_counter_block*	block = nullptr;
+
+	~perf_counter_thread()
+	{
+		if (block)
+		{
+			std::lock_guard<std::mutex> guard(blocks_lock);
+			block->in_use = false;
+		}
+	}
+};
+
+static thread_local perf_counter_thread this_thread_counters;
+
+// Only touched by the thread that ends the frames
+static int64_t							frame_values[max_perf_counters];
+static int64_t							previous_totals[max_perf_counters];
+static uint64_t							frames_ended = 0;
+static FILE*							csv_file = nullptr;
+static int								csv_columns = -1;		// how many counters the header row has; -1 until it's written
+static perf_counter_shared_block*		shared_block = nullptr;
+static int								shared_names_written = 0;
+
+#if defined(_WIN32)
+static HANDLE							shared_mapping = nullptr;
+#else
+static std::string						shared_name;
+#endif
+
+int register_perf_counter(const char* name, perf_counter_kind kind)
+{
+	std::lock_guard<std::mutex> guard(registry_lock);
+	int count = num_counters.load(std::memory_order_relaxed);
+	for (int i = 0; i < count; ++i)
+	{
+		if (strncmp(counter_names[i], name, max_perf_counter_name - 1) == 0)
+			return i;
+	}
+	if (count == max_perf_counters)
+	{
+		printf("Warning: too many performance counters, so there's no %s!\n", name);
+		return -1;
+	}
+
+	snprintf(counter_names[count], max_perf_counter_name, "%s", name);
+	counter_kinds[count] = kind;
+	counter_levels[count].store(0, std::memory_order_relaxed);
+	num_counters.store(count + 1, std::memory_order_release);
+	return count;
+}
+
+static perf_counter_block* get_thread_block()
+{
+	perf_counter_thread& thread = this_thread_counters;
+	if (thread.block)
+		return thread.block;
+
+	std::lock_guard<std::mutex> guard(blocks_lock);
+	for (const std::unique_ptr<perf_counter_block>& block : blocks)
+	{
+		if (!block->in_use)
+		{
+			thread.block = block.get();
+			break;
+		}
+	}
+	if (!thread.block)
+	{
+		blocks.emplace_back(new perf_counter_block);
+		thread.block = blocks.back().get();
+		for (std::atomic<int64_t>& total : thread.block->totals)
+			total.store(0, std::memory_order_relaxed);
+	}
+	thread.block->in_use = true;
+	return thread.block;
+}
+
+void add_perf_counter(int counter, int64_t amount)
+{
+	if (counter < 0)
+		return;
+
+	// Nothing else writes this thread's totals, so there's no need for a fetch_add
+	std::atomic<int64_t>& total = get_thread_block()->totals[counter];
+	total.store(total.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void set_perf_counter(int counter, int64_t value)
+{
+	if (counter >= 0)
+		counter_levels[counter].store(value, std::memory_order_relaxed);
+}
+
+int64_t get_perf_counter(int counter)
+{
+	return (counter >= 0) ? frame_values[counter] : 0;
+}
+
+static void write_csv_row(int count)
+{
+	if (csv_columns < 0)
+	{
+		csv_columns = count;
+		fprintf(csv_file, "frame");
+		for (int i = 0; i < csv_columns; ++i)
+			fprintf(csv_file, ",%s", counter_names[i]);
+		fprintf(csv_file, "\n");
+	}
+
+	fprintf(csv_file, "%llu", (unsigned long long)frames_ended);
+	for (int i = 0; i < csv_columns; ++i)
+		fprintf(csv_file, ",%lld", (long long)frame_values[i]);
+	fprintf(csv_file, "\n");
+}
+
+static void write_shared_block(int count)
+{
+	// Odd while it's being written, so readers know to try again
+	uint64_t sequence = shared_block->sequence.load(std::memory_order_relaxed);
+	shared_block->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for (; shared_names_written < count; ++shared_names_written)
+	{
+		memcpy(shared_block->names[shared_names_written], counter_names[shared_names_written], max_perf_counter_name);
+		shared_block->kinds[shared_names_written] = uint8_t(counter_kinds[shared_names_written]);
+	}
+	shared_block->num_counters = uint32_t(count);
+	shared_block->frame = frames_ended;
+	memcpy(shared_block->values, frame_values, sizeof(int64_t) * size_t(count));
+
+	shared_block->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void end_perf_counter_frame()
+{
+	int count = num_counters.load(std::memory_order_acquire);
+	int64_t totals[max_perf_counters] = {};
+	{
+		std::lock_guard<std::mutex> guard(blocks_lock);
+		for (const std::unique_ptr<perf_counter_block>& block : blocks)
+		{
+			for (int i = 0; i < count; ++i)
+				totals[i] += block->totals[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		switch (counter_kinds[i])
+		{
+		case perf_counter_per_frame:
+			frame_values[i] = totals[i] - previous_totals[i];
+			previous_totals[i] = totals[i];
+			break;
+		case perf_counter_running:
+			frame_values[i] = totals[i];
+			break;
+		case perf_counter_level:
+			frame_values[i] = counter_levels[i].load(std::memory_order_relaxed);
+			break;
+		}
+	}
+	++frames_ended;
+
+	if (csv_file)
+		write_csv_row(count);
+	if (shared_block)
+		write_shared_block(count);
+}
+
+bool open_perf_counter_csv(const char* filename)
+{
+	if (csv_file)
+		fclose(csv_file);
+	csv_file = fopen(filename, "w");
+	csv_columns = -1;
+	return csv_file != nullptr;
+}
+
+bool open_perf_counter_shared_memory(const char* name)
+{
+	if (shared_block)
+		return false;
+
+	void* memory = nullptr;
+#if defined(_WIN32)
+	shared_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, DWORD(sizeof(perf_counter_shared_block)), name);
+	if (!shared_mapping)
+		return false;
+	memory = MapViewOfFile(shared_mapping, FILE_MAP_WRITE, 0, 0, sizeof(perf_counter_shared_block));
+	if (!memory)
+	{
+		CloseHandle(shared_mapping);
+		shared_mapping = nullptr;
+		return false;
+	}
+#else
+	// POSIX wants the name to start with a slash, and have no others
+	shared_name = std::string("/") + name;
+	int fd = shm_open(shared_name.c_str(), O_CREAT | O_RDWR, 0644);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, off_t(sizeof(perf_counter_shared_block))) == 0)
+		memory = mmap(nullptr, sizeof(perf_counter_shared_block), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (!memory || memory == MAP_FAILED)
+	{
+		shm_unlink(shared_name.c_str());
+		return false;
+	}
+#endif
+
+	// A segment left behind by a run that crashed may still have its old contents
+	memset(memory, 0, sizeof(perf_counter_shared_block));
+	shared_block = (perf_counter_shared_block*)memory;
+	shared_block->magic = perf_counter_shared_magic;
+	shared_block->version = perf_counter_shared_version;
+	shared_names_written = 0;
+	return true;
+}
+
+void close_perf_counter_exports()
+{
+	if (csv_file)
+	{
+		fclose(csv_file);
+		csv_file = nullptr;
+	}
+	if (shared_block)
+	{
+#if defined(_WIN32)
+		UnmapViewOfFile(shared_block);
+		CloseHandle(shared_mapping);
+		shared_mapping = nullptr;
+#else
+		munmap(shared_block, sizeof(perf_counter_shared_block));
+		shm_unlink(shared_name.c_str());
+#endif
+		shared_block = nullptr;
+	}
+}
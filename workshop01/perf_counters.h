@@ -0,0 +1,69 @@
+// Performance counters: named counts bumped cheaply from any thread, totted up once a frame, and exported as CSV or shared memory
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+static const int max_perf_counters = 64;
+static const int max_perf_counter_name = 48;		// including the terminator
+
+// How a counter's value for a frame comes from what's added to it
+enum perf_counter_kind
+{
+	perf_counter_per_frame,		// what was added during the frame, like draw calls
+	perf_counter_running,		// everything ever added, so adding and taking away keeps track of an amount, like bytes resident
+	perf_counter_level,			// the last value set, like how many particles are alive
+};
+
+// Add a counter, returning its index for the functions below, or -1 if there are already
+// max_perf_counters of them. Asking for one with the same name again returns the same index, so
+// modules can register theirs in their init functions. Register them all before the first frame
+// ends, as the CSV only has columns for the ones there were then.
+int register_perf_counter(const char* name, perf_counter_kind kind);
+
+// Add to a per frame or running counter, from any thread. Each thread adds to a block of counters
+// of its own, so it's a relaxed load and store, with no locked instructions and no sharing of
+// cache lines. Negative counters (ones that failed to register) are ignored.
+void add_perf_counter(int counter, int64_t amount);
+
+// Set a level counter, from any thread
+void set_perf_counter(int counter, int64_t value);
+
+// Work out every counter's value for the frame that's just ended, and write them out to whatever
+// export's open. Call once a frame, on one thread.
+void end_perf_counter_frame();
+
+// A counter's value for the last frame that ended
+int64_t get_perf_counter(int counter);
+
+// Write a row of every counter's values to a CSV file at the end of each frame, after a header
+// row of their names. Returns false if the file couldn't be opened.
+bool open_perf_counter_csv(const char* filename);
+
+// Publish the counters in a named shared memory segment, laid out as a perf_counter_shared_block,
+// so a monitoring agent can map it and read them while the process runs. On Windows it's a named
+// file mapping; elsewhere it's POSIX shared memory, /dev/shm/<name> on Linux. It's removed again
+// by close_perf_counter_exports(). Returns false if it couldn't be made.
+bool open_perf_counter_shared_memory(const char* name);
+
+// Close the CSV file and shared memory, if they're open
+void close_perf_counter_exports();
+
+static const uint32_t perf_counter_shared_magic = 0x52464550;		// "PEFR", little endian
+static const uint32_t perf_counter_shared_version = 1;
+
+// What the shared memory holds. Readers should map it read only, and copy it out like a seqlock:
+// read 'sequence', copy what they want, then read 'sequence' again, and start over if it was odd
+// (a frame was being written) or has changed. The names only change when a counter's added.
+struct perf_counter_shared_block
+{
+	uint32_t				magic;				// perf_counter_shared_magic
+	uint32_t				version;			// perf_counter_shared_version
+	uint32_t				num_counters;
+	uint32_t				unused;
+	std::atomic<uint64_t>	sequence;
+	uint64_t				frame;				// how many frames have ended
+	char					names[max_perf_counters][max_perf_counter_name];
+	uint8_t					kinds[max_perf_counters];		// perf_counter_kinds
+	int64_t					values[max_perf_counters];
+};
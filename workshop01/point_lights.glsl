@@ -0,0 +1,42 @@
+// The clustered point lights (see light_clusters.h), for the passes that shade particles and the
+// ball. Each point only loops over the lights in its own cell of the grid, so however many lights
+// there are, it's only the handful nearby that cost anything.
+
+uniform bool use_point_lights;
+uniform samplerBuffer point_lights;			// two texels each: position and radius, then color
+uniform usamplerBuffer light_cells;			// two texels each: where the cell's list starts, and how long it is
+uniform usamplerBuffer light_indices;		// the lists, of indices into point_lights
+uniform vec2 light_grid_origin;				// the grid's bottom left corner, in world space
+uniform float light_grid_scale;				// cells per world unit
+uniform ivec2 light_grid_size;				// cells across and up
+
+// The light falling on a point with the given normal from every light that reaches it, in linear
+// color, to be multiplied by what color the surface is
+vec3 point_lighting(vec3 position, vec3 normal)
+{
+	ivec2 cell = ivec2(floor((position.xy - light_grid_origin) * light_grid_scale));
+	if (!use_point_lights || any(lessThan(cell, ivec2(0))) || any(greaterThanEqual(cell, light_grid_size)))
+		return vec3(0.0);
+
+	int cell_index = cell.y * light_grid_size.x + cell.x;
+	int first = int(texelFetch(light_cells, 2 * cell_index).r);
+	int count = int(texelFetch(light_cells, 2 * cell_index + 1).r);
+	vec3 lighting = vec3(0.0);
+	for (int i = 0; i < count; ++i)
+	{
+		int light = int(texelFetch(light_indices, first + i).r);
+		vec4 position_radius = texelFetch(point_lights, 2 * light);
+		vec3 to_light = position_radius.xyz - position;
+		float distance_squared = dot(to_light, to_light);
+		float radius_squared = position_radius.w * position_radius.w;
+		if (distance_squared >= radius_squared)
+			continue;
+
+		// Smoothly down to nothing at the radius, and brighter at the center
+		float falloff = 1.0 - distance_squared / radius_squared;
+		falloff *= falloff;
+		float facing = max(dot(normal, to_light * inversesqrt(max(distance_squared, 1e-8))), 0.0);
+		lighting += texelFetch(point_lights, 2 * light + 1).rgb * falloff * facing;
+	}
+	return lighting;
+}
@@ -0,0 +1,161 @@
+// Program binary cache: saves linked programs to disk, so later runs can skip compiling and linking them
+
+#include "program_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#	include <direct.h>
+#endif
+
+// Bump this if the file layout changes, so old files just miss
+static const uint32_t program_cache_version = 1;
+static const char program_cache_magic[4] = { 'P', 'B', 'I', 'N' };
+
+// What goes ahead of the binary in each file
+struct program_cache_header
+{
+	char		magic[4];
+	uint32_t	version;
+	uint32_t	format;			// the GLenum glGetProgramBinary() gave us
+	uint32_t	length;			// of the binary, in bytes
+	uint64_t	hash;			// the key again, to catch file name collisions
+};
+
+static std::string gl_string(GLenum name)
+{
+	const char* text = (const char*)glGetString(name);
+	return text ? text : "";
+}
+
+static std::string cache_filename(const program_cache& cache, program_cache_key key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key.hash);
+	return cache.directory + "/" + name;
+}
+
+bool init_program_cache(program_cache* cache, const char* directory)
+{
+	cache->enabled = false;
+	cache->directory = directory;
+	cache->driver = gl_string(GL_VENDOR) + "\n" + gl_string(GL_RENDERER) + "\n" + gl_string(GL_VERSION);
+
+	// Program binaries are core in GL 4.1, but drivers are allowed to support no formats at all
+	GLint num_formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+	if (num_formats <= 0)
+		return false;
+
+	// It's fine if it's already there
+#ifdef _WIN32
+	_mkdir(directory);
+#else
+	mkdir(directory, 0755);
+#endif
+	struct stat directory_stat = {};
+	if (stat(directory, &directory_stat) != 0 || !(directory_stat.st_mode & S_IFDIR))
+		return false;
+
+	cache->enabled = true;
+	return true;
+}
+
+program_cache_key begin_program_cache_key(const program_cache& cache)
+{
+	program_cache_key key = { 14695981039346656037ull };
+	add_to_program_cache_key(&key, &program_cache_version, sizeof(program_cache_version));
+	add_to_program_cache_key(&key, cache.driver);
+	return key;
+}
+
+void add_to_program_cache_key(program_cache_key* key, const void* data, size_t size)
+{
+	// 64-bit FNV-1a: not fast, but this only sees a few kilobytes of shader source
+	const unsigned char* bytes = (const unsigned char*)data;
+	uint64_t hash = key->hash;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	key->hash = hash;
+}
+
+GLuint load_cached_program(const program_cache& cache, program_cache_key key)
+{
+	if (!cache.enabled)
+		return 0;
+
+	FILE* file = fopen(cache_filename(cache, key).c_str(), "rb");
+	if (!file)
+		return 0;
+
+	program_cache_header header = {};
+	std::vector<char> binary;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+		memcmp(header.magic, program_cache_magic, sizeof(header.magic)) == 0 &&
+		header.version == program_cache_version && header.hash == key.hash && header.length > 0;
+	if (ok)
+	{
+		binary.resize(header.length);
+		ok = fread(binary.data(), header.length, 1, file) == 1;
+	}
+	fclose(file);
+	if (!ok)
+		return 0;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, GLenum(header.format), binary.data(), GLsizei(header.length));
+
+	// The driver tells us it's rejected a binary by failing the link
+	int linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+void save_cached_program(const program_cache& cache, program_cache_key key, GLuint program)
+{
+	if (!cache.enabled)
+		return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> binary(size_t(length), 0);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+	if (length <= 0)
+		return;
+
+	program_cache_header header = {};
+	memcpy(header.magic, program_cache_magic, sizeof(header.magic));
+	header.version = program_cache_version;
+	header.format = format;
+	header.length = uint32_t(length);
+	header.hash = key.hash;
+
+	// Write to a temporary file and rename it into place, so if we crash, or there are two of
+	// us running, nobody ever reads half a binary
+	std::string filename = cache_filename(cache, key);
+	std::string temp_filename = filename + ".tmp";
+	FILE* file = fopen(temp_filename.c_str(), "wb");
+	if (!file)
+		return;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), size_t(length), 1, file) == 1;
+	ok = (fclose(file) == 0) && ok;
+#ifdef _WIN32
+	// Windows won't rename over an existing file
+	remove(filename.c_str());
+#endif
+	if (!ok || rename(temp_filename.c_str(), filename.c_str()) != 0)
+		remove(temp_filename.c_str());
+}
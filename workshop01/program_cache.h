@@ -0,0 +1,53 @@
+// Program binary cache: saves linked programs to disk, so later runs can skip compiling and linking them
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <glad/glad.h>
+
+struct program_cache
+{
+	bool			enabled;		// false if the driver has no binary formats, or the directory can't be made
+	std::string		directory;
+	std::string		driver;			// vendor, renderer and version: binaries only load on the driver that made them
+};
+
+// Call once the GL functions are loaded. Makes the directory if need be.
+bool init_program_cache(program_cache* cache, const char* directory);
+
+// Builds up the key a program is cached under, from everything that goes into linking it: the
+// source of each stage, and anything else, such as transform feedback varyings, that changes
+// the result. The driver is part of every key.
+struct program_cache_key
+{
+	uint64_t		hash;
+};
+
+program_cache_key begin_program_cache_key(const program_cache& cache);
+void add_to_program_cache_key(program_cache_key* key, const void* data, size_t size);
+inline void add_to_program_cache_key(program_cache_key* key, const char* text, size_t size)
+{
+	// Include the length, so two strings can't run together into the same bytes as two others
+	uint64_t length = size;
+	add_to_program_cache_key(key, &length, sizeof(length));
+	add_to_program_cache_key(key, (const void*)text, size);
+}
+inline void add_to_program_cache_key(program_cache_key* key, const std::string& text)
+{
+	add_to_program_cache_key(key, text.data(), text.size());
+}
+inline void add_to_program_cache_key(program_cache_key* key, const char* text)
+{
+	add_to_program_cache_key(key, text, strlen(text));
+}
+
+// Make a program from the binary cached under 'key', returning 0 if there isn't one, or the
+// driver won't take it (drivers may reject their old binaries after an update, for instance).
+// The program is linked, but its uniform block bindings and so on will need setting up.
+GLuint load_cached_program(const program_cache& cache, program_cache_key key);
+
+// Save a freshly linked program's binary under 'key'. Link it with
+// GL_PROGRAM_BINARY_RETRIEVABLE_HINT set, or the driver may not keep a binary to give us.
+void save_cached_program(const program_cache& cache, program_cache_key key, GLuint program);
@@ -0,0 +1,27 @@
+// How the raytracer lights what it hits, shared by the passes that trace and the one that only shades
+
+// Gamma correction for proper linear lighting
+vec3 gamma_correct(vec3 linear_color)
+{
+    return vec3(pow(linear_color.x, 1.0f / 2.2f),
+                pow(linear_color.y, 1.0f / 2.2f),
+                pow(linear_color.z, 1.0f / 2.2f));
+}
+
+// The particles are the same golden yellow as when they're rasterized, in linear color
+vec3 particle_base_color()
+{
+    return pow(vec3(1.0f, 0.79f, 0.03f), vec3(2.2f));
+}
+
+// Simple light calculation, with a little ambient so the unlit sides aren't black, in linear color
+vec3 shade_particle (in vec3 normal, in vec3 to_light, in float light_visibility)
+{
+    return (max(dot(normal, to_light), 0.0) * light_visibility * 0.8f + 0.2f) * particle_base_color();
+}
+
+// The same sky blue background as the rasterized scene, in linear color
+vec3 sky_color()
+{
+    return pow(vec3(0.0f, 0.6f, 1.0f), vec3(2.2f));
+}
@@ -0,0 +1,372 @@
+// Render graph: each pass says what it reads and writes, and the graph runs only the passes that matter, gives transient targets textures that can be shared, and puts in the barriers
+
+#include "render_graph.h"
+#include "cpu_profiler.h"
+#include "gl_debug.h"
+#include "gpu_memory.h"
+#include "perf_counters.h"
+
+#include <algorithm>
+
+// The barriers that make storage writes visible to each way of using them afterwards
+static GLbitfield get_access_barriers(uint32_t access)
+{
+	GLbitfield barriers = 0;
+	if (access & render_access_render_target)
+		barriers |= GL_FRAMEBUFFER_BARRIER_BIT;
+	if (access & render_access_texture)
+		barriers |= GL_TEXTURE_FETCH_BARRIER_BIT;
+	if (access & render_access_storage)
+		barriers |= GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT;
+	if (access & render_access_vertex)
+		barriers |= GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT;
+	if (access & render_access_indirect)
+		barriers |= GL_COMMAND_BARRIER_BIT;
+	if (access & render_access_uniform)
+		barriers |= GL_UNIFORM_BARRIER_BIT;
+	return barriers;
+}
+
+// What glTexImage2D() wants to go with the formats transient textures come in
+static void get_pixel_format(GLenum internal_format, GLenum* o_format, GLenum* o_type)
+{
+	*o_format = GL_RGBA;
+	switch (internal_format)
+	{
+	case GL_R16F:		*o_format = GL_RED; *o_type = GL_HALF_FLOAT; break;
+	case GL_RGBA16F:	*o_type = GL_HALF_FLOAT; break;
+	case GL_RGBA32F:	*o_type = GL_FLOAT; break;
+	default:			*o_type = GL_UNSIGNED_BYTE; break;
+	}
+}
+
+static void free_render_texture(render_texture* texture)
+{
+	set_gpu_memory(gpu_memory_texture, texture->texture, 0);
+	glDeleteFramebuffers(1, &texture->framebuffer);
+	glDeleteTextures(1, &texture->texture);
+}
+
+void init_render_graph(render_graph* graph)
+{
+	graph->frame = 0;
+	graph->passes_culled_counter = register_perf_counter("render passes culled", perf_counter_level);
+	graph->transient_textures_counter = register_perf_counter("transient textures", perf_counter_level);
+}
+
+void free_render_graph(render_graph* graph)
+{
+	for (render_texture& texture : graph->textures)
+		free_render_texture(&texture);
+	graph->textures.clear();
+	graph->renderable_formats.clear();
+}
+
+void begin_render_graph(render_graph* graph)
+{
+	// Clearing them keeps their memory, so a frame's graph doesn't go to the heap
+	graph->resources.clear();
+	graph->passes.clear();
+	graph->uses.clear();
+	++graph->frame;
+}
+
+int add_render_resource(render_graph* graph, const char* name, uint32_t flags)
+{
+	render_resource resource = {};
+	resource.name = name;
+	resource.flags = flags;
+	resource.texture = -1;
+	resource.first_use = -1;
+	resource.last_use = -1;
+	graph->resources.push_back(resource);
+	return int(graph->resources.size()) - 1;
+}
+
+int add_render_texture(render_graph* graph, const char* name, int width, int height, GLenum format)
+{
+	int index = add_render_resource(graph, name, 0);
+	render_resource& resource = graph->resources[index];
+	resource.transient = true;
+	resource.width = width;
+	resource.height = height;
+	resource.format = format;
+	return index;
+}
+
+int add_render_pass(render_graph* graph, const char* name, render_pass_function function, void* data)
+{
+	render_pass pass = {};
+	pass.name = name;
+	pass.function = function;
+	pass.data = data;
+	graph->passes.push_back(pass);
+	return int(graph->passes.size()) - 1;
+}
+
+void render_pass_reads(render_graph* graph, int pass, int resource, uint32_t access)
+{
+	graph->uses.push_back(render_resource_use{ pass, resource, access, false });
+}
+
+void render_pass_writes(render_graph* graph, int pass, int resource, uint32_t access)
+{
+	graph->uses.push_back(render_resource_use{ pass, resource, access, true });
+	if (access & render_access_upload)
+		graph->passes[pass].upload = true;
+}
+
+// Working back from the last pass, a pass has to run if it writes an output, or something a
+// later pass that has to run reads
+static void cull_render_passes(render_graph* graph)
+{
+	for (render_resource& resource : graph->resources)
+		resource.needed = (resource.flags & render_resource_output) != 0;
+
+	int culled = 0;
+	for (int pass = int(graph->passes.size()) - 1; pass >= 0; --pass)
+	{
+		bool live = false;
+		for (const render_resource_use& use : graph->uses)
+			live = live || (use.pass == pass && use.write && graph->resources[use.resource].needed);
+		graph->passes[pass].live = live;
+		if (!live)
+		{
+			++culled;
+			continue;
+		}
+		for (const render_resource_use& use : graph->uses)
+		{
+			if (use.pass == pass && !use.write)
+				graph->resources[use.resource].needed = true;
+		}
+	}
+	set_perf_counter(graph->passes_culled_counter, culled);
+
+	for (const render_resource_use& use : graph->uses)
+	{
+		if (!graph->passes[use.pass].live)
+			continue;
+		render_resource& resource = graph->resources[use.resource];
+		if (resource.first_use < 0 || use.pass < resource.first_use)
+			resource.first_use = use.pass;
+		resource.last_use = std::max(resource.last_use, use.pass);
+	}
+}
+
+static int make_render_texture(render_graph* graph, const render_resource& resource)
+{
+	render_texture texture = {};
+	texture.width = resource.width;
+	texture.height = resource.height;
+	texture.format = resource.format;
+
+	GLenum format, type;
+	get_pixel_format(resource.format, &format, &type);
+	glGenTextures(1, &texture.texture);
+	glBindTexture(GL_TEXTURE_2D, texture.texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, resource.format, resource.width, resource.height, 0, format, type, nullptr);
+	label_gl_object(GL_TEXTURE, texture.texture, resource.name);
+	set_gpu_memory(gpu_memory_texture, texture.texture, gpu_texture_bytes(resource.format, resource.width, resource.height, 1, false));
+
+	glGenFramebuffers(1, &texture.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, texture.framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.texture, 0);
+	label_gl_object(GL_FRAMEBUFFER, texture.framebuffer, resource.name);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	graph->textures.push_back(texture);
+	return int(graph->textures.size()) - 1;
+}
+
+// Free a texture, moving the last one into its place
+static void remove_render_texture(render_graph* graph, size_t index)
+{
+	free_render_texture(&graph->textures[index]);
+	graph->textures[index] = graph->textures.back();
+	graph->textures.pop_back();
+
+	// Keep the resources pointing at the right ones
+	for (render_resource& resource : graph->resources)
+	{
+		if (resource.texture == int(graph->textures.size()))
+			resource.texture = int(index);
+	}
+}
+
+// Give each transient resource in use a texture, in the order they're first used. One whose
+// last pass is before another's first can share its texture, as long as it's the same size and
+// format, so targets that are never needed at the same time only take up memory once.
+static void find_render_textures(render_graph* graph)
+{
+	for (render_texture& texture : graph->textures)
+		texture.busy_until = -1;
+
+	for (int pass = 0; pass < int(graph->passes.size()); ++pass)
+	{
+		for (render_resource& resource : graph->resources)
+		{
+			if (!resource.transient || resource.first_use != pass)
+				continue;
+			for (int i = 0; i < int(graph->textures.size()) && resource.texture < 0; ++i)
+			{
+				const render_texture& texture = graph->textures[i];
+				if (texture.busy_until < pass && texture.width == resource.width && texture.height == resource.height && texture.format == resource.format)
+					resource.texture = i;
+			}
+			if (resource.texture < 0)
+				resource.texture = make_render_texture(graph, resource);
+			graph->textures[resource.texture].busy_until = resource.last_use;
+			graph->textures[resource.texture].last_used = graph->frame;
+		}
+	}
+
+	// Let go of any the frames have stopped asking for, such as when the window's changed size,
+	// or the scene no longer has the passes that used them
+	for (size_t i = 0; i < graph->textures.size();)
+	{
+		if (graph->frame - graph->textures[i].last_used > uint64_t(render_texture_idle_frames))
+			remove_render_texture(graph, i);
+		else
+			++i;
+	}
+	set_perf_counter(graph->transient_textures_counter, int64_t(graph->textures.size()));
+}
+
+// Before each live pass, whatever barriers the storage writes it follows are still owed, for the
+// ways it uses them
+static void place_render_barriers(render_graph* graph)
+{
+	for (render_resource& resource : graph->resources)
+		resource.unsynced = 0;
+
+	GLbitfield all_barriers = get_access_barriers(~0u);
+	for (int pass = 0; pass < int(graph->passes.size()); ++pass)
+	{
+		render_pass& current = graph->passes[pass];
+		current.barrier = 0;
+		if (!current.live || current.upload)
+			continue;
+		for (const render_resource_use& use : graph->uses)
+		{
+			if (use.pass == pass)
+				current.barrier |= get_access_barriers(use.access) & graph->resources[use.resource].unsynced;
+		}
+		for (const render_resource_use& use : graph->uses)
+		{
+			if (use.pass != pass)
+				continue;
+			render_resource& resource = graph->resources[use.resource];
+			resource.unsynced &= ~current.barrier;
+			if (use.write && (use.access & render_access_storage))
+				resource.unsynced = all_barriers;
+		}
+	}
+}
+
+static void run_render_pass(const render_pass& pass)
+{
+	CPU_PROFILE_SCOPE(pass.name);
+	if (pass.barrier)
+		glMemoryBarrier(pass.barrier);
+	pass.function(pass.data);
+}
+
+void run_render_graph(render_graph* graph, upload_ring* uploads)
+{
+	cull_render_passes(graph);
+	find_render_textures(graph);
+	place_render_barriers(graph);
+
+	// The GPU's done with this frame's uploads after the last pass that uses any of them
+	int last_upload_use = -1;
+	for (const render_resource_use& use : graph->uses)
+	{
+		if (graph->passes[use.pass].live && !graph->passes[use.pass].upload && (graph->resources[use.resource].flags & render_resource_in_upload_ring))
+			last_upload_use = std::max(last_upload_use, use.pass);
+	}
+
+	for (const render_pass& pass : graph->passes)
+	{
+		if (pass.live && pass.upload)
+			run_render_pass(pass);
+	}
+	end_upload_frame(uploads);
+	if (last_upload_use < 0)
+		fence_upload_frame(uploads);
+
+	for (int i = 0; i < int(graph->passes.size()); ++i)
+	{
+		const render_pass& pass = graph->passes[i];
+		if (!pass.live || pass.upload)
+			continue;
+		run_render_pass(pass);
+		if (i == last_upload_use)
+			fence_upload_frame(uploads);
+	}
+}
+
+int64_t trim_render_textures(render_graph* graph, int64_t bytes)
+{
+	int64_t freed = 0;
+	while (freed < bytes)
+	{
+		// The one that's gone unused longest, if any
+		size_t oldest = graph->textures.size();
+		for (size_t i = 0; i < graph->textures.size(); ++i)
+		{
+			const render_texture& texture = graph->textures[i];
+			if (texture.last_used < graph->frame && (oldest == graph->textures.size() || texture.last_used < graph->textures[oldest].last_used))
+				oldest = i;
+		}
+		if (oldest == graph->textures.size())
+			break;
+		const render_texture& texture = graph->textures[oldest];
+		freed += gpu_texture_bytes(texture.format, texture.width, texture.height, 1, false);
+		remove_render_texture(graph, oldest);
+	}
+	set_perf_counter(graph->transient_textures_counter, int64_t(graph->textures.size()));
+	return freed;
+}
+
+GLuint get_render_texture(const render_graph& graph, int resource)
+{
+	int texture = graph.resources[resource].texture;
+	return (texture >= 0) ? graph.textures[texture].texture : 0;
+}
+
+GLuint get_render_framebuffer(const render_graph& graph, int resource)
+{
+	int texture = graph.resources[resource].texture;
+	return (texture >= 0) ? graph.textures[texture].framebuffer : 0;
+}
+
+bool render_format_renderable(render_graph* graph, GLenum format)
+{
+	for (const std::pair<GLenum, bool>& renderable : graph->renderable_formats)
+	{
+		if (renderable.first == format)
+			return renderable.second;
+	}
+
+	// Try a small one
+	render_resource probe = {};
+	probe.name = "format probe";
+	probe.width = 16;
+	probe.height = 16;
+	probe.format = format;
+	int index = make_render_texture(graph, probe);
+	glBindFramebuffer(GL_FRAMEBUFFER, graph->textures[index].framebuffer);
+	bool complete = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	free_render_texture(&graph->textures[index]);
+	graph->textures.pop_back();
+
+	graph->renderable_formats.push_back(std::make_pair(format, complete));
+	return complete;
+}
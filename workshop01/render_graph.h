@@ -0,0 +1,131 @@
+// Render graph: each pass says what it reads and writes, and the graph runs only the passes that matter, gives transient targets textures that can be shared, and puts in the barriers
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "upload_ring.h"
+
+// How a pass uses a resource; a pass can use one in several ways at once. Something written by
+// a shader's storage stores has to be fenced off with a barrier before it's used again, which the
+// graph does for exactly the ways the next passes use it. Render targets and uploads need none.
+enum render_access
+{
+	render_access_render_target	= 1 << 0,	// drawn into, or cleared
+	render_access_texture		= 1 << 1,	// sampled, or fetched through a texture buffer
+	render_access_storage		= 1 << 2,	// shader storage and atomic counters, from compute shaders
+	render_access_vertex		= 1 << 3,	// vertex attributes
+	render_access_indirect		= 1 << 4,	// draw commands
+	render_access_uniform		= 1 << 5,
+	render_access_upload		= 1 << 6,	// written on the CPU. Passes that do this run before the rest.
+};
+
+enum render_resource_flags
+{
+	render_resource_output			= 1 << 0,	// shown, or kept for later frames, so whatever writes it has to run
+	render_resource_in_upload_ring	= 1 << 1,	// its contents are in this frame's uploads
+};
+
+typedef void (*render_pass_function)(void* data);
+
+struct render_resource
+{
+	const char*		name;
+	uint32_t		flags;			// render_resource_flags
+	bool			transient;		// a texture (with a framebuffer) the graph finds for this frame
+	int				width;
+	int				height;
+	GLenum			format;
+	int				texture;		// into render_graph::textures, for a transient one in use
+	int				first_use;		// the first and last live passes that use it
+	int				last_use;
+	bool			needed;			// read by a live pass, while culling
+	GLbitfield		unsynced;		// barriers still owed since it was last written through storage
+};
+
+struct render_pass
+{
+	const char*				name;
+	render_pass_function	function;
+	void*					data;
+	bool					upload;		// writes something with render_access_upload
+	bool					live;		// something that has to run uses what it writes
+	GLbitfield				barrier;	// issued before it runs
+};
+
+struct render_resource_use
+{
+	int			pass;
+	int			resource;
+	uint32_t	access;		// render_access flags
+	bool		write;
+};
+
+// A texture for transient resources, kept from one frame to the next. Resources of the same size
+// and format whose passes don't overlap are given the same one.
+struct render_texture
+{
+	GLuint		texture;
+	GLuint		framebuffer;
+	int			width;
+	int			height;
+	GLenum		format;
+	int			busy_until;		// the last pass using it this frame, or -1
+	uint64_t	last_used;		// the frame it was last used in
+};
+
+struct render_graph
+{
+	std::vector<render_resource>			resources;
+	std::vector<render_pass>				passes;
+	std::vector<render_resource_use>		uses;
+	std::vector<render_texture>				textures;
+	std::vector<std::pair<GLenum, bool>>	renderable_formats;		// whether a framebuffer can have each, found out when first asked
+	uint64_t								frame;
+	int										passes_culled_counter;
+	int										transient_textures_counter;
+};
+
+// Textures no frame has used for this many are freed
+static const int render_texture_idle_frames = 120;
+
+// Call once the GL functions are loaded
+void init_render_graph(render_graph* graph);
+void free_render_graph(render_graph* graph);
+
+// Start declaring a frame's passes and resources, forgetting the last frame's. The textures are kept.
+void begin_render_graph(render_graph* graph);
+
+// A resource from outside the graph: a buffer, a texture that lasts from frame to frame, or the
+// window. 'flags' are render_resource_flags.
+int add_render_resource(render_graph* graph, const char* name, uint32_t flags);
+
+// A texture that only lasts the frame, which the graph finds when it runs, and only if a live
+// pass uses it. It's filtered linearly, and clamped to its edges.
+int add_render_texture(render_graph* graph, const char* name, int width, int height, GLenum format);
+
+// A pass, which runs with 'data' in the order it's added, unless nothing that has to run uses
+// what it writes. The name's shown in CPU traces, so it has to last, as a string literal does.
+int add_render_pass(render_graph* graph, const char* name, render_pass_function function, void* data);
+void render_pass_reads(render_graph* graph, int pass, int resource, uint32_t access);
+void render_pass_writes(render_graph* graph, int pass, int resource, uint32_t access);
+
+// Cull the passes, find the transient textures, and run the live passes: the ones that write
+// uploads first, then the upload ring's end_upload_frame(), then the rest, in order, with their
+// barriers. The ring's fenced once the last pass that uses anything in it has been issued.
+void run_render_graph(render_graph* graph, upload_ring* uploads);
+
+// Free the textures the last frame didn't use, the longest unused first, until 'bytes' of them are
+// gone, without waiting for them to go idle; a frame that wants one again makes it again. Call
+// between frames, to get under the GPU memory budget. Returns how many bytes were freed.
+int64_t trim_render_textures(render_graph* graph, int64_t bytes);
+
+// A transient texture and its framebuffer, for the passes that use it while the graph's running
+GLuint get_render_texture(const render_graph& graph, int resource);
+GLuint get_render_framebuffer(const render_graph& graph, int resource);
+
+// Whether a framebuffer can render to the format, so transient textures of it can be targets
+bool render_format_renderable(render_graph* graph, GLenum format);
@@ -0,0 +1,245 @@
+// Shader builder: compiles and links shader programs in the background, so reloading them doesn't stall the frame
+
+#include "shader_builder.h"
+#include "cpu_profiler.h"
+#include "frame_arena.h"
+#include "perf_counters.h"
+
+#include <cstdio>
+
+const char* const shader_build_mode_names[] =
+{
+	"the driver's compiler threads",
+	"background contexts",
+	"the main thread",
+};
+
+static shader_build_mode			build_mode = shader_build_immediate;
+static int							programs_built_counter = -1;
+static int							build_time_counter = -1;		// from starting each build to its being linked, in microseconds
+
+static void print_shader_info_log(GLuint shader, const shader_stage_source& stage)
+{
+	int info_log_length = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_log_length);
+
+	// If the info log is empty, don't print anything.
+	if (!info_log_length)
+		return;
+
+	// Allocate enough memory in a string to hold the info log.
+	frame_string info_log;
+	info_log.resize(info_log_length);
+
+	// Read the info log into the string.
+	glGetShaderInfoLog(shader, info_log_length, nullptr, &info_log[0]);
+
+	// Lines in included files are numbered by which file they're in; say which is which
+	printf("----- Info log for: %s -----\n", stage.filename.c_str());
+	if (stage.source_names.size() > 1)
+	{
+		for (size_t i = 0; i < stage.source_names.size(); ++i)
+			printf("(source %d is %s)\n", int(i), stage.source_names[i].c_str());
+	}
+	printf(
+		"%s"
+		"----------------------------------------------\n",
+		info_log.c_str());
+}
+
+static void print_program_info_log(GLuint program)
+{
+	int info_log_length = 0;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_log_length);
+
+	// If the info log is empty, don't print anything.
+	if (!info_log_length)
+		return;
+
+	// Allocate enough memory in a string to hold the info log.
+	frame_string info_log;
+	info_log.resize(info_log_length);
+
+	// Read the info log into the string.
+	glGetProgramInfoLog(program, info_log_length, nullptr, &info_log[0]);
+
+	printf(
+		"----- Info log for shader linking -----\n"
+		"%s"
+		"---------------------------------------\n",
+		info_log.c_str());
+}
+
+// Issue all the GL calls for a build, querying nothing, so that the driver needn't finish any of
+// it before returning. Linking shaders that failed to compile just fails the link; we find out
+// which it was when the build's finished.
+static void submit_program_build(program_build* build)
+{
+	build->program = glCreateProgram();
+	build->shaders.clear();
+	for (const shader_stage_source& stage : build->stages)
+	{
+		GLuint shader = glCreateShader(stage.type);
+		const char* source_pointer = stage.source.c_str();
+		int source_length = int(stage.source.size());
+		glShaderSource(shader, 1, &source_pointer, &source_length);
+		glCompileShader(shader);
+		glAttachShader(build->program, shader);
+		build->shaders.push_back(shader);
+	}
+
+	// Transform feedback outputs have to be declared before linking
+	if (!build->feedback_varyings.empty())
+	{
+		frame_vector<const char*> varyings;
+		for (const std::string& varying : build->feedback_varyings)
+			varyings.push_back(varying.c_str());
+		glTransformFeedbackVaryings(build->program, GLsizei(varyings.size()), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+	}
+
+	// Ask the driver to keep the binary, for the program cache
+	glProgramParameteri(build->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(build->program);
+}
+
+static void build_program_on_worker(void* data)
+{
+	program_build* build = (program_build*)data;
+	CPU_PROFILE_SCOPE("build program");
+	frame_arena_scope arena_scope;
+	submit_program_build(build);
+
+	// This is where the waiting for the compiler happens, so the main thread doesn't have to
+	int linked = 0;
+	glGetProgramiv(build->program, GL_LINK_STATUS, &linked);
+}
+
+shader_build_mode init_shader_builder(bool background)
+{
+	build_mode = shader_build_immediate;
+	programs_built_counter = register_perf_counter("programs built", perf_counter_per_frame);
+	build_time_counter = register_perf_counter("shader build us", perf_counter_per_frame);
+	if (!background)
+		return build_mode;
+
+	if (GLAD_GL_KHR_parallel_shader_compile)
+	{
+		// Let the driver use as many threads as it likes
+		glMaxShaderCompilerThreadsKHR(0xffffffffu);
+		build_mode = shader_build_parallel;
+		return build_mode;
+	}
+
+	// Otherwise, build on the GL workers' contexts, if there are any
+	if (gl_worker_count() > 0)
+		build_mode = shader_build_background_context;
+	return build_mode;
+}
+
+void shutdown_shader_builder()
+{
+	build_mode = shader_build_immediate;
+}
+
+void start_program_build(program_build* build)
+{
+	build->program = 0;
+	build->ready.store(false, std::memory_order_relaxed);
+	build->started = std::chrono::steady_clock::now();
+
+	if (build_mode == shader_build_background_context)
+	{
+		start_gl_task(&build->task, &build_program_on_worker, build);
+		return;
+	}
+
+	// With the extension, the driver carries on in the background; without it, it may well have
+	// done all the work before returning
+	submit_program_build(build);
+	if (build_mode == shader_build_immediate)
+		build->ready.store(true, std::memory_order_relaxed);
+}
+
+bool is_program_build_ready(program_build* build)
+{
+	if (build->ready.load(std::memory_order_acquire))
+		return true;
+
+	if (build_mode == shader_build_background_context && is_gl_task_complete(&build->task))
+	{
+		build->ready.store(true, std::memory_order_relaxed);
+		return true;
+	}
+	if (build_mode == shader_build_parallel)
+	{
+		int complete = 0;
+		glGetProgramiv(build->program, GL_COMPLETION_STATUS_KHR, &complete);
+		if (complete)
+		{
+			build->ready.store(true, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+GLuint finish_program_build(program_build* build)
+{
+	// The program's made in a worker's context, so the main one has to wait for it on the GPU too
+	if (build_mode == shader_build_background_context)
+		finish_gl_task(&build->task);
+
+	// Print the info logs (we always do this, even if compiling and linking succeeded, in order to
+	// display any warnings that may have been generated), then check for errors
+	bool compiled = true;
+	for (size_t i = 0; i < build->shaders.size(); ++i)
+	{
+		const char* filename = build->stages[i].filename.c_str();
+		print_shader_info_log(build->shaders[i], build->stages[i]);
+
+		int shader_compiled = 0;
+		glGetShaderiv(build->shaders[i], GL_COMPILE_STATUS, &shader_compiled);
+		if (shader_compiled)
+		{
+			printf("%s compiled successfully!\n", filename);
+		}
+		else
+		{
+			printf("Warning: %s did not compile!\n", filename);
+			compiled = false;
+		}
+	}
+
+	GLuint program = build->program;
+	if (compiled)
+	{
+		print_program_info_log(program);
+
+		int linked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (linked)
+		{
+			printf("Shaders linked successfully!\n");
+		}
+		else
+		{
+			printf("Warning: shaders did not link!\n");
+			compiled = false;
+		}
+	}
+
+	add_perf_counter(programs_built_counter, 1);
+	add_perf_counter(build_time_counter, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - build->started).count());
+
+	// The individual shader objects are no longer needed once the program is linked
+	for (GLuint shader : build->shaders)
+		glDeleteShader(shader);
+	build->shaders.clear();
+	if (!compiled)
+	{
+		glDeleteProgram(program);
+		program = 0;
+	}
+	build->program = 0;
+	return program;
+}
@@ -0,0 +1,64 @@
+// Shader builder: compiles and links shader programs in the background, so reloading them doesn't stall the frame
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "gl_workers.h"
+
+struct shader_stage_source
+{
+	GLenum			type;
+	std::string					filename;		// for the log
+	std::string					source;
+	std::vector<std::string>	source_names;	// the files its #line directives number, if it has includes
+};
+
+// One program to build. Fill in its stages, and any transform feedback varyings, then start it.
+// Don't move or change it until it's finished.
+struct program_build
+{
+	std::vector<shader_stage_source>	stages;
+	std::vector<std::string>			feedback_varyings;		// captured interleaved
+
+	// Where the builder keeps track of it
+	GLuint								program;
+	std::vector<GLuint>					shaders;
+	std::atomic<bool>					ready;					// finishing it won't have to wait
+	std::chrono::steady_clock::time_point	started;			// for the "shader build us" counter
+	gl_task								task;					// building it on a GL worker
+};
+
+// How builds run, best first:
+//  - GL_KHR_parallel_shader_compile: the driver compiles on its own threads, and we poll it
+//  - the GL workers' contexts, which share objects with the main one, a program to a worker at a time
+//  - right away, on the main thread, as compiling always used to
+enum shader_build_mode
+{
+	shader_build_parallel,
+	shader_build_background_context,
+	shader_build_immediate,
+};
+
+extern const char* const shader_build_mode_names[];
+
+// Call once the GL functions are loaded, and the GL workers have started. Unless 'background' is
+// set, builds run immediately.
+shader_build_mode init_shader_builder(bool background);
+
+// Go back to building immediately. Finish every build first, as the GL workers may have them.
+void shutdown_shader_builder();
+
+// Submit a build's compiling and linking, without waiting for any of it
+void start_program_build(program_build* build);
+
+// Whether a build is done, so finish_program_build() would return straight away
+bool is_program_build_ready(program_build* build);
+
+// Wait for the build if needed, print its info logs, and return the linked program, or 0 if it
+// failed. The shader objects are deleted either way.
+GLuint finish_program_build(program_build* build);
@@ -0,0 +1,261 @@
+// Shader source loading: reads shader files, resolving #include directives, and records what each depends on
+
+#include "shader_source.h"
+#include "frame_arena.h"
+#if EMBED_SHADERS
+#	include "embedded_files.h"
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Find a shader file. It could be at different relative paths depending on which directory we
+// started the app from.
+static bool find_shader_file(const char* filename, frame_string* o_path, struct stat* o_stat)
+{
+	*o_path = filename;
+	if (stat(o_path->c_str(), o_stat) == 0)
+		return true;
+
+	*o_path = "../";
+	*o_path += filename;
+	return stat(o_path->c_str(), o_stat) == 0;
+}
+
+// If the line is an #include directive, return the name between its quotes
+// If the line is the given preprocessor directive, return what follows it
+static const char* parse_directive(const frame_string& line, const char* directive)
+{
+	const char* c = line.c_str();
+	while (*c == ' ' || *c == '\t')
+		++c;
+	if (*c++ != '#')
+		return nullptr;
+	while (*c == ' ' || *c == '\t')
+		++c;
+	size_t length = strlen(directive);
+	if (strncmp(c, directive, length) != 0)
+		return nullptr;
+	return c + length;
+}
+
+static bool parse_include(const frame_string& line, frame_string* o_filename)
+{
+	const char* c = parse_directive(line, "include");
+	if (!c)
+		return false;
+	while (*c == ' ' || *c == '\t')
+		++c;
+	if (*c++ != '"')
+		return false;
+	const char* end = strchr(c, '"');
+	if (!end || end == c)
+		return false;
+	o_filename->assign(c, end);
+	return true;
+}
+
+#if !EMBED_SHADERS
+// A file read ahead of time by preload_shader_file(), with the modification time it had then
+struct preloaded_shader_file
+{
+	time_t			mtime;
+	std::string		source;
+};
+
+static std::mutex preloaded_files_lock;
+static std::map<std::string, preloaded_shader_file> preloaded_files;	// by the name it was asked for by
+
+// Read a whole file into memory
+static bool read_whole_file(const char* path, frame_string* o_contents)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	// Allocate enough memory in a string to hold the shader file.
+	fseek(file, 0, SEEK_END);
+	int file_size = int(ftell(file));
+	o_contents->resize(file_size);
+
+	// Read the file into memory
+	fseek(file, 0, SEEK_SET);
+	fread(&(*o_contents)[0], file_size, 1, file);
+	fclose(file);
+	return true;
+}
+
+// The file's preloaded contents, if it hasn't been modified since
+static bool find_preloaded_file(const char* filename, time_t mtime, frame_string* o_contents)
+{
+	std::lock_guard<std::mutex> guard(preloaded_files_lock);
+	std::map<std::string, preloaded_shader_file>::const_iterator preloaded = preloaded_files.find(filename);
+	if (preloaded == preloaded_files.end() || preloaded->second.mtime != mtime)
+		return false;
+	o_contents->assign(preloaded->second.source.begin(), preloaded->second.source.end());
+	return true;
+}
+#endif
+
+static bool append_shader_file(const char* filename, const char* included_from, const char* defines, std::string* o_source, std::vector<shader_dependency>* o_dependencies, std::vector<std::string>* o_source_names)
+{
+#if EMBED_SHADERS
+	const embedded_file* embedded = find_embedded_file(filename);
+	if (!embedded)
+	{
+		if (included_from)
+			printf("Warning: no shader source file %s, included from %s, was embedded in the build!\n", filename, included_from);
+		else
+			printf("Warning: no shader source file %s was embedded in the build!\n", filename);
+		return false;
+	}
+	o_dependencies->push_back(shader_dependency{ filename, 0 });
+	int source_number = int(o_source_names->size());
+	o_source_names->push_back(filename);
+	frame_string file_source(embedded->data, size_t(embedded->size));
+#else
+	// Take it from memory if it was preloaded, and is still the same
+	frame_string path;
+	frame_string file_source;
+	struct stat file_stat = {};
+	bool found = find_shader_file(filename, &path, &file_stat);
+	if (!found || (!find_preloaded_file(filename, file_stat.st_mtime, &file_source) && !read_whole_file(path.c_str(), &file_source)))
+	{
+		// Depend on it anyway, so we try again once it turns up
+		o_dependencies->push_back(shader_dependency{ filename, 0 });
+		if (included_from)
+			printf("Warning: couldn't find shader source file %s, included from %s!\n", filename, included_from);
+		else
+			printf("Warning: couldn't find shader source file %s!\n", filename);
+		return false;
+	}
+
+	// Store the file's modification time for later use
+	o_dependencies->push_back(shader_dependency{ filename, file_stat.st_mtime });
+	int source_number = int(o_source_names->size());
+	o_source_names->push_back(filename);
+#endif
+
+	// Copy it over a line at a time, splicing in the includes
+	int line_number = 1;
+	for (size_t line_start = 0; line_start < file_source.size(); ++line_number)
+	{
+		size_t line_end = file_source.find('\n', line_start);
+		line_end = (line_end == frame_string::npos) ? file_source.size() : line_end + 1;
+		frame_string line = file_source.substr(line_start, line_end - line_start);
+		line_start = line_end;
+
+		frame_string include_filename;
+		if (!parse_include(line, &include_filename))
+		{
+			o_source->append(line.data(), line.size());
+			if (line_start == file_source.size() && line.back() != '\n')
+				*o_source += '\n';
+
+			// The defines go after the #version, then the numbering picks up where it left off
+			if (defines[0] && !included_from && parse_directive(line, "version"))
+			{
+				char line_directive[64];
+				snprintf(line_directive, sizeof(line_directive), "#line %d %d\n", line_number + 1, source_number);
+				*o_source += defines;
+				*o_source += line_directive;
+			}
+			continue;
+		}
+
+		// Each file's only included once
+		bool already_included = std::any_of(o_dependencies->begin(), o_dependencies->end(),
+			[&](const shader_dependency& dependency) { return dependency.filename == include_filename.c_str(); });
+		if (!already_included)
+		{
+			char line_directive[64];
+			snprintf(line_directive, sizeof(line_directive), "#line 1 %d\n", int(o_source_names->size()));
+			*o_source += line_directive;
+			if (!append_shader_file(include_filename.c_str(), filename, defines, o_source, o_dependencies, o_source_names))
+				return false;
+			snprintf(line_directive, sizeof(line_directive), "#line %d %d\n", line_number + 1, source_number);
+			*o_source += line_directive;
+		}
+		else
+		{
+			// Keep the line numbers lined up
+			*o_source += "\n";
+		}
+	}
+	return true;
+}
+
+bool read_shader_source(const char* filename, const char* defines, std::string* o_source, std::vector<shader_dependency>* o_dependencies, std::vector<std::string>* o_source_names)
+{
+	o_source->clear();
+	o_dependencies->clear();
+	o_source_names->clear();
+	return append_shader_file(filename, nullptr, defines, o_source, o_dependencies, o_source_names);
+}
+
+void preload_shader_file(const char* filename)
+{
+#if !EMBED_SHADERS
+	{
+		std::lock_guard<std::mutex> guard(preloaded_files_lock);
+		if (preloaded_files.count(filename))
+			return;
+	}
+
+	frame_arena_scope scope;
+	frame_string path;
+	frame_string file_source;
+	struct stat file_stat = {};
+	if (!find_shader_file(filename, &path, &file_stat) || !read_whole_file(path.c_str(), &file_source))
+		return;
+	{
+		std::lock_guard<std::mutex> guard(preloaded_files_lock);
+		preloaded_shader_file& preloaded = preloaded_files[filename];
+		preloaded.mtime = file_stat.st_mtime;
+		preloaded.source.assign(file_source.begin(), file_source.end());
+	}
+
+	// Then whatever it includes
+	for (size_t line_start = 0; line_start < file_source.size();)
+	{
+		size_t line_end = file_source.find('\n', line_start);
+		line_end = (line_end == frame_string::npos) ? file_source.size() : line_end + 1;
+		frame_string include_filename;
+		if (parse_include(file_source.substr(line_start, line_end - line_start), &include_filename))
+			preload_shader_file(include_filename.c_str());
+		line_start = line_end;
+	}
+#else
+	(void)filename;
+#endif
+}
+
+void discard_preloaded_shader_files()
+{
+#if !EMBED_SHADERS
+	std::lock_guard<std::mutex> guard(preloaded_files_lock);
+	preloaded_files.clear();
+#endif
+}
+
+bool shader_dependencies_changed(const std::vector<shader_dependency>& dependencies)
+{
+	if (!live_shader_files)
+		return false;
+
+	for (const shader_dependency& dependency : dependencies)
+	{
+		// Couldn't find the file - treat it as unmodified
+		frame_string path;
+		struct stat file_stat = {};
+		if (find_shader_file(dependency.filename.c_str(), &path, &file_stat) && file_stat.st_mtime > dependency.mtime)
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,44 @@
+// Shader source loading: reads shader files, resolving #include directives, and records what each depends on
+#pragma once
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+// Builds with the shaders embedded in the executable read them from there, and never touch the
+// file system for them; there's nothing to hot reload, either
+#if EMBED_SHADERS
+static const bool live_shader_files = false;
+#else
+static const bool live_shader_files = true;
+#endif
+
+// A file that went into a shader, and when it was last modified when we read it
+struct shader_dependency
+{
+	std::string		filename;
+	time_t			mtime;
+};
+
+// Read a shader file, replacing each line of the form
+//     #include "filename"
+// with that file's contents, recursively. Included files are found the same way as the shader
+// itself is, and each is only included once per shader, however many times it's asked for (so
+// they don't need guards). '#line' directives go around each one, with the file's index in
+// 'o_source_names' as its source string number, so compile errors point at the right line of the
+// right file. 'defines' (lines of #define directives, or empty) go straight after the shader's
+// #version line, which has to come first. Returns false if any file can't be read. Everything it
+// needs along the way comes from the frame arena.
+bool read_shader_source(const char* filename, const char* defines, std::string* o_source, std::vector<shader_dependency>* o_dependencies, std::vector<std::string>* o_source_names);
+
+// Read a shader file, and everything it includes, into memory ahead of time, so that
+// read_shader_source() doesn't have to wait on the disk for them. Safe to call from any thread, and
+// for many files at once. If a file's modified in between, it's read again. Does nothing in builds
+// with the shaders embedded.
+void preload_shader_file(const char* filename);
+
+// Free the preloaded files, once the shaders they were for have been read
+void discard_preloaded_shader_files();
+
+// Whether any of the files has been modified since it was read
+bool shader_dependencies_changed(const std::vector<shader_dependency>& dependencies);
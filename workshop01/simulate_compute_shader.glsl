@@ -0,0 +1,61 @@
+// Compute shader for simulating the particle system on the GPU. Integrates each live particle
+// in place; cull_compute_shader.glsl then picks out the ones to draw.
+#version 430
+
+layout(local_size_x = 256) in;
+
+#include "particle_data.glsl"
+
+layout(std430, binding = 0) buffer particle_buffer
+{
+	particle particles[];
+};
+
+// Simulation parameters passed from main app
+uniform float timestep;		// seconds to advance the simulation by, per step
+uniform int num_steps;		// how many steps to take
+uniform float gravity;		// acceleration along y
+uniform float kill_height;	// particles that fall below this are dead
+uniform float oldest_creation_time;	// and so are particles created before this
+uniform int capacity;		// size of the particle ring
+
+#include "collider_field.glsl"
+#include "force_field.glsl"
+
+const float two_pi = 6.283185308;
+
+void main()
+{
+	int i = int(gl_GlobalInvocationID.x);
+	if (i >= capacity)
+		return;
+
+	// Skip slots that were never spawned or whose particle has already died (both zero size)
+	particle p = particles[i];
+	if (p.size == 0.0)
+		return;
+
+	for (int step = 0; step < num_steps; ++step)
+	{
+		// Update position using the velocity vector
+		p.position += timestep * p.velocity;
+
+		// Update velocity using gravity
+		p.velocity.y += timestep * gravity;
+
+		// And whatever the force field's pushing it with
+		apply_force_field(p.velocity, p.position, timestep, step);
+
+		// Update angle using the spin speed, but keep it within [0, two_pi]
+		p.angle = mod(p.angle + timestep * p.spin, two_pi);
+
+		// Bounce off the static colliders
+		collide_with_field(p.position, p.velocity, p.size);
+	}
+
+	// Kill particles that have fallen out of the world or got too old
+	if (p.position.y < kill_height || p.creation_time < oldest_creation_time)
+		p.size = 0.0;
+
+	particles[i] = p;
+}
@@ -0,0 +1,244 @@
+// Particle integration kernels: a scalar reference version, plus SIMD versions picked at runtime
+
+#include "simulate_kernels.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if WORKSHOP_X86
+#	include <emmintrin.h>
+#endif
+#if WORKSHOP_NEON
+#	include <arm_neon.h>
+#endif
+
+static const float two_pi = 6.283185308f;
+
+void simulate_particles_scalar(particle_store* store, int first, int count, float timestep, float gravity, int num_steps)
+{
+	float* position_x = store->position_x;
+	float* position_y = store->position_y;
+	float* velocity_x = store->velocity_x;
+	float* velocity_y = store->velocity_y;
+	float* angle = store->angle;
+	const float* spin = store->spin;
+
+	for (int i = first, end = first + count; i < end; ++i)
+	{
+		for (int step = 0; step < num_steps; ++step)
+		{
+			// Update position using the velocity vector
+			position_x[i] += timestep * velocity_x[i];
+			position_y[i] += timestep * velocity_y[i];
+
+			// Update velocity using gravity
+			velocity_y[i] += timestep * gravity;
+
+			// Update angle using the spin speed, but keep it within [-two_pi, two_pi]
+			angle[i] = fmodf(angle[i] + timestep * spin[i], two_pi);
+		}
+	}
+}
+
+#if WORKSHOP_X86
+void simulate_particles_sse2(particle_store* store, int first, int count, float timestep, float gravity, int num_steps)
+{
+	float* position_x = store->position_x;
+	float* position_y = store->position_y;
+	float* velocity_x = store->velocity_x;
+	float* velocity_y = store->velocity_y;
+	float* angle = store->angle;
+	const float* spin = store->spin;
+
+	const __m128 dt = _mm_set1_ps(timestep);
+	const __m128 dv = _mm_set1_ps(timestep * gravity);
+	const __m128 wrap = _mm_set1_ps(two_pi);
+	const __m128 inv_wrap = _mm_set1_ps(1.0f / two_pi);
+
+	// 4 particles per iteration
+	int i = first, end = first + count;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 px = _mm_loadu_ps(position_x + i);
+		__m128 py = _mm_loadu_ps(position_y + i);
+		__m128 vx = _mm_loadu_ps(velocity_x + i);
+		__m128 vy = _mm_loadu_ps(velocity_y + i);
+		__m128 a = _mm_loadu_ps(angle + i);
+		__m128 s = _mm_loadu_ps(spin + i);
+		for (int step = 0; step < num_steps; ++step)
+		{
+			px = _mm_add_ps(px, _mm_mul_ps(dt, vx));
+			py = _mm_add_ps(py, _mm_mul_ps(dt, vy));
+			vy = _mm_add_ps(vy, dv);
+
+			// Wrap the angle without fmod: subtract off the whole number of turns, truncated toward zero
+			a = _mm_add_ps(a, _mm_mul_ps(dt, s));
+			__m128 turns = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(a, inv_wrap)));
+			a = _mm_sub_ps(a, _mm_mul_ps(turns, wrap));
+		}
+		_mm_storeu_ps(position_x + i, px);
+		_mm_storeu_ps(position_y + i, py);
+		_mm_storeu_ps(velocity_y + i, vy);
+		_mm_storeu_ps(angle + i, a);
+	}
+
+	// Leftover particles
+	for (; i < end; ++i)
+	{
+		simulate_particle_tail(store, i, timestep, gravity, num_steps);
+	}
+}
+#endif
+
+#if WORKSHOP_NEON
+void simulate_particles_neon(particle_store* store, int first, int count, float timestep, float gravity, int num_steps)
+{
+	float* position_x = store->position_x;
+	float* position_y = store->position_y;
+	float* velocity_x = store->velocity_x;
+	float* velocity_y = store->velocity_y;
+	float* angle = store->angle;
+	const float* spin = store->spin;
+
+	const float32x4_t dt = vdupq_n_f32(timestep);
+	const float32x4_t dv = vdupq_n_f32(timestep * gravity);
+	const float32x4_t wrap = vdupq_n_f32(two_pi);
+	const float32x4_t inv_wrap = vdupq_n_f32(1.0f / two_pi);
+
+	// 4 particles per iteration
+	int i = first, end = first + count;
+	for (; i + 4 <= end; i += 4)
+	{
+		float32x4_t px = vld1q_f32(position_x + i);
+		float32x4_t py = vld1q_f32(position_y + i);
+		float32x4_t vx = vld1q_f32(velocity_x + i);
+		float32x4_t vy = vld1q_f32(velocity_y + i);
+		float32x4_t a = vld1q_f32(angle + i);
+		float32x4_t s = vld1q_f32(spin + i);
+		for (int step = 0; step < num_steps; ++step)
+		{
+			px = vmlaq_f32(px, dt, vx);
+			py = vmlaq_f32(py, dt, vy);
+			vy = vaddq_f32(vy, dv);
+
+			// Wrap the angle without fmod: subtract off the whole number of turns, truncated toward zero
+			a = vmlaq_f32(a, dt, s);
+			float32x4_t turns = vcvtq_f32_s32(vcvtq_s32_f32(vmulq_f32(a, inv_wrap)));
+			a = vmlsq_f32(a, turns, wrap);
+		}
+		vst1q_f32(position_x + i, px);
+		vst1q_f32(position_y + i, py);
+		vst1q_f32(velocity_y + i, vy);
+		vst1q_f32(angle + i, a);
+	}
+
+	// Leftover particles
+	for (; i < end; ++i)
+	{
+		simulate_particle_tail(store, i, timestep, gravity, num_steps);
+	}
+}
+#endif
+
+simulate_kernel select_simulate_kernel(const char** out_name)
+{
+	const cpu_features& features = get_cpu_features();
+	(void)features;
+
+#if WORKSHOP_X86
+	if (features.avx2)
+	{
+		*out_name = "AVX2";
+		return &simulate_particles_avx2;
+	}
+	if (features.sse2)
+	{
+		*out_name = "SSE2";
+		return &simulate_particles_sse2;
+	}
+#endif
+#if WORKSHOP_NEON
+	if (features.neon)
+	{
+		*out_name = "NEON";
+		return &simulate_particles_neon;
+	}
+#endif
+
+	*out_name = "scalar";
+	return &simulate_particles_scalar;
+}
+
+// Compare two angles, allowing for one of them being wrapped a whole turn differently
+static bool angles_match(float a, float b, float tolerance)
+{
+	float diff = fabsf(a - b);
+	return diff <= tolerance || fabsf(diff - two_pi) <= tolerance;
+}
+
+static bool values_match(float a, float b, float tolerance)
+{
+	return fabsf(a - b) <= tolerance * fmaxf(1.0f, fabsf(a));
+}
+
+bool verify_simulate_kernel(simulate_kernel kernel, particle_store* store, int first, int count, float timestep, float gravity, int num_steps)
+{
+	// Scratch copy of the store for the reference kernel to run on. Kept around between calls,
+	// since this runs every frame when enabled.
+	static particle_store reference = {};
+	if (reference.capacity < store->capacity)
+	{
+		free_particle_store(&reference);
+		if (!init_particle_store(&reference, store->capacity))
+		{
+			printf("Warning: couldn't allocate memory to verify simulation kernel!\n");
+			kernel(store, first, count, timestep, gravity, num_steps);
+			return false;
+		}
+	}
+
+	size_t bytes = size_t(count) * sizeof(float);
+	memcpy(reference.position_x + first, store->position_x + first, bytes);
+	memcpy(reference.position_y + first, store->position_y + first, bytes);
+	memcpy(reference.velocity_x + first, store->velocity_x + first, bytes);
+	memcpy(reference.velocity_y + first, store->velocity_y + first, bytes);
+	memcpy(reference.angle + first, store->angle + first, bytes);
+	memcpy(reference.spin + first, store->spin + first, bytes);
+
+	simulate_particles_scalar(&reference, first, count, timestep, gravity, num_steps);
+	kernel(store, first, count, timestep, gravity, num_steps);
+
+	static const float tolerance = 1e-5f;
+	int mismatches = 0;
+	for (int i = first, end = first + count; i < end; ++i)
+	{
+		if (values_match(store->position_x[i], reference.position_x[i], tolerance) &&
+			values_match(store->position_y[i], reference.position_y[i], tolerance) &&
+			values_match(store->velocity_x[i], reference.velocity_x[i], tolerance) &&
+			values_match(store->velocity_y[i], reference.velocity_y[i], tolerance) &&
+			angles_match(store->angle[i], reference.angle[i], tolerance))
+		{
+			continue;
+		}
+
+		// Only print the first few, so a broken kernel doesn't flood the terminal
+		if (++mismatches <= 4)
+		{
+			printf(
+				"Warning: simulation kernel mismatch at particle %d:\n"
+				"    got      pos (%g, %g) vel (%g, %g) angle %g\n"
+				"    expected pos (%g, %g) vel (%g, %g) angle %g\n",
+				i,
+				store->position_x[i], store->position_y[i], store->velocity_x[i], store->velocity_y[i], store->angle[i],
+				reference.position_x[i], reference.position_y[i], reference.velocity_x[i], reference.velocity_y[i], reference.angle[i]);
+		}
+	}
+
+	if (mismatches > 4)
+	{
+		printf("Warning: ...and %d more simulation kernel mismatches\n", mismatches - 4);
+	}
+
+	return mismatches == 0;
+}
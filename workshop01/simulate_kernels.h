@@ -0,0 +1,55 @@
+// Particle integration kernels: a scalar reference version, plus SIMD versions picked at runtime
+#pragma once
+
+#include "cpu_features.h"
+#include "particle_store.h"
+
+// A kernel integrates particles [first, first + count) forward by num_steps timesteps. The steps are
+// batched: each particle is loaded once, stepped num_steps times in registers, and stored once.
+// All kernels must produce the same results as simulate_particles_scalar, up to float rounding.
+typedef void (*simulate_kernel)(particle_store* store, int first, int count, float timestep, float gravity, int num_steps);
+
+// Scalar reference implementation. This is the straightforward loop, and uses fmod() to wrap angles.
+void simulate_particles_scalar(particle_store* store, int first, int count, float timestep, float gravity, int num_steps);
+
+#if WORKSHOP_X86
+void simulate_particles_sse2(particle_store* store, int first, int count, float timestep, float gravity, int num_steps);
+void simulate_particles_avx2(particle_store* store, int first, int count, float timestep, float gravity, int num_steps);
+#endif
+#if WORKSHOP_NEON
+void simulate_particles_neon(particle_store* store, int first, int count, float timestep, float gravity, int num_steps);
+#endif
+
+// Pick the widest kernel the current CPU supports, and report its name for logging
+simulate_kernel select_simulate_kernel(const char** out_name);
+
+// Run the given kernel and the scalar reference on copies of the same input, and print any
+// particles whose results differ by more than float rounding. Returns true if they all match.
+// This is slow (it copies every hot array), so it's only used when VERIFY_SIMULATION is enabled.
+bool verify_simulate_kernel(simulate_kernel kernel, particle_store* store, int first, int count, float timestep, float gravity, int num_steps);
+
+// Branchless equivalent of fmod(angle, two_pi), for the SIMD kernels to use on their leftover elements
+static inline float wrap_angle(float angle)
+{
+	static const float two_pi = 6.283185308f;
+	return angle - two_pi * float(int(angle * (1.0f / two_pi)));
+}
+
+// Step a single particle, for the SIMD kernels' leftover elements
+static inline void simulate_particle_tail(particle_store* store, int i, float timestep, float gravity, int num_steps)
+{
+	float px = store->position_x[i], py = store->position_y[i];
+	float vx = store->velocity_x[i], vy = store->velocity_y[i];
+	float a = store->angle[i], spin = store->spin[i];
+	for (int step = 0; step < num_steps; ++step)
+	{
+		px += timestep * vx;
+		py += timestep * vy;
+		vy += timestep * gravity;
+		a = wrap_angle(a + timestep * spin);
+	}
+	store->position_x[i] = px;
+	store->position_y[i] = py;
+	store->velocity_y[i] = vy;
+	store->angle[i] = a;
+}
@@ -0,0 +1,68 @@
+// AVX2 particle integration kernel. This file is compiled with AVX2 code generation enabled
+// (see CMakeLists.txt), so nothing in here may run unless get_cpu_features().avx2 is set.
+
+#include "simulate_kernels.h"
+
+#if WORKSHOP_X86
+
+#include <immintrin.h>
+
+static const float two_pi = 6.283185308f;
+
+// Integrate 8 particles starting at index i by num_steps steps
+static inline void simulate_8(particle_store* store, int i, int num_steps, __m256 dt, __m256 dv, __m256 wrap, __m256 inv_wrap)
+{
+	__m256 px = _mm256_loadu_ps(store->position_x + i);
+	__m256 py = _mm256_loadu_ps(store->position_y + i);
+	__m256 vx = _mm256_loadu_ps(store->velocity_x + i);
+	__m256 vy = _mm256_loadu_ps(store->velocity_y + i);
+	__m256 a = _mm256_loadu_ps(store->angle + i);
+	__m256 s = _mm256_loadu_ps(store->spin + i);
+	for (int step = 0; step < num_steps; ++step)
+	{
+		px = _mm256_add_ps(px, _mm256_mul_ps(dt, vx));
+		py = _mm256_add_ps(py, _mm256_mul_ps(dt, vy));
+		vy = _mm256_add_ps(vy, dv);
+
+		// Wrap the angle without fmod: subtract off the whole number of turns, truncated toward zero
+		a = _mm256_add_ps(a, _mm256_mul_ps(dt, s));
+		__m256 turns = _mm256_round_ps(_mm256_mul_ps(a, inv_wrap), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+		a = _mm256_sub_ps(a, _mm256_mul_ps(turns, wrap));
+	}
+	_mm256_storeu_ps(store->position_x + i, px);
+	_mm256_storeu_ps(store->position_y + i, py);
+	_mm256_storeu_ps(store->velocity_y + i, vy);
+	_mm256_storeu_ps(store->angle + i, a);
+}
+
+void simulate_particles_avx2(particle_store* store, int first, int count, float timestep, float gravity, int num_steps)
+{
+	const __m256 dt = _mm256_set1_ps(timestep);
+	const __m256 dv = _mm256_set1_ps(timestep * gravity);
+	const __m256 wrap = _mm256_set1_ps(two_pi);
+	const __m256 inv_wrap = _mm256_set1_ps(1.0f / two_pi);
+
+	// 16 particles per iteration, as two independent 8-wide halves so the loads of
+	// one half can overlap with the arithmetic of the other
+	int i = first, end = first + count;
+	for (; i + 16 <= end; i += 16)
+	{
+		simulate_8(store, i, num_steps, dt, dv, wrap, inv_wrap);
+		simulate_8(store, i + 8, num_steps, dt, dv, wrap, inv_wrap);
+	}
+	for (; i + 8 <= end; i += 8)
+	{
+		simulate_8(store, i, num_steps, dt, dv, wrap, inv_wrap);
+	}
+
+	// Leftover particles
+	for (; i < end; ++i)
+	{
+		simulate_particle_tail(store, i, timestep, gravity, num_steps);
+	}
+
+	// Avoid AVX-SSE transition penalties in whatever SSE code runs next
+	_mm256_zeroupper();
+}
+
+#endif // WORKSHOP_X86
@@ -0,0 +1,59 @@
+// Vertex shader for simulating the particle system on the GPU, using transform feedback.
+// Each vertex is one particle; its outputs are captured straight into the next particle buffer.
+#version 410
+
+// Simulation parameters passed from main app
+uniform float timestep;		// seconds to advance the simulation by, per step
+uniform int num_steps;		// how many steps to take
+uniform float gravity;		// acceleration along y
+uniform float kill_height;	// particles that fall below this are dead
+
+#include "collider_field.glsl"
+#include "force_field.glsl"
+
+// Input data from the current particle buffer (same locations as in vertex_shader.glsl)
+layout(location = 1) in vec2 particle_position;
+layout(location = 2) in vec2 particle_velocity;
+layout(location = 3) in vec4 particle_angle_spin_size_creationtime;	// Four values packed together in a vec4
+
+// Output data captured into the next particle buffer. These are interleaved in this order,
+// so they match struct particle_data in the C++ code.
+out vec2 tf_position;
+out vec2 tf_velocity;
+out vec4 tf_angle_spin_size_creationtime;
+
+const float two_pi = 6.283185308;
+
+void main()
+{
+	vec2 position = particle_position;
+	vec2 velocity = particle_velocity;
+	float angle = particle_angle_spin_size_creationtime.x;
+	float spin = particle_angle_spin_size_creationtime.y;
+	for (int step = 0; step < num_steps; ++step)
+	{
+		// Update position using the velocity vector
+		position += timestep * velocity;
+
+		// Update velocity using gravity
+		velocity.y += timestep * gravity;
+
+		// And whatever the force field's pushing it with
+		apply_force_field(velocity, position, timestep, step);
+
+		// Update angle using the spin speed, but keep it within [0, two_pi]
+		angle = mod(angle + timestep * spin, two_pi);
+
+		// Bounce off the static colliders
+		collide_with_field(position, velocity, particle_angle_spin_size_creationtime.z);
+	}
+
+	tf_position = position;
+	tf_velocity = velocity;
+	tf_angle_spin_size_creationtime = vec4(angle, particle_angle_spin_size_creationtime.yzw);
+
+	// Particles that fall out of the world die, which we mark by setting their size to zero.
+	// They're still in the buffer, but they'll be drawn as nothing.
+	if (tf_position.y < kill_height)
+		tf_angle_spin_size_creationtime.z = 0.0;
+}
@@ -0,0 +1,150 @@
+// Simulation files: the whole CPU simulation saved as it is in memory, so a run can start from where another left off
+
+#include "simulation_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const char simulation_file_magic[8] = { 'P', 'A', 'R', 'T', 'S', 'I', 'M', '\0' };
+
+// The start of the file. The emitters follow it straight away, and the store's arrays come at
+// 'store_offset', which is rounded up so it can be mapped from.
+struct simulation_file_header
+{
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	emitter_size;		// sizeof(particle_emitter), as a check on the layout
+	uint32_t	array_alignment;	// particle_array_alignment, likewise
+	int32_t		capacity;
+	int32_t		live_first;
+	int32_t		live_count;
+	int32_t		num_emitters;
+	int32_t		next_particle_index;
+	uint32_t	random_seed;
+	uint32_t	spawn_counter;
+	double		sim_time;
+	uint64_t	store_offset;
+	uint64_t	store_bytes;
+};
+
+// How big the file is. ftell()'s long is only 32 bits on Windows, and snapshots can be bigger than that.
+static int64_t get_file_size(FILE* file)
+{
+#if defined(_WIN32)
+	if (_fseeki64(file, 0, SEEK_END) != 0)
+		return -1;
+	return _ftelli64(file);
+#else
+	if (fseeko(file, 0, SEEK_END) != 0)
+		return -1;
+	return int64_t(ftello(file));
+#endif
+}
+
+static uint64_t get_store_offset(int num_emitters)
+{
+	uint64_t end = sizeof(simulation_file_header) + uint64_t(num_emitters) * sizeof(particle_emitter);
+	return (end + particle_store_map_alignment - 1) / particle_store_map_alignment * particle_store_map_alignment;
+}
+
+bool save_simulation_file(const char* filename, const particle_store& store, const emitter_set& emitters, const simulation_file_state& state)
+{
+	simulation_file_header header = {};
+	memcpy(header.magic, simulation_file_magic, sizeof(header.magic));
+	header.version = simulation_file_version;
+	header.emitter_size = sizeof(particle_emitter);
+	header.array_alignment = uint32_t(particle_array_alignment);
+	header.capacity = store.capacity;
+	header.live_first = store.live_first;
+	header.live_count = store.live_count;
+	header.num_emitters = emitters.count;
+	header.next_particle_index = state.next_particle_index;
+	header.random_seed = state.random_seed;
+	header.spawn_counter = state.spawn_counter;
+	header.sim_time = state.sim_time;
+	header.store_offset = get_store_offset(emitters.count);
+	header.store_bytes = particle_store_bytes(store.capacity);
+
+	FILE* file = fopen(filename, "wb");
+	if (!file)
+		return false;
+
+	size_t emitter_bytes = size_t(emitters.count) * sizeof(particle_emitter);
+	std::vector<char> padding(size_t(header.store_offset) - sizeof(header) - emitter_bytes, 0);
+	bool written =
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		(emitter_bytes == 0 || fwrite(emitters.emitters, emitter_bytes, 1, file) == 1) &&
+		(padding.empty() || fwrite(padding.data(), padding.size(), 1, file) == 1) &&
+		fwrite(store.memory, size_t(header.store_bytes), 1, file) == 1;
+	written = (fclose(file) == 0) && written;
+	return written;
+}
+
+bool load_simulation_file(const char* filename, particle_store* o_store, emitter_set* o_emitters, simulation_file_state* o_state)
+{
+	FILE* file = fopen(filename, "rb");
+	if (!file)
+	{
+		printf("Error: couldn't open simulation file %s :(\n", filename);
+		return false;
+	}
+
+	simulation_file_header header = {};
+	bool read = (fread(&header, sizeof(header), 1, file) == 1);
+	int64_t file_size = get_file_size(file);
+	if (!read || memcmp(header.magic, simulation_file_magic, sizeof(header.magic)) != 0)
+	{
+		printf("Error: %s isn't a simulation file :(\n", filename);
+		fclose(file);
+		return false;
+	}
+	if (header.version != simulation_file_version || header.emitter_size != sizeof(particle_emitter) || header.array_alignment != particle_array_alignment)
+	{
+		printf("Error: %s is from a different version (%u, where this is %u) :(\n", filename, header.version, simulation_file_version);
+		fclose(file);
+		return false;
+	}
+	if (header.capacity < 1 || header.num_emitters < 1 || header.store_offset != get_store_offset(header.num_emitters) ||
+		header.store_bytes != particle_store_bytes(header.capacity) || file_size < 0 || uint64_t(file_size) < header.store_offset + header.store_bytes ||
+		header.live_first < 0 || header.live_first >= header.capacity || header.live_count < 0 || header.live_count > header.capacity || header.next_particle_index < 0)
+	{
+		printf("Error: %s is cut short or corrupt :(\n", filename);
+		fclose(file);
+		return false;
+	}
+
+	emitter_set emitters;
+	if (!init_emitter_set(&emitters, header.num_emitters))
+	{
+		printf("Error: couldn't allocate emitters :(\n");
+		fclose(file);
+		return false;
+	}
+	fseek(file, long(sizeof(header)), SEEK_SET);
+	read = (fread(emitters.emitters, sizeof(particle_emitter), size_t(emitters.count), file) == size_t(emitters.count));
+	fclose(file);
+
+	particle_store store;
+	if (!read || !map_particle_store(&store, header.capacity, filename, size_t(header.store_offset)))
+	{
+		printf("Error: couldn't map the particles in %s :(\n", filename);
+		free_emitter_set(&emitters);
+		return false;
+	}
+	store.live_first = header.live_first;
+	store.live_count = header.live_count;
+
+	// The GPU has none of them yet
+	mark_particles_dirty(&store, 0, store.capacity);
+
+	free_particle_store(o_store);
+	free_emitter_set(o_emitters);
+	*o_store = store;
+	*o_emitters = emitters;
+	o_state->next_particle_index = header.next_particle_index;
+	o_state->random_seed = header.random_seed;
+	o_state->spawn_counter = header.spawn_counter;
+	o_state->sim_time = header.sim_time;
+	return true;
+}
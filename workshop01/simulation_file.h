@@ -0,0 +1,33 @@
+// Simulation files: the whole CPU simulation saved as it is in memory, so a run can start from where another left off
+#pragma once
+
+#include "emitters.h"
+#include "particle_store.h"
+
+#include <cstdint>
+
+// Bump this whenever anything in the file changes layout, including particle_emitter and the
+// particle store's arrays; files of any other version are turned away rather than misread
+static const uint32_t simulation_file_version = 1;
+
+// The rest of the simulation's state, besides the particles and emitters
+struct simulation_file_state
+{
+	int			next_particle_index;
+	uint32_t	random_seed;
+	uint32_t	spawn_counter;
+	double		sim_time;
+};
+
+// Write the store, the emitters (with their accumulators) and the rest of the state to a file.
+// The particles have to be on the CPU, and nothing can be simulating them meanwhile. Returns false
+// if the file couldn't be written.
+bool save_simulation_file(const char* filename, const particle_store& store, const emitter_set& emitters, const simulation_file_state& state);
+
+// Load a file that save_simulation_file() wrote, replacing the store and emitters. The file's a
+// fixed header, the emitters, and then the store's arrays exactly as they are in memory, so
+// there's nothing to parse: the store's mapped straight from the file (see map_particle_store()),
+// and its pages only come in from the disk as the simulation first touches them. Returns false,
+// having said why and left everything as it was, if the file can't be read, or isn't one of ours,
+// or is a different version.
+bool load_simulation_file(const char* filename, particle_store* o_store, emitter_set* o_emitters, simulation_file_state* o_state);
@@ -0,0 +1,243 @@
+// Simulation LOD: steps blocks of particles that can't be seen every few frames instead of every one, catching them up exactly
+
+#include "simulation_lod.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdlib>
+
+bool init_simulation_lod(simulation_lod* lod, int capacity)
+{
+	free_simulation_lod(lod);
+	int num_blocks = (capacity + simulation_lod_block_size - 1) / simulation_lod_block_size;
+	lod->steps_owed = (uint16_t*)calloc(size_t(num_blocks), sizeof(uint16_t));
+	lod->steps_allowed = (uint16_t*)calloc(size_t(num_blocks), sizeof(uint16_t));
+	if (!lod->steps_owed || !lod->steps_allowed)
+	{
+		free_simulation_lod(lod);
+		return false;
+	}
+	lod->num_blocks = num_blocks;
+	lod->caught_up = true;
+	return true;
+}
+
+void free_simulation_lod(simulation_lod* lod)
+{
+	free(lod->steps_owed);
+	free(lod->steps_allowed);
+	*lod = simulation_lod{};
+}
+
+// How many steps a block's particles can fall behind and still not be seen. A particle that's
+// further out of view along either axis than it can go in that many steps can't have got into it.
+// It's rounded down to whole frames, and a power of two of them, so the blocks that are left fall
+// into a few buckets by how often they're stepped.
+static uint16_t get_steps_allowed(const particle_store& store, int first, int end, const cull_rect& view, const simulation_lod_frame& frame)
+{
+	float step_distance = frame.max_speed * frame.timestep;
+	float frame_distance = step_distance * float(frame.num_steps);
+	float nearest = FLT_MAX;
+	for (int i = first; i < end; ++i)
+	{
+		// Dead ones never come back, so they can be left as long as you like
+		float radius = store.size[i];
+		if (radius == 0.0f)
+			continue;
+		float x = store.position_x[i];
+		float y = store.position_y[i];
+		float outside = std::max(std::max(view.min[0] - x, x - view.max[0]), std::max(view.min[1] - y, y - view.max[1])) - radius;
+		if (outside < frame_distance)
+			return 0;
+		nearest = std::min(nearest, outside);
+	}
+
+	int interval = 1;
+	while (interval < max_simulation_lod_interval && float(interval * 2 - 1) * frame_distance <= nearest)
+		interval *= 2;
+	return uint16_t(std::min((interval - 1) * frame.num_steps, 65535));
+}
+
+// What the jobs share. They're handed ranges of particles starting on block boundaries, in whole
+// blocks, so no two of them have the same block.
+struct simulate_blocks_job_data
+{
+	simulation_lod*				lod;
+	particle_store*				store;
+	const simulation_lod_frame*	frame;
+	int							first;				// the particle that job item 0 is, at the start of a block
+	bool						step_all;
+	particle_range				live[2];			// where the fused upload's particles come from, in order
+	int							num_live_ranges;
+	std::atomic<int>			left_behind;
+};
+
+static void simulate_blocks_job(void* data, int begin, int end)
+{
+	simulate_blocks_job_data* job_data = (simulate_blocks_job_data*)data;
+	simulation_lod* lod = job_data->lod;
+	particle_store* store = job_data->store;
+	const simulation_lod_frame& frame = *job_data->frame;
+	int left_behind = 0;
+	for (int first = job_data->first + begin, last = job_data->first + end; first < last; first += simulation_lod_block_size)
+	{
+		int block = first / simulation_lod_block_size;
+		int block_end = std::min(first + simulation_lod_block_size, last);
+		int steps = lod->steps_owed[block] + frame.num_steps;
+		if (!job_data->step_all && steps <= lod->steps_allowed[block])
+		{
+			lod->steps_owed[block] = uint16_t(steps);
+			left_behind += block_end - first;
+		}
+		else
+		{
+			frame.kernel(store, first, block_end - first, frame.timestep, frame.gravity, steps);
+			lod->steps_owed[block] = 0;
+			lod->steps_allowed[block] = get_steps_allowed(*store, first, block_end, lod->view, frame);
+		}
+
+		// Write out the live part of the block, while it's in the cache, wherever it goes in the window
+		if (!frame.out)
+			continue;
+		int out_offset = 0;
+		for (int i = 0; i < job_data->num_live_ranges; ++i)
+		{
+			const particle_range& range = job_data->live[i];
+			int write_first = std::max(first, range.first);
+			int write_end = std::min(block_end, range.first + range.count);
+			if (write_first < write_end)
+				stream_particle_instances(*store, write_first, write_end - write_first, frame.oldest_creation_time, frame.kill_height, frame.out + out_offset + (write_first - range.first));
+			out_offset += range.count;
+		}
+	}
+	if (left_behind)
+		job_data->left_behind.fetch_add(left_behind, std::memory_order_relaxed);
+}
+
+int simulate_particle_blocks(simulation_lod* lod, particle_store* store, const simulation_lod_frame& frame)
+{
+	simulate_blocks_job_data job_data;
+	job_data.lod = lod;
+	job_data.store = store;
+	job_data.frame = &frame;
+	job_data.num_live_ranges = get_live_particle_ranges(*store, job_data.live);
+	job_data.left_behind.store(0);
+	if (store->live_count == 0)
+		return 0;
+
+	// Allowances worked out against a smaller view don't hold any more, so then they're all
+	// worked out again against this one. Ones worked out against a bigger one still do, so while
+	// the view's inside it, they're all worked out against that, and all stay right for it.
+	job_data.step_all =
+		frame.view.min[0] < lod->view.min[0] || frame.view.min[1] < lod->view.min[1] ||
+		frame.view.max[0] > lod->view.max[0] || frame.view.max[1] > lod->view.max[1];
+	if (job_data.step_all)
+		lod->view = frame.view;
+
+	// The blocks over the live window, in ring order, as up to two runs. If it's wrapped round so
+	// far that the second run reaches the first, they're all in the first.
+	int first_block = store->live_first / simulation_lod_block_size;
+	int live_end = store->live_first + store->live_count;
+	int runs[2][2] = { { first_block, (std::min(live_end, store->capacity) - 1) / simulation_lod_block_size + 1 }, { 0, 0 } };
+	if (live_end > store->capacity)
+	{
+		runs[1][1] = std::min((live_end - store->capacity - 1) / simulation_lod_block_size + 1, first_block);
+		if (runs[1][1] == first_block)
+			runs[0][1] = lod->num_blocks;
+	}
+	for (int run = 0; run < 2; ++run)
+	{
+		if (runs[run][0] >= runs[run][1])
+			continue;
+		job_data.first = runs[run][0] * simulation_lod_block_size;
+		int count = std::min(runs[run][1] * simulation_lod_block_size, store->capacity) - job_data.first;
+		parallel_for(count, simulation_lod_block_size, &simulate_blocks_job, &job_data);
+	}
+
+	int left_behind = job_data.left_behind.load();
+	if (left_behind)
+		lod->caught_up = false;
+	return left_behind;
+}
+
+// Step whatever in [first, end) isn't in the ranges, which are in order, by the steps owed
+static void catch_up_around(particle_store* store, simulate_kernel kernel, float timestep, float gravity, int steps, int first, int end, const particle_range* ranges, int num_ranges)
+{
+	for (int i = 0; i < num_ranges && first < end; ++i)
+	{
+		int range_first = std::max(ranges[i].first, first);
+		int range_end = std::min(ranges[i].first + ranges[i].count, end);
+		if (range_first >= range_end)
+			continue;
+		if (first < range_first)
+			kernel(store, first, range_first - first, timestep, gravity, steps);
+		first = range_end;
+	}
+	if (first < end)
+		kernel(store, first, end - first, timestep, gravity, steps);
+}
+
+void catch_up_spawned_blocks(simulation_lod* lod, particle_store* store, simulate_kernel kernel, float timestep, float gravity, int first, int count)
+{
+	if (count <= 0 || !lod->num_blocks)
+		return;
+	count = std::min(count, store->capacity);
+
+	// The spawned range as up to two linear ones, in order
+	particle_range spawned[2];
+	int num_spawned = 0;
+	if (first + count > store->capacity)
+		spawned[num_spawned++] = particle_range{ 0, first + count - store->capacity };
+	spawned[num_spawned++] = particle_range{ first, std::min(count, store->capacity - first) };
+
+	for (int i = 0; i < num_spawned; ++i)
+	{
+		int last_block = (spawned[i].first + spawned[i].count - 1) / simulation_lod_block_size;
+		for (int block = spawned[i].first / simulation_lod_block_size; block <= last_block; ++block)
+		{
+			if (lod->steps_owed[block])
+			{
+				int block_first = block * simulation_lod_block_size;
+				int block_end = std::min(block_first + simulation_lod_block_size, store->capacity);
+				catch_up_around(store, kernel, timestep, gravity, lod->steps_owed[block], block_first, block_end, spawned, num_spawned);
+			}
+			lod->steps_owed[block] = 0;
+			lod->steps_allowed[block] = 0;
+		}
+	}
+}
+
+// What catch_up_all_blocks()'s jobs share
+struct catch_up_job_data
+{
+	simulation_lod*	lod;
+	particle_store*	store;
+	simulate_kernel	kernel;
+	float			timestep;
+	float			gravity;
+};
+
+static void catch_up_blocks_job(void* data, int begin, int end)
+{
+	const catch_up_job_data* job_data = (const catch_up_job_data*)data;
+	simulation_lod* lod = job_data->lod;
+	for (int first = begin; first < end; first += simulation_lod_block_size)
+	{
+		int block = first / simulation_lod_block_size;
+		if (lod->steps_owed[block])
+			job_data->kernel(job_data->store, first, std::min(first + simulation_lod_block_size, end) - first, job_data->timestep, job_data->gravity, lod->steps_owed[block]);
+		lod->steps_owed[block] = 0;
+		lod->steps_allowed[block] = 0;
+	}
+}
+
+void catch_up_all_blocks(simulation_lod* lod, particle_store* store, simulate_kernel kernel, float timestep, float gravity)
+{
+	if (lod->caught_up)
+		return;
+	catch_up_job_data job_data = { lod, store, kernel, timestep, gravity };
+	parallel_for(std::min(store->capacity, lod->num_blocks * simulation_lod_block_size), simulation_lod_block_size, &catch_up_blocks_job, &job_data);
+	lod->caught_up = true;
+}
@@ -0,0 +1,68 @@
+// Simulation LOD: steps blocks of particles that can't be seen every few frames instead of every one, catching them up exactly
+#pragma once
+
+#include "particle_store.h"
+#include "simulate_kernels.h"
+
+#include <cstdint>
+
+// Particles are scheduled a block at a time: runs of this many in the ring, on block boundaries
+static const int simulation_lod_block_size = 256;
+
+// The most frames a block goes without being stepped. It's stepped every frame, or every 2nd, 4th
+// or 8th, by how far it is out of view.
+static const int max_simulation_lod_interval = 8;
+
+// While gravity's all that moves the particles, stepping one n times in one go puts it exactly
+// where stepping it once a frame for n frames would have, as the kernels take their steps one at a
+// time either way. So a block so far out of view that none of its particles could get into it in
+// the meantime, even at the fastest a particle goes, can be left behind for a few frames, then
+// caught up. Each block keeps how many steps it's behind, and how many it can be behind at most.
+struct simulation_lod
+{
+	uint16_t*	steps_owed;		// per block
+	uint16_t*	steps_allowed;	// per block; 0 for ones that are stepped every frame
+	int			num_blocks;
+	cull_rect	view;			// what the allowances were worked out against
+	bool		caught_up;		// whether no block owes any steps
+};
+
+// What a frame's stepping of the blocks needs to know
+struct simulation_lod_frame
+{
+	simulate_kernel	kernel;
+	float			timestep;
+	float			gravity;
+	int				num_steps;				// this frame's
+	cull_rect		view;					// where particles can be seen, however the render grows it
+	float			max_speed;				// the fastest any particle can go
+
+	// For the fused upload, where to write the live window, in ring order, as in stream_particle_instances()
+	particle_data*	out;
+	float			oldest_creation_time;
+	float			kill_height;
+};
+
+// Allocate the blocks for a store of the given capacity, all caught up, and stepped every frame
+// until they've been looked at. Returns false on failure.
+bool init_simulation_lod(simulation_lod* lod, int capacity);
+
+// Release the blocks and reset to empty
+void free_simulation_lod(simulation_lod* lod);
+
+// Step the blocks over the store's live window that are due this frame, by what they owe and this
+// frame's steps, and work out from where their particles end up how long they can be left next
+// time. The rest fall this frame's steps further behind. If the view's grown past what the
+// allowances were worked out against, every block is stepped. The blocks are spread across the
+// job system's threads. Returns how many particles were left behind.
+int simulate_particle_blocks(simulation_lod* lod, particle_store* store, const simulation_lod_frame& frame);
+
+// New particles are about to be written over [first, first + count), which can wrap: catch up
+// whatever else is in the blocks they're going into, and have those blocks owe nothing, so the new
+// ones start off level with everything else
+void catch_up_spawned_blocks(simulation_lod* lod, particle_store* store, simulate_kernel kernel, float timestep, float gravity, int first, int count);
+
+// Catch every block up, for when everything has to be where it really is: before the particles are
+// saved, handed to another simulation, or moved by something other than gravity. They're then
+// stepped every frame until they've been looked at again.
+void catch_up_all_blocks(simulation_lod* lod, particle_store* store, simulate_kernel kernel, float timestep, float gravity);
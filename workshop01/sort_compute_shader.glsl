@@ -0,0 +1,118 @@
+// Compute shader for sorting the particles to draw, with a bitonic sort. Each workgroup sorts or
+// merges 1024 items at a time in shared memory; merging across workgroups takes a dispatch per step.
+#version 430
+
+layout(local_size_x = 512) in;
+
+// The items to sort: x is the sort key, and y the particle's index. cull_compute_shader.glsl
+// writes these, and the sort puts them in order, with ties broken by index so that
+// equal keys stay in ring order.
+layout(std430, binding = 2) buffer sort_buffer
+{
+	uvec2 items[];
+};
+
+#include "draw_command.glsl"
+
+// total_count is how many items the culling wrote
+layout(std430, binding = 3) readonly buffer particle_draws
+{
+	draw_command draws[3];
+	uint lod_counts[3];
+	uint lod_cursors[3];
+	uint total_count;
+};
+
+// Sort parameters passed from main app
+uniform int stage;				// 0: sort each workgroup's items; 1: one merge step across workgroups; 2: finish a merge within each workgroup
+uniform uint merge_size;		// size of the sequences being merged (stages 1 and 2)
+uniform uint merge_distance;	// distance between the items being compared (stage 1)
+
+const uint items_per_group = 1024u;
+const uint sentinel_key = 0xffffffffu;	// pads out the sort to a power of two, and sorts to the end
+
+shared uvec2 local_items[items_per_group];
+
+bool goes_after(uvec2 a, uvec2 b)
+{
+	return a.x > b.x || (a.x == b.x && a.y > b.y);
+}
+
+// Compare-and-swap the pair of local items this thread is responsible for, sorting ascending
+// or descending depending on which half of a merge_size sequence they're in
+void local_compare_exchange(uint size, uint distance)
+{
+	uint pair = gl_LocalInvocationID.x;
+	uint i = (pair / distance) * 2u * distance + (pair % distance);
+	uint global_i = gl_WorkGroupID.x * items_per_group + i;
+	bool ascending = (global_i & size) == 0u;
+
+	uvec2 a = local_items[i];
+	uvec2 b = local_items[i + distance];
+	if (goes_after(a, b) == ascending)
+	{
+		local_items[i] = b;
+		local_items[i + distance] = a;
+	}
+}
+
+void main()
+{
+	if (stage == 1)
+	{
+		// Merge step between items too far apart to share a workgroup
+		uint pair = gl_GlobalInvocationID.x;
+		uint i = (pair / merge_distance) * 2u * merge_distance + (pair % merge_distance);
+		bool ascending = (i & merge_size) == 0u;
+
+		uvec2 a = items[i];
+		uvec2 b = items[i + merge_distance];
+		if (goes_after(a, b) == ascending)
+		{
+			items[i] = b;
+			items[i + merge_distance] = a;
+		}
+		return;
+	}
+
+	// Load this workgroup's items. The first time through, anything past what the culling wrote
+	// is padding.
+	uint group_first = gl_WorkGroupID.x * items_per_group;
+	for (uint k = 0u; k < 2u; ++k)
+	{
+		uint i = gl_LocalInvocationID.x + k * (items_per_group / 2u);
+		if (stage == 0 && group_first + i >= total_count)
+			local_items[i] = uvec2(sentinel_key, sentinel_key);
+		else
+			local_items[i] = items[group_first + i];
+	}
+
+	if (stage == 0)
+	{
+		// Full bitonic sort of the workgroup's items
+		for (uint size = 2u; size <= items_per_group; size *= 2u)
+		{
+			for (uint distance = size / 2u; distance > 0u; distance /= 2u)
+			{
+				barrier();
+				local_compare_exchange(size, distance);
+			}
+		}
+	}
+	else
+	{
+		// The rest of a merge, once the distance between items fits in the workgroup
+		for (uint distance = items_per_group / 2u; distance > 0u; distance /= 2u)
+		{
+			barrier();
+			local_compare_exchange(merge_size, distance);
+		}
+	}
+	barrier();
+
+	for (uint k = 0u; k < 2u; ++k)
+	{
+		uint i = gl_LocalInvocationID.x + k * (items_per_group / 2u);
+		items[group_first + i] = local_items[i];
+	}
+}
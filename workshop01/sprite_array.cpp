@@ -0,0 +1,196 @@
+// Sprite array: particle sprites packed into the layers of one texture array, so particles with any mix of sprites draw together
+
+#include "sprite_array.h"
+#include "gl_debug.h"
+#include "gl_state.h"
+#include "gpu_memory.h"
+
+#include <algorithm>
+
+// Make a texture array with the given number of layers, all white, with a full mip chain
+static GLuint make_layers(const sprite_array& sprites, int num_layers)
+{
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, sprites.layer_size, sprites.layer_size, num_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	set_gpu_memory(gpu_memory_texture, texture, gpu_texture_bytes(GL_RGBA8, sprites.layer_size, sprites.layer_size, num_layers, true));
+
+	// Clearing each layer as a render target saves making a whole array's worth of white texels
+	static const GLfloat white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sprites.framebuffers[1]);
+	for (int layer = 0; layer < num_layers; ++layer)
+	{
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, layer);
+		glClearBufferfv(GL_COLOR, 0, white);
+	}
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	label_gl_object(GL_TEXTURE, texture, "particle sprites");
+	return texture;
+}
+
+// Scale a 2D texture's mip level, or an array texture's layer, into one of the array's layers.
+// The GPU does it in order with everything else, so nothing waits.
+static void copy_into_layer(const sprite_array& sprites, GLuint source, int source_level, int source_layer, int width, int height, int layer)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, sprites.framebuffers[0]);
+	if (source_layer < 0)
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, source_level);
+	else
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, source, source_level, source_layer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sprites.framebuffers[1]);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sprites.texture, 0, layer);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, sprites.layer_size, sprites.layer_size, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+}
+
+// Copy a compressed texture's level into one of the array's layers. It can't be attached to a
+// framebuffer, so the GL unpacks it into the scratch buffer, which fills the scratch texture, which
+// is copied as usual. That all stays on the GPU, as far as the driver lets it.
+static void copy_compressed_into_layer(const sprite_array& sprites, GLuint source, int source_level, int width, int height, int layer)
+{
+	GLsizeiptr size = GLsizeiptr(width) * height * 4;
+	state_bind_buffer(GL_PIXEL_PACK_BUFFER, sprites.scratch_buffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_COPY);
+	set_gpu_memory(gpu_memory_buffer, sprites.scratch_buffer, int64_t(size));
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, source);
+	glGetTexImage(GL_TEXTURE_2D, source_level, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	state_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, sprites.scratch_buffer);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, sprites.scratch_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	set_gpu_memory(gpu_memory_texture, sprites.scratch_texture, int64_t(size));
+	state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	copy_into_layer(sprites, sprites.scratch_texture, 0, -1, width, height, layer);
+}
+
+// Detach the textures, so the framebuffers don't hold on to them, and go back to the window's
+static void finish_copies(const sprite_array& sprites)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, sprites.framebuffers[0]);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sprites.framebuffers[1]);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+bool init_sprite_array(sprite_array* sprites, int layer_size)
+{
+	*sprites = sprite_array{};
+	sprites->layer_size = layer_size;
+	GLint max_layers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	sprites->max_layers = std::min(int(max_layers), max_sprite_layers);
+
+	glGenFramebuffers(2, sprites->framebuffers);
+	glGenTextures(1, &sprites->scratch_texture);
+	glBindTexture(GL_TEXTURE_2D, sprites->scratch_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	label_gl_object(GL_TEXTURE, sprites->scratch_texture, "sprite scratch");
+	glGenBuffers(1, &sprites->scratch_buffer);
+	sprites->num_layers = 1;
+	sprites->texture = make_layers(*sprites, sprites->num_layers);
+	return sprites->texture != 0;
+}
+
+void free_sprite_array(sprite_array* sprites)
+{
+	set_gpu_memory(gpu_memory_texture, sprites->texture, 0);
+	set_gpu_memory(gpu_memory_texture, sprites->scratch_texture, 0);
+	set_gpu_memory(gpu_memory_buffer, sprites->scratch_buffer, 0);
+	if (sprites->texture)
+		glDeleteTextures(1, &sprites->texture);
+	if (sprites->framebuffers[0])
+		glDeleteFramebuffers(2, sprites->framebuffers);
+	if (sprites->scratch_texture)
+		glDeleteTextures(1, &sprites->scratch_texture);
+	if (sprites->scratch_buffer)
+		state_delete_buffers(1, &sprites->scratch_buffer);
+	*sprites = sprite_array{};
+}
+
+int add_sprite(sprite_array* sprites, texture_streamer* streamer, const char* filename)
+{
+	int layer = int(sprites->sprites.size());
+	if (layer >= sprites->max_layers)
+		return -1;
+
+	// Make room by doubling, copying the layers over, which are all still white if their sprites
+	// aren't in yet. The new array's mipmaps are remade once the copies are done.
+	if (layer >= sprites->num_layers)
+	{
+		int num_layers = std::min(sprites->num_layers * 2, sprites->max_layers);
+		GLuint old_texture = sprites->texture;
+		sprites->texture = make_layers(*sprites, num_layers);
+		for (int i = 0; i < sprites->num_layers; ++i)
+			copy_into_layer(*sprites, old_texture, 0, i, sprites->layer_size, sprites->layer_size, i);
+		finish_copies(*sprites);
+		set_gpu_memory(gpu_memory_texture, old_texture, 0);
+		glDeleteTextures(1, &old_texture);
+		sprites->num_layers = num_layers;
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, sprites->texture);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+
+	sprites->sprites.push_back(request_texture(streamer, filename));
+	return layer;
+}
+
+void update_sprite_array(sprite_array* sprites, texture_streamer* streamer)
+{
+	bool copied = false;
+	for (int layer = sprites->next_copy; layer < int(sprites->sprites.size()); ++layer)
+	{
+		// The layers go in in order, so a slow one holds up the rest, but they're only a frame or so apart
+		int handle = sprites->sprites[size_t(layer)];
+		const streamed_texture& texture = streamer->textures[size_t(handle)];
+		int state = texture.state.load(std::memory_order_relaxed);
+		if (state != streamed_texture_resident && state != streamed_texture_failed)
+			break;
+		sprites->next_copy = layer + 1;
+		if (state == streamed_texture_failed)
+			continue;		// the streamer's said why; the layer stays white
+
+		// Scale it down from the mip level nearest the layer's size, so a big sprite is filtered
+		// properly rather than skipped through by the blit's linear filter. A cooked one only has
+		// the levels it was cooked with.
+		int level = 0;
+		int width = texture.width, height = texture.height;
+		while (std::max(width, height) >= 2 * sprites->layer_size && level < texture.num_levels - 1)
+		{
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+			++level;
+		}
+		if (texture.compressed_format)
+			copy_compressed_into_layer(*sprites, texture.texture, level, width, height, layer);
+		else
+			copy_into_layer(*sprites, texture.texture, level, -1, width, height, layer);
+		copied = true;
+
+		// It's in the layer now, so the streamer can give it back if it's short of memory. The
+		// copy's already been issued, and the GL keeps it around until that's done.
+		release_streamed_texture(streamer, handle);
+	}
+	if (!copied)
+		return;
+
+	finish_copies(*sprites);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, sprites->texture);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
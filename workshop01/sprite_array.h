@@ -0,0 +1,47 @@
+// Sprite array: particle sprites packed into the layers of one texture array, so particles with any mix of sprites draw together
+#pragma once
+
+#include "texture_streamer.h"
+
+#include <vector>
+
+#include <glad/glad.h>
+
+// Particles keep their sprite in a byte, so that's how many layers there can be
+static const int max_sprite_layers = 256;
+
+// Every sprite is scaled to the same square size as it goes in, so a particle picks its sprite by
+// the layer alone, and however many sprites there are, there's one texture to bind. The sprites
+// stream in through the texture streamer; once one's resident, update_sprite_array() copies it
+// into its layer on the GPU, so the CPU never waits for it. Until then, the layer is white. Cooked
+// sprites can't be read through a framebuffer, being compressed, so theirs are unpacked into a
+// scratch texture to be copied from, which may be slower, but only happens once a sprite.
+struct sprite_array
+{
+	GLuint				texture;			// GL_TEXTURE_2D_ARRAY of RGBA8, mipmapped
+	GLuint				framebuffers[2];	// for copying into the layers: one to read from, one to draw to
+	GLuint				scratch_texture;	// RGBA8, for a compressed sprite's level to be copied from
+	GLuint				scratch_buffer;		// which it's read back into on the GPU
+	int					layer_size;			// texels across each layer
+	int					num_layers;			// allocated, which can be more than there are sprites, but is at least one
+	int					max_layers;			// what the GL can have, up to max_sprite_layers
+	std::vector<int>	sprites;			// each layer's texture in the streamer, by layer
+	int					next_copy;			// the first layer that might not have its sprite in yet
+};
+
+// Make the array, with a single white layer, for when there are no sprites. Call once the GL
+// functions are loaded. Returns false on failure.
+bool init_sprite_array(sprite_array* sprites, int layer_size);
+
+// Delete the array and reset it to empty. The sprites' textures belong to the streamer.
+void free_sprite_array(sprite_array* sprites);
+
+// Start streaming an image file in as a sprite, and return its layer, or -1 if the array's full.
+// When the array needs more layers, it's replaced by a bigger one, with the layers so far copied
+// over on the GPU, so this is fine to call at any time, but the array's texture may change.
+int add_sprite(sprite_array* sprites, texture_streamer* streamer, const char* filename);
+
+// Copy any sprites that have become resident since last time into their layers, and remake the
+// mipmaps if there were any. The sprites' textures are released once they're copied, as nothing
+// else samples them. Call once a frame on the GL thread, after update_texture_streamer().
+void update_sprite_array(sprite_array* sprites, texture_streamer* streamer);
@@ -32,8 +32,8 @@
       PIC (Softimage PIC)
       PNM (PPM and PGM binary only)
 
-      Animated GIF still needs a proper API, but here's one way to do it:
-          http://gist.github.com/urraka/685d9a6340b26b830d49
+      Animated GIF: every frame in one pass, as the rectangles that change
+          or as the layers of a texture array; see "Animated GIFs" below
 
       - decode from memory or through FILE (define STBI_NO_STDIO to remove code)
       - decode from arbitrary I/O callbacks
@@ -325,6 +325,15 @@ publish, and distribute this file as you see fit.
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
 //
+// On x86 compilers that can target AVX2 one function at a time (MSVC 2012+,
+// GCC 4.9+, clang), there are also AVX2 versions of the upsampling and color
+// conversion loops, doing twice as many pixels an iteration, and an IDCT that
+// does two horizontally adjacent blocks at once. They're picked with a run-time
+// test too, so the rest of the code doesn't need to be built for AVX2. The IDCT
+// comes into play when whole rows of blocks are transformed at once, which is
+// progressive JPEGs and the parallel decode (see below). Define STBI_NO_AVX2 to
+// leave them out.
+//
 // The output of the JPEG decoder is slightly different from versions where
 // SIMD support was introduced (that is, for versions before 1.49). The
 // difference is only +-1 in the 8-bit RGB channels, and only on a small
@@ -338,6 +347,153 @@ publish, and distribute this file as you see fit.
 //
 // ===========================================================================
 //
+// Parallel JPEG decoding
+//
+// Baseline JPEGs can be decoded across threads, if you hand stb_image a
+// parallel-for to run the work through:
+//
+//     stbi_set_jpeg_parallel_for(my_parallel_for, my_user_data);
+//
+// It's called as parallel_for(user, count, task, task_data), and must call
+// task(task_data, begin, end) over ranges covering [0, count), on whichever
+// threads it likes, returning once they've all finished. It can be called
+// from several decodes at once, if they're on different threads.
+//
+// Then, if the image has restart markers (a DRI segment), and it's being
+// decoded from memory, the entropy-coded data is split at those markers, and
+// the intervals are decoded (and IDCTed) in parallel. Otherwise the entropy
+// decode is serial, but it's done a band of MCU rows at a time into
+// coefficients, which are IDCTed in parallel. Progressive JPEGs' final IDCT
+// is parallel too, and for all JPEGs, so are upsampling and color conversion,
+// in bands of rows. The output is the same as the serial decoder's.
+//
+// ===========================================================================
+//
+// Decoding into your own memory
+//
+// The stbi_load_into* functions decode into a buffer you provide, such as a
+// mapped pixel buffer, rather than one they allocate, with rows as far apart
+// as you like. Get the image's size from stbi_info* first, and how big it'll
+// be from stbi_load_into_size():
+//
+//     stbi_info_from_memory(buffer, len, &x, &y, &n);
+//     size = stbi_load_into_size(x, y, n, 4, stride);
+//     ... get 'size' bytes at 'out' ...
+//     ok = stbi_load_into_from_memory(buffer, len, out, size, stride, &x, &y, &n, 4);
+//
+// req_comp can't be 0 here, since stbi_info* only reads the header, so it
+// can't tell the buffer size: a PNG with a tRNS chunk gains an alpha channel.
+// A stride of 0 means packed rows. The vertical flip, if it's on, is done as
+// the rows are written. JPEGs are color-converted straight into the buffer,
+// and PNGs are filtered into their own and copied over in the same pass as
+// any change of components or flip; other formats are loaded as usual and
+// copied.
+//
+// ===========================================================================
+//
+// Loading at reduced size
+//
+// For thumbnails and placeholders, the *_scaled loaders shrink the image by
+// 'scale', which is 1, 2, 4 or 8, as they load it. The result's (x+scale-1)/
+// scale pixels wide and (y+scale-1)/scale high, each the average of the
+// pixels it covers, more or less:
+//
+//     data = stbi_load_from_memory_scaled(buffer, len, 8, &x, &y, &n, 4);
+//
+// JPEGs are decoded straight to the smaller size, by IDCTing each block to
+// 4x4 or 2x2 pixels, or just its DC term, so there's far less IDCT and
+// upsampling work, and the full-size image never exists. Other formats are
+// loaded at full size and box-filtered down.
+//
+// ===========================================================================
+//
+// Allocating through your own functions
+//
+// STBI_MALLOC, STBI_REALLOC and STBI_FREE are fixed at compile time. For a
+// say on a single load, the *_with_allocator functions take an allocator,
+// and every allocation the load makes, scratch and result alike, goes through
+// that. A decode thread can give each load a bump allocator, say, and reset
+// it once the image has been copied out, or decoded into memory of its own
+// with stbi_load_into*_with_allocator. Free the result through the allocator
+// too, rather than with stbi_image_free.
+//
+// With a parallel-for set (see above), JPEGs' tasks allocate through it as
+// well, on the parallel-for's threads, so it has to be safe to call from
+// several threads at once.
+//
+// ===========================================================================
+//
+// Decoding a band at a time
+//
+// To start on an image before all of it's arrived, open a stream on it, and
+// pull bands of rows out as they're decoded, top to bottom:
+//
+//     stbi_stream *st = stbi_stream_open_from_callbacks(&clbk, user, &x, &y, &n, 4);
+//     while ((rows = stbi_stream_next_rows(st, &first_row, &num_rows)) != NULL)
+//        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first_row, x, num_rows, GL_RGBA, GL_UNSIGNED_BYTE, rows);
+//     stbi_stream_close(st);
+//
+// Each band's rows are packed, and valid until the next call. Only as much
+// of the input is read as the band needs, so the callbacks' reads, the decode
+// and what's done with each band overlap, and the stream only keeps about a
+// band's worth of the image at a time. next_rows returns NULL after the last
+// band, or if the image turns out to be corrupt, in which case first_row is
+// short of y, and stbi_failure_reason() says why. The rows always come top to
+// bottom, whatever stbi_set_flip_vertically_on_load says.
+//
+// Baseline JPEGs with their components in one scan, non-interlaced PNGs, and
+// HDRs (converted to 8 bits as by stbi_load) decode a band at a time. Other
+// images are decoded whole when the stream's opened, and handed out from
+// that, a band at a time all the same.
+//
+// ===========================================================================
+//
+// Animated GIFs
+//
+// stbi_load and friends give a GIF's first frame. To decode all of its frames
+// in one pass, either load them as the rectangles they change:
+//
+//     stbi_gif_animation *anim = stbi_load_gif_animation_from_memory(buffer, len, 4);
+//     ... once anim->frames[i-1].delay milliseconds are up:
+//     stbi_gif_animation_apply(anim, i, canvas, 0);
+//     ...
+//     stbi_gif_animation_free(anim);
+//
+// Frame 0 covers the whole anim->w by anim->h canvas, and each one after it
+// only the pixels it changed, the last frame's disposal included, so a
+// sprite moving about a still background costs a sprite's worth of memory a
+// frame. Or, for a texture array, load every frame whole, a layer after
+// another:
+//
+//     data = stbi_load_gif_from_memory(buffer, len, &delays, &x, &y, &layers, &n, 4);
+//     glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, x, y, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+//
+// Each layer starts as a copy of the one before, and only the rectangle that
+// changed is converted over it. Free data and delays with stbi_image_free.
+// Either way, the decoder keeps just the one canvas, however many frames
+// there are, and the frames are flipped if stbi_set_flip_vertically_on_load
+// says to.
+//
+// ===========================================================================
+//
+// Scanning many images' headers
+//
+// To index a library of images, stbi_info_batch* gets the headers of a list
+// of files or buffers (memory-mapped files, say) in one call, across threads
+// if you hand it a parallel-for, as for JPEG decoding above:
+//
+//     stbi_info_result *results = malloc(count * sizeof(*results));
+//     found = stbi_info_batch(filenames, count, results, my_parallel_for, my_user_data);
+//
+// Each image's format is told from its first bytes, so only that format's
+// header is parsed, and only as much of the file is read as that takes. Each
+// result has stbi_info's x, y and comp, the bits per channel as stored, and
+// the format, which is STBI_format_unknown (and the rest 0) if the image
+// couldn't be read or isn't one stb_image knows. stbi_info* tell the format
+// the same way. stbi_failure_reason() isn't meaningful after a parallel batch.
+//
+// ===========================================================================
+//
 // HDR image support   (disable by defining STBI_NO_HDR)
 //
 // stb_image now supports loading HDR images in general, and currently
@@ -365,6 +521,14 @@ publish, and distribute this file as you see fit.
 //     stbi_ldr_to_hdr_scale(1.0f);
 //     stbi_ldr_to_hdr_gamma(2.2f);
 //
+// To keep the range at half the memory, stbi_loadf16 gives the same values
+// as half floats (IEEE binary16), ready for GL_RGB16F and GL_HALF_FLOAT:
+//
+//    stbi_us *data = stbi_loadf16(filename, &x, &y, &n, 3);
+//
+// HDR files are converted straight from their scanlines to halves, or to
+// bytes for stbi_load, without a whole image of floats in between.
+//
 // Finally, given a filename (or an open file or memory block--see header
 // file for details) containing image data, you can query for the "most
 // appropriate" interface to use (that is, whether the image is HDR or
@@ -393,6 +557,8 @@ publish, and distribute this file as you see fit.
 #include <stdio.h>
 #endif // STBI_NO_STDIO
 
+#include <stddef.h> // size_t
+
 #define STBI_VERSION 1
 
 enum
@@ -406,6 +572,7 @@ enum
 };
 
 typedef unsigned char stbi_uc;
+typedef unsigned short stbi_us;
 
 #ifdef __cplusplus
 extern "C" {
@@ -439,6 +606,92 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk  , void
 
 #ifndef STBI_NO_STDIO
 STBIDEF stbi_uc *stbi_load_from_file  (FILE *f,                  int *x, int *y, int *comp, int req_comp);
+#endif
+
+// decode into 'out', which is 'out_size' bytes, with rows 'out_stride' bytes
+// apart (or packed, if it's 0); see "Decoding into your own memory" above.
+// returns 1 on success, and 0 if the image couldn't be loaded or doesn't fit,
+// in which case some of 'out' may have been written
+STBIDEF int stbi_load_into_from_memory   (stbi_uc           const *buffer, int len   , stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp);
+STBIDEF int stbi_load_into_from_callbacks(stbi_io_callbacks const *clbk  , void *user, stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp);
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_into               (char              const *filename,           stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp);
+STBIDEF int stbi_load_into_from_file     (FILE *f,                                     stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp);
+#endif
+
+// an allocator for a load to make all its allocations through, rather than
+// STBI_MALLOC and friends; see "Allocating through your own functions" above
+typedef struct
+{
+   void *(*malloc_fn) (void *user, size_t size);
+   void *(*realloc_fn)(void *user, void *p, size_t old_size, size_t new_size);
+   void  (*free_fn)   (void *user, void *p);
+   void *user;
+} stbi_allocator;
+
+STBIDEF stbi_uc *stbi_load_from_memory_with_allocator   (stbi_uc           const *buffer, int len   , int *x, int *y, int *comp, int req_comp, stbi_allocator const *alloc);
+STBIDEF stbi_uc *stbi_load_from_callbacks_with_allocator(stbi_io_callbacks const *clbk  , void *user, int *x, int *y, int *comp, int req_comp, stbi_allocator const *alloc);
+STBIDEF int stbi_load_into_from_memory_with_allocator   (stbi_uc           const *buffer, int len   , stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp, stbi_allocator const *alloc);
+STBIDEF int stbi_load_into_from_callbacks_with_allocator(stbi_io_callbacks const *clbk  , void *user, stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp, stbi_allocator const *alloc);
+
+// load an image shrunk by 'scale' (1, 2, 4 or 8); see "Loading at reduced
+// size" above
+STBIDEF stbi_uc *stbi_load_from_memory_scaled   (stbi_uc           const *buffer, int len   , int scale, int *x, int *y, int *comp, int req_comp);
+STBIDEF stbi_uc *stbi_load_from_callbacks_scaled(stbi_io_callbacks const *clbk  , void *user, int scale, int *x, int *y, int *comp, int req_comp);
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_scaled               (char              const *filename,           int scale, int *x, int *y, int *comp, int req_comp);
+#endif
+
+// how many bytes stbi_load_into* needs for an image of x*y pixels, with
+// 'req_comp' components (or 'comp', if that's 0, which stbi_load_into*
+// rejects), and rows 'out_stride' bytes apart (or 0 for packed). returns 0 if
+// the stride's too small for a row
+STBIDEF size_t stbi_load_into_size(int x, int y, int comp, int req_comp, int out_stride);
+
+// decode an image a band of rows at a time; see "Decoding a band at a time"
+// above. a stream from memory reads from the buffer until it's closed
+typedef struct stbi__stream stbi_stream;
+
+STBIDEF stbi_stream *stbi_stream_open_from_memory   (stbi_uc           const *buffer, int len   , int *x, int *y, int *comp, int req_comp);
+STBIDEF stbi_stream *stbi_stream_open_from_callbacks(stbi_io_callbacks const *clbk  , void *user, int *x, int *y, int *comp, int req_comp);
+STBIDEF stbi_uc     *stbi_stream_next_rows(stbi_stream *st, int *first_row, int *num_rows);
+STBIDEF void         stbi_stream_close(stbi_stream *st);
+
+// every frame of an animated GIF; see "Animated GIFs" above
+typedef struct
+{
+   int x, y, w, h;      // the rectangle of the canvas the frame changed, in pixels
+   int delay;           // how long to show the frame, in milliseconds
+   stbi_uc *pixels;     // the rectangle's new pixels, packed rows of w*comp bytes
+} stbi_gif_frame;
+
+typedef struct
+{
+   int w, h, comp;      // the canvas, and the components per pixel (req_comp, or 4)
+   int num_frames;
+   stbi_gif_frame *frames;
+   stbi_uc *pixels;     // the block every frame's pixels are in
+} stbi_gif_animation;
+
+STBIDEF stbi_gif_animation *stbi_load_gif_animation_from_memory   (stbi_uc           const *buffer, int len   , int req_comp);
+STBIDEF stbi_gif_animation *stbi_load_gif_animation_from_callbacks(stbi_io_callbacks const *clbk  , void *user, int req_comp);
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_gif_animation *stbi_load_gif_animation               (char              const *filename,           int req_comp);
+#endif
+STBIDEF void                stbi_gif_animation_free(stbi_gif_animation *anim);
+
+// copy 'frame's rectangle into 'canvas', a whole frame whose rows are
+// 'stride' bytes apart (or 0 for packed), and which has the frame before on it
+STBIDEF void stbi_gif_animation_apply(stbi_gif_animation const *anim, int frame, stbi_uc *canvas, int stride);
+
+// load every frame of a GIF whole, one x*y layer after another, with the
+// frames' delays in milliseconds in *delays if it's not NULL
+STBIDEF stbi_uc *stbi_load_gif_from_memory   (stbi_uc           const *buffer, int len   , int **delays, int *x, int *y, int *layers, int *comp, int req_comp);
+STBIDEF stbi_uc *stbi_load_gif_from_callbacks(stbi_io_callbacks const *clbk  , void *user, int **delays, int *x, int *y, int *layers, int *comp, int req_comp);
+
+#ifndef STBI_NO_STDIO
 // for stbi_load_from_file, file pointer is left pointing immediately after image
 #endif
 
@@ -450,6 +703,15 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f,                  int *x, int *y,
    #ifndef STBI_NO_STDIO
    STBIDEF float *stbi_loadf_from_file  (FILE *f,                int *x, int *y, int *comp, int req_comp);
    #endif
+
+   // the same as half floats
+   STBIDEF stbi_us *stbi_loadf16               (char const *filename,           int *x, int *y, int *comp, int req_comp);
+   STBIDEF stbi_us *stbi_loadf16_from_memory   (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
+   STBIDEF stbi_us *stbi_loadf16_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp);
+
+   #ifndef STBI_NO_STDIO
+   STBIDEF stbi_us *stbi_loadf16_from_file  (FILE *f,              int *x, int *y, int *comp, int req_comp);
+   #endif
 #endif
 
 #ifndef STBI_NO_HDR
@@ -502,6 +764,44 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// decode JPEGs across threads through the given parallel-for, or serially if
+// it's NULL (the default); see "Parallel JPEG decoding" above. NOT THREADSAFE
+// to change while anything's being decoded
+typedef void stbi_parallel_task(void *task_data, int begin, int end);
+typedef void stbi_parallel_for_func(void *user, int count, stbi_parallel_task *task, void *task_data);
+STBIDEF void stbi_set_jpeg_parallel_for(stbi_parallel_for_func *parallel_for, void *user);
+
+// the format an image was found to be in, by stbi_info_batch*
+enum
+{
+   STBI_format_unknown = 0, // couldn't be read, or not an image we know
+
+   STBI_format_jpeg,
+   STBI_format_png,
+   STBI_format_gif,
+   STBI_format_bmp,
+   STBI_format_psd,
+   STBI_format_pic,
+   STBI_format_pnm,
+   STBI_format_hdr,
+   STBI_format_tga
+};
+
+typedef struct
+{
+   int x, y, comp; // as from stbi_info
+   int bits;       // bits per channel as stored: 1, 2, 4, 8 or 16, or 32 for HDR's floats
+   int format;     // STBI_format_*
+} stbi_info_result;
+
+// get the headers of 'count' images into 'results', through 'parallel_for' if
+// it's not NULL; see "Scanning many images' headers" above. returns how many
+// of them were images
+STBIDEF int stbi_info_batch_from_memory(stbi_uc const * const *buffers, int const *lens, int count, stbi_info_result *results, stbi_parallel_for_func *parallel_for, void *user);
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_info_batch(char const * const *filenames, int count, stbi_info_result *results, stbi_parallel_for_func *parallel_for, void *user);
+#endif
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -597,12 +897,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -722,6 +1024,37 @@ static int stbi__sse2_available()
 #endif
 }
 #endif
+
+// AVX2, compiled per function (STBI__AVX2) so it needn't be enabled
+// everywhere, and only ever called after checking for it at run time
+#if !defined(STBI_NO_AVX2) && ((defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__clang__) || \
+    (defined(__GNUC__) && (__GNUC__ * 100 + __GNUC_MINOR__) >= 409))
+#define STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2
+
+static int stbi__avx2_available()
+{
+   int info[4];
+   __cpuid(info,1);
+   // the CPU has to have AVX, and the OS has to save the ymm registers
+   if (((info[2] >> 27) & 3) != 3 || (_xgetbv(0) & 6) != 6)
+      return 0;
+   __cpuidex(info,7,0);
+   return ((info[1] >> 5) & 1) != 0;
+}
+#else
+#define STBI__AVX2 __attribute__((target("avx2")))
+
+static int stbi__avx2_available()
+{
+   // this checks the OS saves the ymm registers, as well as the CPU's support
+   return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif
 #endif
 
 // ARM NEON
@@ -759,6 +1092,22 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   // the caller's buffer, for stbi_load_into*, or NULL to allocate one. the
+   // loaders that write straight into it check it's big enough with
+   // stbi__check_out, and return it; the rest are copied in afterwards
+   stbi_uc *out;
+   size_t out_size;
+   int out_stride;
+
+   // whether to flip the image vertically, and whether the loader did it
+   int flip, flipped;
+
+   // what to allocate through, or NULL for STBI_MALLOC and friends
+   stbi_allocator const *alloc;
+
+   // how much to shrink the image by, and whether the loader did it
+   int scale, scaled;
 } stbi__context;
 
 
@@ -771,6 +1120,11 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
    s->read_from_callbacks = 0;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
+   s->out = NULL;
+   s->flip = s->flipped = 0;
+   s->alloc = NULL;
+   s->scale = 1;
+   s->scaled = 0;
 }
 
 // initialize a callback-based context
@@ -783,6 +1137,11 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
    s->img_buffer_original = s->buffer_start;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
+   s->out = NULL;
+   s->flip = s->flipped = 0;
+   s->alloc = NULL;
+   s->scale = 1;
+   s->scaled = 0;
 }
 
 #ifndef STBI_NO_STDIO
@@ -827,16 +1186,35 @@ static void stbi__rewind(stbi__context *s)
    s->img_buffer_end = s->img_buffer_original_end;
 }
 
+// an image being decoded a band at a time. the formats that can do that set
+// up 'next_rows' to decode each band, and 'close' to free what they keep in
+// 'state'; the rest just decode the whole 'image'
+struct stbi__stream
+{
+   stbi__context s;
+   int x, y, comp;
+   int n;            // components per output pixel
+   int row;          // the first row of the next band
+   int failed;
+   stbi_uc *image;
+   void *state;
+   stbi_uc *(*next_rows)(struct stbi__stream *st, int *num_rows);
+   void (*close)(struct stbi__stream *st);
+};
+
+typedef struct stbi__stream stbi__stream;
+
 #ifndef STBI_NO_JPEG
 static int      stbi__jpeg_test(stbi__context *s);
 static stbi_uc *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp);
 static int      stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp);
+static int      stbi__jpeg_stream_start(stbi__stream *st, int req_comp);
 #endif
 
 #ifndef STBI_NO_PNG
 static int      stbi__png_test(stbi__context *s);
 static stbi_uc *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req_comp);
-static int      stbi__png_info(stbi__context *s, int *x, int *y, int *comp);
+static int      stbi__png_stream_start(stbi__stream *st, int req_comp);
 #endif
 
 #ifndef STBI_NO_BMP
@@ -859,8 +1237,9 @@ static int      stbi__psd_info(stbi__context *s, int *x, int *y, int *comp);
 
 #ifndef STBI_NO_HDR
 static int      stbi__hdr_test(stbi__context *s);
-static float   *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp);
+static void    *stbi__hdr_load_as(stbi__context *s, int *x, int *y, int *comp, int req_comp, int bytes);
 static int      stbi__hdr_info(stbi__context *s, int *x, int *y, int *comp);
+static int      stbi__hdr_stream_start(stbi__stream *st, int req_comp);
 #endif
 
 #ifndef STBI_NO_PIC
@@ -873,6 +1252,8 @@ static int      stbi__pic_info(stbi__context *s, int *x, int *y, int *comp);
 static int      stbi__gif_test(stbi__context *s);
 static stbi_uc *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int req_comp);
 static int      stbi__gif_info(stbi__context *s, int *x, int *y, int *comp);
+static stbi_gif_animation *stbi__gif_load_animation(stbi__context *s, int req_comp);
+static stbi_uc *stbi__gif_load_layers(stbi__context *s, int **delays, int *x, int *y, int *layers, int *comp, int req_comp);
 #endif
 
 #ifndef STBI_NO_PNM
@@ -895,9 +1276,27 @@ static int stbi__err(const char *str)
    return 0;
 }
 
-static void *stbi__malloc(size_t size)
+// everything a load allocates goes through its allocator, if it was given
+// one, or STBI_MALLOC and friends
+static void *stbi__malloc(stbi_allocator const *alloc, size_t size)
+{
+   if (alloc) return alloc->malloc_fn(alloc->user, size);
+   return STBI_MALLOC(size);
+}
+
+static void *stbi__realloc(stbi_allocator const *alloc, void *p, size_t old_size, size_t new_size)
+{
+   if (alloc) return alloc->realloc_fn(alloc->user, p, old_size, new_size);
+   STBI_NOTUSED(old_size);
+   return STBI_REALLOC_SIZED(p, old_size, new_size);
+}
+
+static void stbi__free(stbi_allocator const *alloc, void *p)
 {
-    return STBI_MALLOC(size);
+   if (!alloc)
+      STBI_FREE(p);
+   else if (p)
+      alloc->free_fn(alloc->user, p);
 }
 
 // stbi__err - error
@@ -921,11 +1320,11 @@ STBIDEF void stbi_image_free(void *retval_from_stbi_load)
 }
 
 #ifndef STBI_NO_LINEAR
-static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp);
+static float   *stbi__ldr_to_hdr(stbi_allocator const *alloc, stbi_uc *data, int x, int y, int comp);
 #endif
 
-#ifndef STBI_NO_HDR
-static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp);
+#if !defined(STBI_NO_LINEAR) || !defined(STBI_NO_HDR)
+static void     stbi__float_to_half_run(stbi_us *output, float const *data, size_t count);
 #endif
 
 static int stbi__vertically_flip_on_load = 0;
@@ -935,6 +1334,102 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
     stbi__vertically_flip_on_load = flag_true_if_should_flip;
 }
 
+static stbi_parallel_for_func *stbi__jpeg_parallel_for = NULL;
+static void *stbi__jpeg_parallel_user = NULL;
+
+STBIDEF void stbi_set_jpeg_parallel_for(stbi_parallel_for_func *parallel_for, void *user)
+{
+   stbi__jpeg_parallel_for = parallel_for;
+   stbi__jpeg_parallel_user = user;
+}
+
+STBIDEF size_t stbi_load_into_size(int x, int y, int comp, int req_comp, int out_stride)
+{
+   int n = req_comp ? req_comp : comp;
+   if (out_stride == 0) out_stride = x*n;
+   if (x <= 0 || y <= 0 || out_stride < x*n) return 0;
+   return (size_t) out_stride * (y-1) + (size_t) x*n;
+}
+
+// check an x*y image of n components fits in the caller's buffer, making a
+// stride of 0 packed rows
+static int stbi__check_out(stbi__context *s, int x, int y, int n)
+{
+   size_t size;
+   if (s->out_stride == 0) s->out_stride = x*n;
+   size = stbi_load_into_size(x, y, n, n, s->out_stride);
+   if (size == 0 || size > s->out_size) return stbi__err("buffer too small", "Output buffer too small for image");
+   return 1;
+}
+
+// swap the rows of an image end for end, given how long they are and how far
+// apart
+static void stbi__flip_rows(stbi_uc *data, size_t bytes, size_t stride, int h)
+{
+   stbi_uc temp[2048];
+   int row;
+   for (row = 0; row < (h>>1); row++) {
+      stbi_uc *a = data + row * stride;
+      stbi_uc *b = data + (h - row - 1) * stride;
+      size_t left = bytes;
+      while (left) {
+         size_t chunk = left < sizeof(temp) ? left : sizeof(temp);
+         memcpy(temp, a, chunk);
+         memcpy(a, b, chunk);
+         memcpy(b, temp, chunk);
+         a += chunk;
+         b += chunk;
+         left -= chunk;
+      }
+   }
+}
+
+// shrink an image of n components by 'scale', averaging each scale*scale box
+// of pixels, or as much of one as there is at the edges. if 'from_bottom' is
+// set, the boxes line up with the bottom row rather than the top, for images
+// that've been flipped already. frees the input
+static stbi_uc *stbi__box_shrink(stbi_allocator const *alloc, stbi_uc *data, int *x, int *y, int n, int scale, int from_bottom)
+{
+   int w = (*x + scale-1) / scale, h = (*y + scale-1) / scale;
+   int skip = from_bottom ? h*scale - *y : 0; // rows the first box is short of
+   int i,j,k,row;
+   stbi_uc *out = (stbi_uc *) stbi__malloc(alloc, (size_t) w * h * n);
+   unsigned int *sums = (unsigned int *) stbi__malloc(alloc, (size_t) w * n * sizeof(unsigned int));
+   if (!out || !sums) {
+      stbi__free(alloc, out);
+      stbi__free(alloc, sums);
+      stbi__free(alloc, data);
+      return stbi__errpuc("outofmem", "Out of memory");
+   }
+
+   for (j=0; j < h; ++j) {
+      int y0 = j*scale - skip, y1 = y0 + scale;
+      if (y0 < 0) y0 = 0;
+      if (y1 > *y) y1 = *y;
+      memset(sums, 0, (size_t) w * n * sizeof(unsigned int));
+      for (row=y0; row < y1; ++row) {
+         stbi_uc const *in = data + (size_t) row * *x * n;
+         for (i=0; i < *x; ++i)
+            for (k=0; k < n; ++k)
+               sums[(i/scale)*n + k] += *in++;
+      }
+      for (i=0; i < w; ++i) {
+         int x1 = (i+1)*scale < *x ? (i+1)*scale : *x;
+         unsigned int count = (unsigned int) ((x1 - i*scale) * (y1 - y0));
+         for (k=0; k < n; ++k)
+            out[((size_t) j*w + i)*n + k] = (stbi_uc) ((sums[i*n + k] + count/2) / count);
+      }
+   }
+
+   stbi__free(alloc, sums);
+   stbi__free(alloc, data);
+   *x = w;
+   *y = h;
+   return out;
+}
+
+static void stbi__convert_format_into(stbi_uc *dest, int dest_stride, int flip, stbi_uc const *data, int img_n, int req_comp, unsigned int x, unsigned int y);
+
 static unsigned char *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    #ifndef STBI_NO_JPEG
@@ -960,10 +1455,8 @@ static unsigned char *stbi__load_main(stbi__context *s, int *x, int *y, int *com
    #endif
 
    #ifndef STBI_NO_HDR
-   if (stbi__hdr_test(s)) {
-      float *hdr = stbi__hdr_load(s, x,y,comp,req_comp);
-      return stbi__hdr_to_ldr(hdr, *x, *y, req_comp ? req_comp : *comp);
-   }
+   if (stbi__hdr_test(s))
+      return (stbi_uc *) stbi__hdr_load_as(s, x,y,comp,req_comp, 1);
    #endif
 
    #ifndef STBI_NO_TGA
@@ -977,48 +1470,58 @@ static unsigned char *stbi__load_main(stbi__context *s, int *x, int *y, int *com
 
 static unsigned char *stbi__load_flip(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
-   unsigned char *result = stbi__load_main(s, x, y, comp, req_comp);
+   unsigned char *result;
+   s->flip = stbi__vertically_flip_on_load;
+   result = stbi__load_main(s, x, y, comp, req_comp);
 
-   if (stbi__vertically_flip_on_load && result != NULL) {
-      int w = *x, h = *y;
-      int depth = req_comp ? req_comp : *comp;
-      int row,col,z;
-      stbi_uc temp;
-
-      // @OPTIMIZE: use a bigger temp buffer and memcpy multiple pixels at once
-      for (row = 0; row < (h>>1); row++) {
-         for (col = 0; col < w; col++) {
-            for (z = 0; z < depth; z++) {
-               temp = result[(row * w + col) * depth + z];
-               result[(row * w + col) * depth + z] = result[((h - row - 1) * w + col) * depth + z];
-               result[((h - row - 1) * w + col) * depth + z] = temp;
-            }
-         }
-      }
+   // JPEGs are decoded at the smaller size; the rest are shrunk afterwards
+   if (s->scale > 1 && !s->scaled && result != NULL)
+      result = stbi__box_shrink(s->alloc, result, x, y, req_comp ? req_comp : *comp, s->scale, s->flipped);
+
+   // the loaders that write their output a row at a time flip it as they go
+   if (s->flip && !s->flipped && result != NULL) {
+      size_t row_bytes = (size_t) *x * (req_comp ? req_comp : *comp);
+      stbi__flip_rows(result, row_bytes, row_bytes, *y);
    }
 
    return result;
 }
 
+// load into the caller's buffer in s->out, which the loader might've done
+// already; if it allocated one of its own instead, that's copied in
+static int stbi__load_into(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+{
+   unsigned char *result;
+   int n;
+   if (req_comp < 1 || req_comp > 4) return stbi__err("bad req_comp", "stbi_load_into* needs req_comp");
+   s->flip = stbi__vertically_flip_on_load;
+   result = stbi__load_main(s, x, y, comp, req_comp);
+   if (result == NULL) return 0;
+   if (result == s->out) return 1;
+
+   n = req_comp;
+   if (!stbi__check_out(s, *x, *y, n)) {
+      stbi__free(s->alloc, result);
+      return 0;
+   }
+   stbi__convert_format_into(s->out, s->out_stride, s->flip && !s->flipped, result, n, n, *x, *y);
+   stbi__free(s->alloc, result);
+   return 1;
+}
+
+static void stbi__start_out(stbi__context *s, stbi_uc *out, size_t out_size, int out_stride)
+{
+   s->out = out;
+   s->out_size = out_size;
+   s->out_stride = out_stride;
+}
+
 #ifndef STBI_NO_HDR
 static void stbi__float_postprocess(float *result, int *x, int *y, int *comp, int req_comp)
 {
    if (stbi__vertically_flip_on_load && result != NULL) {
-      int w = *x, h = *y;
-      int depth = req_comp ? req_comp : *comp;
-      int row,col,z;
-      float temp;
-
-      // @OPTIMIZE: use a bigger temp buffer and memcpy multiple pixels at once
-      for (row = 0; row < (h>>1); row++) {
-         for (col = 0; col < w; col++) {
-            for (z = 0; z < depth; z++) {
-               temp = result[(row * w + col) * depth + z];
-               result[(row * w + col) * depth + z] = result[((h - row - 1) * w + col) * depth + z];
-               result[((h - row - 1) * w + col) * depth + z] = temp;
-            }
-         }
-      }
+      size_t row_bytes = (size_t) *x * (req_comp ? req_comp : *comp) * sizeof(float);
+      stbi__flip_rows((stbi_uc *) result, row_bytes, row_bytes, *y);
    }
 }
 #endif
@@ -1060,6 +1563,30 @@ STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req
    }
    return result;
 }
+
+STBIDEF int stbi_load_into(char const *filename, stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   int result;
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   result = stbi_load_into_from_file(f,out,out_size,out_stride,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF int stbi_load_into_from_file(FILE *f, stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp)
+{
+   int result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   stbi__start_out(&s,out,out_size,out_stride);
+   result = stbi__load_into(&s,x,y,comp,req_comp);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   return result;
+}
 #endif //!STBI_NO_STDIO
 
 STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
@@ -1076,56 +1603,384 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_flip(&s,x,y,comp,req_comp);
 }
 
-#ifndef STBI_NO_LINEAR
-static float *stbi__loadf_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+// how many rows to a band, for the formats that don't have a natural size
+// for one: about 256K of output
+static int stbi__stream_band_rows(stbi__stream *st)
 {
-   unsigned char *data;
+   int rows = (1 << 18) / (st->x * st->n);
+   return rows > 0 ? rows : 1;
+}
+
+static int stbi__stream_start(stbi__stream *st, int req_comp)
+{
+   #ifndef STBI_NO_JPEG
+   if (stbi__jpeg_test(&st->s)) return stbi__jpeg_stream_start(st, req_comp);
+   #endif
+   #ifndef STBI_NO_PNG
+   if (stbi__png_test(&st->s))  return stbi__png_stream_start(st, req_comp);
+   #endif
    #ifndef STBI_NO_HDR
-   if (stbi__hdr_test(s)) {
-      float *hdr_data = stbi__hdr_load(s,x,y,comp,req_comp);
-      if (hdr_data)
-         stbi__float_postprocess(hdr_data,x,y,comp,req_comp);
-      return hdr_data;
+   if (stbi__hdr_test(&st->s))  return stbi__hdr_stream_start(st, req_comp);
+   #endif
+
+   // everything else is decoded whole, and handed out from that
+   st->image = stbi__load_main(&st->s, &st->x, &st->y, &st->comp, req_comp);
+   st->n = req_comp ? req_comp : st->comp;
+   return st->image != NULL;
+}
+
+static stbi_stream *stbi__stream_open(stbi__stream *st, int *x, int *y, int *comp, int req_comp)
+{
+   st->row = 0;
+   st->failed = 0;
+   st->image = NULL;
+   st->state = NULL;
+   st->next_rows = NULL;
+   st->close = NULL;
+   if (req_comp < 0 || req_comp > 4) {
+      STBI_FREE(st);
+      return (stbi_stream *) stbi__errpuc("bad req_comp", "Internal error");
+   }
+   if (!stbi__stream_start(st, req_comp)) {
+      stbi_stream_close(st);
+      return NULL;
+   }
+   *x = st->x;
+   *y = st->y;
+   if (comp) *comp = st->comp;
+   return st;
+}
+
+STBIDEF stbi_stream *stbi_stream_open_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__stream *st = (stbi__stream *) STBI_MALLOC(sizeof(*st));
+   if (st == NULL) return (stbi_stream *) stbi__errpuc("outofmem", "Out of memory");
+   stbi__start_mem(&st->s, buffer, len);
+   return stbi__stream_open(st, x, y, comp, req_comp);
+}
+
+STBIDEF stbi_stream *stbi_stream_open_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__stream *st = (stbi__stream *) STBI_MALLOC(sizeof(*st));
+   if (st == NULL) return (stbi_stream *) stbi__errpuc("outofmem", "Out of memory");
+   stbi__start_callbacks(&st->s, (stbi_io_callbacks *) clbk, user);
+   return stbi__stream_open(st, x, y, comp, req_comp);
+}
+
+STBIDEF stbi_uc *stbi_stream_next_rows(stbi_stream *st, int *first_row, int *num_rows)
+{
+   stbi_uc *rows;
+   int n;
+   *first_row = st->row;
+   *num_rows = 0;
+   if (st->failed || st->row >= st->y) return NULL;
+   if (st->image) {
+      n = stbi__stream_band_rows(st);
+      if (n > st->y - st->row) n = st->y - st->row;
+      rows = st->image + (size_t) st->row * st->x * st->n;
+   } else {
+      rows = st->next_rows(st, &n);
+      if (rows == NULL) {
+         st->failed = 1;
+         return NULL;
+      }
    }
+   st->row += n;
+   *num_rows = n;
+   return rows;
+}
+
+STBIDEF void stbi_stream_close(stbi_stream *st)
+{
+   if (st == NULL) return;
+   if (st->close) st->close(st);
+   STBI_FREE(st->image);
+   STBI_FREE(st);
+}
+
+static stbi_gif_animation *stbi__load_gif_animation(stbi__context *s, int req_comp)
+{
+   #ifndef STBI_NO_GIF
+   return stbi__gif_load_animation(s, req_comp);
+   #else
+   STBI_NOTUSED(s);
+   STBI_NOTUSED(req_comp);
+   return (stbi_gif_animation *) stbi__errpuc("not GIF", "GIF support is compiled out");
    #endif
-   data = stbi__load_flip(s, x, y, comp, req_comp);
-   if (data)
-      return stbi__ldr_to_hdr(data, *x, *y, req_comp ? req_comp : *comp);
-   return stbi__errpf("unknown image type", "Image not of any known type, or corrupt");
 }
 
-STBIDEF float *stbi_loadf_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+STBIDEF stbi_gif_animation *stbi_load_gif_animation_from_memory(stbi_uc const *buffer, int len, int req_comp)
 {
    stbi__context s;
    stbi__start_mem(&s,buffer,len);
-   return stbi__loadf_main(&s,x,y,comp,req_comp);
+   return stbi__load_gif_animation(&s,req_comp);
 }
 
-STBIDEF float *stbi_loadf_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
+STBIDEF stbi_gif_animation *stbi_load_gif_animation_from_callbacks(stbi_io_callbacks const *clbk, void *user, int req_comp)
 {
    stbi__context s;
    stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
-   return stbi__loadf_main(&s,x,y,comp,req_comp);
+   return stbi__load_gif_animation(&s,req_comp);
 }
 
 #ifndef STBI_NO_STDIO
-STBIDEF float *stbi_loadf(char const *filename, int *x, int *y, int *comp, int req_comp)
+STBIDEF stbi_gif_animation *stbi_load_gif_animation(char const *filename, int req_comp)
 {
-   float *result;
    FILE *f = stbi__fopen(filename, "rb");
-   if (!f) return stbi__errpf("can't fopen", "Unable to open file");
-   result = stbi_loadf_from_file(f,x,y,comp,req_comp);
+   stbi_gif_animation *result;
+   stbi__context s;
+   if (!f) return (stbi_gif_animation *) stbi__errpuc("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   result = stbi__load_gif_animation(&s,req_comp);
    fclose(f);
    return result;
 }
+#endif
 
-STBIDEF float *stbi_loadf_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
+STBIDEF void stbi_gif_animation_free(stbi_gif_animation *anim)
 {
-   stbi__context s;
-   stbi__start_file(&s,f);
-   return stbi__loadf_main(&s,x,y,comp,req_comp);
+   if (anim == NULL) return;
+   STBI_FREE(anim->pixels);
+   STBI_FREE(anim->frames);
+   STBI_FREE(anim);
 }
-#endif // !STBI_NO_STDIO
+
+STBIDEF void stbi_gif_animation_apply(stbi_gif_animation const *anim, int frame, stbi_uc *canvas, int stride)
+{
+   stbi_gif_frame const *f = &anim->frames[frame];
+   int j, row_bytes = f->w * anim->comp;
+   if (stride == 0) stride = anim->w * anim->comp;
+   for (j=0; j < f->h; ++j)
+      memcpy(canvas + (size_t) stride * (f->y + j) + f->x * anim->comp, f->pixels + (size_t) row_bytes * j, row_bytes);
+}
+
+static stbi_uc *stbi__load_gif_layers(stbi__context *s, int **delays, int *x, int *y, int *layers, int *comp, int req_comp)
+{
+   #ifndef STBI_NO_GIF
+   return stbi__gif_load_layers(s, delays, x, y, layers, comp, req_comp);
+   #else
+   STBI_NOTUSED(s); STBI_NOTUSED(delays); STBI_NOTUSED(x); STBI_NOTUSED(y);
+   STBI_NOTUSED(layers); STBI_NOTUSED(comp); STBI_NOTUSED(req_comp);
+   return stbi__errpuc("not GIF", "GIF support is compiled out");
+   #endif
+}
+
+STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *layers, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_gif_layers(&s,delays,x,y,layers,comp,req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_gif_from_callbacks(stbi_io_callbacks const *clbk, void *user, int **delays, int *x, int *y, int *layers, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__load_gif_layers(&s,delays,x,y,layers,comp,req_comp);
+}
+
+STBIDEF int stbi_load_into_from_memory(stbi_uc const *buffer, int len, stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   stbi__start_out(&s,out,out_size,out_stride);
+   return stbi__load_into(&s,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_into_from_callbacks(stbi_io_callbacks const *clbk, void *user, stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   stbi__start_out(&s,out,out_size,out_stride);
+   return stbi__load_into(&s,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_from_memory_with_allocator(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_allocator const *alloc)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   s.alloc = alloc;
+   return stbi__load_flip(&s,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_from_callbacks_with_allocator(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp, stbi_allocator const *alloc)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   s.alloc = alloc;
+   return stbi__load_flip(&s,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_into_from_memory_with_allocator(stbi_uc const *buffer, int len, stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp, stbi_allocator const *alloc)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   stbi__start_out(&s,out,out_size,out_stride);
+   s.alloc = alloc;
+   return stbi__load_into(&s,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_into_from_callbacks_with_allocator(stbi_io_callbacks const *clbk, void *user, stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp, stbi_allocator const *alloc)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   stbi__start_out(&s,out,out_size,out_stride);
+   s.alloc = alloc;
+   return stbi__load_into(&s,x,y,comp,req_comp);
+}
+
+static int stbi__check_scale(int scale)
+{
+   if (scale != 1 && scale != 2 && scale != 4 && scale != 8) return stbi__err("bad scale", "Scale must be 1, 2, 4 or 8");
+   return 1;
+}
+
+STBIDEF stbi_uc *stbi_load_from_memory_scaled(stbi_uc const *buffer, int len, int scale, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   if (!stbi__check_scale(scale)) return NULL;
+   stbi__start_mem(&s,buffer,len);
+   s.scale = scale;
+   return stbi__load_flip(&s,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_from_callbacks_scaled(stbi_io_callbacks const *clbk, void *user, int scale, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   if (!stbi__check_scale(scale)) return NULL;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   s.scale = scale;
+   return stbi__load_flip(&s,x,y,comp,req_comp);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_scaled(char const *filename, int scale, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   unsigned char *result;
+   stbi__context s;
+   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   if (!stbi__check_scale(scale)) { fclose(f); return NULL; }
+   stbi__start_file(&s,f);
+   s.scale = scale;
+   result = stbi__load_flip(&s,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+#endif
+
+#ifndef STBI_NO_LINEAR
+static float *stbi__loadf_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+{
+   unsigned char *data;
+   #ifndef STBI_NO_HDR
+   if (stbi__hdr_test(s)) {
+      float *hdr_data = (float *) stbi__hdr_load_as(s,x,y,comp,req_comp, 4);
+      if (hdr_data)
+         stbi__float_postprocess(hdr_data,x,y,comp,req_comp);
+      return hdr_data;
+   }
+   #endif
+   data = stbi__load_flip(s, x, y, comp, req_comp);
+   if (data)
+      return stbi__ldr_to_hdr(s->alloc, data, *x, *y, req_comp ? req_comp : *comp);
+   return stbi__errpf("unknown image type", "Image not of any known type, or corrupt");
+}
+
+STBIDEF float *stbi_loadf_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__loadf_main(&s,x,y,comp,req_comp);
+}
+
+STBIDEF float *stbi_loadf_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__loadf_main(&s,x,y,comp,req_comp);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF float *stbi_loadf(char const *filename, int *x, int *y, int *comp, int req_comp)
+{
+   float *result;
+   FILE *f = stbi__fopen(filename, "rb");
+   if (!f) return stbi__errpf("can't fopen", "Unable to open file");
+   result = stbi_loadf_from_file(f,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF float *stbi_loadf_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_file(&s,f);
+   return stbi__loadf_main(&s,x,y,comp,req_comp);
+}
+#endif // !STBI_NO_STDIO
+
+static stbi_us *stbi__loadf16_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+{
+   float *data;
+   stbi_us *result;
+   size_t count;
+   #ifndef STBI_NO_HDR
+   if (stbi__hdr_test(s)) {
+      result = (stbi_us *) stbi__hdr_load_as(s,x,y,comp,req_comp, 2);
+      if (stbi__vertically_flip_on_load && result != NULL) {
+         size_t row_bytes = (size_t) *x * (req_comp ? req_comp : *comp) * sizeof(stbi_us);
+         stbi__flip_rows((stbi_uc *) result, row_bytes, row_bytes, *y);
+      }
+      return result;
+   }
+   #endif
+   // everything else goes by way of floats
+   data = stbi__loadf_main(s,x,y,comp,req_comp);
+   if (data == NULL) return NULL;
+   count = (size_t) *x * *y * (req_comp ? req_comp : *comp);
+   result = (stbi_us *) stbi__malloc(s->alloc, count * sizeof(stbi_us));
+   if (result == NULL) {
+      stbi__free(s->alloc, data);
+      return (stbi_us *) stbi__errpuc("outofmem", "Out of memory");
+   }
+   stbi__float_to_half_run(result, data, count);
+   stbi__free(s->alloc, data);
+   return result;
+}
+
+STBIDEF stbi_us *stbi_loadf16_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__loadf16_main(&s,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_us *stbi_loadf16_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__loadf16_main(&s,x,y,comp,req_comp);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_us *stbi_loadf16(char const *filename, int *x, int *y, int *comp, int req_comp)
+{
+   stbi_us *result;
+   FILE *f = stbi__fopen(filename, "rb");
+   if (!f) return (stbi_us *) stbi__errpuc("can't fopen", "Unable to open file");
+   result = stbi_loadf16_from_file(f,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF stbi_us *stbi_loadf16_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_file(&s,f);
+   return stbi__loadf16_main(&s,x,y,comp,req_comp);
+}
+#endif // !STBI_NO_STDIO
 
 #endif // !STBI_NO_LINEAR
 
@@ -1206,7 +2061,8 @@ enum
 {
    STBI__SCAN_load=0,
    STBI__SCAN_type,
-   STBI__SCAN_header
+   STBI__SCAN_header,
+   STBI__SCAN_stream  // as far as a band-at-a-time decode needs, if it can do one
 };
 
 static void stbi__refill_buffer(stbi__context *s)
@@ -1331,30 +2187,28 @@ static stbi__uint32 stbi__get32le(stbi__context *s)
 //    interleave an alpha=255 channel, but falls back to this for other cases
 //
 //  assume data buffer is malloced, so malloc a new one and free that one
-//  only failure mode is malloc failing
+//  only failure mode is malloc failing. stbi__convert_format_into does the
+//  conversion into a buffer of your own, and can flip the rows as it goes
 
 static stbi_uc stbi__compute_y(int r, int g, int b)
 {
    return (stbi_uc) (((r*77) + (g*150) +  (29*b)) >> 8);
 }
 
-static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+static void stbi__convert_format_into(stbi_uc *dest_rows, int dest_stride, int flip, stbi_uc const *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
    int i,j;
-   unsigned char *good;
 
-   if (req_comp == img_n) return data;
    STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
 
-   good = (unsigned char *) stbi__malloc(req_comp * x * y);
-   if (good == NULL) {
-      STBI_FREE(data);
-      return stbi__errpuc("outofmem", "Out of memory");
-   }
-
    for (j=0; j < (int) y; ++j) {
-      unsigned char *src  = data + j * x * img_n   ;
-      unsigned char *dest = good + j * x * req_comp;
+      stbi_uc const *src  = data + j * x * img_n;
+      stbi_uc *dest = dest_rows + (size_t) dest_stride * (flip ? (int) y-1-j : j);
+
+      if (img_n == req_comp) {
+         memcpy(dest, src, x * img_n);
+         continue;
+      }
 
       #define COMBO(a,b)  ((a)*8+(b))
       #define CASE(a,b)   case COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
@@ -1377,17 +2231,111 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
       }
       #undef CASE
    }
+}
+
+static unsigned char *stbi__convert_format(stbi_allocator const *alloc, unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+   unsigned char *good;
+
+   if (req_comp == img_n) return data;
+
+   good = (unsigned char *) stbi__malloc(alloc, req_comp * x * y);
+   if (good == NULL) {
+      stbi__free(alloc, data);
+      return stbi__errpuc("outofmem", "Out of memory");
+   }
 
-   STBI_FREE(data);
+   stbi__convert_format_into(good, req_comp * x, 0, data, img_n, req_comp, x, y);
+   stbi__free(alloc, data);
    return good;
 }
 
+#if !defined(STBI_NO_LINEAR) || !defined(STBI_NO_HDR)
+// float to half, rounding to nearest even: too big for a half is infinity,
+// and too small comes out denormal or 0. the float's bits are moved down
+// into the half's, with the exponent rebiased, except for denormals, where
+// adding a magic number has the FPU do the shift and rounding
+static stbi_us stbi__float_to_half(float f)
+{
+   union { float f; stbi__uint32 u; } v, magic;
+   stbi__uint32 sign, u;
+   stbi_us h;
+   v.f = f;
+   sign = v.u & 0x80000000u;
+   u = v.u ^ sign;
+   if (u >= (127+16) << 23) {
+      h = u > 0x7f800000u ? 0x7e00 : 0x7c00; // NaN, or infinity
+   } else if (u < (127-14) << 23) {
+      magic.u = ((127-15) + (23-10) + 1) << 23;
+      v.u = u;
+      v.f += magic.f;
+      h = (stbi_us) (v.u - magic.u);
+   } else {
+      stbi__uint32 mant_odd = (u >> 13) & 1;
+      u -= (stbi__uint32) (127-15) << 23;
+      u += 0xfff + mant_odd;
+      h = (stbi_us) (u >> 13);
+   }
+   return (stbi_us) (h | (sign >> 16));
+}
+
+#ifdef STBI_SSE2
+// the same for four floats, each in the bottom 16 bits of its lane, which
+// is sign-extended so _mm_packs_epi32 keeps it as is
+static __m128i stbi__float_to_half_sse2(__m128 f)
+{
+   __m128i c_f16max = _mm_set1_epi32((127+16) << 23);
+   __m128i c_nanbit = _mm_set1_epi32(0x200);
+   __m128i c_infty = _mm_set1_epi32(0x7c00);
+   __m128i c_min_normal = _mm_set1_epi32((127-14) << 23);
+   __m128i c_subnorm_magic = _mm_set1_epi32(((127-15) + (23-10) + 1) << 23);
+   __m128i c_normal_bias = _mm_set1_epi32(0xfff - ((127-15) << 23));
+
+   __m128 justsign = _mm_and_ps(f, _mm_castsi128_ps(_mm_set1_epi32((int) 0x80000000u)));
+   __m128 absf = _mm_xor_ps(f, justsign);
+   __m128i absf_int = _mm_castps_si128(absf);
+   __m128i is_nan = _mm_castps_si128(_mm_cmpunord_ps(absf, absf));
+   __m128i is_regular = _mm_cmpgt_epi32(c_f16max, absf_int);
+   __m128i inf_or_nan = _mm_or_si128(_mm_and_si128(is_nan, c_nanbit), c_infty);
+   __m128i is_sub = _mm_castps_si128(_mm_cmplt_ps(absf, _mm_castsi128_ps(c_min_normal)));
+
+   // results that are denormal
+   __m128 subnorm1 = _mm_add_ps(absf, _mm_castsi128_ps(c_subnorm_magic));
+   __m128i subnorm = _mm_sub_epi32(_mm_castps_si128(subnorm1), c_subnorm_magic);
+
+   // results that are normal
+   __m128i mant_odd = _mm_srai_epi32(_mm_slli_epi32(absf_int, 31-13), 31);
+   __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absf_int, c_normal_bias), mant_odd), 13);
+
+   __m128i nonspecial = _mm_or_si128(_mm_and_si128(is_sub, subnorm), _mm_andnot_si128(is_sub, normal));
+   __m128i joined = _mm_or_si128(_mm_and_si128(is_regular, nonspecial), _mm_andnot_si128(is_regular, inf_or_nan));
+   return _mm_or_si128(joined, _mm_srai_epi32(_mm_castps_si128(justsign), 16));
+}
+#endif
+
+static void stbi__float_to_half_run(stbi_us *output, float const *data, size_t count)
+{
+   size_t i = 0;
+   #ifdef STBI_SSE2
+   if (stbi__sse2_available()) {
+      for (; i + 8 <= count; i += 8) {
+         __m128i lo = stbi__float_to_half_sse2(_mm_loadu_ps(data + i));
+         __m128i hi = stbi__float_to_half_sse2(_mm_loadu_ps(data + i + 4));
+         _mm_storeu_si128((__m128i *) (output + i), _mm_packs_epi32(lo, hi));
+      }
+   }
+   #endif
+   for (; i < count; ++i)
+      output[i] = stbi__float_to_half(data[i]);
+}
+#endif
+
 #ifndef STBI_NO_LINEAR
-static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
+static float   *stbi__ldr_to_hdr(stbi_allocator const *alloc, stbi_uc *data, int x, int y, int comp)
 {
    int i,k,n;
-   float *output = (float *) stbi__malloc(x * y * comp * sizeof(float));
-   if (output == NULL) { STBI_FREE(data); return stbi__errpf("outofmem", "Out of memory"); }
+   float *output = (float *) stbi__malloc(alloc, x * y * comp * sizeof(float));
+   if (output == NULL) { stbi__free(alloc, data); return stbi__errpf("outofmem", "Out of memory"); }
    // compute number of non-alpha components
    if (comp & 1) n = comp; else n = comp-1;
    for (i=0; i < x*y; ++i) {
@@ -1396,21 +2344,20 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
       }
       if (k < comp) output[i*comp + k] = data[i*comp+k]/255.0f;
    }
-   STBI_FREE(data);
+   stbi__free(alloc, data);
    return output;
 }
 #endif
 
 #ifndef STBI_NO_HDR
 #define stbi__float2int(x)   ((int) (x))
-static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
+// convert 'count' pixels
+static void stbi__hdr_to_ldr_into(stbi_uc *output, float *data, int count, int comp)
 {
    int i,k,n;
-   stbi_uc *output = (stbi_uc *) stbi__malloc(x * y * comp);
-   if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
    // compute number of non-alpha components
    if (comp & 1) n = comp; else n = comp-1;
-   for (i=0; i < x*y; ++i) {
+   for (i=0; i < count; ++i) {
       for (k=0; k < n; ++k) {
          float z = (float) pow(data[i*comp+k]*stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
          if (z < 0) z = 0;
@@ -1424,8 +2371,6 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
          output[i*comp + k] = (stbi_uc) stbi__float2int(z);
       }
    }
-   STBI_FREE(data);
-   return output;
 }
 #endif
 
@@ -1447,7 +2392,7 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 //      - quality integer IDCT derived from IJG's 'slow'
 //    performance
 //      - fast huffman; reasonable integer IDCT
-//      - some SIMD kernels for common paths on targets with SSE2/NEON
+//      - some SIMD kernels for common paths on targets with SSE2/NEON/AVX2
 //      - uses a lot of intermediate memory, could cache poorly
 
 #ifndef STBI_NO_JPEG
@@ -1494,6 +2439,14 @@ typedef struct
       stbi_uc *linebuf;
       short   *coeff;   // progressive only
       int      coeff_w, coeff_h; // number of 8x8 coefficient blocks
+
+      // at reduced scale, each block's IDCTed to (8 >> shift) pixels square,
+      // by 'idct'. subsampled components are shrunk less, so they upsample less
+      int      shift;
+      void   (*idct)(stbi_uc *out, int out_stride, short data[64]);
+
+      // the plane row 'data' starts at, when it only holds a window of rows
+      int      first_row;
    } img_comp[4];
 
    stbi__uint32   code_buffer; // jpeg entropy-coded buffer
@@ -1512,8 +2465,12 @@ typedef struct
    int scan_n, order[4];
    int restart_interval, todo;
 
+   int scale_shift; // the image is decoded at 1 / (1 << scale_shift) size
+   int stream;      // a baseline image's planes just hold three MCU rows; see stbi__jpeg_stream_rows
+
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
+   void (*idct_block_pair_kernel)(stbi_uc *out, int out_stride, short data[128]); // NULL if there isn't one
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
    stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
 } stbi__jpeg;
@@ -2025,6 +2982,66 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced-size IDCTs, for decoding at 1/2, 1/4 and 1/8 scale. each is the
+// N-point IDCT of the block's lowest NxN coefficients, which is the 8-point
+// one sampled at the middle of each run of 8/N pixels, less the frequencies
+// too high to show at that size
+
+// 4-point IDCT of s0..s3, scaled up by 1<<12, and by 2 since each of the two
+// dimensions' 1/2 is left for the end; outputs are e0+o0, e1+o1, e1-o1, e0-o0
+#define STBI__IDCT_1D_4(s0,s1,s2,s3) \
+   int e0 = ((s0) + (s2)) * stbi__f2f(0.707106781f);                    \
+   int e1 = ((s0) - (s2)) * stbi__f2f(0.707106781f);                    \
+   int o0 = (s1) * stbi__f2f(0.923879533f) + (s3) * stbi__f2f(0.382683432f); \
+   int o1 = (s1) * stbi__f2f(0.382683432f) - (s3) * stbi__f2f(0.923879533f);
+
+static void stbi__idct_block_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,val[16],*v=val;
+   stbi_uc *o;
+   short *d = data;
+
+   // columns, keeping 2 extra bits of precision, as the 8x8 IDCT does
+   for (i=0; i < 4; ++i,++d,++v) {
+      STBI__IDCT_1D_4(d[0],d[8],d[16],d[24])
+      v[ 0] = (e0+o0 + 512) >> 10;
+      v[ 4] = (e1+o1 + 512) >> 10;
+      v[ 8] = (e1-o1 + 512) >> 10;
+      v[12] = (e0-o0 + 512) >> 10;
+   }
+
+   // rows: 1<<12 from the constants, 1<<2 from the columns, and the two 1/2s
+   // make 1<<16 to take off, after rounding and adding 128
+   for (i=0, v=val, o=out; i < 4; ++i,v+=4,o+=out_stride) {
+      STBI__IDCT_1D_4(v[0],v[1],v[2],v[3])
+      e0 += 32768 + (128<<16);
+      e1 += 32768 + (128<<16);
+      o[0] = stbi__clamp((e0+o0) >> 16);
+      o[1] = stbi__clamp((e1+o1) >> 16);
+      o[2] = stbi__clamp((e1-o1) >> 16);
+      o[3] = stbi__clamp((e0-o0) >> 16);
+   }
+}
+
+static void stbi__idct_block_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   // the 2-point IDCT's just a sum and a difference, so each pixel is
+   // (F00 +- F01 +- F10 +- F11) / 8
+   int a = data[0] + data[8], b = data[0] - data[8];
+   int c = data[1] + data[9], d = data[1] - data[9];
+   out[0]            = stbi__clamp(((a+c + 4) >> 3) + 128);
+   out[1]            = stbi__clamp(((a-c + 4) >> 3) + 128);
+   out[out_stride]   = stbi__clamp(((b+d + 4) >> 3) + 128);
+   out[out_stride+1] = stbi__clamp(((b-d + 4) >> 3) + 128);
+}
+
+static void stbi__idct_block_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+   // just the DC term, rounded as the 8x8 IDCT would have it
+   STBI_NOTUSED(out_stride);
+   out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2206,41 +3223,229 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
-#ifdef STBI_NEON
-
-// NEON integer IDCT. should produce bit-identical
-// results to the generic C version.
-static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
+#ifdef STBI_AVX2
+// avx2 version of the above, doing two horizontally adjacent blocks at once:
+// data[0..63] goes to out, and data[64..127] to out+8. each 128-bit lane
+// holds a row of one of the blocks, and the steps are all within lanes, so
+// it's the same arithmetic, and just as bit-identical to the C version.
+static STBI__AVX2 void stbi__idct_avx2_pair(stbi_uc *out, int out_stride, short data[128])
 {
-   int16x8_t row0, row1, row2, row3, row4, row5, row6, row7;
+   __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m256i tmp;
 
-   int16x4_t rot0_0 = vdup_n_s16(stbi__f2f(0.5411961f));
-   int16x4_t rot0_1 = vdup_n_s16(stbi__f2f(-1.847759065f));
-   int16x4_t rot0_2 = vdup_n_s16(stbi__f2f( 0.765366865f));
-   int16x4_t rot1_0 = vdup_n_s16(stbi__f2f( 1.175875602f));
-   int16x4_t rot1_1 = vdup_n_s16(stbi__f2f(-0.899976223f));
-   int16x4_t rot1_2 = vdup_n_s16(stbi__f2f(-2.562915447f));
-   int16x4_t rot2_0 = vdup_n_s16(stbi__f2f(-1.961570560f));
-   int16x4_t rot2_1 = vdup_n_s16(stbi__f2f(-0.390180644f));
-   int16x4_t rot3_0 = vdup_n_s16(stbi__f2f( 0.298631336f));
-   int16x4_t rot3_1 = vdup_n_s16(stbi__f2f( 2.053119869f));
-   int16x4_t rot3_2 = vdup_n_s16(stbi__f2f( 3.072711026f));
-   int16x4_t rot3_3 = vdup_n_s16(stbi__f2f( 1.501321110f));
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
 
-#define dct_long_mul(out, inq, coeff) \
-   int32x4_t out##_l = vmull_s16(vget_low_s16(inq), coeff); \
-   int32x4_t out##_h = vmull_s16(vget_high_s16(inq), coeff)
+   // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+   // out(1) = c1[even]*x + c1[odd]*y
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
 
-#define dct_long_mac(out, acc, inq, coeff) \
-   int32x4_t out##_l = vmlal_s16(acc##_l, vget_low_s16(inq), coeff); \
-   int32x4_t out##_h = vmlal_s16(acc##_h, vget_high_s16(inq), coeff)
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
 
-#define dct_widen(out, inq) \
-   int32x4_t out##_l = vshll_n_s16(vget_low_s16(inq), 12); \
-   int32x4_t out##_h = vshll_n_s16(vget_high_s16(inq), 12)
+   // wide add
+   #define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
 
-// wide add
-#define dct_wadd(out, a, b) \
+   // wide sub
+   #define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+   // 8-bit interleave step (for transposes)
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+   // 16-bit interleave step (for transposes)
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   // a row of each block, the first block's in the low lane
+   #define dct_load(r) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128((const __m128i *) (data + (r)*8))), \
+         _mm_load_si128((const __m128i *) (data + 64 + (r)*8)), 1)
+
+   // two rows of output, each of which is 8 pixels from each block
+   #define dct_store2(p) \
+      { \
+         __m256i rows = _mm256_permute4x64_epi64(p, 0xd8); \
+         _mm_storeu_si128((__m128i *) out, _mm256_castsi256_si128(rows)); out += out_stride; \
+         _mm_storeu_si128((__m128i *) out, _mm256_extracti128_si256(rows, 1)); out += out_stride; \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = dct_load(0);
+   row1 = dct_load(1);
+   row2 = dct_load(2);
+   row3 = dct_load(3);
+   row4 = dct_load(4);
+   row5 = dct_load(5);
+   row6 = dct_load(6);
+   row7 = dct_load(7);
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose pass 1
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      // transpose pass 2
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      // transpose pass 3
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m256i p0 = _mm256_packus_epi16(row0, row1);
+      __m256i p1 = _mm256_packus_epi16(row2, row3);
+      __m256i p2 = _mm256_packus_epi16(row4, row5);
+      __m256i p3 = _mm256_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose, in each lane
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      // store, putting the two blocks' halves of each row side by side
+      dct_store2(p0);
+      dct_store2(p2);
+      dct_store2(p1);
+      dct_store2(p3);
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+#undef dct_store2
+}
+
+#endif // STBI_AVX2
+
+#ifdef STBI_NEON
+
+// NEON integer IDCT. should produce bit-identical
+// results to the generic C version.
+static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
+{
+   int16x8_t row0, row1, row2, row3, row4, row5, row6, row7;
+
+   int16x4_t rot0_0 = vdup_n_s16(stbi__f2f(0.5411961f));
+   int16x4_t rot0_1 = vdup_n_s16(stbi__f2f(-1.847759065f));
+   int16x4_t rot0_2 = vdup_n_s16(stbi__f2f( 0.765366865f));
+   int16x4_t rot1_0 = vdup_n_s16(stbi__f2f( 1.175875602f));
+   int16x4_t rot1_1 = vdup_n_s16(stbi__f2f(-0.899976223f));
+   int16x4_t rot1_2 = vdup_n_s16(stbi__f2f(-2.562915447f));
+   int16x4_t rot2_0 = vdup_n_s16(stbi__f2f(-1.961570560f));
+   int16x4_t rot2_1 = vdup_n_s16(stbi__f2f(-0.390180644f));
+   int16x4_t rot3_0 = vdup_n_s16(stbi__f2f( 0.298631336f));
+   int16x4_t rot3_1 = vdup_n_s16(stbi__f2f( 2.053119869f));
+   int16x4_t rot3_2 = vdup_n_s16(stbi__f2f( 3.072711026f));
+   int16x4_t rot3_3 = vdup_n_s16(stbi__f2f( 1.501321110f));
+
+#define dct_long_mul(out, inq, coeff) \
+   int32x4_t out##_l = vmull_s16(vget_low_s16(inq), coeff); \
+   int32x4_t out##_h = vmull_s16(vget_high_s16(inq), coeff)
+
+#define dct_long_mac(out, acc, inq, coeff) \
+   int32x4_t out##_l = vmlal_s16(acc##_l, vget_low_s16(inq), coeff); \
+   int32x4_t out##_h = vmlal_s16(acc##_h, vget_high_s16(inq), coeff)
+
+#define dct_widen(out, inq) \
+   int32x4_t out##_l = vshll_n_s16(vget_low_s16(inq), 12); \
+   int32x4_t out##_h = vshll_n_s16(vget_high_s16(inq), 12)
+
+// wide add
+#define dct_wadd(out, a, b) \
    int32x4_t out##_l = vaddq_s32(a##_l, b##_l); \
    int32x4_t out##_h = vaddq_s32(a##_h, b##_h)
 
@@ -2448,67 +3653,281 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+// the number of MCUs in the current scan: in a non-interleaved one, each is a
+// single block of the one component, in trivial scanline order
+static int stbi__jpeg_scan_mcus(stbi__jpeg *z)
 {
-   stbi__jpeg_reset(z);
-   if (!z->progressive) {
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      return ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   }
+   return z->img_mcu_x * z->img_mcu_y;
+}
+
+// where block (bx,by) of component n goes in its plane of pixels, and how far
+// apart the plane's rows are
+static stbi_uc *stbi__jpeg_block_out(stbi__jpeg *z, int n, int bx, int by)
+{
+   int size = 8 >> z->img_comp[n].shift;
+   return z->img_comp[n].data + (size_t) (z->img_comp[n].w2 >> z->img_comp[n].shift) * (by * size - z->img_comp[n].first_row) + bx * size;
+}
+
+static int stbi__jpeg_plane_stride(stbi__jpeg *z, int n)
+{
+   return z->img_comp[n].w2 >> z->img_comp[n].shift;
+}
+
+// decode MCUs [first, end) of a baseline scan, counting down the restart
+// interval as we go. the blocks are IDCTed as they're decoded, unless 'coeff'
+// is set, in which case each component's (dequantized) blocks are stored
+// there instead, for a band of MCU rows starting at 'coeff_row' (see
+// stbi__jpeg_decode_bands). returns 0 on errors, or 2 if the data stopped short, without a
+// restart marker where there should have been one
+static int stbi__jpeg_decode_baseline_mcus(stbi__jpeg *z, int first, int end, short *coeff[4], int coeff_row)
+{
+   int mcu,k,x,y;
+   STBI_SIMD_ALIGN(short, block[64]);
+   for (mcu=first; mcu < end; ++mcu) {
       if (z->scan_n == 1) {
-         int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
+         // non-interleaved data, we just need to process one block at a time
          int n = z->order[0];
-         // non-interleaved data, we just need to process one block at a time,
-         // in trivial scanline order
-         // number of blocks to do just depends on how many actual "pixels" this
-         // component has, independent of interleaved MCU blocking and such
          int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  // if it's NOT a restart, then just bail, so we get corrupt data
-                  // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
-            }
-         }
-         return 1;
-      } else { // interleaved
-         int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
-                        int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
-                     }
-                  }
-               }
-               // after all interleaved components, that's an interleaved MCU,
-               // so now count down the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
+         int i = mcu % w, j = mcu / w;
+         int ha = z->img_comp[n].ha;
+         short *data = coeff ? coeff[n] + 64 * (i + (j - coeff_row) * (z->img_comp[n].w2 >> 3)) : block;
+         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+         if (!coeff)
+            z->img_comp[n].idct(stbi__jpeg_block_out(z, n, i, j), stbi__jpeg_plane_stride(z, n), data);
+      } else {
+         // scan an interleaved mcu... process scan_n components in order
+         int i = mcu % z->img_mcu_x, j = mcu / z->img_mcu_x;
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            // scan out an mcu's worth of this component; that's just determined
+            // by the basic H and V specified for the component
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int x2 = (i*z->img_comp[n].h + x)*8;
+                  int y2 = (j*z->img_comp[n].v + y)*8;
+                  int ha = z->img_comp[n].ha;
+                  short *data = coeff ? coeff[n] + 64 * ((x2 >> 3) + ((j - coeff_row)*z->img_comp[n].v + y) * (z->img_comp[n].w2 >> 3)) : block;
+                  if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                  if (!coeff)
+                     z->img_comp[n].idct(stbi__jpeg_block_out(z, n, x2 >> 3, y2 >> 3), stbi__jpeg_plane_stride(z, n), data);
                }
             }
          }
-         return 1;
       }
+      // after all interleaved components (or the one block), that's an MCU,
+      // so now count down the restart interval
+      if (--z->todo <= 0) {
+         if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+         // if it's NOT a restart, then just bail, so we get corrupt data
+         // rather than no data
+         if (!STBI__RESTART(z->marker)) return 2;
+         stbi__jpeg_reset(z);
+      }
+   }
+   return 1;
+}
+
+// restart markers split the entropy-coded data into intervals that can each be
+// decoded on their own, from a fresh decoder state
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc **starts;    // where each interval's data starts
+   stbi_uc *decoded;    // whether each interval decoded without errors
+   int mcus;
+} stbi__jpeg_restart_split;
+
+static void stbi__jpeg_decode_restart_intervals(void *task_data, int begin, int end)
+{
+   stbi__jpeg_restart_split *split = (stbi__jpeg_restart_split *) task_data;
+   // each task works on its own copy of the decoder, and of the stream
+   stbi__jpeg *z = (stbi__jpeg *) stbi__malloc(split->z->s->alloc, sizeof(stbi__jpeg));
+   stbi__context s;
+   int i;
+   if (!z) { stbi__err("outofmem", "Out of memory"); return; }
+   *z = *split->z;
+   s = *split->z->s;
+   z->s = &s;
+   for (i=begin; i < end; ++i) {
+      int first = i * z->restart_interval;
+      int last = first + z->restart_interval < split->mcus ? first + z->restart_interval : split->mcus;
+      s.img_buffer = split->starts[i];
+      stbi__jpeg_reset(z);
+      split->decoded[i] = (stbi_uc) (stbi__jpeg_decode_baseline_mcus(z, first, last, NULL, 0) != 0);
+   }
+   stbi__free(split->z->s->alloc, z);
+}
+
+// decode a baseline scan's restart intervals in parallel, if it has them, and
+// its data's all in memory. returns -1 if it can't be split, with nothing read
+static int stbi__jpeg_decode_restarts(stbi__jpeg *z, int mcus)
+{
+   stbi__context *s = z->s;
+   stbi__jpeg_restart_split split;
+   stbi_uc *p, *scan_end = NULL;
+   int num_intervals, found = 0, i, result = 1;
+   if (!z->restart_interval || s->read_from_callbacks) return -1;
+   num_intervals = (mcus + z->restart_interval - 1) / z->restart_interval;
+   if (num_intervals < 2) return -1;
+
+   split.z = z;
+   split.mcus = mcus;
+   split.starts = (stbi_uc **) stbi__malloc(z->s->alloc, num_intervals * sizeof(stbi_uc *));
+   split.decoded = (stbi_uc *) stbi__malloc(z->s->alloc, num_intervals);
+   if (!split.starts || !split.decoded) {
+      stbi__free(z->s->alloc, split.starts);
+      stbi__free(z->s->alloc, split.decoded);
+      return -1;
+   }
+
+   // find the intervals' starts, and the marker after the scan; if there are
+   // more or fewer restarts than the interval says, leave it to the serial decoder
+   split.starts[found++] = s->img_buffer;
+   for (p = s->img_buffer; p+1 < s->img_buffer_end; ++p) {
+      if (p[0] != 0xff) continue;
+      if (p[1] == 0x00) { ++p; continue; } // stuffed zero byte
+      if (p[1] == 0xff) continue;          // fill byte before a marker
+      if (STBI__RESTART(p[1]) && found < num_intervals) {
+         split.starts[found++] = p+2;
+         ++p;
+         continue;
+      }
+      if (!STBI__RESTART(p[1]))
+         scan_end = p;
+      break;
+   }
+   if (!scan_end || found != num_intervals) {
+      stbi__free(z->s->alloc, split.starts);
+      stbi__free(z->s->alloc, split.decoded);
+      return -1;
+   }
+
+   memset(split.decoded, 0, num_intervals);
+   stbi__jpeg_parallel_for(stbi__jpeg_parallel_user, num_intervals, stbi__jpeg_decode_restart_intervals, &split);
+   for (i=0; i < num_intervals; ++i)
+      if (!split.decoded[i]) result = 0;
+   stbi__free(z->s->alloc, split.starts);
+   stbi__free(z->s->alloc, split.decoded);
+   if (!result) return 0; // the failing task said why
+
+   // carry on from the marker after the scan, as the serial decoder would
+   s->img_buffer = scan_end;
+   z->marker = STBI__MARKER_none;
+   z->code_bits = 0;
+   z->code_buffer = 0;
+   return 1;
+}
+
+// how many MCU rows of a baseline scan without restart markers are entropy
+// decoded at a time, before they're IDCTed in parallel
+#define STBI__JPEG_BAND_MCU_ROWS 16
+
+typedef struct
+{
+   stbi__jpeg *z;
+   short *coeff[4];     // each component's blocks in the band
+   int row, rows;       // MCU rows in the band
+} stbi__jpeg_band;
+
+static int stbi__jpeg_band_block_rows(stbi__jpeg *z, int n, int mcu_rows)
+{
+   return z->scan_n == 1 ? mcu_rows : mcu_rows * z->img_comp[n].v;
+}
+
+// IDCT a row of 'count' blocks of component n, starting at block row 'by',
+// two at a time if there's a kernel for that. data holds their coefficients
+// back to back.
+static void stbi__jpeg_idct_row(stbi__jpeg *z, int n, int by, short *data, int count)
+{
+   stbi_uc *out = stbi__jpeg_block_out(z, n, 0, by);
+   int i=0, size = 8 >> z->img_comp[n].shift, out_stride = stbi__jpeg_plane_stride(z, n);
+   if (z->idct_block_pair_kernel && !z->img_comp[n].shift)
+      for (; i+1 < count; i += 2)
+         z->idct_block_pair_kernel(out+i*8, out_stride, data+64*i);
+   for (; i < count; ++i)
+      z->img_comp[n].idct(out+i*size, out_stride, data+64*i);
+}
+
+// IDCT rows of blocks of a decoded band, counting through each of the scan's
+// components in turn
+static void stbi__jpeg_idct_band(void *task_data, int begin, int end)
+{
+   stbi__jpeg_band *band = (stbi__jpeg_band *) task_data;
+   stbi__jpeg *z = band->z;
+   int item,k;
+   for (item=begin; item < end; ++item) {
+      int r = item, n = 0, w, first_row;
+      for (k=0; k < z->scan_n; ++k) {
+         n = z->order[k];
+         if (r < stbi__jpeg_band_block_rows(z, n, band->rows)) break;
+         r -= stbi__jpeg_band_block_rows(z, n, band->rows);
+      }
+      w = z->scan_n == 1 ? (z->img_comp[n].x+7) >> 3 : z->img_mcu_x * z->img_comp[n].h;
+      first_row = stbi__jpeg_band_block_rows(z, n, band->row);
+      stbi__jpeg_idct_row(z, n, first_row+r, band->coeff[n] + 64 * r * (z->img_comp[n].w2 >> 3), w);
+   }
+}
+
+// decode a baseline scan a band of MCU rows at a time, then IDCT each band in
+// parallel
+static int stbi__jpeg_decode_bands(stbi__jpeg *z)
+{
+   stbi__jpeg_band band;
+   void *raw_coeff[4] = { NULL, NULL, NULL, NULL };
+   size_t coeff_size[4] = { 0, 0, 0, 0 };
+   int k, result = 1, mcus_per_row, mcu_rows, items;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      mcus_per_row = (z->img_comp[n].x+7) >> 3;
+      mcu_rows = (z->img_comp[n].y+7) >> 3;
+   } else {
+      mcus_per_row = z->img_mcu_x;
+      mcu_rows = z->img_mcu_y;
+   }
+
+   band.z = z;
+   for (k=0; k < z->scan_n; ++k) {
+      int n = z->order[k];
+      coeff_size[n] = (size_t) (z->img_comp[n].w2 >> 3) * stbi__jpeg_band_block_rows(z, n, STBI__JPEG_BAND_MCU_ROWS) * 64 * sizeof(short);
+      raw_coeff[n] = stbi__malloc(z->s->alloc, coeff_size[n] + 15);
+      if (!raw_coeff[n]) result = stbi__err("outofmem", "Out of memory");
+      band.coeff[n] = (short *) (((size_t) raw_coeff[n] + 15) & ~15);
+   }
+
+   for (band.row = 0; band.row < mcu_rows && result == 1; band.row += STBI__JPEG_BAND_MCU_ROWS) {
+      band.rows = mcu_rows - band.row < STBI__JPEG_BAND_MCU_ROWS ? mcu_rows - band.row : STBI__JPEG_BAND_MCU_ROWS;
+      // blocks the data stops short of come out flat, rather than as garbage
+      for (k=0; k < z->scan_n; ++k)
+         memset(band.coeff[z->order[k]], 0, coeff_size[z->order[k]]);
+      result = stbi__jpeg_decode_baseline_mcus(z, band.row * mcus_per_row, (band.row + band.rows) * mcus_per_row, band.coeff, band.row);
+      if (result) {
+         items = 0;
+         for (k=0; k < z->scan_n; ++k)
+            items += stbi__jpeg_band_block_rows(z, z->order[k], band.rows);
+         stbi__jpeg_parallel_for(stbi__jpeg_parallel_user, items, stbi__jpeg_idct_band, &band);
+      }
+   }
+
+   for (k=0; k < 4; ++k)
+      stbi__free(z->s->alloc, raw_coeff[k]);
+   return result != 0;
+}
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+{
+   stbi__jpeg_reset(z);
+   if (!z->progressive) {
+      int mcus = stbi__jpeg_scan_mcus(z);
+      if (stbi__jpeg_parallel_for) {
+         int result = stbi__jpeg_decode_restarts(z, mcus);
+         if (result >= 0) return result;
+         return stbi__jpeg_decode_bands(z);
+      }
+      return stbi__jpeg_decode_baseline_mcus(z, 0, mcus, NULL, 0) != 0;
    } else {
       if (z->scan_n == 1) {
          int i,j;
@@ -2579,22 +3998,36 @@ static void stbi__jpeg_dequantize(short *data, stbi_uc *dequant)
       data[i] *= dequant[i];
 }
 
+// dequantize and idct rows of blocks, counting through each component in turn
+static void stbi__jpeg_finish_rows(void *task_data, int begin, int end)
+{
+   stbi__jpeg *z = (stbi__jpeg *) task_data;
+   int item,i,n;
+   for (item=begin; item < end; ++item) {
+      int j = item;
+      short *blocks;
+      for (n=0; n < z->s->img_n - 1; ++n) {
+         if (j < (z->img_comp[n].y+7) >> 3) break;
+         j -= (z->img_comp[n].y+7) >> 3;
+      }
+      blocks = z->img_comp[n].coeff + 64 * j * z->img_comp[n].coeff_w;
+      for (i=0; i < (z->img_comp[n].x+7) >> 3; ++i)
+         stbi__jpeg_dequantize(blocks + 64*i, z->dequant[z->img_comp[n].tq]);
+      stbi__jpeg_idct_row(z, n, j, blocks, (z->img_comp[n].x+7) >> 3);
+   }
+}
+
 static void stbi__jpeg_finish(stbi__jpeg *z)
 {
    if (z->progressive) {
       // dequantize and idct the data
-      int i,j,n;
-      for (n=0; n < z->s->img_n; ++n) {
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-            }
-         }
-      }
+      int n, rows = 0;
+      for (n=0; n < z->s->img_n; ++n)
+         rows += (z->img_comp[n].y+7) >> 3;
+      if (stbi__jpeg_parallel_for)
+         stbi__jpeg_parallel_for(stbi__jpeg_parallel_user, rows, stbi__jpeg_finish_rows, z);
+      else
+         stbi__jpeg_finish_rows(z, 0, rows);
    }
 }
 
@@ -2704,7 +4137,7 @@ static int stbi__process_scan_header(stbi__jpeg *z)
 static int stbi__process_frame_header(stbi__jpeg *z, int scan)
 {
    stbi__context *s = z->s;
-   int Lf,p,i,q, h_max=1,v_max=1,c;
+   int Lf,p,i,q, h_max=1,v_max=1,c,rows;
    Lf = stbi__get16be(s);         if (Lf < 11) return stbi__err("bad SOF len","Corrupt JPEG"); // JPEG
    p  = stbi__get8(s);            if (p != 8) return stbi__err("only 8-bit","JPEG format not supported: 8-bit only"); // JPEG baseline
    s->img_y = stbi__get16be(s);   if (s->img_y == 0) return stbi__err("no header height", "JPEG format not supported: delayed height"); // Legal, but we don't handle it--but neither does IJG
@@ -2754,6 +4187,18 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
    z->img_mcu_y = (s->img_y + z->img_mcu_h-1) / z->img_mcu_h;
 
    for (i=0; i < s->img_n; ++i) {
+      // at reduced scale, a component subsampled by a power of two is shrunk
+      // that much less, as far as it can be, so its plane comes out nearer the
+      // output's size
+      int hs = h_max / z->img_comp[i].h, vs = v_max / z->img_comp[i].v, sub = 0;
+      if (h_max % z->img_comp[i].h == 0 && v_max % z->img_comp[i].v == 0)
+         while (sub < z->scale_shift && !((hs|vs) & ((2 << sub)-1)))
+            ++sub;
+      z->img_comp[i].shift = z->scale_shift - sub;
+      z->img_comp[i].idct = z->img_comp[i].shift == 3 ? stbi__idct_block_1x1 :
+                            z->img_comp[i].shift == 2 ? stbi__idct_block_2x2 :
+                            z->img_comp[i].shift == 1 ? stbi__idct_block_4x4 : z->idct_block_kernel;
+
       // number of effective pixels (e.g. for non-interleaved MCU)
       z->img_comp[i].x = (s->img_x * z->img_comp[i].h + h_max-1) / h_max;
       z->img_comp[i].y = (s->img_y * z->img_comp[i].v + v_max-1) / v_max;
@@ -2763,11 +4208,15 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // discard the extra data until colorspace conversion
       z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
       z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
-      z->img_comp[i].raw_data = stbi__malloc(z->img_comp[i].w2 * z->img_comp[i].h2+15);
+      z->img_comp[i].first_row = 0;
+      rows = z->img_comp[i].h2 >> z->img_comp[i].shift;
+      if (z->stream && !z->progressive && rows > 3 * 8 * z->img_comp[i].v)
+         rows = 3 * 8 * z->img_comp[i].v;
+      z->img_comp[i].raw_data = stbi__malloc(z->s->alloc, (z->img_comp[i].w2 >> z->img_comp[i].shift) * rows + 15);
 
       if (z->img_comp[i].raw_data == NULL) {
          for(--i; i >= 0; --i) {
-            STBI_FREE(z->img_comp[i].raw_data);
+            stbi__free(z->s->alloc, z->img_comp[i].raw_data);
             z->img_comp[i].raw_data = NULL;
          }
          return stbi__err("outofmem", "Out of memory");
@@ -2778,7 +4227,7 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       if (z->progressive) {
          z->img_comp[i].coeff_w = (z->img_comp[i].w2 + 7) >> 3;
          z->img_comp[i].coeff_h = (z->img_comp[i].h2 + 7) >> 3;
-         z->img_comp[i].raw_coeff = STBI_MALLOC(z->img_comp[i].coeff_w * z->img_comp[i].coeff_h * 64 * sizeof(short) + 15);
+         z->img_comp[i].raw_coeff = stbi__malloc(z->s->alloc, z->img_comp[i].coeff_w * z->img_comp[i].coeff_h * 64 * sizeof(short) + 15);
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
       } else {
          z->img_comp[i].coeff = 0;
@@ -2820,34 +4269,33 @@ static int stbi__decode_jpeg_header(stbi__jpeg *z, int scan)
    return 1;
 }
 
-// decode image to YCbCr format
-static int stbi__decode_jpeg_image(stbi__jpeg *j)
+// decode the scan whose header's just been read
+static int stbi__decode_jpeg_scan(stbi__jpeg *j)
 {
-   int m;
-   for (m = 0; m < 4; m++) {
-      j->img_comp[m].raw_data = NULL;
-      j->img_comp[m].raw_coeff = NULL;
+   if (!stbi__parse_entropy_coded_data(j)) return 0;
+   if (j->marker == STBI__MARKER_none ) {
+      // handle 0s at the end of image data from IP Kamera 9060
+      while (!stbi__at_eof(j->s)) {
+         int x = stbi__get8(j->s);
+         if (x == 255) {
+            j->marker = stbi__get8(j->s);
+            break;
+         } else if (x != 0) {
+            return stbi__err("junk before marker", "Corrupt JPEG");
+         }
+      }
+      // if we reach eof without hitting a marker, stbi__get_marker() below will fail and we'll eventually return 0
    }
-   j->restart_interval = 0;
-   if (!stbi__decode_jpeg_header(j, STBI__SCAN_load)) return 0;
-   m = stbi__get_marker(j);
+   return 1;
+}
+
+// decode the rest of the image, from marker m on
+static int stbi__decode_jpeg_scans(stbi__jpeg *j, int m)
+{
    while (!stbi__EOI(m)) {
       if (stbi__SOS(m)) {
          if (!stbi__process_scan_header(j)) return 0;
-         if (!stbi__parse_entropy_coded_data(j)) return 0;
-         if (j->marker == STBI__MARKER_none ) {
-            // handle 0s at the end of image data from IP Kamera 9060
-            while (!stbi__at_eof(j->s)) {
-               int x = stbi__get8(j->s);
-               if (x == 255) {
-                  j->marker = stbi__get8(j->s);
-                  break;
-               } else if (x != 0) {
-                  return stbi__err("junk before marker", "Corrupt JPEG");
-               }
-            }
-            // if we reach eof without hitting a marker, stbi__get_marker() below will fail and we'll eventually return 0
-         }
+         if (!stbi__decode_jpeg_scan(j)) return 0;
       } else {
          if (!stbi__process_marker(j, m)) return 0;
       }
@@ -2858,6 +4306,19 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
    return 1;
 }
 
+// decode image to YCbCr format
+static int stbi__decode_jpeg_image(stbi__jpeg *j)
+{
+   int m;
+   for (m = 0; m < 4; m++) {
+      j->img_comp[m].raw_data = NULL;
+      j->img_comp[m].raw_coeff = NULL;
+   }
+   j->restart_interval = 0;
+   if (!stbi__decode_jpeg_header(j, STBI__SCAN_load)) return 0;
+   return stbi__decode_jpeg_scans(j, stbi__get_marker(j));
+}
+
 // static jfif-centered resampling (across block boundaries)
 
 typedef stbi_uc *(*resample_row_func)(stbi_uc *out, stbi_uc *in0, stbi_uc *in1,
@@ -3055,6 +4516,85 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// avx2 version of the above, 16 pixels at a time
+static STBI__AVX2 stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   // need to generate 2x2 samples for every one in input
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   // process groups of 16 pixels for as long as we can; the rest, including
+   // the last pixel in the row, are done one at a time
+   for (; i < ((w-1) & ~15); i += 16) {
+      // load and perform the vertical filtering pass
+      // this uses 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff); // current row
+
+      // "prev" and "next" are the current row shifted by a pixel, as
+      // before. the byte shifts only work within lanes, so each one is
+      // aligned against a copy of the row with its lanes moved over by one.
+      __m256i lo_up = _mm256_permute2x128_si256(curr, curr, 0x08); // 0, curr's low lane
+      __m256i hi_dn = _mm256_permute2x128_si256(curr, curr, 0x81); // curr's high lane, 0
+      __m256i prv0  = _mm256_alignr_epi8(curr, lo_up, 14);
+      __m256i nxt0  = _mm256_alignr_epi8(hi_dn, curr, 2);
+      __m256i prev  = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next  = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal filter, polyphase implementation since it's convenient:
+      // even pixels = 3*cur + prev = cur*4 + (prev - cur)
+      // odd  pixels = 3*cur + next = cur*4 + (next - cur)
+      // note the shared term.
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave even and odd pixels, then undo scaling. within each
+      // lane, this comes out in order.
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+
+      // pack and write output
+      __m256i outv = _mm256_packus_epi16(de0, de1);
+      _mm256_storeu_si256((__m256i *) (out + i*2), outv);
+
+      // "previous" value for next iter
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3259,10 +4799,77 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// avx2 version of the step == 4 loop above, 16 pixels at a time, with the
+// same arithmetic. it leaves what's left over to the sse2 version.
+static STBI__AVX2 void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4) {
+      __m256i signflip  = _mm256_set1_epi16(-0x8000); // -128, once they're shifted up
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load, widening to short (rather than unpacking bytes as the
+         // sse2 version does, since unpacks work within lanes)
+         __m256i y_words  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (y+i)));
+         __m256i cr_words = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (pcr+i)));
+         __m256i cb_words = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (pcb+i)));
+
+         // left-shift by 8 (and bias y, and -128 cr, cb)
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(y_words, 8), y_bias);
+         __m256i crw = _mm256_xor_si256(_mm256_slli_epi16(cr_words, 8), signflip);
+         __m256i cbw = _mm256_xor_si256(_mm256_slli_epi16(cb_words, 8), signflip);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte, set up for transpose
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+
+         // transpose to interleave channels. each lane ends up with 4
+         // pixels in o0 and the next 4 in o1.
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+         // store, low lanes first
+         _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+
+   stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
    j->idct_block_kernel = stbi__idct_block;
+   j->idct_block_pair_kernel = NULL;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
@@ -3276,6 +4883,16 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    }
 #endif
 
+#ifdef STBI_AVX2
+   if (stbi__avx2_available()) {
+      j->idct_block_pair_kernel = stbi__idct_avx2_pair;
+      #ifndef STBI_JPEG_OLD
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      #endif
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
+#endif
+
 #ifdef STBI_NEON
    j->idct_block_kernel = stbi__idct_simd;
    #ifndef STBI_JPEG_OLD
@@ -3283,6 +4900,9 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    #endif
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
 #endif
+
+   j->scale_shift = j->s->scale == 8 ? 3 : j->s->scale == 4 ? 2 : j->s->scale == 2 ? 1 : 0;
+   j->stream = 0;
 }
 
 // clean up the temporary component buffers
@@ -3291,17 +4911,17 @@ static void stbi__cleanup_jpeg(stbi__jpeg *j)
    int i;
    for (i=0; i < j->s->img_n; ++i) {
       if (j->img_comp[i].raw_data) {
-         STBI_FREE(j->img_comp[i].raw_data);
+         stbi__free(j->s->alloc, j->img_comp[i].raw_data);
          j->img_comp[i].raw_data = NULL;
          j->img_comp[i].data = NULL;
       }
       if (j->img_comp[i].raw_coeff) {
-         STBI_FREE(j->img_comp[i].raw_coeff);
+         stbi__free(j->s->alloc, j->img_comp[i].raw_coeff);
          j->img_comp[i].raw_coeff = 0;
          j->img_comp[i].coeff = 0;
       }
       if (j->img_comp[i].linebuf) {
-         STBI_FREE(j->img_comp[i].linebuf);
+         stbi__free(j->s->alloc, j->img_comp[i].linebuf);
          j->img_comp[i].linebuf = NULL;
       }
    }
@@ -3317,16 +4937,165 @@ typedef struct
    int ypos;    // which pre-expansion row we're on
 } stbi__resample;
 
-static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+// set up a component's resampling as it would be by output row 'row', having
+// stepped through all the rows before it
+static void stbi__jpeg_resample_seek(stbi__jpeg *z, int k, stbi__resample *r, int row)
 {
+   int steps = row + (r->vs >> 1);
+   int wraps = steps / r->vs;
+   int last = z->img_comp[k].y - 1;
+   int first = z->img_comp[k].first_row;
+   r->ystep = steps % r->vs;
+   r->ypos  = wraps;
+   r->line0 = z->img_comp[k].data + z->img_comp[k].w2 * ((wraps == 0 ? 0 : (wraps-1 < last ? wraps-1 : last)) - first);
+   r->line1 = z->img_comp[k].data + z->img_comp[k].w2 * ((wraps < last ? wraps : last) - first);
+}
+
+// everything the resampling and color conversion of a band of rows needs
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__resample res_comp[4];  // with the row-independent parts set up
+   stbi_uc *output;
+   int row0;                    // the image row 'output' starts at
+   int stride;                  // between output rows
+   int flip;                    // whether the rows go into the output bottom-up
    int n, decode_n;
-   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+   int outofmem;                // set by any band that couldn't get its line buffers
+} stbi__jpeg_convert;
+
+// resample and color-convert output rows [begin, end), using the given line
+// buffers. 3-component rows are converted 4 bytes a pixel, so the last pixel
+// clobbers the first byte after the row. with packed rows, that's the next
+// row, which a later row puts right in serial, or the extra byte on the end of
+// our own buffer. otherwise (that row might've been done already, in parallel
+// or flipped, or it's the caller's padding, or past the end of their buffer),
+// 'spill' is set, and the rows that would clobber something go through there
+static void stbi__jpeg_convert_rows(stbi__jpeg_convert *c, stbi_uc *linebuf[4], stbi_uc *spill, int begin, int end)
+{
+   stbi__jpeg *z = c->z;
+   int n = c->n, k;
+   unsigned int i,j;
+   stbi_uc *coutput[4];
+   stbi__resample res_comp[4];
+   int packed = c->stride == n * (int) z->s->img_x;
+
+   for (k=0; k < c->decode_n; ++k) {
+      res_comp[k] = c->res_comp[k];
+      stbi__jpeg_resample_seek(z, k, &res_comp[k], begin);
+   }
+
+   for (j=begin; j < (unsigned int) end; ++j) {
+      stbi_uc *row_out = c->output + (size_t) c->stride * ((c->flip ? z->s->img_y-1-j : j) - c->row0);
+      int spilled = spill && n == 3 && !(packed && !c->flip && j+1 < (unsigned int) end);
+      stbi_uc *out = spilled ? spill : row_out;
+      for (k=0; k < c->decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (z->rgb == 3) {
+               for (i=0; i < z->s->img_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         stbi_uc *y = coutput[0];
+         if (n == 1)
+            for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+         else
+            for (i=0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
+      }
+      if (spilled)
+         memcpy(row_out, spill, n * z->s->img_x);
+   }
+}
 
-   // validate req_comp
-   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+// how many output rows each parallel task resamples and color-converts
+#define STBI__JPEG_CONVERT_ROWS 32
 
-   // load a jpeg image from whichever source, but leave in YCbCr format
-   if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+static void stbi__jpeg_convert_bands(void *task_data, int begin, int end)
+{
+   stbi__jpeg_convert *c = (stbi__jpeg_convert *) task_data;
+   stbi_uc *linebuf[4] = { NULL, NULL, NULL, NULL };
+   stbi_uc *spill = (stbi_uc *) stbi__malloc(c->z->s->alloc, c->n * c->z->s->img_x + 1);
+   int k, ok = spill != NULL, band;
+   for (k=0; k < c->decode_n; ++k) {
+      linebuf[k] = (stbi_uc *) stbi__malloc(c->z->s->alloc, c->z->s->img_x + 3);
+      if (!linebuf[k]) ok = 0;
+   }
+   if (!ok)
+      c->outofmem = 1;
+   else
+      for (band=begin; band < end; ++band) {
+         int last = (band+1) * STBI__JPEG_CONVERT_ROWS;
+         stbi__jpeg_convert_rows(c, linebuf, spill, band * STBI__JPEG_CONVERT_ROWS, last < (int) c->z->s->img_y ? last : (int) c->z->s->img_y);
+      }
+   for (k=0; k < c->decode_n; ++k)
+      stbi__free(c->z->s->alloc, linebuf[k]);
+   stbi__free(c->z->s->alloc, spill);
+}
+
+// set up the row-independent parts of resampling component k
+static void stbi__jpeg_resample_setup(stbi__jpeg *z, int k, stbi__resample *r)
+{
+   r->hs      = z->img_h_max / z->img_comp[k].h;
+   r->vs      = z->img_v_max / z->img_comp[k].v;
+   r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
+
+   if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+   else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+   else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+   else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+   else                               r->resample = stbi__resample_row_generic;
+}
+
+// resample and color-convert the decoded image
+static stbi_uc *stbi__jpeg_output(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+{
+   int n, decode_n;
+
+   // at reduced scale, the planes are smaller, and from here on, so's the
+   // image. components that were shrunk less are that much less subsampled
+   if (z->scale_shift) {
+      int k, scale = 1 << z->scale_shift;
+      z->s->img_x = (z->s->img_x + scale-1) >> z->scale_shift;
+      z->s->img_y = (z->s->img_y + scale-1) >> z->scale_shift;
+      for (k=0; k < z->s->img_n; ++k) {
+         int sub = z->scale_shift - z->img_comp[k].shift;
+         z->img_comp[k].w2 >>= z->img_comp[k].shift;
+         z->img_comp[k].h2 >>= z->img_comp[k].shift;
+         z->img_comp[k].h <<= sub;
+         z->img_comp[k].v <<= sub;
+         z->img_comp[k].x = (z->s->img_x * z->img_comp[k].h + z->img_h_max-1) / z->img_h_max;
+         z->img_comp[k].y = (z->s->img_y * z->img_comp[k].v + z->img_v_max-1) / z->img_v_max;
+      }
+      z->s->scaled = 1;
+   }
 
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n;
@@ -3339,83 +5108,63 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // resample and color-convert
    {
       int k;
-      unsigned int i,j;
       stbi_uc *output;
-      stbi_uc *coutput[4];
-
-      stbi__resample res_comp[4];
-
+      stbi_uc *linebuf[4];
+      stbi__jpeg_convert convert;
+
+      convert.z = z;
+      convert.n = n;
+      convert.decode_n = decode_n;
+      convert.outofmem = 0;
+      convert.row0 = 0;
       for (k=0; k < decode_n; ++k) {
-         stbi__resample *r = &res_comp[k];
-
          // allocate line buffer big enough for upsampling off the edges
          // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
+         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->alloc, z->s->img_x + 3);
          if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         linebuf[k] = z->img_comp[k].linebuf;
+         stbi__jpeg_resample_setup(z, k, &convert.res_comp[k]);
+      }
 
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
-         r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
-         r->ypos    = 0;
-         r->line0   = r->line1 = z->img_comp[k].data;
-
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-         else                               r->resample = stbi__resample_row_generic;
-      }
-
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc(n * z->s->img_x * z->s->img_y + 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
+      // straight into the caller's buffer, if there is one, flipping as we go
+      if (z->s->out) {
+         if (!stbi__check_out(z->s, z->s->img_x, z->s->img_y, n)) { stbi__cleanup_jpeg(z); return NULL; }
+         output = z->s->out;
+         convert.stride = z->s->out_stride;
+      } else {
+         // can't error after this so, this is safe
+         output = (stbi_uc *) stbi__malloc(z->s->alloc, n * z->s->img_x * z->s->img_y + 1);
+         if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         convert.stride = n * z->s->img_x;
+      }
+      convert.output = output;
+      convert.flip = z->s->flip;
+
+      // now go ahead and resample, in bands across threads if we can. each band
+      // works out where its rows' resampling is at afresh, so they don't depend
+      // on each other
+      if (stbi__jpeg_parallel_for && z->s->img_y > STBI__JPEG_CONVERT_ROWS) {
+         int bands = (z->s->img_y + STBI__JPEG_CONVERT_ROWS-1) / STBI__JPEG_CONVERT_ROWS;
+         stbi__jpeg_parallel_for(stbi__jpeg_parallel_user, bands, stbi__jpeg_convert_bands, &convert);
+         if (convert.outofmem) {
+            if (output != z->s->out) stbi__free(z->s->alloc, output);
+            stbi__cleanup_jpeg(z);
+            return stbi__errpuc("outofmem", "Out of memory");
          }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (z->rgb == 3) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            stbi_uc *y = coutput[0];
-            if (n == 1)
-               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-            else
-               for (i=0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
+      } else {
+         stbi_uc *spill = NULL;
+         if (n == 3 && (z->s->out || z->s->flip)) {
+            spill = (stbi_uc *) stbi__malloc(z->s->alloc, n * z->s->img_x + 1);
+            if (!spill) {
+               if (output != z->s->out) stbi__free(z->s->alloc, output);
+               stbi__cleanup_jpeg(z);
+               return stbi__errpuc("outofmem", "Out of memory");
+            }
          }
+         stbi__jpeg_convert_rows(&convert, linebuf, spill, 0, z->s->img_y);
+         stbi__free(z->s->alloc, spill);
       }
+      z->s->flipped = z->s->flip;
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
@@ -3424,17 +5173,201 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    }
 }
 
+static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+{
+   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+
+   // validate req_comp
+   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+
+   // load a jpeg image from whichever source, but leave in YCbCr format
+   if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+
+   return stbi__jpeg_output(z, out_x, out_y, comp, req_comp);
+}
+
 static unsigned char *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    unsigned char* result;
-   stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
+   stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(s->alloc, sizeof(stbi__jpeg));
    j->s = s;
    stbi__setup_jpeg(j);
    result = load_jpeg_image(j, x,y,comp,req_comp);
-   STBI_FREE(j);
+   stbi__free(s->alloc, j);
    return result;
 }
 
+// a baseline jpeg being decoded a band at a time. it's decoded an MCU row at
+// a time (or a row of blocks, for a non-interleaved scan), into planes that
+// hold the last three, which is as much as upsampling the rows of the middle
+// one needs. those are what each band holds, bar the last one, which holds
+// the last two
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__jpeg_convert convert;
+   int mcu_row, mcu_rows, mcus_per_row;
+   int rows_per_mcu_row;   // output rows
+   int stopped;            // the data stopped short
+   stbi_uc *band;
+} stbi__jpeg_stream;
+
+// plane rows of component n in an MCU row
+static int stbi__jpeg_stream_plane_rows(stbi__jpeg *z, int n)
+{
+   return z->scan_n == 1 ? 8 : 8 * z->img_comp[n].v;
+}
+
+static stbi_uc *stbi__jpeg_stream_rows(stbi__stream *st, int *num_rows)
+{
+   stbi__jpeg_stream *j = (stbi__jpeg_stream *) st->state;
+   stbi__jpeg *z = j->z;
+   stbi_uc *linebuf[4];
+   int k, end;
+   do {
+      // drop the oldest MCU row to make room for the next one
+      for (k=0; k < z->scan_n; ++k) {
+         int n = z->order[k], rows = stbi__jpeg_stream_plane_rows(z, n);
+         if ((j->mcu_row + 1) * rows > z->img_comp[n].first_row + 3 * rows) {
+            size_t size = (size_t) z->img_comp[n].w2 * rows;
+            memmove(z->img_comp[n].data, z->img_comp[n].data + size, size * 2);
+            z->img_comp[n].first_row += rows;
+         }
+      }
+      // once the data stops short, the rest of the rows are left as they were
+      if (!j->stopped) {
+         int r = stbi__jpeg_decode_baseline_mcus(z, j->mcu_row * j->mcus_per_row, (j->mcu_row + 1) * j->mcus_per_row, NULL, 0);
+         if (r == 0) return NULL;
+         if (r == 2) j->stopped = 1;
+      }
+      ++j->mcu_row;
+      end = j->mcu_row == j->mcu_rows ? st->y : (j->mcu_row - 1) * j->rows_per_mcu_row;
+   } while (end <= st->row);
+
+   for (k=0; k < j->convert.decode_n; ++k)
+      linebuf[k] = z->img_comp[k].linebuf;
+   j->convert.row0 = st->row;
+   stbi__jpeg_convert_rows(&j->convert, linebuf, NULL, st->row, end);
+   *num_rows = end - st->row;
+   return j->band;
+}
+
+// whether the image is one that can be decoded a band at a time
+static int stbi__jpeg_streamable(stbi__jpeg *z)
+{
+   int k;
+   if (z->progressive || z->scan_n != z->s->img_n) return 0;
+   for (k=0; k < z->s->img_n; ++k)
+      if (z->img_v_max % z->img_comp[k].v) return 0;
+   return 1;
+}
+
+// swap the windows of rows for whole planes, to decode the image whole
+static int stbi__jpeg_whole_planes(stbi__jpeg *z)
+{
+   int k;
+   for (k=0; k < z->s->img_n; ++k) {
+      stbi__free(z->s->alloc, z->img_comp[k].raw_data);
+      z->img_comp[k].raw_data = stbi__malloc(z->s->alloc, z->img_comp[k].w2 * z->img_comp[k].h2 + 15);
+      if (z->img_comp[k].raw_data == NULL) return stbi__err("outofmem", "Out of memory");
+      z->img_comp[k].data = (stbi_uc*) (((size_t) z->img_comp[k].raw_data + 15) & ~15);
+      z->img_comp[k].first_row = 0;
+   }
+   return 1;
+}
+
+static void stbi__jpeg_stream_close(stbi__stream *st)
+{
+   stbi__jpeg_stream *j = (stbi__jpeg_stream *) st->state;
+   if (j == NULL) return;
+   stbi__cleanup_jpeg(j->z);
+   STBI_FREE(j->band);
+   STBI_FREE(j->z);
+   STBI_FREE(j);
+}
+
+static int stbi__jpeg_stream_start(stbi__stream *st, int req_comp)
+{
+   stbi__jpeg_stream *j = (stbi__jpeg_stream *) STBI_MALLOC(sizeof(stbi__jpeg_stream));
+   stbi__jpeg *z = (stbi__jpeg *) STBI_MALLOC(sizeof(stbi__jpeg));
+   int m, k;
+   if (j == NULL || z == NULL) {
+      STBI_FREE(j);
+      STBI_FREE(z);
+      return stbi__err("outofmem", "Out of memory");
+   }
+   st->state = j;
+   st->next_rows = stbi__jpeg_stream_rows;
+   st->close = stbi__jpeg_stream_close;
+   j->z = z;
+   j->band = NULL;
+   z->s = &st->s;
+   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+   stbi__setup_jpeg(z);
+   z->stream = 1;
+   for (m = 0; m < 4; m++) {
+      z->img_comp[m].raw_data = NULL;
+      z->img_comp[m].raw_coeff = NULL;
+      z->img_comp[m].linebuf = NULL;
+   }
+   z->restart_interval = 0;
+   if (!stbi__decode_jpeg_header(z, STBI__SCAN_load)) return 0;
+
+   // read up to the first scan's data
+   m = stbi__get_marker(z);
+   while (!stbi__SOS(m)) {
+      if (stbi__EOI(m)) return stbi__err("no SOS", "Corrupt JPEG");
+      if (!stbi__process_marker(z, m)) return 0;
+      m = stbi__get_marker(z);
+   }
+   if (!stbi__process_scan_header(z)) return 0;
+
+   if (!stbi__jpeg_streamable(z)) {
+      if (!z->progressive && !stbi__jpeg_whole_planes(z)) return 0;
+      if (!stbi__decode_jpeg_scan(z)) return 0;
+      if (!stbi__decode_jpeg_scans(z, stbi__get_marker(z))) return 0;
+      st->image = stbi__jpeg_output(z, &st->x, &st->y, &st->comp, req_comp);
+      st->n = req_comp ? req_comp : st->comp;
+      return st->image != NULL;
+   }
+
+   st->x = z->s->img_x;
+   st->y = z->s->img_y;
+   st->comp = z->s->img_n;
+   st->n = req_comp ? req_comp : st->comp;
+
+   j->mcu_row = 0;
+   j->stopped = 0;
+   if (z->scan_n == 1) {
+      j->mcus_per_row = (z->img_comp[z->order[0]].x+7) >> 3;
+      j->mcu_rows = (z->img_comp[z->order[0]].y+7) >> 3;
+      j->rows_per_mcu_row = 8;
+   } else {
+      j->mcus_per_row = z->img_mcu_x;
+      j->mcu_rows = z->img_mcu_y;
+      j->rows_per_mcu_row = z->img_mcu_h;
+   }
+
+   j->convert.z = z;
+   j->convert.n = st->n;
+   j->convert.decode_n = z->s->img_n == 3 && st->n < 3 ? 1 : z->s->img_n;
+   j->convert.stride = st->n * st->x;
+   j->convert.flip = 0;
+   j->convert.outofmem = 0;
+   for (k=0; k < j->convert.decode_n; ++k) {
+      z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->alloc, z->s->img_x + 3);
+      if (!z->img_comp[k].linebuf) return stbi__err("outofmem", "Out of memory");
+      stbi__jpeg_resample_setup(z, k, &j->convert.res_comp[k]);
+   }
+   // the last band's two MCU rows, and a byte for 3-component rows to clobber
+   j->band = (stbi_uc *) STBI_MALLOC((size_t) j->convert.stride * j->rows_per_mcu_row * 2 + 1);
+   if (!j->band) return stbi__err("outofmem", "Out of memory");
+   j->convert.output = j->band;
+
+   stbi__jpeg_reset(z);
+   return 1;
+}
+
 static int stbi__jpeg_test(stbi__context *s)
 {
    int r;
@@ -3461,10 +5394,10 @@ static int stbi__jpeg_info_raw(stbi__jpeg *j, int *x, int *y, int *comp)
 static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 {
    int result;
-   stbi__jpeg* j = (stbi__jpeg*) (stbi__malloc(sizeof(stbi__jpeg)));
+   stbi__jpeg* j = (stbi__jpeg*) (stbi__malloc(s->alloc, sizeof(stbi__jpeg)));
    j->s = s;
    result = stbi__jpeg_info_raw(j, x, y, comp);
-   STBI_FREE(j);
+   stbi__free(s->alloc, j);
    return result;
 }
 #endif
@@ -3475,6 +5408,9 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
 //      - fast huffman
+//      - a fast path for the bulk of each block: 64-bit bit buffer, tables
+//        that resolve lengths/distances with their extra bits, and pairs of
+//        literals, and matches copied 8 bytes at a time
 
 #ifndef STBI_NO_ZLIB
 
@@ -3482,6 +5418,13 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 
+// the fast path's tables resolve whole literal/length and distance codes,
+// extra bits and all, and pairs of literals where they both fit
+#define STBI__ZFAST_LENGTH_BITS  11
+#define STBI__ZFAST_LENGTH_MASK  ((1 << STBI__ZFAST_LENGTH_BITS) - 1)
+#define STBI__ZFAST_DIST_BITS    10
+#define STBI__ZFAST_DIST_MASK    ((1 << STBI__ZFAST_DIST_BITS) - 1)
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -3564,7 +5507,9 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, stbi_uc *sizelist, int num)
 //    we require PNG read all the IDATs and combine them into a single
 //    memory buffer
 
-typedef struct
+typedef struct stbi__zbuf stbi__zbuf;
+
+struct stbi__zbuf
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
@@ -3574,13 +5519,30 @@ typedef struct
    char *zout_start;
    char *zout_end;
    int   z_expandable;
+   stbi_allocator const *alloc; // what an expandable zout is grown through
+
+   // for inflating a piece at a time (see stbi__zinflate_some): where more
+   // input comes from once zbuffer runs out, which returns 0 if there isn't
+   // any, and where we stopped in the stream. the fast path can give back a
+   // few bytes it read ahead, so a refill has to leave the 8 bytes before the
+   // new zbuffer holding the ones that came before it
+   int (*refill)(stbi__zbuf *z);
+   int z_pause;     // stop before zout runs out of room, rather than growing it
+   int final;       // the block we're in is the last one
+   int block;       // 0 between blocks, 1 in a huffman one, 2 in a stored one
+   int stored_left; // bytes still to copy from a stored block
 
    stbi__zhuffman z_length, z_distance;
-} stbi__zbuf;
+
+   // the fast path's tables, see stbi__zbuild_fast_tables
+   stbi__uint32 zfast_length[1 << STBI__ZFAST_LENGTH_BITS];
+   stbi__uint32 zfast_distance[1 << STBI__ZFAST_DIST_BITS];
+};
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
 {
-   if (z->zbuffer >= z->zbuffer_end) return 0;
+   if (z->zbuffer >= z->zbuffer_end)
+      if (!z->refill || !z->refill(z)) return 0;
    return *z->zbuffer++;
 }
 
@@ -3603,12 +5565,14 @@ stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
    return k;
 }
 
-static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+// decode the symbol at the bottom of 'code', which must have at least 16
+// bits in it, without consuming it; its size goes in *size
+static int stbi__zhuffman_peek_slowpath(stbi__zhuffman *z, unsigned int code, int *size)
 {
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse(code, 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -3616,9 +5580,27 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    // code size is s, so:
    b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
    STBI_ASSERT(z->size[b] == s);
+   *size = s;
+   return z->value[b];
+}
+
+stbi_inline static int stbi__zhuffman_peek(stbi__zhuffman *z, unsigned int code, int *size)
+{
+   int b = z->fast[code & STBI__ZFAST_MASK];
+   if (b) {
+      *size = b >> 9;
+      return b & 511;
+   }
+   return stbi__zhuffman_peek_slowpath(z, code, size);
+}
+
+static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+{
+   int s, v = stbi__zhuffman_peek_slowpath(z, a->code_buffer, &s);
+   if (v < 0) return -1;
    a->code_buffer >>= s;
    a->num_bits -= s;
-   return z->value[b];
+   return v;
 }
 
 stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
@@ -3645,8 +5627,7 @@ static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room
    limit = old_limit = (int) (z->zout_end - z->zout_start);
    while (cur + n > limit)
       limit *= 2;
-   q = (char *) STBI_REALLOC_SIZED(z->zout_start, old_limit, limit);
-   STBI_NOTUSED(old_limit);
+   q = (char *) stbi__realloc(z->alloc, z->zout_start, old_limit, limit);
    if (q == NULL) return stbi__err("outofmem", "Out of memory");
    z->zout_start = q;
    z->zout       = q + cur;
@@ -3668,11 +5649,227 @@ static int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,
 static int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+// fast path table entries: the number of bits to consume in the bottom 6
+// bits, then what kind of entry it is. a zero entry means the code didn't
+// fit, so it has to be decoded with the regular tables.
+#define STBI__ZFAST_LITERAL  (1 << 6)  // literal in bits 16-23
+#define STBI__ZFAST_LITERAL2 (1 << 7)  // and another in bits 24-31
+#define STBI__ZFAST_LENGTH   (1 << 8)  // length, or distance, in bits 16-31
+#define STBI__ZFAST_END      (1 << 9)  // end of block
+
+// the codes for each symbol, bit-reversed as they come out of the stream,
+// from code lengths the regular tables have already validated
+static void stbi__zfast_codes(stbi_uc *sizelist, int num, int *codes)
+{
+   int i, code = 0, next_code[16], sizes[16];
+   memset(sizes, 0, sizeof(sizes));
+   for (i=0; i < num; ++i)
+      ++sizes[sizelist[i]];
+   sizes[0] = 0;
+   for (i=1; i < 16; ++i) {
+      next_code[i] = code;
+      code = (code + sizes[i]) << 1;
+   }
+   for (i=0; i < num; ++i)
+      if (sizelist[i])
+         codes[i] = stbi__bit_reverse(next_code[sizelist[i]]++, sizelist[i]);
+}
+
+// fill in all the entries of a table starting with a code of 'bits' bits
+static void stbi__zfast_fill(stbi__uint32 *table, int table_bits, int code, int bits, stbi__uint32 entry)
+{
+   for (; code < (1 << table_bits); code += 1 << bits)
+      table[code] = entry;
+}
+
+// a symbol with 'extra' extra bits: one entry for each value they could have
+static void stbi__zfast_fill_extra(stbi__uint32 *table, int table_bits, int code, int bits, int extra, int base)
+{
+   int x;
+   if (bits + extra > table_bits) return;
+   for (x=0; x < (1 << extra); ++x)
+      stbi__zfast_fill(table, table_bits, code | (x << bits), bits + extra,
+         (stbi__uint32) (bits + extra) | STBI__ZFAST_LENGTH | ((stbi__uint32) (base + x) << 16));
+}
+
+static void stbi__zbuild_fast_tables(stbi__zbuf *a, stbi_uc *length_sizes, int num_lengths, stbi_uc *dist_sizes, int num_dists)
+{
+   int codes[288], i, j;
+   stbi__uint32 *table = a->zfast_length;
+
+   memset(a->zfast_length, 0, sizeof(a->zfast_length));
+   stbi__zfast_codes(length_sizes, num_lengths, codes);
+   for (i=0; i < num_lengths; ++i) {
+      int s = length_sizes[i];
+      if (!s) continue;
+      if (i < 256) {
+         if (s <= STBI__ZFAST_LENGTH_BITS)
+            stbi__zfast_fill(table, STBI__ZFAST_LENGTH_BITS, codes[i], s, (stbi__uint32) s | STBI__ZFAST_LITERAL | ((stbi__uint32) i << 16));
+      } else if (i == 256) {
+         if (s <= STBI__ZFAST_LENGTH_BITS)
+            stbi__zfast_fill(table, STBI__ZFAST_LENGTH_BITS, codes[i], s, (stbi__uint32) s | STBI__ZFAST_END);
+      } else if (i < 286) {
+         stbi__zfast_fill_extra(table, STBI__ZFAST_LENGTH_BITS, codes[i], s, stbi__zlength_extra[i-257], stbi__zlength_base[i-257]);
+      }
+   }
+
+   // pair up literals that fit together. each entry's second literal is the
+   // entry for the bits after the first one, which is at a lower index, so
+   // going down from the top means it hasn't been paired up itself yet.
+   for (j=(1 << STBI__ZFAST_LENGTH_BITS) - 1; j >= 0; --j) {
+      stbi__uint32 e = table[j], e2;
+      int s = e & 63;
+      if (!(e & STBI__ZFAST_LITERAL)) continue;
+      e2 = table[j >> s];
+      if ((e2 & STBI__ZFAST_LITERAL) && (int) (e2 & 63) <= STBI__ZFAST_LENGTH_BITS - s)
+         table[j] = (stbi__uint32) (s + (e2 & 63)) | STBI__ZFAST_LITERAL | STBI__ZFAST_LITERAL2 | (e & 0xff0000) | ((e2 & 0xff0000) << 8);
+   }
+
+   memset(a->zfast_distance, 0, sizeof(a->zfast_distance));
+   stbi__zfast_codes(dist_sizes, num_dists, codes);
+   for (i=0; i < num_dists && i < 30; ++i)
+      if (dist_sizes[i])
+         stbi__zfast_fill_extra(a->zfast_distance, STBI__ZFAST_DIST_BITS, codes[i], dist_sizes[i], stbi__zdist_extra[i], stbi__zdist_base[i]);
+}
+
+// the fast path runs while there's at least a word of input left, and room
+// for two literals or a whole match, plus what the 8-byte copies overshoot by
+#define STBI__ZFAST_OUTPUT_MARGIN  (258 + 8)
+
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+   // compilers make this a single load on little-endian targets
+   return  (stbi__uint64) p[0]        | ((stbi__uint64) p[1] <<  8) | ((stbi__uint64) p[2] << 16) | ((stbi__uint64) p[3] << 24) |
+          ((stbi__uint64) p[4] << 32) | ((stbi__uint64) p[5] << 40) | ((stbi__uint64) p[6] << 48) | ((stbi__uint64) p[7] << 56);
+}
+
+// decode as much of a huffman block as the margins allow, with a 64-bit bit
+// buffer that's topped up a word at a time. returns 0 on error, and sets
+// *end_of_block if it got to the end.
+static int stbi__parse_huffman_fast(stbi__zbuf *a, int *end_of_block)
+{
+   stbi_uc *in = a->zbuffer;
+   char *zout = a->zout;
+   stbi__uint64 bits = a->code_buffer;
+   int num_bits = a->num_bits;
+   int result = 1;
+
+   *end_of_block = 0;
+   while (a->zbuffer_end - in >= 8 && a->zout_end - zout >= STBI__ZFAST_OUTPUT_MARGIN) {
+      stbi__uint32 e;
+      int len, dist, s, z;
+      char *p;
+
+      // top up to at least 56 bits, which is enough for a whole length and
+      // distance with their extra bits. the top few bits may be part of a
+      // byte that isn't counted yet; the next top-up ORs in the same bits.
+      bits |= stbi__zload64(in) << num_bits;
+      in += (63 - num_bits) >> 3;
+      num_bits |= 56;
+
+      e = a->zfast_length[bits & STBI__ZFAST_LENGTH_MASK];
+      if (e & STBI__ZFAST_LITERAL) {
+         zout[0] = (char) (e >> 16);
+         zout[1] = (char) (e >> 24);
+         zout += (e & STBI__ZFAST_LITERAL2) ? 2 : 1;
+         bits >>= e & 63;
+         num_bits -= e & 63;
+         continue;
+      }
+      if (e & STBI__ZFAST_END) {
+         bits >>= e & 63;
+         num_bits -= e & 63;
+         *end_of_block = 1;
+         break;
+      }
+      if (e) {
+         len = (int) (e >> 16);
+         bits >>= e & 63;
+         num_bits -= e & 63;
+      } else {
+         z = stbi__zhuffman_peek(&a->z_length, (unsigned int) bits, &s);
+         if (z < 0 || z >= 286) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+         bits >>= s;
+         num_bits -= s;
+         if (z < 256) {
+            *zout++ = (char) z;
+            continue;
+         }
+         if (z == 256) {
+            *end_of_block = 1;
+            break;
+         }
+         z -= 257;
+         len = stbi__zlength_base[z] + (int) (bits & ((1 << stbi__zlength_extra[z]) - 1));
+         bits >>= stbi__zlength_extra[z];
+         num_bits -= stbi__zlength_extra[z];
+      }
+
+      e = a->zfast_distance[bits & STBI__ZFAST_DIST_MASK];
+      if (e) {
+         dist = (int) (e >> 16);
+         bits >>= e & 63;
+         num_bits -= e & 63;
+      } else {
+         z = stbi__zhuffman_peek(&a->z_distance, (unsigned int) bits, &s);
+         if (z < 0 || z >= 30) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+         bits >>= s;
+         num_bits -= s;
+         dist = stbi__zdist_base[z] + (int) (bits & ((1 << stbi__zdist_extra[z]) - 1));
+         bits >>= stbi__zdist_extra[z];
+         num_bits -= stbi__zdist_extra[z];
+      }
+      if (zout - a->zout_start < dist) { result = stbi__err("bad dist","Corrupt PNG"); break; }
+
+      // copy the match. from 8 bytes back or more, 8-byte copies only ever
+      // read what's already been written; closer than that, they'd overlap.
+      p = zout - dist;
+      if (dist == 1) {
+         memset(zout, *p, len);
+         zout += len;
+      } else if (dist < 8) {
+         do *zout++ = *p++; while (--len);
+      } else {
+         char *end = zout + len;
+         do {
+            memcpy(zout, p, 8);
+            zout += 8;
+            p += 8;
+         } while (zout < end);
+         zout = end;
+      }
+   }
+
+   // give back the whole bytes still in the bit buffer, leaving less than a
+   // byte, which the regular 32-bit one can take
+   in -= num_bits >> 3;
+   num_bits &= 7;
+   a->zbuffer = in;
+   a->code_buffer = (stbi__uint32) bits & ((1u << num_bits) - 1);
+   a->num_bits = num_bits;
+   a->zout = zout;
+   return result;
+}
+
+// returns 0 on errors, 1 at the end of the block, and 2 if it stopped for room
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+      if (a->z_pause && a->zout_end - zout < 258) {
+         a->zout = zout;
+         return 2;
+      }
+      if (a->zbuffer_end - a->zbuffer >= 8 && a->zout_end - zout >= STBI__ZFAST_OUTPUT_MARGIN) {
+         int end_of_block;
+         a->zout = zout;
+         if (!stbi__parse_huffman_fast(a, &end_of_block)) return 0;
+         if (end_of_block) return 1;
+         zout = a->zout;
+         continue; // it stopped for input or room; see which before going on
+      }
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -3753,10 +5950,12 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
    if (n != hlit+hdist) return stbi__err("bad codelengths","Corrupt PNG");
    if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
    if (!stbi__zbuild_huffman(&a->z_distance, lencodes+hlit, hdist)) return 0;
+   stbi__zbuild_fast_tables(a, lencodes, hlit, lencodes+hlit, hdist);
    return 1;
 }
 
-static int stbi__parse_uncompressed_block(stbi__zbuf *a)
+// read a stored block's header, returning its length, or -1 if it's corrupt
+static int stbi__parse_uncompressed_header(stbi__zbuf *a)
 {
    stbi_uc header[4];
    int len,nlen,k;
@@ -3775,7 +5974,17 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
       header[k++] = stbi__zget8(a);
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
-   if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
+   if (nlen != (len ^ 0xffff)) {
+      stbi__err("zlib corrupt","Corrupt PNG");
+      return -1;
+   }
+   return len;
+}
+
+static int stbi__parse_uncompressed_block(stbi__zbuf *a)
+{
+   int len = stbi__parse_uncompressed_header(a);
+   if (len < 0) return 0;
    if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    if (a->zout + len > a->zout_end)
       if (!stbi__zexpand(a, a->zout, len)) return 0;
@@ -3811,6 +6020,20 @@ static void stbi__init_zdefaults(void)
    for (i=0; i <=  31; ++i)     stbi__zdefault_distance[i] = 5;
 }
 
+// set up the tables for a block of type 1 (fixed codes) or 2 (dynamic ones)
+static int stbi__start_huffman_block(stbi__zbuf *a, int type)
+{
+   if (type == 1) {
+      // use fixed code lengths
+      if (!stbi__zdefault_distance[31]) stbi__init_zdefaults();
+      if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , 288)) return 0;
+      if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
+      stbi__zbuild_fast_tables(a, stbi__zdefault_length, 288, stbi__zdefault_distance, 32);
+      return 1;
+   }
+   return stbi__compute_huffman_codes(a);
+}
+
 static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
 {
    int final, type;
@@ -3826,46 +6049,100 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
       } else if (type == 3) {
          return 0;
       } else {
-         if (type == 1) {
-            // use fixed code lengths
-            if (!stbi__zdefault_distance[31]) stbi__init_zdefaults();
-            if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , 288)) return 0;
-            if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
-         } else {
-            if (!stbi__compute_huffman_codes(a)) return 0;
-         }
+         if (!stbi__start_huffman_block(a, type)) return 0;
          if (!stbi__parse_huffman_block(a)) return 0;
       }
    } while (!final);
    return 1;
 }
 
+#ifndef STBI_NO_PNG
+// start inflating a stream a piece at a time, with stbi__zinflate_some
+static int stbi__zinflate_start(stbi__zbuf *a, int parse_header)
+{
+   if (parse_header)
+      if (!stbi__parse_zlib_header(a)) return 0;
+   a->num_bits = 0;
+   a->code_buffer = 0;
+   a->final = 0;
+   a->block = 0;
+   a->z_pause = 1;
+   return 1;
+}
+
+// inflate into zout until there's less than a match's worth of room left, or
+// the stream ends, picking up wherever the last call stopped. the caller
+// makes room by moving what's in zout down, keeping the last 32K of it for
+// matches to copy from. returns 0 on errors, 1 at the end of the stream, and
+// 2 if it stopped for room
+static int stbi__zinflate_some(stbi__zbuf *a)
+{
+   for(;;) {
+      if (a->block == 1) {
+         int r = stbi__parse_huffman_block(a);
+         if (r != 1) return r;
+         a->block = 0;
+      } else if (a->block == 2) {
+         for (; a->stored_left; --a->stored_left) {
+            if (a->zout_end - a->zout < 258) return 2;
+            *a->zout++ = (char) stbi__zget8(a);
+         }
+         a->block = 0;
+      } else {
+         int type;
+         if (a->final) return 1;
+         a->final = stbi__zreceive(a,1);
+         type = stbi__zreceive(a,2);
+         if (type == 0) {
+            a->stored_left = stbi__parse_uncompressed_header(a);
+            if (a->stored_left < 0) return 0;
+            a->block = 2;
+         } else if (type == 3) {
+            return 0;
+         } else {
+            if (!stbi__start_huffman_block(a, type)) return 0;
+            a->block = 1;
+         }
+      }
+   }
+}
+#endif
+
 static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse_header)
 {
    a->zout_start = obuf;
    a->zout       = obuf;
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
+   a->z_pause = 0;
 
    return stbi__parse_zlib(a, parse_header);
 }
 
-STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen)
+// decode into a buffer allocated, and grown as need be, through 'alloc'
+static char *stbi__zlib_decode_malloc(stbi_allocator const *alloc, const char *buffer, int len, int initial_size, int *outlen, int parse_header)
 {
    stbi__zbuf a;
-   char *p = (char *) stbi__malloc(initial_size);
+   char *p = (char *) stbi__malloc(alloc, initial_size);
    if (p == NULL) return NULL;
+   a.alloc = alloc;
+   a.refill = NULL;
    a.zbuffer = (stbi_uc *) buffer;
    a.zbuffer_end = (stbi_uc *) buffer + len;
-   if (stbi__do_zlib(&a, p, initial_size, 1, 1)) {
+   if (stbi__do_zlib(&a, p, initial_size, 1, parse_header)) {
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
    } else {
-      STBI_FREE(a.zout_start);
+      stbi__free(alloc, a.zout_start);
       return NULL;
    }
 }
 
+STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen)
+{
+   return stbi__zlib_decode_malloc(NULL, buffer, len, initial_size, outlen, 1);
+}
+
 STBIDEF char *stbi_zlib_decode_malloc(char const *buffer, int len, int *outlen)
 {
    return stbi_zlib_decode_malloc_guesssize(buffer, len, 16384, outlen);
@@ -3873,23 +6150,14 @@ STBIDEF char *stbi_zlib_decode_malloc(char const *buffer, int len, int *outlen)
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize_headerflag(const char *buffer, int len, int initial_size, int *outlen, int parse_header)
 {
-   stbi__zbuf a;
-   char *p = (char *) stbi__malloc(initial_size);
-   if (p == NULL) return NULL;
-   a.zbuffer = (stbi_uc *) buffer;
-   a.zbuffer_end = (stbi_uc *) buffer + len;
-   if (stbi__do_zlib(&a, p, initial_size, 1, parse_header)) {
-      if (outlen) *outlen = (int) (a.zout - a.zout_start);
-      return a.zout_start;
-   } else {
-      STBI_FREE(a.zout_start);
-      return NULL;
-   }
+   return stbi__zlib_decode_malloc(NULL, buffer, len, initial_size, outlen, parse_header);
 }
 
 STBIDEF int stbi_zlib_decode_buffer(char *obuffer, int olen, char const *ibuffer, int ilen)
 {
    stbi__zbuf a;
+   a.alloc = NULL;
+   a.refill = NULL;
    a.zbuffer = (stbi_uc *) ibuffer;
    a.zbuffer_end = (stbi_uc *) ibuffer + ilen;
    if (stbi__do_zlib(&a, obuffer, olen, 0, 1))
@@ -3900,23 +6168,14 @@ STBIDEF int stbi_zlib_decode_buffer(char *obuffer, int olen, char const *ibuffer
 
 STBIDEF char *stbi_zlib_decode_noheader_malloc(char const *buffer, int len, int *outlen)
 {
-   stbi__zbuf a;
-   char *p = (char *) stbi__malloc(16384);
-   if (p == NULL) return NULL;
-   a.zbuffer = (stbi_uc *) buffer;
-   a.zbuffer_end = (stbi_uc *) buffer+len;
-   if (stbi__do_zlib(&a, p, 16384, 1, 0)) {
-      if (outlen) *outlen = (int) (a.zout - a.zout_start);
-      return a.zout_start;
-   } else {
-      STBI_FREE(a.zout_start);
-      return NULL;
-   }
+   return stbi__zlib_decode_malloc(NULL, buffer, len, 16384, outlen, 0);
 }
 
 STBIDEF int stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const char *ibuffer, int ilen)
 {
    stbi__zbuf a;
+   a.alloc = NULL;
+   a.refill = NULL;
    a.zbuffer = (stbi_uc *) ibuffer;
    a.zbuffer_end = (stbi_uc *) ibuffer + ilen;
    if (stbi__do_zlib(&a, obuffer, olen, 0, 0))
@@ -3960,11 +6219,41 @@ static int stbi__check_png_header(stbi__context *s)
    return 1;
 }
 
+#define STBI__PNG_STREAM_INPUT  16384
+
+// a non-interlaced png being decoded a band at a time: what the chunks
+// before the first IDAT said, and how far through the IDATs we are
+typedef struct
+{
+   stbi__zbuf z;               // first, so the refill can find the rest
+   stbi__context *s;
+   stbi__uint32 idat_left;     // of the current IDAT
+   int idat_done;              // there aren't any more
+
+   stbi_uc palette[1024];
+   int pal_img_n, pal_len, has_trans, color, depth;
+   stbi_uc tc[3];
+   stbi__uint16 tc16[3];
+
+   int img_n, pixel_n, out_n, simd;
+   stbi__uint32 row_bytes;     // of filtered data, not counting the filter byte
+   char *window;               // inflated data, from 'z.zout_start'
+   char *next;                 // where the next row starts in it
+   stbi_uc *prior, *cur;       // the unfiltered rows
+   stbi_uc *pixels;            // a row as 8-bit, pixel_n component pixels
+   stbi_uc *band;
+   int band_rows;
+
+   // the 8 bytes before the input, for the inflate to give back
+   stbi_uc in[8 + STBI__PNG_STREAM_INPUT];
+} stbi__png_stream;
+
 typedef struct
 {
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   stbi__png_stream *stream; // for STBI__SCAN_stream, to stop at the first IDAT
 } stbi__png;
 
 
@@ -4001,6 +6290,326 @@ static int stbi__paeth(int a, int b, int c)
 
 static stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+// a pixel of 3 or 4 bytes, as an int (little-endian, so it goes in and out of
+// the vectors' bottom lanes the same way round)
+stbi_inline static stbi__uint32 stbi__png_get_pixel(const stbi_uc *p, int n)
+{
+   stbi__uint32 v = p[0] | (p[1] << 8) | (p[2] << 16);
+   if (n == 4) v |= (stbi__uint32) p[3] << 24;
+   return v;
+}
+
+stbi_inline static void stbi__png_put_pixel(stbi_uc *p, int n, stbi__uint32 v)
+{
+   p[0] = (stbi_uc) v;
+   p[1] = (stbi_uc) (v >> 8);
+   p[2] = (stbi_uc) (v >> 16);
+   if (n == 4) p[3] = (stbi_uc) (v >> 24);
+}
+
+// undo a filter on all but the first pixel of a row of 8-bit pixels, with
+// 3 or 4 bytes each. they're read 'filter_bytes' apart, and written out
+// 'output_bytes' apart; if that's one more, the alpha is filled in too. cur,
+// prior and raw point at the second pixel. sub, avg and paeth depend on the
+// previous pixel, so they go a pixel at a time, with all its bytes at once;
+// up doesn't, so it goes 16 bytes at a time when there's no alpha to add.
+// (the same approach as libpng's filter_sse2_intrinsics.c.)
+static void stbi__png_unfilter_simd(int filter, stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int count, int filter_bytes, int output_bytes)
+{
+   stbi__uint32 alpha = (output_bytes != filter_bytes) ? 0xff000000 : 0;
+   int i;
+
+#if defined(STBI_SSE2)
+   __m128i a, b, c, x;
+
+   if (filter == STBI__F_up && !alpha) {
+      int n = count * filter_bytes;
+      for (i=0; i+16 <= n; i += 16) {
+         __m128i rv = _mm_loadu_si128((__m128i *) (raw + i));
+         __m128i pv = _mm_loadu_si128((__m128i *) (prior + i));
+         _mm_storeu_si128((__m128i *) (cur + i), _mm_add_epi8(rv, pv));
+      }
+      for (; i < n; ++i)
+         cur[i] = STBI__BYTECAST(raw[i] + prior[i]);
+      return;
+   }
+
+   // a is the pixel to the left, b the one above, and c the one above that.
+   // (there's no row above on the first row, which only has sub, and
+   // paeth_first, so only the filters that use them load b and c.)
+   a = _mm_cvtsi32_si128((int) stbi__png_get_pixel(cur - output_bytes, filter_bytes));
+
+   #define STBI__UNFILTER_LOOP(load_b, predict) \
+      for (i=0; i < count; ++i, raw += filter_bytes, cur += output_bytes, prior += output_bytes) { \
+         x = _mm_cvtsi32_si128((int) stbi__png_get_pixel(raw, filter_bytes)); \
+         if (load_b) b = _mm_cvtsi32_si128((int) stbi__png_get_pixel(prior, filter_bytes)); \
+         x = _mm_add_epi8(x, predict); \
+         stbi__png_put_pixel(cur, output_bytes, (stbi__uint32) _mm_cvtsi128_si32(x) | alpha); \
+         a = x; \
+      }
+
+   switch (filter) {
+      case STBI__F_sub:
+      case STBI__F_paeth_first: // which is the same thing
+         STBI__UNFILTER_LOOP(0, a);
+         break;
+      case STBI__F_up:
+         STBI__UNFILTER_LOOP(1, b);
+         break;
+      case STBI__F_avg: {
+         // avg_epu8 rounds up; take the low bit of the sum back off
+         __m128i one = _mm_set1_epi8(1);
+         STBI__UNFILTER_LOOP(1, _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one)));
+         break;
+      }
+      case STBI__F_paeth: {
+         // in 16 bits: p = a+b-c, so |p-a| = |b-c|, |p-b| = |a-c|, and
+         // |p-c| = |(b-c) + (a-c)|
+         __m128i zero = _mm_setzero_si128();
+         c = _mm_cvtsi32_si128((int) stbi__png_get_pixel(prior - output_bytes, filter_bytes));
+         for (i=0; i < count; ++i, raw += filter_bytes, cur += output_bytes, prior += output_bytes) {
+            __m128i aw, bw, cw, pa, pb, pc, both, smallest, nearest;
+            x = _mm_cvtsi32_si128((int) stbi__png_get_pixel(raw, filter_bytes));
+            b = _mm_cvtsi32_si128((int) stbi__png_get_pixel(prior, filter_bytes));
+            aw = _mm_unpacklo_epi8(a, zero);
+            bw = _mm_unpacklo_epi8(b, zero);
+            cw = _mm_unpacklo_epi8(c, zero);
+            pa = _mm_sub_epi16(bw, cw);
+            pb = _mm_sub_epi16(aw, cw);
+            both = _mm_add_epi16(pa, pb);
+            pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+            pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+            pc = _mm_max_epi16(both, _mm_sub_epi16(zero, both));
+            // a if pa is smallest, else b if pb is, else c
+            smallest = _mm_min_epi16(_mm_min_epi16(pa, pb), pc);
+            nearest = _mm_cmpeq_epi16(smallest, pb);
+            nearest = _mm_or_si128(_mm_and_si128(nearest, bw), _mm_andnot_si128(nearest, cw));
+            pa = _mm_cmpeq_epi16(smallest, pa);
+            nearest = _mm_or_si128(_mm_and_si128(pa, aw), _mm_andnot_si128(pa, nearest));
+            x = _mm_add_epi8(x, _mm_packus_epi16(nearest, zero));
+            stbi__png_put_pixel(cur, output_bytes, (stbi__uint32) _mm_cvtsi128_si32(x) | alpha);
+            c = b;
+            a = x;
+         }
+         break;
+      }
+   }
+   #undef STBI__UNFILTER_LOOP
+
+#elif defined(STBI_NEON)
+   uint8x8_t a, b, c, x;
+
+   if (filter == STBI__F_up && !alpha) {
+      int n = count * filter_bytes;
+      for (i=0; i+16 <= n; i += 16)
+         vst1q_u8(cur + i, vaddq_u8(vld1q_u8(raw + i), vld1q_u8(prior + i)));
+      for (; i < n; ++i)
+         cur[i] = STBI__BYTECAST(raw[i] + prior[i]);
+      return;
+   }
+
+   // a is the pixel to the left, b the one above, and c the one above that,
+   // which are only loaded by the filters that use them, as above
+   a = vreinterpret_u8_u32(vdup_n_u32(stbi__png_get_pixel(cur - output_bytes, filter_bytes)));
+   b = c = vdup_n_u8(0);
+
+   #define STBI__UNFILTER_LOOP(load_b, predict) \
+      for (i=0; i < count; ++i, raw += filter_bytes, cur += output_bytes, prior += output_bytes) { \
+         x = vreinterpret_u8_u32(vdup_n_u32(stbi__png_get_pixel(raw, filter_bytes))); \
+         if (load_b) b = vreinterpret_u8_u32(vdup_n_u32(stbi__png_get_pixel(prior, filter_bytes))); \
+         x = vadd_u8(x, predict); \
+         stbi__png_put_pixel(cur, output_bytes, vget_lane_u32(vreinterpret_u32_u8(x), 0) | alpha); \
+         c = b; \
+         a = x; \
+      }
+
+   switch (filter) {
+      case STBI__F_sub:
+      case STBI__F_paeth_first: // which is the same thing
+         STBI__UNFILTER_LOOP(0, a);
+         break;
+      case STBI__F_up:
+         STBI__UNFILTER_LOOP(1, b);
+         break;
+      case STBI__F_avg:
+         STBI__UNFILTER_LOOP(1, vhadd_u8(a, b));
+         break;
+      case STBI__F_paeth:
+         c = vreinterpret_u8_u32(vdup_n_u32(stbi__png_get_pixel(prior - output_bytes, filter_bytes)));
+         // |p-a| = |b-c| and |p-b| = |a-c| fit in bytes; |p-c| = |a+b-2c|
+         // doesn't, but saturating it doesn't change how it compares
+         #define STBI__PAETH(a, b, c) \
+            vbsl_u8(vand_u8(vcle_u8(vabd_u8(b, c), vabd_u8(a, c)), \
+                            vcle_u8(vabd_u8(b, c), vqmovn_u16(vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c))))), a, \
+               vbsl_u8(vcle_u8(vabd_u8(a, c), vqmovn_u16(vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c)))), b, c))
+         STBI__UNFILTER_LOOP(1, STBI__PAETH(a, b, c));
+         #undef STBI__PAETH
+         break;
+   }
+   #undef STBI__UNFILTER_LOOP
+#endif
+}
+#endif
+
+// unfilter a row of x pixels from 'raw' (just past its filter byte) into 'cur',
+// with 'prior' the row above it, unfiltered the same way. 8- and 16-bit rows
+// come out with out_n components, which can be img_n+1 to add an opaque
+// alpha; smaller depths come out packed, as img_width_bytes bytes
+static void stbi__png_unfilter_row(stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int filter, int img_n, int out_n, stbi__uint32 x, int depth, int simd)
+{
+   int bytes = (depth == 16? 2 : 1);
+   stbi__uint32 i;
+   int k;
+   stbi_uc *row = cur;
+
+   int output_bytes = out_n*bytes;
+   int filter_bytes = img_n*bytes;
+   int width = x;
+
+   if (depth < 8) {
+      filter_bytes = 1;
+      width = ((img_n * x * depth) + 7) >> 3;
+   }
+
+   // handle first byte explicitly
+   for (k=0; k < filter_bytes; ++k) {
+      switch (filter) {
+         case STBI__F_none       : cur[k] = raw[k]; break;
+         case STBI__F_sub        : cur[k] = raw[k]; break;
+         case STBI__F_up         : cur[k] = STBI__BYTECAST(raw[k] + prior[k]); break;
+         case STBI__F_avg        : cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1)); break;
+         case STBI__F_paeth      : cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(0,prior[k],0)); break;
+         case STBI__F_avg_first  : cur[k] = raw[k]; break;
+         case STBI__F_paeth_first: cur[k] = raw[k]; break;
+      }
+   }
+
+   if (depth == 8) {
+      if (img_n != out_n)
+         cur[img_n] = 255; // first pixel
+      raw += img_n;
+      cur += out_n;
+      prior += out_n;
+   } else if (depth == 16) {
+      if (img_n != out_n) {
+         cur[filter_bytes]   = 255; // first pixel top byte
+         cur[filter_bytes+1] = 255; // first pixel bottom byte
+      }
+      raw += filter_bytes;
+      cur += output_bytes;
+      prior += output_bytes;
+   } else {
+      raw += 1;
+      cur += 1;
+      prior += 1;
+   }
+
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+   // 8-bit rgb and rgba go a pixel at a time, apart from the filters that
+   // are simple enough already, and the one that only applies to a row
+   if (simd && depth == 8 && filter_bytes >= 3 && filter != STBI__F_none && filter != STBI__F_avg_first) {
+      stbi__png_unfilter_simd(filter, cur, prior, raw, x-1, filter_bytes, output_bytes);
+      return;
+   }
+#else
+   STBI_NOTUSED(simd);
+#endif
+
+   // this is a little gross, so that we don't switch per-pixel or per-component
+   if (depth < 8 || img_n == out_n) {
+      int nk = (width - 1)*filter_bytes;
+      #define CASE(f) \
+          case f:     \
+             for (k=0; k < nk; ++k)
+      switch (filter) {
+         // "none" filter turns into a memcpy here; make that explicit.
+         case STBI__F_none:         memcpy(cur, raw, nk); break;
+         CASE(STBI__F_sub)          cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]); break;
+         CASE(STBI__F_up)           cur[k] = STBI__BYTECAST(raw[k] + prior[k]); break;
+         CASE(STBI__F_avg)          cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1)); break;
+         CASE(STBI__F_paeth)        cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes],prior[k],prior[k-filter_bytes])); break;
+         CASE(STBI__F_avg_first)    cur[k] = STBI__BYTECAST(raw[k] + (cur[k-filter_bytes] >> 1)); break;
+         CASE(STBI__F_paeth_first)  cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes],0,0)); break;
+      }
+      #undef CASE
+   } else {
+      STBI_ASSERT(img_n+1 == out_n);
+      #define CASE(f) \
+          case f:     \
+             for (i=x-1; i >= 1; --i, cur[filter_bytes]=255,raw+=filter_bytes,cur+=output_bytes,prior+=output_bytes) \
+                for (k=0; k < filter_bytes; ++k)
+      switch (filter) {
+         CASE(STBI__F_none)         cur[k] = raw[k]; break;
+         CASE(STBI__F_sub)          cur[k] = STBI__BYTECAST(raw[k] + cur[k- output_bytes]); break;
+         CASE(STBI__F_up)           cur[k] = STBI__BYTECAST(raw[k] + prior[k]); break;
+         CASE(STBI__F_avg)          cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k- output_bytes])>>1)); break;
+         CASE(STBI__F_paeth)        cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k- output_bytes],prior[k],prior[k- output_bytes])); break;
+         CASE(STBI__F_avg_first)    cur[k] = STBI__BYTECAST(raw[k] + (cur[k- output_bytes] >> 1)); break;
+         CASE(STBI__F_paeth_first)  cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k- output_bytes],0,0)); break;
+      }
+      #undef CASE
+
+      // the loop above sets the high byte of the pixels' alpha, but for
+      // 16 bit png files we also need the low byte set. we'll do that here.
+      if (depth == 16) {
+         cur = row; // start at the beginning of the row again
+         for (i=0; i < x; ++i,cur+=output_bytes) {
+            cur[filter_bytes+1] = 255;
+         }
+      }
+   }
+}
+
+// unpack a row of 'count' 1/2/4-bit samples from 'in' into bytes at 'cur',
+// scaled by 'scale'. 'in' can be the rightmost bytes of the same row, as
+// they're read before they're overwritten
+static void stbi__png_expand_bits(stbi_uc *cur, stbi_uc *in, int count, int depth, stbi_uc scale)
+{
+   int k;
+   // note that the final byte might overshoot and write more data than desired.
+   // we can allocate enough data that this never writes out of memory, but it
+   // could also overwrite the next scanline. can it overwrite non-empty data
+   // on the next scanline? yes, consider 1-pixel-wide scanlines with 1-bit-per-pixel.
+   // so we need to explicitly clamp the final ones
+
+   if (depth == 4) {
+      for (k=count; k >= 2; k-=2, ++in) {
+         *cur++ = scale * ((*in >> 4)       );
+         *cur++ = scale * ((*in     ) & 0x0f);
+      }
+      if (k > 0) *cur++ = scale * ((*in >> 4)       );
+   } else if (depth == 2) {
+      for (k=count; k >= 4; k-=4, ++in) {
+         *cur++ = scale * ((*in >> 6)       );
+         *cur++ = scale * ((*in >> 4) & 0x03);
+         *cur++ = scale * ((*in >> 2) & 0x03);
+         *cur++ = scale * ((*in     ) & 0x03);
+      }
+      if (k > 0) *cur++ = scale * ((*in >> 6)       );
+      if (k > 1) *cur++ = scale * ((*in >> 4) & 0x03);
+      if (k > 2) *cur++ = scale * ((*in >> 2) & 0x03);
+   } else if (depth == 1) {
+      for (k=count; k >= 8; k-=8, ++in) {
+         *cur++ = scale * ((*in >> 7)       );
+         *cur++ = scale * ((*in >> 6) & 0x01);
+         *cur++ = scale * ((*in >> 5) & 0x01);
+         *cur++ = scale * ((*in >> 4) & 0x01);
+         *cur++ = scale * ((*in >> 3) & 0x01);
+         *cur++ = scale * ((*in >> 2) & 0x01);
+         *cur++ = scale * ((*in >> 1) & 0x01);
+         *cur++ = scale * ((*in     ) & 0x01);
+      }
+      if (k > 0) *cur++ = scale * ((*in >> 7)       );
+      if (k > 1) *cur++ = scale * ((*in >> 6) & 0x01);
+      if (k > 2) *cur++ = scale * ((*in >> 5) & 0x01);
+      if (k > 3) *cur++ = scale * ((*in >> 4) & 0x01);
+      if (k > 4) *cur++ = scale * ((*in >> 3) & 0x01);
+      if (k > 5) *cur++ = scale * ((*in >> 2) & 0x01);
+      if (k > 6) *cur++ = scale * ((*in >> 1) & 0x01);
+   }
+}
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4008,15 +6617,17 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    stbi__context *s = a->s;
    stbi__uint32 i,j,stride = x*out_n*bytes;
    stbi__uint32 img_len, img_width_bytes;
-   int k;
    int img_n = s->img_n; // copy it into a local for later
-
-   int output_bytes = out_n*bytes;
-   int filter_bytes = img_n*bytes;
-   int width = x;
+#if defined(STBI_SSE2)
+   int simd = stbi__sse2_available();
+#elif defined(STBI_NEON)
+   int simd = 1;
+#else
+   int simd = 0;
+#endif
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (stbi_uc *) stbi__malloc(x * y * output_bytes); // extra bytes to write off the end into
+   a->out = (stbi_uc *) stbi__malloc(a->s->alloc, x * y * out_n * bytes); // extra bytes to write off the end into
    if (!a->out) return stbi__err("outofmem", "Out of memory");
 
    img_width_bytes = (((img_n * x * depth) + 7) >> 3);
@@ -4029,7 +6640,6 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 
    for (j=0; j < y; ++j) {
       stbi_uc *cur = a->out + stride*j;
-      stbi_uc *prior = cur - stride;
       int filter = *raw++;
 
       if (filter > 4)
@@ -4038,90 +6648,14 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       if (depth < 8) {
          STBI_ASSERT(img_width_bytes <= x);
          cur += x*out_n - img_width_bytes; // store output to the rightmost img_len bytes, so we can decode in place
-         filter_bytes = 1;
-         width = img_width_bytes;
       }
 
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
 
-      // handle first byte explicitly
-      for (k=0; k < filter_bytes; ++k) {
-         switch (filter) {
-            case STBI__F_none       : cur[k] = raw[k]; break;
-            case STBI__F_sub        : cur[k] = raw[k]; break;
-            case STBI__F_up         : cur[k] = STBI__BYTECAST(raw[k] + prior[k]); break;
-            case STBI__F_avg        : cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1)); break;
-            case STBI__F_paeth      : cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(0,prior[k],0)); break;
-            case STBI__F_avg_first  : cur[k] = raw[k]; break;
-            case STBI__F_paeth_first: cur[k] = raw[k]; break;
-         }
-      }
-
-      if (depth == 8) {
-         if (img_n != out_n)
-            cur[img_n] = 255; // first pixel
-         raw += img_n;
-         cur += out_n;
-         prior += out_n;
-      } else if (depth == 16) {
-         if (img_n != out_n) {
-            cur[filter_bytes]   = 255; // first pixel top byte
-            cur[filter_bytes+1] = 255; // first pixel bottom byte
-         }
-         raw += filter_bytes;
-         cur += output_bytes;
-         prior += output_bytes;
-      } else {
-         raw += 1;
-         cur += 1;
-         prior += 1;
-      }
-
-      // this is a little gross, so that we don't switch per-pixel or per-component
-      if (depth < 8 || img_n == out_n) {
-         int nk = (width - 1)*filter_bytes;
-         #define CASE(f) \
-             case f:     \
-                for (k=0; k < nk; ++k)
-         switch (filter) {
-            // "none" filter turns into a memcpy here; make that explicit.
-            case STBI__F_none:         memcpy(cur, raw, nk); break;
-            CASE(STBI__F_sub)          cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]); break;
-            CASE(STBI__F_up)           cur[k] = STBI__BYTECAST(raw[k] + prior[k]); break;
-            CASE(STBI__F_avg)          cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1)); break;
-            CASE(STBI__F_paeth)        cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes],prior[k],prior[k-filter_bytes])); break;
-            CASE(STBI__F_avg_first)    cur[k] = STBI__BYTECAST(raw[k] + (cur[k-filter_bytes] >> 1)); break;
-            CASE(STBI__F_paeth_first)  cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes],0,0)); break;
-         }
-         #undef CASE
-         raw += nk;
-      } else {
-         STBI_ASSERT(img_n+1 == out_n);
-         #define CASE(f) \
-             case f:     \
-                for (i=x-1; i >= 1; --i, cur[filter_bytes]=255,raw+=filter_bytes,cur+=output_bytes,prior+=output_bytes) \
-                   for (k=0; k < filter_bytes; ++k)
-         switch (filter) {
-            CASE(STBI__F_none)         cur[k] = raw[k]; break;
-            CASE(STBI__F_sub)          cur[k] = STBI__BYTECAST(raw[k] + cur[k- output_bytes]); break;
-            CASE(STBI__F_up)           cur[k] = STBI__BYTECAST(raw[k] + prior[k]); break;
-            CASE(STBI__F_avg)          cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k- output_bytes])>>1)); break;
-            CASE(STBI__F_paeth)        cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k- output_bytes],prior[k],prior[k- output_bytes])); break;
-            CASE(STBI__F_avg_first)    cur[k] = STBI__BYTECAST(raw[k] + (cur[k- output_bytes] >> 1)); break;
-            CASE(STBI__F_paeth_first)  cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k- output_bytes],0,0)); break;
-         }
-         #undef CASE
-
-         // the loop above sets the high byte of the pixels' alpha, but for
-         // 16 bit png files we also need the low byte set. we'll do that here.
-         if (depth == 16) {
-            cur = a->out + stride*j; // start at the beginning of the row again
-            for (i=0; i < x; ++i,cur+=output_bytes) {
-               cur[filter_bytes+1] = 255;
-            }
-         }
-      }
+      // the row above's at the same place in its row, packed or not
+      stbi__png_unfilter_row(cur, cur - stride, raw, filter, img_n, out_n, x, depth, simd);
+      raw += img_width_bytes;
    }
 
    // we make a separate pass to expand bits to pixels; for performance,
@@ -4135,47 +6669,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          // png guarante byte alignment, if width is not multiple of 8/4/2 we'll decode dummy trailing data that will be skipped in the later loop
          stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
 
-         // note that the final byte might overshoot and write more data than desired.
-         // we can allocate enough data that this never writes out of memory, but it
-         // could also overwrite the next scanline. can it overwrite non-empty data
-         // on the next scanline? yes, consider 1-pixel-wide scanlines with 1-bit-per-pixel.
-         // so we need to explicitly clamp the final ones
-
-         if (depth == 4) {
-            for (k=x*img_n; k >= 2; k-=2, ++in) {
-               *cur++ = scale * ((*in >> 4)       );
-               *cur++ = scale * ((*in     ) & 0x0f);
-            }
-            if (k > 0) *cur++ = scale * ((*in >> 4)       );
-         } else if (depth == 2) {
-            for (k=x*img_n; k >= 4; k-=4, ++in) {
-               *cur++ = scale * ((*in >> 6)       );
-               *cur++ = scale * ((*in >> 4) & 0x03);
-               *cur++ = scale * ((*in >> 2) & 0x03);
-               *cur++ = scale * ((*in     ) & 0x03);
-            }
-            if (k > 0) *cur++ = scale * ((*in >> 6)       );
-            if (k > 1) *cur++ = scale * ((*in >> 4) & 0x03);
-            if (k > 2) *cur++ = scale * ((*in >> 2) & 0x03);
-         } else if (depth == 1) {
-            for (k=x*img_n; k >= 8; k-=8, ++in) {
-               *cur++ = scale * ((*in >> 7)       );
-               *cur++ = scale * ((*in >> 6) & 0x01);
-               *cur++ = scale * ((*in >> 5) & 0x01);
-               *cur++ = scale * ((*in >> 4) & 0x01);
-               *cur++ = scale * ((*in >> 3) & 0x01);
-               *cur++ = scale * ((*in >> 2) & 0x01);
-               *cur++ = scale * ((*in >> 1) & 0x01);
-               *cur++ = scale * ((*in     ) & 0x01);
-            }
-            if (k > 0) *cur++ = scale * ((*in >> 7)       );
-            if (k > 1) *cur++ = scale * ((*in >> 6) & 0x01);
-            if (k > 2) *cur++ = scale * ((*in >> 5) & 0x01);
-            if (k > 3) *cur++ = scale * ((*in >> 4) & 0x01);
-            if (k > 4) *cur++ = scale * ((*in >> 3) & 0x01);
-            if (k > 5) *cur++ = scale * ((*in >> 2) & 0x01);
-            if (k > 6) *cur++ = scale * ((*in >> 1) & 0x01);
-         }
+         stbi__png_expand_bits(cur, in, x*img_n, depth, scale);
          if (img_n != out_n) {
             int q;
             // insert alpha = 255
@@ -4212,20 +6706,41 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    return 1;
 }
 
+// the adam7 passes: where each one starts, and how far apart its pixels are
+static int stbi__png_xorig[] = { 0,4,0,2,0,1,0 };
+static int stbi__png_yorig[] = { 0,0,4,0,2,0,1 };
+static int stbi__png_xspc[]  = { 8,8,4,4,2,2,1 };
+static int stbi__png_yspc[]  = { 8,8,8,4,4,2,2 };
+
+// exactly how big the filtered image data decompresses to, so it can be
+// decompressed without reallocating
+static stbi__uint32 stbi__png_raw_size(stbi__context *s, int depth, int interlaced)
+{
+   stbi__uint32 size = 0;
+   int p;
+   if (!interlaced)
+      return ((((s->img_n * s->img_x * depth) + 7) >> 3) + 1) * s->img_y;
+   for (p=0; p < 7; ++p) {
+      stbi__uint32 x = (s->img_x - stbi__png_xorig[p] + stbi__png_xspc[p]-1) / stbi__png_xspc[p];
+      stbi__uint32 y = (s->img_y - stbi__png_yorig[p] + stbi__png_yspc[p]-1) / stbi__png_yspc[p];
+      if (x && y)
+         size += ((((s->img_n * x * depth) + 7) >> 3) + 1) * y;
+   }
+   return size;
+}
+
 static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced)
 {
+   int *xorig = stbi__png_xorig, *yorig = stbi__png_yorig, *xspc = stbi__png_xspc, *yspc = stbi__png_yspc;
    stbi_uc *final;
-   int p;
+   int p, out_bytes = out_n * (depth == 16 ? 2 : 1);
    if (!interlaced)
       return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
 
    // de-interlacing
-   final = (stbi_uc *) stbi__malloc(a->s->img_x * a->s->img_y * out_n);
+   final = (stbi_uc *) stbi__malloc(a->s->alloc, a->s->img_x * a->s->img_y * out_bytes);
+   if (!final) return stbi__err("outofmem", "Out of memory");
    for (p=0; p < 7; ++p) {
-      int xorig[] = { 0,4,0,2,0,1,0 };
-      int yorig[] = { 0,0,4,0,2,0,1 };
-      int xspc[]  = { 8,8,4,4,2,2,1 };
-      int yspc[]  = { 8,8,8,4,4,2,2 };
       int i,j,x,y;
       // pass1_x[4] = 0, pass1_x[5] = 1, pass1_x[12] = 1
       x = (a->s->img_x - xorig[p] + xspc[p]-1) / xspc[p];
@@ -4233,18 +6748,18 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       if (x && y) {
          stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
          if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
-            STBI_FREE(final);
+            stbi__free(a->s->alloc, final);
             return 0;
          }
          for (j=0; j < y; ++j) {
             for (i=0; i < x; ++i) {
                int out_y = j*yspc[p]+yorig[p];
                int out_x = i*xspc[p]+xorig[p];
-               memcpy(final + out_y*a->s->img_x*out_n + out_x*out_n,
-                      a->out + (j*x+i)*out_n, out_n);
+               memcpy(final + out_y*a->s->img_x*out_bytes + out_x*out_bytes,
+                      a->out + (j*x+i)*out_bytes, out_bytes);
             }
          }
-         STBI_FREE(a->out);
+         stbi__free(a->s->alloc, a->out);
          image_data += img_len;
          image_data_len -= img_len;
       }
@@ -4309,7 +6824,7 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
    stbi__uint32 i, pixel_count = a->s->img_x * a->s->img_y;
    stbi_uc *p, *temp_out, *orig = a->out;
 
-   p = (stbi_uc *) stbi__malloc(pixel_count * pal_img_n);
+   p = (stbi_uc *) stbi__malloc(a->s->alloc, pixel_count * pal_img_n);
    if (p == NULL) return stbi__err("outofmem", "Out of memory");
 
    // between here and free(out) below, exitting would leak
@@ -4333,7 +6848,7 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
          p += 4;
       }
    }
-   STBI_FREE(a->out);
+   stbi__free(a->s->alloc, a->out);
    a->out = temp_out;
 
    STBI_NOTUSED(len);
@@ -4350,13 +6865,13 @@ static int stbi__reduce_png(stbi__png *p)
 
    if (p->depth != 16) return 1; // don't need to do anything if not 16-bit data
 
-   reduced = (stbi_uc *)stbi__malloc(img_len);
+   reduced = (stbi_uc *)stbi__malloc(p->s->alloc, img_len);
    if (p == NULL) return stbi__err("outofmem", "Out of memory");
 
    for (i = 0; i < img_len; ++i) reduced[i] = (stbi_uc)((orig[i] >> 8) & 0xFF); // top half of each byte is a decent approx of 16->8 bit scaling
 
    p->out = reduced;
-   STBI_FREE(orig);
+   stbi__free(p->s->alloc, orig);
 
    return 1;
 }
@@ -4512,6 +7027,20 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (pal_img_n && !pal_len) return stbi__err("no PLTE","Corrupt PNG");
             if (scan == STBI__SCAN_header) { s->img_n = pal_img_n; return 1; }
+            if (scan == STBI__SCAN_stream && !interlace && !is_iphone) {
+               // the rest's read as it's needed, by stbi__png_stream_rows
+               stbi__png_stream *st = z->stream;
+               memcpy(st->palette, palette, sizeof(palette));
+               st->pal_img_n = pal_img_n;
+               st->pal_len = pal_len;
+               st->has_trans = has_trans;
+               memcpy(st->tc, tc, sizeof(tc));
+               memcpy(st->tc16, tc16, sizeof(tc16));
+               st->color = color;
+               st->depth = z->depth;
+               st->idat_left = c.length;
+               return 1;
+            }
             if ((int)(ioff + c.length) < (int)ioff) return 0;
             if (ioff + c.length > idata_limit) {
                stbi__uint32 idata_limit_old = idata_limit;
@@ -4520,7 +7049,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                while (ioff + c.length > idata_limit)
                   idata_limit *= 2;
                STBI_NOTUSED(idata_limit_old);
-               p = (stbi_uc *) STBI_REALLOC_SIZED(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
+               p = (stbi_uc *) stbi__realloc(z->s->alloc, z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
                z->idata = p;
             }
             if (!stbi__getn(s, z->idata+ioff,c.length)) return stbi__err("outofdata","Corrupt PNG");
@@ -4529,16 +7058,16 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
          }
 
          case STBI__PNG_TYPE('I','E','N','D'): {
-            stbi__uint32 raw_len, bpl;
+            stbi__uint32 raw_len;
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
-            if (scan != STBI__SCAN_load) return 1;
+            if (scan != STBI__SCAN_load && scan != STBI__SCAN_stream) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
-            // initial guess for decoded data size to avoid unnecessary reallocs
-            bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
-            raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
-            z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
+            // the decoded data's size is known up front, so it needn't be
+            // reallocated (unless the stream's corrupt and goes on longer)
+            raw_len = stbi__png_raw_size(s, z->depth, interlace);
+            z->expanded = (stbi_uc *) stbi__zlib_decode_malloc(z->s->alloc, (char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
             if (z->expanded == NULL) return 0; // zlib should set error
-            STBI_FREE(z->idata); z->idata = NULL;
+            stbi__free(z->s->alloc, z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
@@ -4561,7 +7090,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                if (!stbi__expand_png_palette(z, palette, pal_len, s->img_out_n))
                   return 0;
             }
-            STBI_FREE(z->expanded); z->expanded = NULL;
+            stbi__free(z->s->alloc, z->expanded); z->expanded = NULL;
             return 1;
          }
 
@@ -4587,31 +7116,60 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
    }
 }
 
-static unsigned char *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp)
+// the result of a png that's been parsed whole, in the format asked for
+static unsigned char *stbi__png_result(stbi__png *p, int *x, int *y, int *n, int req_comp)
 {
    unsigned char *result=NULL;
-   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
-   if (stbi__parse_png_file(p, STBI__SCAN_load, req_comp)) {
-      if (p->depth == 16) {
-         if (!stbi__reduce_png(p)) {
-            return result;
-         }
+   if (p->depth == 16) {
+      if (!stbi__reduce_png(p)) {
+         return result;
+      }
+   }
+   result = p->out;
+   p->out = NULL;
+   // one pass converts the components, flips, and puts the rows into the
+   // caller's buffer, whichever of those there are to do
+   if (p->s->out || (req_comp && req_comp != p->s->img_out_n)) {
+      int out_n = req_comp ? req_comp : p->s->img_out_n;
+      stbi_uc *dest = NULL;
+      if (p->s->out) {
+         if (stbi__check_out(p->s, p->s->img_x, p->s->img_y, out_n))
+            dest = p->s->out;
+      } else {
+         dest = (stbi_uc *) stbi__malloc(p->s->alloc, out_n * p->s->img_x * p->s->img_y);
+         if (dest == NULL) stbi__err("outofmem", "Out of memory");
+         p->s->out_stride = out_n * p->s->img_x;
       }
-      result = p->out;
-      p->out = NULL;
-      if (req_comp && req_comp != p->s->img_out_n) {
-         result = stbi__convert_format(result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
-         p->s->img_out_n = req_comp;
-         if (result == NULL) return result;
+      if (dest) {
+         stbi__convert_format_into(dest, p->s->out_stride, p->s->flip, result, p->s->img_out_n, out_n, p->s->img_x, p->s->img_y);
+         p->s->flipped = p->s->flip;
+         p->s->img_out_n = out_n;
       }
+      stbi__free(p->s->alloc, result);
+      result = dest;
+   }
+   if (result) {
       *x = p->s->img_x;
       *y = p->s->img_y;
       if (n) *n = p->s->img_n;
    }
-   STBI_FREE(p->out);      p->out      = NULL;
-   STBI_FREE(p->expanded); p->expanded = NULL;
-   STBI_FREE(p->idata);    p->idata    = NULL;
+   return result;
+}
+
+static void stbi__png_cleanup(stbi__png *p)
+{
+   stbi__free(p->s->alloc, p->out);      p->out      = NULL;
+   stbi__free(p->s->alloc, p->expanded); p->expanded = NULL;
+   stbi__free(p->s->alloc, p->idata);    p->idata    = NULL;
+}
 
+static unsigned char *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp)
+{
+   unsigned char *result=NULL;
+   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+   if (stbi__parse_png_file(p, STBI__SCAN_load, req_comp))
+      result = stbi__png_result(p, x, y, n, req_comp);
+   stbi__png_cleanup(p);
    return result;
 }
 
@@ -4619,9 +7177,204 @@ static unsigned char *stbi__png_load(stbi__context *s, int *x, int *y, int *comp
 {
    stbi__png p;
    p.s = s;
+   p.stream = NULL;
    return stbi__do_png(&p, x,y,comp,req_comp);
 }
 
+// read the next piece of IDAT data for the inflate, going on to the next
+// IDAT at the end of each one
+static int stbi__png_stream_refill(stbi__zbuf *z)
+{
+   stbi__png_stream *p = (stbi__png_stream *) z;
+   int n;
+   while (p->idat_left == 0) {
+      stbi__pngchunk c;
+      if (p->idat_done) return 0;
+      stbi__get32be(p->s); // the last one's CRC
+      c = stbi__get_chunk_header(p->s);
+      if (c.type != STBI__PNG_TYPE('I','D','A','T')) {
+         p->idat_done = 1;
+         return 0;
+      }
+      p->idat_left = c.length;
+   }
+   n = p->idat_left < STBI__PNG_STREAM_INPUT ? (int) p->idat_left : STBI__PNG_STREAM_INPUT;
+   memmove(p->in, z->zbuffer_end - 8, 8);
+   if (!stbi__getn(p->s, p->in + 8, n)) {
+      p->idat_done = 1;
+      return 0;
+   }
+   p->idat_left -= n;
+   z->zbuffer = p->in + 8;
+   z->zbuffer_end = p->in + 8 + n;
+   return 1;
+}
+
+// inflate the next filtered row, making room in the window for it if need be
+static stbi_uc *stbi__png_stream_inflate_row(stbi__png_stream *p)
+{
+   stbi__zbuf *z = &p->z;
+   while ((stbi__uint32) (z->zout - p->next) < p->row_bytes + 1) {
+      int r;
+      if (z->zout_end - z->zout < 258) {
+         // move the rest of the row down, along with the 32K before the end
+         // that matches can refer back to
+         char *keep = z->zout - p->window > 32768 ? z->zout - 32768 : p->window;
+         if (p->next < keep) keep = p->next;
+         memmove(p->window, keep, z->zout - keep);
+         p->next -= keep - p->window;
+         z->zout -= keep - p->window;
+      }
+      r = stbi__zinflate_some(z);
+      if (r == 0) return NULL;
+      if (r == 1 && (stbi__uint32) (z->zout - p->next) < p->row_bytes + 1)
+         return stbi__errpuc("not enough pixels","Corrupt PNG");
+   }
+   p->next += p->row_bytes + 1;
+   return (stbi_uc *) p->next - p->row_bytes - 1;
+}
+
+// unfilter the next row, and make it 8-bit pixels, as the whole-image path
+// would have by now
+static int stbi__png_stream_row(stbi__png_stream *p, int row)
+{
+   stbi__uint32 i, x = p->s->img_x;
+   stbi_uc *raw = stbi__png_stream_inflate_row(p), *t;
+   int filter, k, n = p->img_n;
+   if (raw == NULL) return 0;
+   filter = *raw++;
+   if (filter > 4) return stbi__err("invalid filter","Corrupt PNG");
+   if (row == 0) filter = first_row_filter[filter];
+   stbi__png_unfilter_row(p->cur, p->prior, raw, filter, n, n, x, p->depth, p->simd);
+
+   if (p->depth < 8) {
+      stbi_uc scale = (p->color == 0) ? stbi__depth_scale_table[p->depth] : 1;
+      stbi__png_expand_bits(p->pixels, p->cur, x*n, p->depth, scale);
+   } else if (p->depth == 16) {
+      for (i=0; i < x*n; ++i)
+         p->pixels[i] = p->cur[i*2];
+   } else {
+      memcpy(p->pixels, p->cur, x*n);
+   }
+
+   if (p->has_trans) {
+      // add an alpha, working backwards so it can be done in place
+      for (i=x; i-- > 0; ) {
+         int opaque = 0;
+         for (k=0; k < n; ++k) {
+            if (p->depth == 16)
+               opaque |= ((p->cur[i*n*2 + k*2] << 8) | p->cur[i*n*2 + k*2 + 1]) != p->tc16[k];
+            else
+               opaque |= p->pixels[i*n + k] != p->tc[k];
+         }
+         p->pixels[i*(n+1) + n] = opaque ? 255 : 0;
+         for (k=n-1; k >= 0; --k)
+            p->pixels[i*(n+1) + k] = p->pixels[i*n + k];
+      }
+   } else if (p->pal_img_n) {
+      for (i=x; i-- > 0; ) {
+         stbi_uc *c = p->palette + p->pixels[i]*4;
+         for (k=0; k < p->pal_img_n; ++k)
+            p->pixels[i*p->pal_img_n + k] = c[k];
+      }
+   }
+
+   t = p->prior; p->prior = p->cur; p->cur = t;
+   return 1;
+}
+
+static stbi_uc *stbi__png_stream_rows(stbi__stream *st, int *num_rows)
+{
+   stbi__png_stream *p = (stbi__png_stream *) st->state;
+   int j, rows = st->y - st->row < p->band_rows ? st->y - st->row : p->band_rows;
+   for (j=0; j < rows; ++j) {
+      if (!stbi__png_stream_row(p, st->row + j)) return NULL;
+      stbi__convert_format_into(p->band + (size_t) j * st->x * st->n, st->x * st->n, 0, p->pixels, p->pixel_n, st->n, st->x, 1);
+   }
+   *num_rows = rows;
+   return p->band;
+}
+
+static void stbi__png_stream_close(stbi__stream *st)
+{
+   stbi__png_stream *p = (stbi__png_stream *) st->state;
+   if (p == NULL) return;
+   STBI_FREE(p->window);
+   STBI_FREE(p->prior);
+   STBI_FREE(p->cur);
+   STBI_FREE(p->pixels);
+   STBI_FREE(p->band);
+   STBI_FREE(p);
+}
+
+static int stbi__png_stream_start(stbi__stream *st, int req_comp)
+{
+   stbi__png_stream *p = (stbi__png_stream *) STBI_MALLOC(sizeof(stbi__png_stream));
+   stbi__png png;
+   size_t row_size, window_size;
+   if (p == NULL) return stbi__err("outofmem", "Out of memory");
+   png.s = &st->s;
+   png.stream = p;
+   if (!stbi__parse_png_file(&png, STBI__SCAN_stream, req_comp)) {
+      stbi__png_cleanup(&png);
+      STBI_FREE(p);
+      return 0;
+   }
+   if (png.out) {
+      // interlaced, or from an iphone, so it's been decoded whole
+      STBI_FREE(p);
+      st->image = stbi__png_result(&png, &st->x, &st->y, &st->comp, req_comp);
+      stbi__png_cleanup(&png);
+      st->n = req_comp ? req_comp : st->s.img_out_n;
+      return st->image != NULL;
+   }
+
+   st->state = p;
+   st->next_rows = stbi__png_stream_rows;
+   st->close = stbi__png_stream_close;
+   st->x = st->s.img_x;
+   st->y = st->s.img_y;
+
+   p->s = &st->s;
+   p->idat_done = 0;
+   p->img_n = st->s.img_n;
+   if (p->pal_img_n) {
+      st->comp = p->pixel_n = p->pal_img_n;
+   } else {
+      st->comp = p->img_n;
+      p->pixel_n = p->img_n + p->has_trans;
+   }
+   st->n = req_comp ? req_comp : p->pixel_n;
+#if defined(STBI_SSE2)
+   p->simd = stbi__sse2_available();
+#elif defined(STBI_NEON)
+   p->simd = 1;
+#else
+   p->simd = 0;
+#endif
+
+   p->row_bytes = ((p->img_n * st->x * p->depth) + 7) >> 3;
+   row_size = (size_t) st->x * p->img_n * (p->depth == 16 ? 2 : 1);
+   // room for a row and the 32K before it, and plenty more to inflate into
+   window_size = 32768 + p->row_bytes + 1 + 65536;
+   p->band_rows = stbi__stream_band_rows(st);
+   p->window = (char *) STBI_MALLOC(window_size);
+   p->prior = (stbi_uc *) STBI_MALLOC(row_size);
+   p->cur = (stbi_uc *) STBI_MALLOC(row_size);
+   p->pixels = (stbi_uc *) STBI_MALLOC((size_t) st->x * 4);
+   p->band = (stbi_uc *) STBI_MALLOC((size_t) st->x * st->n * p->band_rows);
+   if (!p->window || !p->prior || !p->cur || !p->pixels || !p->band)
+      return stbi__err("outofmem", "Out of memory");
+
+   p->z.zbuffer = p->z.zbuffer_end = p->in + 8;
+   p->z.refill = stbi__png_stream_refill;
+   p->z.zout_start = p->z.zout = p->next = p->window;
+   p->z.zout_end = p->window + window_size;
+   p->z.z_expandable = 0;
+   p->z.alloc = NULL;
+   return stbi__zinflate_start(&p->z, 1);
+}
+
 static int stbi__png_test(stbi__context *s)
 {
    int r;
@@ -4642,12 +7395,6 @@ static int stbi__png_info_raw(stbi__png *p, int *x, int *y, int *comp)
    return 1;
 }
 
-static int stbi__png_info(stbi__context *s, int *x, int *y, int *comp)
-{
-   stbi__png p;
-   p.s = s;
-   return stbi__png_info_raw(&p, x, y, comp);
-}
 #endif
 
 // Microsoft/Windows BMP image
@@ -4843,11 +7590,11 @@ static stbi_uc *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int
    else
       target = s->img_n; // if they want monochrome, we'll post-convert
 
-   out = (stbi_uc *) stbi__malloc(target * s->img_x * s->img_y);
+   out = (stbi_uc *) stbi__malloc(s->alloc, target * s->img_x * s->img_y);
    if (!out) return stbi__errpuc("outofmem", "Out of memory");
    if (info.bpp < 16) {
       int z=0;
-      if (psize == 0 || psize > 256) { STBI_FREE(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
+      if (psize == 0 || psize > 256) { stbi__free(s->alloc, out); return stbi__errpuc("invalid", "Corrupt BMP"); }
       for (i=0; i < psize; ++i) {
          pal[i][2] = stbi__get8(s);
          pal[i][1] = stbi__get8(s);
@@ -4858,7 +7605,7 @@ static stbi_uc *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int
       stbi__skip(s, info.offset - 14 - info.hsz - psize * (info.hsz == 12 ? 3 : 4));
       if (info.bpp == 4) width = (s->img_x + 1) >> 1;
       else if (info.bpp == 8) width = s->img_x;
-      else { STBI_FREE(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
+      else { stbi__free(s->alloc, out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
       pad = (-width)&3;
       for (j=0; j < (int) s->img_y; ++j) {
          for (i=0; i < (int) s->img_x; i += 2) {
@@ -4896,7 +7643,7 @@ static stbi_uc *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int
             easy = 2;
       }
       if (!easy) {
-         if (!mr || !mg || !mb) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+         if (!mr || !mg || !mb) { stbi__free(s->alloc, out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
          // right shift amt to put high bit in position #7
          rshift = stbi__high_bit(mr)-7; rcount = stbi__bitcount(mr);
          gshift = stbi__high_bit(mg)-7; gcount = stbi__bitcount(mg);
@@ -4949,7 +7696,7 @@ static stbi_uc *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int
    }
 
    if (req_comp && req_comp != target) {
-      out = stbi__convert_format(out, target, req_comp, s->img_x, s->img_y);
+      out = stbi__convert_format(s->alloc, out, target, req_comp, s->img_x, s->img_y);
       if (out == NULL) return out; // stbi__convert_format frees input on failure
    }
 
@@ -5143,7 +7890,7 @@ static stbi_uc *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int
    *y = tga_height;
    if (comp) *comp = tga_comp;
 
-   tga_data = (unsigned char*)stbi__malloc( (size_t)tga_width * tga_height * tga_comp );
+   tga_data = (unsigned char*)stbi__malloc(s->alloc, (size_t)tga_width * tga_height * tga_comp );
    if (!tga_data) return stbi__errpuc("outofmem", "Out of memory");
 
    // skip to the data's starting position (offset usually = 0)
@@ -5162,9 +7909,9 @@ static stbi_uc *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int
          //   any data to skip? (offset usually = 0)
          stbi__skip(s, tga_palette_start );
          //   load the palette
-         tga_palette = (unsigned char*)stbi__malloc( tga_palette_len * tga_comp );
+         tga_palette = (unsigned char*)stbi__malloc(s->alloc, tga_palette_len * tga_comp );
          if (!tga_palette) {
-            STBI_FREE(tga_data);
+            stbi__free(s->alloc, tga_data);
             return stbi__errpuc("outofmem", "Out of memory");
          }
          if (tga_rgb16) {
@@ -5175,8 +7922,8 @@ static stbi_uc *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int
                pal_entry += tga_comp;
             }
          } else if (!stbi__getn(s, tga_palette, tga_palette_len * tga_comp)) {
-               STBI_FREE(tga_data);
-               STBI_FREE(tga_palette);
+               stbi__free(s->alloc, tga_data);
+               stbi__free(s->alloc, tga_palette);
                return stbi__errpuc("bad palette", "Corrupt TGA");
          }
       }
@@ -5257,7 +8004,7 @@ static stbi_uc *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int
       //   clear my palette, if I had one
       if ( tga_palette != NULL )
       {
-         STBI_FREE( tga_palette );
+         stbi__free(s->alloc, tga_palette );
       }
    }
 
@@ -5276,7 +8023,7 @@ static stbi_uc *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int
 
    // convert to target component count
    if (req_comp && req_comp != tga_comp)
-      tga_data = stbi__convert_format(tga_data, tga_comp, req_comp, tga_width, tga_height);
+      tga_data = stbi__convert_format(s->alloc, tga_data, tga_comp, req_comp, tga_width, tga_height);
 
    //   the things I do to get rid of an error message, and yet keep
    //   Microsoft's C compilers happy... [8^(
@@ -5363,7 +8110,7 @@ static stbi_uc *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int
       return stbi__errpuc("bad compression", "PSD has an unknown compression format");
 
    // Create the destination image.
-   out = (stbi_uc *) stbi__malloc(4 * w*h);
+   out = (stbi_uc *) stbi__malloc(s->alloc, 4 * w*h);
    if (!out) return stbi__errpuc("outofmem", "Out of memory");
    pixelCount = w*h;
 
@@ -5470,7 +8217,7 @@ static stbi_uc *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int
    }
 
    if (req_comp && req_comp != 4) {
-      out = stbi__convert_format(out, 4, req_comp, w, h);
+      out = stbi__convert_format(s->alloc, out, 4, req_comp, w, h);
       if (out == NULL) return out; // stbi__convert_format frees input on failure
    }
 
@@ -5672,17 +8419,17 @@ static stbi_uc *stbi__pic_load(stbi__context *s,int *px,int *py,int *comp,int re
    stbi__get16be(s); //skip `pad'
 
    // intermediate buffer is RGBA
-   result = (stbi_uc *) stbi__malloc(x*y*4);
+   result = (stbi_uc *) stbi__malloc(s->alloc, x*y*4);
    memset(result, 0xff, x*y*4);
 
    if (!stbi__pic_load_core(s,x,y,comp, result)) {
-      STBI_FREE(result);
+      stbi__free(s->alloc, result);
       result=0;
    }
    *px = x;
    *py = y;
    if (req_comp == 0) req_comp = *comp;
-   result=stbi__convert_format(result,4,req_comp,x,y);
+   result=stbi__convert_format(s->alloc, result,4,req_comp,x,y);
 
    return result;
 }
@@ -5709,8 +8456,11 @@ typedef struct
 typedef struct
 {
    int w,h;
-   stbi_uc *out, *old_out;             // output buffer (always 4 components)
+   stbi_uc *out;                       // output buffer (always 4 components), kept from frame to frame
+   stbi_uc *history;                   // what was under a frame that's to be disposed to previous
    int flags, bgindex, ratio, transparent, eflags, delay;
+   int dispose;                        // how to dispose of the last frame before drawing the next
+   int dirty_x0, dirty_y0, dirty_x1, dirty_y1; // the pixels the last frame changed
    stbi_uc  pal[256][4];
    stbi_uc lpal[256][4];
    stbi__gif_lzw codes[4096];
@@ -5781,15 +8531,15 @@ static int stbi__gif_header(stbi__context *s, stbi__gif *g, int *comp, int is_in
 
 static int stbi__gif_info_raw(stbi__context *s, int *x, int *y, int *comp)
 {
-   stbi__gif* g = (stbi__gif*) stbi__malloc(sizeof(stbi__gif));
+   stbi__gif* g = (stbi__gif*) stbi__malloc(s->alloc, sizeof(stbi__gif));
    if (!stbi__gif_header(s, g, comp, 1)) {
-      STBI_FREE(g);
+      stbi__free(s->alloc, g);
       stbi__rewind( s );
       return 0;
    }
    if (x) *x = g->w;
    if (y) *y = g->h;
-   STBI_FREE(g);
+   stbi__free(s->alloc, g);
    return 1;
 }
 
@@ -5884,11 +8634,14 @@ static stbi_uc *stbi__process_gif_raster(stbi__context *s, stbi__gif *g)
             if (first) return stbi__errpuc("no clear code", "Corrupt GIF");
 
             if (oldcode >= 0) {
-               p = &g->codes[avail++];
-               if (avail > 4096)        return stbi__errpuc("too many codes", "Corrupt GIF");
-               p->prefix = (stbi__int16) oldcode;
-               p->first = g->codes[oldcode].first;
-               p->suffix = (code == avail) ? p->first : g->codes[code].first;
+               // once the table's full, encoders can go on without clearing
+               // it, and codes just stop being added
+               if (avail < 4096) {
+                  p = &g->codes[avail++];
+                  p->prefix = (stbi__int16) oldcode;
+                  p->first = g->codes[oldcode].first;
+                  p->suffix = (code == avail) ? p->first : g->codes[code].first;
+               }
             } else if (code == avail)
                return stbi__errpuc("illegal code in raster", "Corrupt GIF");
 
@@ -5922,40 +8675,70 @@ static void stbi__fill_gif_background(stbi__gif *g, int x0, int y0, int x1, int
    }
 }
 
-// this function is designed to support animated gifs, although stb_image doesn't support it
+// grow the rectangle the current frame has changed to take in the one from
+// start to max
+static void stbi__gif_mark_dirty(stbi__gif *g)
+{
+   int x0 = g->start_x / 4, y0 = g->start_y / g->line_size;
+   int x1 = g->max_x / 4,   y1 = g->max_y / g->line_size;
+   if (x0 >= x1 || y0 >= y1) return;
+   if (g->dirty_x0 >= g->dirty_x1) {
+      g->dirty_x0 = x0; g->dirty_y0 = y0;
+      g->dirty_x1 = x1; g->dirty_y1 = y1;
+   } else {
+      if (x0 < g->dirty_x0) g->dirty_x0 = x0;
+      if (y0 < g->dirty_y0) g->dirty_y0 = y0;
+      if (x1 > g->dirty_x1) g->dirty_x1 = x1;
+      if (y1 > g->dirty_y1) g->dirty_y1 = y1;
+   }
+}
+
+// decode the next frame onto the canvas in g->out, which is reused from one
+// frame to the next, and note the rectangle of it that changed. returns
+// g->out, or s once there are no more frames
 static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, int req_comp)
 {
    int i;
-   stbi_uc *prev_out = 0;
 
-   if (g->out == 0 && !stbi__gif_header(s, g, comp,0))
-      return 0; // stbi__g_failure_reason set by stbi__gif_header
-
-   prev_out = g->out;
-   g->out = (stbi_uc *) stbi__malloc(4 * g->w * g->h);
-   if (g->out == 0) return stbi__errpuc("outofmem", "Out of memory");
-
-   switch ((g->eflags & 0x1C) >> 2) {
-      case 0: // unspecified (also always used on 1st frame)
-         stbi__fill_gif_background(g, 0, 0, 4 * g->w, 4 * g->w * g->h);
-         break;
-      case 1: // do not dispose
-         if (prev_out) memcpy(g->out, prev_out, 4 * g->w * g->h);
-         g->old_out = prev_out;
-         break;
+   g->dirty_x0 = g->dirty_y0 = g->dirty_x1 = g->dirty_y1 = 0;
+   if (g->out == 0) {
+      if (!stbi__gif_header(s, g, comp,0))
+         return 0; // stbi__g_failure_reason set by stbi__gif_header
+      if (g->w == 0 || g->h == 0) return stbi__errpuc("0-pixel image", "Corrupt GIF");
+      g->out = (stbi_uc *) stbi__malloc(s->alloc, 4 * g->w * g->h);
+      if (g->out == 0) return stbi__errpuc("outofmem", "Out of memory");
+      g->line_size = g->w * 4;
+      g->start_x = g->start_y = 0;
+      g->max_x = g->line_size;
+      g->max_y = g->line_size * g->h;
+      stbi__fill_gif_background(g, g->start_x, g->start_y, g->max_x, g->max_y);
+      stbi__gif_mark_dirty(g);
+   }
+
+   // the last frame's disposal is part of what this one changes
+   switch (g->dispose) {
       case 2: // dispose to background
-         if (prev_out) memcpy(g->out, prev_out, 4 * g->w * g->h);
          stbi__fill_gif_background(g, g->start_x, g->start_y, g->max_x, g->max_y);
+         stbi__gif_mark_dirty(g);
          break;
       case 3: // dispose to previous
-         if (g->old_out) {
-            for (i = g->start_y; i < g->max_y; i += 4 * g->w)
-               memcpy(&g->out[i + g->start_x], &g->old_out[i + g->start_x], g->max_x - g->start_x);
-         }
+         for (i = g->start_y; i < g->max_y; i += g->line_size)
+            memcpy(&g->out[i + g->start_x], &g->history[i + g->start_x], g->max_x - g->start_x);
+         stbi__gif_mark_dirty(g);
+         break;
+      default: // unspecified, or do not dispose
          break;
    }
+   g->dispose = 0;
+
+   // a graphic control extension only applies to the image after it
+   g->eflags = 0;
+   g->delay = 0;
+   g->transparent = -1;
 
    for (;;) {
+      // plenty of GIFs leave off the trailer, and just end
+      if (stbi__at_eof(s)) return (stbi_uc *) s;
       switch (stbi__get8(s)) {
          case 0x2C: /* Image Descriptor */
          {
@@ -5970,7 +8753,6 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
             if (((x + w) > (g->w)) || ((y + h) > (g->h)))
                return stbi__errpuc("bad Image Descriptor", "Corrupt GIF");
 
-            g->line_size = g->w * 4;
             g->start_x = x * 4;
             g->start_y = y * g->line_size;
             g->max_x   = g->start_x + w * 4;
@@ -6000,8 +8782,20 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
             } else
                return stbi__errpuc("missing color table", "Corrupt GIF");
 
+            // keep what's under the frame, if it's to be put back after
+            g->dispose = (g->eflags & 0x1C) >> 2;
+            if (g->dispose == 3) {
+               if (g->history == 0) {
+                  g->history = (stbi_uc *) stbi__malloc(s->alloc, 4 * g->w * g->h);
+                  if (g->history == 0) return stbi__errpuc("outofmem", "Out of memory");
+               }
+               for (i = g->start_y; i < g->max_y; i += g->line_size)
+                  memcpy(&g->history[i + g->start_x], &g->out[i + g->start_x], g->max_x - g->start_x);
+            }
+
             o = stbi__process_gif_raster(s, g);
             if (o == NULL) return NULL;
+            stbi__gif_mark_dirty(g);
 
             if (prev_trans != -1)
                g->pal[g->transparent][3] = (stbi_uc) prev_trans;
@@ -6042,7 +8836,8 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
 static stbi_uc *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    stbi_uc *u = 0;
-   stbi__gif* g = (stbi__gif*) stbi__malloc(sizeof(stbi__gif));
+   stbi__gif* g = (stbi__gif*) stbi__malloc(s->alloc, sizeof(stbi__gif));
+   if (g == NULL) return stbi__errpuc("outofmem", "Out of memory");
    memset(g, 0, sizeof(*g));
 
    u = stbi__gif_load_next(s, g, comp, req_comp);
@@ -6051,11 +8846,12 @@ static stbi_uc *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int
       *x = g->w;
       *y = g->h;
       if (req_comp && req_comp != 4)
-         u = stbi__convert_format(u, 4, req_comp, g->w, g->h);
+         u = stbi__convert_format(s->alloc, u, 4, req_comp, g->w, g->h);
    }
    else if (g->out)
-      STBI_FREE(g->out);
-   STBI_FREE(g);
+      stbi__free(s->alloc, g->out);
+   stbi__free(s->alloc, g->history);
+   stbi__free(s->alloc, g);
    return u;
 }
 
@@ -6063,6 +8859,155 @@ static int stbi__gif_info(stbi__context *s, int *x, int *y, int *comp)
 {
    return stbi__gif_info_raw(s,x,y,comp);
 }
+
+// convert the rectangle of the canvas the last frame changed into 'dest',
+// whose rows are 'stride' bytes apart; they go bottom-up if flipping
+static void stbi__gif_copy_dirty(stbi__gif *g, stbi_uc *dest, int stride, int flip, int req_comp)
+{
+   int j, w = g->dirty_x1 - g->dirty_x0, h = g->dirty_y1 - g->dirty_y0;
+   for (j=0; j < h; ++j)
+      stbi__convert_format_into(dest + (size_t) stride * (flip ? h-1-j : j), 0, 0,
+                                g->out + ((size_t) (g->dirty_y0 + j) * g->w + g->dirty_x0) * 4, 4, req_comp, w, 1);
+}
+
+static stbi_gif_animation *stbi__gif_load_animation(stbi__context *s, int req_comp)
+{
+   stbi__gif *g;
+   stbi_gif_animation *anim = NULL;
+   stbi_gif_frame *frames = NULL, *f;
+   stbi_uc *pixels = NULL, *u;
+   size_t used = 0, cap = 0;
+   int i, n = req_comp ? req_comp : 4, num_frames = 0, max_frames = 0;
+
+   if (req_comp < 0 || req_comp > 4) return (stbi_gif_animation *) stbi__errpuc("bad req_comp", "Internal error");
+   if (!stbi__gif_test(s)) return (stbi_gif_animation *) stbi__errpuc("not GIF", "Image is not a GIF");
+   g = (stbi__gif *) stbi__malloc(s->alloc, sizeof(stbi__gif));
+   if (g == NULL) return (stbi_gif_animation *) stbi__errpuc("outofmem", "Out of memory");
+   memset(g, 0, sizeof(*g));
+
+   // each frame keeps only the rectangle it changed, one after another in
+   // 'pixels'; they're pointed at once it's done moving
+   while ((u = stbi__gif_load_next(s, g, NULL, req_comp)) != NULL && u != (stbi_uc *) s) {
+      int w = g->dirty_x1 - g->dirty_x0, h = g->dirty_y1 - g->dirty_y0;
+      size_t size = (size_t) w * h * n;
+      if (num_frames == max_frames) {
+         int grown = max_frames ? max_frames * 2 : 8;
+         f = (stbi_gif_frame *) stbi__realloc(s->alloc, frames, max_frames * sizeof(*frames), grown * sizeof(*frames));
+         if (f == NULL) { u = stbi__errpuc("outofmem", "Out of memory"); break; }
+         frames = f;
+         max_frames = grown;
+      }
+      if (used + size > cap) {
+         size_t grown = cap * 2 > used + size ? cap * 2 : used + size;
+         u = (stbi_uc *) stbi__realloc(s->alloc, pixels, cap, grown);
+         if (u == NULL) { stbi__err("outofmem", "Out of memory"); break; }
+         pixels = u;
+         cap = grown;
+      }
+      f = &frames[num_frames++];
+      f->x = g->dirty_x0;
+      f->y = stbi__vertically_flip_on_load ? g->h - g->dirty_y1 : g->dirty_y0;
+      f->w = w;
+      f->h = h;
+      f->delay = g->delay * 10;
+      f->pixels = NULL;
+      stbi__gif_copy_dirty(g, pixels + used, w * n, stbi__vertically_flip_on_load, n);
+      used += size;
+   }
+
+   if (u != NULL && num_frames == 0)
+      u = stbi__errpuc("no frames", "Corrupt GIF");
+   if (u != NULL)
+      anim = (stbi_gif_animation *) stbi__malloc(s->alloc, sizeof(*anim));
+   if (anim != NULL) {
+      anim->w = g->w;
+      anim->h = g->h;
+      anim->comp = n;
+      anim->num_frames = num_frames;
+      anim->frames = frames;
+      anim->pixels = pixels;
+      for (i=0; i < num_frames; ++i) {
+         frames[i].pixels = pixels;
+         pixels += (size_t) frames[i].w * frames[i].h * n;
+      }
+   } else {
+      if (u != NULL) stbi__err("outofmem", "Out of memory");
+      stbi__free(s->alloc, frames);
+      stbi__free(s->alloc, pixels);
+   }
+   stbi__free(s->alloc, g->out);
+   stbi__free(s->alloc, g->history);
+   stbi__free(s->alloc, g);
+   return anim;
+}
+
+static stbi_uc *stbi__gif_load_layers(stbi__context *s, int **delays, int *x, int *y, int *layers, int *comp, int req_comp)
+{
+   stbi__gif *g;
+   stbi_uc *out = NULL, *u;
+   int *delay = NULL;
+   int n = req_comp ? req_comp : 4, num_layers = 0, max_layers = 0;
+   size_t layer_size = 0;
+
+   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+   if (!stbi__gif_test(s)) return stbi__errpuc("not GIF", "Image is not a GIF");
+   g = (stbi__gif *) stbi__malloc(s->alloc, sizeof(stbi__gif));
+   if (g == NULL) return stbi__errpuc("outofmem", "Out of memory");
+   memset(g, 0, sizeof(*g));
+
+   while ((u = stbi__gif_load_next(s, g, comp, req_comp)) != NULL && u != (stbi_uc *) s) {
+      stbi_uc *layer;
+      int row_bytes = g->w * n;
+      layer_size = (size_t) row_bytes * g->h;
+      if (num_layers == max_layers) {
+         int grown = max_layers ? max_layers * 2 : 4;
+         u = (stbi_uc *) stbi__realloc(s->alloc, out, max_layers * layer_size, grown * layer_size);
+         if (u == NULL) { stbi__err("outofmem", "Out of memory"); break; }
+         out = u;
+         if (delays) {
+            int *d = (int *) stbi__realloc(s->alloc, delay, max_layers * sizeof(int), grown * sizeof(int));
+            if (d == NULL) { u = stbi__errpuc("outofmem", "Out of memory"); break; }
+            delay = d;
+         }
+         max_layers = grown;
+      }
+
+      // each layer starts as the one before, and only the rectangle that
+      // changed is converted over it
+      layer = out + num_layers * layer_size;
+      if (num_layers)
+         memcpy(layer, layer - layer_size, layer_size);
+      if (stbi__vertically_flip_on_load)
+         layer += (size_t) (g->h - g->dirty_y1) * row_bytes + g->dirty_x0 * n;
+      else
+         layer += (size_t) g->dirty_y0 * row_bytes + g->dirty_x0 * n;
+      stbi__gif_copy_dirty(g, layer, row_bytes, stbi__vertically_flip_on_load, n);
+      if (delays) delay[num_layers] = g->delay * 10;
+      ++num_layers;
+   }
+
+   if (u != NULL && num_layers == 0)
+      u = stbi__errpuc("no frames", "Corrupt GIF");
+   if (u != NULL) {
+      // give back what the last doubling didn't need
+      if (num_layers < max_layers) {
+         u = (stbi_uc *) stbi__realloc(s->alloc, out, max_layers * layer_size, num_layers * layer_size);
+         if (u != NULL) out = u;
+      }
+      *x = g->w;
+      *y = g->h;
+      *layers = num_layers;
+      if (delays) *delays = delay;
+   } else {
+      stbi__free(s->alloc, out);
+      stbi__free(s->alloc, delay);
+      out = NULL;
+   }
+   stbi__free(s->alloc, g->out);
+   stbi__free(s->alloc, g->history);
+   stbi__free(s->alloc, g);
+   return out;
+}
 #endif
 
 // *************************************************************************************************
@@ -6136,22 +9081,97 @@ static void stbi__hdr_convert(float *output, stbi_uc *input, int req_comp)
    }
 }
 
-static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+#ifdef STBI_SSE2
+// four rgbe pixels as four vectors of r,g,b,1 floats: each component times
+// 2^(e-136), built straight in the exponent bits, or 0 if e is 0. returns 0
+// if an exponent's under 10, which would want a denormal scale, and leaves
+// those to stbi__hdr_convert
+static int stbi__hdr_convert4_sse2(__m128 px[4], stbi_uc const *input)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i bytes = _mm_loadu_si128((__m128i const *) input);
+   __m128i e = _mm_srli_epi32(bytes, 24);
+   __m128i lo = _mm_unpacklo_epi8(bytes, zero), hi = _mm_unpackhi_epi8(bytes, zero);
+   __m128i p[4];
+   __m128 rgb = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+   __m128 one = _mm_setr_ps(0, 0, 0, 1.0f);
+   int k;
+   if (_mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi32(e, zero), _mm_cmplt_epi32(e, _mm_set1_epi32(10)))))
+      return 0;
+   p[0] = _mm_unpacklo_epi16(lo, zero);
+   p[1] = _mm_unpackhi_epi16(lo, zero);
+   p[2] = _mm_unpacklo_epi16(hi, zero);
+   p[3] = _mm_unpackhi_epi16(hi, zero);
+   for (k=0; k < 4; ++k) {
+      __m128i ek = _mm_shuffle_epi32(p[k], _MM_SHUFFLE(3,3,3,3));
+      __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(ek, _mm_set1_epi32(9)), 23));
+      __m128 keep = _mm_and_ps(rgb, _mm_castsi128_ps(_mm_cmpgt_epi32(ek, zero)));
+      px[k] = _mm_or_ps(_mm_and_ps(_mm_mul_ps(_mm_cvtepi32_ps(p[k]), scale), keep), one);
+   }
+   return 1;
+}
+#endif
+
+// convert a scanline of 'count' rgbe pixels to 'req_comp' floats each,
+// or to halves if 'halves' isn't NULL
+static void stbi__hdr_convert_row(float *output, stbi_us *halves, stbi_uc const *input, int count, int req_comp, int simd)
+{
+   int i = 0;
+   #ifdef STBI_SSE2
+   // the 3-component stores write a component past the pixel, which the
+   // next one overwrites, so the last pixel's left to the scalar loop
+   if (simd && req_comp >= 3) {
+      for (; i + 4 < count || (req_comp == 4 && i + 4 == count); i += 4) {
+         __m128 px[4];
+         int k;
+         if (!stbi__hdr_convert4_sse2(px, input + i*4)) {
+            for (k=0; k < 4; ++k) {
+               float f[4];
+               stbi__hdr_convert(f, (stbi_uc *) input + (i+k)*4, req_comp);
+               if (halves) stbi__float_to_half_run(halves + (i+k)*req_comp, f, req_comp);
+               else        memcpy(output + (i+k)*req_comp, f, req_comp * sizeof(float));
+            }
+         } else if (halves) {
+            __m128i h01 = _mm_packs_epi32(stbi__float_to_half_sse2(px[0]), stbi__float_to_half_sse2(px[1]));
+            __m128i h23 = _mm_packs_epi32(stbi__float_to_half_sse2(px[2]), stbi__float_to_half_sse2(px[3]));
+            if (req_comp == 4) {
+               _mm_storeu_si128((__m128i *) (halves + i*4    ), h01);
+               _mm_storeu_si128((__m128i *) (halves + i*4 + 8), h23);
+            } else {
+               _mm_storel_epi64((__m128i *) (halves + i*3    ), h01);
+               _mm_storel_epi64((__m128i *) (halves + i*3 + 3), _mm_srli_si128(h01, 8));
+               _mm_storel_epi64((__m128i *) (halves + i*3 + 6), h23);
+               _mm_storel_epi64((__m128i *) (halves + i*3 + 9), _mm_srli_si128(h23, 8));
+            }
+         } else {
+            for (k=0; k < 4; ++k)
+               _mm_storeu_ps(output + (i+k)*req_comp, px[k]);
+         }
+      }
+   }
+   #else
+   STBI_NOTUSED(simd);
+   #endif
+   for (; i < count; ++i) {
+      if (halves) {
+         float f[4];
+         stbi__hdr_convert(f, (stbi_uc *) input + i*4, req_comp);
+         stbi__float_to_half_run(halves + i*req_comp, f, req_comp);
+      } else
+         stbi__hdr_convert(output + i*req_comp, (stbi_uc *) input + i*4, req_comp);
+   }
+}
+
+// read the header, up to the first scanline
+static int stbi__hdr_header(stbi__context *s, int *x, int *y)
 {
    char buffer[STBI__HDR_BUFLEN];
    char *token;
    int valid = 0;
-   int width, height;
-   stbi_uc *scanline;
-   float *hdr_data;
-   int len;
-   unsigned char count, value;
-   int i, j, k, c1,c2, z;
-
 
    // Check identifier
    if (strcmp(stbi__hdr_gettoken(s,buffer), "#?RADIANCE") != 0)
-      return stbi__errpf("not HDR", "Corrupt HDR image");
+      return stbi__err("not HDR", "Corrupt HDR image");
 
    // Parse header
    for(;;) {
@@ -6160,91 +9180,192 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
       if (strcmp(token, "FORMAT=32-bit_rle_rgbe") == 0) valid = 1;
    }
 
-   if (!valid)    return stbi__errpf("unsupported format", "Unsupported HDR format");
+   if (!valid)    return stbi__err("unsupported format", "Unsupported HDR format");
 
    // Parse width and height
    // can't use sscanf() if we're not using stdio!
    token = stbi__hdr_gettoken(s,buffer);
-   if (strncmp(token, "-Y ", 3))  return stbi__errpf("unsupported data layout", "Unsupported HDR format");
+   if (strncmp(token, "-Y ", 3))  return stbi__err("unsupported data layout", "Unsupported HDR format");
    token += 3;
-   height = (int) strtol(token, &token, 10);
+   *y = (int) strtol(token, &token, 10);
    while (*token == ' ') ++token;
-   if (strncmp(token, "+X ", 3))  return stbi__errpf("unsupported data layout", "Unsupported HDR format");
+   if (strncmp(token, "+X ", 3))  return stbi__err("unsupported data layout", "Unsupported HDR format");
    token += 3;
-   width = (int) strtol(token, NULL, 10);
+   *x = (int) strtol(token, NULL, 10);
+   return 1;
+}
+
+// read a scanline of 'width' rgbe pixels. they're run-length encoded a
+// component at a time, unless the image is too narrow or wide for that, or
+// the first one turns out not to be, which means none of them are, and
+// *flat gets set
+static int stbi__hdr_scanline(stbi__context *s, stbi_uc *scanline, int width, int *flat)
+{
+   int i, k, c1, c2, len;
+   unsigned char count, value;
+   if (width < 8 || width >= 32768)
+      *flat = 1;
+   if (*flat) {
+      // Read flat data
+      stbi__getn(s, scanline, width * 4);
+      return 1;
+   }
+
+   c1 = stbi__get8(s);
+   c2 = stbi__get8(s);
+   len = stbi__get8(s);
+   if (c1 != 2 || c2 != 2 || (len & 0x80)) {
+      // not run-length encoded, so we have to actually use THIS data as a decoded
+      // pixel (note this can't be a valid pixel--one of RGB must be >= 128)
+      scanline[0] = (stbi_uc) c1;
+      scanline[1] = (stbi_uc) c2;
+      scanline[2] = (stbi_uc) len;
+      scanline[3] = (stbi_uc) stbi__get8(s);
+      stbi__getn(s, scanline + 4, (width - 1) * 4);
+      *flat = 1;
+      return 1;
+   }
+   len <<= 8;
+   len |= stbi__get8(s);
+   if (len != width) return stbi__err("invalid decoded scanline length", "corrupt HDR");
+
+   for (k = 0; k < 4; ++k) {
+      i = 0;
+      while (i < width) {
+         count = stbi__get8(s);
+         if (count > 128) {
+            // Run
+            value = stbi__get8(s);
+            count -= 128;
+            if (count > width - i) return stbi__err("corrupt", "bad RLE data in HDR");
+            while (count--)
+               scanline[i++ * 4 + k] = value;
+         } else {
+            // Dump
+            if (count == 0 || count > width - i) return stbi__err("corrupt", "bad RLE data in HDR");
+            while (count--)
+               scanline[i++ * 4 + k] = stbi__get8(s);
+         }
+      }
+   }
+   return 1;
+}
+
+// load as 'bytes' per component: 4 for floats, 2 for halves, or 1 for
+// stbi_load's bytes, a scanline at a time
+static void *stbi__hdr_load_as(stbi__context *s, int *x, int *y, int *comp, int req_comp, int bytes)
+{
+   int width, height;
+   stbi_uc *scanline, *out;
+   float *floats = NULL;
+   size_t row_bytes;
+   int j, flat = 0, simd = 0;
+
+   if (!stbi__hdr_header(s, &width, &height)) return NULL;
+   if (width <= 0 || height <= 0) return stbi__errpuc("0-pixel image", "Corrupt HDR image");
 
    *x = width;
    *y = height;
 
    if (comp) *comp = 3;
    if (req_comp == 0) req_comp = 3;
+   row_bytes = (size_t) width * req_comp * bytes;
+
+   #ifdef STBI_SSE2
+   simd = stbi__sse2_available();
+   #endif
 
    // Read data
-   hdr_data = (float *) stbi__malloc(height * width * req_comp * sizeof(float));
+   out = (stbi_uc *) stbi__malloc(s->alloc, row_bytes * height);
+   scanline = (stbi_uc *) stbi__malloc(s->alloc, width * 4);
+   if (bytes == 1)
+      floats = (float *) stbi__malloc(s->alloc, (size_t) width * req_comp * sizeof(float));
+   if (!out || !scanline || (bytes == 1 && !floats)) {
+      stbi__free(s->alloc, out);
+      stbi__free(s->alloc, scanline);
+      stbi__free(s->alloc, floats);
+      return stbi__errpuc("outofmem", "Out of memory");
+   }
 
    // Load image data
-   // image data is stored as some number of sca
-   if ( width < 8 || width >= 32768) {
-      // Read flat data
-      for (j=0; j < height; ++j) {
-         for (i=0; i < width; ++i) {
-            stbi_uc rgbe[4];
-           main_decode_loop:
-            stbi__getn(s, rgbe, 4);
-            stbi__hdr_convert(hdr_data + j * width * req_comp + i * req_comp, rgbe, req_comp);
-         }
+   for (j = 0; j < height; ++j) {
+      stbi_uc *row = out + row_bytes * j;
+      if (!stbi__hdr_scanline(s, scanline, width, &flat)) {
+         stbi__free(s->alloc, out);
+         out = NULL;
+         break;
       }
-   } else {
-      // Read RLE-encoded data
-      scanline = NULL;
-
-      for (j = 0; j < height; ++j) {
-         c1 = stbi__get8(s);
-         c2 = stbi__get8(s);
-         len = stbi__get8(s);
-         if (c1 != 2 || c2 != 2 || (len & 0x80)) {
-            // not run-length encoded, so we have to actually use THIS data as a decoded
-            // pixel (note this can't be a valid pixel--one of RGB must be >= 128)
-            stbi_uc rgbe[4];
-            rgbe[0] = (stbi_uc) c1;
-            rgbe[1] = (stbi_uc) c2;
-            rgbe[2] = (stbi_uc) len;
-            rgbe[3] = (stbi_uc) stbi__get8(s);
-            stbi__hdr_convert(hdr_data, rgbe, req_comp);
-            i = 1;
-            j = 0;
-            STBI_FREE(scanline);
-            goto main_decode_loop; // yes, this makes no sense
-         }
-         len <<= 8;
-         len |= stbi__get8(s);
-         if (len != width) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
-         if (scanline == NULL) scanline = (stbi_uc *) stbi__malloc(width * 4);
-
-         for (k = 0; k < 4; ++k) {
-            i = 0;
-            while (i < width) {
-               count = stbi__get8(s);
-               if (count > 128) {
-                  // Run
-                  value = stbi__get8(s);
-                  count -= 128;
-                  for (z = 0; z < count; ++z)
-                     scanline[i++ * 4 + k] = value;
-               } else {
-                  // Dump
-                  for (z = 0; z < count; ++z)
-                     scanline[i++ * 4 + k] = stbi__get8(s);
-               }
-            }
-         }
-         for (i=0; i < width; ++i)
-            stbi__hdr_convert(hdr_data+(j*width + i)*req_comp, scanline + i*4, req_comp);
+      if (bytes == 4)
+         stbi__hdr_convert_row((float *) row, NULL, scanline, width, req_comp, simd);
+      else if (bytes == 2)
+         stbi__hdr_convert_row(NULL, (stbi_us *) row, scanline, width, req_comp, simd);
+      else {
+         stbi__hdr_convert_row(floats, NULL, scanline, width, req_comp, simd);
+         stbi__hdr_to_ldr_into(row, floats, width, req_comp);
       }
-      STBI_FREE(scanline);
    }
+   stbi__free(s->alloc, scanline);
+   stbi__free(s->alloc, floats);
+
+   return out;
+}
 
-   return hdr_data;
+// an hdr being decoded a band at a time
+typedef struct
+{
+   int flat, simd;
+   stbi_uc *scanline;
+   float *floats;   // a row of them
+   stbi_uc *band;
+   int band_rows;
+} stbi__hdr_stream;
+
+static stbi_uc *stbi__hdr_stream_rows(stbi__stream *st, int *num_rows)
+{
+   stbi__hdr_stream *h = (stbi__hdr_stream *) st->state;
+   int j, rows = st->y - st->row < h->band_rows ? st->y - st->row : h->band_rows;
+   for (j=0; j < rows; ++j) {
+      if (!stbi__hdr_scanline(&st->s, h->scanline, st->x, &h->flat)) return NULL;
+      stbi__hdr_convert_row(h->floats, NULL, h->scanline, st->x, st->n, h->simd);
+      stbi__hdr_to_ldr_into(h->band + (size_t) j * st->x * st->n, h->floats, st->x, st->n);
+   }
+   *num_rows = rows;
+   return h->band;
+}
+
+static void stbi__hdr_stream_close(stbi__stream *st)
+{
+   stbi__hdr_stream *h = (stbi__hdr_stream *) st->state;
+   if (h == NULL) return;
+   STBI_FREE(h->scanline);
+   STBI_FREE(h->floats);
+   STBI_FREE(h->band);
+   STBI_FREE(h);
+}
+
+static int stbi__hdr_stream_start(stbi__stream *st, int req_comp)
+{
+   stbi__hdr_stream *h;
+   if (!stbi__hdr_header(&st->s, &st->x, &st->y)) return 0;
+   if (st->x <= 0 || st->y <= 0) return stbi__err("0-pixel image", "Corrupt HDR image");
+   st->comp = 3;
+   st->n = req_comp ? req_comp : 3;
+   h = (stbi__hdr_stream *) STBI_MALLOC(sizeof(stbi__hdr_stream));
+   if (h == NULL) return stbi__err("outofmem", "Out of memory");
+   st->state = h;
+   st->next_rows = stbi__hdr_stream_rows;
+   st->close = stbi__hdr_stream_close;
+   h->flat = 0;
+   h->simd = 0;
+   #ifdef STBI_SSE2
+   h->simd = stbi__sse2_available();
+   #endif
+   h->band_rows = stbi__stream_band_rows(st);
+   h->scanline = (stbi_uc *) STBI_MALLOC((size_t) st->x * 4);
+   h->floats = (float *) STBI_MALLOC((size_t) st->x * st->n * sizeof(float));
+   h->band = (stbi_uc *) STBI_MALLOC((size_t) st->x * st->n * h->band_rows);
+   if (!h->scanline || !h->floats || !h->band) return stbi__err("outofmem", "Out of memory");
+   return 1;
 }
 
 static int stbi__hdr_info(stbi__context *s, int *x, int *y, int *comp)
@@ -6428,12 +9549,12 @@ static stbi_uc *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int
    *y = s->img_y;
    *comp = s->img_n;
 
-   out = (stbi_uc *) stbi__malloc(s->img_n * s->img_x * s->img_y);
+   out = (stbi_uc *) stbi__malloc(s->alloc, s->img_n * s->img_x * s->img_y);
    if (!out) return stbi__errpuc("outofmem", "Out of memory");
    stbi__getn(s, out, s->img_n * s->img_x * s->img_y);
 
    if (req_comp && req_comp != s->img_n) {
-      out = stbi__convert_format(out, s->img_n, req_comp, s->img_x, s->img_y);
+      out = stbi__convert_format(s->alloc, out, s->img_n, req_comp, s->img_x, s->img_y);
       if (out == NULL) return out; // stbi__convert_format frees input on failure
    }
    return out;
@@ -6510,48 +9631,167 @@ static int      stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp)
 }
 #endif
 
-static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp)
+// tell an image's format from its first few bytes. everything but TGA starts
+// with a signature whose second byte is more than 1, which no TGA's colormap
+// type can be, so a file with a signature can't be a TGA, and one without can
+// only be a TGA
+static int stbi__info_sniff(stbi__context *s)
 {
-   #ifndef STBI_NO_JPEG
-   if (stbi__jpeg_info(s, x, y, comp)) return 1;
-   #endif
+   stbi_uc m[4];
+   int i;
+   for (i=0; i < 4; ++i)
+      m[i] = stbi__get8(s);
+   stbi__rewind(s);
 
-   #ifndef STBI_NO_PNG
-   if (stbi__png_info(s, x, y, comp))  return 1;
-   #endif
+   if (m[0] == 0xff && (m[1] == 0xd8 || m[1] == 0xff))            return STBI_format_jpeg;
+   if (m[0] == 0x89 && m[1] == 'P' && m[2] == 'N' && m[3] == 'G')  return STBI_format_png;
+   if (m[0] == 'G' && m[1] == 'I' && m[2] == 'F' && m[3] == '8')   return STBI_format_gif;
+   if (m[0] == 'B' && m[1] == 'M')                                 return STBI_format_bmp;
+   if (m[0] == '8' && m[1] == 'B' && m[2] == 'P' && m[3] == 'S')   return STBI_format_psd;
+   if (m[0] == 0x53 && m[1] == 0x80 && m[2] == 0xf6 && m[3] == 0x34) return STBI_format_pic;
+   if (m[0] == 'P' && (m[1] == '5' || m[1] == '6'))                return STBI_format_pnm;
+   if (m[0] == '#' && m[1] == '?')                                 return STBI_format_hdr;
+   return STBI_format_tga;
+}
 
-   #ifndef STBI_NO_GIF
-   if (stbi__gif_info(s, x, y, comp))  return 1;
-   #endif
+// parse just the one format's header
+static int stbi__info_format(stbi__context *s, int format, int *x, int *y, int *comp, int *bits)
+{
+   *bits = 8;
+   switch (format) {
+      #ifndef STBI_NO_JPEG
+      case STBI_format_jpeg: return stbi__jpeg_info(s, x, y, comp);
+      #endif
 
-   #ifndef STBI_NO_BMP
-   if (stbi__bmp_info(s, x, y, comp))  return 1;
-   #endif
+      #ifndef STBI_NO_PNG
+      case STBI_format_png: {
+         stbi__png p;
+         p.s = s;
+         p.stream = NULL;
+         if (!stbi__png_info_raw(&p, x, y, comp)) return 0;
+         // a paletted image's 1/2/4-bit indices are into 8-bit entries
+         if (p.depth >= 8 || *comp < 3) *bits = p.depth;
+         return 1;
+      }
+      #endif
 
-   #ifndef STBI_NO_PSD
-   if (stbi__psd_info(s, x, y, comp))  return 1;
-   #endif
+      #ifndef STBI_NO_GIF
+      case STBI_format_gif: return stbi__gif_info(s, x, y, comp);
+      #endif
 
-   #ifndef STBI_NO_PIC
-   if (stbi__pic_info(s, x, y, comp))  return 1;
-   #endif
+      #ifndef STBI_NO_BMP
+      case STBI_format_bmp: return stbi__bmp_info(s, x, y, comp);
+      #endif
 
-   #ifndef STBI_NO_PNM
-   if (stbi__pnm_info(s, x, y, comp))  return 1;
-   #endif
+      #ifndef STBI_NO_PSD
+      case STBI_format_psd: return stbi__psd_info(s, x, y, comp);
+      #endif
 
-   #ifndef STBI_NO_HDR
-   if (stbi__hdr_info(s, x, y, comp))  return 1;
-   #endif
+      #ifndef STBI_NO_PIC
+      case STBI_format_pic: return stbi__pic_info(s, x, y, comp);
+      #endif
 
-   // test tga last because it's a crappy test!
-   #ifndef STBI_NO_TGA
-   if (stbi__tga_info(s, x, y, comp))
-       return 1;
-   #endif
-   return stbi__err("unknown image type", "Image not of any known type, or corrupt");
+      #ifndef STBI_NO_PNM
+      case STBI_format_pnm: return stbi__pnm_info(s, x, y, comp);
+      #endif
+
+      #ifndef STBI_NO_HDR
+      case STBI_format_hdr: *bits = 32; return stbi__hdr_info(s, x, y, comp);
+      #endif
+
+      #ifndef STBI_NO_TGA
+      case STBI_format_tga: return stbi__tga_info(s, x, y, comp);
+      #endif
+   }
+   return 0;
 }
 
+static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp)
+{
+   int ix, iy, icomp, bits;
+   if (!stbi__info_format(s, stbi__info_sniff(s), &ix, &iy, &icomp, &bits))
+      return stbi__err("unknown image type", "Image not of any known type, or corrupt");
+   if (x) *x = ix;
+   if (y) *y = iy;
+   if (comp) *comp = icomp;
+   return 1;
+}
+
+static void stbi__info_result(stbi__context *s, stbi_info_result *r)
+{
+   int format = stbi__info_sniff(s);
+   if (stbi__info_format(s, format, &r->x, &r->y, &r->comp, &r->bits))
+      r->format = format;
+   else
+      memset(r, 0, sizeof(*r));
+}
+
+typedef struct
+{
+   char const * const *filenames; // or NULL, for buffers
+   stbi_uc const * const *buffers;
+   int const *lens;
+   stbi_info_result *results;
+} stbi__info_batch;
+
+static void stbi__info_batch_task(void *task_data, int begin, int end)
+{
+   stbi__info_batch *b = (stbi__info_batch *) task_data;
+   stbi__context s;
+   int i;
+   for (i=begin; i < end; ++i) {
+      memset(&b->results[i], 0, sizeof(b->results[i]));
+      #ifndef STBI_NO_STDIO
+      if (b->filenames) {
+         FILE *f = stbi__fopen(b->filenames[i], "rb");
+         if (!f) continue;
+         stbi__start_file(&s, f);
+         stbi__info_result(&s, &b->results[i]);
+         fclose(f);
+         continue;
+      }
+      #endif
+      stbi__start_mem(&s, b->buffers[i], b->lens[i]);
+      stbi__info_result(&s, &b->results[i]);
+   }
+}
+
+static int stbi__info_batch_run(stbi__info_batch *b, int count, stbi_parallel_for_func *parallel_for, void *user)
+{
+   int i, found = 0;
+   if (count <= 0) return 0;
+   if (parallel_for)
+      parallel_for(user, count, stbi__info_batch_task, b);
+   else
+      stbi__info_batch_task(b, 0, count);
+   for (i=0; i < count; ++i)
+      if (b->results[i].format != STBI_format_unknown)
+         ++found;
+   return found;
+}
+
+STBIDEF int stbi_info_batch_from_memory(stbi_uc const * const *buffers, int const *lens, int count, stbi_info_result *results, stbi_parallel_for_func *parallel_for, void *user)
+{
+   stbi__info_batch b;
+   b.filenames = NULL;
+   b.buffers = buffers;
+   b.lens = lens;
+   b.results = results;
+   return stbi__info_batch_run(&b, count, parallel_for, user);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_info_batch(char const * const *filenames, int count, stbi_info_result *results, stbi_parallel_for_func *parallel_for, void *user)
+{
+   stbi__info_batch b;
+   b.filenames = filenames;
+   b.buffers = NULL;
+   b.lens = NULL;
+   b.results = results;
+   return stbi__info_batch_run(&b, count, parallel_for, user);
+}
+#endif
+
 #ifndef STBI_NO_STDIO
 STBIDEF int stbi_info(char const *filename, int *x, int *y, int *comp)
 {
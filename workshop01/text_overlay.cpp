@@ -0,0 +1,39 @@
+// Text overlay: a small grid of characters, drawn over the scene by fragment_shader_overlay.glsl
+
+#include "text_overlay.h"
+
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+void clear_text_overlay(text_overlay* overlay)
+{
+	memset(overlay->text, ' ', sizeof(overlay->text));
+	overlay->num_rows = 0;
+}
+
+void print_text_overlay(text_overlay* overlay, const char* format, ...)
+{
+	if (overlay->num_rows >= overlay_rows)
+		return;
+
+	char line[overlay_columns + 1];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	if (length < 0)
+		return;
+
+	char* row = overlay->text[overlay->num_rows++];
+	for (int i = 0; i < overlay_columns && line[i]; ++i)
+		row[i] = char(toupper((unsigned char)line[i]));
+}
+
+void pack_text_overlay(const text_overlay& overlay, uint32_t out[overlay_rows * overlay_columns / 4])
+{
+	const unsigned char* text = (const unsigned char*)&overlay.text[0][0];
+	for (int i = 0; i < overlay_rows * overlay_columns / 4; ++i)
+		out[i] = uint32_t(text[4 * i]) | (uint32_t(text[4 * i + 1]) << 8) | (uint32_t(text[4 * i + 2]) << 16) | (uint32_t(text[4 * i + 3]) << 24);
+}
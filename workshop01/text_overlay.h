@@ -0,0 +1,24 @@
+// Text overlay: a small grid of characters, drawn over the scene by fragment_shader_overlay.glsl
+#pragma once
+
+#include <cstdint>
+
+// The size of the grid; these match fragment_shader_overlay.glsl
+static const int overlay_columns = 32;
+static const int overlay_rows = 16;
+
+struct text_overlay
+{
+	char	text[overlay_rows][overlay_columns];
+	int		num_rows;		// rows written so far
+};
+
+// Empty the overlay, ready to print into again
+void clear_text_overlay(text_overlay* overlay);
+
+// Add a row of text, printf-style. It's upper-cased, since the font only has capitals, and cut off
+// at the overlay's width. Rows past the last one are dropped.
+void print_text_overlay(text_overlay* overlay, const char* format, ...);
+
+// Pack the text four characters to a uint, the way the shader reads it
+void pack_text_overlay(const text_overlay& overlay, uint32_t out[overlay_rows * overlay_columns / 4]);
@@ -0,0 +1,328 @@
+// Texture compression: the block formats cooked textures come in, the DDS files they're kept in, and the encoders the cooker uses
+
+#include "texture_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// The bits of a DDS file we use. The header's fields are little-endian 32-bit words, after the
+// four byte magic number; see Microsoft's DDS_HEADER and DDS_HEADER_DXT10.
+static const uint32_t dds_magic = 0x20534444;				// "DDS "
+static const size_t dds_header_size = 124;
+static const size_t dds_dx10_header_size = 20;
+static const uint32_t dds_fourcc_dxt1 = 0x31545844;			// "DXT1"
+static const uint32_t dds_fourcc_dxt5 = 0x35545844;			// "DXT5"
+static const uint32_t dds_fourcc_dx10 = 0x30315844;			// "DX10"
+static const uint32_t dds_pixel_format_fourcc = 0x4;
+static const uint32_t dds_caps2_cubemap = 0x200;
+static const uint32_t dds_caps2_volume = 0x200000;
+static const uint32_t dxgi_format_bc1_unorm = 71;
+static const uint32_t dxgi_format_bc3_unorm = 77;
+static const uint32_t dxgi_format_bc7_unorm = 98;
+static const uint32_t dxgi_dimension_texture2d = 3;
+
+// Offsets of the fields, counting from the start of the header
+enum dds_field
+{
+	dds_size = 0,
+	dds_flags = 4,
+	dds_height = 8,
+	dds_width = 12,
+	dds_linear_size = 16,
+	dds_mip_count = 24,
+	dds_pixel_format_size = 72,
+	dds_pixel_format_flags = 76,
+	dds_fourcc = 80,
+	dds_caps = 104,
+	dds_caps2 = 108,
+};
+
+static uint32_t read_u32(const unsigned char* data)
+{
+	return uint32_t(data[0]) | (uint32_t(data[1]) << 8) | (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24);
+}
+
+static void write_u32(unsigned char* data, uint32_t value)
+{
+	data[0] = (unsigned char)value;
+	data[1] = (unsigned char)(value >> 8);
+	data[2] = (unsigned char)(value >> 16);
+	data[3] = (unsigned char)(value >> 24);
+}
+
+int compressed_block_bytes(GLenum format)
+{
+	switch (format)
+	{
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:		return 8;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:		return 16;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM_ARB:		return 16;
+	default:									return 0;
+	}
+}
+
+size_t compressed_level_size(GLenum format, int width, int height)
+{
+	return size_t((width + 3) / 4) * size_t((height + 3) / 4) * size_t(compressed_block_bytes(format));
+}
+
+bool parse_dds(const unsigned char* data, size_t size, compressed_texture* o_texture, const char** o_failure_reason)
+{
+	if (size < 4 + dds_header_size || read_u32(data) != dds_magic || read_u32(data + 4 + dds_size) != dds_header_size)
+	{
+		*o_failure_reason = "not a DDS file";
+		return false;
+	}
+	const unsigned char* header = data + 4;
+	size_t offset = 4 + dds_header_size;
+
+	GLenum format = 0;
+	uint32_t fourcc = read_u32(header + dds_fourcc);
+	if (!(read_u32(header + dds_pixel_format_flags) & dds_pixel_format_fourcc))
+		fourcc = 0;
+	if (fourcc == dds_fourcc_dxt1)
+		format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+	else if (fourcc == dds_fourcc_dxt5)
+		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	else if (fourcc == dds_fourcc_dx10 && size >= offset + dds_dx10_header_size)
+	{
+		// Only single 2D textures; the array size is the fourth field
+		const unsigned char* dx10 = data + offset;
+		offset += dds_dx10_header_size;
+		uint32_t dxgi_format = read_u32(dx10);
+		if (read_u32(dx10 + 4) == dxgi_dimension_texture2d && read_u32(dx10 + 12) == 1)
+		{
+			if (dxgi_format == dxgi_format_bc1_unorm)
+				format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+			else if (dxgi_format == dxgi_format_bc3_unorm)
+				format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			else if (dxgi_format == dxgi_format_bc7_unorm)
+				format = GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+		}
+	}
+	if (!format || (read_u32(header + dds_caps2) & (dds_caps2_cubemap | dds_caps2_volume)))
+	{
+		*o_failure_reason = "not a BC1, BC3 or BC7 2D texture";
+		return false;
+	}
+
+	o_texture->format = format;
+	o_texture->width = int(read_u32(header + dds_width));
+	o_texture->height = int(read_u32(header + dds_height));
+	o_texture->num_levels = std::min(std::max(int(read_u32(header + dds_mip_count)), 1), max_texture_levels);
+	if (o_texture->width <= 0 || o_texture->height <= 0)
+	{
+		*o_failure_reason = "bad size";
+		return false;
+	}
+
+	// The levels follow one another, largest first
+	for (int level = 0; level < o_texture->num_levels; ++level)
+	{
+		texture_level& layout = o_texture->levels[level];
+		layout.width = std::max(o_texture->width >> level, 1);
+		layout.height = std::max(o_texture->height >> level, 1);
+		layout.offset = offset;
+		layout.size = compressed_level_size(format, layout.width, layout.height);
+		offset += layout.size;
+	}
+	if (offset > size)
+	{
+		*o_failure_reason = "file is cut short";
+		return false;
+	}
+	return true;
+}
+
+bool write_dds(FILE* file, const compressed_texture& texture, const unsigned char* blocks)
+{
+	// Caps, height, width, pixel format, mip count and linear size are there
+	unsigned char header[4 + dds_header_size] = {};
+	write_u32(header, dds_magic);
+	unsigned char* fields = header + 4;
+	write_u32(fields + dds_size, uint32_t(dds_header_size));
+	write_u32(fields + dds_flags, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000);
+	write_u32(fields + dds_height, uint32_t(texture.height));
+	write_u32(fields + dds_width, uint32_t(texture.width));
+	write_u32(fields + dds_linear_size, uint32_t(texture.levels[0].size));
+	write_u32(fields + dds_mip_count, uint32_t(texture.num_levels));
+	write_u32(fields + dds_pixel_format_size, 32);
+	write_u32(fields + dds_pixel_format_flags, dds_pixel_format_fourcc);
+	write_u32(fields + dds_caps, 0x1000 | (texture.num_levels > 1 ? 0x400008 : 0));		// a texture, with mipmaps if there are any
+
+	// BC7 has no four character code of its own, so it needs the DX10 header
+	unsigned char dx10[dds_dx10_header_size] = {};
+	bool has_dx10 = (texture.format == GL_COMPRESSED_RGBA_BPTC_UNORM_ARB);
+	if (texture.format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
+		write_u32(fields + dds_fourcc, dds_fourcc_dxt1);
+	else if (texture.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+		write_u32(fields + dds_fourcc, dds_fourcc_dxt5);
+	else if (has_dx10)
+	{
+		write_u32(fields + dds_fourcc, dds_fourcc_dx10);
+		write_u32(dx10, dxgi_format_bc7_unorm);
+		write_u32(dx10 + 4, dxgi_dimension_texture2d);
+		write_u32(dx10 + 12, 1);
+	}
+	else
+		return false;
+
+	bool written = fwrite(header, sizeof(header), 1, file) == 1;
+	if (has_dx10)
+		written = written && fwrite(dx10, sizeof(dx10), 1, file) == 1;
+	for (int level = 0; level < texture.num_levels; ++level)
+		written = written && fwrite(blocks + texture.levels[level].offset, texture.levels[level].size, 1, file) == 1;
+	return written;
+}
+
+// Endpoints are stored as 5:6:5, and decoded by repeating their top bits into the bottom ones
+static uint16_t pack_565(const float color[3])
+{
+	int r = std::min(std::max(int(color[0] * (31.0f / 255.0f) + 0.5f), 0), 31);
+	int g = std::min(std::max(int(color[1] * (63.0f / 255.0f) + 0.5f), 0), 63);
+	int b = std::min(std::max(int(color[2] * (31.0f / 255.0f) + 0.5f), 0), 31);
+	return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static void unpack_565(uint16_t packed, int o_color[3])
+{
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	o_color[0] = (r << 3) | (r >> 2);
+	o_color[1] = (g << 2) | (g >> 4);
+	o_color[2] = (b << 3) | (b >> 2);
+}
+
+// The colors lie mostly along a line, which the block's two endpoints are put on: the covariance's
+// main axis, found by power iteration, from which the ends are pulled in a little, as the texels
+// near them are fewer than the ones in between.
+void encode_bc1_block(const unsigned char rgba[64], unsigned char o_block[8])
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; ++i)
+	{
+		for (int c = 0; c < 3; ++c)
+			mean[c] += float(rgba[i * 4 + c]) * (1.0f / 16.0f);
+	}
+	float covariance[6] = {};
+	for (int i = 0; i < 16; ++i)
+	{
+		float d[3] = { float(rgba[i * 4]) - mean[0], float(rgba[i * 4 + 1]) - mean[1], float(rgba[i * 4 + 2]) - mean[2] };
+		covariance[0] += d[0] * d[0];
+		covariance[1] += d[0] * d[1];
+		covariance[2] += d[0] * d[2];
+		covariance[3] += d[1] * d[1];
+		covariance[4] += d[1] * d[2];
+		covariance[5] += d[2] * d[2];
+	}
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; ++iteration)
+	{
+		float next[3] =
+		{
+			covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+			covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+			covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2],
+		};
+		float length = std::max(std::max(std::fabs(next[0]), std::fabs(next[1])), std::fabs(next[2]));
+		if (length < 1e-6f)
+			break;
+		for (int c = 0; c < 3; ++c)
+			axis[c] = next[c] / length;
+	}
+	float axis_length_sq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+	float min_t = 0.0f, max_t = 0.0f;
+	for (int i = 0; i < 16; ++i)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < 3; ++c)
+			t += (float(rgba[i * 4 + c]) - mean[c]) * axis[c];
+		t /= axis_length_sq;
+		min_t = std::min(min_t, t);
+		max_t = std::max(max_t, t);
+	}
+	float inset = (max_t - min_t) / 16.0f;
+	min_t += inset;
+	max_t -= inset;
+	float ends[2][3];
+	for (int c = 0; c < 3; ++c)
+	{
+		ends[0][c] = mean[c] + axis[c] * max_t;
+		ends[1][c] = mean[c] + axis[c] * min_t;
+	}
+
+	// The first endpoint has to be the greater for the block to have four colors, rather than
+	// three and transparent black
+	uint16_t endpoints[2] = { pack_565(ends[0]), pack_565(ends[1]) };
+	if (endpoints[0] < endpoints[1])
+		std::swap(endpoints[0], endpoints[1]);
+	int palette[4][3];
+	unpack_565(endpoints[0], palette[0]);
+	unpack_565(endpoints[1], palette[1]);
+	for (int c = 0; c < 3; ++c)
+	{
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	uint32_t indices = 0;
+	for (int i = 0; i < 16 && endpoints[0] != endpoints[1]; ++i)
+	{
+		int best = 0, best_error = 0x7fffffff;
+		for (int p = 0; p < 4; ++p)
+		{
+			int error = 0;
+			for (int c = 0; c < 3; ++c)
+			{
+				int d = int(rgba[i * 4 + c]) - palette[p][c];
+				error += d * d;
+			}
+			if (error < best_error)
+			{
+				best = p;
+				best_error = error;
+			}
+		}
+		indices |= uint32_t(best) << (i * 2);
+	}
+
+	o_block[0] = (unsigned char)endpoints[0];
+	o_block[1] = (unsigned char)(endpoints[0] >> 8);
+	o_block[2] = (unsigned char)endpoints[1];
+	o_block[3] = (unsigned char)(endpoints[1] >> 8);
+	write_u32(o_block + 4, indices);
+}
+
+// BC3 is an alpha block, whose two endpoints are the extremes, with six steps in between, followed
+// by a BC1 color block
+void encode_bc3_block(const unsigned char rgba[64], unsigned char o_block[16])
+{
+	int alpha_max = 0, alpha_min = 255;
+	for (int i = 0; i < 16; ++i)
+	{
+		alpha_max = std::max(alpha_max, int(rgba[i * 4 + 3]));
+		alpha_min = std::min(alpha_min, int(rgba[i * 4 + 3]));
+	}
+	int palette[8] = { alpha_max, alpha_min };
+	for (int step = 1; step < 7; ++step)
+		palette[step + 1] = ((7 - step) * alpha_max + step * alpha_min) / 7;
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 16 && alpha_max != alpha_min; ++i)
+	{
+		int best = 0;
+		for (int p = 1; p < 8; ++p)
+		{
+			if (std::abs(int(rgba[i * 4 + 3]) - palette[p]) < std::abs(int(rgba[i * 4 + 3]) - palette[best]))
+				best = p;
+		}
+		indices |= uint64_t(best) << (i * 3);
+	}
+
+	o_block[0] = (unsigned char)alpha_max;
+	o_block[1] = (unsigned char)alpha_min;
+	for (int i = 0; i < 6; ++i)
+		o_block[2 + i] = (unsigned char)(indices >> (i * 8));
+	encode_bc1_block(rgba, o_block + 8);
+}
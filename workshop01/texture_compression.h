@@ -0,0 +1,50 @@
+// Texture compression: the block formats cooked textures come in, the DDS files they're kept in, and the encoders the cooker uses
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include <glad/glad.h>
+
+// Enough for a 32K texture's whole mip chain
+static const int max_texture_levels = 16;
+
+// Where one mip level's blocks are, in a cooked texture's data
+struct texture_level
+{
+	int			width;
+	int			height;
+	size_t		offset;
+	size_t		size;
+};
+
+// A cooked texture's layout: its format, and its levels, largest first
+struct compressed_texture
+{
+	GLenum			format;		// one of the GL_COMPRESSED_* formats below
+	int				width;
+	int				height;
+	int				num_levels;
+	texture_level	levels[max_texture_levels];
+};
+
+// The formats cooked textures can be in. BC1 is opaque, at 4 bits a texel; BC3 and BC7 have alpha,
+// at 8. Returns 0 for anything else.
+int compressed_block_bytes(GLenum format);
+
+// The bytes in a level of the given size, which is padded out to whole 4x4 blocks
+size_t compressed_level_size(GLenum format, int width, int height);
+
+// Find a DDS file's levels, as offsets into its data. BC1 and BC3 are read from either kind of
+// header; BC7 needs the DX10 one. Returns false, with the reason, if it's not a DDS file, or not
+// one of those formats, or is cut short.
+bool parse_dds(const unsigned char* data, size_t size, compressed_texture* o_texture, const char** o_failure_reason);
+
+// Write a DDS file with the given levels, taken from 'blocks' at their offsets. Returns false if
+// the writes failed.
+bool write_dds(FILE* file, const compressed_texture& texture, const unsigned char* blocks);
+
+// Compress a 4x4 block of RGBA8 texels, given in rows, top first. BC1 ignores their alpha.
+void encode_bc1_block(const unsigned char rgba[64], unsigned char o_block[8]);
+void encode_bc3_block(const unsigned char rgba[64], unsigned char o_block[16]);
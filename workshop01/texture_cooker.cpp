@@ -0,0 +1,196 @@
+// texture_cooker: compresses images ahead of time into DDS files, with their mipmaps, which the
+// texture streamer loads in place of the images, at a quarter to an eighth of the memory
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mip_generator.h"
+#include "texture_compression.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// Options; set on the command line
+GLenum cook_format = 0;				// 0 to pick BC1 for opaque images, and BC3 for ones with alpha
+int max_size = 0;					// 0 for no limit; otherwise levels bigger than this are left out
+std::vector<const char*> input_files;
+
+// The cooked file goes next to the image, where the streamer looks for it
+static std::string get_cooked_filename(const char* filename)
+{
+	std::string cooked = filename;
+	size_t dot = cooked.find_last_of('.');
+	size_t slash = cooked.find_last_of("/\\");
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+		cooked.erase(dot);
+	return cooked + ".dds";
+}
+
+// Compress a level a block at a time. Blocks over the edge repeat the last row and column.
+static void compress_level(const unsigned char* rgba, int width, int height, GLenum format, unsigned char* o_blocks)
+{
+	int block_bytes = compressed_block_bytes(format);
+	for (int block_y = 0; block_y < height; block_y += 4)
+	{
+		for (int block_x = 0; block_x < width; block_x += 4)
+		{
+			unsigned char texels[64];
+			for (int y = 0; y < 4; ++y)
+			{
+				for (int x = 0; x < 4; ++x)
+				{
+					const unsigned char* texel = rgba + (std::min(block_y + y, height - 1) * width + std::min(block_x + x, width - 1)) * 4;
+					memcpy(texels + (y * 4 + x) * 4, texel, 4);
+				}
+			}
+			if (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
+				encode_bc1_block(texels, o_blocks);
+			else
+				encode_bc3_block(texels, o_blocks);
+			o_blocks += block_bytes;
+		}
+	}
+}
+
+static bool cook_texture(const char* filename)
+{
+	int width = 0, height = 0, channels = 0;
+	unsigned char* pixels = stbi_load(filename, &width, &height, &channels, 4);
+	if (!pixels)
+	{
+		printf("Error: couldn't load %s (%s) :(\n", filename, stbi_failure_reason());
+		return false;
+	}
+	std::vector<unsigned char> level_pixels(pixels, pixels + size_t(width) * height * 4);
+	stbi_image_free(pixels);
+
+	GLenum format = cook_format;
+	if (!format)
+	{
+		bool opaque = true;
+		for (size_t i = 3; i < level_pixels.size() && opaque; i += 4)
+			opaque = (level_pixels[i] == 255);
+		format = opaque ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+
+	// Go down the mip chain, all the way to 1x1, averaging in linear light as the streamer does,
+	// and compress each level that's small enough
+	compressed_texture texture = {};
+	texture.format = format;
+	std::vector<unsigned char> blocks;
+	std::vector<unsigned char> half_pixels;
+	for (;;)
+	{
+		if ((max_size == 0 || std::max(width, height) <= max_size) && texture.num_levels < max_texture_levels)
+		{
+			if (texture.num_levels == 0)
+			{
+				texture.width = width;
+				texture.height = height;
+			}
+			texture_level& level = texture.levels[texture.num_levels++];
+			level.width = width;
+			level.height = height;
+			level.offset = blocks.size();
+			level.size = compressed_level_size(format, width, height);
+			blocks.resize(blocks.size() + level.size);
+			compress_level(level_pixels.data(), width, height, format, blocks.data() + level.offset);
+		}
+		if (width == 1 && height == 1)
+			break;
+
+		half_pixels.resize(size_t(std::max(width / 2, 1)) * std::max(height / 2, 1) * 4);
+		downsample_rows(level_pixels.data(), width, height, half_pixels.data(), 0, std::max(height / 2, 1));
+		level_pixels.swap(half_pixels);
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+
+	std::string cooked_filename = get_cooked_filename(filename);
+	FILE* file = fopen(cooked_filename.c_str(), "wb");
+	if (!file)
+	{
+		printf("Error: couldn't open %s for writing :(\n", cooked_filename.c_str());
+		return false;
+	}
+	bool written = write_dds(file, texture, blocks.data());
+	written = (fclose(file) == 0) && written;
+	if (!written)
+	{
+		printf("Error: couldn't write %s :(\n", cooked_filename.c_str());
+		remove(cooked_filename.c_str());
+		return false;
+	}
+	printf("%s: %dx%d, %d levels, %s, %.1f KB\n", cooked_filename.c_str(), texture.width, texture.height, texture.num_levels,
+		(format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? "BC1" : "BC3", double(blocks.size()) / 1024.0);
+	return true;
+}
+
+static bool parse_command_line(int argc, const char** argv)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* option = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		char* value_end = nullptr;
+
+		if (strcmp(option, "--format") == 0 && value)
+		{
+			if (strcmp(value, "bc1") == 0)
+				cook_format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+			else if (strcmp(value, "bc3") == 0)
+				cook_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			else
+			{
+				printf("Error: --format must be bc1 or bc3 :(\n");
+				return false;
+			}
+			++i;
+		}
+		else if (strcmp(option, "--max-size") == 0 && value)
+		{
+			long size = strtol(value, &value_end, 10);
+			if (*value_end != '\0' || size < 1)
+			{
+				printf("Error: --max-size must be at least 1 :(\n");
+				return false;
+			}
+			max_size = int(size);
+			++i;
+		}
+		else if (option[0] != '-')
+		{
+			input_files.push_back(option);
+		}
+		else
+		{
+			printf("Error: unrecognized option %s :(\n", option);
+			input_files.clear();
+			break;
+		}
+	}
+	if (input_files.empty())
+	{
+		printf("Usage: texture_cooker [--format bc1|bc3] [--max-size <texels>] <image> [<image> ...]\n");
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, const char** argv)
+{
+	if (!parse_command_line(argc, argv))
+		return -1;
+
+	int failed = 0;
+	for (const char* filename : input_files)
+	{
+		if (!cook_texture(filename))
+			++failed;
+	}
+	return failed ? -1 : 0;
+}
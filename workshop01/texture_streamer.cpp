@@ -0,0 +1,734 @@
+// Texture streamer: decodes image files on background threads, and uploads them a slice at a time so loading never hitches a frame
+
+#include "texture_streamer.h"
+#include "gl_state.h"
+#include "gl_debug.h"
+#include "async_log.h"
+#include "cpu_profiler.h"
+#include "gpu_memory.h"
+#include "job_system.h"
+#include "mip_generator.h"
+#include "perf_counters.h"
+#include "thread_config.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+static int texture_upload_bytes_counter = -1;		// texels sent to GL, by the render thread or the workers
+static int texture_resident_bytes_counter = -1;		// of the textures that are all there, counting their mipmaps
+
+// What a texture takes up once it's resident: all its levels
+static int64_t resident_texture_bytes(const streamed_texture& texture)
+{
+	int64_t bytes = 0;
+	for (int level = 0; level < texture.num_levels; ++level)
+		bytes += int64_t(texture.levels[level].size);
+	return bytes;
+}
+
+// Levels are uploaded in slices of rows: of texels, or of 4x4 blocks for a compressed texture
+static int get_upload_rows(const streamed_texture& texture, int level)
+{
+	int height = texture.levels[level].height;
+	return texture.compressed_format ? (height + 3) / 4 : height;
+}
+
+static size_t get_upload_row_bytes(const streamed_texture& texture, int level)
+{
+	int width = texture.levels[level].width;
+	if (texture.compressed_format)
+		return size_t((width + 3) / 4) * size_t(compressed_block_bytes(texture.compressed_format));
+	return size_t(width) * 4;
+}
+
+// Whether the GL can sample a cooked texture's format. Desktop GLs all have S3TC, but it's still
+// an extension.
+static bool compressed_format_usable(GLenum format)
+{
+	if (format == GL_COMPRESSED_RGBA_BPTC_UNORM_ARB)
+		return GLAD_GL_ARB_texture_compression_bptc != 0;
+	return GLAD_GL_EXT_texture_compression_s3tc != 0;
+}
+
+// The cooker's file for an image: the same name, with a .dds extension
+static std::string get_cooked_filename(const std::string& filename)
+{
+	size_t dot = filename.find_last_of('.');
+	size_t slash = filename.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return filename + ".dds";
+	return filename.substr(0, dot) + ".dds";
+}
+
+// Set up a texture to be allocated with the given format, and then have its levels sent from the
+// pixels. Everything's bound and unbound here, so this can go on a GL worker, or the GL thread.
+static void create_streamed_texture(streamed_texture* texture)
+{
+	glGenTextures(1, &texture->texture);
+	glBindTexture(GL_TEXTURE_2D, texture->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	label_gl_object(GL_TEXTURE, texture->texture, texture->filename.c_str());
+	set_gpu_memory(gpu_memory_texture, texture->texture, resident_texture_bytes(*texture));
+
+	// A cooked texture may have been cut short of 1x1, as may a huge one, so it's only sampled down
+	// to the levels it has
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture->num_levels - 1);
+}
+
+// Read a whole file into memory. It could be at different relative paths depending on which
+// directory we started the app from, same as the shaders.
+static bool read_texture_file(const std::string& filename, std::vector<unsigned char>* o_data)
+{
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (!file)
+		file = fopen(("../" + filename).c_str(), "rb");
+	if (!file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long file_size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	o_data->resize(size_t(std::max(file_size, 0L)));
+	bool read = file_size > 0 && fread(o_data->data(), size_t(file_size), 1, file) == 1;
+	fclose(file);
+	return read;
+}
+
+// stb_image's parallel-for, for spreading big JPEGs' decodes across the job system. The decode
+// threads aren't workers, so their jobs go in alongside the main thread's, and it may run one while
+// it waits on its own; each is only a band of rows, though, so that's not much of a hitch.
+static void parallel_for_jobs(void*, int count, stbi_parallel_task* task, void* task_data)
+{
+	static const int max_jobs = 64;
+	int num_jobs = std::min(std::min(count, job_thread_count() * 4), max_jobs);
+	job jobs[max_jobs];
+	for (int i = 0; i < num_jobs; ++i)
+		jobs[i] = job{ task, task_data, int(int64_t(count) * i / num_jobs), int(int64_t(count) * (i + 1) / num_jobs), nullptr };
+	std::atomic<int> counter(0);
+	submit_jobs(jobs, num_jobs, &counter);
+	wait_for_counter(&counter);
+}
+
+// Where a decode thread's stb_image scratch comes from: one block, bumped through and reset after
+// each image, so decodes don't fight over the heap or fragment it. JPEGs' bands allocate from it on
+// the job threads too, hence the atomic. Anything that doesn't fit goes to the heap, and the block
+// grows to what the image wanted the next time it's reset, so it soon covers the biggest texture.
+struct decode_arena
+{
+	char*				base;
+	size_t				capacity;
+	std::atomic<size_t>	used;
+};
+
+static const size_t decode_arena_alignment = 16;
+
+static void* arena_malloc(void* user, size_t size)
+{
+	decode_arena* arena = (decode_arena*)user;
+	size_t aligned = (size + decode_arena_alignment - 1) & ~(decode_arena_alignment - 1);
+	size_t offset = arena->used.fetch_add(aligned, std::memory_order_relaxed);
+	if (offset + aligned <= arena->capacity)
+		return arena->base + offset;
+	return malloc(size);
+}
+
+static void arena_free(void* user, void* p)
+{
+	decode_arena* arena = (decode_arena*)user;
+	if ((char*)p < arena->base || (char*)p >= arena->base + arena->capacity)
+		free(p);
+}
+
+static void* arena_realloc(void* user, void* p, size_t old_size, size_t new_size)
+{
+	void* q = arena_malloc(user, new_size);
+	if (q && p)
+	{
+		memcpy(q, p, std::min(old_size, new_size));
+		arena_free(user, p);
+	}
+	return q;
+}
+
+static void reset_decode_arena(decode_arena* arena)
+{
+	size_t wanted = arena->used.load(std::memory_order_relaxed);
+	if (wanted > arena->capacity)
+	{
+		free(arena->base);
+		arena->base = (char*)malloc(wanted);
+		arena->capacity = arena->base ? wanted : 0;
+	}
+	arena->used.store(0, std::memory_order_relaxed);
+}
+
+// Upload a whole decoded texture, on a GL worker. Only the worker's own bindings are touched here,
+// so none of the GL state tracking's needed.
+static void upload_texture_on_worker(void* data)
+{
+	streamed_texture* texture = (streamed_texture*)data;
+	CPU_PROFILE_SCOPE("upload texture");
+	create_streamed_texture(texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	for (int level = 0; level < texture->num_levels; ++level)
+	{
+		const texture_level& layout = texture->levels[level];
+		if (texture->compressed_format)
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, texture->compressed_format, layout.width, layout.height, 0, GLsizei(layout.size), texture->pixels + layout.offset);
+		else
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, layout.width, layout.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture->pixels + layout.offset);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	add_perf_counter(texture_upload_bytes_counter, resident_texture_bytes(*texture));
+}
+
+// Decoding can start before there's a GL context, but what the GL can sample isn't known until
+// there is, so cooked textures wait here for it
+static void wait_for_gl_ready(texture_streamer* streamer)
+{
+	std::unique_lock<std::mutex> lock(streamer->lock);
+	streamer->wake.wait(lock, [streamer] { return streamer->gl_ready || streamer->quitting; });
+}
+
+// Load a cooked texture's blocks, if there's a DDS file for it that the GL can use. If not, it's
+// left to be decoded from the image instead, unless the DDS file's what was asked for, in which
+// case it's failed, and this says why.
+static bool load_cooked_texture(texture_streamer* streamer, streamed_texture* texture, std::vector<unsigned char>* file_data, const char** o_failure_reason)
+{
+	std::string cooked_filename = get_cooked_filename(texture->filename);
+	bool asked_for = (cooked_filename == texture->filename);
+	if (!read_texture_file(cooked_filename, file_data))
+	{
+		if (asked_for)
+			*o_failure_reason = "can't read the file";
+		return false;
+	}
+
+	compressed_texture cooked;
+	const char* failure_reason = nullptr;
+	bool parsed = parse_dds(file_data->data(), file_data->size(), &cooked, &failure_reason);
+	if (parsed)
+		wait_for_gl_ready(streamer);
+	if (parsed && !compressed_format_usable(cooked.format))
+		failure_reason = "the GL can't sample its format";
+	else if (parsed)
+	{
+		// The levels are one after another in the file, so they're copied out all at once
+		const texture_level& last = cooked.levels[cooked.num_levels - 1];
+		size_t start = cooked.levels[0].offset;
+		texture->pixels = (unsigned char*)malloc(last.offset + last.size - start);
+		if (!texture->pixels)
+			failure_reason = "out of memory";
+		else
+			memcpy(texture->pixels, file_data->data() + start, last.offset + last.size - start);
+	}
+	if (failure_reason)
+	{
+		if (asked_for)
+			*o_failure_reason = failure_reason;
+		else
+			log_message(log_warning, 0, "Warning: couldn't use %s (%s), so decoding %s instead!", cooked_filename.c_str(), failure_reason, texture->filename.c_str());
+		return false;
+	}
+
+	texture->width = cooked.width;
+	texture->height = cooked.height;
+	texture->compressed_format = cooked.format;
+	texture->num_levels = cooked.num_levels;
+	for (int level = 0; level < cooked.num_levels; ++level)
+	{
+		texture->levels[level] = cooked.levels[level];
+		texture->levels[level].offset -= cooked.levels[0].offset;
+	}
+	return true;
+}
+
+// Levels at least this big have their rows made in bands across the job system
+static const int parallel_mip_texels = 256 * 256;
+
+// A level to make from the one above, in bands of rows
+struct mip_level_job
+{
+	const unsigned char*	source;
+	int						source_width;
+	int						source_height;
+	unsigned char*			destination;
+};
+
+static void downsample_band(void* data, int begin, int end)
+{
+	const mip_level_job* level = (const mip_level_job*)data;
+	downsample_rows(level->source, level->source_width, level->source_height, level->destination, begin, end);
+}
+
+// Decode an image into RGBA8 with stb_image, and make its mipmaps. Returns why it couldn't, or null.
+static const char* decode_texture(streamed_texture* texture, std::vector<unsigned char>* file_data, const stbi_allocator* allocator, decode_arena* arena)
+{
+	if (!read_texture_file(texture->filename, file_data))
+		return "can't read the file";
+
+	// Always four channels, so every texture uploads the same way. The pixels have to outlive
+	// the arena, so they're decoded into memory of their own, with room after them for the
+	// mipmaps. (stb_image's failure reason is a global, but all it's ever set to is a string
+	// literal, so a race only muddles the message.)
+	int channels = 0;
+	const char* failure_reason = nullptr;
+	if (!stbi_info_from_memory(file_data->data(), int(file_data->size()), &texture->width, &texture->height, &channels))
+		failure_reason = stbi_failure_reason();
+	else
+	{
+		size_t size = stbi_load_into_size(texture->width, texture->height, channels, 4, 0);
+		size_t chain_size = 0;
+		texture->num_levels = get_mip_chain_layout(texture->width, texture->height, texture->levels, &chain_size);
+		texture->pixels = size ? (unsigned char*)malloc(std::max(size, chain_size)) : nullptr;
+		if (!texture->pixels)
+			failure_reason = "out of memory";
+		else if (!stbi_load_into_from_memory_with_allocator(file_data->data(), int(file_data->size()), texture->pixels, size, 0,
+					&texture->width, &texture->height, &channels, 4, allocator))
+			failure_reason = stbi_failure_reason();
+	}
+	reset_decode_arena(arena);
+	if (failure_reason)
+	{
+		free(texture->pixels);
+		texture->pixels = nullptr;
+		return failure_reason;
+	}
+
+	// Each level's made from the one above, here rather than by the GL, which would hold up the
+	// GL thread, and whose filtering varies from driver to driver. Big levels are spread across
+	// the job system, as big JPEGs are.
+	CPU_PROFILE_SCOPE("generate mipmaps");
+	for (int level = 1; level < texture->num_levels; ++level)
+	{
+		const texture_level& above = texture->levels[level - 1];
+		const texture_level& layout = texture->levels[level];
+		mip_level_job job = { texture->pixels + above.offset, above.width, above.height, texture->pixels + layout.offset };
+		if (layout.width * layout.height >= parallel_mip_texels)
+			parallel_for(layout.height, 1, &downsample_band, &job);
+		else
+			downsample_band(&job, 0, layout.height);
+	}
+	return nullptr;
+}
+
+static void decode_thread_main(texture_streamer* streamer, int thread_index)
+{
+	char thread_name[32];
+	snprintf(thread_name, sizeof(thread_name), "texture decode %d", thread_index);
+	set_cpu_profiler_thread_name(thread_name);
+	set_thread_role(thread_role_decode, thread_index);
+
+	std::vector<unsigned char> file_data;
+	decode_arena arena;
+	arena.base = nullptr;
+	arena.capacity = 0;
+	arena.used.store(0, std::memory_order_relaxed);
+	stbi_allocator allocator = { &arena_malloc, &arena_realloc, &arena_free, &arena };
+	for (;;)
+	{
+		streamed_texture* texture;
+		{
+			std::unique_lock<std::mutex> lock(streamer->lock);
+			streamer->wake.wait(lock, [streamer] { return !streamer->decode_queue.empty() || streamer->quitting; });
+			if (streamer->quitting)
+			{
+				free(arena.base);
+				return;
+			}
+			texture = streamer->decode_queue.front();
+			streamer->decode_queue.pop_front();
+		}
+
+		CPU_PROFILE_SCOPE("decode texture");
+		const char* failure_reason = nullptr;
+		if (!load_cooked_texture(streamer, texture, &file_data, &failure_reason) && !failure_reason)
+			failure_reason = decode_texture(texture, &file_data, &allocator, &arena);
+		if (failure_reason)
+		{
+			texture->failure_reason = failure_reason;
+			texture->state.store(streamed_texture_failed, std::memory_order_release);
+			continue;
+		}
+
+		// The GL thread can't touch it while it's on a worker, until it sees it's uploading. Before
+		// the GL's ready, there are no workers yet, so it's left for start_texture_uploads() to
+		// hand on; deciding under the lock means it can't miss any.
+		bool to_worker;
+		{
+			std::lock_guard<std::mutex> guard(streamer->lock);
+			to_worker = streamer->gl_ready && gl_worker_count() > 0;
+			if (!to_worker)
+				texture->state.store(streamed_texture_decoded, std::memory_order_release);
+		}
+		if (to_worker)
+		{
+			texture->on_worker = true;
+			start_gl_task(&texture->upload, &upload_texture_on_worker, texture);
+			texture->state.store(streamed_texture_uploading, std::memory_order_release);
+		}
+	}
+}
+
+void init_texture_streamer(texture_streamer* streamer, int num_decode_threads)
+{
+	streamer->placeholder = 0;
+	streamer->pixel_buffer = 0;
+	streamer->next_upload = 0;
+	streamer->frame = 0;
+	streamer->gl_ready = false;
+	streamer->quitting = false;
+	texture_upload_bytes_counter = register_perf_counter("texture upload bytes", perf_counter_per_frame);
+	texture_resident_bytes_counter = register_perf_counter("texture resident bytes", perf_counter_running);
+
+	stbi_set_jpeg_parallel_for(&parallel_for_jobs, nullptr);
+	for (int i = 0; i < num_decode_threads; ++i)
+		streamer->threads.emplace_back(&decode_thread_main, streamer, i);
+}
+
+void start_texture_uploads(texture_streamer* streamer)
+{
+	static const unsigned char white[4] = { 255, 255, 255, 255 };
+	glGenTextures(1, &streamer->placeholder);
+	glBindTexture(GL_TEXTURE_2D, streamer->placeholder);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	label_gl_object(GL_TEXTURE, streamer->placeholder, "placeholder texture");
+	set_gpu_memory(gpu_memory_texture, streamer->placeholder, 4);
+
+	glGenBuffers(1, &streamer->pixel_buffer);
+	state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, streamer->pixel_buffer);
+	label_gl_object(GL_BUFFER, streamer->pixel_buffer, "texture streaming");
+	state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	{
+		std::lock_guard<std::mutex> guard(streamer->lock);
+		streamer->gl_ready = true;
+	}
+	streamer->wake.notify_all();
+
+	// Anything decoded in the meantime is the GL thread's, so it can go to the workers from here
+	if (gl_worker_count() > 0)
+	{
+		for (streamed_texture& texture : streamer->textures)
+		{
+			if (texture.state.load(std::memory_order_acquire) != streamed_texture_decoded)
+				continue;
+			texture.on_worker = true;
+			start_gl_task(&texture.upload, &upload_texture_on_worker, &texture);
+			texture.state.store(streamed_texture_uploading, std::memory_order_release);
+		}
+	}
+}
+
+void free_texture_streamer(texture_streamer* streamer)
+{
+	{
+		std::lock_guard<std::mutex> guard(streamer->lock);
+		streamer->quitting = true;
+	}
+	streamer->wake.notify_all();
+	for (std::thread& thread : streamer->threads)
+		thread.join();
+	streamer->threads.clear();
+	streamer->decode_queue.clear();
+	stbi_set_jpeg_parallel_for(nullptr, nullptr);
+
+	for (streamed_texture& texture : streamer->textures)
+	{
+		// The workers may still have the pixels, or not have made the texture yet
+		if (texture.on_worker && texture.state.load(std::memory_order_acquire) == streamed_texture_uploading)
+			finish_gl_task(&texture.upload);
+		free(texture.pixels);
+		set_gpu_memory(gpu_memory_texture, texture.texture, 0);
+		if (texture.texture)
+			glDeleteTextures(1, &texture.texture);
+		if (texture.state.load(std::memory_order_relaxed) == streamed_texture_resident)
+			add_perf_counter(texture_resident_bytes_counter, -resident_texture_bytes(texture));
+	}
+	streamer->textures.clear();
+	set_gpu_memory(gpu_memory_texture, streamer->placeholder, 0);
+	set_gpu_memory(gpu_memory_buffer, streamer->pixel_buffer, 0);
+	if (streamer->placeholder)
+		glDeleteTextures(1, &streamer->placeholder);
+	if (streamer->pixel_buffer)
+		state_delete_buffers(1, &streamer->pixel_buffer);
+	streamer->placeholder = 0;
+	streamer->pixel_buffer = 0;
+	streamer->next_upload = 0;
+	streamer->gl_ready = false;
+}
+
+// Start a texture off from nothing, and give it to the decode threads. It's the GL thread's, so
+// it's fine to reset, as it's either new or evicted.
+static void queue_texture(texture_streamer* streamer, int handle)
+{
+	streamed_texture& texture = streamer->textures[size_t(handle)];
+	texture.state.store(streamed_texture_queued, std::memory_order_relaxed);
+	texture.failure_reason = nullptr;
+	texture.width = 0;
+	texture.height = 0;
+	texture.compressed_format = 0;
+	texture.num_levels = 0;
+	texture.pixels = nullptr;
+	texture.levels_uploaded = 0;
+	texture.rows_uploaded = 0;
+	texture.texture = 0;
+	texture.on_worker = false;
+	texture.released = false;
+	texture.last_used = streamer->frame;
+	streamer->next_upload = std::min(streamer->next_upload, handle);
+	{
+		std::lock_guard<std::mutex> guard(streamer->lock);
+		streamer->decode_queue.push_back(&texture);
+	}
+	// (All of them, as any waiting on the GL have to be passed over)
+	streamer->wake.notify_all();
+}
+
+int request_texture(texture_streamer* streamer, const char* filename)
+{
+	for (size_t i = 0; i < streamer->textures.size(); ++i)
+	{
+		streamed_texture& texture = streamer->textures[i];
+		if (texture.filename != filename)
+			continue;
+		if (texture.state.load(std::memory_order_relaxed) == streamed_texture_evicted)
+			queue_texture(streamer, int(i));
+		texture.released = false;
+		return int(i);
+	}
+
+	streamer->textures.emplace_back();
+	streamer->textures.back().filename = filename;
+	int handle = int(streamer->textures.size() - 1);
+	queue_texture(streamer, handle);
+	return handle;
+}
+
+GLuint get_streamed_texture(texture_streamer* streamer, int handle)
+{
+	streamed_texture& texture = streamer->textures[size_t(handle)];
+	int state = texture.state.load(std::memory_order_acquire);
+	texture.last_used = streamer->frame;
+	texture.released = false;
+	if (state == streamed_texture_evicted)
+		queue_texture(streamer, handle);
+	if (state == streamed_texture_resident || (state == streamed_texture_uploading && !texture.on_worker && texture.levels_uploaded > 0))
+		return texture.texture;
+	return streamer->placeholder;
+}
+
+void release_streamed_texture(texture_streamer* streamer, int handle)
+{
+	streamer->textures[size_t(handle)].released = true;
+}
+
+int64_t evict_streamed_textures(texture_streamer* streamer, int64_t bytes)
+{
+	std::vector<streamed_texture*> candidates;
+	for (streamed_texture& texture : streamer->textures)
+	{
+		if (texture.released && texture.state.load(std::memory_order_relaxed) == streamed_texture_resident)
+			candidates.push_back(&texture);
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const streamed_texture* a, const streamed_texture* b) { return a->last_used < b->last_used; });
+
+	// Whatever's still drawing from one has been issued already, and the GL keeps it until that's done
+	int64_t freed = 0;
+	for (size_t i = 0; i < candidates.size() && freed < bytes; ++i)
+	{
+		streamed_texture& texture = *candidates[i];
+		int64_t texture_bytes = resident_texture_bytes(texture);
+		set_gpu_memory(gpu_memory_texture, texture.texture, 0);
+		glDeleteTextures(1, &texture.texture);
+		texture.texture = 0;
+		texture.levels_uploaded = 0;
+		texture.state.store(streamed_texture_evicted, std::memory_order_relaxed);
+		add_perf_counter(texture_resident_bytes_counter, -texture_bytes);
+		freed += texture_bytes;
+	}
+	return freed;
+}
+
+// Most runs of rows to upload in one frame, each from a different texture; any more wait for the next
+static const int max_upload_slices = 16;
+
+// A run of rows of one of a texture's levels, at 'offset' in this frame's pixel buffer
+struct texture_upload_slice
+{
+	streamed_texture*	texture;
+	int					level;
+	int					first_row;
+	int					num_rows;
+	size_t				offset;
+};
+
+void update_texture_streamer(texture_streamer* streamer, size_t byte_budget)
+{
+	CPU_PROFILE_SCOPE("stream textures");
+	++streamer->frame;
+
+	// Work out which rows fit, taking textures in the order they were asked for. Ones still being
+	// decoded don't hold up the ones after them.
+	texture_upload_slice slices[max_upload_slices];
+	int num_slices = 0;
+	size_t used = 0;
+	bool all_done_so_far = true;
+	for (size_t i = size_t(streamer->next_upload); i < streamer->textures.size() && num_slices < max_upload_slices; ++i)
+	{
+		streamed_texture& texture = streamer->textures[i];
+		int state = texture.state.load(std::memory_order_acquire);
+		if (state == streamed_texture_uploading && texture.on_worker && is_gl_task_complete(&texture.upload))
+		{
+			finish_gl_task(&texture.upload);
+			free(texture.pixels);
+			texture.pixels = nullptr;
+			texture.levels_uploaded = texture.num_levels;
+			state = streamed_texture_resident;
+			texture.state.store(state, std::memory_order_relaxed);
+			add_perf_counter(texture_resident_bytes_counter, resident_texture_bytes(texture));
+		}
+		if (state == streamed_texture_failed && texture.failure_reason)
+		{
+			printf("Warning: couldn't load texture %s (%s)!\n", texture.filename.c_str(), texture.failure_reason);
+			texture.failure_reason = nullptr;
+		}
+		if (state == streamed_texture_resident || state == streamed_texture_failed || state == streamed_texture_evicted)
+		{
+			if (all_done_so_far)
+				streamer->next_upload = int(i + 1);
+			continue;
+		}
+		all_done_so_far = false;
+		if (state == streamed_texture_queued || texture.on_worker)
+			continue;
+
+		// The levels go up smallest first, so the texture can be drawn with as soon as the first is
+		// in, and sharpens as the rest arrive. The small ones all fit in the same frame.
+		int num_uploaded = texture.levels_uploaded;
+		int first_row = texture.rows_uploaded;
+		bool budget_spent = false;
+		while (num_uploaded < texture.num_levels && num_slices < max_upload_slices)
+		{
+			int level = texture.num_levels - 1 - num_uploaded;
+			size_t row_bytes = get_upload_row_bytes(texture, level);
+			int rows = int(std::min(size_t(get_upload_rows(texture, level) - first_row), (byte_budget - used) / row_bytes));
+			if (rows == 0 && used == 0)
+				rows = 1;
+			if (rows == 0)
+			{
+				budget_spent = true;
+				break;
+			}
+			slices[num_slices++] = texture_upload_slice{ &texture, level, first_row, rows, used };
+			used += size_t(rows) * row_bytes;
+			first_row += rows;
+			if (first_row == get_upload_rows(texture, level))
+			{
+				++num_uploaded;
+				first_row = 0;
+			}
+			if (used >= byte_budget)
+			{
+				budget_spent = true;
+				break;
+			}
+		}
+		if (budget_spent)
+			break;
+	}
+	if (num_slices == 0)
+		return;
+
+	// Give the pixel buffer fresh storage, so the driver hands us new memory rather than waiting
+	// for last frame's uploads to finish reading the old, and copy the rows in
+	state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, streamer->pixel_buffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(used), nullptr, GL_STREAM_DRAW);
+	set_gpu_memory(gpu_memory_buffer, streamer->pixel_buffer, int64_t(used));
+	char* mapped = (char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(used), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (!mapped)
+	{
+		log_message(log_warning, 0, "Warning: couldn't map the texture streaming buffer!");
+		state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return;
+	}
+	for (int i = 0; i < num_slices; ++i)
+	{
+		const texture_upload_slice& slice = slices[i];
+		size_t row_bytes = get_upload_row_bytes(*slice.texture, slice.level);
+		const unsigned char* level_pixels = slice.texture->pixels + slice.texture->levels[slice.level].offset;
+		memcpy(mapped + slice.offset, level_pixels + size_t(slice.first_row) * row_bytes, size_t(slice.num_rows) * row_bytes);
+	}
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	add_perf_counter(texture_upload_bytes_counter, int64_t(used));
+
+	// The rows go in as they come, top first, so t = 0 is the top of the image
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	for (int i = 0; i < num_slices; ++i)
+	{
+		const texture_upload_slice& slice = slices[i];
+		streamed_texture& texture = *slice.texture;
+		if (!texture.texture)
+		{
+			create_streamed_texture(&texture);
+
+			// Allocating it reads nothing, so the pixel buffer mustn't be bound for this one
+			state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			for (int level = 0; level < texture.num_levels; ++level)
+			{
+				const texture_level& layout = texture.levels[level];
+				if (texture.compressed_format)
+					glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.compressed_format, layout.width, layout.height, 0, GLsizei(layout.size), nullptr);
+				else
+					glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, layout.width, layout.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			}
+			state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, streamer->pixel_buffer);
+			texture.state.store(streamed_texture_uploading, std::memory_order_relaxed);
+		}
+		glBindTexture(GL_TEXTURE_2D, texture.texture);
+		const texture_level& layout = texture.levels[slice.level];
+		if (texture.compressed_format)
+		{
+			// Rows of blocks are four texels high, except at the bottom of a level that isn't a multiple of four
+			int y = slice.first_row * 4;
+			int height = std::min(slice.num_rows * 4, layout.height - y);
+			GLsizei size = GLsizei(size_t(slice.num_rows) * get_upload_row_bytes(texture, slice.level));
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, slice.level, 0, y, layout.width, height, texture.compressed_format, size, (const void*)slice.offset);
+		}
+		else
+			glTexSubImage2D(GL_TEXTURE_2D, slice.level, 0, slice.first_row, layout.width, slice.num_rows, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)slice.offset);
+		texture.rows_uploaded += slice.num_rows;
+
+		// Only sample the levels that are all there, from this one down
+		if (texture.rows_uploaded == get_upload_rows(texture, slice.level))
+		{
+			++texture.levels_uploaded;
+			texture.rows_uploaded = 0;
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, slice.level);
+		}
+
+		// Once it's all there, the pixels in memory aren't needed any more
+		if (texture.levels_uploaded == texture.num_levels)
+		{
+			free(texture.pixels);
+			texture.pixels = nullptr;
+			texture.state.store(streamed_texture_resident, std::memory_order_relaxed);
+			add_perf_counter(texture_resident_bytes_counter, resident_texture_bytes(texture));
+		}
+	}
+
+	// Anything else that specifies texels from client memory would read from the buffer otherwise
+	state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,111 @@
+// Texture streamer: decodes image files on background threads, and uploads them a slice at a time so loading never hitches a frame
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "gl_workers.h"
+#include "texture_compression.h"
+
+// How far along a texture is. The decode threads take it as far as decoded (or failed); from
+// there on, it belongs to the GL thread.
+enum streamed_texture_state
+{
+	streamed_texture_queued,		// waiting for a decode thread
+	streamed_texture_decoded,		// its pixels (or blocks) are in memory, ready to upload
+	streamed_texture_uploading,		// some of its rows are in the texture, smallest levels first
+	streamed_texture_resident,		// all of it is, with mipmaps
+	streamed_texture_failed,		// the file couldn't be read or decoded, so it stays the placeholder
+	streamed_texture_evicted,		// it was resident, but was given back to get under the GPU memory budget
+};
+
+struct streamed_texture
+{
+	std::string			filename;
+	std::atomic<int>	state;				// a streamed_texture_state
+	const char*			failure_reason;		// stb_image's, or the DDS file's, if it failed
+	int					width;
+	int					height;
+	GLenum				compressed_format;	// a cooked texture's, or 0 for RGBA8 from stb_image
+	int					num_levels;			// in the pixels, which have the whole mip chain
+	texture_level		levels[max_texture_levels];
+	unsigned char*		pixels;				// RGBA8 or blocks, top row first, until it's all uploaded
+	int					levels_uploaded;	// counting up from the smallest
+	int					rows_uploaded;		// of the next level; in rows of blocks, for a compressed one
+	GLuint				texture;			// made when it starts uploading
+	bool				on_worker;			// it's being uploaded all at once by a GL worker, rather than in slices
+	gl_task				upload;				// which does that
+	bool				released;			// whatever it was for is done with it, so it can be evicted
+	uint64_t			last_used;			// the streamer's frame it was last bound in, for evicting the longest unused first
+};
+
+struct texture_streamer
+{
+	std::deque<streamed_texture>	textures;			// by handle; a deque, so the decode threads' pointers into it stay put
+	GLuint							placeholder;		// a single opaque white texel, for anything that isn't resident yet
+	GLuint							pixel_buffer;		// each frame's rows on their way to the textures
+	int								next_upload;		// the first texture that might not be resident or failed yet
+	uint64_t						frame;				// counting update_texture_streamer() calls
+
+	std::vector<std::thread>		threads;
+	std::mutex						lock;				// protects the three below
+	std::condition_variable			wake;
+	std::deque<streamed_texture*>	decode_queue;
+	bool							gl_ready;			// start_texture_uploads() has been called
+	bool							quitting;
+};
+
+// Start the decode threads. Call once the job system has started; there needn't be a GL context
+// yet, so textures can be requested, and decoded, while the window's still coming up. The decode
+// threads are the streamer's own, rather than the job system's, so a long decode never holds up
+// the simulation's jobs, or gets run by the main thread while it waits on them. Big JPEGs do farm
+// their decodes out to the job system, in bands of rows, so a decode thread isn't stuck with a
+// whole 8K texture on its own.
+void init_texture_streamer(texture_streamer* streamer, int num_decode_threads);
+
+// Make the placeholder and the pixel buffer, and start uploading. Call on the GL thread once the GL
+// functions are loaded, and the GL workers have started. With GL workers, each decoded texture
+// goes straight to one, to be uploaded whole off the render thread, and then it's the GL thread's
+// once that's done; without, the GL thread uploads them a few rows a frame. Cooked textures wait
+// for this to find out whether the GL can sample them.
+void start_texture_uploads(texture_streamer* streamer);
+
+// Stop the decode threads, dropping anything they haven't got to, and delete all the textures.
+// Call before shutting down the job system, which they may be using.
+void free_texture_streamer(texture_streamer* streamer);
+
+// Start loading an image file (anything stb_image reads), found the same way as the shaders, and
+// return a handle for it. Asking for the same file again returns the same handle, and brings it
+// back if it's been evicted. If the cooker's made a DDS file of it, with the same name but a .dds
+// extension, and the GL can sample its format, its blocks and mipmaps are loaded instead, at a
+// quarter to an eighth of the size; if not, it's decoded, and the decode thread makes its mipmaps.
+// A .dds file can be asked for directly too.
+int request_texture(texture_streamer* streamer, const char* filename);
+
+// Upload the next slice of whatever's been decoded, up to 'byte_budget' bytes of texels (but
+// always at least a row, so a budget smaller than that still gets there), and pick up any the GL
+// workers have finished. Call once a frame on
+// the GL thread. The rows go through a pixel buffer that's orphaned every frame, so copying them
+// in never waits on the GPU, and the texture uploads from it are asynchronous.
+void update_texture_streamer(texture_streamer* streamer, size_t byte_budget);
+
+// What to bind for a texture: the real one once any of its levels are in, blurry until the rest
+// follow, and the placeholder until then. That counts as using it, for eviction, and one that's
+// been evicted starts loading again, and isn't released any more. Call on the GL thread.
+GLuint get_streamed_texture(texture_streamer* streamer, int handle);
+
+// Say that whatever the texture was for is done with it, so the streamer can evict it once it's
+// resident, to get under the GPU memory budget. Asking for it again brings it back.
+void release_streamed_texture(texture_streamer* streamer, int handle);
+
+// Delete released, resident textures, the longest unused first, until 'bytes' of them are gone, or
+// there are no more. Call on the GL thread. Returns how many bytes were freed.
+int64_t evict_streamed_textures(texture_streamer* streamer, int64_t bytes);
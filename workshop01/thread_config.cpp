@@ -0,0 +1,378 @@
+// Thread configuration: the priority of each role's threads, and which cores they run on, so the scheduler can't starve or bounce the render thread
+
+#include "thread_config.h"
+#include "async_log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#elif defined(__APPLE__)
+#	include <pthread.h>
+#	include <sys/qos.h>
+#elif defined(__linux__)
+#	include <errno.h>
+#	include <pthread.h>
+#	include <sched.h>
+#	include <sys/resource.h>
+#	include <sys/syscall.h>
+#	include <unistd.h>
+#endif
+
+const char* const thread_role_names[num_thread_roles] = { "render", "simulation", "jobs", "upload", "decode", "background", "present" };
+const char* const thread_priority_names[num_thread_priorities] = { "default", "idle", "low", "normal", "high" };
+
+struct thread_role_config
+{
+	thread_priority		priority;
+	std::vector<int>	cpus;			// the logical CPUs it may run on, or empty for any
+	bool				spread;			// a physical core per thread, as far as they go
+	bool				dedicated;		// a physical core no other role's threads run on
+};
+
+static thread_role_config role_configs[num_thread_roles] =
+{
+	{ thread_priority_default, {}, false, false },
+	{ thread_priority_default, {}, false, false },
+	{ thread_priority_default, {}, false, false },
+	{ thread_priority_default, {}, false, false },
+	{ thread_priority_low, {}, false, false },
+	{ thread_priority_low, {}, false, false },
+	{ thread_priority_default, {}, false, false },
+};
+
+// What init_thread_config() works out: each physical core's logical CPUs, and each role's CPUs in
+// the order its threads take them. They're only read once it's done, before the threads start.
+static std::vector<std::vector<int>> physical_cores;
+static std::vector<int> role_cpus[num_thread_roles];		// empty to leave them wherever the OS puts them
+static bool role_pinned[num_thread_roles];					// each thread gets one of them, rather than all
+static std::atomic<bool> warned_priority(false);
+static std::atomic<bool> warned_affinity(false);
+
+static bool parse_cpu_list(const std::string& list, std::vector<int>* o_cpus)
+{
+	const char* p = list.c_str();
+	while (*p)
+	{
+		char* end;
+		long first = strtol(p, &end, 10);
+		if (end == p || first < 0)
+			return false;
+		long last = first;
+		p = end;
+		if (*p == '-')
+		{
+			last = strtol(p + 1, &end, 10);
+			if (end == p + 1 || last < first)
+				return false;
+			p = end;
+		}
+		for (long cpu = first; cpu <= last; ++cpu)
+			o_cpus->push_back(int(cpu));
+		if (*p == '+')
+			++p;
+		else if (*p)
+			return false;
+	}
+	return !o_cpus->empty();
+}
+
+static bool parse_thread_role_entry(const std::string& entry)
+{
+	size_t equals = entry.find('=');
+	std::string name = entry.substr(0, equals);
+	int role = 0;
+	while (role < num_thread_roles && name != thread_role_names[role])
+		++role;
+	if (equals == std::string::npos || role == num_thread_roles)
+	{
+		printf("Error: \"%s\" isn't a thread role and its settings, such as render=high :(\n", entry.c_str());
+		return false;
+	}
+
+	thread_role_config config = { thread_priority_default, {}, false, false };
+	size_t start = equals + 1;
+	for (;;)
+	{
+		size_t slash = entry.find('/', start);
+		std::string setting = entry.substr(start, (slash == std::string::npos) ? std::string::npos : slash - start);
+		int priority = 0;
+		while (priority < num_thread_priorities && setting != thread_priority_names[priority])
+			++priority;
+		if (priority < num_thread_priorities)
+			config.priority = thread_priority(priority);
+		else if (setting == "spread")
+			config.spread = true;
+		else if (setting == "dedicated")
+			config.dedicated = true;
+		else if (!parse_cpu_list(setting, &config.cpus))
+		{
+			printf("Error: \"%s\" isn't a priority, a list of CPUs, spread or dedicated, for the %s threads :(\n", setting.c_str(), thread_role_names[role]);
+			return false;
+		}
+		if (slash == std::string::npos)
+			break;
+		start = slash + 1;
+	}
+	role_configs[role] = config;
+	return true;
+}
+
+bool parse_thread_config(const char* settings)
+{
+	std::string entry;
+	for (const char* p = settings;; ++p)
+	{
+		if (*p == '#')
+		{
+			while (*p && *p != '\n')
+				++p;
+		}
+		if (*p == '\0' || *p == ',' || isspace((unsigned char)*p))
+		{
+			if (!entry.empty() && !parse_thread_role_entry(entry))
+				return false;
+			entry.clear();
+			if (*p == '\0')
+				return true;
+		}
+		else
+		{
+			entry += *p;
+		}
+	}
+}
+
+bool load_thread_config(const char* filename)
+{
+	FILE* file = fopen(filename, "rb");
+	if (!file)
+	{
+		printf("Error: couldn't open thread settings file %s :(\n", filename);
+		return false;
+	}
+	std::string settings;
+	char buffer[1024];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		settings.append(buffer, read);
+	fclose(file);
+	return parse_thread_config(settings.c_str());
+}
+
+// Each physical core's logical CPUs, lowest first. Where the OS doesn't say, each is its own core.
+static std::vector<std::vector<int>> find_physical_cores()
+{
+	std::vector<std::vector<int>> cores;
+#if defined(_WIN32)
+	DWORD length = 0;
+	GetLogicalProcessorInformation(nullptr, &length);
+	std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+	if (!info.empty() && GetLogicalProcessorInformation(info.data(), &length))
+	{
+		for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& processor : info)
+		{
+			if (processor.Relationship != RelationProcessorCore)
+				continue;
+			std::vector<int> core;
+			for (int cpu = 0; cpu < int(sizeof(ULONG_PTR) * 8); ++cpu)
+			{
+				if (processor.ProcessorMask & (ULONG_PTR(1) << cpu))
+					core.push_back(cpu);
+			}
+			if (!core.empty())
+				cores.push_back(core);
+		}
+	}
+#elif defined(__linux__)
+	// The CPUs sharing each one's core are in sysfs, as a list like the ones we read, but with commas
+	long num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	for (long cpu = 0; cpu < num_cpus; ++cpu)
+	{
+		char path[128];
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld/topology/thread_siblings_list", cpu);
+		FILE* file = fopen(path, "r");
+		if (!file)
+			continue;
+		char list[256] = {};
+		bool read = fgets(list, sizeof(list), file) != nullptr;
+		fclose(file);
+		std::string siblings(list);
+		siblings.erase(std::remove_if(siblings.begin(), siblings.end(), [](char c) { return isspace((unsigned char)c) != 0; }), siblings.end());
+		std::replace(siblings.begin(), siblings.end(), ',', '+');
+		std::vector<int> core;
+		if (!read || !parse_cpu_list(siblings, &core))
+			core.assign(1, int(cpu));
+		if (std::find(cores.begin(), cores.end(), core) == cores.end())
+			cores.push_back(core);
+	}
+#endif
+	if (cores.empty())
+	{
+		int num_cpus = std::max(1, int(std::thread::hardware_concurrency()));
+		for (int cpu = 0; cpu < num_cpus; ++cpu)
+			cores.push_back(std::vector<int>(1, cpu));
+	}
+	return cores;
+}
+
+void init_thread_config()
+{
+	physical_cores = find_physical_cores();
+	int num_cpus = 0;
+	for (const std::vector<int>& core : physical_cores)
+		num_cpus += int(core.size());
+
+	// Give out the dedicated cores first: the one with the role's first CPU, if it has a list, or
+	// else the last one not yet taken. There has to be one left for everything else.
+	std::vector<bool> core_taken(physical_cores.size(), false);
+	int dedicated_core[num_thread_roles];
+	int cores_left = int(physical_cores.size());
+	for (int role = 0; role < num_thread_roles; ++role)
+	{
+		dedicated_core[role] = -1;
+		const thread_role_config& config = role_configs[role];
+		if (!config.dedicated)
+			continue;
+		for (int core = int(physical_cores.size()) - 1; core >= 0; --core)
+		{
+			const std::vector<int>& cpus = physical_cores[size_t(core)];
+			bool wanted = config.cpus.empty() || std::find(cpus.begin(), cpus.end(), config.cpus[0]) != cpus.end();
+			if (wanted && !core_taken[size_t(core)])
+			{
+				dedicated_core[role] = core;
+				break;
+			}
+		}
+		if (dedicated_core[role] < 0 || cores_left <= 1)
+		{
+			printf("Warning: there isn't a physical core to dedicate to the %s threads!\n", thread_role_names[role]);
+			dedicated_core[role] = -1;
+			continue;
+		}
+		core_taken[size_t(dedicated_core[role])] = true;
+		--cores_left;
+	}
+
+	// The rest go on their own CPUs, or anywhere, apart from the dedicated cores. Spread, they take
+	// the first CPU of each physical core, and then the second, and so on.
+	for (int role = 0; role < num_thread_roles; ++role)
+	{
+		const thread_role_config& config = role_configs[role];
+		std::vector<int>& cpus = role_cpus[role];
+		cpus.clear();
+		role_pinned[role] = false;
+		if (dedicated_core[role] >= 0)
+		{
+			cpus.push_back(physical_cores[size_t(dedicated_core[role])][0]);
+			role_pinned[role] = true;
+			printf("Running the %s threads on a physical core of their own, CPU %d\n", thread_role_names[role], cpus[0]);
+			continue;
+		}
+		bool any_taken = std::find(core_taken.begin(), core_taken.end(), true) != core_taken.end();
+		if (config.cpus.empty() && !config.spread && !any_taken)
+			continue;
+
+		for (size_t sibling = 0; cpus.empty() || sibling < 8; ++sibling)
+		{
+			bool any_left = false;
+			for (size_t core = 0; core < physical_cores.size(); ++core)
+			{
+				if (core_taken[core] || sibling >= physical_cores[core].size())
+					continue;
+				any_left = true;
+				int cpu = physical_cores[core][sibling];
+				if (config.cpus.empty() || std::find(config.cpus.begin(), config.cpus.end(), cpu) != config.cpus.end())
+					cpus.push_back(cpu);
+			}
+			if (!any_left)
+				break;
+		}
+		if (cpus.empty())
+		{
+			printf("Warning: none of the CPUs given for the %s threads are there to run them on!\n", thread_role_names[role]);
+			continue;
+		}
+		role_pinned[role] = config.spread;
+	}
+
+	if (std::find(core_taken.begin(), core_taken.end(), true) != core_taken.end() || num_cpus != int(physical_cores.size()))
+		printf("Found %d logical CPUs on %d physical cores\n", num_cpus, int(physical_cores.size()));
+}
+
+#if defined(__linux__)
+// Nice values: per thread on Linux, though POSIX has them per process
+static const int thread_nice_values[num_thread_priorities] = { 0, 19, 10, 0, -10 };
+#elif defined(_WIN32)
+static const int thread_priority_levels[num_thread_priorities] = { THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_IDLE, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_HIGHEST };
+#elif defined(__APPLE__)
+static const qos_class_t thread_qos_classes[num_thread_priorities] = { QOS_CLASS_DEFAULT, QOS_CLASS_BACKGROUND, QOS_CLASS_UTILITY, QOS_CLASS_USER_INITIATED, QOS_CLASS_USER_INTERACTIVE };
+#endif
+
+static bool set_thread_priority(thread_priority priority)
+{
+#if defined(__linux__)
+	return setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), thread_nice_values[priority]) == 0;
+#elif defined(_WIN32)
+	return SetThreadPriority(GetCurrentThread(), thread_priority_levels[priority]) != 0;
+#elif defined(__APPLE__)
+	return pthread_set_qos_class_self_np(thread_qos_classes[priority], 0) == 0;
+#else
+	(void)priority;
+	return false;
+#endif
+}
+
+// Let the calling thread run only on the CPUs
+static bool set_thread_cpus(const int* cpus, int count)
+{
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i = 0; i < count; ++i)
+	{
+		if (cpus[i] < CPU_SETSIZE)
+			CPU_SET(cpus[i], &set);
+	}
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+	// Only the first processor group's, which is all of them up to 64
+	DWORD_PTR mask = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (cpus[i] < int(sizeof(DWORD_PTR) * 8))
+			mask |= DWORD_PTR(1) << cpus[i];
+	}
+	return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+	// macOS only takes hints about which threads should share a cache
+	(void)cpus;
+	(void)count;
+	return false;
+#endif
+}
+
+void set_thread_role(thread_role role, int index)
+{
+	// Threads start as normal, so a default priority leaves them be
+	thread_priority priority = role_configs[role].priority;
+	if (priority != thread_priority_default && !set_thread_priority(priority) && !warned_priority.exchange(true))
+		log_message(log_warning, 0, "Warning: couldn't make the %s threads %s priority, so they're left as they were!", thread_role_names[role], thread_priority_names[priority]);
+
+	const std::vector<int>& cpus = role_cpus[role];
+	if (cpus.empty())
+		return;
+	bool placed = role_pinned[role] ? set_thread_cpus(&cpus[size_t(index) % cpus.size()], 1) : set_thread_cpus(cpus.data(), int(cpus.size()));
+	if (!placed && !warned_affinity.exchange(true))
+		log_message(log_warning, 0, "Warning: couldn't choose which CPUs the %s threads run on, so the OS is left to!", thread_role_names[role]);
+}
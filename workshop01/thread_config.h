@@ -0,0 +1,57 @@
+// Thread configuration: the priority of each role's threads, and which cores they run on, so the scheduler can't starve or bounce the render thread
+#pragma once
+
+// What a thread's for. Every thread says which it is when it starts, and gets that role's settings.
+enum thread_role
+{
+	thread_role_render,			// the main thread, which renders (and simulates, without the simulation thread)
+	thread_role_simulation,		// the simulation thread
+	thread_role_jobs,			// the job system's workers
+	thread_role_upload,			// the GL workers, which upload textures
+	thread_role_decode,			// the texture streamer's decode threads
+	thread_role_background,		// the log writer, the capture encoder and the file watcher
+	thread_role_present,		// the output windows', which show the frame on the other monitors
+	num_thread_roles,
+};
+
+extern const char* const thread_role_names[num_thread_roles];
+
+// From the OS's point of view: on Linux, these are nice values of 19, 10, 0 and -10 (which needs
+// CAP_SYS_NICE, or a high enough RLIMIT_NICE); on Windows, thread priorities; and on macOS, QoS
+// classes. The default leaves a thread as it started.
+enum thread_priority
+{
+	thread_priority_default,
+	thread_priority_idle,
+	thread_priority_low,
+	thread_priority_normal,
+	thread_priority_high,
+	num_thread_priorities,
+};
+
+extern const char* const thread_priority_names[num_thread_priorities];
+
+// Read settings for the roles, adding to (or replacing) any read before. They're entries separated
+// by commas, spaces or lines, with anything after a # ignored, each a role's name, an =, and its
+// settings separated by slashes:
+//  - a priority's name
+//  - a list of the logical CPUs its threads may run on, with ranges, joined by +, like 0-3+8
+//  - spread, to put each of its threads on a physical core of its own, as far as they go, before
+//    doubling any up on a core's SMT siblings
+//  - dedicated, to give its threads a physical core to themselves: the one with the first of its
+//    CPUs, or else the last one. Every other thread is kept off all of that core's siblings.
+// For example, "render=high/dedicated, jobs=spread, decode=low". Until they're changed, the decode
+// and background threads are low, so they never hold up a frame, and the rest are left as they are.
+// Returns false, having said why, if anything's wrong with them.
+bool parse_thread_config(const char* settings);
+
+// The same, from a file
+bool load_thread_config(const char* filename);
+
+// Find out which logical CPUs share physical cores, and which cores are dedicated to which roles.
+// Call once the settings are read, before starting any threads. Says what it's done, if anything.
+void init_thread_config();
+
+// Give the calling thread its role's priority and cores. 'index' counts the role's threads from
+// 0, for spreading them over the cores.
+void set_thread_role(thread_role role, int index);
@@ -0,0 +1,8 @@
+// Uniforms passed from main app: this matches struct uniform_data in the C++ code
+layout(std140) uniform uniform_data
+{
+	vec2 window_size;		// window size in world space
+	vec2 window_center;		// window center in world space
+	vec3 light_dir;			// direction of a light source
+	float time;				// current simulation time in seconds
+};
@@ -0,0 +1,326 @@
+// Per-frame upload allocator: a ring of GPU buffer space, split into one region per frame in flight
+
+#include "upload_ring.h"
+#include "gl_state.h"
+#include "gl_debug.h"
+#include "async_log.h"
+#include "gpu_memory.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+const char* const upload_strategy_names[num_upload_strategies] = { "persistent", "unsynchronized", "invalidate", "orphan", "subdata" };
+
+// Whether the frames have regions of their own, which are fenced, rather than sharing the one
+static bool has_frame_regions(upload_strategy strategy)
+{
+	return strategy == upload_persistent || strategy == upload_unsynchronized;
+}
+
+static bool uses_staging(upload_strategy strategy)
+{
+	return strategy == upload_orphan || strategy == upload_sub_data;
+}
+
+bool upload_strategy_supported(upload_strategy strategy)
+{
+	return strategy != upload_persistent || GLAD_GL_ARB_buffer_storage;
+}
+
+bool init_upload_ring(upload_ring* ring, size_t frame_size, upload_strategy strategy)
+{
+	// Each region starts as aligned as the first, so frames after it don't lose space to padding
+	frame_size = (frame_size + upload_frame_alignment - 1) / upload_frame_alignment * upload_frame_alignment;
+
+	*ring = upload_ring{};
+	ring->frame_size = frame_size;
+	ring->strategy = strategy;
+	ring->num_frames = has_frame_regions(strategy) ? max_upload_frames_in_flight : 1;
+
+	// Create the buffer through the copy-write binding point so we don't disturb any other bindings
+	glGenBuffers(1, &ring->buffer);
+	state_bind_buffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+	GLsizeiptr buffer_size = GLsizeiptr(frame_size * ring->num_frames);
+
+	if (strategy == upload_persistent)
+	{
+		// Immutable storage, mapped once for the life of the buffer. COHERENT means our writes
+		// become visible to the GPU without explicit flushes.
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, buffer_size, nullptr, flags);
+		ring->mapped_memory = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, buffer_size, flags);
+		if (!ring->mapped_memory)
+		{
+			printf("Warning: couldn't persistently map upload buffer!\n");
+			free_upload_ring(ring);
+			return false;
+		}
+	}
+	else
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, buffer_size, nullptr, GL_STREAM_DRAW);
+	}
+	set_gpu_memory(gpu_memory_buffer, ring->buffer, int64_t(buffer_size));
+
+	if (uses_staging(strategy))
+	{
+		ring->staging = (char*)malloc(frame_size);
+		if (!ring->staging)
+		{
+			free_upload_ring(ring);
+			return false;
+		}
+	}
+	label_gl_object(GL_BUFFER, ring->buffer, "upload ring");
+
+	return true;
+}
+
+void free_upload_ring(upload_ring* ring)
+{
+	for (GLsync& fence : ring->fences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+	}
+
+	// Deleting a buffer also unmaps it
+	set_gpu_memory(gpu_memory_buffer, ring->buffer, 0);
+	if (ring->buffer)
+		state_delete_buffers(1, &ring->buffer);
+	free(ring->staging);
+
+	*ring = upload_ring{};
+}
+
+// Wait for the GPU to finish the frame that last used the current region. The first wait flushes,
+// so that the fence is guaranteed to get to the GPU and eventually signal.
+static void wait_for_region(upload_ring* ring)
+{
+	GLsync& fence = ring->fences[ring->current_frame];
+	if (!fence)
+		return;
+
+	GLbitfield wait_flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	for (;;)
+	{
+		GLenum result = glClientWaitSync(fence, wait_flags, 1000000000);	// 1 second, in nanoseconds
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+			break;
+		if (result == GL_WAIT_FAILED)
+		{
+			log_message(log_warning, 0, "Warning: waiting on upload fence failed!");
+			break;
+		}
+		wait_flags = 0;
+	}
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+bool begin_upload_frame(upload_ring* ring)
+{
+	ring->current_frame = (ring->current_frame + 1) % ring->num_frames;
+	ring->frame_used = 0;
+	ring->frame_memory = nullptr;
+
+	switch (ring->strategy)
+	{
+	case upload_persistent:
+		wait_for_region(ring);
+		ring->frame_memory = ring->mapped_memory + size_t(ring->current_frame) * ring->frame_size;
+		break;
+
+	case upload_unsynchronized:
+		// The fence is what keeps us off the GPU's toes, so the driver needn't check
+		wait_for_region(ring);
+		state_bind_buffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+		ring->mapped_memory = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, GLintptr(size_t(ring->current_frame) * ring->frame_size),
+			GLsizeiptr(ring->frame_size), GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		ring->frame_memory = ring->mapped_memory;
+		break;
+
+	case upload_invalidate:
+		// Same as always mapping with INVALIDATE_BUFFER_BIT: the driver hands us fresh memory
+		// if the GPU is still reading the old contents.
+		state_bind_buffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+		ring->mapped_memory = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, GLsizeiptr(ring->frame_size), GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_WRITE_BIT);
+		ring->frame_memory = ring->mapped_memory;
+		break;
+
+	case upload_orphan:
+	case upload_sub_data:
+		ring->frame_memory = ring->staging;
+		break;
+
+	default:
+		break;
+	}
+
+	if (!ring->frame_memory)
+	{
+		log_message(log_warning, 0, "Warning: couldn't map upload buffer!");
+		return false;
+	}
+	return true;
+}
+
+upload_allocation allocate_upload(upload_ring* ring, size_t size, size_t alignment)
+{
+	// The offset's aligned within the buffer, not the region, since that's what binding it needs.
+	// With only one region, it's at the start, so that's the same thing.
+	size_t frame_offset = size_t(ring->current_frame) * ring->frame_size;
+	size_t offset = (frame_offset + ring->frame_used + alignment - 1) / alignment * alignment - frame_offset;
+	if (!ring->frame_memory || offset + size > ring->frame_size)
+		return upload_allocation{};
+	ring->frame_used = offset + size;
+
+	return upload_allocation{ ring->frame_memory + offset, ring->buffer, frame_offset + offset };
+}
+
+void end_upload_frame(upload_ring* ring)
+{
+	if (!ring->frame_memory)
+		return;
+
+	switch (ring->strategy)
+	{
+	case upload_unsynchronized:
+	case upload_invalidate:
+		state_bind_buffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		ring->mapped_memory = nullptr;
+		break;
+
+	case upload_orphan:
+		// New storage, so the copy can't have to wait for the GPU to finish with the old
+		state_bind_buffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(ring->frame_size), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, 0, GLsizeiptr(ring->frame_used), ring->staging);
+		break;
+
+	case upload_sub_data:
+		state_bind_buffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, 0, GLsizeiptr(ring->frame_used), ring->staging);
+		break;
+
+	default:
+		break;
+	}
+	ring->frame_memory = nullptr;
+}
+
+void fence_upload_frame(upload_ring* ring)
+{
+	if (has_frame_regions(ring->strategy))
+		ring->fences[ring->current_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+static std::string gl_string(GLenum name)
+{
+	const char* text = (const char*)glGetString(name);
+	return text ? text : "";
+}
+
+// Run a strategy for a few frames like the real ones: write a frame's worth of data, have the GPU
+// read it all (by copying it to another buffer), and fence it. Returns the seconds a frame took, or
+// a negative number if it didn't work.
+static double time_upload_strategy(upload_strategy strategy, size_t frame_size, GLuint scratch_buffer)
+{
+	static const int warmup_frames = 4;
+	static const int timed_frames = 24;
+
+	upload_ring ring;
+	if (!init_upload_ring(&ring, frame_size, strategy))
+		return -1.0;
+
+	std::chrono::steady_clock::time_point start;
+	bool worked = true;
+	for (int frame = 0; frame < warmup_frames + timed_frames && worked; ++frame)
+	{
+		if (frame == warmup_frames)
+		{
+			glFinish();
+			start = std::chrono::steady_clock::now();
+		}
+
+		worked = begin_upload_frame(&ring);
+		upload_allocation allocation = allocate_upload(&ring, frame_size, 1);
+		if (allocation.memory)
+			memset(allocation.memory, frame & 0xff, frame_size);
+		end_upload_frame(&ring);
+
+		state_bind_buffer(GL_COPY_READ_BUFFER, ring.buffer);
+		state_bind_buffer(GL_COPY_WRITE_BUFFER, scratch_buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GLintptr(allocation.offset), 0, GLsizeiptr(frame_size));
+		fence_upload_frame(&ring);
+	}
+	glFinish();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	free_upload_ring(&ring);
+	return worked ? seconds / timed_frames : -1.0;
+}
+
+upload_strategy select_upload_strategy(size_t frame_size, const char* cache_directory)
+{
+	// The file holds the strategy's name, then the driver it was timed on
+	std::string driver = gl_string(GL_VENDOR) + "\n" + gl_string(GL_RENDERER) + "\n" + gl_string(GL_VERSION);
+	std::string filename = cache_directory ? std::string(cache_directory) + "/upload_strategy.txt" : std::string();
+	if (FILE* file = cache_directory ? fopen(filename.c_str(), "rb") : nullptr)
+	{
+		std::string contents;
+		char chunk[256];
+		size_t length;
+		while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0)
+			contents.append(chunk, length);
+		fclose(file);
+
+		size_t name_end = contents.find('\n');
+		if (name_end != std::string::npos && contents.compare(name_end + 1, std::string::npos, driver) == 0)
+		{
+			for (int strategy = 0; strategy < num_upload_strategies; ++strategy)
+			{
+				if (contents.compare(0, name_end, upload_strategy_names[strategy]) == 0 && upload_strategy_supported(upload_strategy(strategy)))
+					return upload_strategy(strategy);
+			}
+		}
+	}
+
+	// Time them on a frame's worth of data, though no more than the particles need at a few million,
+	// which is plenty to tell them apart
+	static const size_t max_timed_frame_size = size_t(64) << 20;
+	size_t timed_frame_size = (frame_size < max_timed_frame_size) ? frame_size : max_timed_frame_size;
+	GLuint scratch_buffer = 0;
+	glGenBuffers(1, &scratch_buffer);
+	state_bind_buffer(GL_COPY_WRITE_BUFFER, scratch_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(timed_frame_size), nullptr, GL_STATIC_COPY);
+
+	upload_strategy fastest = upload_invalidate;
+	double fastest_seconds = -1.0;
+	for (int strategy = 0; strategy < num_upload_strategies; ++strategy)
+	{
+		if (!upload_strategy_supported(upload_strategy(strategy)))
+			continue;
+		double seconds = time_upload_strategy(upload_strategy(strategy), timed_frame_size, scratch_buffer);
+		if (seconds < 0.0)
+			continue;
+		printf("Upload strategy %s: %.2f ms a frame\n", upload_strategy_names[strategy], seconds * 1000.0);
+		if (fastest_seconds < 0.0 || seconds < fastest_seconds)
+		{
+			fastest = upload_strategy(strategy);
+			fastest_seconds = seconds;
+		}
+	}
+	state_delete_buffers(1, &scratch_buffer);
+
+	if (FILE* file = cache_directory ? fopen(filename.c_str(), "wb") : nullptr)
+	{
+		fprintf(file, "%s\n%s", upload_strategy_names[fastest], driver.c_str());
+		fclose(file);
+	}
+	return fastest;
+}
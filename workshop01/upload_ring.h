@@ -0,0 +1,77 @@
+// Per-frame upload allocator: a ring of GPU buffer space, split into one region per frame in flight
+#pragma once
+
+#include <cstddef>
+#include <glad/glad.h>
+
+// How many frames the CPU may run ahead of the GPU before it has to wait
+static const int max_upload_frames_in_flight = 3;
+
+// Each frame's region is rounded up to a multiple of this, which is as much as any GL asks of
+// uniform buffer offsets, and a multiple of the particle instances' sizes
+static const size_t upload_frame_alignment = 256;
+
+// The ways of getting each frame's data into the buffer. They all look the same from outside, but
+// which is fastest depends on the driver, so select_upload_strategy() times them.
+enum upload_strategy
+{
+	upload_persistent,			// mapped once, persistently and coherently (GL_ARB_buffer_storage), with a fenced region per frame
+	upload_unsynchronized,		// each frame's region mapped with UNSYNCHRONIZED_BIT, fenced the same way
+	upload_invalidate,			// one region, mapped with INVALIDATE_BUFFER_BIT each frame, leaving the driver to rename it
+	upload_orphan,				// written to CPU memory, then sent with glBufferSubData, after glBufferData orphans the old storage
+	upload_sub_data,			// written to CPU memory, then sent with glBufferSubData, leaving the driver to sync or copy
+	num_upload_strategies,
+};
+
+extern const char* const upload_strategy_names[num_upload_strategies];
+
+struct upload_ring
+{
+	GLuint				buffer;
+	upload_strategy		strategy;
+	char*				mapped_memory;							// the persistent mapping, or this frame's mapping if it's mapped per frame
+	char*				staging;								// CPU memory the frame's written to, for the strategies that copy it over
+	char*				frame_memory;							// where this frame's region is, for the CPU; null if it couldn't be had
+	size_t				frame_size;								// bytes available to each frame
+	int					num_frames;								// regions in the ring
+	int					current_frame;							// region being written this frame
+	size_t				frame_used;								// bytes allocated so far this frame
+	GLsync				fences[max_upload_frames_in_flight];	// signaled when the GPU is done with each region
+};
+
+// A piece of this frame's upload space. Write through 'memory', then bind 'buffer' at 'offset'.
+struct upload_allocation
+{
+	void*	memory;
+	GLuint	buffer;
+	size_t	offset;
+};
+
+// Whether the GL context can use the strategy at all
+bool upload_strategy_supported(upload_strategy strategy);
+
+// Create the ring with room for at least frame_size bytes per frame. Returns false on failure.
+bool init_upload_ring(upload_ring* ring, size_t frame_size, upload_strategy strategy);
+
+// Release the buffer and fences and reset the ring to empty
+void free_upload_ring(upload_ring* ring);
+
+// Start writing a new frame's uploads. This waits until the GPU has finished with the region
+// we're about to reuse, which only blocks if the CPU is a full ring ahead.
+bool begin_upload_frame(upload_ring* ring);
+
+// Carve out space for this frame, with its offset in the buffer a multiple of alignment. Returns a
+// null allocation if the frame's region is full.
+upload_allocation allocate_upload(upload_ring* ring, size_t size, size_t alignment);
+
+// Finish writing this frame's uploads; call before any draws that read them
+void end_upload_frame(upload_ring* ring);
+
+// Mark the end of the GPU work that reads this frame's uploads; call after the last such draw
+void fence_upload_frame(upload_ring* ring);
+
+// Pick the fastest strategy for frames of about frame_size bytes. The result is kept in
+// upload_strategy.txt in cache_directory, keyed on the driver, so it's only timed once per driver;
+// pass null to time them every run. The timing runs each supported strategy for a few dozen frames
+// of writing the data and having the GPU copy it out, which takes a moment.
+upload_strategy select_upload_strategy(size_t frame_size, const char* cache_directory);
@@ -1,49 +1,222 @@
 // Vertex shader for simple particle system
 #version 410
 
-// Uniforms passed from main app: this matches struct uniform_data in the C++ code
-layout(std140) uniform uniform_data
-{
-	vec2 window_size;		// window size in world space
-	vec2 window_center;		// window center in world space	
-    vec3 light_dir;         // direction of a light source
-	float time;				// current simulation time in seconds
-};
+#include "uniform_data.glsl"
 
 // Input data from vertex buffer
 layout(location = 0) in vec2 vertex_position;
 
+// This is built in variants, with these defined or not, as the C++ code asks for them:
+//  - PACKED_INSTANCES when the particle data is in the compact format (struct packed_particle_data
+//    in the C++ code)
+//  - ANALYTIC_MOTION when the particle data is the particles' state at creation, rather than their
+//    current state. Their motion is simple ballistics, so we can work out where they are now directly.
+//  - PULLED_INSTANCES when the particle data isn't fed in as vertex attributes, but fetched here from
+//    texture buffers by the instance ID. That's a particle_data per two texels, or with STORE_LAYOUT
+//    as well, the CPU store's field arrays as they are, picked through the sorted list of which
+//    particles to draw.
+//  - MULTI_VIEW when the window's split into views, and each instance is drawn once per view, one
+//    after another. Attributes step on once per view's worth, by their divisor; pulled instances
+//    divide the instance ID by the views themselves.
+uniform float gravity;		// acceleration along y
+uniform float kill_height;	// particles that fall below this are dead
+
+// The simulation runs in fixed steps, and the particle data is from the latest one. We render a
+// little earlier, between that step and the one before, by interpolation_alpha.
+uniform float interpolation_step;	// length of a simulation step, in seconds
+uniform float interpolation_alpha;	// 1 means render the particle data as it is
+
+// Pixels per world unit, for sizing particles that are drawn as points
+uniform float point_size_scale;
+
+// Seconds of motion to stretch each particle back over, for motion trails, or 0 for none. It's
+// only the velocity it has now, so a trail's always straight, but it needs nothing the instance
+// doesn't already have.
+uniform float trail_time;
+
+#ifdef MULTI_VIEW
+// Where each view looks, and where it goes: this matches struct view_data in the C++ code
+struct view
+{
+	vec2 window_size;		// as in uniform_data, but the view's
+	vec2 window_center;
+	vec4 viewport;			// x, y, width and height in [-1, 1] screen space
+	float zoom;				// how much bigger things are in it than across the whole window
+};
+layout(std140) uniform view_data
+{
+	view views[4];
+};
+uniform int num_views;
+
+// Each vertex is clipped to its view's four edges, as the views all share the one viewport
+out float gl_ClipDistance[4];
+#endif
+
+#ifdef PULLED_INSTANCES
+// Where to fetch the particle data from. gl_InstanceID doesn't count from the draw's base instance,
+// so the draws say where they start themselves: indirect ones by which draw command has it.
+uniform samplerBuffer particle_instances;			// RGBA32F particle_data, or R32F store fields
+uniform usamplerBuffer particle_instance_indices;	// STORE_LAYOUT only: where each instance's particle is in particle_instances
+uniform usamplerBuffer particle_draw_commands;		// the GPU culling's indirect draws (struct gpu_particle_draws in the C++ code)
+uniform int first_pulled_instance;
+uniform int pulled_draw_command;					// -1 if it's not an indirect draw
+uniform int pulled_field_stride;					// STORE_LAYOUT only: texels from one field's array to the next
+#else
 // Input data from particle data buffer
 layout(location = 1) in vec2 particle_position;
 layout(location = 2) in vec2 particle_velocity;
 layout(location = 3) in vec4 particle_angle_spin_size_creationtime;	// Four values packed together in a vec4
+#ifdef PACKED_INSTANCES
+layout(location = 4) in vec2 packed_particle_size_age;				// Compact format only; angle and spin are in location 3
+#endif
+
+// Which layer of the sprite array to texture it with. This comes from a buffer of its own, a byte
+// per instance, when the particles have sprites; otherwise it's left off, and they're all layer 0.
+layout(location = 5) in float particle_sprite;
+#endif
 
-// Output data to send to fragment shader
+// Ranges of the quantized fields in the compact format; these match the constants in particle_store.h
+const float max_packed_spin = 8.0;
+const float max_packed_size = 2.0;
+const float max_packed_age = 8.0;
+const float pi = 3.141592654;
+
+// Output data to send to fragment shader. Only pass through what it reads, since every output
+// costs interpolation.
 layout(location = 0) out vec2 v_vertex_position;
 layout(location = 1) out vec2 v_particle_position;
-layout(location = 2) out vec2 v_particle_velocity;
-layout(location = 3) out vec4 v_particle_angle_spin_size_creationtime;
+layout(location = 2) flat out float v_sprite;
+layout(location = 3) out vec2 v_world_position;
+layout(location = 4) out float v_trail;		// how far towards the tail of its trail the vertex is, from 0 to 1
 
 void main()
 {
-	float particle_angle = particle_angle_spin_size_creationtime.x;
-	float particle_size  = particle_angle_spin_size_creationtime.z;
+#ifdef PULLED_INSTANCES
+	// Each draw command is five uints, and the base instance is the last
+#ifdef MULTI_VIEW
+	int instance = first_pulled_instance + gl_InstanceID / num_views;
+#else
+	int instance = first_pulled_instance + gl_InstanceID;
+#endif
+	if (pulled_draw_command >= 0)
+		instance += int(texelFetch(particle_draw_commands, pulled_draw_command * 5 + 4).r);
+#ifdef STORE_LAYOUT
+	int particle = int(texelFetch(particle_instance_indices, instance).r);
+	vec2 particle_position = vec2(
+		texelFetch(particle_instances, particle).r,
+		texelFetch(particle_instances, particle + pulled_field_stride).r);
+	vec2 particle_velocity = vec2(
+		texelFetch(particle_instances, particle + 2 * pulled_field_stride).r,
+		texelFetch(particle_instances, particle + 3 * pulled_field_stride).r);
+	vec4 particle_angle_spin_size_creationtime = vec4(
+		texelFetch(particle_instances, particle + 4 * pulled_field_stride).r,
+		texelFetch(particle_instances, particle + 5 * pulled_field_stride).r,
+		texelFetch(particle_instances, particle + 6 * pulled_field_stride).r,
+		texelFetch(particle_instances, particle + 7 * pulled_field_stride).r);
+#else
+	vec4 position_velocity = texelFetch(particle_instances, 2 * instance);
+	vec2 particle_position = position_velocity.xy;
+	vec2 particle_velocity = position_velocity.zw;
+	vec4 particle_angle_spin_size_creationtime = texelFetch(particle_instances, 2 * instance + 1);
+#endif
+#endif
+
+	// Turn the compact format back into the full one. The angle and spin come in as [-1, 1], and
+	// the size and age as [0, 1]; the age is relative to the current time.
+#ifdef PACKED_INSTANCES
+	vec4 angle_spin_size_creationtime = vec4(
+		(particle_angle_spin_size_creationtime.x + 1.0) * pi,
+		particle_angle_spin_size_creationtime.y * max_packed_spin,
+		packed_particle_size_age.x * max_packed_size,
+		time - packed_particle_size_age.y * max_packed_age);
+#else
+	vec4 angle_spin_size_creationtime = particle_angle_spin_size_creationtime;
+#endif
+
+	vec2 position = particle_position;
+	vec2 velocity = particle_velocity;
+	if (interpolation_alpha < 1.0)
+	{
+		// Each step moves a particle by the velocity it had before the step, then applies gravity.
+		// So we can undo the last step exactly, which means interpolating between the previous
+		// step and this one doesn't need the previous step's data.
+		float step_back = (1.0 - interpolation_alpha) * interpolation_step;
+		vec2 previous_velocity = velocity - vec2(0.0, interpolation_step * gravity);
+		position -= step_back * previous_velocity;
+		velocity.y -= step_back * gravity;
+		angle_spin_size_creationtime.x -= step_back * angle_spin_size_creationtime.y;
+	}
+#ifdef ANALYTIC_MOTION
+	{
+		// Constant velocity plus constant acceleration under gravity, and constant spin
+		float age = time - angle_spin_size_creationtime.w;
+		position += age * velocity + vec2(0.0, 0.5 * gravity * age * age);
+		velocity.y += gravity * age;
+		angle_spin_size_creationtime.x += age * angle_spin_size_creationtime.y;
+
+		// Particles that have fallen out of the world are dead; shrink them to nothing
+		if (position.y < kill_height)
+			angle_spin_size_creationtime.z = 0.0;
+	}
+#endif
+
+	float particle_angle = angle_spin_size_creationtime.x;
+	float particle_size  = angle_spin_size_creationtime.z;
 
 	// Calculate the world-space position of the vertex, by applying the vertex's local offset to
 	// the particle's position, and applying the particle's rotation and size.
 	float sin_angle = sin(particle_angle);
 	float cos_angle = cos(particle_angle);
 	mat2 particle_transform = mat2(cos_angle, sin_angle, -sin_angle, cos_angle) * particle_size;
-	vec2 world_space_pos = particle_position + particle_transform * vertex_position;
+	vec2 offset = particle_transform * vertex_position;
+
+	// Drag the vertices on the trailing side back along the way the particle came, the more the
+	// more squarely they face that way, so the mesh stretches out into a streak as long as how far
+	// it moves in trail_time. The center and the leading side stay put.
+	float trail = 0.0;
+	float speed = length(velocity);
+	if (trail_time > 0.0 && speed > 0.0 && offset != vec2(0.0))
+	{
+		vec2 backwards = -velocity / speed;
+		trail = max(dot(normalize(offset), backwards), 0.0);
+		offset += backwards * (trail * speed * trail_time);
+	}
+	vec2 world_space_pos = position + offset;
 	
 	// Use the window size to scale the vertex position from world space to [-1, 1] screen space
+#ifdef MULTI_VIEW
+	// Or the view's, and then squeeze that into the view's part of the window
+	view instance_view = views[gl_InstanceID % num_views];
+	vec2 view_space_pos = (world_space_pos - instance_view.window_center) / (0.5 * instance_view.window_size);
+	vec4 viewport = instance_view.viewport;
+	vec2 screen_space_pos = viewport.xy + (0.5 * view_space_pos + 0.5) * viewport.zw;
+	gl_ClipDistance[0] = screen_space_pos.x - viewport.x;
+	gl_ClipDistance[1] = viewport.x + viewport.z - screen_space_pos.x;
+	gl_ClipDistance[2] = screen_space_pos.y - viewport.y;
+	gl_ClipDistance[3] = viewport.y + viewport.w - screen_space_pos.y;
+	float zoom = instance_view.zoom;
+#else
 	vec2 screen_space_pos = (world_space_pos - window_center) / (0.5 * window_size);
+	float zoom = 1.0;
+#endif
 	gl_Position = vec4(screen_space_pos, 0.0, 1.0);
 
+	// Points are only used for the smallest particles (see particle_lod in particle_sort.h). They're
+	// about the same area as the star, and at least a pixel. Dead ones have to be moved out of view.
+	gl_PointSize = max(1.5 * particle_size * point_size_scale * zoom, 1.0);
+	if (particle_size == 0.0)
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+
 	// Pass through vertex attributes to fragment shader, so we can
 	// do calculations based on these values there too, if we want.
 	v_vertex_position = vertex_position;
-	v_particle_position = particle_position;
-	v_particle_velocity = particle_velocity;
-	v_particle_angle_spin_size_creationtime = particle_angle_spin_size_creationtime;
+	v_particle_position = position;
+	v_world_position = world_space_pos;
+	v_trail = trail;
+#ifdef PULLED_INSTANCES
+	v_sprite = 0.0;
+#else
+	v_sprite = particle_sprite;
+#endif
 }
@@ -0,0 +1,19 @@
+// Vertex shader for the text overlay: puts the screen space quad where the overlay goes
+#version 410
+
+// Input data from vertex buffer
+layout(location = 0) in vec2 vertex_position;
+
+// Overlay parameters passed from main app
+uniform vec2 overlay_min;		// the overlay's rectangle, in normalized device coordinates
+uniform vec2 overlay_max;
+
+// Output data to send to fragment shader: where we are in the overlay, from (0, 0) at the top left to (1, 1)
+layout(location = 0) out vec2 o_overlay_position;
+
+void main()
+{
+	vec2 t = vertex_position * 0.5 + 0.5;
+	gl_Position = vec4(mix(overlay_min, overlay_max, t), 0.0, 1.0);
+	o_overlay_position = vec2(t.x, 1.0 - t.y);
+}
@@ -0,0 +1,13 @@
+// Fragment shader for the Vulkan renderer: the same as fragment_shader.glsl
+#version 450
+
+layout(location = 0) in vec2 v_vertex_position;
+layout(location = 1) in vec2 v_particle_position;
+
+layout(location = 0) out vec4 o_color;
+
+void main()
+{
+	// Set the output color to a nice golden yellow
+	o_color = vec4(1.0, 0.79, 0.03, 1.0);
+}
@@ -0,0 +1,55 @@
+// Vertex shader for the Vulkan renderer: vertex_shader.glsl's path for full-format, stepped particles
+#version 450
+
+// Matches struct vulkan_frame_params in vulkan_renderer.h
+layout(std140, set = 0, binding = 0) uniform frame_params
+{
+	vec2 window_size;			// window size in world space
+	vec2 window_center;			// window center in world space
+	float time;					// current render time in seconds
+	float gravity;				// acceleration along y
+	float interpolation_step;	// length of a simulation step, in seconds
+	float interpolation_alpha;	// 1 means render the particle data as it is
+	float point_size_scale;		// pixels per world unit, for particles drawn as points
+};
+
+// Input data from the mesh, and from the instance buffer, laid out as struct particle_data
+layout(location = 0) in vec2 vertex_position;
+layout(location = 1) in vec2 particle_position;
+layout(location = 2) in vec2 particle_velocity;
+layout(location = 3) in vec4 particle_angle_spin_size_creationtime;
+
+layout(location = 0) out vec2 v_vertex_position;
+layout(location = 1) out vec2 v_particle_position;
+
+void main()
+{
+	vec2 position = particle_position;
+	vec2 velocity = particle_velocity;
+	float particle_angle = particle_angle_spin_size_creationtime.x;
+	float particle_size = particle_angle_spin_size_creationtime.z;
+	if (interpolation_alpha < 1.0)
+	{
+		// Undo part of the last step exactly; see vertex_shader.glsl
+		float step_back = (1.0 - interpolation_alpha) * interpolation_step;
+		vec2 previous_velocity = velocity - vec2(0.0, interpolation_step * gravity);
+		position -= step_back * previous_velocity;
+		particle_angle -= step_back * particle_angle_spin_size_creationtime.y;
+	}
+
+	float sin_angle = sin(particle_angle);
+	float cos_angle = cos(particle_angle);
+	mat2 particle_transform = mat2(cos_angle, sin_angle, -sin_angle, cos_angle) * particle_size;
+	vec2 world_space_pos = position + particle_transform * vertex_position;
+
+	// Vulkan's clip space has y pointing down, unlike GL's
+	vec2 screen_space_pos = (world_space_pos - window_center) / (0.5 * window_size);
+	gl_Position = vec4(screen_space_pos.x, -screen_space_pos.y, 0.0, 1.0);
+
+	gl_PointSize = max(1.5 * particle_size * point_size_scale, 1.0);
+	if (particle_size == 0.0)
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+
+	v_vertex_position = vertex_position;
+	v_particle_position = position;
+}
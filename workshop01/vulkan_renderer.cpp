@@ -0,0 +1,986 @@
+// Vulkan renderer: draws the rasterized scene of CPU-simulated particles through Vulkan, with every command buffer recorded up front
+
+#include "vulkan_renderer.h"
+#include "particle_store.h"
+#include "cpu_profiler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// The functions are looked up through GLFW, which has already loaded the Vulkan library, and
+// device functions straight from the device, so calls skip the loader's dispatch
+#define VK_NO_PROTOTYPES
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// The SPIR-V for vulkan_particle.vert and vulkan_particle.frag, compiled by the build
+#include "vulkan_particle.vert.h"
+#include "vulkan_particle.frag.h"
+
+#define VULKAN_GLOBAL_FUNCTIONS(X) \
+	X(vkCreateInstance) \
+	X(vkEnumerateInstanceLayerProperties)
+
+#define VULKAN_INSTANCE_FUNCTIONS(X) \
+	X(vkDestroyInstance) \
+	X(vkEnumeratePhysicalDevices) \
+	X(vkGetPhysicalDeviceProperties) \
+	X(vkGetPhysicalDeviceFeatures) \
+	X(vkGetPhysicalDeviceQueueFamilyProperties) \
+	X(vkGetPhysicalDeviceMemoryProperties) \
+	X(vkGetPhysicalDeviceSurfaceSupportKHR) \
+	X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR) \
+	X(vkGetPhysicalDeviceSurfaceFormatsKHR) \
+	X(vkGetPhysicalDeviceSurfacePresentModesKHR) \
+	X(vkEnumerateDeviceExtensionProperties) \
+	X(vkDestroySurfaceKHR) \
+	X(vkCreateDevice) \
+	X(vkGetDeviceProcAddr)
+
+#define VULKAN_DEVICE_FUNCTIONS(X) \
+	X(vkDestroyDevice) \
+	X(vkGetDeviceQueue) \
+	X(vkDeviceWaitIdle) \
+	X(vkCreateSwapchainKHR) \
+	X(vkDestroySwapchainKHR) \
+	X(vkGetSwapchainImagesKHR) \
+	X(vkAcquireNextImageKHR) \
+	X(vkQueuePresentKHR) \
+	X(vkQueueSubmit) \
+	X(vkCreateImageView) \
+	X(vkDestroyImageView) \
+	X(vkCreateRenderPass) \
+	X(vkDestroyRenderPass) \
+	X(vkCreateFramebuffer) \
+	X(vkDestroyFramebuffer) \
+	X(vkCreateShaderModule) \
+	X(vkDestroyShaderModule) \
+	X(vkCreateDescriptorSetLayout) \
+	X(vkDestroyDescriptorSetLayout) \
+	X(vkCreateDescriptorPool) \
+	X(vkDestroyDescriptorPool) \
+	X(vkAllocateDescriptorSets) \
+	X(vkUpdateDescriptorSets) \
+	X(vkCreatePipelineLayout) \
+	X(vkDestroyPipelineLayout) \
+	X(vkCreateGraphicsPipelines) \
+	X(vkDestroyPipeline) \
+	X(vkCreateBuffer) \
+	X(vkDestroyBuffer) \
+	X(vkGetBufferMemoryRequirements) \
+	X(vkAllocateMemory) \
+	X(vkFreeMemory) \
+	X(vkBindBufferMemory) \
+	X(vkMapMemory) \
+	X(vkCreateCommandPool) \
+	X(vkDestroyCommandPool) \
+	X(vkAllocateCommandBuffers) \
+	X(vkFreeCommandBuffers) \
+	X(vkBeginCommandBuffer) \
+	X(vkEndCommandBuffer) \
+	X(vkCmdBeginRenderPass) \
+	X(vkCmdEndRenderPass) \
+	X(vkCmdBindPipeline) \
+	X(vkCmdBindDescriptorSets) \
+	X(vkCmdBindVertexBuffers) \
+	X(vkCmdBindIndexBuffer) \
+	X(vkCmdSetViewport) \
+	X(vkCmdSetScissor) \
+	X(vkCmdDrawIndexedIndirect) \
+	X(vkCreateFence) \
+	X(vkDestroyFence) \
+	X(vkWaitForFences) \
+	X(vkResetFences) \
+	X(vkCreateSemaphore) \
+	X(vkDestroySemaphore)
+
+#define DEFINE_VULKAN_FUNCTION(name) static PFN_##name name = nullptr;
+VULKAN_GLOBAL_FUNCTIONS(DEFINE_VULKAN_FUNCTION)
+VULKAN_INSTANCE_FUNCTIONS(DEFINE_VULKAN_FUNCTION)
+VULKAN_DEVICE_FUNCTIONS(DEFINE_VULKAN_FUNCTION)
+#undef DEFINE_VULKAN_FUNCTION
+
+// Frames the CPU can have submitted before it waits for the GPU
+static const int max_frames_in_flight = 2;
+
+// A buffer and its memory, which is host visible and coherent, and mapped for as long as it lives
+struct mapped_buffer
+{
+	VkBuffer		buffer;
+	VkDeviceMemory	memory;
+	char*			mapped;
+};
+
+// Everything per swapchain image. Each image has its own part of the frame buffer, and a command
+// buffer recorded to draw into that image from that part, which is then submitted as it is every
+// time the image comes round.
+struct swapchain_image
+{
+	VkImage			image;
+	VkImageView		view;
+	VkFramebuffer	framebuffer;
+	VkCommandBuffer	commands;
+	VkDescriptorSet	descriptors;
+	VkFence			last_fence;		// the frame's that last drew into it, if any
+	size_t			params_offset;	// its part of frame_buffer
+	size_t			draws_offset;
+	size_t			instances_offset;
+};
+
+// Everything per frame in flight
+struct frame_sync
+{
+	VkSemaphore		image_acquired;
+	VkSemaphore		render_finished;
+	VkFence			finished;
+};
+
+static GLFWwindow*						vk_window = nullptr;
+static VkInstance						instance = VK_NULL_HANDLE;
+static VkSurfaceKHR						surface = VK_NULL_HANDLE;
+static VkPhysicalDevice					physical_device = VK_NULL_HANDLE;
+static VkPhysicalDeviceProperties		device_properties = {};
+static VkPhysicalDeviceMemoryProperties	memory_properties = {};
+static VkDevice							device = VK_NULL_HANDLE;
+static uint32_t							queue_family = 0;
+static VkQueue							queue = VK_NULL_HANDLE;
+static VkSurfaceFormatKHR				surface_format = {};
+static VkPresentModeKHR					present_mode = VK_PRESENT_MODE_FIFO_KHR;
+static VkRenderPass						render_pass = VK_NULL_HANDLE;
+static VkDescriptorSetLayout			descriptor_layout = VK_NULL_HANDLE;
+static VkPipelineLayout					pipeline_layout = VK_NULL_HANDLE;
+static VkPipeline						triangle_pipeline = VK_NULL_HANDLE;
+static VkPipeline						point_pipeline = VK_NULL_HANDLE;
+static VkCommandPool					command_pool = VK_NULL_HANDLE;
+static mapped_buffer					mesh_buffer = {};		// the vertices, then the indices
+static size_t							mesh_indices_offset = 0;
+static vulkan_mesh_lod					mesh_lods[max_vulkan_mesh_lods] = {};
+static int								num_mesh_lods = 0;
+static int								max_frame_instances = 0;
+static frame_sync						frames[max_frames_in_flight] = {};
+static int								current_frame = 0;
+static vulkan_lod_draw					frame_draws[max_vulkan_mesh_lods] = {};	// what the frame being filled in asked for
+
+// The swapchain, and what's made for each of its images. This all gets rebuilt when it's resized.
+static VkSwapchainKHR					swapchain = VK_NULL_HANDLE;
+static VkExtent2D						swapchain_extent = {};
+static int								swapchain_framebuffer_size[2] = {};	// what it was made for, which the surface may not quite match
+static std::vector<swapchain_image>		swapchain_images;
+static VkDescriptorPool					descriptor_pool = VK_NULL_HANDLE;
+static mapped_buffer					frame_buffer = {};		// every image's params, draws and instances
+static uint32_t							current_image = 0;
+static bool								swapchain_stale = false;	// present said it's suboptimal
+
+static size_t align_up(size_t size, size_t alignment)
+{
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+static bool find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags flags, uint32_t* o_type)
+{
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i)
+	{
+		if ((type_bits & (1u << i)) && (memory_properties.memoryTypes[i].propertyFlags & flags) == flags)
+		{
+			*o_type = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Everything the CPU writes each frame lives in memory it can see, mapped once for good. Coherent
+// memory means there's nothing to flush; the queue submit makes the writes visible.
+static bool create_mapped_buffer(size_t size, VkBufferUsageFlags usage, mapped_buffer* o_buffer)
+{
+	VkBufferCreateInfo buffer_info = {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = size;
+	buffer_info.usage = usage;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (vkCreateBuffer(device, &buffer_info, nullptr, &o_buffer->buffer) != VK_SUCCESS)
+		return false;
+
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, o_buffer->buffer, &requirements);
+	VkMemoryAllocateInfo allocate_info = {};
+	allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocate_info.allocationSize = requirements.size;
+	void* mapped = nullptr;
+	if (!find_memory_type(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &allocate_info.memoryTypeIndex) ||
+		vkAllocateMemory(device, &allocate_info, nullptr, &o_buffer->memory) != VK_SUCCESS)
+	{
+		vkDestroyBuffer(device, o_buffer->buffer, nullptr);
+		*o_buffer = mapped_buffer{};
+		return false;
+	}
+	if (vkBindBufferMemory(device, o_buffer->buffer, o_buffer->memory, 0) != VK_SUCCESS ||
+		vkMapMemory(device, o_buffer->memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+	{
+		vkDestroyBuffer(device, o_buffer->buffer, nullptr);
+		vkFreeMemory(device, o_buffer->memory, nullptr);
+		*o_buffer = mapped_buffer{};
+		return false;
+	}
+	o_buffer->mapped = (char*)mapped;
+	return true;
+}
+
+static void free_mapped_buffer(mapped_buffer* buffer)
+{
+	// Freeing the memory unmaps it
+	if (buffer->buffer)
+		vkDestroyBuffer(device, buffer->buffer, nullptr);
+	if (buffer->memory)
+		vkFreeMemory(device, buffer->memory, nullptr);
+	*buffer = mapped_buffer{};
+}
+
+static bool create_instance()
+{
+	if (!glfwVulkanSupported())
+		return false;
+
+#define LOAD_VULKAN_FUNCTION(name) name = (PFN_##name)glfwGetInstanceProcAddress(nullptr, #name);
+	VULKAN_GLOBAL_FUNCTIONS(LOAD_VULKAN_FUNCTION)
+#undef LOAD_VULKAN_FUNCTION
+	if (!vkCreateInstance || !vkEnumerateInstanceLayerProperties)
+		return false;
+
+	uint32_t num_extensions = 0;
+	const char** extensions = glfwGetRequiredInstanceExtensions(&num_extensions);
+	if (!extensions)
+		return false;
+
+	// Debug builds check every call with the validation layers, which print what they find; release
+	// builds don't pay for that
+	std::vector<const char*> layers;
+#ifndef NDEBUG
+	static const char* const validation_layer = "VK_LAYER_LUNARG_standard_validation";
+	uint32_t num_layers = 0;
+	vkEnumerateInstanceLayerProperties(&num_layers, nullptr);
+	std::vector<VkLayerProperties> available_layers(num_layers);
+	vkEnumerateInstanceLayerProperties(&num_layers, available_layers.data());
+	for (const VkLayerProperties& layer : available_layers)
+	{
+		if (strcmp(layer.layerName, validation_layer) == 0)
+			layers.push_back(validation_layer);
+	}
+	if (layers.empty())
+		printf("Warning: Vulkan validation layers not available!\n");
+#endif
+
+	VkApplicationInfo app_info = {};
+	app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	app_info.pApplicationName = "workshop01";
+	app_info.apiVersion = VK_MAKE_VERSION(1, 0, 0);
+	VkInstanceCreateInfo instance_info = {};
+	instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	instance_info.pApplicationInfo = &app_info;
+	instance_info.enabledLayerCount = uint32_t(layers.size());
+	instance_info.ppEnabledLayerNames = layers.data();
+	instance_info.enabledExtensionCount = num_extensions;
+	instance_info.ppEnabledExtensionNames = extensions;
+	if (vkCreateInstance(&instance_info, nullptr, &instance) != VK_SUCCESS)
+		return false;
+
+#define LOAD_VULKAN_FUNCTION(name) name = (PFN_##name)glfwGetInstanceProcAddress(instance, #name);
+	VULKAN_INSTANCE_FUNCTIONS(LOAD_VULKAN_FUNCTION)
+#undef LOAD_VULKAN_FUNCTION
+	return true;
+}
+
+static bool has_device_extension(VkPhysicalDevice candidate, const char* name)
+{
+	uint32_t num_extensions = 0;
+	vkEnumerateDeviceExtensionProperties(candidate, nullptr, &num_extensions, nullptr);
+	std::vector<VkExtensionProperties> extensions(num_extensions);
+	vkEnumerateDeviceExtensionProperties(candidate, nullptr, &num_extensions, extensions.data());
+	for (const VkExtensionProperties& extension : extensions)
+	{
+		if (strcmp(extension.extensionName, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+// Take the first device that can draw and present to the window from one queue, and start
+// instanced draws partway through the instance buffer from an indirect command, preferring a
+// discrete GPU
+static bool create_device()
+{
+	uint32_t num_devices = 0;
+	vkEnumeratePhysicalDevices(instance, &num_devices, nullptr);
+	std::vector<VkPhysicalDevice> devices(num_devices);
+	vkEnumeratePhysicalDevices(instance, &num_devices, devices.data());
+
+	VkPhysicalDeviceFeatures features = {};
+	for (VkPhysicalDevice candidate : devices)
+	{
+		VkPhysicalDeviceFeatures candidate_features;
+		vkGetPhysicalDeviceFeatures(candidate, &candidate_features);
+		if (!candidate_features.drawIndirectFirstInstance || !has_device_extension(candidate, VK_KHR_SWAPCHAIN_EXTENSION_NAME))
+			continue;
+
+		uint32_t num_families = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(candidate, &num_families, nullptr);
+		std::vector<VkQueueFamilyProperties> families(num_families);
+		vkGetPhysicalDeviceQueueFamilyProperties(candidate, &num_families, families.data());
+		for (uint32_t i = 0; i < num_families; ++i)
+		{
+			VkBool32 can_present = VK_FALSE;
+			vkGetPhysicalDeviceSurfaceSupportKHR(candidate, i, surface, &can_present);
+			if (!(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) || !can_present)
+				continue;
+
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(candidate, &properties);
+			if (!physical_device || properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+			{
+				physical_device = candidate;
+				device_properties = properties;
+				queue_family = i;
+				features = candidate_features;
+			}
+			break;
+		}
+	}
+	if (!physical_device)
+		return false;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+	// Only turn on what's used. Points bigger than a pixel need largePoints, but without it they
+	// just come out small.
+	VkPhysicalDeviceFeatures enabled_features = {};
+	enabled_features.drawIndirectFirstInstance = VK_TRUE;
+	enabled_features.largePoints = features.largePoints;
+
+	float priority = 1.0f;
+	VkDeviceQueueCreateInfo queue_info = {};
+	queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queue_info.queueFamilyIndex = queue_family;
+	queue_info.queueCount = 1;
+	queue_info.pQueuePriorities = &priority;
+	const char* extension = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+	VkDeviceCreateInfo device_info = {};
+	device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	device_info.queueCreateInfoCount = 1;
+	device_info.pQueueCreateInfos = &queue_info;
+	device_info.enabledExtensionCount = 1;
+	device_info.ppEnabledExtensionNames = &extension;
+	device_info.pEnabledFeatures = &enabled_features;
+	if (vkCreateDevice(physical_device, &device_info, nullptr, &device) != VK_SUCCESS)
+		return false;
+
+#define LOAD_VULKAN_FUNCTION(name) name = (PFN_##name)vkGetDeviceProcAddr(device, #name);
+	VULKAN_DEVICE_FUNCTIONS(LOAD_VULKAN_FUNCTION)
+#undef LOAD_VULKAN_FUNCTION
+	vkGetDeviceQueue(device, queue_family, 0, &queue);
+	return true;
+}
+
+// Pick the surface's format, and how to present. Like the GL renderer's swap interval of -1, keep
+// to the refresh rate, but let a late frame tear rather than wait for the next one, if we can.
+static void choose_surface_format()
+{
+	uint32_t num_formats = 0;
+	vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &num_formats, nullptr);
+	std::vector<VkSurfaceFormatKHR> formats(num_formats);
+	vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &num_formats, formats.data());
+	surface_format.format = VK_FORMAT_B8G8R8A8_UNORM;
+	surface_format.colorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+	if (!formats.empty() && formats[0].format != VK_FORMAT_UNDEFINED)
+	{
+		surface_format = formats[0];
+		for (const VkSurfaceFormatKHR& format : formats)
+		{
+			if (format.format == VK_FORMAT_B8G8R8A8_UNORM)
+				surface_format = format;
+		}
+	}
+
+	uint32_t num_modes = 0;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &num_modes, nullptr);
+	std::vector<VkPresentModeKHR> modes(num_modes);
+	vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &num_modes, modes.data());
+	present_mode = VK_PRESENT_MODE_FIFO_KHR;
+	if (std::find(modes.begin(), modes.end(), VK_PRESENT_MODE_FIFO_RELAXED_KHR) != modes.end())
+		present_mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+}
+
+static bool create_render_pass()
+{
+	VkAttachmentDescription color = {};
+	color.format = surface_format.format;
+	color.samples = VK_SAMPLE_COUNT_1_BIT;
+	color.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	color.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	color.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	color.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	color.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	color.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkAttachmentReference color_reference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &color_reference;
+
+	// The image isn't ours until the acquire semaphore's waited on, which happens at this stage
+	VkSubpassDependency dependency = {};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo render_pass_info = {};
+	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	render_pass_info.attachmentCount = 1;
+	render_pass_info.pAttachments = &color;
+	render_pass_info.subpassCount = 1;
+	render_pass_info.pSubpasses = &subpass;
+	render_pass_info.dependencyCount = 1;
+	render_pass_info.pDependencies = &dependency;
+	return vkCreateRenderPass(device, &render_pass_info, nullptr, &render_pass) == VK_SUCCESS;
+}
+
+static VkShaderModule create_shader_module(const uint32_t* code, size_t size)
+{
+	VkShaderModuleCreateInfo module_info = {};
+	module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	module_info.codeSize = size;
+	module_info.pCode = code;
+	VkShaderModule module = VK_NULL_HANDLE;
+	vkCreateShaderModule(device, &module_info, nullptr, &module);
+	return module;
+}
+
+// The particle pipelines, one for the triangle LODs and one for points. The viewport and scissor
+// are dynamic, so resizing only means recording the command buffers again.
+static bool create_pipelines()
+{
+	VkDescriptorSetLayoutBinding binding = {};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	binding.descriptorCount = 1;
+	binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	VkDescriptorSetLayoutCreateInfo descriptor_layout_info = {};
+	descriptor_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptor_layout_info.bindingCount = 1;
+	descriptor_layout_info.pBindings = &binding;
+	if (vkCreateDescriptorSetLayout(device, &descriptor_layout_info, nullptr, &descriptor_layout) != VK_SUCCESS)
+		return false;
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = 1;
+	pipeline_layout_info.pSetLayouts = &descriptor_layout;
+	if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pipeline_layout) != VK_SUCCESS)
+		return false;
+
+	VkShaderModule vertex_module = create_shader_module(vulkan_particle_vert, sizeof(vulkan_particle_vert));
+	VkShaderModule fragment_module = create_shader_module(vulkan_particle_frag, sizeof(vulkan_particle_frag));
+	VkPipelineShaderStageCreateInfo stages[2] = {};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = vertex_module;
+	stages[0].pName = "main";
+	stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = fragment_module;
+	stages[1].pName = "main";
+
+	// The mesh's vertices, and the particles as instances, laid out as particle_data
+	VkVertexInputBindingDescription bindings[2] =
+	{
+		{ 0, 2 * sizeof(float), VK_VERTEX_INPUT_RATE_VERTEX },
+		{ 1, sizeof(particle_data), VK_VERTEX_INPUT_RATE_INSTANCE },
+	};
+	VkVertexInputAttributeDescription attributes[4] =
+	{
+		{ 0, 0, VK_FORMAT_R32G32_SFLOAT, 0 },
+		{ 1, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(particle_data, position) },
+		{ 2, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(particle_data, velocity) },
+		{ 3, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(particle_data, angle) },
+	};
+	VkPipelineVertexInputStateCreateInfo vertex_input = {};
+	vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertex_input.vertexBindingDescriptionCount = 2;
+	vertex_input.pVertexBindingDescriptions = bindings;
+	vertex_input.vertexAttributeDescriptionCount = 4;
+	vertex_input.pVertexAttributeDescriptions = attributes;
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+	input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewport = {};
+	viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewport.viewportCount = 1;
+	viewport.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterization = {};
+	rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterization.cullMode = VK_CULL_MODE_NONE;
+	rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterization.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisample = {};
+	multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState blend_attachment = {};
+	blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	VkPipelineColorBlendStateCreateInfo blend = {};
+	blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	blend.attachmentCount = 1;
+	blend.pAttachments = &blend_attachment;
+
+	VkDynamicState dynamic_states[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamic = {};
+	dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic.dynamicStateCount = 2;
+	dynamic.pDynamicStates = dynamic_states;
+
+	VkGraphicsPipelineCreateInfo pipeline_info = {};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeline_info.stageCount = 2;
+	pipeline_info.pStages = stages;
+	pipeline_info.pVertexInputState = &vertex_input;
+	pipeline_info.pInputAssemblyState = &input_assembly;
+	pipeline_info.pViewportState = &viewport;
+	pipeline_info.pRasterizationState = &rasterization;
+	pipeline_info.pMultisampleState = &multisample;
+	pipeline_info.pColorBlendState = &blend;
+	pipeline_info.pDynamicState = &dynamic;
+	pipeline_info.layout = pipeline_layout;
+	pipeline_info.renderPass = render_pass;
+	pipeline_info.subpass = 0;
+
+	bool created = vertex_module && fragment_module &&
+		vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &triangle_pipeline) == VK_SUCCESS;
+	input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+	created = created &&
+		vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &point_pipeline) == VK_SUCCESS;
+
+	if (vertex_module)
+		vkDestroyShaderModule(device, vertex_module, nullptr);
+	if (fragment_module)
+		vkDestroyShaderModule(device, fragment_module, nullptr);
+	return created;
+}
+
+// Record the commands that draw a frame into one swapchain image: clear it to the sky, then draw
+// each LOD's instances with the counts the CPU leaves in the image's indirect commands. Nothing
+// in here changes from frame to frame, so it's only recorded again when the swapchain is rebuilt.
+static bool record_image_commands(const swapchain_image& image)
+{
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	if (vkBeginCommandBuffer(image.commands, &begin_info) != VK_SUCCESS)
+		return false;
+
+	VkClearValue clear = {};
+	clear.color.float32[0] = 0.0f;
+	clear.color.float32[1] = 0.6f;
+	clear.color.float32[2] = 1.0f;
+	clear.color.float32[3] = 1.0f;
+	VkRenderPassBeginInfo pass_info = {};
+	pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	pass_info.renderPass = render_pass;
+	pass_info.framebuffer = image.framebuffer;
+	pass_info.renderArea.extent = swapchain_extent;
+	pass_info.clearValueCount = 1;
+	pass_info.pClearValues = &clear;
+	vkCmdBeginRenderPass(image.commands, &pass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport = { 0.0f, 0.0f, float(swapchain_extent.width), float(swapchain_extent.height), 0.0f, 1.0f };
+	VkRect2D scissor = { { 0, 0 }, swapchain_extent };
+	vkCmdSetViewport(image.commands, 0, 1, &viewport);
+	vkCmdSetScissor(image.commands, 0, 1, &scissor);
+
+	VkBuffer vertex_buffers[2] = { mesh_buffer.buffer, frame_buffer.buffer };
+	VkDeviceSize vertex_offsets[2] = { 0, image.instances_offset };
+	vkCmdBindVertexBuffers(image.commands, 0, 2, vertex_buffers, vertex_offsets);
+	vkCmdBindIndexBuffer(image.commands, mesh_buffer.buffer, mesh_indices_offset, VK_INDEX_TYPE_UINT16);
+	vkCmdBindDescriptorSets(image.commands, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &image.descriptors, 0, nullptr);
+
+	// Smallest LOD first, like the GL renderer, so the stars end up on top
+	VkPipeline bound = VK_NULL_HANDLE;
+	for (int lod = num_mesh_lods - 1; lod >= 0; --lod)
+	{
+		VkPipeline pipeline = mesh_lods[lod].points ? point_pipeline : triangle_pipeline;
+		if (pipeline != bound)
+		{
+			vkCmdBindPipeline(image.commands, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			bound = pipeline;
+		}
+		vkCmdDrawIndexedIndirect(image.commands, frame_buffer.buffer, image.draws_offset + lod * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+	}
+
+	vkCmdEndRenderPass(image.commands);
+	return vkEndCommandBuffer(image.commands) == VK_SUCCESS;
+}
+
+static void destroy_swapchain_resources()
+{
+	for (swapchain_image& image : swapchain_images)
+	{
+		if (image.framebuffer)
+			vkDestroyFramebuffer(device, image.framebuffer, nullptr);
+		if (image.view)
+			vkDestroyImageView(device, image.view, nullptr);
+		if (image.commands)
+			vkFreeCommandBuffers(device, command_pool, 1, &image.commands);
+	}
+	swapchain_images.clear();
+	if (descriptor_pool)
+		vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+	descriptor_pool = VK_NULL_HANDLE;
+	free_mapped_buffer(&frame_buffer);
+}
+
+// (Re)build the swapchain at the framebuffer's size, with each image's part of the frame buffer,
+// and its commands recorded. Returns false if there's nothing to draw to, such as when the window's
+// minimized, in which case it's tried again next frame.
+static bool create_swapchain(int width, int height)
+{
+	vkDeviceWaitIdle(device);
+	destroy_swapchain_resources();
+	swapchain_stale = false;
+	swapchain_framebuffer_size[0] = width;
+	swapchain_framebuffer_size[1] = height;
+
+	VkSurfaceCapabilitiesKHR capabilities;
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &capabilities);
+	VkExtent2D extent = capabilities.currentExtent;
+	if (extent.width == 0xffffffffu)
+	{
+		extent.width = std::min(std::max(uint32_t(width), capabilities.minImageExtent.width), capabilities.maxImageExtent.width);
+		extent.height = std::min(std::max(uint32_t(height), capabilities.minImageExtent.height), capabilities.maxImageExtent.height);
+	}
+	if (extent.width == 0 || extent.height == 0)
+		return false;
+
+	uint32_t num_images = capabilities.minImageCount + 1;
+	if (capabilities.maxImageCount > 0)
+		num_images = std::min(num_images, capabilities.maxImageCount);
+
+	VkSwapchainKHR old_swapchain = swapchain;
+	VkSwapchainCreateInfoKHR swapchain_info = {};
+	swapchain_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+	swapchain_info.surface = surface;
+	swapchain_info.minImageCount = num_images;
+	swapchain_info.imageFormat = surface_format.format;
+	swapchain_info.imageColorSpace = surface_format.colorSpace;
+	swapchain_info.imageExtent = extent;
+	swapchain_info.imageArrayLayers = 1;
+	swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	swapchain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	swapchain_info.preTransform = capabilities.currentTransform;
+	swapchain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	swapchain_info.presentMode = present_mode;
+	swapchain_info.clipped = VK_TRUE;
+	swapchain_info.oldSwapchain = old_swapchain;
+	VkResult result = vkCreateSwapchainKHR(device, &swapchain_info, nullptr, &swapchain);
+	if (old_swapchain)
+		vkDestroySwapchainKHR(device, old_swapchain, nullptr);
+	if (result != VK_SUCCESS)
+	{
+		swapchain = VK_NULL_HANDLE;
+		return false;
+	}
+	swapchain_extent = extent;
+
+	vkGetSwapchainImagesKHR(device, swapchain, &num_images, nullptr);
+	std::vector<VkImage> images(num_images);
+	vkGetSwapchainImagesKHR(device, swapchain, &num_images, images.data());
+	swapchain_images.resize(num_images, swapchain_image{});
+
+	// Each image's part of the frame buffer: its parameters, its indirect draws, then its instances
+	size_t uniform_alignment = std::max(size_t(device_properties.limits.minUniformBufferOffsetAlignment), size_t(16));
+	size_t params_size = align_up(sizeof(vulkan_frame_params), uniform_alignment);
+	size_t draws_size = align_up(max_vulkan_mesh_lods * sizeof(VkDrawIndexedIndirectCommand), uniform_alignment);
+	size_t instances_size = align_up(size_t(max_frame_instances) * sizeof(particle_data), uniform_alignment);
+	size_t image_size = params_size + draws_size + instances_size;
+	if (!create_mapped_buffer(image_size * num_images,
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &frame_buffer))
+		return false;
+
+	VkDescriptorPoolSize pool_size = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, num_images };
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.maxSets = num_images;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	if (vkCreateDescriptorPool(device, &pool_info, nullptr, &descriptor_pool) != VK_SUCCESS)
+		return false;
+
+	for (uint32_t i = 0; i < num_images; ++i)
+	{
+		swapchain_image& image = swapchain_images[i];
+		image.image = images[i];
+		image.params_offset = image_size * i;
+		image.draws_offset = image.params_offset + params_size;
+		image.instances_offset = image.draws_offset + draws_size;
+
+		VkImageViewCreateInfo view_info = {};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = image.image;
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = surface_format.format;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		view_info.subresourceRange.levelCount = 1;
+		view_info.subresourceRange.layerCount = 1;
+		if (vkCreateImageView(device, &view_info, nullptr, &image.view) != VK_SUCCESS)
+			return false;
+
+		VkFramebufferCreateInfo framebuffer_info = {};
+		framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebuffer_info.renderPass = render_pass;
+		framebuffer_info.attachmentCount = 1;
+		framebuffer_info.pAttachments = &image.view;
+		framebuffer_info.width = extent.width;
+		framebuffer_info.height = extent.height;
+		framebuffer_info.layers = 1;
+		if (vkCreateFramebuffer(device, &framebuffer_info, nullptr, &image.framebuffer) != VK_SUCCESS)
+			return false;
+
+		VkDescriptorSetAllocateInfo set_info = {};
+		set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		set_info.descriptorPool = descriptor_pool;
+		set_info.descriptorSetCount = 1;
+		set_info.pSetLayouts = &descriptor_layout;
+		if (vkAllocateDescriptorSets(device, &set_info, &image.descriptors) != VK_SUCCESS)
+			return false;
+		VkDescriptorBufferInfo buffer_info = { frame_buffer.buffer, image.params_offset, sizeof(vulkan_frame_params) };
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = image.descriptors;
+		write.dstBinding = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		write.pBufferInfo = &buffer_info;
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+		// No draws until the CPU fills some in
+		VkDrawIndexedIndirectCommand* draws = (VkDrawIndexedIndirectCommand*)(frame_buffer.mapped + image.draws_offset);
+		memset(draws, 0, max_vulkan_mesh_lods * sizeof(VkDrawIndexedIndirectCommand));
+
+		VkCommandBufferAllocateInfo command_info = {};
+		command_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_info.commandPool = command_pool;
+		command_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		command_info.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(device, &command_info, &image.commands) != VK_SUCCESS || !record_image_commands(image))
+			return false;
+	}
+	return true;
+}
+
+static bool create_frame_sync()
+{
+	VkSemaphoreCreateInfo semaphore_info = {};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	for (frame_sync& frame : frames)
+	{
+		if (vkCreateSemaphore(device, &semaphore_info, nullptr, &frame.image_acquired) != VK_SUCCESS ||
+			vkCreateSemaphore(device, &semaphore_info, nullptr, &frame.render_finished) != VK_SUCCESS ||
+			vkCreateFence(device, &fence_info, nullptr, &frame.finished) != VK_SUCCESS)
+			return false;
+	}
+	return true;
+}
+
+bool init_vulkan_renderer(GLFWwindow* window, int max_instances,
+	const float* vertices, int num_vertices, const uint16_t* indices, int num_indices,
+	const vulkan_mesh_lod* lods, int num_lods)
+{
+	vk_window = window;
+	max_frame_instances = max_instances;
+	num_mesh_lods = std::min(num_lods, max_vulkan_mesh_lods);
+	std::copy_n(lods, num_mesh_lods, mesh_lods);
+
+	if (!create_instance())
+	{
+		free_vulkan_renderer();
+		return false;
+	}
+	if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS || !create_device())
+	{
+		free_vulkan_renderer();
+		return false;
+	}
+	choose_surface_format();
+
+	VkCommandPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = queue_family;
+	if (!create_render_pass() || !create_pipelines() || !create_frame_sync() ||
+		vkCreateCommandPool(device, &pool_info, nullptr, &command_pool) != VK_SUCCESS)
+	{
+		free_vulkan_renderer();
+		return false;
+	}
+
+	// The mesh never changes, and it's tiny, so it stays in the same kind of memory as everything else
+	size_t vertices_size = size_t(num_vertices) * 2 * sizeof(float);
+	mesh_indices_offset = align_up(vertices_size, 4);
+	if (!create_mapped_buffer(mesh_indices_offset + size_t(num_indices) * sizeof(uint16_t), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &mesh_buffer))
+	{
+		free_vulkan_renderer();
+		return false;
+	}
+	memcpy(mesh_buffer.mapped, vertices, vertices_size);
+	memcpy(mesh_buffer.mapped + mesh_indices_offset, indices, size_t(num_indices) * sizeof(uint16_t));
+	return true;
+}
+
+void free_vulkan_renderer()
+{
+	if (device)
+	{
+		vkDeviceWaitIdle(device);
+		destroy_swapchain_resources();
+		if (swapchain)
+			vkDestroySwapchainKHR(device, swapchain, nullptr);
+		free_mapped_buffer(&mesh_buffer);
+		for (frame_sync& frame : frames)
+		{
+			if (frame.image_acquired)
+				vkDestroySemaphore(device, frame.image_acquired, nullptr);
+			if (frame.render_finished)
+				vkDestroySemaphore(device, frame.render_finished, nullptr);
+			if (frame.finished)
+				vkDestroyFence(device, frame.finished, nullptr);
+			frame = frame_sync{};
+		}
+		if (command_pool)
+			vkDestroyCommandPool(device, command_pool, nullptr);
+		if (triangle_pipeline)
+			vkDestroyPipeline(device, triangle_pipeline, nullptr);
+		if (point_pipeline)
+			vkDestroyPipeline(device, point_pipeline, nullptr);
+		if (pipeline_layout)
+			vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+		if (descriptor_layout)
+			vkDestroyDescriptorSetLayout(device, descriptor_layout, nullptr);
+		if (render_pass)
+			vkDestroyRenderPass(device, render_pass, nullptr);
+		vkDestroyDevice(device, nullptr);
+	}
+	if (surface)
+		vkDestroySurfaceKHR(instance, surface, nullptr);
+	if (instance)
+		vkDestroyInstance(instance, nullptr);
+
+	swapchain = VK_NULL_HANDLE;
+	command_pool = VK_NULL_HANDLE;
+	triangle_pipeline = VK_NULL_HANDLE;
+	point_pipeline = VK_NULL_HANDLE;
+	pipeline_layout = VK_NULL_HANDLE;
+	descriptor_layout = VK_NULL_HANDLE;
+	render_pass = VK_NULL_HANDLE;
+	device = VK_NULL_HANDLE;
+	physical_device = VK_NULL_HANDLE;
+	surface = VK_NULL_HANDLE;
+	instance = VK_NULL_HANDLE;
+	vk_window = nullptr;
+}
+
+const char* vulkan_device_name()
+{
+	return device_properties.deviceName;
+}
+
+bool begin_vulkan_frame(int framebuffer_width, int framebuffer_height, vulkan_frame* o_frame)
+{
+	CPU_PROFILE_SCOPE("begin_vulkan_frame");
+	if (framebuffer_width <= 0 || framebuffer_height <= 0)
+		return false;
+	if (!swapchain || swapchain_images.empty() || swapchain_stale ||
+		framebuffer_width != swapchain_framebuffer_size[0] || framebuffer_height != swapchain_framebuffer_size[1])
+	{
+		if (!create_swapchain(framebuffer_width, framebuffer_height))
+			return false;
+	}
+
+	// The frame in flight from this slot last time round has to be done with its semaphores
+	frame_sync& frame = frames[current_frame];
+	vkWaitForFences(device, 1, &frame.finished, VK_TRUE, UINT64_MAX);
+	VkResult result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, frame.image_acquired, VK_NULL_HANDLE, &current_image);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		create_swapchain(framebuffer_width, framebuffer_height);
+		return false;
+	}
+	if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+		return false;
+
+	// And whichever frame last drew into this image has to be done reading its part of the buffer
+	swapchain_image& image = swapchain_images[current_image];
+	if (image.last_fence && image.last_fence != frame.finished)
+		vkWaitForFences(device, 1, &image.last_fence, VK_TRUE, UINT64_MAX);
+	image.last_fence = frame.finished;
+	vkResetFences(device, 1, &frame.finished);
+
+	o_frame->params = (vulkan_frame_params*)(frame_buffer.mapped + image.params_offset);
+	o_frame->instances = (particle_data*)(frame_buffer.mapped + image.instances_offset);
+	o_frame->max_instances = max_frame_instances;
+	for (int lod = 0; lod < num_mesh_lods; ++lod)
+		frame_draws[lod] = vulkan_lod_draw{ 0, 0 };
+	o_frame->draws = frame_draws;
+	return true;
+}
+
+void end_vulkan_frame()
+{
+	CPU_PROFILE_SCOPE("end_vulkan_frame");
+	swapchain_image& image = swapchain_images[current_image];
+	frame_sync& frame = frames[current_frame];
+
+	// Only the instance runs change from frame to frame; the recorded commands read them from here
+	VkDrawIndexedIndirectCommand* commands = (VkDrawIndexedIndirectCommand*)(frame_buffer.mapped + image.draws_offset);
+	for (int lod = 0; lod < num_mesh_lods; ++lod)
+	{
+		commands[lod].indexCount = mesh_lods[lod].num_indices;
+		commands[lod].instanceCount = frame_draws[lod].instance_count;
+		commands[lod].firstIndex = mesh_lods[lod].first_index;
+		commands[lod].vertexOffset = 0;
+		commands[lod].firstInstance = frame_draws[lod].first_instance;
+	}
+
+	VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.waitSemaphoreCount = 1;
+	submit_info.pWaitSemaphores = &frame.image_acquired;
+	submit_info.pWaitDstStageMask = &wait_stage;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &image.commands;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &frame.render_finished;
+	if (vkQueueSubmit(queue, 1, &submit_info, frame.finished) != VK_SUCCESS)
+		printf("Warning: Vulkan frame submission failed!\n");
+
+	VkPresentInfoKHR present_info = {};
+	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	present_info.waitSemaphoreCount = 1;
+	present_info.pWaitSemaphores = &frame.render_finished;
+	present_info.swapchainCount = 1;
+	present_info.pSwapchains = &swapchain;
+	present_info.pImageIndices = &current_image;
+	VkResult result = vkQueuePresentKHR(queue, &present_info);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		swapchain_stale = true;
+
+	current_frame = (current_frame + 1) % max_frames_in_flight;
+}
@@ -0,0 +1,70 @@
+// Vulkan renderer: draws the rasterized scene of CPU-simulated particles through Vulkan, with every command buffer recorded up front
+#pragma once
+
+#include <cstdint>
+
+struct GLFWwindow;
+struct particle_data;
+
+// The most mesh LODs there can be, each drawn with its own indirect draw
+static const int max_vulkan_mesh_lods = 4;
+
+// One of the particle mesh's LODs, as a run of its indices. Points get a pipeline of their own.
+struct vulkan_mesh_lod
+{
+	uint32_t	first_index;
+	uint32_t	num_indices;
+	bool		points;
+};
+
+// What the vertex shader needs to know about the frame. This matches the uniform block in
+// vulkan_particle.vert.
+struct vulkan_frame_params
+{
+	float	window_size[2];			// in world space
+	float	window_center[2];
+	float	time;					// the render time, a little behind the simulation
+	float	gravity;
+	float	interpolation_step;		// length of a simulation step, in seconds
+	float	interpolation_alpha;	// 1 means draw the particles as they are
+	float	point_size_scale;		// pixels per world unit
+};
+
+// One LOD's run of this frame's instances
+struct vulkan_lod_draw
+{
+	uint32_t	first_instance;
+	uint32_t	instance_count;
+};
+
+// This frame's part of the persistently mapped buffer, which the GPU is done with. Fill it all in
+// between begin_vulkan_frame() and end_vulkan_frame(); the commands that read it never change.
+struct vulkan_frame
+{
+	vulkan_frame_params*	params;
+	particle_data*			instances;
+	int						max_instances;
+	vulkan_lod_draw*		draws;			// one per LOD, in the order init_vulkan_renderer() had them
+};
+
+// Start Vulkan on a window made with GLFW_CLIENT_API set to GLFW_NO_API, with room for up to
+// 'max_instances' particles a frame, and upload the particle mesh. Debug builds turn on the
+// validation layers if they're installed; release builds leave them off, so nothing checks each
+// call. Returns false, with nothing left to free, if there's no Vulkan or no device that'll do.
+bool init_vulkan_renderer(GLFWwindow* window, int max_instances,
+	const float* vertices, int num_vertices, const uint16_t* indices, int num_indices,
+	const vulkan_mesh_lod* lods, int num_lods);
+
+// Wait for the GPU and release everything
+void free_vulkan_renderer();
+
+// Which GPU it's using
+const char* vulkan_device_name();
+
+// Get the next swapchain image, and this frame's part of the mapped buffer, waiting for the GPU to
+// finish with them if it has to. The swapchain is rebuilt, and its commands recorded again, when
+// the framebuffer size changes. Returns false if there's no frame to draw this time round.
+bool begin_vulkan_frame(int framebuffer_width, int framebuffer_height, vulkan_frame* o_frame);
+
+// Submit the image's recorded commands, and present it
+void end_vulkan_frame();
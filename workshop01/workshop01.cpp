@@ -1,9 +1,20 @@
 // workshop01: simple OpenGL particle system
 
 #include <algorithm>	// for std::min, std::max
+#include <atomic>
+#include <cassert>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 // Windows-specific: prevent Windows headers from defining extra stuff we don't need or want
 #ifdef WIN32
@@ -17,10 +28,58 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "particle_store.h"
+#include "simulate_kernels.h"
+#include "job_system.h"
+#include "upload_ring.h"
+#include "frame_clock.h"
+#include "emitters.h"
+#include "particle_sort.h"
+#include "particle_shapes.h"
+#include "gl_state.h"
+#include "gl_debug.h"
+#include "file_watcher.h"
+#include "program_cache.h"
+#include "shader_builder.h"
+#include "shader_source.h"
+#include "particle_snapshot.h"
+#include "gpu_profiler.h"
+#include "cpu_profiler.h"
+#include "benchmark.h"
+#include "text_overlay.h"
+#include "particle_bvh.h"
+#include "cpu_raytracer.h"
+#include "particle_collisions.h"
+#include "collider_field.h"
+#include "force_field.h"
+#include "simulation_lod.h"
+#include "texture_streamer.h"
+#include "sprite_array.h"
+#include "light_clusters.h"
+#include "async_log.h"
+#include "perf_counters.h"
+#include "simulation_file.h"
+#include "frame_replay.h"
+#include "frame_arena.h"
+#include "frame_capture.h"
+#include "render_graph.h"
+#include "gl_workers.h"
+#include "gpu_memory.h"
+#include "thread_config.h"
+#include "output_windows.h"
+#if VULKAN_RENDERER
+#include "vulkan_renderer.h"
+#endif
 
 static const float two_pi = 6.283185308f;
+static const float gravity = -40.0f;
+static const int max_num_particles = 1 << 24;	// 16M particles, 512MB per GPU particle buffer
+static const int max_num_emitters = 1 << 16;
+static const float kill_height = -20.0f;		// particles below this are well off the bottom of the window, and are dead
+static const float max_particle_age = 5.0f;		// and any that haven't got there by this many seconds die anyway
+static const int max_steps_per_frame = 8;		// if we fall further behind than this, slow down rather than spiral
+static const float max_particle_speed = 64.0f;	// particles launch at up to ~50, and fall to kill_height at up to ~63
+static const float particle_restitution = 0.3f;	// how much of their closing speed colliding particles bounce back with
 
 // Definition of the data for a single vertex for our particle system
 struct particle_vertex
@@ -34,413 +93,5208 @@ struct quad_vertex
 	float screen_position[2];
 };
 
-// Definition of the data for a single particle
-struct particle_data
+// Definition of the "uniform" data that will be passed to the shaders...
+// basically global variables for shaders
+struct uniform_data
+{
+	float window_size[2];		// window size in world space
+	float window_center[2];		// window center in world space
+	float light_dir[3];			// direction of a moving light source
+	float time;					// current simulation time in seconds
+};
+
+// Where each view looks, when the particles are drawn into several at once (see num_views), and
+// where it goes in the window: this matches struct view in vertex_shader.glsl
+static const int max_views = 4;
+struct view_data
+{
+	float window_size[2];		// as in uniform_data, but the view's
+	float window_center[2];
+	float viewport[4];			// where it goes, as x, y, width and height in [-1, 1] screen space
+	float zoom;					// how much bigger things are in it than across the whole window
+	float padding[3];			// std140 rounds an array's structs up to a multiple of 16 bytes
+};
+
+// A program the shader builder's working on, and where to put it when it's done
+struct pending_program
+{
+	program_build		build;
+	std::string			label;
+	program_cache_key	key;				// to save its binary under
+	GLuint*				out_program;
+	bool				superseded;			// it's been reloaded again since, so throw this one away
+};
+
+// Global variables
+int					num_particles = 1000;				// capacity of the particle ring; set with --particles, or +/- at runtime
+float				particles_per_second = 50.0f;		// total emission rate; set with --rate
+int					num_emitters = 1;					// how many emitters share that rate; set with --emitters
+emitter_set			emitters = {};
+int					next_particle_index = 0;			// next slot in the ring to spawn a particle into
+double				simulation_rate = 120.0;			// fixed simulation steps per second; set with --sim-rate
+uint32_t			random_seed = 0xf2eec0de;			// seeds all the random streams; set with --seed
+uint32_t			spawn_counter = 0;					// how many particles have been spawned on the CPU so far
+frame_clock			sim_clock = {};						// the one source of time for everything in a frame
+particle_store		particles = {};
+simulate_kernel		simulate_kernel_fn = nullptr;
+
+GLFWwindow*			window = nullptr;
+int					framebuffer_width = 0;				// the size to render at, kept up to date by framebuffer_size_callback()
+int					framebuffer_height = 0;
+bool				framebuffer_size_changed = true;	// since the last frame, so the viewport needs updating
+bool				polling_events = false;				// inside glfwPollEvents(), which a live resize can keep us in
+bool				render_on_demand = true;			// skip frames while nothing's changing; --continuous renders them all
+bool				redraw_requested = true;			// something's changed since the last frame that the scene can't see for itself
+int					frames_run_while_polling = 0;
+double				prev_shader_load_time = 0.0;			// for polling the shader files, when we can't watch them
+file_watcher		shader_watcher;						// tells us when a shader file's been saved
+bool				watching_shaders = false;
+program_cache		shader_cache;						// linked programs from earlier runs, keyed on their source and the driver
+bool				use_shader_cache = true;			// turn off with --no-shader-cache, to time compiling from scratch
+std::list<pending_program>	pending_programs;			// oldest first; a list, so they stay put while they build
+GLuint				quad_vertex_buffer = 0;
+GLuint				vertex_buffer = 0;
+GLuint				index_buffer = 0;					// indices for each particle LOD's mesh, in vertex_buffer
+GLuint				quad_vertex_array = 0;				// the screen space quad, for the overlay
+GLuint				simulate_vertex_arrays[2] = {};		// each of feedback_particle_buffers as per-vertex input to the simulation
+upload_ring			frame_uploads = {};					// per-frame uniform and CPU-simulated particle data
+upload_strategy		frame_upload_strategy = upload_invalidate;	// timed at startup, unless --upload picks one
+bool				upload_strategy_chosen = false;
+GLint				uniform_buffer_alignment = 256;		// required alignment of uniform buffer offsets
+GLuint				feedback_particle_buffers[2] = {};	// ping-pong particle buffers for GPU simulation
+int					feedback_source_index = 0;			// which of those holds the current particle state
+GLuint				analytic_particle_buffer = 0;		// particles' creation state, for the analytic mode
+GLuint				compute_particle_buffer = 0;		// particle state for the compute simulation
+GLuint				compute_draw_buffer = 0;			// compacted list of visible particles, written by the GPU culling pass
+GLuint				compute_indirect_buffer = 0;		// indirect draw commands, one per LOD, with the visible particle counts filled in on the GPU
+GLuint				compute_emit_buffer = 0;			// this frame's runs of particles to emit, one per emitter
+GLuint				compute_sort_buffer = 0;			// sort keys and indices of the visible particles, when sorting on the GPU
+render_graph		frame_graph = {};					// the frame's passes, declared afresh every frame
+GLuint				raytrace_geometry_texture = 0;		// what the raytracer last hit in each of its pixels, for reshading
+GLuint				raytrace_geometry_framebuffer = 0;
+int					raytrace_geometry_width = 0;		// the framebuffer's size, which the scene only fills at full resolution
+int					raytrace_geometry_height = 0;
+bool				raytrace_geometry_complete = false;	// if not, every frame's traced afresh
+particle_bvh		raytrace_bvh = {};					// the particles as spheres, rebuilt every frame in raytrace mode
+GLuint				raytrace_bvh_buffers[2] = {};		// its nodes and spheres, uploaded for the raytracer
+GLuint				raytrace_bvh_textures[2] = {};		// and the texture buffers it reads them through
+GLuint				pulled_instance_textures[3] = {};	// texture buffers the particle shader fetches its instances through, when it does
+GLuint				point_light_buffers[3] = {};		// the point lights, their grid's cells, and the cells' lists, uploaded every frame
+GLuint				point_light_textures[3] = {};		// and the texture buffers the shaders read them through
+GLint				max_texture_buffer_texels = 0;
+GLuint				accumulation_textures[2] = {};		// the progressive raytracer's sums of samples, ping-ponged
+GLuint				accumulation_framebuffers[2] = {};
+int					accumulation_width = 0;				// the framebuffer's size
+int					accumulation_height = 0;
+bool				accumulation_framebuffers_complete = false;	// if not, the progressive scene's drawn like the raytraced one
+
+GLuint				upscale_shader_program = 0;
+GLuint				resolve_shader_program = 0;
+GLuint				shade_shader_program = 0;
+GLuint				composite_shader_program = 0;
+GLuint				overlay_shader_program = 0;
+GLuint				simulate_shader_program = 0;
+GLuint				emit_compute_program = 0;
+GLuint				simulate_compute_program = 0;
+GLuint				cull_compute_program = 0;
+GLuint				sort_compute_program = 0;
+GLuint				gather_compute_program = 0;
+GLuint				draw_commands_compute_program = 0;
+GLuint				occlusion_shader_program = 0;
+GLuint				transparency_shader_program = 0;
+
+// Every shader program, and the files it's built from. Each remembers all the files that went into
+// it last time it was loaded, includes and all, so a change only rebuilds the programs it affects.
+//
+// Programs with variant features are built in variants instead, each with its own set of the
+// features #defined, ahead of the source. A variant's key has a bit set for each feature it's built
+// with. They're built the first time they're asked for, with get_shader_variant(), and kept.
+struct shader_program
+{
+	GLuint*							program;			// unless it has variants
+	const char*						vertex_file;		// a vertex shader, and optionally a fragment shader;
+	const char*						fragment_file;
+	const char*						compute_file;		// or a compute shader, which needs GL 4.3
+	const char**					feedback_varyings;	// outputs captured by transform feedback
+	int								num_feedback_varyings;
+	const char* const*				variant_features;
+	int								num_variant_features;
+	std::map<uint32_t, GLuint>		variants;			// the ones built so far (0 if they didn't build), by key
+	std::vector<shader_dependency>	dependencies;
+};
+
+// The particle shaders' variant features. Everything else about how they draw is a uniform.
+enum particle_shader_feature
+{
+	particle_shader_packed_instances	= 1 << 0,		// the instances are in the compact format
+	particle_shader_analytic_motion		= 1 << 1,		// the instances are the particles at creation
+	particle_shader_pulled_instances	= 1 << 2,		// the shader fetches the instances itself, rather than from attributes
+	particle_shader_store_layout		= 1 << 3,		// and they're the CPU store's field arrays, drawn through a list of indices
+	particle_shader_weighted_transparency	= 1 << 4,	// they're translucent, accumulated into the weighted blended targets
+	particle_shader_multi_view			= 1 << 5,		// each instance is drawn once per view, into its part of the window
+};
+const char* const	particle_shader_features[] = { "PACKED_INSTANCES", "ANALYTIC_MOTION", "PULLED_INSTANCES", "STORE_LAYOUT", "WEIGHTED_TRANSPARENCY", "MULTI_VIEW" };
+
+// And the raytracer's
+enum raytrace_shader_feature
+{
+	raytrace_shader_ball_with_depth		= 1 << 0,		// the hybrid scene's ball, instead of the particles
+	raytrace_shader_progressive			= 1 << 1,		// adding samples to the accumulated ones
+	raytrace_shader_geometry_only		= 1 << 2,		// writing what was hit, for the shading pass to light
+};
+const char* const	raytrace_shader_features[] = { "BALL_WITH_DEPTH", "PROGRESSIVE", "GEOMETRY_ONLY" };
+
+// The GPU simulation has no fragment shader; its vertex shader outputs are captured into a buffer
+const char*			simulate_varyings[] = { "tf_position", "tf_velocity", "tf_angle_spin_size_creationtime" };
+
+shader_program		shader_programs[] =
+{
+	{ nullptr, "vertex_shader.glsl", "fragment_shader.glsl", nullptr, nullptr, 0, particle_shader_features, 6 },
+	{ nullptr, "vertex_shader_quad.glsl", "fragment_shader_raytrace.glsl", nullptr, nullptr, 0, raytrace_shader_features, 3 },
+	{ &upscale_shader_program, "vertex_shader_quad.glsl", "fragment_shader_upscale.glsl" },
+	{ &resolve_shader_program, "vertex_shader_quad.glsl", "fragment_shader_resolve.glsl" },
+	{ &shade_shader_program, "vertex_shader_quad.glsl", "fragment_shader_shade.glsl" },
+	{ &composite_shader_program, "vertex_shader_quad.glsl", "fragment_shader_composite.glsl" },
+	{ &occlusion_shader_program, "vertex_shader_quad.glsl", nullptr },
+	{ &transparency_shader_program, "vertex_shader_quad.glsl", "fragment_shader_transparency.glsl" },
+	{ &overlay_shader_program, "vertex_shader_overlay.glsl", "fragment_shader_overlay.glsl" },
+	{ &simulate_shader_program, "simulate_vertex_shader.glsl", nullptr, nullptr, simulate_varyings, 3 },
+	{ &emit_compute_program, nullptr, nullptr, "emit_compute_shader.glsl" },
+	{ &simulate_compute_program, nullptr, nullptr, "simulate_compute_shader.glsl" },
+	{ &cull_compute_program, nullptr, nullptr, "cull_compute_shader.glsl" },
+	{ &sort_compute_program, nullptr, nullptr, "sort_compute_shader.glsl" },
+	{ &gather_compute_program, nullptr, nullptr, "gather_compute_shader.glsl" },
+	{ &draw_commands_compute_program, nullptr, nullptr, "draw_commands_compute_shader.glsl" },
+};
+static const int num_shader_programs = int(sizeof(shader_programs) / sizeof(shader_programs[0]));
+shader_program&		particle_shaders = shader_programs[0];
+shader_program&		raytrace_shaders = shader_programs[1];
+
+// How the scene's drawn; R cycles through them
+enum render_mode
+{
+	render_mode_raster,		// the particles, rasterized
+	render_mode_raytrace,	// the particles, raytraced as spheres
+	render_mode_progressive,// raytraced, adding to the samples from earlier frames for as long as nothing moves
+	render_mode_hybrid,		// the particles, rasterized around a raytraced ball, which they're depth tested against
+	num_render_modes,
+};
+static const char* render_mode_names[num_render_modes] = { "rasterized", "raytraced", "progressive raytraced", "hybrid" };
+render_mode scene_render_mode = render_mode_raster;
+
+// The raytraced scene renders at a fraction of the window's resolution, which is adjusted every
+// frame to keep its pass within a GPU time budget (--raytrace-budget <ms>), then scaled up.
+static const float min_raytrace_scale = 0.25f;
+static const float max_raytrace_scale_step = 0.05f;	// the most the scale can change by in a frame, as a fraction
+float raytrace_budget_ms = 4.0f;					// 0 to always render at full resolution
+float raytrace_scale = 1.0f;						// of the window's width and height
+
+// The raytraced scene can be traced on the CPU instead (--cpu-raytrace), and is, under a software
+// GL such as llvmpipe, which would only run the raytrace shader on the CPU far more slowly. It's
+// uploaded into the scene's texture, and then scaled up the same. --cpu-raytrace-output <file>
+// saves the last frame it traced at exit, as a PPM, for runs with no one watching.
+bool				use_cpu_raytrace = false;
+const char*			cpu_raytrace_output = nullptr;
+cpu_raytrace_image	cpu_raytraced = {};
+float				cpu_raytrace_ms = 0.0f;			// how long the last frame's tracing took, for the budget
+
+// The rasterized particles can be drawn at a half or a quarter of the window's resolution, into a
+// transient texture, then composited over the scene. Big, overlapping particles are bound by the
+// pixels they fill, and half resolution has a quarter of them. --particle-resolution (or H) picks
+// one, or auto, which steps between them to keep the particles' pass within --particle-budget <ms>.
+enum particle_resolution_mode
+{
+	particle_resolution_full,
+	particle_resolution_half,
+	particle_resolution_quarter,
+	particle_resolution_auto,
+	num_particle_resolution_modes,
+};
+static const char* particle_resolution_names[num_particle_resolution_modes] = { "full", "half", "quarter", "auto" };
+static const int particle_resolution_divisors[num_particle_resolution_modes] = { 1, 2, 4, 0 };
+static const int max_particle_resolution_divisor = 4;
+particle_resolution_mode particle_resolution = particle_resolution_full;
+float particle_budget_ms = 4.0f;
+int particle_resolution_divisor = 1;				// what the particles are drawn at this frame
+int particle_resolution_held_frames = 0;			// since auto last changed it
+
+// The progressive scene is always at full resolution, and spends the budget on adding samples
+// instead, as many a frame as fit in it. Whenever the scene changes, it starts again. Pause the
+// simulation (with space) and the light (with L) to let it build up; once it has enough, it stops tracing altogether.
+static const int max_progressive_samples_per_frame = 64;
+static const int max_accumulated_samples = 1024;
+static const float progressive_light_radius = 0.1f;	// the light's disc, relative to its distance, for soft shadows
+int progressive_samples_per_frame = 1;
+int progressive_samples_in_flight[gpu_profiler_frames] = {};	// per GPU profiler frame, to go with their timings
+int accumulated_samples = 0;						// in accumulation_textures[accumulation_index]
+int accumulation_index = 0;
+uniform_data accumulation_uniforms = {};			// what the samples were traced with
+
+// The raytraced scene keeps what each pixel's ray hit in raytrace_geometry_texture, and while
+// nothing that decides that changes, it only relights it. With the simulation paused and the light
+// going round, that's a cheap pass a frame rather than a trace.
+struct raytrace_geometry_key
+{
+	float	window_size[2];
+	float	window_center[2];
+	float	time;					// the particles are where they were at the render time
+	int		width;					// the part of the texture it was traced into
+	int		height;
+	int		num_spheres;
+	GLuint	program;				// reloading the raytracer might change what it hits
+};
+raytrace_geometry_key raytrace_geometry_traced = {};
+bool raytrace_geometry_valid = false;				// whether raytrace_geometry_texture holds what that traced
+bool packed_instances = false;		// upload CPU-simulated particles in the compact format; set with --packed-instances or P
+
+// When the CPU simulation runs on the main thread, and the GPU can cull, the simulation writes each
+// block of particles straight into this frame's uploads as it finishes with it, rather than the
+// render reading them all again to pack them. Turn it off with --no-fused-upload.
+bool use_fused_upload = true;
+upload_allocation fused_particle_upload = {};	// the live window, in ring order, if the simulation wrote it this frame
+int fused_particle_count = 0;
+static const int fused_block_size = 1024;		// particles simulated and written out at a time, small enough to stay in the cache
+
+// Have the particle shader fetch its instances from texture buffers itself, rather than have them
+// fed in as vertex attributes. Then the CPU simulation's particles go up as the store's arrays are,
+// with the sorted list of which to draw, and nothing's interleaved on the CPU. Set with
+// --pull-instances or V.
+bool pull_instances = false;
+
+// Split the window into this many views of the same simulation, each with its own camera, and draw
+// the particles into all of them with the same draws: each instance is drawn once per view, and
+// the vertex shader puts each copy in its view, clipped to its edges, so nothing's uploaded or
+// culled more than once. Two go side by side, and three or four in a grid. Only the rasterized
+// scene is split; the others, and the Vulkan renderer, draw the one view. Set with --views.
+int num_views = 1;
+
+// Each view's framing: how much of the world it has across its shorter side, as the whole window
+// has world_size, and what it's centered on, both in world_size units
+static const float view_framings[max_views][3] =
+{
+	{ 1.0f, 0.0f, 0.4f },		// everything, as with one view
+	{ 0.3f, 0.0f, 0.07f },		// the fountain's source
+	{ 0.4f, 0.0f, 0.4f },		// around the ball
+	{ 0.45f, 0.0f, 0.73f },		// the top of the spray
+};
+texture_streamer textures;			// loads images in the background; anything drawn with one gets the placeholder until it's in
+static const int max_gl_workers = 2;		// contexts for making GL objects off the main thread
+static const size_t texture_upload_budget = 256 * 1024;		// bytes of texels to upload a frame, at most
+
+// What to keep the buffers and textures to, or 0 to go by what the driver says there is. Once a
+// frame, if they're over, the render graph's idle targets go first, then the sprites' textures,
+// which are only read once they're in their layers. Set in megabytes with --gpu-memory-budget.
+int64_t gpu_memory_budget_bytes = 0;
+gl_state_stats last_frame_gl_stats = {};	// how many binds the state tracker let through last frame, and dropped; print with B
+
+// Show the frame on every monitor, through a window on each of the others, with --all-monitors. They
+// all show the one simulation, rendered once; with the scene split into views, they get a view each.
+bool use_all_monitors = false;
+
+// Which API draws the frames; set with --renderer. Vulkan is only built in with WORKSHOP01_VULKAN,
+// and only draws the rasterized scene of particles simulated on the CPU.
+bool use_vulkan = false;
+
+// The passes timed on the GPU, and shown in the overlay (toggle with T)
+enum gpu_timer
+{
+	gpu_timer_frame,		// everything from the start of the frame to the swap
+	gpu_timer_simulate,		// the GPU simulation modes' passes
+	gpu_timer_clear,
+	gpu_timer_cull,			// culling, sorting and laying out the draws on the GPU
+	gpu_timer_particles,	// drawing the rasterized particles
+	gpu_timer_raytrace,		// the raytraced scene's fullscreen pass
+	gpu_timer_upscale,		// scaling the raytraced scene up to the window
+	gpu_timer_resolve,		// averaging the progressive raytracer's samples
+	gpu_timer_shade,		// lighting what the raytracer hit
+	gpu_timer_composite,	// laying the reduced-resolution particles over the scene
+	num_gpu_timers,
+};
+static const char* gpu_timer_names[num_gpu_timers] = { "frame", "simulate", "clear", "cull+sort", "particles", "raytrace", "upscale", "resolve", "shade", "composite" };
+gpu_profiler profiler = {};
+text_overlay overlay = {};
+bool show_gpu_timings = true;
+
+// Where C writes the CPU profiler's trace. Naming the file with --cpu-trace also writes it at exit.
+const char* cpu_trace_filename = "cpu_trace.json";
+bool write_cpu_trace_at_exit = false;
+
+// Where S saves the whole simulation (see simulation_file.h). Naming the file with --save-snapshot
+// also saves it at exit. Starting with --load-snapshot <file> carries on from one, so benchmarks
+// can start from a steady state rather than waiting for the particles to fill up.
+const char* snapshot_save_filename = "simulation.bin";
+bool save_snapshot_at_exit = false;
+const char* snapshot_load_filename = nullptr;
+
+// Recording a run with --record <file>, and playing it back with --replay <file> (see
+// frame_replay.h), so a regression run does exactly what the last one did: the same clock
+// readings, the same seed, the same keys on the same frames, and the same dynamic resolution.
+// Either way, the simulation stays on the main thread, where each frame's steps follow from its
+// own clock reading. Playing back, the keyboard's ignored, apart from Escape, and the window
+// closes after the last frame.
+frame_replay replay = {};
+const char* replay_record_filename = nullptr;
+const char* replay_play_filename = nullptr;
+const replay_frame* replayed_frame = nullptr;		// the frame being played back
+bool dispatching_replayed_keys = false;
+
+// Capturing every frame with --capture <file> (see frame_capture.h): raw, as PNGs, or as a video
+// through ffmpeg, by the file's extension. Frames are rendered continuously meanwhile, so the
+// capture keeps to the display's rate.
+const char* capture_filename = nullptr;
+
+// Benchmark mode (--benchmark <frames>): after a warmup, runs a fixed number of frames, taking
+// exactly one simulation step each, in a hidden window without vsync. Then it writes every frame's
+// timings to benchmark_output and quits.
+int benchmark_frames = 0;
+static const int benchmark_warmup_frames = 60;
+int benchmark_frames_run = 0;		// including the warmup
+const char* benchmark_output = "benchmark.json";
+double benchmark_start_time = 0.0;
+double benchmark_last_swap_time = 0.0;
+benchmark_recorder benchmark = {};
+int benchmark_frame_series = 0;
+int benchmark_simulate_series = 0;
+int benchmark_render_series = 0;
+int benchmark_swap_series = 0;
+int benchmark_gpu_series[num_gpu_timers] = {};
+std::atomic<float> last_simulate_frame_ms(0.0f);	// set by whichever thread runs simulate_frame()
+
+// What order to draw the particles in; set with --sort, or O
+particle_sort_order sort_order = particle_sort_none;
+particle_sort_buffers sort_buffers = {};
+static const char* sort_order_names[num_particle_sort_orders] = { "none", "age", "size" };
+
+// Weighted blended order-independent transparency (McGuire and Bavoil): the rasterized particles
+// are drawn translucent, summing their colors, weighted by how opaque they are, into one target,
+// and multiplying together how much of the scene each lets through into another. A resolve pass
+// lays the weighted average color over the scene by how much they cover. None of that depends on
+// the order they're drawn in, so they aren't sorted. I toggles it, or start with
+// --weighted-transparency. (The GL renderer only, where the targets can be float.)
+static const float transparent_particle_opacity = 0.5f;
+bool weighted_transparency = false;
+GLuint transparency_framebuffer = 0;				// with the frame's two targets attached
+GLuint transparency_attachments[2] = {};			// which textures those are, so they're only attached when they change
+
+// Where the particle simulation runs
+enum simulation_mode
+{
+	simulation_mode_cpu,					// integrate on the CPU, and upload every particle every frame
+	simulation_mode_transform_feedback,		// integrate in a vertex shader, ping-ponging between two GPU buffers
+	simulation_mode_compute,				// emit and integrate in compute shaders (GL 4.3+)
+	simulation_mode_analytic,				// don't integrate at all: the vertex shader evaluates each particle's path from its creation state
+	num_simulation_modes,
+};
+static const char* simulation_mode_names[num_simulation_modes] = { "cpu", "feedback", "compute", "analytic" };
+simulation_mode sim_mode = simulation_mode_cpu;
+simulation_mode requested_sim_mode = simulation_mode_compute;	// what to start in; compute falls back to the CPU if that's unusable
+bool sim_mode_chosen = false;										// whether --sim-mode asked for requested_sim_mode, or it's the default
+bool compute_simulation_supported = false;
+
+// The CPU simulation runs on its own thread, a frame ahead of the render, and hands each finished
+// frame over as a snapshot. While it's running, the particle store and sim_clock belong to it;
+// stop it before touching them from the main thread. Turn it off with --no-sim-thread.
+bool use_simulation_thread = true;
+std::thread simulation_thread;
+std::atomic<bool> simulation_thread_quitting(false);
+std::atomic<bool> simulation_paused(false);		// toggled with space; the scene stays as it is until it's unpaused
+
+// Particles can collide with each other, in the CPU simulation only; toggle it with K, or start with
+// --collisions. The grid belongs to whichever thread is simulating.
+std::atomic<bool> particle_collisions(false);
+particle_collision_grid collision_grid = {};
+
+// Static colliders, baked into a distance field at startup: the hybrid scene's ball, which holds
+// still while they're on, and a floor, unless --colliders reads others from a file. F turns them on
+// and off. The analytic simulation can't bounce anything, so it carries on without them.
+std::atomic<bool> colliders_enabled(false);
+std::vector<collider_shape> collider_shapes;
+collider_field colliders = {};
+GLuint collider_field_texture = 0;
+static const float collider_field_min[2] = { -48.0f, -24.0f };	// the field covers everywhere particles can get to before they die
+static const float collider_field_max[2] = { 48.0f, 48.0f };
+static const float collider_cell_size = 0.25f;
+
+// Turbulence: curl noise baked into a force field at startup, whose pattern drifts with the wind.
+// W turns it on and off, or start with --turbulence <strength>. The analytic simulation can't
+// follow it, so it carries on without.
+std::atomic<bool> turbulence_enabled(false);
+float turbulence_strength = 60.0f;								// the strongest push, in world units per second squared
+force_field turbulence = {};
+GLuint force_field_texture = 0;
+static const int force_field_size = 256;						// samples each way; the pattern repeats every 128 world units
+static const float force_field_cell_size = 0.5f;
+static const uint32_t force_field_seed = 0x7ab5e11u;			// the same every run, so replays and snapshots carry on the same
+static const float force_field_wind[2] = { 3.0f, 0.5f };		// how fast the pattern drifts, in world units per second
+
+// Simulation LOD: the CPU simulation steps blocks of particles that are far enough out of view
+// every 2nd, 4th or 8th frame instead, all their steps at once, which puts them exactly where
+// they'd have been (see simulation_lod.h). Only gravity can be moving them for that, so it's off
+// while collisions, colliders or turbulence are on. Turn it off with --no-sim-lod. The simulation
+// thread can't read the framebuffer's size, so it gets the view's size from here.
+bool use_simulation_lod = true;
+simulation_lod sim_lod = {};
+std::atomic<float> sim_view_size[2];		// the window's width and height, in world units
+
+// The light goes round on its own clock, which follows the wall clock rather than the simulation,
+// so it keeps moving while the simulation's paused. L stops it, for the progressive scene to settle.
+bool light_moving = true;
+double light_time = 0.0;
+double light_wall_time = 0.0;		// when light_time was last advanced
+bool light_clock_started = false;
+particle_snapshot_buffer particle_snapshots;
+
+// The simulation thread waits here once it's published a frame, until the render has picked it up
+std::mutex simulation_pace_lock;
+std::condition_variable simulation_pace;
+bool snapshot_taken = false;
+
+// One emitter's run of new particles, for the compute emission shader. This matches
+// struct emit_batch in emit_compute_shader.glsl.
+struct compute_emit_batch
+{
+	float position[2];
+	float velocity_min[2];
+	float velocity_max[2];
+	float spin_range[2];
+	float log2_size_range[2];
+	GLint first;		// index of the run's first particle within this frame's emission
+	GLint count;
+};
+std::vector<compute_emit_batch> compute_emit_batches;
+
+// The shapes particles are drawn as, all in vertex_buffer and index_buffer. The first is a star,
+// with a pentagon and a point for the smaller LODs, and unless there's a mix (--shapes, or --shape
+// <file.obj>), it's the only one. The GPU simulations don't keep track of shapes, so their
+// particles are always stars.
+particle_shape_library particle_shapes;
+static const int star_points = 5;
+bool mixed_shapes = false;
+std::vector<const char*> shape_files;		// .obj files to load shapes from, as well as the built-in ones
+
+// The sprites particles are textured with, a layer each of one texture array, so particles with
+// different sprites still draw together. Each particle picks one of them at random. Without any
+// (--sprite <image>, as many times as there are sprites), the array's one white layer, and the
+// particles are plain. Only the CPU simulation's particles keep track of which they have, and
+// only when they're fed in as vertex attributes; the rest all get the first.
+sprite_array particle_sprites;
+std::vector<const char*> sprite_files;
+static const int sprite_size = 128;		// texels across each layer
+GLuint particle_sprite_buffer = 0;		// where this frame's instances' sprites are, if they have them, as
+size_t particle_sprite_offset = 0;		// set_particle_sprite_attribute() takes them
+
+// Point lights, like sparks, at some of the CPU simulation's particles, lighting the particles and
+// the ball around them. They're binned into a grid over the view every frame, so each pixel only
+// shades with the few in its cell. Set how many there can be with --lights <count>; there are none
+// by default. The GPU simulations' particles aren't on the CPU to put lights at.
+light_clusters point_lights;
+int max_point_lights = 0;
+static const int max_point_lights_limit = 65536;
+static const float point_light_radius_scale = 4.0f;		// how far a light reaches, relative to its particle's size
+static const float point_light_color[3] = { 1.5f, 0.6f, 0.15f };
+static const float light_cell_pixels = 32.0f;			// how big the grid's cells are on screen
+
+// Stretch each particle back along its velocity into a streak, in the vertex shader, fading out
+// towards the tail. It's only the particle's velocity now, so it takes no history of where it's
+// been. Set with --trails or M.
+bool motion_trails = false;
+static const float motion_trail_steps = 3.0f;		// how long the trails are, in simulation steps of motion
+
+// Counts for capacity planning, totted up every frame (see perf_counters.h). They're written to a
+// CSV file with --counters <file>, and published in shared memory for a monitoring agent to read
+// with --counters-shm <name>. The particle counts are the CPU simulation's; the GPU simulations'
+// aren't read back.
+const char* counters_csv_filename = nullptr;
+const char* counters_shared_memory_name = nullptr;
+int particles_alive_counter = -1;		// the live window, which may have a few dead ones in it
+int particles_spawned_counter = -1;
+int particles_culled_counter = -1;		// of the live window, not drawn as they're out of view
+int draw_calls_counter = -1;
+int binds_issued_counter = -1;
+int binds_elided_counter = -1;			// dropped as redundant by the state tracker
+int frame_upload_bytes_counter = -1;	// through the upload ring
+int bvh_upload_bytes_counter = -1;
+int light_upload_bytes_counter = -1;
+int particles_left_behind_counter = -1;	// not stepped this frame, by the simulation LOD
+
+// How many world units across we should be able to see in the window, whichever way is narrower
+static const float world_size = 30.0f;
+
+// The hybrid scene's ball, which drifts from side to side across the fountain, at the height of the window's center
+static const float ball_radius = 4.0f;
+
+// Occlusion culling: in the hybrid scene, the emitters' bounds are depth tested against the ball
+// inside an occlusion query, once it's drawn, and the particles are drawn conditionally on it, so
+// when it's hiding every emitter, the GPU skips their draws by itself, without the CPU waiting to
+// find out. Particles don't know which emitter spawned them, so it's all of them or none. The bounds
+// only hold while gravity's all that's moving the particles, so it's off while collisions,
+// colliders or turbulence are on, and until every particle they moved has died. Beyond a handful of
+// emitters, the box around all of them is tested instead. Turn it off with --no-occlusion-culling.
+static const int max_occlusion_boxes = 64;
+bool use_occlusion_culling = true;
+GLuint emitter_occlusion_query = 0;
+double emitter_bounds_valid_time = 0.0;		// the simulation time from which every particle's inside its emitter's bounds
+
+// Particles need to be at least this many pixels in radius to see the points of the star,
+// and below this they might as well be a dot
+static const float lod_min_star_pixels = 6.0f;
+static const float lod_min_pentagon_pixels = 1.5f;
+
+// Where the particle shader's instances come from. Each has a vertex array object with the
+// particle mesh and that buffer's instances, pointed at its start, so drawing from it is just a
+// bind; draws that start partway through pass a base instance.
+enum particle_instance_source
+{
+	instances_from_upload,				// CPU simulated, in this frame's part of the upload ring
+	instances_from_upload_packed,		// the same, in the compact format
+	instances_from_feedback_0,			// feedback_particle_buffers, for the transform feedback simulation
+	instances_from_feedback_1,
+	instances_from_analytic,			// analytic_particle_buffer
+	instances_from_compute_draw,		// compute_draw_buffer, after culling on the GPU
+	instances_pulled,					// none; the shader fetches them from wherever they are (see bind_pulled_instances())
+	num_particle_instance_sources,
+};
+
+struct particle_vertex_array
+{
+	GLuint	vertex_array;
+	GLuint	instance_buffer;	// the buffer it was built for; when that changes, it needs rebuilding
+	bool	packed;				// instances are in the compact format
+	bool	pulled;				// there are no instance attributes
+};
+particle_vertex_array particle_vertex_arrays[num_particle_instance_sources] = {};
+
+// Layout of the command read by glDrawElementsIndirect
+struct draw_elements_indirect_command
 {
-	float position[2];		// current position of the particle's center in world space
-	float velocity[2];		// velocity vector
-	float angle;			// current rotation angle
-	float spin;				// how fast it's rotating
-	float size;				// particle size
-	float creation_time;	// when the particle was created
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLuint base_vertex;
+	GLuint base_instance;
 };
 
-// Definition of the "uniform" data that will be passed to the shaders...
-// basically global variables for shaders
-struct uniform_data
+// What the GPU culling fills in: a draw per LOD, and the counts they're built from. This matches
+// the layout the compute shaders use, which also has the atomic counters' offsets baked in.
+struct gpu_particle_draws
+{
+	draw_elements_indirect_command	draws[num_particle_lods];		// indexed by LOD
+	GLuint							lod_counts[num_particle_lods];	// how many particles to draw at each LOD
+	GLuint							lod_cursors[num_particle_lods];	// for writing each LOD's particles into the draw buffer
+	GLuint							total_count;					// all the particles to draw
+};
+
+// What render_frame() works out for the frame's passes, and what they hand on to each other
+struct frame_render_state
+{
+	const particle_store*	draw_particles;
+	const frame_clock*		draw_clock;
+	float					time;
+	float					pixels_to_world_scale;
+	uniform_data			uniforms;
+	cull_rect				visible;
+	particle_lod_sizes		lod_sizes;
+
+	// Where the particles' instances are; the upload pass fills these in for the CPU simulation
+	GLuint					instance_buffer;
+	int						first_instance;			// where this frame's instances start in the buffer
+	particle_range			draw_ranges[2];
+	int						num_draw_ranges;
+	int						bucket_counts[num_particle_draw_buckets];	// how many particles there are of each shape at each LOD
+	bool					fused;
+	bool					pulled;
+	bool					draw_packed_instances;
+	bool					store_layout;			// pulled from the store's arrays, through a list of indices
+	GLuint					pulled_index_buffer;
+	int						pulled_field_stride;
+	bool					cull_on_gpu;
+	bool					weighted_transparency;
+	particle_sort_order		sort_order;				// none when they're drawn with weighted transparency
+	int						num_views;				// each instance is drawn once per view
+
+	// The raytraced scene, and the part of it that's drawn at the current scale
+	bool					offscreen;				// if not, it's drawn straight to the window at full resolution
+	int						raytrace_width;
+	int						raytrace_height;
+
+	// The rasterized particles, and the size they're drawn at, if it's not the window's
+	int						particle_divisor;		// 1 if they're drawn straight into the window
+	int						particle_width;
+	int						particle_height;
+
+	// The emitters' bounds on screen, which the particles are only drawn if any of is in front of the ball
+	bool					occlusion_tested;
+	int						occlusion_rects[max_occlusion_boxes][4];	// x, y, width, height, as glScissor() takes them
+	int						num_occlusion_rects;
+
+	// The frame_graph resources the passes use
+	int						window;
+	int						uniform_buffer;
+	int						lights;
+	int						instances;
+	int						raytraced_scene;
+	int						reduced_particles;
+	int						transparency_accumulation;	// the weighted, premultiplied colors and their weights, summed
+	int						transparency_revealage;		// how much of the scene shows through the particles
+	int						emitter_visibility;		// the occlusion query's result
+};
+
+// Pre-declare functions we'll use later
+bool init_gl_context();
+void init_graphics();
+bool make_particle_shapes();
+void run_frame();
+bool start_replayed_frame();
+void take_frame_particles(const particle_store** o_particles, const frame_clock** o_clock);
+bool frame_wanted();
+void wait_for_frame_wanted();
+void wake_main_thread();
+void simulate_frame(bool fuse_upload = false);
+bool fused_upload_usable();
+double next_refresh_time(double time);
+void render_frame(const particle_store& draw_particles, const frame_clock& draw_clock);
+#if VULKAN_RENDERER
+bool init_vulkan_graphics();
+void run_vulkan_frame();
+bool render_vulkan_frame(const particle_store& draw_particles, const frame_clock& draw_clock);
+#endif
+void start_simulation_thread();
+void stop_simulation_thread();
+void begin_gpu_pass(gpu_timer timer);
+void end_gpu_pass(gpu_timer timer);
+void draw_gpu_timings_overlay(int framebuffer_width, int framebuffer_height);
+void add_raster_passes(frame_render_state* frame);
+void add_raytrace_passes(frame_render_state* frame);
+void upload_point_lights_pass(void* data);
+void upload_particles_pass(void* data);
+void build_bvh_pass(void* data);
+void clear_pass(void* data);
+void draw_raytraced_ball_pass(void* data);
+void cull_particles_pass(void* data);
+void test_emitter_occlusion_pass(void* data);
+void draw_particles_pass(void* data);
+void composite_particles_pass(void* data);
+void resolve_transparency_pass(void* data);
+void draw_overlay_pass(void* data);
+void accumulate_samples_pass(void* data);
+void resolve_samples_pass(void* data);
+void raytrace_scene_pass(void* data);
+void cpu_raytrace_scene_pass(void* data);
+void trace_geometry_pass(void* data);
+void shade_raytraced_scene_pass(void* data);
+void upscale_raytraced_scene_pass(void* data);
+void allocate_raytrace_geometry(int width, int height);
+void update_raytrace_scale();
+void update_particle_resolution();
+void upload_raytrace_bvh(const particle_store& draw_particles, const frame_clock& draw_clock, const cull_rect& visible);
+void upload_point_lights(const particle_store& draw_particles, const cull_rect& visible, float cell_size);
+void bind_point_lights(GLuint program);
+bool get_raytrace_scissor(const uniform_data& uniforms, const float box_min[3], const float box_max[3], int width, int height, int o_rect[4]);
+void get_raytrace_bvh_bounds(float o_min[3], float o_max[3]);
+void bind_raytrace_bvh(GLuint program);
+void draw_raytraced_ball(const uniform_data& uniforms, float time);
+int get_emitter_occlusion_rects(const uniform_data& uniforms, float margin, int o_rects[max_occlusion_boxes][4]);
+void make_default_colliders(std::vector<collider_shape>* o_shapes);
+void bind_collider_field(GLuint program);
+void get_force_field_offset(double time, float o_offset[2]);
+void bind_force_field(GLuint program, float timestep);
+void allocate_accumulation_targets(int width, int height);
+bool progressive_raytrace_usable();
+void save_cpu_trace();
+void save_snapshot();
+void start_benchmark();
+void record_benchmark_frame(double render_start_time, double render_end_time, double swap_end_time);
+bool finish_benchmark();
+void generate_particles(float timestep, int* out_first_spawned, int* out_num_spawned);
+void simulate_particles(float timestep, int num_steps, bool fuse_upload);
+void simulate_particles_on_gpu(float timestep, int num_steps);
+void simulate_particles_with_compute(float timestep, int num_steps, int first_spawned, int num_spawned);
+void simulate_particles_analytically();
+void cull_particles_on_gpu(GLuint particle_buffer, const particle_range* ranges, int num_ranges, const cull_rect& visible, const particle_lod_sizes& lod_sizes, float time, particle_sort_order order, int views);
+void sort_particles_on_gpu(int max_count);
+int gpu_sort_size(int max_count);
+bool gpu_culling_usable();
+bool compute_simulation_usable();
+void fetch_particles_from_gpu();
+void send_particles_to_gpu();
+void set_simulation_mode(simulation_mode mode);
+void allocate_particle_buffers();
+void build_vertex_arrays();
+void set_particle_capacity(int capacity);
+bool parse_command_line(int argc, const char** argv);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void set_simulation_view(int width, int height);
+void get_views(int width, int height, int count, view_data o_views[max_views]);
+void get_views_bounds(const view_data* views, int count, float o_min[2], float o_max[2]);
+int get_output_regions(int width, int height, output_region o_regions[max_views]);
+void window_refresh_callback(GLFWwindow* window);
+void APIENTRY debug_message_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* msg, const void* data);
+void load_all_shaders();
+void finish_pending_programs(bool wait);
+void load_shader_program(shader_program* program);
+GLuint get_shader_variant(shader_program* program, uint32_t key);
+void reload_shaders_using(const std::vector<std::string>& changed_files, bool all_changed);
+void reload_shaders_if_changed();
+
+
+
+// What can be got on with while the window and its context come up, on the workers, as none of it
+// needs GL. main() waits for it all once there's a context.
+enum startup_task
+{
+	startup_task_load_particles,	// the snapshot, if we're given one, and the rest of the simulation's storage
+	startup_task_bake_colliders,
+	startup_task_bake_turbulence,
+	startup_task_read_shaders,		// into memory, so compiling them doesn't wait on the disk
+	num_startup_tasks,
+};
+bool startup_task_succeeded[num_startup_tasks];
+std::atomic<int> startup_tasks_running(0);
+
+bool load_particles()
+{
+	// Carry on from a saved simulation, if we're given one, with its particles, emitters and all
+	if (snapshot_load_filename)
+	{
+		simulation_file_state state;
+		if (!load_simulation_file(snapshot_load_filename, &particles, &emitters, &state))
+			return false;
+		if (particles.capacity > max_num_particles)
+		{
+			printf("Error: %s has more than %d particles :(\n", snapshot_load_filename, max_num_particles);
+			return false;
+		}
+		num_particles = particles.capacity;
+		next_particle_index = state.next_particle_index % num_particles;
+		random_seed = state.random_seed;
+		spawn_counter = state.spawn_counter;
+		sim_clock.sim_time = state.sim_time;
+		emitter_bounds_valid_time = state.sim_time + max_particle_age;		// whatever moved its particles, they're gone by then
+
+		// It may have been saved with shapes we haven't got; those are drawn as the first
+		int num_shapes = int(particle_shapes.shapes.size());
+		for (int i = 0; i < num_particles; ++i)
+		{
+			if (particles.shape[i] >= num_shapes)
+				particles.shape[i] = 0;
+		}
+		for (int i = 0; i < emitters.count; ++i)
+		{
+			particle_emitter& emitter = emitters.emitters[i];
+			if (emitter.first_shape + std::max(emitter.num_shapes, 1) > num_shapes)
+			{
+				emitter.first_shape = 0;
+				emitter.num_shapes = 0;
+			}
+		}
+	}
+
+	// Allocate storage for the particle simulation (all but the store, if it came from a file)
+	if ((!particles.memory && !init_particle_store(&particles, num_particles)) || !resize_particle_sort_buffers(&sort_buffers, num_particles) ||
+		!init_particle_snapshot_buffer(&particle_snapshots, num_particles) || !init_simulation_lod(&sim_lod, num_particles))
+	{
+		printf("Error: couldn't allocate particle storage :(\n");
+		return false;
+	}
+	return true;
+}
+
+void run_startup_tasks(void*, int begin, int end)
+{
+	for (int task = begin; task < end; ++task)
+	{
+		bool succeeded = true;
+		if (task == startup_task_load_particles)
+		{
+			CPU_PROFILE_SCOPE("load particles");
+			succeeded = load_particles();
+		}
+		else if (task == startup_task_bake_colliders)
+		{
+			CPU_PROFILE_SCOPE("bake colliders");
+			if (collider_shapes.empty())
+				make_default_colliders(&collider_shapes);
+			succeeded = bake_collider_field(&colliders, collider_shapes.data(), int(collider_shapes.size()), collider_field_min, collider_field_max, collider_cell_size);
+		}
+		else if (task == startup_task_bake_turbulence)
+		{
+			CPU_PROFILE_SCOPE("bake turbulence");
+			succeeded = bake_curl_noise_field(&turbulence, force_field_size, force_field_cell_size, force_field_seed);
+		}
+		else if (task == startup_task_read_shaders && !use_vulkan)
+		{
+			CPU_PROFILE_SCOPE("read shaders");
+			for (const shader_program& program : shader_programs)
+			{
+				const char* files[3] = { program.vertex_file, program.fragment_file, program.compute_file };
+				for (const char* filename : files)
+				{
+					if (filename)
+						preload_shader_file(filename);
+				}
+			}
+		}
+		startup_task_succeeded[task] = succeeded;
+	}
+}
+
+// Everything starts here!
+int main (int argc, const char ** argv)
+{
+	std::chrono::steady_clock::time_point startup_begin = std::chrono::steady_clock::now();
+	bool first_frame_shown = false;
+	printf("Starting up!\n");
+	set_cpu_profiler_thread_name("main");
+
+	// The counters the modules don't register for themselves, in the order they go in the CSV
+	particles_alive_counter = register_perf_counter("particles alive", perf_counter_level);
+	particles_spawned_counter = register_perf_counter("particles spawned", perf_counter_per_frame);
+	particles_culled_counter = register_perf_counter("particles culled", perf_counter_per_frame);
+	draw_calls_counter = register_perf_counter("draw calls", perf_counter_per_frame);
+	binds_issued_counter = register_perf_counter("binds issued", perf_counter_level);
+	binds_elided_counter = register_perf_counter("binds elided", perf_counter_level);
+	frame_upload_bytes_counter = register_perf_counter("frame upload bytes", perf_counter_per_frame);
+	bvh_upload_bytes_counter = register_perf_counter("bvh upload bytes", perf_counter_per_frame);
+	light_upload_bytes_counter = register_perf_counter("light upload bytes", perf_counter_per_frame);
+	particles_left_behind_counter = register_perf_counter("particles left behind", perf_counter_per_frame);
+
+	if (!parse_command_line(argc, argv))
+		return -1;
+
+	// Work out which cores the threads go on before starting any, and put this one on its own
+	init_thread_config();
+	set_thread_role(thread_role_render, 0);
+
+	// Anything logged while rendering goes through here, so a flood of messages doesn't hold up frames
+	init_async_log();
+	if (replay_play_filename)
+	{
+		if (!load_replay(&replay, replay_play_filename))
+			return -1;
+		random_seed = replay.seed;
+		printf("Replaying %d frames from %s\n", int(replay.frames.size()), replay_play_filename);
+	}
+	else if (replay_record_filename)
+	{
+		if (!start_replay_recording(&replay, replay_record_filename, random_seed))
+		{
+			printf("Error: couldn't open %s to record to :(\n", replay_record_filename);
+			return -1;
+		}
+		printf("Recording to %s\n", replay_record_filename);
+	}
+	if ((replay.playing || replay.recording) && use_simulation_thread)
+	{
+		printf("Simulating on the main thread, so the replay matches\n");
+		use_simulation_thread = false;
+	}
+	if (counters_csv_filename && !open_perf_counter_csv(counters_csv_filename))
+	{
+		printf("Error: couldn't open %s to write the counters to :(\n", counters_csv_filename);
+		return -1;
+	}
+	if (counters_shared_memory_name && !open_perf_counter_shared_memory(counters_shared_memory_name))
+	{
+		printf("Error: couldn't make the shared memory %s for the counters :(\n", counters_shared_memory_name);
+		return -1;
+	}
+	printf("Simulating up to %d particles, emitting %g per second from %d emitter%s\n", num_particles, particles_per_second, num_emitters, (num_emitters == 1) ? "" : "s");
+
+	// Set up the particle emitters, spread across the bottom of the view
+	if (!init_emitter_set(&emitters, num_emitters))
+	{
+		printf("Error: couldn't allocate emitters :(\n");
+		return -1;
+	}
+	make_fountain_emitters(&emitters, -20.0f, 20.0f, particles_per_second);
+	if (!make_particle_shapes())
+	{
+		printf("Error: couldn't load the particle shapes :(\n");
+		return -1;
+	}
+
+	// Start up worker threads for the simulation. They're wanted from the start, to get on with
+	// everything that doesn't need a window while it comes up.
+	init_job_system(0);
+	printf("Running simulation on %d threads\n", job_thread_count());
+
+	// Pick the fastest simulation kernel this CPU can run
+	const char* simulate_kernel_name = nullptr;
+	simulate_kernel_fn = select_simulate_kernel(&simulate_kernel_name);
+	printf("Using %s simulation kernel\n", simulate_kernel_name);
+#if VERIFY_SIMULATION
+	printf("Verifying simulation kernel against the scalar reference every frame\n");
+#endif
+
+	// Read the snapshot, bake the fields and read the shaders on the workers, and decode the
+	// sprites on the texture streamer's threads, while the window and its context are made here
+	init_frame_clock(&sim_clock, simulation_rate, max_steps_per_frame);
+	job startup_jobs[num_startup_tasks];
+	for (int task = 0; task < num_startup_tasks; ++task)
+		startup_jobs[task] = job{ &run_startup_tasks, nullptr, task, task + 1, nullptr };
+	submit_jobs(startup_jobs, num_startup_tasks, &startup_tasks_running);
+	if (!use_vulkan)
+	{
+		init_texture_streamer(&textures, 2);
+		for (const char* filename : sprite_files)
+			request_texture(&textures, filename);
+	}
+
+	// Initialize the library
+	if (!glfwInit())
+	{
+		printf("Error: couldn't initialize GLFW :(\n");
+		wait_for_counter(&startup_tasks_running);
+		return -1;
+	}
+
+	// Debug builds want debugging support enabled. Release builds skip the driver's error checking
+	// altogether, where it supports that; it's ignored where it doesn't.
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, use_gl_debug_context);
+	glfwWindowHint(GLFW_CONTEXT_NO_ERROR, !use_gl_debug_context);
+
+	// Tell GLFW we want at least an OpenGL 4.1 core profile context
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+	// The hybrid scene depth tests the particles against what it raytraces
+	glfwWindowHint(GLFW_DEPTH_BITS, 24);
+
+	// Benchmarks run unattended, so keep the window out of the way
+	if (benchmark_frames > 0)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	// Vulkan draws to the window through a surface of its own, so it doesn't want a GL context
+	const char* window_title = "OpenGL Particle System";
+	if (use_vulkan)
+	{
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		window_title = "Vulkan Particle System";
+	}
+
+	// Create a windowed mode window and its OpenGL context
+	window = glfwCreateWindow(1280, 720, window_title, NULL, NULL);
+	if (!window && !use_gl_debug_context && !use_vulkan)
+	{
+		// Some drivers claim no-error contexts, then won't make one
+		glfwWindowHint(GLFW_CONTEXT_NO_ERROR, false);
+		window = glfwCreateWindow(1280, 720, window_title, NULL, NULL);
+	}
+	if (!window)
+	{
+		printf("Error: couldn't create window with GLFW :(\n");
+		wait_for_counter(&startup_tasks_running);
+		glfwTerminate();
+		return -1;
+	}
+
+	// Set up event-handling callbacks
+	glfwSetKeyCallback(window, &key_callback);
+	glfwSetFramebufferSizeCallback(window, &framebuffer_size_callback);
+	glfwSetWindowRefreshCallback(window, &window_refresh_callback);
+
+	// The framebuffer size is only queried this once; after that, the callback tells us when it changes.
+	// Note that framebuffer size may differ from "window size" due to DPI shenanigans.
+	glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+	set_simulation_view(framebuffer_width, framebuffer_height);
+
+	// Make the window's context current, and load the GL functions; then everything that was
+	// waiting on it can go ahead, once the startup tasks are done
+	bool have_context = use_vulkan || init_gl_context();
+	{
+		CPU_PROFILE_SCOPE("wait for startup tasks");
+		wait_for_counter(&startup_tasks_running);
+	}
+	if (!have_context || !startup_task_succeeded[startup_task_load_particles])
+	{
+		glfwTerminate();
+		return -1;
+	}
+	if (snapshot_load_filename)
+	{
+		printf("Carrying on from %s: %d particles in a ring of %d, from %d emitter%s, %.1f seconds in\n", snapshot_load_filename,
+			particles.live_count, num_particles, emitters.count, (emitters.count == 1) ? "" : "s", sim_clock.sim_time);
+	}
+	if (!startup_task_succeeded[startup_task_bake_colliders])
+	{
+		printf("Warning: couldn't allocate the collider field, so there are no colliders!\n");
+		colliders_enabled.store(false);
+	}
+	if (!startup_task_succeeded[startup_task_bake_turbulence])
+	{
+		printf("Warning: couldn't allocate the force field, so there's no turbulence!\n");
+		turbulence_enabled.store(false);
+	}
+	if (!use_simulation_thread)
+		printf("Simulating on the main thread, in between rendering\n");
+
+#if VULKAN_RENDERER
+	// Vulkan has its SPIR-V compiled into the build, and nothing else to make; it only draws the
+	// rasterized scene, of particles simulated on the CPU
+	if (use_vulkan && !init_vulkan_graphics())
+	{
+		printf("Error: couldn't start Vulkan :(\n");
+		glfwTerminate();
+		return -1;
+	}
+#endif
+
+	// Start up the GL workers, whose contexts build shaders and upload textures alongside the
+	// render. Each comes with a hidden window, so they have to be made here on the main thread.
+	if (!use_vulkan)
+	{
+		int num_gl_workers = init_gl_workers(window, max_gl_workers);
+		if (num_gl_workers > 0)
+			printf("Making GL objects on %d worker context%s\n", num_gl_workers, (num_gl_workers == 1) ? "" : "s");
+		else
+			printf("Warning: couldn't make any worker contexts, so making all GL objects on the main thread!\n");
+
+		// Initialize all our graphics resources such as buffers, shaders, etc
+		init_graphics();
+
+		// The frames are captured at the size the window came up at, and the capture's told they're
+		// at the display's rate
+		if (capture_filename)
+		{
+			double present, period;
+			int frame_rate = (glfwGetFrameTiming(window, &present, &period) && period > 0.0) ? int(1.0 / period + 0.5) : 60;
+			start_frame_capture(capture_filename, framebuffer_width, framebuffer_height, frame_rate);
+		}
+
+		// The other monitors' windows share the main context's objects, so only their frames are theirs
+		if (use_all_monitors)
+		{
+			int num_output_windows = init_output_windows(window);
+			printf("Showing the frame on %d more monitor%s\n", num_output_windows, (num_output_windows == 1) ? "" : "s");
+		}
+	}
+	else if (capture_filename)
+	{
+		printf("Warning: can't capture frames from Vulkan!\n");
+	}
+	if (use_vulkan && use_all_monitors)
+		printf("Warning: can't show Vulkan's frames on the other monitors!\n");
+
+	// Watch the shaders' directories (they can be in either, as read_shader_source() looks in both)
+	// on a background thread, so the render thread doesn't have to keep checking the files
+	static const char* shader_directories[] = { ".", ".." };
+	if (!live_shader_files || use_vulkan)
+	{
+		printf("Using the shaders embedded in the build\n");
+	}
+	else if (benchmark_frames == 0)
+	{
+		watching_shaders = init_file_watcher(&shader_watcher, shader_directories, 2, ".glsl", &wake_main_thread);
+		if (watching_shaders)
+			printf("Watching shader files for changes\n");
+		else
+			printf("Warning: no file change notifications, so polling shader files instead!\n");
+	}
+
+	// Simulate with compute shaders if we can, unless told otherwise; otherwise stay on the CPU
+	simulation_mode start_mode = requested_sim_mode;
+	if (use_vulkan && start_mode != simulation_mode_cpu)
+	{
+		if (sim_mode_chosen)
+			printf("Warning: Vulkan only draws particles simulated on the CPU, so simulating on the CPU!\n");
+		start_mode = simulation_mode_cpu;
+	}
+	if (start_mode == simulation_mode_compute && !compute_simulation_usable())
+	{
+		if (sim_mode_chosen)
+			printf("Warning: can't simulate with compute shaders here, so simulating on the CPU!\n");
+		start_mode = simulation_mode_cpu;
+	}
+	if (start_mode != simulation_mode_cpu)
+		set_simulation_mode(start_mode);
+	else
+		printf("Simulating particles on the CPU\n");
+
+	// Loop until the user closes the window, or the benchmark is done
+	start_simulation_thread();
+	if (benchmark_frames > 0)
+		start_benchmark();
+	while (!glfwWindowShouldClose(window))
+	{
+		// (The frame after the warmup only starts the benchmark's clock.)
+		if (benchmark_frames > 0 && benchmark_frames_run == benchmark_warmup_frames + 1 + benchmark_frames)
+			break;
+
+		// If a live resize already ran frames while we were polling, one has only just been shown.
+		// Rendering on demand, a frame's only run when there's something new to show.
+		if (frames_run_while_polling == 0 && (!render_on_demand || frame_wanted()))
+		{
+			redraw_requested = false;
+			run_frame();
+			if (!first_frame_shown)
+			{
+				printf("First frame shown %.0f ms after starting up\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup_begin).count());
+				first_frame_shown = true;
+			}
+		}
+
+		// Poll for and process events, or if the scene's gone still, sleep until something comes
+		// in that might change it. (On some platforms, a live resize doesn't return from here
+		// until it's over; window_refresh_callback() keeps the frames coming meanwhile.)
+		frames_run_while_polling = 0;
+		polling_events = true;
+		if (render_on_demand && !frame_wanted())
+		{
+			CPU_PROFILE_SCOPE("wait_for_frame_wanted");
+			wait_for_frame_wanted();
+		}
+		else
+		{
+			CPU_PROFILE_SCOPE("glfwPollEvents");
+			glfwPollEvents();
+		}
+		polling_events = false;
+	}
+
+	printf("Shutting down!\n");
+	stop_simulation_thread();
+	if (save_snapshot_at_exit)
+		save_snapshot();
+	free_sprite_array(&particle_sprites);
+	free_texture_streamer(&textures);
+	bool benchmark_written = (benchmark_frames == 0) || finish_benchmark();
+	if (cpu_raytrace_output)
+	{
+		if (!cpu_raytraced.pixels)
+			printf("Warning: nothing was raytraced on the CPU to write to %s!\n", cpu_raytrace_output);
+		else if (write_cpu_raytrace_image(cpu_raytraced, cpu_raytrace_output))
+			printf("Wrote the last CPU raytraced frame to %s\n", cpu_raytrace_output);
+		else
+			printf("Error: couldn't write the CPU raytraced frame to %s :(\n", cpu_raytrace_output);
+	}
+	shutdown_job_system();
+	if (write_cpu_trace_at_exit)
+		save_cpu_trace();
+	free_particle_store(&particles);
+	free_particle_snapshot_buffer(&particle_snapshots);
+	free_emitter_set(&emitters);
+	free_particle_sort_buffers(&sort_buffers);
+	free_particle_bvh(&raytrace_bvh);
+	free_cpu_raytrace_image(&cpu_raytraced);
+	free_particle_collision_grid(&collision_grid);
+	free_collider_field(&colliders);
+	free_force_field(&turbulence);
+	free_simulation_lod(&sim_lod);
+#if VULKAN_RENDERER
+	if (use_vulkan)
+		free_vulkan_renderer();
+#endif
+	if (!use_vulkan)
+	{
+		shutdown_output_windows();
+		stop_frame_capture();
+		free_upload_ring(&frame_uploads);
+		free_gpu_profiler(&profiler);
+		free_render_graph(&frame_graph);
+	}
+	free_file_watcher(&shader_watcher);
+	finish_pending_programs(true);
+	shutdown_shader_builder();
+	shutdown_gl_workers();
+	glfwTerminate();
+	free_frame_replay(&replay);
+	close_perf_counter_exports();
+	shutdown_async_log();
+	return benchmark_written ? 0 : -1;
+}
+
+// Make the window's context current, and get ready to use it. Not for Vulkan windows, which have none.
+bool init_gl_context()
+{
+	glfwMakeContextCurrent(window);
+
+	// Now that we have a context, look up the OpenGL functions we use, through GLFW, which already
+	// has the GL library open
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		printf("Error: couldn't load OpenGL functions :(\n");
+		return false;
+	}
+	printf("Got OpenGL version %d.%d\n", GLVersion.major, GLVersion.minor);
+
+	// A software renderer has no GPU behind it, so the raytracer's better off on the CPU itself
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	if (!use_cpu_raytrace && renderer && (strstr(renderer, "llvmpipe") || strstr(renderer, "softpipe") || strstr(renderer, "SWR")))
+	{
+		printf("Raytracing on the CPU, as OpenGL is %s\n", renderer);
+		use_cpu_raytrace = true;
+	}
+
+	// Benchmarks measure how fast we can go, not the display's refresh rate. Otherwise keep to
+	// it, but let a frame that's only just late tear rather than wait a whole extra refresh.
+	if (benchmark_frames > 0)
+		glfwSwapInterval(0);
+	else
+		glfwSwapInterval(-1);
+
+	// Compute shaders (and the SSBOs and atomic counters that go with them) arrived in GL 4.3
+	compute_simulation_supported =
+		(GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3)) &&
+		GLAD_GL_ARB_compute_shader && GLAD_GL_ARB_shader_storage_buffer_object &&
+		GLAD_GL_ARB_shader_atomic_counters && GLAD_GL_ARB_shader_image_load_store;
+	return true;
+}
+
+void init_graphics()
+{
+	// Configure OpenGL debug messages (assuming it's supported), in debug builds
+	init_gl_debug();
+	if (!use_gl_debug_context)
+	{
+		printf("Using a no-error OpenGL context; build in debug to get debug messages\n");
+	}
+	else if (GLAD_GL_KHR_debug)
+	{
+		glDebugMessageCallback(&debug_message_callback, nullptr);
+	}
+	else
+	{
+		printf("Warning: OpenGL debug messages not available!\n");
+	}
+
+	// Load the vertex and fragment shaders, skipping compiling any we've linked on an earlier run
+	if (use_shader_cache && !init_program_cache(&shader_cache, "shader_cache"))
+		printf("Warning: can't cache shader program binaries, so compiling them every time!\n");
+	// Hot reloads build the programs in the background, keeping the old ones until they're done;
+	// the first time, there's nothing to draw with until they're built, so wait for them
+	shader_build_mode build_mode = init_shader_builder(benchmark_frames == 0 && live_shader_files);
+	printf("Building shaders on %s\n", shader_build_mode_names[build_mode]);
+	load_all_shaders();
+	discard_preloaded_shader_files();
+	finish_pending_programs(true);
+
+	// Set up the timer queries for the render passes
+	init_gpu_profiler(&profiler, num_gpu_timers, gpu_timer_names);
+	init_render_graph(&frame_graph);
+	init_gpu_memory(gpu_memory_budget_bytes);
+
+	// Textures load in the background, with a couple of threads decoding them, which have been at
+	// it since before the window came up; now they can be uploaded
+	start_texture_uploads(&textures);
+
+	// The particles' sprites, which were asked for then, go into the sprite array as they arrive
+	if (!init_sprite_array(&particle_sprites, sprite_size))
+		printf("Warning: couldn't create the particle sprite array!\n");
+	int num_sprites = 0;
+	for (const char* filename : sprite_files)
+	{
+		if (add_sprite(&particle_sprites, &textures, filename) < 0)
+		{
+			printf("Warning: there are too many sprites to add %s!\n", filename);
+			break;
+		}
+		++num_sprites;
+	}
+	for (int i = 0; i < emitters.count; ++i)
+	{
+		emitters.emitters[i].first_sprite = 0;
+		emitters.emitters[i].num_sprites = num_sprites;
+	}
+
+	// Set up various buffers that we'll pass to the shaders running on the GPU.
+	// 1. The vertex buffer will define the shape of an individual particle.
+	// 2. The particle buffer defines the positions and other properties of the particles.
+	// 3. The uniform buffer is a set of global variables accessible to all particles' shaders.
+
+	// Generate two triangles that make up a screen-space quad
+	quad_vertex quad_vertices[6] = 
+	{
+		-1.0f, -1.0f,
+		1.0f, -1.0f,
+		-1.0f, 1.0f,
+		1.0f, -1.0f,
+		1.0f, 1.0f,
+		-1.0f, 1.0f,
+	};
+
+	// Upload these buffers to the GPU, where we'll re-use them each time we draw.
+	// The particle shapes all share one vertex buffer and one index buffer.
+	glGenBuffers(1, &vertex_buffer);
+	state_bind_buffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, particle_shapes.vertices.size() * sizeof(float), particle_shapes.vertices.data(), GL_STATIC_DRAW);
+	set_gpu_memory(gpu_memory_buffer, vertex_buffer, int64_t(particle_shapes.vertices.size() * sizeof(float)));
+	// (The index buffer's element array binding belongs to the vertex array objects, which
+	// build_vertex_arrays() sets up, so it's uploaded through the plain array buffer binding.)
+	glGenBuffers(1, &index_buffer);
+	state_bind_buffer(GL_ARRAY_BUFFER, index_buffer);
+	glBufferData(GL_ARRAY_BUFFER, particle_shapes.indices.size() * sizeof(uint16_t), particle_shapes.indices.data(), GL_STATIC_DRAW);
+	set_gpu_memory(gpu_memory_buffer, index_buffer, int64_t(particle_shapes.indices.size() * sizeof(uint16_t)));
+	label_gl_object(GL_BUFFER, vertex_buffer, "particle mesh vertices");
+	label_gl_object(GL_BUFFER, index_buffer, "particle mesh indices");
+
+	// The point LOD's size comes from the vertex shader
+	glEnable(GL_PROGRAM_POINT_SIZE);
+
+	// Screen space quad buffer
+	glGenBuffers(1, &quad_vertex_buffer);
+	state_bind_buffer(GL_ARRAY_BUFFER, quad_vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), quad_vertices, GL_STATIC_DRAW);
+	set_gpu_memory(gpu_memory_buffer, quad_vertex_buffer, int64_t(sizeof(quad_vertices)));
+	label_gl_object(GL_BUFFER, quad_vertex_buffer, "quad vertices");
+
+	// The raytracer reads the particles' BVH through texture buffers, since it's a fragment shader
+	// and there are no storage buffers in GL 4.1. The buffers' storage is replaced every frame.
+	static const char* raytrace_bvh_labels[2] = { "raytrace bvh nodes", "raytrace bvh spheres" };
+	glGenBuffers(2, raytrace_bvh_buffers);
+	glGenTextures(2, raytrace_bvh_textures);
+	for (int i = 0; i < 2; ++i)
+	{
+		state_bind_buffer(GL_TEXTURE_BUFFER, raytrace_bvh_buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(particle_bvh_node), nullptr, GL_STREAM_DRAW);
+		set_gpu_memory(gpu_memory_buffer, raytrace_bvh_buffers[i], int64_t(sizeof(particle_bvh_node)));
+		glBindTexture(GL_TEXTURE_BUFFER, raytrace_bvh_textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, raytrace_bvh_buffers[i]);
+		label_gl_object(GL_BUFFER, raytrace_bvh_buffers[i], raytrace_bvh_labels[i]);
+		label_gl_object(GL_TEXTURE, raytrace_bvh_textures[i], raytrace_bvh_labels[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	// The particle shader can read its instances through texture buffers too. They're pointed at
+	// whichever buffers have the instances each frame, which can be up to the whole upload ring.
+	static const char* pulled_instance_labels[3] = { "pulled particle instances", "pulled particle indices", "pulled particle draw commands" };
+	glGenTextures(3, pulled_instance_textures);
+	for (int i = 0; i < 3; ++i)
+	{
+		glBindTexture(GL_TEXTURE_BUFFER, pulled_instance_textures[i]);
+		label_gl_object(GL_TEXTURE, pulled_instance_textures[i], pulled_instance_labels[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texture_buffer_texels);
+
+	// The point lights go up the same way as the BVH, as texture buffers whose storage is replaced
+	// every frame
+	static const char* point_light_labels[3] = { "point lights", "point light cells", "point light indices" };
+	static const GLenum point_light_formats[3] = { GL_RGBA32F, GL_R32UI, GL_R32UI };
+	glGenBuffers(3, point_light_buffers);
+	glGenTextures(3, point_light_textures);
+	for (int i = 0; i < 3; ++i)
+	{
+		state_bind_buffer(GL_TEXTURE_BUFFER, point_light_buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(point_light), nullptr, GL_STREAM_DRAW);
+		set_gpu_memory(gpu_memory_buffer, point_light_buffers[i], int64_t(sizeof(point_light)));
+		glBindTexture(GL_TEXTURE_BUFFER, point_light_textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, point_light_formats[i], point_light_buffers[i]);
+		label_gl_object(GL_BUFFER, point_light_buffers[i], point_light_labels[i]);
+		label_gl_object(GL_TEXTURE, point_light_textures[i], point_light_labels[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	// The occlusion query the hybrid scene's particles are drawn conditionally on
+	glGenQueries(1, &emitter_occlusion_query);
+
+	// The colliders' distance field, for the GPU simulations. It never changes.
+	if (colliders.distances)
+	{
+		glGenTextures(1, &collider_field_texture);
+		glBindTexture(GL_TEXTURE_2D, collider_field_texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, colliders.width, colliders.height, 0, GL_RED, GL_FLOAT, colliders.distances);
+		set_gpu_memory(gpu_memory_texture, collider_field_texture, gpu_texture_bytes(GL_R32F, colliders.width, colliders.height, 1, false));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		label_gl_object(GL_TEXTURE, collider_field_texture, "collider field");
+	}
+
+	// And the turbulence's forces, which repeat, as the field does on the CPU
+	if (turbulence.forces)
+	{
+		glGenTextures(1, &force_field_texture);
+		glBindTexture(GL_TEXTURE_2D, force_field_texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, turbulence.width, turbulence.height, 0, GL_RG, GL_FLOAT, turbulence.forces);
+		set_gpu_memory(gpu_memory_texture, force_field_texture, gpu_texture_bytes(GL_RG32F, turbulence.width, turbulence.height, 1, false));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		label_gl_object(GL_TEXTURE, force_field_texture, "force field");
+	}
+
+	// Now create the particle buffers for simulating with transform feedback; they're sized by
+	// allocate_particle_buffers(), below.
+	glGenBuffers(2, feedback_particle_buffers);
+	glGenBuffers(1, &analytic_particle_buffer);
+
+	// The compute shaders' buffers: the particle state, the compacted list of visible particles to draw,
+	// the runs of particles to emit, the keys for sorting them, and the indirect draw commands that
+	// the culling fills in.
+	if (compute_simulation_supported)
+	{
+		glGenBuffers(1, &compute_particle_buffer);
+		glGenBuffers(1, &compute_draw_buffer);
+		glGenBuffers(1, &compute_emit_buffer);
+		glGenBuffers(1, &compute_sort_buffer);
+
+		glGenBuffers(1, &compute_indirect_buffer);
+		state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, compute_indirect_buffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(gpu_particle_draws), nullptr, GL_DYNAMIC_DRAW);
+		set_gpu_memory(gpu_memory_buffer, compute_indirect_buffer, int64_t(sizeof(gpu_particle_draws)));
+		label_gl_object(GL_BUFFER, compute_indirect_buffer, "particle draw commands");
+
+		// The emit buffer's storage is given it each frame, but it has to exist to be labeled
+		state_bind_buffer(GL_SHADER_STORAGE_BUFFER, compute_emit_buffer);
+		label_gl_object(GL_BUFFER, compute_emit_buffer, "particle emit batches");
+	}
+
+	// The uniform data and (when simulating on the CPU) particle data are written fresh every frame
+	// into the upload ring, which is also sized by allocate_particle_buffers().
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_buffer_alignment);
+
+	// Which way of uploading is fastest depends on the driver, so time them all, once per driver
+	if (upload_strategy_chosen && !upload_strategy_supported(frame_upload_strategy))
+	{
+		printf("Warning: the %s upload strategy isn't supported here!\n", upload_strategy_names[frame_upload_strategy]);
+		upload_strategy_chosen = false;
+	}
+	if (!upload_strategy_chosen)
+		frame_upload_strategy = select_upload_strategy((size_t(num_particles) + 1) * sizeof(particle_data), shader_cache.enabled ? shader_cache.directory.c_str() : nullptr);
+	printf("Using the %s upload strategy\n", upload_strategy_names[frame_upload_strategy]);
+
+	// This also builds the vertex array objects, since they refer to the buffers
+	allocate_particle_buffers();
+}
+
+// Build the shapes the particles can be drawn as, which every renderer draws them with, and point
+// the emitters at them. Returns false if a shape file couldn't be loaded.
+bool make_particle_shapes()
+{
+	add_star_shape(&particle_shapes, star_points);
+	if (mixed_shapes)
+	{
+		add_spark_shape(&particle_shapes);
+		add_debris_shape(&particle_shapes, random_seed);
+		add_debris_shape(&particle_shapes, random_seed + 1);
+		for (const char* filename : shape_files)
+		{
+			if (load_particle_shape(&particle_shapes, filename) < 0)
+				return false;
+		}
+	}
+
+	for (int i = 0; i < emitters.count; ++i)
+	{
+		emitters.emitters[i].first_shape = 0;
+		emitters.emitters[i].num_shapes = int(particle_shapes.shapes.size());
+	}
+	return true;
+}
+
+// The primitives a shape's LOD is made of
+GLenum particle_shape_mode(const particle_shape_lod& mesh)
+{
+	return mesh.points ? GL_POINTS : GL_TRIANGLES;
+}
+
+// Set up vertex attributes 1-3 to be loaded from a particle buffer by the GPU, starting at the given
+// byte offset. With a divisor of 1 each particle is an instance; with 0, each particle is a vertex.
+void set_particle_attributes(GLuint buffer, size_t offset, GLuint divisor)
+{
+	state_bind_buffer(GL_ARRAY_BUFFER, buffer);
+
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, false, sizeof(particle_data), (const void *)(offset + offsetof(particle_data, position)));
+	glVertexAttribDivisor(1, divisor);
+
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(particle_data), (const void *)(offset + offsetof(particle_data, velocity)));
+	glVertexAttribDivisor(2, divisor);
+
+	// Angle, spin, size, creation_time all packed into a single vec4 attribute, to save space
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 4, GL_FLOAT, false, sizeof(particle_data), (const void *)(offset + offsetof(particle_data, angle)));
+	glVertexAttribDivisor(3, divisor);
+
+	// Only the compact format uses this one
+	glDisableVertexAttribArray(4);
+}
+
+// The same for instances in the compact format. The shader gets the same values, give or take
+// some precision, except that it's the particle's age instead of its creation time.
+void set_packed_particle_attributes(GLuint buffer, size_t offset)
+{
+	state_bind_buffer(GL_ARRAY_BUFFER, buffer);
+
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_HALF_FLOAT, false, sizeof(packed_particle_data), (const void *)(offset + offsetof(packed_particle_data, position)));
+	glVertexAttribDivisor(1, 1);
+
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_HALF_FLOAT, false, sizeof(packed_particle_data), (const void *)(offset + offsetof(packed_particle_data, velocity)));
+	glVertexAttribDivisor(2, 1);
+
+	// Angle and spin are signed, size and age unsigned, so they need an attribute each
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 2, GL_SHORT, true, sizeof(packed_particle_data), (const void *)(offset + offsetof(packed_particle_data, angle)));
+	glVertexAttribDivisor(3, 1);
+
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 2, GL_UNSIGNED_SHORT, true, sizeof(packed_particle_data), (const void *)(offset + offsetof(packed_particle_data, size)));
+	glVertexAttribDivisor(4, 1);
+}
+
+// Point vertex attribute 5, the instances' sprites, at a byte per instance in the buffer, starting
+// where instance 0's would be. With no buffer, it's turned off, and they're all the first sprite.
+void set_particle_sprite_attribute(GLuint buffer, size_t offset)
+{
+	if (!buffer)
+	{
+		glDisableVertexAttribArray(5);
+		return;
+	}
+	state_bind_buffer(GL_ARRAY_BUFFER, buffer);
+	glEnableVertexAttribArray(5);
+	glVertexAttribPointer(5, 1, GL_UNSIGNED_BYTE, false, 1, (const void *)offset);
+	glVertexAttribDivisor(5, 1);
+}
+
+// Have the bound vertex array's instance attributes, 1-5, move on to the next instance once every
+// 'divisor' instances drawn, which is how each is drawn once per view. It's 1 otherwise.
+void set_particle_instance_divisor(GLuint divisor)
+{
+	for (GLuint attribute = 1; attribute <= 5; ++attribute)
+		glVertexAttribDivisor(attribute, divisor);
+}
+
+// Set up the vertex array objects for each pass, so drawing only has to bind one. They hold on to
+// the buffers they were built with, so this has to be called again whenever any of those are
+// replaced; reallocating a buffer's storage in place is fine.
+void build_vertex_arrays()
+{
+	// The overlay is a screen space quad. (The fullscreen passes bind this too, but make their
+	// triangle from the vertex IDs.)
+	if (!quad_vertex_array)
+		glGenVertexArrays(1, &quad_vertex_array);
+	state_bind_vertex_array(quad_vertex_array);
+	state_bind_buffer(GL_ARRAY_BUFFER, quad_vertex_buffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(quad_vertex), (const void *)offsetof(quad_vertex, screen_position));
+	label_gl_object(GL_VERTEX_ARRAY, quad_vertex_array, "quad");
+
+	// The particle shader's: the particle mesh, and each source's instances
+	static const char* vertex_array_labels[num_particle_instance_sources] =
+	{
+		"particles from upload",
+		"packed particles from upload",
+		"particles from feedback 0",
+		"particles from feedback 1",
+		"analytic particles",
+		"particles from compute",
+		"pulled particles",
+	};
+	GLuint instance_buffers[num_particle_instance_sources] =
+	{
+		frame_uploads.buffer,
+		frame_uploads.buffer,
+		feedback_particle_buffers[0],
+		feedback_particle_buffers[1],
+		analytic_particle_buffer,
+		compute_draw_buffer,
+		0,
+	};
+	for (int source = 0; source < num_particle_instance_sources; ++source)
+	{
+		particle_vertex_array& vertex_array = particle_vertex_arrays[source];
+		vertex_array.instance_buffer = instance_buffers[source];
+		vertex_array.packed = (source == instances_from_upload_packed);
+		vertex_array.pulled = (source == instances_pulled);
+		if (!vertex_array.instance_buffer && !vertex_array.pulled)
+			continue;
+
+		if (!vertex_array.vertex_array)
+			glGenVertexArrays(1, &vertex_array.vertex_array);
+		state_bind_vertex_array(vertex_array.vertex_array);
+		state_bind_buffer(GL_ARRAY_BUFFER, vertex_buffer);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(particle_vertex), (const void *)offsetof(particle_vertex, position));
+		state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+		if (vertex_array.packed)
+			set_packed_particle_attributes(vertex_array.instance_buffer, 0);
+		else if (!vertex_array.pulled)
+			set_particle_attributes(vertex_array.instance_buffer, 0, 1);
+		label_gl_object(GL_VERTEX_ARRAY, vertex_array.vertex_array, vertex_array_labels[source]);
+	}
+
+	// The transform feedback simulation reads each particle as a vertex, and doesn't use the mesh
+	for (int i = 0; i < 2; ++i)
+	{
+		if (!simulate_vertex_arrays[i])
+			glGenVertexArrays(1, &simulate_vertex_arrays[i]);
+		state_bind_vertex_array(simulate_vertex_arrays[i]);
+		set_particle_attributes(feedback_particle_buffers[i], 0, 0);
+		label_gl_object(GL_VERTEX_ARRAY, simulate_vertex_arrays[i], i ? "simulate from feedback 1" : "simulate from feedback 0");
+	}
+
+	state_bind_vertex_array(0);
+}
+
+// Draw count instances of the bound particle vertex array's instances as the given shape's mesh
+// at the given LOD, starting at first_instance, with the particle program that's in use, once for
+// each of 'views'. The shapes are all in the same buffers, so it's only a matter of where the draw
+// starts in them. Without GL_ARB_base_instance, a draw can't start partway through the instances,
+// so the instance attributes get pointed at the first one instead. When the shader pulls the
+// instances, it's told where they start.
+void draw_particle_instances(const particle_vertex_array& vertex_array, GLuint program, int shape, particle_lod lod, int first_instance, int count, int views)
+{
+	const particle_shape& shape_mesh = particle_shapes.shapes[shape];
+	const particle_shape_lod& mesh = shape_mesh.lods[lod];
+	GLenum mode = particle_shape_mode(mesh);
+	const void* indices = (const void *)(mesh.first_index * sizeof(GLushort));
+	if (vertex_array.pulled)
+	{
+		glUniform1i(glGetUniformLocation(program, "first_pulled_instance"), first_instance);
+		glDrawElementsInstancedBaseVertex(mode, mesh.num_indices, GL_UNSIGNED_SHORT, indices, count * views, shape_mesh.first_vertex);
+		add_perf_counter(draw_calls_counter, 1);
+		return;
+	}
+	if (GLAD_GL_ARB_base_instance)
+	{
+		glDrawElementsInstancedBaseVertexBaseInstance(mode, mesh.num_indices, GL_UNSIGNED_SHORT, indices, count * views, shape_mesh.first_vertex, GLuint(first_instance));
+		add_perf_counter(draw_calls_counter, 1);
+		return;
+	}
+
+	if (vertex_array.packed)
+		set_packed_particle_attributes(vertex_array.instance_buffer, first_instance * sizeof(packed_particle_data));
+	else
+		set_particle_attributes(vertex_array.instance_buffer, first_instance * sizeof(particle_data), 1);
+	if (particle_sprite_buffer)
+		set_particle_sprite_attribute(particle_sprite_buffer, particle_sprite_offset + size_t(first_instance));
+	if (views > 1)
+		set_particle_instance_divisor(GLuint(views));
+	glDrawElementsInstancedBaseVertex(mode, mesh.num_indices, GL_UNSIGNED_SHORT, indices, count * views, shape_mesh.first_vertex);
+	add_perf_counter(draw_calls_counter, 1);
+}
+
+// Can the particle shader fetch its instances itself? A texture buffer has to reach across the
+// whole upload ring, as single floats.
+bool pulled_instances_usable()
+{
+	size_t upload_texels = frame_uploads.frame_size * size_t(frame_uploads.num_frames) / sizeof(float);
+	return !use_vulkan && frame_uploads.buffer && upload_texels <= size_t(max_texture_buffer_texels);
+}
+
+// Point the particle shader (the current program) at where it's to fetch its instances from, on
+// texture units 4-6. The instances are particle_data in particle_buffer, or with store_layout, the
+// store's field arrays there, field_stride floats apart, drawn through the list in index_buffer
+// (which is otherwise 0).
+// Indirect draws from the GPU culling find their base instance in the draw commands.
+void bind_pulled_instances(GLuint program, GLuint particle_buffer, bool store_layout, GLuint index_buffer, int field_stride)
+{
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_BUFFER, pulled_instance_textures[0]);
+	glTexBuffer(GL_TEXTURE_BUFFER, store_layout ? GL_R32F : GL_RGBA32F, particle_buffer);
+	glActiveTexture(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_BUFFER, pulled_instance_textures[1]);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, index_buffer);
+	glActiveTexture(GL_TEXTURE6);
+	glBindTexture(GL_TEXTURE_BUFFER, pulled_instance_textures[2]);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, compute_indirect_buffer);
+	glActiveTexture(GL_TEXTURE0);
+
+	glUniform1i(glGetUniformLocation(program, "particle_instances"), 4);
+	glUniform1i(glGetUniformLocation(program, "particle_instance_indices"), 5);
+	glUniform1i(glGetUniformLocation(program, "particle_draw_commands"), 6);
+	glUniform1i(glGetUniformLocation(program, "first_pulled_instance"), 0);
+	glUniform1i(glGetUniformLocation(program, "pulled_draw_command"), -1);
+	glUniform1i(glGetUniformLocation(program, "pulled_field_stride"), field_stride);
+}
+
+// Simulate forward to the current time, render, and show the result
+void run_frame()
+{
+	// Playing back, the frame's keys go in first, as they did when it was recorded
+	if (replay.playing && !start_replayed_frame())
+		return;
+
+#if VULKAN_RENDERER
+	if (use_vulkan)
+	{
+		run_vulkan_frame();
+		return;
+	}
+#endif
+
+	begin_gpu_profiler_frame(&profiler);
+	begin_gpu_pass(gpu_timer_frame);
+
+	// The fused upload has the simulation write into this frame's uploads, so they have to be ready first
+	if (!begin_upload_frame(&frame_uploads))
+		log_message(log_warning, 0, "Warning: couldn't start this frame's uploads!");
+
+	const particle_store* draw_particles = nullptr;
+	const frame_clock* draw_clock = nullptr;
+	take_frame_particles(&draw_particles, &draw_clock);
+	set_perf_counter(particles_alive_counter, (sim_mode == simulation_mode_cpu) ? draw_particles->live_count : 0);
+
+	// Reload shaders as soon as they're saved, to allow live editing. Without a file watcher, check
+	// them for modifications every 0.5 second instead. Benchmarks leave them be, so the file system
+	// doesn't get into the timings, as do builds with the shaders embedded, which have no files.
+	if (watching_shaders)
+	{
+		std::vector<std::string> changed_files;
+		bool all_changed = false;
+		if (take_file_changes(&shader_watcher, &changed_files, &all_changed))
+		{
+			CPU_PROFILE_SCOPE("reload_shaders_using");
+			reload_shaders_using(changed_files, all_changed);
+		}
+	}
+	else if (benchmark_frames == 0 && live_shader_files && draw_clock->wall_time > prev_shader_load_time + 0.5)
+	{
+		CPU_PROFILE_SCOPE("reload_shaders_if_changed");
+		reload_shaders_if_changed();
+		prev_shader_load_time = draw_clock->wall_time;
+	}
+
+	// Switch to any reloaded programs that have finished building
+	finish_pending_programs(false);
+
+	// Render a new frame, unless the window's minimized and there's nothing to render to
+	double render_start_time = glfwGetTime();
+	if (framebuffer_width > 0 && framebuffer_height > 0)
+	{
+		render_frame(*draw_particles, *draw_clock);
+		capture_frame(framebuffer_width, framebuffer_height);
+		if (output_window_count() > 0)
+		{
+			output_region regions[max_views];
+			int num_regions = get_output_regions(framebuffer_width, framebuffer_height, regions);
+			present_output_windows(regions, num_regions);
+		}
+	}
+	else
+	{
+		// Nothing read the uploads, but the region still has to be handed back
+		end_upload_frame(&frame_uploads);
+		fence_upload_frame(&frame_uploads);
+	}
+	end_gpu_pass(gpu_timer_frame);
+	double render_end_time = glfwGetTime();
+
+	// Swap front and back buffers
+	{
+		CPU_PROFILE_SCOPE("glfwSwapBuffers");
+		glfwSwapBuffers(window);
+	}
+	last_frame_gl_stats = take_gl_state_stats();
+
+	set_perf_counter(binds_issued_counter, last_frame_gl_stats.issued);
+	set_perf_counter(binds_elided_counter, last_frame_gl_stats.elided);
+	add_perf_counter(frame_upload_bytes_counter, int64_t(frame_uploads.frame_used));
+	end_perf_counter_frame();
+	record_replay_frame(&replay, draw_clock->wall_time, raytrace_scale, particle_resolution_divisor, framebuffer_width, framebuffer_height);
+
+	if (benchmark_frames > 0)
+		record_benchmark_frame(render_start_time, render_end_time, glfwGetTime());
+
+	// Nothing the frame took from the arena outlives it
+	reset_frame_arena();
+}
+
+// Take the next frame to play back, and press its keys. Once they've all been played, this closes
+// the window instead, and returns false.
+bool start_replayed_frame()
+{
+	replayed_frame = next_replay_frame(&replay);
+	if (!replayed_frame)
+	{
+		printf("Finished the replay\n");
+		glfwSetWindowShouldClose(window, true);
+		return false;
+	}
+
+	dispatching_replayed_keys = true;
+	for (uint32_t i = 0; i < replayed_frame->num_key_events; ++i)
+	{
+		const replay_key_event& event = replay.key_events[replayed_frame->first_key_event + i];
+		key_callback(window, event.key, event.scancode, event.action, event.mods);
+	}
+	dispatching_replayed_keys = false;
+
+	// The window can't be made to resize in step, so just say when it's not the size it was
+	if (replayed_frame->framebuffer_width != framebuffer_width || replayed_frame->framebuffer_height != framebuffer_height)
+	{
+		log_message(log_warning, 0, "Warning: replaying at %dx%d, where it was recorded at %dx%d, so the timings won't compare!",
+			framebuffer_width, framebuffer_height, replayed_frame->framebuffer_width, replayed_frame->framebuffer_height);
+	}
+	return true;
+}
+
+// Either wait for this frame's simulation, or pick up the latest frame the simulation thread has
+// finished, and tell it to get on with the next one
+void take_frame_particles(const particle_store** o_particles, const frame_clock** o_clock)
+{
+	*o_particles = &particles;
+	*o_clock = &sim_clock;
+	fused_particle_upload = upload_allocation{};
+	fused_particle_count = 0;
+	if (simulation_thread.joinable())
+	{
+		bool new_snapshot = false;
+		const particle_snapshot* snapshot = acquire_particle_snapshot(&particle_snapshots, &new_snapshot);
+		*o_particles = &snapshot->particles;
+		*o_clock = &snapshot->clock;
+		if (new_snapshot)
+		{
+			{
+				std::lock_guard<std::mutex> guard(simulation_pace_lock);
+				snapshot_taken = true;
+			}
+			simulation_pace.notify_one();
+		}
+	}
+	else
+	{
+		simulate_frame(fused_upload_usable());
+	}
+}
+
+// Whether there's any reason to run a frame: the scene's moving, or something's changed that it
+// needs to catch up with. When there isn't, another frame would look exactly like the last one.
+bool frame_wanted()
+{
+	// Benchmarks time every frame, and a running simulation or moving light changes every frame.
+	// Replays play every frame that was recorded, one after another.
+	if (benchmark_frames > 0 || redraw_requested || replay.playing)
+		return true;
+	if (!simulation_paused.load(std::memory_order_relaxed) || light_moving)
+		return true;
+
+	// The progressive scene keeps adding samples until it has all it wants
+	if (scene_render_mode == render_mode_progressive && accumulation_framebuffers_complete && accumulated_samples < max_accumulated_samples)
+		return true;
+
+	// Saved shaders are picked up by the next frame, and rebuilt ones, and textures, over a few
+	if (shader_watcher.changed.load(std::memory_order_relaxed) || !pending_programs.empty())
+		return true;
+	if (textures.next_upload < int(textures.textures.size()))
+		return true;
+
+	// Without a file watcher, the shader files are checked for changes every so often
+	if (!watching_shaders && !use_vulkan && benchmark_frames == 0 && live_shader_files && glfwGetTime() > prev_shader_load_time + 0.5)
+		return true;
+
+	return false;
+}
+
+// Sleep until there are events, or another thread wakes us with wake_main_thread(), or it's time
+// to check the shader files if nothing's telling us when they change
+void wait_for_frame_wanted()
+{
+	if (!watching_shaders && !use_vulkan && live_shader_files)
+		glfwWaitEventsTimeout(std::max(prev_shader_load_time + 0.5 - glfwGetTime(), 0.0));
+	else
+		glfwWaitEvents();
+}
+
+// Wake the main thread out of wait_for_frame_wanted(), if it's in there. Safe from any thread.
+void wake_main_thread()
+{
+	glfwPostEmptyEvent();
+}
+
+// Generate new particles and simulate them forward to the current time
+void simulate_frame(bool fuse_upload)
+{
+	CPU_PROFILE_SCOPE("simulate_frame");
+
+	// Work out how many fixed steps to simulate this frame. This is the only place we read
+	// the wall clock; everything else in the frame takes its time from the frame clock.
+	// Benchmarks take exactly one step a frame instead, so every run does the same work;
+	// otherwise we simulate up to the refresh the frame will be shown at.
+	double start_time = glfwGetTime();
+	double cur_time = (benchmark_frames > 0) ? sim_clock.wall_time + sim_clock.step : next_refresh_time(start_time);
+	if (replayed_frame)
+		cur_time = replayed_frame->wall_time;
+	if (simulation_paused.load(std::memory_order_relaxed) && benchmark_frames == 0)
+		tick_paused_frame_clock(&sim_clock, cur_time);
+	else
+		tick_frame_clock(&sim_clock, cur_time);
+	float timestep = float(sim_clock.step);
+	int num_steps = sim_clock.num_steps;
+
+	// Generate new particles
+	int first_spawned = 0, num_spawned = 0;
+	generate_particles(timestep * num_steps, &first_spawned, &num_spawned);
+
+	// Simulate particles' forward in time using physics
+	if (sim_mode == simulation_mode_cpu)
+	{
+		catch_up_spawned_blocks(&sim_lod, &particles, simulate_kernel_fn, timestep, gravity, first_spawned, num_spawned);
+		simulate_particles(timestep, num_steps, fuse_upload);
+
+		// The render sends every particle to the GPU each frame, so none are left out of date
+		clear_dirty_particles(&particles);
+	}
+	else
+	{
+		// These only ever run on the main thread, so they can be timed on the GPU
+		begin_gpu_pass(gpu_timer_simulate);
+		if (sim_mode == simulation_mode_transform_feedback)
+			simulate_particles_on_gpu(timestep, num_steps);
+		else if (sim_mode == simulation_mode_compute)
+			simulate_particles_with_compute(timestep, num_steps, first_spawned, num_spawned);
+		else
+			simulate_particles_analytically();
+		end_gpu_pass(gpu_timer_simulate);
+	}
+
+	last_simulate_frame_ms.store(float((glfwGetTime() - start_time) * 1000.0), std::memory_order_relaxed);
+}
+
+// When the display next refreshes after the given time, which is the soonest a frame started then
+// can be shown. Simulating up to refreshes, rather than to whenever each frame happened to start,
+// moves things on by the same amount every refresh. Without presentation timing, it's just the time.
+double next_refresh_time(double time)
+{
+	// (Frame timing comes from the GL context, and Vulkan windows don't have one.)
+	double present, period;
+	if (use_vulkan || !glfwGetFrameTiming(window, &present, &period) || period <= 0.0)
+		return time;
+
+	// Never behind the last frame's, should the refresh times shift a little
+	double refresh = present + std::ceil((time - present) / period) * period;
+	return std::max(refresh, sim_clock.wall_time);
+}
+
+void simulation_thread_main()
+{
+	set_cpu_profiler_thread_name("simulation");
+	set_thread_role(thread_role_simulation, 0);
+	while (!simulation_thread_quitting.load())
+	{
+		// Simulate a frame, just as the main thread would without us, and hand it over
+		simulate_frame();
+		{
+			CPU_PROFILE_SCOPE("take_particle_snapshot");
+			take_particle_snapshot(back_particle_snapshot(&particle_snapshots), particles, sim_clock);
+		}
+		{
+			std::lock_guard<std::mutex> guard(simulation_pace_lock);
+			snapshot_taken = false;
+		}
+		publish_particle_snapshot(&particle_snapshots);
+		reset_frame_arena();
+
+		// Then wait for the render to pick it up, so we only ever run the one frame ahead of it.
+		// The next frame's simulation then overlaps with this one's render.
+		CPU_PROFILE_SCOPE("wait for render");
+		std::unique_lock<std::mutex> lock(simulation_pace_lock);
+		simulation_pace.wait(lock, [] { return snapshot_taken || simulation_thread_quitting.load(); });
+	}
+}
+
+// Move the CPU simulation onto its own thread, if that's what we're running and it's turned on
+void start_simulation_thread()
+{
+	if (!use_simulation_thread || sim_mode != simulation_mode_cpu || simulation_thread.joinable())
+		return;
+
+	// Publish the current state straight away, so the render doesn't show a stale snapshot
+	// left over from the last time the thread ran
+	take_particle_snapshot(back_particle_snapshot(&particle_snapshots), particles, sim_clock);
+	publish_particle_snapshot(&particle_snapshots);
+
+	simulation_thread_quitting.store(false);
+	simulation_thread = std::thread(&simulation_thread_main);
+}
+
+// Bring the simulation back onto the main thread, once it's finished the frame it's on
+void stop_simulation_thread()
+{
+	if (!simulation_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(simulation_pace_lock);
+		simulation_thread_quitting.store(true);
+	}
+	simulation_pace.notify_one();
+	simulation_thread.join();
+}
+
+void render_frame(const particle_store& draw_particles, const frame_clock& draw_clock)
+{
+	CPU_PROFILE_SCOPE("render_frame");
+
+	// Set the rendering viewport to match the current size of the framebuffer. However many
+	// resize events there were since the last frame, this only happens once.
+	if (framebuffer_size_changed)
+	{
+		glViewport(0, 0, framebuffer_width, framebuffer_height);
+		framebuffer_size_changed = false;
+	}
+
+	// Upload some more of any textures that have been decoded since last frame, and put any
+	// sprites that are in now into their layers
+	update_texture_streamer(&textures, texture_upload_budget);
+	update_sprite_array(&particle_sprites, &textures);
+
+	// Give back what we can if we're over the GPU memory budget, before this frame asks for more
+	int64_t over_budget = update_gpu_memory();
+	if (over_budget > 0)
+	{
+		int64_t evicted = trim_render_textures(&frame_graph, over_budget);
+		if (evicted < over_budget)
+			evicted += evict_streamed_textures(&textures, over_budget - evicted);
+		add_gpu_memory_evicted(evicted);
+
+		// What's left is all in use, so it's just said once, rather than every frame
+		static bool warned_over_budget = false;
+		if (evicted < over_budget && !warned_over_budget)
+		{
+			log_message(log_warning, 0, "Warning: using %lld MB more GPU memory than the budget, with nothing left to evict!", (long long)((over_budget - evicted) >> 20));
+			warned_over_budget = true;
+		}
+	}
+
+	// Get the time to render at. This is a little behind the simulation, in between its last two steps.
+	float time = float(frame_render_time(draw_clock));
+
+	// Calculate a moving light source
+	if (light_moving && light_clock_started)
+		light_time += draw_clock.wall_time - light_wall_time;
+	light_wall_time = draw_clock.wall_time;
+	light_clock_started = true;
+	float light_angle = float(light_time);
+	float light_dir[3] = { (float)cos(light_angle) * 0.7f, 0.5f, (float)sin(light_angle) * 0.7f };
+
+	// Calculate the uniform buffer parameters
+	float pixels_to_world_scale = world_size / float(std::min(framebuffer_width, framebuffer_height));
+	uniform_data uniforms =
+	{
+		pixels_to_world_scale * float(framebuffer_width),	// window_size.x
+		pixels_to_world_scale * float(framebuffer_height),	// window_size.y
+		0.0f, 0.4f * world_size,							// window_center
+		light_dir[0], light_dir[1], light_dir[2],			// light_dir
+		time,												// time
+	};
+
+	// The views the particles are drawn into: the one, the whole window's, unless it's split
+	view_data views[max_views];
+	int frame_views = (scene_render_mode == render_mode_raster) ? num_views : 1;
+	get_views(framebuffer_width, framebuffer_height, frame_views, views);
+
+	// The part of the world we can see in any of them, which particles are culled against. It's grown
+	// by how far a particle can move when the vertex shader interpolates it back from the last
+	// simulation step.
+	float cull_margin = float(draw_clock.step) * max_particle_speed;
+	cull_rect visible;
+	get_views_bounds(views, frame_views, visible.min, visible.max);
+	visible.min[0] -= cull_margin;
+	visible.min[1] -= cull_margin;
+	visible.max[0] += cull_margin;
+	visible.max[1] += cull_margin;
+
+	// Send this frame's uniform data to the GPU, by writing it into this frame's slice of
+	// the upload ring, which run_frame() started. The GPU may still be reading previous frames' slices.
+	if (!frame_uploads.frame_memory)
+		return;
+	upload_allocation uniform_upload = allocate_upload(&frame_uploads, sizeof(uniforms), size_t(uniform_buffer_alignment));
+	if (!uniform_upload.memory)
+	{
+		log_message(log_warning, 0, "Warning: ran out of upload buffer space!");
+		end_upload_frame(&frame_uploads);
+		fence_upload_frame(&frame_uploads);
+		return;
+	}
+	memcpy(uniform_upload.memory, &uniforms, sizeof(uniforms));
+
+	// Set up the uniform buffer to be loaded by the shaders
+	state_bind_buffer_range(GL_UNIFORM_BUFFER, 0, uniform_upload.buffer, GLintptr(uniform_upload.offset), sizeof(uniform_data));
+
+	// And the views, next to them, when there's more than one
+	if (frame_views > 1)
+	{
+		upload_allocation view_upload = allocate_upload(&frame_uploads, sizeof(views), size_t(uniform_buffer_alignment));
+		if (view_upload.memory)
+		{
+			memcpy(view_upload.memory, views, sizeof(views));
+			state_bind_buffer_range(GL_UNIFORM_BUFFER, 1, view_upload.buffer, GLintptr(view_upload.offset), sizeof(views));
+		}
+		else
+		{
+			frame_views = 1;
+		}
+	}
+
+	// Anything but gravity can move the particles out of their emitters' bounds, so they can't be
+	// trusted until every particle that's moved has died
+	if (particle_collisions.load(std::memory_order_relaxed) || colliders_enabled.load(std::memory_order_relaxed) || turbulence_enabled.load(std::memory_order_relaxed))
+		emitter_bounds_valid_time = draw_clock.sim_time + max_particle_age;
+
+	// What the passes work from
+	frame_render_state frame = {};
+	frame.draw_particles = &draw_particles;
+	frame.draw_clock = &draw_clock;
+	frame.time = time;
+	frame.pixels_to_world_scale = pixels_to_world_scale;
+	frame.uniforms = uniforms;
+	frame.visible = visible;
+
+	frame.num_views = frame_views;
+
+	// Each LOD gets drawn separately, so pick which particles to draw at which by how big they are on
+	// screen, in whichever view they're biggest in
+	float max_zoom = 1.0f;
+	for (int i = 0; i < frame_views; ++i)
+		max_zoom = std::max(max_zoom, views[i].zoom);
+	float lod_scale = pixels_to_world_scale / max_zoom;
+	particle_lod_sizes lod_sizes = { { lod_min_star_pixels * lod_scale, lod_min_pentagon_pixels * lod_scale } };
+	frame.lod_sizes = lod_sizes;
+
+	// Find the particles. When simulating on the GPU, they're already there, and the CPU simulation
+	// may have written them into the uploads itself; otherwise, they're uploaded by a pass.
+	// Either way, we only draw the part of the ring that has live particles in it.
+	frame.instance_buffer = feedback_particle_buffers[feedback_source_index];
+	if (sim_mode == simulation_mode_compute)
+		frame.instance_buffer = compute_particle_buffer;
+	else if (sim_mode == simulation_mode_analytic)
+		frame.instance_buffer = analytic_particle_buffer;
+	frame.num_draw_ranges = get_live_particle_ranges(draw_particles, frame.draw_ranges);
+	frame.fused = (sim_mode == simulation_mode_cpu && fused_particle_upload.memory);
+	frame.pulled = (pull_instances && pulled_instances_usable());
+	particle_sprite_buffer = 0;
+	if (frame.fused)
+	{
+		// The simulation already wrote out the live window, dead particles and all, and the GPU culls it
+		frame.instance_buffer = fused_particle_upload.buffer;
+		assert(fused_particle_upload.offset % sizeof(particle_data) == 0);
+		frame.draw_ranges[0] = particle_range{ int(fused_particle_upload.offset / sizeof(particle_data)), fused_particle_count };
+		frame.num_draw_ranges = 1;
+	}
+
+	// When the particles are on the GPU, cull them there too, if we can. The CPU doesn't know which
+	// of the compute simulation's particles are alive, so that has to cull the whole ring.
+	frame.cull_on_gpu = ((sim_mode != simulation_mode_cpu || frame.fused) && gpu_culling_usable());
+
+	// Rasterized particles drawn with weighted transparency come out the same in any order, so
+	// they're left unsorted
+	frame.weighted_transparency = (weighted_transparency && (scene_render_mode == render_mode_raster || scene_render_mode == render_mode_hybrid) &&
+		transparency_shader_program && render_format_renderable(&frame_graph, GL_RGBA16F) && render_format_renderable(&frame_graph, GL_R16F));
+	frame.sort_order = frame.weighted_transparency ? particle_sort_none : sort_order;
+	if (frame.cull_on_gpu && sim_mode == simulation_mode_compute)
+	{
+		frame.draw_ranges[0] = particle_range{ 0, num_particles };
+		frame.num_draw_ranges = 1;
+	}
+
+	// Put the frame together from its passes. Each says what it uses, and the graph only runs the
+	// ones whose results end up on the screen, or are kept for later frames, with barriers where
+	// they're needed. So the particles are only uploaded when they're rasterized, for instance.
+	begin_render_graph(&frame_graph);
+	frame.window = add_render_resource(&frame_graph, "window", render_resource_output);
+	frame.uniform_buffer = add_render_resource(&frame_graph, "uniforms", render_resource_in_upload_ring);
+	frame.lights = add_render_resource(&frame_graph, "point lights", 0);
+	frame.instances = add_render_resource(&frame_graph, "particle instances", (sim_mode == simulation_mode_cpu) ? render_resource_in_upload_ring : 0);
+
+	int pass = add_render_pass(&frame_graph, "upload point lights", &upload_point_lights_pass, &frame);
+	render_pass_writes(&frame_graph, pass, frame.lights, render_access_upload);
+	if (sim_mode == simulation_mode_cpu && !frame.fused)
+	{
+		pass = add_render_pass(&frame_graph, "upload particles", &upload_particles_pass, &frame);
+		render_pass_writes(&frame_graph, pass, frame.instances, render_access_upload);
+	}
+
+	pass = add_render_pass(&frame_graph, "clear", &clear_pass, &frame);
+	render_pass_writes(&frame_graph, pass, frame.window, render_access_render_target);
+
+	if (scene_render_mode == render_mode_raster || scene_render_mode == render_mode_hybrid)
+		add_raster_passes(&frame);
+	else
+		add_raytrace_passes(&frame);
+
+	if (show_gpu_timings)
+	{
+		pass = add_render_pass(&frame_graph, "gpu timings overlay", &draw_overlay_pass, &frame);
+		render_pass_writes(&frame_graph, pass, frame.window, render_access_render_target);
+	}
+
+	// This ends the frame's uploads, and fences them once everything that reads them is submitted
+	run_render_graph(&frame_graph, &frame_uploads);
+}
+
+// The rasterized scene's passes. In the hybrid one, the raytraced ball goes first, and the
+// particles are depth tested against it.
+void add_raster_passes(frame_render_state* frame)
+{
+	int pass;
+	if (scene_render_mode == render_mode_hybrid)
+	{
+		pass = add_render_pass(&frame_graph, "raytraced ball", &draw_raytraced_ball_pass, frame);
+		render_pass_reads(&frame_graph, pass, frame->uniform_buffer, render_access_uniform);
+		render_pass_reads(&frame_graph, pass, frame->lights, render_access_texture);
+		render_pass_writes(&frame_graph, pass, frame->window, render_access_render_target);
+	}
+
+	// Then the emitters' bounds are tested against it, while they hold. (The query's result is
+	// only read by the GPU, which needs no barrier, so it's said to be a render target.)
+	frame->occlusion_tested = (scene_render_mode == render_mode_hybrid && use_occlusion_culling && occlusion_shader_program &&
+		frame->draw_clock->sim_time >= emitter_bounds_valid_time);
+	if (frame->occlusion_tested)
+	{
+		float margin = float(frame->draw_clock->step) * max_particle_speed;
+		frame->num_occlusion_rects = get_emitter_occlusion_rects(frame->uniforms, margin, frame->occlusion_rects);
+		frame->emitter_visibility = add_render_resource(&frame_graph, "emitter visibility", 0);
+		pass = add_render_pass(&frame_graph, "emitter occlusion", &test_emitter_occlusion_pass, frame);
+		render_pass_reads(&frame_graph, pass, frame->window, render_access_render_target);
+		render_pass_writes(&frame_graph, pass, frame->emitter_visibility, render_access_render_target);
+	}
+
+	// Culling on the GPU writes the visible particles, and their draws, through storage, so they
+	// need a barrier before they're drawn from
+	int drawn = frame->instances;
+	if (frame->cull_on_gpu)
+	{
+		drawn = add_render_resource(&frame_graph, "visible particles", 0);
+		pass = add_render_pass(&frame_graph, "cull particles", &cull_particles_pass, frame);
+		render_pass_reads(&frame_graph, pass, frame->instances, render_access_storage);
+		render_pass_writes(&frame_graph, pass, drawn, render_access_storage);
+	}
+
+	// At a reduced resolution, the particles go into a transient texture of their own, which is
+	// then composited over the window. With weighted transparency, they always go into its two
+	// targets, at whatever resolution, and the resolve scales them up too.
+	update_particle_resolution();
+	frame->particle_divisor = 1;
+	if (particle_resolution_divisor > 1 && (frame->weighted_transparency || (render_format_renderable(&frame_graph, GL_RGBA8) && composite_shader_program)))
+		frame->particle_divisor = particle_resolution_divisor;
+	frame->particle_width = (framebuffer_width + frame->particle_divisor - 1) / frame->particle_divisor;
+	frame->particle_height = (framebuffer_height + frame->particle_divisor - 1) / frame->particle_divisor;
+	int particles_target = frame->window;
+	if (frame->weighted_transparency)
+	{
+		frame->transparency_accumulation = add_render_texture(&frame_graph, "transparency accumulation", frame->particle_width, frame->particle_height, GL_RGBA16F);
+		frame->transparency_revealage = add_render_texture(&frame_graph, "transparency revealage", frame->particle_width, frame->particle_height, GL_R16F);
+		particles_target = frame->transparency_accumulation;
+	}
+	else if (frame->particle_divisor > 1)
+	{
+		frame->reduced_particles = add_render_texture(&frame_graph, "reduced particles", frame->particle_width, frame->particle_height, GL_RGBA8);
+		particles_target = frame->reduced_particles;
+	}
+
+	pass = add_render_pass(&frame_graph, "particles", &draw_particles_pass, frame);
+	render_pass_reads(&frame_graph, pass, frame->uniform_buffer, render_access_uniform);
+	render_pass_reads(&frame_graph, pass, frame->lights, render_access_texture);
+	render_pass_reads(&frame_graph, pass, drawn, render_access_vertex | render_access_indirect | render_access_texture);
+	render_pass_writes(&frame_graph, pass, particles_target, render_access_render_target);
+	if (frame->weighted_transparency)
+		render_pass_writes(&frame_graph, pass, frame->transparency_revealage, render_access_render_target);
+	if (frame->occlusion_tested)
+		render_pass_reads(&frame_graph, pass, frame->emitter_visibility, render_access_render_target);
+
+	if (frame->weighted_transparency)
+	{
+		pass = add_render_pass(&frame_graph, "resolve transparency", &resolve_transparency_pass, frame);
+		render_pass_reads(&frame_graph, pass, frame->transparency_accumulation, render_access_texture);
+		render_pass_reads(&frame_graph, pass, frame->transparency_revealage, render_access_texture);
+		render_pass_writes(&frame_graph, pass, frame->window, render_access_render_target);
+	}
+	else if (frame->particle_divisor > 1)
+	{
+		pass = add_render_pass(&frame_graph, "composite particles", &composite_particles_pass, frame);
+		render_pass_reads(&frame_graph, pass, frame->reduced_particles, render_access_texture);
+		render_pass_writes(&frame_graph, pass, frame->window, render_access_render_target);
+	}
+}
+
+// The raytraced scenes' passes, which all trace through the BVH. The progressive one adds to
+// its sums, then shows their average. The other's drawn at the current scale into a transient
+// texture, then scaled up to fill the window. Offscreen, tracing is split from lighting: the rays'
+// hits go into raytrace_geometry_texture, and a shading pass lights them.
+void add_raytrace_passes(frame_render_state* frame)
+{
+	int bvh = add_render_resource(&frame_graph, "bvh", 0);
+	int pass = add_render_pass(&frame_graph, "build bvh", &build_bvh_pass, frame);
+	render_pass_writes(&frame_graph, pass, bvh, render_access_upload);
+
+	if (scene_render_mode == render_mode_progressive && progressive_raytrace_usable())
+	{
+		// The sums are kept for later frames
+		int accumulation = add_render_resource(&frame_graph, "accumulation", render_resource_output);
+		pass = add_render_pass(&frame_graph, "accumulate samples", &accumulate_samples_pass, frame);
+		render_pass_reads(&frame_graph, pass, frame->uniform_buffer, render_access_uniform);
+		render_pass_reads(&frame_graph, pass, frame->lights, render_access_texture);
+		render_pass_reads(&frame_graph, pass, bvh, render_access_texture);
+		render_pass_reads(&frame_graph, pass, accumulation, render_access_texture);
+		render_pass_writes(&frame_graph, pass, accumulation, render_access_render_target);
+
+		pass = add_render_pass(&frame_graph, "resolve samples", &resolve_samples_pass, frame);
+		render_pass_reads(&frame_graph, pass, accumulation, render_access_texture);
+		render_pass_writes(&frame_graph, pass, frame->window, render_access_render_target);
+		return;
+	}
+
+	allocate_raytrace_geometry(framebuffer_width, framebuffer_height);
+	update_raytrace_scale();
+	frame->offscreen = render_format_renderable(&frame_graph, GL_RGBA8) && upscale_shader_program;
+	frame->raytrace_width = framebuffer_width;
+	frame->raytrace_height = framebuffer_height;
+	int scene = frame->window;
+	if (frame->offscreen)
+	{
+		// The texture's the framebuffer's size, which the scene only fills at full resolution, so
+		// it's only changed when the window is
+		frame->raytrace_width = std::max(1, int(float(framebuffer_width) * raytrace_scale + 0.5f));
+		frame->raytrace_height = std::max(1, int(float(framebuffer_height) * raytrace_scale + 0.5f));
+		scene = add_render_texture(&frame_graph, "raytraced scene", framebuffer_width, framebuffer_height, GL_RGBA8);
+		frame->raytraced_scene = scene;
+	}
+
+	GLuint geometry_program = get_shader_variant(&raytrace_shaders, raytrace_shader_geometry_only);
+	if (frame->offscreen && use_cpu_raytrace)
+	{
+		// The BVH and the lights are read on the CPU, once they're built
+		pass = add_render_pass(&frame_graph, "cpu raytrace", &cpu_raytrace_scene_pass, frame);
+		render_pass_reads(&frame_graph, pass, frame->lights, render_access_texture);
+		render_pass_reads(&frame_graph, pass, bvh, render_access_texture);
+		render_pass_writes(&frame_graph, pass, scene, render_access_render_target);
+	}
+	else if (frame->offscreen && raytrace_geometry_complete && shade_shader_program && geometry_program)
+	{
+		// The hits are kept for later frames, which only relight them while they'd be the same
+		int geometry = add_render_resource(&frame_graph, "raytraced geometry", render_resource_output);
+		pass = add_render_pass(&frame_graph, "trace geometry", &trace_geometry_pass, frame);
+		render_pass_reads(&frame_graph, pass, frame->uniform_buffer, render_access_uniform);
+		render_pass_reads(&frame_graph, pass, bvh, render_access_texture);
+		render_pass_writes(&frame_graph, pass, geometry, render_access_render_target);
+
+		pass = add_render_pass(&frame_graph, "shade", &shade_raytraced_scene_pass, frame);
+		render_pass_reads(&frame_graph, pass, frame->uniform_buffer, render_access_uniform);
+		render_pass_reads(&frame_graph, pass, frame->lights, render_access_texture);
+		render_pass_reads(&frame_graph, pass, geometry, render_access_texture);
+		render_pass_writes(&frame_graph, pass, scene, render_access_render_target);
+	}
+	else
+	{
+		pass = add_render_pass(&frame_graph, "raytrace", &raytrace_scene_pass, frame);
+		render_pass_reads(&frame_graph, pass, frame->uniform_buffer, render_access_uniform);
+		render_pass_reads(&frame_graph, pass, frame->lights, render_access_texture);
+		render_pass_reads(&frame_graph, pass, bvh, render_access_texture);
+		render_pass_writes(&frame_graph, pass, scene, render_access_render_target);
+	}
+
+	if (frame->offscreen)
+	{
+		pass = add_render_pass(&frame_graph, "upscale", &upscale_raytraced_scene_pass, frame);
+		render_pass_reads(&frame_graph, pass, scene, render_access_texture);
+		render_pass_writes(&frame_graph, pass, frame->window, render_access_render_target);
+	}
+}
+
+// The render graph's passes. Each is given the frame_render_state, and starts and ends with the
+// window as the framebuffer, at its size.
+
+void upload_point_lights_pass(void* data)
+{
+	// Bin the point lights into cells of the view, for every pass that shades with them
+	frame_render_state* frame = (frame_render_state*)data;
+	upload_point_lights(*frame->draw_particles, frame->visible, light_cell_pixels * frame->pixels_to_world_scale);
+}
+
+// Send the CPU simulation's particles to the GPU. They're stored as separate arrays per field
+// on the CPU, so they're either pulled from copies of those arrays, or interleaved into the
+// instance layout as they're written.
+void upload_particles_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	const particle_store& draw_particles = *frame->draw_particles;
+	int sort_key_bits = mixed_shapes ? particle_shape_sort_key_bits : particle_sort_key_bits;
+	if (frame->pulled && sort_buffers.capacity >= num_particles)
+	{
+		// Copy the live window up as the store has it, an array per field, and then the sorted list of
+		// the live, visible particles in it. The shader looks each instance up through the list, so
+		// the particles are never interleaved or gathered on the CPU.
+		CPU_PROFILE_SCOPE("upload particles");
+		int window_count = 0;
+		for (int i = 0; i < frame->num_draw_ranges; ++i)
+			window_count += frame->draw_ranges[i].count;
+		upload_allocation field_upload = allocate_upload(&frame_uploads, size_t(window_count) * num_particle_fields * sizeof(float), sizeof(float));
+		int num_sorted = 0;
+		if (field_upload.memory)
+		{
+			CPU_PROFILE_SCOPE("sort particles");
+			for (int i = 0; i < frame->num_draw_ranges; ++i)
+				num_sorted += gather_particle_sort_items(draw_particles, frame->draw_ranges[i].first, frame->draw_ranges[i].count, frame->visible, frame->sort_order, frame->lod_sizes, frame->time, max_particle_age, sort_buffers.items + num_sorted, frame->bucket_counts);
+			sort_particle_items(&sort_buffers, num_sorted, sort_key_bits);
+			add_perf_counter(particles_culled_counter, window_count - num_sorted);
+		}
+		upload_allocation index_upload = allocate_upload(&frame_uploads, size_t(num_sorted) * sizeof(uint32_t), sizeof(uint32_t));
+		if (field_upload.memory && index_upload.memory)
+		{
+			int window_first = 0;
+			for (int i = 0; i < frame->num_draw_ranges; ++i)
+			{
+				copy_particle_fields(draw_particles, frame->draw_ranges[i].first, frame->draw_ranges[i].count, size_t(window_count), (float*)field_upload.memory + window_first);
+				window_first += frame->draw_ranges[i].count;
+			}
+
+			// The indices are into the store, so they become texels in the upload buffer. When the
+			// ring wraps, the second range is the one before the first.
+			uint32_t range_first[2] = { uint32_t(frame->draw_ranges[0].first), uint32_t(frame->draw_ranges[frame->num_draw_ranges - 1].first) };
+			uint32_t range_texel[2] = { uint32_t(field_upload.offset / sizeof(float)), uint32_t(field_upload.offset / sizeof(float)) + uint32_t(frame->draw_ranges[0].count) };
+			uint32_t* indices = (uint32_t*)index_upload.memory;
+			for (int i = 0; i < num_sorted; ++i)
+			{
+				uint32_t index = sort_buffers.indices[i];
+				int range = (index < range_first[0]) ? 1 : 0;
+				indices[i] = range_texel[range] + index - range_first[range];
+			}
+
+			frame->store_layout = true;
+			frame->instance_buffer = field_upload.buffer;
+			frame->pulled_index_buffer = index_upload.buffer;
+			frame->pulled_field_stride = window_count;
+			frame->first_instance = int(index_upload.offset / sizeof(uint32_t));
+		}
+		else
+		{
+			frame->instance_buffer = 0;
+		}
+		frame->draw_ranges[0] = particle_range{ 0, num_sorted };
+		frame->num_draw_ranges = 1;
+		return;
+	}
+
+	// Pack just the live, visible particles, back to back, so they can be drawn in one go per LOD
+	CPU_PROFILE_SCOPE("upload particles");
+	frame->draw_packed_instances = packed_instances && !frame->pulled;
+	size_t instance_size = frame->draw_packed_instances ? sizeof(packed_particle_data) : sizeof(particle_data);
+	upload_allocation particle_upload = allocate_upload(&frame_uploads, draw_particles.live_count * instance_size, instance_size);
+	int num_packed = 0;
+	if (particle_upload.memory && sort_buffers.capacity >= num_particles)
+	{
+		// Sort them into their shapes and LODs first (and into sort_order within each), then pack
+		// them in that order. The particles themselves stay put in the store; only the list of which ones to
+		// pack gets shuffled.
+		{
+			CPU_PROFILE_SCOPE("sort particles");
+			for (int i = 0; i < frame->num_draw_ranges; ++i)
+				num_packed += gather_particle_sort_items(draw_particles, frame->draw_ranges[i].first, frame->draw_ranges[i].count, frame->visible, frame->sort_order, frame->lod_sizes, frame->time, max_particle_age, sort_buffers.items + num_packed, frame->bucket_counts);
+			sort_particle_items(&sort_buffers, num_packed, sort_key_bits);
+		}
+		if (frame->draw_packed_instances)
+			pack_indexed_particle_instances_compact(draw_particles, sort_buffers.indices, num_packed, frame->time, (packed_particle_data*)particle_upload.memory);
+		else
+			pack_indexed_particle_instances(draw_particles, sort_buffers.indices, num_packed, (particle_data*)particle_upload.memory);
+
+		// Their sprites go up after them. The attribute's pointed back from where they start
+		// by the first instance, so the draws' base instances count from it too. (The instances
+		// come first, so that's never before the start of the buffer.)
+		upload_allocation sprite_upload = {};
+		if (!particle_sprites.sprites.empty())
+			sprite_upload = allocate_upload(&frame_uploads, size_t(num_packed), 1);
+		if (sprite_upload.memory)
+		{
+			pack_indexed_particle_sprites(draw_particles, sort_buffers.indices, num_packed, (uint8_t*)sprite_upload.memory);
+			particle_sprite_buffer = sprite_upload.buffer;
+			assert(particle_upload.offset % instance_size == 0);
+			particle_sprite_offset = sprite_upload.offset - particle_upload.offset / instance_size;
+		}
+	}
+	else if (particle_upload.memory)
+	{
+		// Without space to sort them, they all get drawn as stars, in ring order
+		for (int i = 0; i < frame->num_draw_ranges; ++i)
+		{
+			if (frame->draw_packed_instances)
+				num_packed += pack_live_particle_instances_compact(draw_particles, frame->draw_ranges[i].first, frame->draw_ranges[i].count, frame->visible, frame->time, (packed_particle_data*)particle_upload.memory + num_packed);
+			else
+				num_packed += pack_live_particle_instances(draw_particles, frame->draw_ranges[i].first, frame->draw_ranges[i].count, frame->visible, (particle_data*)particle_upload.memory + num_packed);
+		}
+		frame->bucket_counts[particle_draw_bucket(0, particle_lod_star)] = num_packed;
+	}
+	add_perf_counter(particles_culled_counter, draw_particles.live_count - num_packed);
+	frame->draw_ranges[0] = particle_range{ 0, num_packed };
+	frame->num_draw_ranges = 1;
+
+	// The allocation's offset in the buffer is aligned to the instance size, so it starts on a
+	// whole instance, whatever was allocated before it
+	frame->instance_buffer = particle_upload.buffer;
+	assert(particle_upload.offset % instance_size == 0);
+	frame->first_instance = int(particle_upload.offset / instance_size);
+}
+
+void build_bvh_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	upload_raytrace_bvh(*frame->draw_particles, *frame->draw_clock, frame->visible);
+}
+
+// Render a nice sky blue background. Only the hybrid scene uses the depth buffer, but clearing
+// it is all but free, where leaving it would make the GPU keep its old contents.
+void clear_pass(void* data)
+{
+	begin_gpu_pass(gpu_timer_clear);
+	glClearColor(0.0f, 0.6f, 1.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	end_gpu_pass(gpu_timer_clear);
+}
+
+void draw_raytraced_ball_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	draw_raytraced_ball(frame->uniforms, frame->time);
+}
+
+void cull_particles_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	begin_gpu_pass(gpu_timer_cull);
+	cull_particles_on_gpu(frame->instance_buffer, frame->draw_ranges, frame->num_draw_ranges, frame->visible, frame->lod_sizes, frame->time, frame->sort_order, frame->num_views);
+	end_gpu_pass(gpu_timer_cull);
+}
+
+// Draw the emitters' bounds at the particles' depth, behind the ball's, counting whether any of
+// their pixels pass the depth test, without drawing anything
+void test_emitter_occlusion_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	state_bind_vertex_array(quad_vertex_array);
+	state_use_program(occlusion_shader_program);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glEnable(GL_SCISSOR_TEST);
+	glBeginQuery(GL_ANY_SAMPLES_PASSED, emitter_occlusion_query);
+	for (int i = 0; i < frame->num_occlusion_rects; ++i)
+	{
+		const int* rect = frame->occlusion_rects[i];
+		glScissor(rect[0], rect[1], rect[2], rect[3]);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		add_perf_counter(draw_calls_counter, 1);
+	}
+	glEndQuery(GL_ANY_SAMPLES_PASSED);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+// Draw the rasterized particles. In the hybrid scene, they're depth tested against the ball
+// without writing any depth themselves, so they still draw in their sorted order. Their fragment
+// shader doesn't touch depth, so the ones behind the ball are rejected before they're shaded.
+// The particles' pass draws into their own texture when they're at a reduced resolution, which
+// starts out empty every frame, or into the weighted transparency's targets, which start out with
+// nothing summed, and all of the scene showing through
+void begin_reduced_particles(const frame_render_state& frame)
+{
+	if (frame.weighted_transparency)
+	{
+		if (!transparency_framebuffer)
+		{
+			glGenFramebuffers(1, &transparency_framebuffer);
+			glBindFramebuffer(GL_FRAMEBUFFER, transparency_framebuffer);
+			static const GLenum draw_buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+			glDrawBuffers(2, draw_buffers);
+			label_gl_object(GL_FRAMEBUFFER, transparency_framebuffer, "weighted transparency");
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, transparency_framebuffer);
+		GLuint targets[2] = { get_render_texture(frame_graph, frame.transparency_accumulation), get_render_texture(frame_graph, frame.transparency_revealage) };
+		for (int i = 0; i < 2; ++i)
+		{
+			if (targets[i] != transparency_attachments[i])
+			{
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, targets[i], 0);
+				transparency_attachments[i] = targets[i];
+			}
+		}
+		glViewport(0, 0, frame.particle_width, frame.particle_height);
+		static const GLfloat nothing_summed[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		static const GLfloat all_revealed[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glClearBufferfv(GL_COLOR, 0, nothing_summed);
+		glClearBufferfv(GL_COLOR, 1, all_revealed);
+		return;
+	}
+	if (frame.particle_divisor <= 1)
+		return;
+	glBindFramebuffer(GL_FRAMEBUFFER, get_render_framebuffer(frame_graph, frame.reduced_particles));
+	glViewport(0, 0, frame.particle_width, frame.particle_height);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void end_reduced_particles(const frame_render_state& frame)
+{
+	if (frame.particle_divisor <= 1 && !frame.weighted_transparency)
+		return;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, framebuffer_width, framebuffer_height);
+}
+
+void draw_particles_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	const frame_clock& draw_clock = *frame->draw_clock;
+	bool reduced = (frame->particle_divisor > 1 || frame->weighted_transparency);	// drawn anywhere but the window
+	begin_reduced_particles(*frame);
+	if (!frame->instance_buffer)
+	{
+		log_message(log_warning, 0, "Warning: ran out of upload buffer space!");
+		end_reduced_particles(*frame);
+		return;
+	}
+	if (scene_render_mode == render_mode_hybrid && !reduced)
+	{
+		glEnable(GL_DEPTH_TEST);
+		glDepthMask(GL_FALSE);
+	}
+
+	// Pick the vertex array object for wherever the instances are. Its vertex attributes already
+	// point at the particle mesh and the start of the instance buffer. If the shader's pulling
+	// the instances, it only has the mesh.
+	particle_instance_source source = frame->draw_packed_instances ? instances_from_upload_packed : instances_from_upload;
+	if (frame->pulled)
+		source = instances_pulled;
+	else if (frame->cull_on_gpu)
+		source = instances_from_compute_draw;
+	else if (sim_mode == simulation_mode_transform_feedback)
+		source = feedback_source_index ? instances_from_feedback_1 : instances_from_feedback_0;
+	else if (sim_mode == simulation_mode_analytic)
+		source = instances_from_analytic;
+	const particle_vertex_array& vertex_array = particle_vertex_arrays[source];
+	state_bind_vertex_array(vertex_array.vertex_array);
+	if (source == instances_from_upload || source == instances_from_upload_packed)
+		set_particle_sprite_attribute(particle_sprite_buffer, particle_sprite_offset);
+
+	// Draw the particles. If they were culled on the GPU, it already knows how many are visible at
+	// each LOD, so those draws take their instance counts from the indirect buffer. The CPU
+	// simulation's particles are packed grouped by shape and LOD, so there's a draw per group,
+	// all from the same buffers, each starting at its shape's first vertex. Otherwise,
+	// there's one draw per range of the ring, with the instance data starting at that range, and
+	// everything's drawn as stars.
+	uint32_t particle_variant =
+		(frame->draw_packed_instances ? particle_shader_packed_instances : 0) |
+		((sim_mode == simulation_mode_analytic) ? particle_shader_analytic_motion : 0) |
+		(frame->pulled ? particle_shader_pulled_instances : 0) |
+		(frame->store_layout ? particle_shader_store_layout : 0) |
+		(frame->weighted_transparency ? particle_shader_weighted_transparency : 0) |
+		((frame->num_views > 1) ? particle_shader_multi_view : 0);
+	GLuint particle_program = get_shader_variant(&particle_shaders, particle_variant);
+	state_use_program(particle_program);
+	if (frame->pulled)
+		bind_pulled_instances(particle_program, frame->cull_on_gpu ? compute_draw_buffer : frame->instance_buffer, frame->store_layout, frame->pulled_index_buffer, frame->pulled_field_stride);
+	glUniform1f(glGetUniformLocation(particle_program, "point_size_scale"), 1.0f / (frame->pixels_to_world_scale * float(frame->particle_divisor)));
+	glActiveTexture(GL_TEXTURE7);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, particle_sprites.texture);
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i(glGetUniformLocation(particle_program, "particle_sprites"), 7);
+	bind_point_lights(particle_program);
+	glUniform1f(glGetUniformLocation(particle_program, "gravity"), gravity);
+	glUniform1f(glGetUniformLocation(particle_program, "kill_height"), kill_height);
+
+	// Split into views, each instance is drawn once per view, and clipped to its view's edges. The
+	// vertex array's divisor is put back afterwards, as it's kept with the vertex array.
+	if (frame->num_views > 1)
+	{
+		glUniform1i(glGetUniformLocation(particle_program, "num_views"), frame->num_views);
+		for (int i = 0; i < 4; ++i)
+			glEnable(GL_CLIP_DISTANCE0 + i);
+		if (!frame->pulled)
+			set_particle_instance_divisor(GLuint(frame->num_views));
+	}
+
+	// The stepped simulations leave the particles at the last step, so have the shader interpolate
+	// them back to the render time. The analytic one can evaluate them there directly.
+	glUniform1f(glGetUniformLocation(particle_program, "interpolation_step"), float(draw_clock.step));
+	glUniform1f(glGetUniformLocation(particle_program, "interpolation_alpha"), (sim_mode == simulation_mode_analytic) ? 1.0f : draw_clock.alpha);
+
+	// Trails fade out, so they're blended over what's behind them, in the order they're drawn. At a
+	// reduced resolution, everything's blended, over nothing, so the texture ends up with the
+	// particles' colors premultiplied by how much they cover, and that coverage in alpha.
+	glUniform1f(glGetUniformLocation(particle_program, "trail_time"), motion_trails ? motion_trail_steps * float(draw_clock.step) : 0.0f);
+	if (frame->weighted_transparency)
+	{
+		// The weighted colors are summed, and what the scene shows through is multiplied by one
+		// minus each one's opacity
+		glUniform1f(glGetUniformLocation(particle_program, "transparent_opacity"), transparent_particle_opacity);
+		glEnable(GL_BLEND);
+		glBlendFunci(0, GL_ONE, GL_ONE);
+		glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+	}
+	else if (reduced)
+	{
+		glEnable(GL_BLEND);
+		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	else if (motion_trails)
+	{
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	// If the emitters were tested against the ball, the GPU only draws the particles if any of them
+	// passed. It has to wait for the test's result, but that's only a few boxes' depth tests.
+	begin_gpu_pass(gpu_timer_particles);
+	if (frame->occlusion_tested)
+		glBeginConditionalRender(emitter_occlusion_query, GL_QUERY_WAIT);
+	if (frame->cull_on_gpu)
+	{
+		state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, compute_indirect_buffer);
+		for (int lod = num_particle_lods - 1; lod >= 0; --lod)
+		{
+			const particle_shape_lod& mesh = particle_shapes.shapes[0].lods[lod];
+			if (frame->pulled)
+				glUniform1i(glGetUniformLocation(particle_program, "pulled_draw_command"), lod);
+			glDrawElementsIndirect(particle_shape_mode(mesh), GL_UNSIGNED_SHORT, (const void *)(offsetof(gpu_particle_draws, draws) + lod * sizeof(draw_elements_indirect_command)));
+			add_perf_counter(draw_calls_counter, 1);
+		}
+	}
+	else if (sim_mode == simulation_mode_cpu)
+	{
+		int first_instance = frame->first_instance;
+		for (int shape = 0; shape < int(particle_shapes.shapes.size()); ++shape)
+		{
+			for (int lod = num_particle_lods - 1; lod >= 0; --lod)
+			{
+				int count = frame->bucket_counts[particle_draw_bucket(shape, particle_lod(lod))];
+				if (count == 0)
+					continue;
+				draw_particle_instances(vertex_array, particle_program, shape, particle_lod(lod), first_instance, count, frame->num_views);
+				first_instance += count;
+			}
+		}
+	}
+	else
+	{
+		for (int i = 0; i < frame->num_draw_ranges; ++i)
+		{
+			if (frame->draw_ranges[i].count != 0)
+				draw_particle_instances(vertex_array, particle_program, 0, particle_lod_star, frame->draw_ranges[i].first, frame->draw_ranges[i].count, frame->num_views);
+		}
+	}
+	if (frame->occlusion_tested)
+		glEndConditionalRender();
+	end_gpu_pass(gpu_timer_particles);
+	if (frame->num_views > 1)
+	{
+		for (int i = 0; i < 4; ++i)
+			glDisable(GL_CLIP_DISTANCE0 + i);
+		if (!frame->pulled)
+			set_particle_instance_divisor(1);
+	}
+	if (motion_trails || reduced)
+		glDisable(GL_BLEND);
+	if (scene_render_mode == render_mode_hybrid && !reduced)
+	{
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(GL_TRUE);
+	}
+	end_reduced_particles(*frame);
+}
+
+// Lay the reduced-resolution particles over the scene, with bilinear filtering to scale them up.
+// They're all drawn at the same depth, which the fullscreen triangle is at too, so in the hybrid
+// scene it's depth tested against the ball per full-resolution pixel, just as they'd have been;
+// the ball's edges stay sharp, however blurry the particles behind them.
+void composite_particles_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	state_bind_vertex_array(quad_vertex_array);
+	if (scene_render_mode == render_mode_hybrid)
+	{
+		glEnable(GL_DEPTH_TEST);
+		glDepthMask(GL_FALSE);
+	}
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	begin_gpu_pass(gpu_timer_composite);
+	state_use_program(composite_shader_program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, get_render_texture(frame_graph, frame->reduced_particles));
+	glUniform1i(glGetUniformLocation(composite_shader_program, "particles"), 0);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	add_perf_counter(draw_calls_counter, 1);
+	end_gpu_pass(gpu_timer_composite);
+	glDisable(GL_BLEND);
+	if (scene_render_mode == render_mode_hybrid)
+	{
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(GL_TRUE);
+	}
+}
+
+// Lay the weighted transparency's average color over the scene, by how much the particles cover.
+// Like the reduced-resolution composite, it's depth tested against the ball in the hybrid scene,
+// and scales the particles up if they were drawn smaller.
+void resolve_transparency_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	state_bind_vertex_array(quad_vertex_array);
+	if (scene_render_mode == render_mode_hybrid)
+	{
+		glEnable(GL_DEPTH_TEST);
+		glDepthMask(GL_FALSE);
+	}
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	begin_gpu_pass(gpu_timer_composite);
+	state_use_program(transparency_shader_program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, get_render_texture(frame_graph, frame->transparency_accumulation));
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, get_render_texture(frame_graph, frame->transparency_revealage));
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i(glGetUniformLocation(transparency_shader_program, "accumulation"), 0);
+	glUniform1i(glGetUniformLocation(transparency_shader_program, "revealage"), 1);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	add_perf_counter(draw_calls_counter, 1);
+	end_gpu_pass(gpu_timer_composite);
+	glDisable(GL_BLEND);
+	if (scene_render_mode == render_mode_hybrid)
+	{
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(GL_TRUE);
+	}
+}
+
+void draw_overlay_pass(void* data)
+{
+	draw_gpu_timings_overlay(framebuffer_width, framebuffer_height);
+}
+
+#if VULKAN_RENDERER
+// Start the Vulkan renderer, with the same particle mesh the GL one draws. It only draws the
+// first shape, the star, which starts at the first vertex, so its indices need no base vertex.
+bool init_vulkan_graphics()
+{
+	vulkan_mesh_lod lods[num_particle_lods];
+	for (int lod = 0; lod < num_particle_lods; ++lod)
+	{
+		const particle_shape_lod& mesh = particle_shapes.shapes[0].lods[lod];
+		lods[lod] = vulkan_mesh_lod{ uint32_t(mesh.first_index), uint32_t(mesh.num_indices), mesh.points };
+	}
+
+	if (!init_vulkan_renderer(window, num_particles, particle_shapes.vertices.data(), int(particle_shapes.vertices.size() / 2),
+		particle_shapes.indices.data(), int(particle_shapes.indices.size()), lods, num_particle_lods))
+		return false;
+	printf("Rendering with Vulkan on %s\n", vulkan_device_name());
+	return true;
+}
+
+// run_frame(), for Vulkan. Its shaders are compiled into the build, so there's nothing to reload,
+// and it has no GPU timers. The "swap" is submitting the recorded commands and presenting.
+void run_vulkan_frame()
+{
+	const particle_store* draw_particles = nullptr;
+	const frame_clock* draw_clock = nullptr;
+	take_frame_particles(&draw_particles, &draw_clock);
+	set_perf_counter(particles_alive_counter, draw_particles->live_count);
+
+	double render_start_time = glfwGetTime();
+	bool rendered = render_vulkan_frame(*draw_particles, *draw_clock);
+	double render_end_time = glfwGetTime();
+	if (rendered)
+		end_vulkan_frame();
+	end_perf_counter_frame();
+	record_replay_frame(&replay, draw_clock->wall_time, raytrace_scale, particle_resolution_divisor, framebuffer_width, framebuffer_height);
+
+	if (benchmark_frames > 0)
+		record_benchmark_frame(render_start_time, render_end_time, glfwGetTime());
+	reset_frame_arena();
+}
+
+struct pack_instances_job_data
+{
+	const particle_store* store;
+	const uint32_t* indices;	// which particle each job item packs
+	particle_data* out;
+};
+
+void pack_instances_job(void* data, int begin, int end)
+{
+	const pack_instances_job_data* job_data = (const pack_instances_job_data*)data;
+	pack_indexed_particle_instances(*job_data->store, job_data->indices + begin, end - begin, job_data->out + begin);
+}
+
+// render_frame()'s rasterized scene, for Vulkan. The view, culling, LODs and sorting all work the
+// same, but the instances are packed straight into the frame's part of Vulkan's mapped buffer. The
+// commands that draw them were recorded along with the swapchain, and only need the LODs' runs of
+// instances, so the packing's all there is to do, and it's spread across the job system's threads.
+// Returns false if there's no frame to draw into.
+bool render_vulkan_frame(const particle_store& draw_particles, const frame_clock& draw_clock)
+{
+	CPU_PROFILE_SCOPE("render_vulkan_frame");
+
+	vulkan_frame frame;
+	if (!begin_vulkan_frame(framebuffer_width, framebuffer_height, &frame))
+		return false;
+	framebuffer_size_changed = false;
+
+	// The stepped simulation leaves the particles at the last step, so the shader interpolates them
+	// back to the render time
+	float time = float(frame_render_time(draw_clock));
+	float pixels_to_world_scale = world_size / float(std::min(framebuffer_width, framebuffer_height));
+	vulkan_frame_params& params = *frame.params;
+	params.window_size[0] = pixels_to_world_scale * float(framebuffer_width);
+	params.window_size[1] = pixels_to_world_scale * float(framebuffer_height);
+	params.window_center[0] = 0.0f;
+	params.window_center[1] = 0.4f * world_size;
+	params.time = time;
+	params.gravity = gravity;
+	params.interpolation_step = float(draw_clock.step);
+	params.interpolation_alpha = draw_clock.alpha;
+	params.point_size_scale = 1.0f / pixels_to_world_scale;
+
+	float cull_margin = float(draw_clock.step) * max_particle_speed;
+	cull_rect visible =
+	{
+		{ params.window_center[0] - 0.5f * params.window_size[0] - cull_margin, params.window_center[1] - 0.5f * params.window_size[1] - cull_margin },
+		{ params.window_center[0] + 0.5f * params.window_size[0] + cull_margin, params.window_center[1] + 0.5f * params.window_size[1] + cull_margin },
+	};
+
+	// Sort the live, visible particles into their LODs (and into sort_order within each), then
+	// pack them in that order. The buffers were sized for the capacity, which can't change.
+	particle_range draw_ranges[2];
+	int num_draw_ranges = get_live_particle_ranges(draw_particles, draw_ranges);
+	particle_lod_sizes lod_sizes = { { lod_min_star_pixels * pixels_to_world_scale, lod_min_pentagon_pixels * pixels_to_world_scale } };
+	int bucket_counts[num_particle_draw_buckets] = {};
+	int num_packed = 0;
+	{
+		CPU_PROFILE_SCOPE("sort particles");
+		for (int i = 0; i < num_draw_ranges; ++i)
+			num_packed += gather_particle_sort_items(draw_particles, draw_ranges[i].first, draw_ranges[i].count, visible, sort_order, lod_sizes, time, max_particle_age, sort_buffers.items + num_packed, bucket_counts);
+		sort_particle_items(&sort_buffers, num_packed);
+	}
+	add_perf_counter(particles_culled_counter, draw_particles.live_count - num_packed);
+	{
+		CPU_PROFILE_SCOPE("pack particles");
+		pack_instances_job_data job_data = { &draw_particles, sort_buffers.indices, frame.instances };
+		parallel_for(num_packed, int(particle_array_alignment / sizeof(particle_data)), &pack_instances_job, &job_data);
+	}
+
+	// They're grouped by LOD from the smallest up, the order they're drawn in. Only the GL renderer
+	// draws the other shapes, so they're sorted without them, and every particle's a star.
+	int first_instance = 0;
+	for (int lod = num_particle_lods - 1; lod >= 0; --lod)
+	{
+		int count = 0;
+		for (int shape = 0; shape < int(particle_shapes.shapes.size()); ++shape)
+			count += bucket_counts[particle_draw_bucket(shape, particle_lod(lod))];
+		frame.draws[lod] = vulkan_lod_draw{ uint32_t(first_instance), uint32_t(count) };
+		first_instance += count;
+	}
+	return true;
+}
+#endif
+
+// Time a pass on the GPU, and (in debug builds) group its calls under the timer's name in captures
+void begin_gpu_pass(gpu_timer timer)
+{
+	push_gl_debug_group(gpu_timer_names[timer]);
+	begin_gpu_timer(&profiler, timer);
+}
+
+void end_gpu_pass(gpu_timer timer)
+{
+	end_gpu_timer(&profiler, timer);
+	pop_gl_debug_group();
+}
+
+// Size raytrace_geometry_texture for the framebuffer. It's only reallocated when the window
+// changes size; at lower resolutions, the scene's traced into its bottom left corner. The
+// geometry's read back texel for texel, so it's never filtered. Half floats are plenty for the
+// normal, and for the distance, which only has to tell a hit (positive) from a miss (0).
+void allocate_raytrace_geometry(int width, int height)
+{
+	if (width == raytrace_geometry_width && height == raytrace_geometry_height)
+		return;
+	raytrace_geometry_width = width;
+	raytrace_geometry_height = height;
+
+	if (!raytrace_geometry_texture)
+	{
+		glGenTextures(1, &raytrace_geometry_texture);
+		glBindTexture(GL_TEXTURE_2D, raytrace_geometry_texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		label_gl_object(GL_TEXTURE, raytrace_geometry_texture, "raytraced geometry");
+		glGenFramebuffers(1, &raytrace_geometry_framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, raytrace_geometry_framebuffer);
+		label_gl_object(GL_FRAMEBUFFER, raytrace_geometry_framebuffer, "raytraced geometry");
+	}
+	glBindTexture(GL_TEXTURE_2D, raytrace_geometry_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+	set_gpu_memory(gpu_memory_texture, raytrace_geometry_texture, gpu_texture_bytes(GL_RGBA16F, width, height, 1, false));
+
+	glBindFramebuffer(GL_FRAMEBUFFER, raytrace_geometry_framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, raytrace_geometry_texture, 0);
+	bool complete = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	if (!complete && raytrace_geometry_complete != complete)
+		printf("Warning: can't keep the raytraced geometry, so it's traced again every frame!\n");
+	raytrace_geometry_complete = complete;
+	raytrace_geometry_valid = false;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Nudge the raytraced scene's resolution towards what fits in its budget. Its cost goes with the
+// number of pixels, so with the pass taking 'ms' at the current scale, the scale that'd just fit
+// is sqrt(budget / ms) times as big. The timings come in a few frames late, though, by which time
+// the scale's already moved on, so it only goes a few percent of the way at a time; any faster
+// and it overshoots and oscillates. (The CPU raytracer's are timed as it goes, and aren't late.)
+void update_raytrace_scale()
+{
+	float ms = 0.0f;
+	if (replayed_frame)
+		raytrace_scale = replayed_frame->raytrace_scale;
+	else if (raytrace_budget_ms <= 0.0f || !render_format_renderable(&frame_graph, GL_RGBA8) || !upscale_shader_program)
+		raytrace_scale = 1.0f;
+	else if (use_cpu_raytrace ? (ms = cpu_raytrace_ms) > 0.0f : get_collected_gpu_timer_sample(profiler, gpu_timer_raytrace, &ms) && ms > 0.0f)
+	{
+		float step = sqrtf(raytrace_budget_ms / ms);
+		step = std::min(std::max(step, 1.0f - max_raytrace_scale_step), 1.0f + max_raytrace_scale_step);
+		raytrace_scale = std::min(std::max(raytrace_scale * step, min_raytrace_scale), 1.0f);
+	}
+}
+
+// Pick the resolution the particles are drawn at. Automatically, there are only the three, each
+// with four times the pixels of the next, so it halves the resolution when the pass goes over
+// budget, and only doubles it again once a quarter of the time would fit with room to spare;
+// otherwise it'd flip back and forth. After a change, it waits for the timings to catch up.
+void update_particle_resolution()
+{
+	float ms = 0.0f;
+	if (replayed_frame)
+		particle_resolution_divisor = replayed_frame->particle_divisor;
+	else if (particle_resolution != particle_resolution_auto)
+		particle_resolution_divisor = particle_resolution_divisors[particle_resolution];
+	else if (++particle_resolution_held_frames > gpu_profiler_frames && get_collected_gpu_timer_sample(profiler, gpu_timer_particles, &ms))
+	{
+		int divisor = particle_resolution_divisor;
+		if (ms > particle_budget_ms && divisor < max_particle_resolution_divisor)
+			divisor *= 2;
+		else if (ms * 4.0f < particle_budget_ms * 0.75f && divisor > 1)
+			divisor /= 2;
+		if (divisor != particle_resolution_divisor)
+		{
+			particle_resolution_divisor = divisor;
+			particle_resolution_held_frames = 0;
+		}
+	}
+}
+
+// Build the BVH over the particles, and send it to the GPU for the raytracer. Only the CPU
+// simulation has the particles on the CPU to build it from; in the other modes, it's empty.
+void upload_raytrace_bvh(const particle_store& draw_particles, const frame_clock& draw_clock, const cull_rect& visible)
+{
+	CPU_PROFILE_SCOPE("build bvh");
+	raytrace_bvh.num_spheres = 0;
+	if (sim_mode == simulation_mode_cpu)
+	{
+		float step_back = float((1.0 - draw_clock.alpha) * draw_clock.step);
+		if (!build_particle_bvh(&raytrace_bvh, draw_particles, visible, step_back, float(draw_clock.step), gravity))
+			log_message(log_warning, 0, "Warning: ran out of memory for the raytracer's BVH!");
+	}
+
+	// Specifying the storage afresh each frame lets the driver hand us new memory, rather than
+	// waiting for the frames still reading the old. They're never empty, so they're always valid.
+	int num_nodes = std::max(raytrace_bvh.num_spheres - 1, 1);
+	int num_spheres = std::max(raytrace_bvh.num_spheres, 1);
+	state_bind_buffer(GL_TEXTURE_BUFFER, raytrace_bvh_buffers[0]);
+	glBufferData(GL_TEXTURE_BUFFER, num_nodes * sizeof(particle_bvh_node), (raytrace_bvh.num_spheres > 1) ? raytrace_bvh.nodes : nullptr, GL_STREAM_DRAW);
+	set_gpu_memory(gpu_memory_buffer, raytrace_bvh_buffers[0], int64_t(num_nodes * sizeof(particle_bvh_node)));
+	state_bind_buffer(GL_TEXTURE_BUFFER, raytrace_bvh_buffers[1]);
+	glBufferData(GL_TEXTURE_BUFFER, num_spheres * sizeof(particle_bvh_sphere), (raytrace_bvh.num_spheres > 0) ? raytrace_bvh.spheres : nullptr, GL_STREAM_DRAW);
+	set_gpu_memory(gpu_memory_buffer, raytrace_bvh_buffers[1], int64_t(num_spheres * sizeof(particle_bvh_sphere)));
+	if (raytrace_bvh.num_spheres > 0)
+		add_perf_counter(bvh_upload_bytes_counter, int64_t((raytrace_bvh.num_spheres - 1) * sizeof(particle_bvh_node) + raytrace_bvh.num_spheres * sizeof(particle_bvh_sphere)));
+}
+
+// The part of a width x height viewport that the raytracer could see anything in a world space
+// box in: the box, projected onto the screen by the raytracer's camera. Returns false if that's
+// nothing. The rectangle is x, y, width, height, as glScissor() takes it.
+bool get_raytrace_scissor(const uniform_data& uniforms, const float box_min[3], const float box_max[3], int width, int height, int o_rect[4])
+{
+	// The camera looks down at z = 0 from this far away, as in fragment_shader_raytrace.glsl. A
+	// point's image is where the ray through it meets that plane, and the box's image is inside
+	// the rectangle around its corners' images.
+	float camera_distance = uniforms.window_size[1];
+	float screen_min[2] = { 1e30f, 1e30f };
+	float screen_max[2] = { -1e30f, -1e30f };
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		float z = (corner & 4) ? box_max[2] : box_min[2];
+		if (z >= camera_distance)
+		{
+			// It's behind the camera, which sees everything around it
+			o_rect[0] = o_rect[1] = 0;
+			o_rect[2] = width;
+			o_rect[3] = height;
+			return true;
+		}
+		float perspective = camera_distance / (camera_distance - z);
+		for (int axis = 0; axis < 2; ++axis)
+		{
+			float world = (corner & (1 << axis)) ? box_max[axis] : box_min[axis];
+			float ndc = (world - uniforms.window_center[axis]) * perspective / (0.5f * uniforms.window_size[axis]);
+			screen_min[axis] = std::min(screen_min[axis], ndc);
+			screen_max[axis] = std::max(screen_max[axis], ndc);
+		}
+	}
+
+	// To whole pixels, rounding outwards, and clipped to the viewport
+	int size[2] = { width, height };
+	int pixel_min[2], pixel_max[2];
+	for (int axis = 0; axis < 2; ++axis)
+	{
+		float scale = 0.5f * float(size[axis]);
+		pixel_min[axis] = int(std::max(floorf((screen_min[axis] + 1.0f) * scale), 0.0f));
+		pixel_max[axis] = int(std::min(ceilf((screen_max[axis] + 1.0f) * scale), float(size[axis])));
+		if (pixel_max[axis] <= pixel_min[axis])
+			return false;
+	}
+	o_rect[0] = pixel_min[0];
+	o_rect[1] = pixel_min[1];
+	o_rect[2] = pixel_max[0] - pixel_min[0];
+	o_rect[3] = pixel_max[1] - pixel_min[1];
+	return true;
+}
+
+// Everything the raytracer can see is inside the BVH's root box. Only call this with particles in it.
+void get_raytrace_bvh_bounds(float o_min[3], float o_max[3])
+{
+	if (raytrace_bvh.num_spheres == 1)
+	{
+		const particle_bvh_sphere& sphere = raytrace_bvh.spheres[0];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			o_min[axis] = sphere.center[axis] - sphere.radius;
+			o_max[axis] = sphere.center[axis] + sphere.radius;
+		}
+	}
+	else if (raytrace_bvh.num_spheres > 1)
+	{
+		std::copy_n(raytrace_bvh.nodes[0].min, 3, o_min);
+		std::copy_n(raytrace_bvh.nodes[0].max, 3, o_max);
+	}
+}
+
+// Point a raytrace program (the current one) at the BVH, on texture units 1 and 2
+void bind_raytrace_bvh(GLuint program)
+{
+	for (int i = 0; i < 2; ++i)
+	{
+		glActiveTexture(GL_TEXTURE1 + i);
+		glBindTexture(GL_TEXTURE_BUFFER, raytrace_bvh_textures[i]);
+	}
+	glUniform1i(glGetUniformLocation(program, "bvh_nodes"), 1);
+	glUniform1i(glGetUniformLocation(program, "bvh_spheres"), 2);
+	glUniform1i(glGetUniformLocation(program, "bvh_num_spheres"), raytrace_bvh.num_spheres);
+}
+
+// Put the point lights at the CPU simulation's particles, bin them into cells 'cell_size' across
+// over the visible part of the world, and upload the lot
+void upload_point_lights(const particle_store& draw_particles, const cull_rect& visible, float cell_size)
+{
+	CPU_PROFILE_SCOPE("build light clusters");
+	point_lights.lights.clear();
+	if (sim_mode == simulation_mode_cpu && max_point_lights > 0)
+		gather_particle_lights(&point_lights, draw_particles, std::max(num_particles / max_point_lights, 1), max_point_lights, point_light_radius_scale, point_light_color);
+	build_light_clusters(&point_lights, visible.min, visible.max, cell_size);
+
+	// The same as the BVH: fresh storage every frame, and never empty
+	const void* data[3] = { point_lights.lights.data(), point_lights.cells.data(), point_lights.indices.data() };
+	size_t sizes[3] =
+	{
+		point_lights.lights.size() * sizeof(point_light),
+		point_lights.cells.size() * sizeof(uint32_t),
+		point_lights.indices.size() * sizeof(uint32_t),
+	};
+	for (int i = 0; i < 3; ++i)
+	{
+		state_bind_buffer(GL_TEXTURE_BUFFER, point_light_buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, GLsizeiptr(std::max(sizes[i], sizeof(uint32_t))), sizes[i] ? data[i] : nullptr, GL_STREAM_DRAW);
+		set_gpu_memory(gpu_memory_buffer, point_light_buffers[i], int64_t(std::max(sizes[i], sizeof(uint32_t))));
+		add_perf_counter(light_upload_bytes_counter, int64_t(sizes[i]));
+	}
+}
+
+// Point a program that shades with the point lights (the current one) at them, on texture units 8-10
+void bind_point_lights(GLuint program)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		glActiveTexture(GL_TEXTURE8 + i);
+		glBindTexture(GL_TEXTURE_BUFFER, point_light_textures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i(glGetUniformLocation(program, "use_point_lights"), !point_lights.lights.empty());
+	glUniform1i(glGetUniformLocation(program, "point_lights"), 8);
+	glUniform1i(glGetUniformLocation(program, "light_cells"), 9);
+	glUniform1i(glGetUniformLocation(program, "light_indices"), 10);
+	glUniform2fv(glGetUniformLocation(program, "light_grid_origin"), 1, point_lights.origin);
+	glUniform1f(glGetUniformLocation(program, "light_grid_scale"), 1.0f / point_lights.cell_size);
+	glUniform2i(glGetUniformLocation(program, "light_grid_size"), point_lights.width, point_lights.height);
+}
+
+// The hybrid scene's ball, raytraced into the window at full resolution, with its depth, for the
+// particles to be tested against. It drifts from side to side across the fountain, unless it's
+// one of the colliders, which can't follow it.
+void draw_raytraced_ball(const uniform_data& uniforms, float time)
+{
+	float ball_x = colliders_enabled.load(std::memory_order_relaxed) ? 0.0f : 8.0f * sinf(0.4f * time);
+	float ball[4] = { ball_x, uniforms.window_center[1], 0.0f, ball_radius };
+	float box_min[3] = { ball[0] - ball_radius, ball[1] - ball_radius, -ball_radius };
+	float box_max[3] = { ball[0] + ball_radius, ball[1] + ball_radius, ball_radius };
+	int scissor[4];
+	if (!get_raytrace_scissor(uniforms, box_min, box_max, framebuffer_width, framebuffer_height, scissor))
+		return;
+
+	// Writing depth from the shader means the depth test has to wait until it's run, but there's
+	// nothing already in the depth buffer for this to be hidden behind anyway
+	state_bind_vertex_array(quad_vertex_array);
+	begin_gpu_pass(gpu_timer_raytrace);
+	GLuint ball_program = get_shader_variant(&raytrace_shaders, raytrace_shader_ball_with_depth);
+	state_use_program(ball_program);
+	glUniform4fv(glGetUniformLocation(ball_program, "ball"), 1, ball);
+	bind_point_lights(ball_program);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	add_perf_counter(draw_calls_counter, 1);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_DEPTH_TEST);
+	end_gpu_pass(gpu_timer_raytrace);
+}
+
+// The emitters' bounds on screen, grown by the margin, in world units, each side. Beyond
+// max_occlusion_boxes emitters, there's one rectangle around them all. Those entirely off screen are
+// left out. Returns how many there are.
+int get_emitter_occlusion_rects(const uniform_data& uniforms, float margin, int o_rects[max_occlusion_boxes][4])
+{
+	bool merged = (emitters.count > max_occlusion_boxes);
+	float merged_min[3] = { 1e30f, 1e30f, 0.0f };
+	float merged_max[3] = { -1e30f, -1e30f, 0.0f };
+	int num_rects = 0;
+	for (int i = 0; i < emitters.count; ++i)
+	{
+		float box_min[3] = {};
+		float box_max[3] = {};
+		get_emitter_bounds(emitters.emitters[i], gravity, max_particle_age, kill_height, box_min, box_max);
+		for (int axis = 0; axis < 2; ++axis)
+		{
+			box_min[axis] -= margin;
+			box_max[axis] += margin;
+			merged_min[axis] = std::min(merged_min[axis], box_min[axis]);
+			merged_max[axis] = std::max(merged_max[axis], box_max[axis]);
+		}
+		if (!merged && get_raytrace_scissor(uniforms, box_min, box_max, framebuffer_width, framebuffer_height, o_rects[num_rects]))
+			++num_rects;
+	}
+	if (merged && get_raytrace_scissor(uniforms, merged_min, merged_max, framebuffer_width, framebuffer_height, o_rects[0]))
+		num_rects = 1;
+	return num_rects;
+}
+
+// Size the progressive raytracer's sums for the framebuffer, which starts them again
+void allocate_accumulation_targets(int width, int height)
+{
+	if (width == accumulation_width && height == accumulation_height)
+		return;
+	accumulation_width = width;
+	accumulation_height = height;
+	accumulated_samples = 0;
+
+	// They're full floats, so adding a sample to a thousand others still counts for something
+	static const char* accumulation_labels[2] = { "accumulation 0", "accumulation 1" };
+	bool complete = true;
+	for (int i = 0; i < 2; ++i)
+	{
+		if (!accumulation_textures[i])
+		{
+			glGenTextures(1, &accumulation_textures[i]);
+			glBindTexture(GL_TEXTURE_2D, accumulation_textures[i]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+			label_gl_object(GL_TEXTURE, accumulation_textures[i], accumulation_labels[i]);
+			glGenFramebuffers(1, &accumulation_framebuffers[i]);
+			glBindFramebuffer(GL_FRAMEBUFFER, accumulation_framebuffers[i]);
+			label_gl_object(GL_FRAMEBUFFER, accumulation_framebuffers[i], accumulation_labels[i]);
+		}
+		glBindTexture(GL_TEXTURE_2D, accumulation_textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+		set_gpu_memory(gpu_memory_texture, accumulation_textures[i], gpu_texture_bytes(GL_RGBA32F, width, height, 1, false));
+		glBindFramebuffer(GL_FRAMEBUFFER, accumulation_framebuffers[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumulation_textures[i], 0);
+		complete = complete && (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	}
+	if (!complete && accumulation_framebuffers_complete != complete)
+		printf("Warning: can't render to float textures, so the progressive scene is only ever one sample!\n");
+	accumulation_framebuffers_complete = complete;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Whether the progressive scene can be drawn, sizing its sums for the framebuffer first. If it
+// can't, it's drawn like the raytraced one instead.
+bool progressive_raytrace_usable()
+{
+	allocate_accumulation_targets(framebuffer_width, framebuffer_height);
+	return accumulation_framebuffers_complete && resolve_shader_program && get_shader_variant(&raytrace_shaders, raytrace_shader_progressive);
+}
+
+// Add as many samples to the progressive raytracer's sums as fit in the budget
+void accumulate_samples_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	const uniform_data& uniforms = frame->uniforms;
+	GLuint progressive_program = get_shader_variant(&raytrace_shaders, raytrace_shader_progressive);
+
+	// Adapt the samples per frame to the budget. The pass's cost goes with how many samples it
+	// takes, and its timings come in a few frames late, so they're matched up with how many it
+	// took back then. It only goes a quarter of the way there at a time, to keep it steady.
+	float ms = 0.0f;
+	int samples_timed = progressive_samples_in_flight[profiler.current_frame];
+	progressive_samples_in_flight[profiler.current_frame] = 0;
+	if (raytrace_budget_ms <= 0.0f)
+	{
+		progressive_samples_per_frame = 1;
+	}
+	else if (samples_timed > 0 && get_collected_gpu_timer_sample(profiler, gpu_timer_raytrace, &ms) && ms > 0.0f)
+	{
+		float ideal = raytrace_budget_ms * float(samples_timed) / ms;
+		float next = float(progressive_samples_per_frame) + 0.25f * (ideal - float(progressive_samples_per_frame));
+		progressive_samples_per_frame = std::min(std::max(int(next + 0.5f), 1), max_progressive_samples_per_frame);
+	}
+
+	// Start again whenever what's being traced changes: the camera, the light or the particles.
+	// Besides the window, those all follow the render time, so they hold still while paused.
+	if (memcmp(&uniforms, &accumulation_uniforms, sizeof(uniform_data)) != 0)
+	{
+		accumulation_uniforms = uniforms;
+		accumulated_samples = 0;
+	}
+
+	int num_samples = std::min(progressive_samples_per_frame, max_accumulated_samples - accumulated_samples);
+	if (num_samples <= 0)
+		return;
+
+	// Read the sums from one target, and write them with the new samples added to the other.
+	// Starting again, both are cleared, so what's outside the scissor is never stale.
+	state_bind_vertex_array(quad_vertex_array);
+	begin_gpu_pass(gpu_timer_raytrace);
+	if (accumulated_samples == 0)
+	{
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		for (int i = 0; i < 2; ++i)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, accumulation_framebuffers[i]);
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+	}
+
+	float box_min[3], box_max[3];
+	get_raytrace_bvh_bounds(box_min, box_max);
+	int scissor[4];
+	if (raytrace_bvh.num_spheres > 0 && get_raytrace_scissor(uniforms, box_min, box_max, framebuffer_width, framebuffer_height, scissor))
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, accumulation_framebuffers[1 - accumulation_index]);
+		state_use_program(progressive_program);
+		bind_raytrace_bvh(progressive_program);
+		bind_point_lights(progressive_program);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, accumulation_textures[accumulation_index]);
+		glUniform1i(glGetUniformLocation(progressive_program, "accumulation"), 0);
+		glUniform1i(glGetUniformLocation(progressive_program, "sample_index"), accumulated_samples);
+		glUniform1i(glGetUniformLocation(progressive_program, "num_samples"), num_samples);
+		glUniform2f(glGetUniformLocation(progressive_program, "pixel_size"), 2.0f / float(framebuffer_width), 2.0f / float(framebuffer_height));
+		glUniform1f(glGetUniformLocation(progressive_program, "light_radius"), progressive_light_radius);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		add_perf_counter(draw_calls_counter, 1);
+		glDisable(GL_SCISSOR_TEST);
+		accumulation_index = 1 - accumulation_index;
+	}
+	end_gpu_pass(gpu_timer_raytrace);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	accumulated_samples += num_samples;
+	progressive_samples_in_flight[profiler.current_frame] = num_samples;
+}
+
+// Show the average of the progressive raytracer's samples
+void resolve_samples_pass(void* data)
+{
+	state_bind_vertex_array(quad_vertex_array);
+	begin_gpu_pass(gpu_timer_resolve);
+	state_use_program(resolve_shader_program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, accumulation_textures[accumulation_index]);
+	glUniform1i(glGetUniformLocation(resolve_shader_program, "accumulation"), 0);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	add_perf_counter(draw_calls_counter, 1);
+	end_gpu_pass(gpu_timer_resolve);
+}
+
+// Only the pixels of the raytraced scene that the particles could be in are traced. The rest are
+// sky, which is cleared to, and when the particles are small and bunched up, as they usually are,
+// that's most of the screen. Returns false if there's nothing to trace.
+bool get_raytraced_scene_scissor(const frame_render_state& frame, int o_scissor[4])
+{
+	if (raytrace_bvh.num_spheres == 0)
+		return false;
+	float box_min[3], box_max[3];
+	get_raytrace_bvh_bounds(box_min, box_max);
+	return get_raytrace_scissor(frame.uniforms, box_min, box_max, frame.raytrace_width, frame.raytrace_height, o_scissor);
+}
+
+// Draw into the raytraced scene: its texture, at the current scale, cleared to the sky, or else
+// the window, which already has been
+void begin_raytraced_scene(const frame_render_state& frame)
+{
+	if (!frame.offscreen)
+		return;
+	glBindFramebuffer(GL_FRAMEBUFFER, get_render_framebuffer(frame_graph, frame.raytraced_scene));
+	glViewport(0, 0, frame.raytrace_width, frame.raytrace_height);
+	glClearColor(0.0f, 0.6f, 1.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void end_raytraced_scene(const frame_render_state& frame)
+{
+	if (!frame.offscreen)
+		return;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, framebuffer_width, framebuffer_height);
+}
+
+// Trace and light the raytraced scene in one go. Both this and the passes that split it are a
+// single triangle covering the viewport; the fragment shaders do the rest!
+void raytrace_scene_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	begin_raytraced_scene(*frame);
+	int scissor[4];
+	if (get_raytraced_scene_scissor(*frame, scissor))
+	{
+		// Core profile needs a vertex array bound to draw, even with no attributes
+		state_bind_vertex_array(quad_vertex_array);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
+		begin_gpu_pass(gpu_timer_raytrace);
+		GLuint raytrace_program = get_shader_variant(&raytrace_shaders, 0);
+		state_use_program(raytrace_program);
+		bind_raytrace_bvh(raytrace_program);
+		bind_point_lights(raytrace_program);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		add_perf_counter(draw_calls_counter, 1);
+		end_gpu_pass(gpu_timer_raytrace);
+		glDisable(GL_SCISSOR_TEST);
+	}
+	end_raytraced_scene(*frame);
+}
+
+// Trace the raytraced scene on the CPU, and upload it into its texture. Only the part the particles
+// could be in is uploaded, over the sky it's cleared to, as the GL raytracer only draws that part;
+// the whole image is kept, sky and all, for --cpu-raytrace-output.
+void cpu_raytrace_scene_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	begin_raytraced_scene(*frame);
+	int scissor[4] = {};
+	bool tracing = get_raytraced_scene_scissor(*frame, scissor);
+	if (resize_cpu_raytrace_image(&cpu_raytraced, frame->raytrace_width, frame->raytrace_height))
+	{
+		const uniform_data& uniforms = frame->uniforms;
+		cpu_raytrace_view view =
+		{
+			{ uniforms.window_size[0], uniforms.window_size[1] },
+			{ uniforms.window_center[0], uniforms.window_center[1] },
+			{ uniforms.light_dir[0], uniforms.light_dir[1], uniforms.light_dir[2] },
+		};
+		double start_time = glfwGetTime();
+		cpu_raytrace_scene(raytrace_bvh, &point_lights, view, scissor, &cpu_raytraced);
+		cpu_raytrace_ms = float((glfwGetTime() - start_time) * 1000.0);
+
+		if (tracing)
+		{
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, get_render_texture(frame_graph, frame->raytraced_scene));
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, cpu_raytraced.width);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, scissor[0], scissor[1], scissor[2], scissor[3], GL_RGBA, GL_UNSIGNED_BYTE,
+				cpu_raytraced.pixels + (size_t(scissor[1]) * cpu_raytraced.width + scissor[0]) * 4);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		}
+	}
+	else
+	{
+		log_message(log_warning, 0, "Warning: ran out of memory for the CPU raytracer's image!");
+	}
+	end_raytraced_scene(*frame);
+}
+
+// Trace what each pixel's ray hits into raytrace_geometry_texture. Only the light moves from one
+// frame to the next while the simulation's paused, so then the hits are kept, and it's just the
+// shading pass.
+void trace_geometry_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	int scissor[4];
+	if (!get_raytraced_scene_scissor(*frame, scissor))
+		return;
+	GLuint geometry_program = get_shader_variant(&raytrace_shaders, raytrace_shader_geometry_only);
+
+	// Everything the hits depend on. The key's cleared first so its padding compares equal.
+	raytrace_geometry_key key;
+	memset(&key, 0, sizeof(key));
+	memcpy(key.window_size, frame->uniforms.window_size, sizeof(key.window_size));
+	memcpy(key.window_center, frame->uniforms.window_center, sizeof(key.window_center));
+	key.time = frame->uniforms.time;
+	key.width = frame->raytrace_width;
+	key.height = frame->raytrace_height;
+	key.num_spheres = raytrace_bvh.num_spheres;
+	key.program = geometry_program;
+	if (raytrace_geometry_valid && memcmp(&key, &raytrace_geometry_traced, sizeof(key)) == 0)
+		return;
+
+	// Misses are all zeros, and so is everything outside the scissor
+	begin_gpu_pass(gpu_timer_raytrace);
+	glBindFramebuffer(GL_FRAMEBUFFER, raytrace_geometry_framebuffer);
+	glViewport(0, 0, frame->raytrace_width, frame->raytrace_height);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	state_bind_vertex_array(quad_vertex_array);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
+	state_use_program(geometry_program);
+	bind_raytrace_bvh(geometry_program);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	add_perf_counter(draw_calls_counter, 1);
+	glDisable(GL_SCISSOR_TEST);
+	end_gpu_pass(gpu_timer_raytrace);
+	raytrace_geometry_traced = key;
+	raytrace_geometry_valid = true;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, framebuffer_width, framebuffer_height);
+}
+
+// Light what the rays hit
+void shade_raytraced_scene_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	begin_raytraced_scene(*frame);
+	int scissor[4];
+	if (get_raytraced_scene_scissor(*frame, scissor))
+	{
+		state_bind_vertex_array(quad_vertex_array);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
+		begin_gpu_pass(gpu_timer_shade);
+		state_use_program(shade_shader_program);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, raytrace_geometry_texture);
+		glUniform1i(glGetUniformLocation(shade_shader_program, "geometry"), 0);
+		bind_point_lights(shade_shader_program);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		add_perf_counter(draw_calls_counter, 1);
+		end_gpu_pass(gpu_timer_shade);
+		glDisable(GL_SCISSOR_TEST);
+	}
+	end_raytraced_scene(*frame);
+}
+
+// Scale the raytraced scene up to fill the window. The texture's the framebuffer's size, so it
+// samples only inside the part that was drawn, which is the whole texture at full resolution.
+void upscale_raytraced_scene_pass(void* data)
+{
+	frame_render_state* frame = (frame_render_state*)data;
+	state_bind_vertex_array(quad_vertex_array);
+	begin_gpu_pass(gpu_timer_upscale);
+	state_use_program(upscale_shader_program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, get_render_texture(frame_graph, frame->raytraced_scene));
+	glUniform1i(glGetUniformLocation(upscale_shader_program, "scene"), 0);
+	glUniform2f(glGetUniformLocation(upscale_shader_program, "scene_uv_scale"),
+		float(frame->raytrace_width) / float(framebuffer_width), float(frame->raytrace_height) / float(framebuffer_height));
+	glUniform2f(glGetUniformLocation(upscale_shader_program, "scene_uv_max"),
+		(float(frame->raytrace_width) - 0.5f) / float(framebuffer_width), (float(frame->raytrace_height) - 0.5f) / float(framebuffer_height));
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	add_perf_counter(draw_calls_counter, 1);
+	end_gpu_pass(gpu_timer_upscale);
+}
+
+// Show the GPU timings, for the passes that ran lately, over the top left of the scene
+void draw_gpu_timings_overlay(int framebuffer_width, int framebuffer_height)
+{
+	if (!overlay_shader_program)
+		return;
+
+	clear_text_overlay(&overlay);
+	print_text_overlay(&overlay, "GPU ms       min   avg   max");
+	for (int timer = 0; timer < num_gpu_timers; ++timer)
+	{
+		gpu_timer_stats stats = get_gpu_timer_stats(profiler, timer);
+		if (stats.num_samples > 0)
+			print_text_overlay(&overlay, "%-10s %5.2f %5.2f %5.2f", gpu_timer_names[timer], stats.min_ms, stats.avg_ms, stats.max_ms);
+	}
+	if (scene_render_mode == render_mode_raytrace && raytrace_budget_ms > 0.0f)
+		print_text_overlay(&overlay, "raytrace at %3.0f%% for %.1f ms", raytrace_scale * 100.0f, raytrace_budget_ms);
+	if (scene_render_mode == render_mode_progressive)
+		print_text_overlay(&overlay, "%4d samples, %2d a frame", accumulated_samples, progressive_samples_per_frame);
+	if ((scene_render_mode == render_mode_raster || scene_render_mode == render_mode_hybrid) && particle_resolution == particle_resolution_auto)
+		print_text_overlay(&overlay, "particles at 1/%d for %.1f ms", particle_resolution_divisor, particle_budget_ms);
+
+	// Scale the font with the framebuffer, so it's still readable on big displays. The overlay is
+	// a font pixel of margin around the rows of 4x6 cells, and sits a little in from the corner.
+	float glyph_scale = std::max(2.0f, floorf(float(framebuffer_height) / 360.0f));
+	float width = float(overlay_columns * 4 + 1) * glyph_scale;
+	float height = float(overlay.num_rows * 6 + 1) * glyph_scale;
+	float margin = 4.0f * glyph_scale;
+	float x_min = -1.0f + 2.0f * margin / float(framebuffer_width);
+	float y_max = 1.0f - 2.0f * margin / float(framebuffer_height);
+
+	uint32_t packed_text[overlay_rows * overlay_columns / 4];
+	pack_text_overlay(overlay, packed_text);
+
+	push_gl_debug_group("overlay");
+	state_bind_vertex_array(quad_vertex_array);
+	state_use_program(overlay_shader_program);
+	glUniform2f(glGetUniformLocation(overlay_shader_program, "overlay_min"), x_min, y_max - 2.0f * height / float(framebuffer_height));
+	glUniform2f(glGetUniformLocation(overlay_shader_program, "overlay_max"), x_min + 2.0f * width / float(framebuffer_width), y_max);
+	glUniform2f(glGetUniformLocation(overlay_shader_program, "overlay_size"), width, height);
+	glUniform1f(glGetUniformLocation(overlay_shader_program, "glyph_scale"), glyph_scale);
+	glUniform4uiv(glGetUniformLocation(overlay_shader_program, "overlay_text"), overlay_rows * overlay_columns / 16, packed_text);
+
+	// Blend it over the scene, so the background's see-through
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	add_perf_counter(draw_calls_counter, 1);
+	glDisable(GL_BLEND);
+	pop_gl_debug_group();
+}
+
+// Write out what the CPU profiler has recorded lately, for chrome://tracing or ui.perfetto.dev
+void save_cpu_trace()
+{
+#if CPU_PROFILER
+	if (write_cpu_trace(cpu_trace_filename))
+		printf("Wrote CPU trace to %s\n", cpu_trace_filename);
+	else
+		printf("Error: couldn't write CPU trace to %s :(\n", cpu_trace_filename);
+#else
+	printf("Warning: built without the CPU profiler (see WORKSHOP01_CPU_PROFILER)!\n");
+#endif
+}
+
+// Save the whole simulation, for --load-snapshot to carry on from. It has to be on the CPU, and
+// still, meanwhile, so this stops the simulation thread and fetches it back from the GPU, if
+// that's where it is, and then hands it back again.
+void save_snapshot()
+{
+	bool restart = simulation_thread.joinable();
+	stop_simulation_thread();
+	fetch_particles_from_gpu();
+
+	simulation_file_state state = { next_particle_index, random_seed, spawn_counter, sim_clock.sim_time };
+	if (save_simulation_file(snapshot_save_filename, particles, emitters, state))
+		printf("Saved the simulation to %s\n", snapshot_save_filename);
+	else
+		printf("Error: couldn't save the simulation to %s :(\n", snapshot_save_filename);
+
+	send_particles_to_gpu();
+	if (restart)
+		start_simulation_thread();
+}
+
+// Set up the series to record, and turn off anything that'd get in the way of the timings
+void start_benchmark()
+{
+	printf("Benchmarking %d frames, after %d to warm up\n", benchmark_frames, benchmark_warmup_frames);
+	show_gpu_timings = false;
+
+	benchmark_frame_series = add_benchmark_series(&benchmark, "", "frame");
+	benchmark_simulate_series = add_benchmark_series(&benchmark, "cpu", "simulate");
+	benchmark_render_series = add_benchmark_series(&benchmark, "cpu", "render");
+	benchmark_swap_series = add_benchmark_series(&benchmark, "cpu", "swap");
+	for (int timer = 0; timer < num_gpu_timers; ++timer)
+		benchmark_gpu_series[timer] = add_benchmark_series(&benchmark, "gpu", gpu_timer_names[timer]);
+}
+
+// Record the frame that just ended. Frame times are from swap to swap, so they take in everything
+// the main thread does. The GPU timers come in a few frames late, so the last few recorded
+// frames' GPU times are never collected; that's too few to move the percentiles.
+void record_benchmark_frame(double render_start_time, double render_end_time, double swap_end_time)
+{
+	int frame = benchmark_frames_run++;
+	double frame_ms = (swap_end_time - benchmark_last_swap_time) * 1000.0;
+	benchmark_last_swap_time = swap_end_time;
+	if (frame < benchmark_warmup_frames)
+		return;
+	if (frame == benchmark_warmup_frames)
+	{
+		// The first recorded frame's length would take in the warmup, so it just starts the clock
+		benchmark_start_time = swap_end_time;
+		return;
+	}
+
+	add_benchmark_sample(&benchmark, benchmark_frame_series, float(frame_ms));
+	add_benchmark_sample(&benchmark, benchmark_simulate_series, last_simulate_frame_ms.load(std::memory_order_relaxed));
+	add_benchmark_sample(&benchmark, benchmark_render_series, float((render_end_time - render_start_time) * 1000.0));
+	add_benchmark_sample(&benchmark, benchmark_swap_series, float((swap_end_time - render_end_time) * 1000.0));
+	for (int timer = 0; timer < num_gpu_timers; ++timer)
+	{
+		float ms = 0.0f;
+		if (get_collected_gpu_timer_sample(profiler, timer, &ms))
+			add_benchmark_sample(&benchmark, benchmark_gpu_series[timer], ms);
+	}
+}
+
+// Write out the report. Returns false if it couldn't be written, or the run was cut short.
+bool finish_benchmark()
+{
+	int frames_recorded = std::max(0, benchmark_frames_run - benchmark_warmup_frames - 1);
+	if (frames_recorded == 0)
+	{
+		printf("Error: the benchmark stopped before recording any frames :(\n");
+		return false;
+	}
+
+	benchmark_settings settings =
+	{
+		frames_recorded,
+		benchmark_warmup_frames,
+		num_particles,
+		particles_per_second,
+		num_emitters,
+		random_seed,
+		simulation_rate,
+		simulation_mode_names[sim_mode],
+		sort_order_names[sort_order],
+		job_thread_count(),
+		framebuffer_width,
+		framebuffer_height,
+		(const char*)glGetString(GL_RENDERER),
+		(const char*)glGetString(GL_VERSION),
+		benchmark_last_swap_time - benchmark_start_time,
+	};
+	if (!write_benchmark_report(benchmark, settings, benchmark_output))
+	{
+		printf("Error: couldn't write benchmark report to %s :(\n", benchmark_output);
+		return false;
+	}
+	printf("Wrote benchmark report for %d frames to %s\n", frames_recorded, benchmark_output);
+	return frames_recorded == benchmark_frames;
+}
+
+// Parameters shared by all the spawning jobs for one batch
+struct spawn_job_data
+{
+	const particle_emitter* emitter;	// the emitter the batch comes from
+	int first;					// index of the particle that job item 0 corresponds to
+	uint32_t first_counter;		// spawn number of that particle
+	float time;					// creation time for all of them
+};
+
+void spawn_particles_job(void* data, int begin, int end)
+{
+	const spawn_job_data* job_data = (const spawn_job_data*)data;
+	spawn_particles(&particles, *job_data->emitter, random_seed, job_data->first + begin, end - begin, job_data->first_counter + uint32_t(begin), job_data->time);
+}
+
+// (Re)allocate storage for all the particle buffers at the current capacity, discarding their contents
+void allocate_particle_buffers()
+{
+	// Each frame of the upload ring holds the uniforms, the views, and a full set of particle
+	// instances, plus room to align each of them. Pulled instances need a list of indices as well,
+	// and instances with sprites a byte each for those.
+	size_t upload_frame_size = sizeof(uniform_data) + sizeof(view_data) * max_views + 2 * size_t(uniform_buffer_alignment) + (num_particles + 1) * sizeof(particle_data) + num_particles * sizeof(uint32_t) + num_particles;
+	free_upload_ring(&frame_uploads);
+	if (!init_upload_ring(&frame_uploads, upload_frame_size, frame_upload_strategy))
+		printf("Error: couldn't create upload buffer :(\n");
+
+	// These are written and read only by the GPU, apart from newly spawned particles, hence the COPY usage hint.
+	for (GLuint buffer : feedback_particle_buffers)
+	{
+		state_bind_buffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, num_particles * sizeof(particle_data), nullptr, GL_DYNAMIC_COPY);
+		set_gpu_memory(gpu_memory_buffer, buffer, int64_t(num_particles * sizeof(particle_data)));
+	}
+
+	// This one is only written when particles spawn, and read every frame
+	state_bind_buffer(GL_ARRAY_BUFFER, analytic_particle_buffer);
+	glBufferData(GL_ARRAY_BUFFER, num_particles * sizeof(particle_data), nullptr, GL_DYNAMIC_DRAW);
+	set_gpu_memory(gpu_memory_buffer, analytic_particle_buffer, int64_t(num_particles * sizeof(particle_data)));
+
+	if (compute_simulation_supported)
+	{
+		state_bind_buffer(GL_SHADER_STORAGE_BUFFER, compute_particle_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, num_particles * sizeof(particle_data), nullptr, GL_DYNAMIC_COPY);
+		state_bind_buffer(GL_SHADER_STORAGE_BUFFER, compute_draw_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, num_particles * sizeof(particle_data), nullptr, GL_DYNAMIC_COPY);
+		state_bind_buffer(GL_SHADER_STORAGE_BUFFER, compute_sort_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, gpu_sort_size(num_particles) * 2 * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+		set_gpu_memory(gpu_memory_buffer, compute_particle_buffer, int64_t(num_particles * sizeof(particle_data)));
+		set_gpu_memory(gpu_memory_buffer, compute_draw_buffer, int64_t(num_particles * sizeof(particle_data)));
+		set_gpu_memory(gpu_memory_buffer, compute_sort_buffer, int64_t(gpu_sort_size(num_particles) * 2 * sizeof(GLuint)));
+	}
+
+	label_gl_object(GL_BUFFER, feedback_particle_buffers[0], "feedback particles 0");
+	label_gl_object(GL_BUFFER, feedback_particle_buffers[1], "feedback particles 1");
+	label_gl_object(GL_BUFFER, analytic_particle_buffer, "analytic particles");
+	label_gl_object(GL_BUFFER, compute_particle_buffer, "compute particles");
+	label_gl_object(GL_BUFFER, compute_draw_buffer, "compute draw particles");
+	label_gl_object(GL_BUFFER, compute_sort_buffer, "compute sort items");
+
+	// The upload ring is a new buffer, so the vertex arrays reading from it have to be rebuilt
+	build_vertex_arrays();
+}
+
+void generate_particles(float timestep, int* out_first_spawned, int* out_num_spawned)
+{
+	CPU_PROFILE_SCOPE("generate_particles");
+
+	// Calculate how many particles each emitter generates, based on their emission rates
+	int particles_to_generate = update_emitters(&emitters, timestep);
+
+	// They're all born at the start of this frame's steps
+	float time = float(frame_start_sim_time(sim_clock));
+
+	// If there are more than fit in the ring, the first ones would just be overwritten by the
+	// last ones, so skip them
+	int num_to_skip = std::max(particles_to_generate - num_particles, 0);
+	next_particle_index = (next_particle_index + num_to_skip) % num_particles;
+
+	// Report which slots we're about to overwrite, so they can be sent to the GPU if needed.
+	// This range can wrap around the end of the array.
+	*out_first_spawned = next_particle_index;
+	*out_num_spawned = particles_to_generate - num_to_skip;
+	add_perf_counter(particles_spawned_counter, *out_num_spawned);
+
+	// Each emitter's particles go into the ring one run after another, starting where the last
+	// emitter's left off, so all the emitters share the one pool and it's drawn all together
+	compute_emit_batches.clear();
+	int num_emitted = 0;
+	for (int i = 0; i < emitters.count; ++i)
+	{
+		const particle_emitter& emitter = emitters.emitters[i];
+		int skipped = std::min(emitter.spawn_count, num_to_skip);
+		num_to_skip -= skipped;
+		int num_to_spawn = emitter.spawn_count - skipped;
+		if (num_to_spawn == 0)
+			continue;
+
+		// The compute simulation creates its own particles on the GPU; we just tell it what to make
+		if (sim_mode == simulation_mode_compute)
+		{
+			compute_emit_batch batch =
+			{
+				{ emitter.position[0], emitter.position[1] },
+				{ emitter.velocity_min[0], emitter.velocity_min[1] },
+				{ emitter.velocity_max[0], emitter.velocity_max[1] },
+				{ emitter.spin_min, emitter.spin_max },
+				{ emitter.log2_size_min, emitter.log2_size_max },
+				num_emitted, num_to_spawn,
+			};
+			compute_emit_batches.push_back(batch);
+			next_particle_index = (next_particle_index + num_to_spawn) % num_particles;
+			num_emitted += num_to_spawn;
+			continue;
+		}
+
+		// Generate the particles by writing into the particles data arrays. The run of new particles
+		// wraps around to the beginning of the ring once it gets to the end, so it's done in up to two
+		// pieces; big bursts are split across threads, which doesn't change the results.
+		while (num_to_spawn > 0)
+		{
+			int batch = std::min(num_to_spawn, num_particles - next_particle_index);
+			spawn_job_data job_data = { &emitter, next_particle_index, spawn_counter, time };
+			parallel_for(batch, int(particle_array_alignment / sizeof(float)), &spawn_particles_job, &job_data);
+
+			spawn_counter += uint32_t(batch);
+			next_particle_index = (next_particle_index + batch) % num_particles;
+			num_to_spawn -= batch;
+		}
+	}
+	if (sim_mode == simulation_mode_compute)
+		return;
+
+	// These are the only particles the GPU simulation doesn't already know about
+	mark_particles_dirty(&particles, *out_first_spawned, *out_num_spawned);
+	spawn_live_particles(&particles, next_particle_index, *out_num_spawned);
+}
+
+// Parameters shared by all the simulation jobs for one step
+struct simulate_job_data
+{
+	int first;			// index of the particle that job item 0 corresponds to
+	float timestep;
+	float gravity;
+	int num_steps;
+
+	// The force field to push them with after the step, if it's on, in which case there's only the one
+	const force_field* forces;
+	float force_strength;
+	float force_offset[2];
+
+	// For the fused upload, where to write the range's particles, and which those are; the extra ones
+	// at the start that the alignment took in are simulated, but not written
+	particle_data* out;
+	int out_first;
+	int out_end;
+	float oldest_creation_time;
+};
+
+void simulate_particles_job(void* data, int begin, int end)
+{
+	const simulate_job_data* job_data = (const simulate_job_data*)data;
+	if (!job_data->out && !job_data->forces)
+	{
+		simulate_kernel_fn(&particles, job_data->first + begin, end - begin, job_data->timestep, job_data->gravity, job_data->num_steps);
+		return;
+	}
+
+	// Push each block through the force field, and write it out, while it's still in the cache, so
+	// it's only read from memory the once
+	for (int block = job_data->first + begin, last = job_data->first + end; block < last; block += fused_block_size)
+	{
+		int block_end = std::min(block + fused_block_size, last);
+		simulate_kernel_fn(&particles, block, block_end - block, job_data->timestep, job_data->gravity, job_data->num_steps);
+		if (job_data->forces)
+			apply_force_field(*job_data->forces, &particles, block, block_end - block, job_data->force_strength, job_data->force_offset, job_data->timestep);
+		if (!job_data->out)
+			continue;
+		int write_first = std::max(block, job_data->out_first);
+		int write_end = std::min(block_end, job_data->out_end);
+		if (write_first < write_end)
+			stream_particle_instances(particles, write_first, write_end - write_first, job_data->oldest_creation_time, kill_height, job_data->out + (write_first - job_data->out_first));
+	}
+}
+
+// Whether simulate_particles() can write this frame's particles straight into the uploads: the
+// render only draws them from there when it culls on the GPU, and the collisions move them after
+// the kernels are done with them
+bool fused_upload_usable()
+{
+	return use_fused_upload && !use_vulkan && sim_mode == simulation_mode_cpu && gpu_culling_usable() &&
+		(scene_render_mode == render_mode_raster || scene_render_mode == render_mode_hybrid) &&
+		!particle_collisions.load(std::memory_order_relaxed) && !colliders_enabled.load(std::memory_order_relaxed);
+}
+
+void simulate_particles(float timestep, int num_steps, bool fuse_upload)
+{
+	CPU_PROFILE_SCOPE("simulate_particles");
+
+	if (num_steps == 0)
+		return;
+
+	// Collisions are resolved, and the force field pushes, after every step, so then the kernel can
+	// only take one at a time
+	bool colliding = particle_collisions.load(std::memory_order_relaxed);
+	bool hitting_colliders = colliders_enabled.load(std::memory_order_relaxed) && colliders.distances;
+	const force_field* forces = (turbulence_enabled.load(std::memory_order_relaxed) && turbulence.forces) ? &turbulence : nullptr;
+	bool only_gravity = !colliding && !hitting_colliders && !forces;
+	int steps_per_pass = only_gravity ? num_steps : 1;
+
+	// The simulation LOD can only leave particles behind while gravity's all that's moving them;
+	// otherwise, any it's left have to catch up first
+	float view_size[2] = { sim_view_size[0].load(std::memory_order_relaxed), sim_view_size[1].load(std::memory_order_relaxed) };
+	bool use_lod = use_simulation_lod && only_gravity && view_size[0] > 0.0f;
+#if VERIFY_SIMULATION
+	use_lod = false;
+#endif
+	if (!use_lod)
+		catch_up_all_blocks(&sim_lod, &particles, simulate_kernel_fn, timestep, gravity);
+
+	// The fused upload takes the whole live window, in ring order. It's only ever asked for on the
+	// main thread, which owns the uploads.
+	if (fuse_upload && steps_per_pass == num_steps)
+	{
+		fused_particle_upload = allocate_upload(&frame_uploads, size_t(particles.live_count) * sizeof(particle_data), sizeof(particle_data));
+		if (fused_particle_upload.memory)
+			fused_particle_count = particles.live_count;
+	}
+
+	if (use_lod)
+	{
+		// The view the render culls against, grown as it does by how far a particle can go in the
+		// step it interpolates back over
+		float margin = timestep * max_particle_speed;
+		float center_y = 0.4f * world_size;
+		simulation_lod_frame lod_frame =
+		{
+			simulate_kernel_fn, timestep, gravity, num_steps,
+			{ { -0.5f * view_size[0] - margin, center_y - 0.5f * view_size[1] - margin }, { 0.5f * view_size[0] + margin, center_y + 0.5f * view_size[1] + margin } },
+			max_particle_speed,
+			(particle_data*)fused_particle_upload.memory, float(sim_clock.sim_time) - max_particle_age, kill_height,
+		};
+		add_perf_counter(particles_left_behind_counter, simulate_particle_blocks(&sim_lod, &particles, lod_frame));
+		kill_particles(&particles, float(sim_clock.sim_time), max_particle_age, kill_height);
+		return;
+	}
+
+	for (int pass = 0; pass < num_steps; pass += steps_per_pass)
+	{
+		// Where the force field's pattern has got to by the end of the step
+		float force_offset[2] = { 0.0f, 0.0f };
+		if (forces)
+			get_force_field_offset(frame_start_sim_time(sim_clock) + double(pass + 1) * timestep, force_offset);
+
+		// Only simulate the part of the ring that has live particles in it
+		particle_range ranges[2];
+		int num_ranges = get_live_particle_ranges(particles, ranges);
+		particle_data* out = (particle_data*)fused_particle_upload.memory;
+		for (int i = 0; i < num_ranges; ++i)
+		{
+			// Start each range on a cache line boundary, so the jobs' chunks do too. The few extra
+			// particles this takes in are dead, so it doesn't matter what happens to them, unless
+			// the window has wrapped right round to meet itself.
+			const int alignment = int(particle_array_alignment / sizeof(float));
+			int first = ranges[i].first / alignment * alignment;
+			if (i == 0 && num_ranges == 2)
+				first = std::max(first, ranges[1].count);
+			int count = ranges[i].first + ranges[i].count - first;
+
+#if VERIFY_SIMULATION
+			// The verification pass shares one scratch buffer, so it runs single-threaded
+			verify_simulate_kernel(simulate_kernel_fn, &particles, first, count, timestep, gravity, steps_per_pass);
+			if (forces)
+				apply_force_field(*forces, &particles, first, count, turbulence_strength, force_offset, timestep);
+			if (out)
+				stream_particle_instances(particles, ranges[i].first, ranges[i].count, float(sim_clock.sim_time) - max_particle_age, kill_height, out);
+#else
+			// Split the particles up across all threads
+			simulate_job_data job_data = { first, timestep, gravity, steps_per_pass, forces, turbulence_strength, { force_offset[0], force_offset[1] },
+				out, ranges[i].first, ranges[i].first + ranges[i].count, float(sim_clock.sim_time) - max_particle_age };
+			parallel_for(count, alignment, &simulate_particles_job, &job_data);
+#endif
+			if (out)
+				out += ranges[i].count;
+		}
+
+		if (colliding)
+		{
+			CPU_PROFILE_SCOPE("collide_particles");
+			if (!collide_particles(&collision_grid, &particles, particle_restitution))
+			{
+				log_message(log_warning, 0, "Warning: couldn't allocate the collision grid; turning collisions off!");
+				particle_collisions.store(false, std::memory_order_relaxed);
+				colliding = false;
+			}
+		}
+
+		// The colliders go last, so particles the others pushed into them don't stay there
+		if (hitting_colliders)
+		{
+			CPU_PROFILE_SCOPE("collide_particles_with_field");
+			collide_particles_with_field(colliders, &particles, particle_restitution);
+		}
+	}
+
+	// Now get rid of any that have fallen out of the world or got too old
+	kill_particles(&particles, float(sim_clock.sim_time), max_particle_age, kill_height);
+}
+
+// Copy particles [first, first + count) from the CPU particle store into a GPU particle buffer.
+// The range may wrap around the end of the array, as a run of newly spawned particles can.
+void upload_particle_range(GLuint buffer, int first, int count)
+{
+	// Small ranges (the usual case: a frame's worth of spawns) are packed into a staging array
+	// on the stack and sent with glBufferSubData. Bigger ones are packed straight into the buffer
+	// through a mapping of just that range, so we don't copy them twice.
+	static const int staging_size = 256;
+	particle_data staging[staging_size];
+
+	state_bind_buffer(GL_ARRAY_BUFFER, buffer);
+	while (count > 0)
+	{
+		int batch = std::min(count, num_particles - first);
+		GLintptr offset = first * sizeof(particle_data);
+		GLsizeiptr size = batch * sizeof(particle_data);
+		if (batch <= staging_size)
+		{
+			pack_particle_instances(particles, first, batch, staging);
+			glBufferSubData(GL_ARRAY_BUFFER, offset, size, staging);
+		}
+		else if (void* mapped_buffer = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT))
+		{
+			pack_particle_instances(particles, first, batch, (particle_data*)mapped_buffer);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+		else
+		{
+			log_message(log_warning, 0, "Warning: couldn't map particle buffer for upload!");
+		}
+		first = (first + batch) % num_particles;
+		count -= batch;
+	}
+}
+
+// Bring a GPU particle buffer up to date by sending it only the particles that changed on the CPU
+// since the last time. Everything else in it is already current.
+void upload_dirty_particles(GLuint buffer)
+{
+	CPU_PROFILE_SCOPE("upload_dirty_particles");
+	particle_range ranges[2];
+	int num_ranges = take_dirty_particle_ranges(&particles, ranges);
+	for (int i = 0; i < num_ranges; ++i)
+		upload_particle_range(buffer, ranges[i].first, ranges[i].count);
+}
+
+void simulate_particles_on_gpu(float timestep, int num_steps)
+{
+	GLuint source_buffer = feedback_particle_buffers[feedback_source_index];
+	GLuint dest_buffer = feedback_particle_buffers[1 - feedback_source_index];
+
+	// The CPU only knows the particles' ages, not where they are; the shader kills the ones that fall
+	// out of the world. Since the oldest particles are always at the start of the live window, that's
+	// enough to keep it from growing.
+	kill_particles(&particles, float(sim_clock.sim_time), max_particle_age, -INFINITY);
+
+	// Newly spawned particles were created on the CPU, so copy just those into the current state
+	upload_dirty_particles(source_buffer);
+
+	// If the simulation shader didn't compile, leave the particles where they are.
+	// And if there are no steps to take this frame, they're already where they should be.
+	if (!simulate_shader_program || num_steps == 0)
+		return;
+
+	state_use_program(simulate_shader_program);
+	glUniform1f(glGetUniformLocation(simulate_shader_program, "timestep"), timestep);
+	glUniform1i(glGetUniformLocation(simulate_shader_program, "num_steps"), num_steps);
+	glUniform1f(glGetUniformLocation(simulate_shader_program, "gravity"), gravity);
+	glUniform1f(glGetUniformLocation(simulate_shader_program, "kill_height"), kill_height);
+	bind_collider_field(simulate_shader_program);
+	bind_force_field(simulate_shader_program, timestep);
+
+	// The particle state is read from the source buffer as ordinary per-vertex attributes: one vertex per particle.
+	state_bind_vertex_array(simulate_vertex_arrays[feedback_source_index]);
+
+	// Run the simulation shader over each range of the ring that has live particles, capturing its
+	// outputs into the same range of the other buffer. Nothing needs to be rasterized, so turn that
+	// off entirely. The rest of the other buffer is left stale, but it's all dead particles anyway.
+	particle_range ranges[2];
+	int num_ranges = get_live_particle_ranges(particles, ranges);
+	glEnable(GL_RASTERIZER_DISCARD);
+	for (int i = 0; i < num_ranges; ++i)
+	{
+		// The captured vertices are written from the start of the bound range, wherever the draw starts reading
+		GLintptr offset = ranges[i].first * sizeof(particle_data);
+		state_bind_buffer_range(GL_TRANSFORM_FEEDBACK_BUFFER, 0, dest_buffer, offset, ranges[i].count * sizeof(particle_data));
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, ranges[i].first, ranges[i].count);
+		add_perf_counter(draw_calls_counter, 1);
+		glEndTransformFeedback();
+	}
+	glDisable(GL_RASTERIZER_DISCARD);
+	state_bind_buffer_base(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+
+	// The buffer we just wrote is now the current state
+	feedback_source_index = 1 - feedback_source_index;
+}
+
+void simulate_particles_with_compute(float timestep, int num_steps, int first_spawned, int num_spawned)
+{
+	// If either compute shader didn't compile, leave the particles where they are
+	if (!emit_compute_program || !simulate_compute_program)
+		return;
+
+	state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 0, compute_particle_buffer);
+
+	// Emit this frame's new particles into the ring. All the emitters' runs are done in one dispatch.
+	if (num_spawned > 0)
+	{
+		// Each frame gets a different random seed, from a Weyl sequence
+		static GLuint emit_seed = random_seed;
+		emit_seed += 0x9e3779b9u;
+
+		state_bind_buffer(GL_SHADER_STORAGE_BUFFER, compute_emit_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, compute_emit_batches.size() * sizeof(compute_emit_batch), compute_emit_batches.data(), GL_STREAM_DRAW);
+		set_gpu_memory(gpu_memory_buffer, compute_emit_buffer, int64_t(compute_emit_batches.size() * sizeof(compute_emit_batch)));
+		state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 1, compute_emit_buffer);
+
+		state_use_program(emit_compute_program);
+		glUniform1i(glGetUniformLocation(emit_compute_program, "first_index"), first_spawned);
+		glUniform1i(glGetUniformLocation(emit_compute_program, "emit_count"), num_spawned);
+		glUniform1i(glGetUniformLocation(emit_compute_program, "num_batches"), int(compute_emit_batches.size()));
+		glUniform1i(glGetUniformLocation(emit_compute_program, "capacity"), num_particles);
+		glUniform1f(glGetUniformLocation(emit_compute_program, "time"), float(frame_start_sim_time(sim_clock)));
+		glUniform1ui(glGetUniformLocation(emit_compute_program, "seed"), emit_seed);
+		glDispatchCompute((num_spawned + 63) / 64, 1, 1);
+
+		// The simulation pass reads what we just wrote
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	// Integrate all the live particles
+	state_use_program(simulate_compute_program);
+	glUniform1f(glGetUniformLocation(simulate_compute_program, "timestep"), timestep);
+	glUniform1i(glGetUniformLocation(simulate_compute_program, "num_steps"), num_steps);
+	glUniform1f(glGetUniformLocation(simulate_compute_program, "gravity"), gravity);
+	glUniform1f(glGetUniformLocation(simulate_compute_program, "kill_height"), kill_height);
+	glUniform1f(glGetUniformLocation(simulate_compute_program, "oldest_creation_time"), float(sim_clock.sim_time) - max_particle_age);
+	glUniform1i(glGetUniformLocation(simulate_compute_program, "capacity"), num_particles);
+	bind_collider_field(simulate_compute_program);
+	bind_force_field(simulate_compute_program, timestep);
+	glDispatchCompute((num_particles + 255) / 256, 1, 1);
+
+	// Make the results visible to the culling pass, and to reading back
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+// The hybrid scene's ball, where it stops, and a floor just below the fountains
+void make_default_colliders(std::vector<collider_shape>* o_shapes)
+{
+	collider_shape ball = { collider_circle, { 0.0f, 0.4f * world_size }, { ball_radius, 0.0f } };
+	collider_shape floor = { collider_plane, { 0.0f, -1.0f }, { 0.0f, 1.0f } };
+	o_shapes->push_back(ball);
+	o_shapes->push_back(floor);
+}
+
+// Point a simulation program (the current one) at the colliders' distance field, on texture unit 3
+void bind_collider_field(GLuint program)
+{
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, collider_field_texture);
+	glActiveTexture(GL_TEXTURE0);
+	bool enabled = colliders_enabled.load(std::memory_order_relaxed) && collider_field_texture != 0;
+	glUniform1i(glGetUniformLocation(program, "use_collider_field"), enabled);
+	glUniform1i(glGetUniformLocation(program, "collider_field"), 3);
+	glUniform2fv(glGetUniformLocation(program, "collider_field_origin"), 1, colliders.origin);
+	glUniform1f(glGetUniformLocation(program, "collider_field_scale"), 1.0f / colliders.cell_size);
+	glUniform1f(glGetUniformLocation(program, "collider_restitution"), particle_restitution);
+}
+
+// How far the force field's pattern has drifted by the given sim time. It's wrapped to within the
+// tile, which looks the same, so it doesn't lose precision as the time goes on.
+void get_force_field_offset(double time, float o_offset[2])
+{
+	double tile_size = double(turbulence.width) * double(turbulence.cell_size);
+	for (int axis = 0; axis < 2; ++axis)
+		o_offset[axis] = float(fmod(double(force_field_wind[axis]) * time, tile_size));
+}
+
+// Point a simulation program (the current one) at the force field, on texture unit 11, for this
+// frame's steps
+void bind_force_field(GLuint program, float timestep)
+{
+	glActiveTexture(GL_TEXTURE11);
+	glBindTexture(GL_TEXTURE_2D, force_field_texture);
+	glActiveTexture(GL_TEXTURE0);
+	bool enabled = turbulence_enabled.load(std::memory_order_relaxed) && force_field_texture != 0;
+	float offset[2] = { 0.0f, 0.0f };
+	if (enabled)
+		get_force_field_offset(frame_start_sim_time(sim_clock) + timestep, offset);
+	float step_offset[2] = { force_field_wind[0] * timestep, force_field_wind[1] * timestep };
+	glUniform1i(glGetUniformLocation(program, "use_force_field"), enabled);
+	glUniform1i(glGetUniformLocation(program, "force_field"), 11);
+	glUniform1f(glGetUniformLocation(program, "force_field_scale"), 1.0f / force_field_cell_size);
+	glUniform2fv(glGetUniformLocation(program, "force_field_offset"), 1, offset);
+	glUniform2fv(glGetUniformLocation(program, "force_field_step_offset"), 1, step_offset);
+	glUniform1f(glGetUniformLocation(program, "force_field_strength"), turbulence_strength);
+}
+
+// Can we cull (and so draw) particles on the GPU? That takes all the passes from culling to
+// building the draws; sorting is optional.
+bool gpu_culling_usable()
+{
+	return compute_simulation_supported && cull_compute_program && draw_commands_compute_program && gather_compute_program;
+}
+
+// Can we simulate with compute shaders? Drawing from that simulation relies on culling on the GPU, too.
+bool compute_simulation_usable()
+{
+	return gpu_culling_usable() && emit_compute_program && simulate_compute_program;
+}
+
+void cull_particles_on_gpu(GLuint particle_buffer, const particle_range* ranges, int num_ranges, const cull_rect& visible, const particle_lod_sizes& lod_sizes, float time, particle_sort_order order, int views)
+{
+	// Reset the draw commands, one per LOD. The culling shader counts up the instances at each LOD
+	// as it finds visible particles.
+	gpu_particle_draws draws = {};
+	for (int lod = 0; lod < num_particle_lods; ++lod)
+	{
+		const particle_shape_lod& mesh = particle_shapes.shapes[0].lods[lod];
+		draws.draws[lod] = draw_elements_indirect_command{ GLuint(mesh.num_indices), 0, GLuint(mesh.first_index), GLuint(particle_shapes.shapes[0].first_vertex), 0 };
+	}
+	state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, compute_indirect_buffer);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(draws), &draws);
+
+	// The culling shader writes sort keys rather than particles, and the particles are copied
+	// into the draw buffer once the draws are laid out (and they're in order, if sorting)
+	bool sort_on_gpu = (order != particle_sort_none && sort_compute_program);
+
+	state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 0, particle_buffer);
+	state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 1, compute_draw_buffer);
+	state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 2, compute_sort_buffer);
+	state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 3, compute_indirect_buffer);
+	state_bind_buffer_base(GL_ATOMIC_COUNTER_BUFFER, 0, compute_indirect_buffer);
+
+	state_use_program(cull_compute_program);
+	glUniform2f(glGetUniformLocation(cull_compute_program, "lod_min_size"), lod_sizes.min_size[0], lod_sizes.min_size[1]);
+	glUniform1i(glGetUniformLocation(cull_compute_program, "sort_order"), sort_on_gpu ? int(order) : 0);
+	glUniform1f(glGetUniformLocation(cull_compute_program, "max_age"), max_particle_age);
+	glUniform2f(glGetUniformLocation(cull_compute_program, "visible_min"), visible.min[0], visible.min[1]);
+	glUniform2f(glGetUniformLocation(cull_compute_program, "visible_max"), visible.max[0], visible.max[1]);
+	glUniform1i(glGetUniformLocation(cull_compute_program, "analytic_motion"), sim_mode == simulation_mode_analytic);
+	glUniform1f(glGetUniformLocation(cull_compute_program, "time"), time);
+	glUniform1f(glGetUniformLocation(cull_compute_program, "gravity"), gravity);
+	glUniform1f(glGetUniformLocation(cull_compute_program, "kill_height"), kill_height);
+
+	// All the ranges append to the same list, so they can be drawn together
+	int max_count = 0;
+	for (int i = 0; i < num_ranges; ++i)
+	{
+		if (ranges[i].count == 0)
+			continue;
+		glUniform1i(glGetUniformLocation(cull_compute_program, "first_index"), ranges[i].first);
+		glUniform1i(glGetUniformLocation(cull_compute_program, "count"), ranges[i].count);
+		glDispatchCompute((ranges[i].count + 255) / 256, 1, 1);
+		max_count += ranges[i].count;
+	}
+
+	// Lay out the draws from the culling shader's counts, each drawing its instances once per view.
+	// Everything after this reads the counts straight out of the draw commands buffer.
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT);
+	state_use_program(draw_commands_compute_program);
+	glUniform1ui(glGetUniformLocation(draw_commands_compute_program, "num_views"), GLuint(views));
+	glDispatchCompute(1, 1, 1);
+
+	if (max_count > 0)
+	{
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		if (sort_on_gpu)
+			sort_particles_on_gpu(max_count);
+
+		// Copy the particles into the draw buffer: in sorted order, which groups them by LOD too,
+		// or else into each LOD's slice of it
+		state_use_program(gather_compute_program);
+		glUniform1i(glGetUniformLocation(gather_compute_program, "sorted"), sort_on_gpu);
+		glDispatchCompute((max_count + 255) / 256, 1, 1);
+	}
+
+	// Make the results visible to next frame's reset of the draw command. The render graph puts in
+	// the barrier for the draw, for however it reads them.
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+// Size of the GPU sort: a power of two, and at least a whole workgroup's worth
+// (this matches items_per_group in sort_compute_shader.glsl)
+int gpu_sort_size(int max_count)
+{
+	int size = 1024;
+	while (size < max_count)
+		size *= 2;
+	return size;
+}
+
+// Sort the culling pass's keys with a bitonic sort, using the buffers cull_particles_on_gpu() bound.
+// max_count is an upper bound on how many there are; the GPU knows the real number.
+void sort_particles_on_gpu(int max_count)
+{
+	static const int items_per_group = 1024;
+	int size = gpu_sort_size(max_count);
+	int num_groups = size / items_per_group;
+
+	// Sort each workgroup's worth, padding out the end
+	state_use_program(sort_compute_program);
+	GLint stage_location = glGetUniformLocation(sort_compute_program, "stage");
+	GLint merge_size_location = glGetUniformLocation(sort_compute_program, "merge_size");
+	GLint merge_distance_location = glGetUniformLocation(sort_compute_program, "merge_distance");
+	glUniform1i(stage_location, 0);
+	glDispatchCompute(num_groups, 1, 1);
+
+	// Then merge them together, a dispatch per step while the items being compared are in different
+	// workgroups, and then one more to finish each merge within the workgroups
+	for (int merge_size = 2 * items_per_group; merge_size <= size; merge_size *= 2)
+	{
+		glUniform1ui(merge_size_location, GLuint(merge_size));
+		for (int distance = merge_size / 2; distance >= items_per_group; distance /= 2)
+		{
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			glUniform1i(stage_location, 1);
+			glUniform1ui(merge_distance_location, GLuint(distance));
+			glDispatchCompute(num_groups, 1, 1);
+		}
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		glUniform1i(stage_location, 2);
+		glDispatchCompute(num_groups, 1, 1);
+	}
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+// Copy the whole particle state from a GPU buffer back into the CPU particle store.
+// This stalls until the GPU catches up, but only happens when the user switches modes.
+void read_back_particles(GLuint buffer)
+{
+	state_bind_buffer(GL_ARRAY_BUFFER, buffer);
+	if (const void* mapped_buffer = glMapBufferRange(GL_ARRAY_BUFFER, 0, num_particles * sizeof(particle_data), GL_MAP_READ_BIT))
+	{
+		unpack_particle_instances(&particles, 0, num_particles, (const particle_data*)mapped_buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	else
+	{
+		log_message(log_warning, 0, "Warning: couldn't map particle buffer to read back GPU simulation!");
+	}
+}
+
+void simulate_particles_analytically()
+{
+	// There's nothing to integrate: the vertex shader works out where each particle is from its
+	// creation state and the time. All we do is kill off old particles, as in the transform feedback
+	// simulation, and send the GPU the ones that were just spawned.
+	kill_particles(&particles, float(sim_clock.sim_time), max_particle_age, -INFINITY);
+	upload_dirty_particles(analytic_particle_buffer);
+}
+
+// Bring the particle state back to the CPU from wherever the current simulation mode keeps it
+void fetch_particles_from_gpu()
+{
+	if (sim_mode == simulation_mode_transform_feedback)
+	{
+		read_back_particles(feedback_particle_buffers[feedback_source_index]);
+	}
+	else if (sim_mode == simulation_mode_compute)
+	{
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		read_back_particles(compute_particle_buffer);
+
+		// The compute simulation spawns and kills particles without telling us, so we don't know
+		// which are alive any more. Start from the whole ring; the dead ones will be trimmed off.
+		reset_live_particles(&particles, next_particle_index);
+	}
+	else if (sim_mode == simulation_mode_analytic)
+	{
+		// The CPU already has the particles' creation state; just work out where they are now
+		advance_particles_from_creation(&particles, float(sim_clock.sim_time), gravity);
+	}
+	else
+	{
+		// Bring any the simulation LOD left behind up to now
+		catch_up_all_blocks(&sim_lod, &particles, simulate_kernel_fn, float(sim_clock.step), gravity);
+	}
+}
+
+// And the reverse: hand the whole CPU particle state over to the current simulation mode's buffer
+void send_particles_to_gpu()
+{
+	if (sim_mode == simulation_mode_transform_feedback)
+		upload_particle_range(feedback_particle_buffers[feedback_source_index], 0, num_particles);
+	else if (sim_mode == simulation_mode_compute)
+		upload_particle_range(compute_particle_buffer, 0, num_particles);
+	else if (sim_mode == simulation_mode_analytic)
+	{
+		// Work back from where the particles are now to where they'd have had to start for the
+		// analytic motion to bring them here
+		rewind_particles_to_creation(&particles, float(sim_clock.sim_time), gravity);
+		upload_particle_range(analytic_particle_buffer, 0, num_particles);
+	}
+	clear_dirty_particles(&particles);
+}
+
+void set_simulation_mode(simulation_mode mode)
+{
+	if (mode == sim_mode)
+		return;
+
+	stop_simulation_thread();
+	fetch_particles_from_gpu();
+	sim_mode = mode;
+	send_particles_to_gpu();
+	start_simulation_thread();
+
+	if (mode == simulation_mode_transform_feedback)
+		printf("Simulating particles on the GPU (transform feedback)\n");
+	else if (mode == simulation_mode_compute)
+		printf("Simulating particles on the GPU (compute shaders)\n");
+	else if (mode == simulation_mode_analytic)
+		printf("Simulating particles analytically in the vertex shader\n");
+	else
+		printf("Simulating particles on the CPU\n");
+}
+
+// Grow or shrink the particle ring while running. The particles that still fit are kept,
+// wherever they're currently being simulated.
+void set_particle_capacity(int capacity)
+{
+	capacity = std::max(1, std::min(capacity, max_num_particles));
+	if (capacity == num_particles)
+		return;
+
+	stop_simulation_thread();
+	fetch_particles_from_gpu();
+	if (!resize_particle_store(&particles, capacity))
+	{
+		printf("Warning: couldn't allocate storage for %d particles!\n", capacity);
+		start_simulation_thread();
+		return;
+	}
+
+	num_particles = capacity;
+	if (next_particle_index >= num_particles)
+		next_particle_index = 0;
+	if (!init_simulation_lod(&sim_lod, capacity))
+	{
+		printf("Warning: couldn't allocate the simulation LOD's blocks; every particle's stepped every frame!\n");
+		use_simulation_lod = false;
+	}
+	if (!resize_particle_sort_buffers(&sort_buffers, capacity))
+		printf("Warning: couldn't allocate space to sort %d particles; they'll be drawn unsorted!\n", capacity);
+	reset_live_particles(&particles, next_particle_index);
+
+	allocate_particle_buffers();
+	send_particles_to_gpu();
+	printf("Particle capacity is now %d\n", num_particles);
+
+	// The snapshots have to match the store
+	if (!init_particle_snapshot_buffer(&particle_snapshots, capacity))
+	{
+		printf("Warning: couldn't allocate particle snapshots; simulating on the main thread!\n");
+		use_simulation_thread = false;
+	}
+	start_simulation_thread();
+}
+
+bool parse_command_line(int argc, const char** argv)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		// Options either take one value, which follows them, or none
+		const char* option = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		char* value_end = nullptr;
+
+		if (strcmp(option, "--particles") == 0 && value)
+		{
+			long capacity = strtol(value, &value_end, 10);
+			if (*value_end != '\0' || capacity < 1 || capacity > max_num_particles)
+			{
+				printf("Error: --particles must be between 1 and %d :(\n", max_num_particles);
+				return false;
+			}
+			num_particles = int(capacity);
+			++i;
+		}
+		else if (strcmp(option, "--rate") == 0 && value)
+		{
+			double rate = strtod(value, &value_end);
+			if (*value_end != '\0' || !(rate >= 0.0))
+			{
+				printf("Error: --rate must be a non-negative number of particles per second :(\n");
+				return false;
+			}
+			particles_per_second = float(rate);
+			++i;
+		}
+		else if (strcmp(option, "--emitters") == 0 && value)
+		{
+			long count = strtol(value, &value_end, 10);
+			if (*value_end != '\0' || count < 1 || count > max_num_emitters)
+			{
+				printf("Error: --emitters must be between 1 and %d :(\n", max_num_emitters);
+				return false;
+			}
+			num_emitters = int(count);
+			++i;
+		}
+		else if (strcmp(option, "--sim-rate") == 0 && value)
+		{
+			double rate = strtod(value, &value_end);
+			if (*value_end != '\0' || !(rate >= 1.0))
+			{
+				printf("Error: --sim-rate must be at least 1 step per second :(\n");
+				return false;
+			}
+			simulation_rate = rate;
+			++i;
+		}
+		else if (strcmp(option, "--seed") == 0 && value)
+		{
+			unsigned long seed = strtoul(value, &value_end, 0);
+			if (*value_end != '\0')
+			{
+				printf("Error: --seed must be an integer :(\n");
+				return false;
+			}
+			random_seed = uint32_t(seed);
+			++i;
+		}
+		else if (strcmp(option, "--packed-instances") == 0)
+		{
+			packed_instances = true;
+		}
+		else if (strcmp(option, "--no-sim-thread") == 0)
+		{
+			use_simulation_thread = false;
+		}
+		else if (strcmp(option, "--no-fused-upload") == 0)
+		{
+			use_fused_upload = false;
+		}
+		else if (strcmp(option, "--no-sim-lod") == 0)
+		{
+			use_simulation_lod = false;
+		}
+		else if (strcmp(option, "--no-occlusion-culling") == 0)
+		{
+			use_occlusion_culling = false;
+		}
+		else if (strcmp(option, "--weighted-transparency") == 0)
+		{
+			weighted_transparency = true;
+		}
+		else if (strcmp(option, "--views") == 0 && value)
+		{
+			long views = strtol(value, &value_end, 10);
+			if (*value_end != '\0' || views < 1 || views > max_views)
+			{
+				printf("Error: --views must be from 1 to %d :(\n", max_views);
+				return false;
+			}
+			num_views = int(views);
+			++i;
+		}
+		else if (strcmp(option, "--pull-instances") == 0)
+		{
+			pull_instances = true;
+		}
+		else if (strcmp(option, "--shapes") == 0)
+		{
+			mixed_shapes = true;
+		}
+		else if (strcmp(option, "--shape") == 0 && value)
+		{
+			shape_files.push_back(value);
+			mixed_shapes = true;
+			++i;
+		}
+		else if (strcmp(option, "--sprite") == 0 && value)
+		{
+			sprite_files.push_back(value);
+			++i;
+		}
+		else if (strcmp(option, "--lights") == 0 && value)
+		{
+			long count = strtol(value, &value_end, 10);
+			if (*value_end != '\0' || count < 0 || count > max_point_lights_limit)
+			{
+				printf("Error: --lights must be between 0 and %d :(\n", max_point_lights_limit);
+				return false;
+			}
+			max_point_lights = int(count);
+			++i;
+		}
+		else if (strcmp(option, "--trails") == 0)
+		{
+			motion_trails = true;
+		}
+		else if (strcmp(option, "--collisions") == 0)
+		{
+			particle_collisions.store(true);
+		}
+		else if (strcmp(option, "--colliders") == 0 && value)
+		{
+			if (!load_collider_shapes(value, &collider_shapes))
+			{
+				printf("Error: couldn't read colliders from %s :(\n", value);
+				return false;
+			}
+			colliders_enabled.store(true);
+			++i;
+		}
+		else if (strcmp(option, "--turbulence") == 0 && value)
+		{
+			turbulence_strength = float(strtod(value, &value_end));
+			if (*value_end != '\0' || !(turbulence_strength > 0.0f))
+			{
+				printf("Error: --turbulence must be greater than 0 :(\n");
+				return false;
+			}
+			turbulence_enabled.store(true);
+			++i;
+		}
+		else if (strcmp(option, "--sort") == 0 && value)
+		{
+			int order = 0;
+			while (order < num_particle_sort_orders && strcmp(value, sort_order_names[order]) != 0)
+				++order;
+			if (order == num_particle_sort_orders)
+			{
+				printf("Error: --sort must be none, age or size :(\n");
+				return false;
+			}
+			sort_order = particle_sort_order(order);
+			++i;
+		}
+		else if (strcmp(option, "--sim-mode") == 0 && value)
+		{
+			int mode = 0;
+			while (mode < num_simulation_modes && strcmp(value, simulation_mode_names[mode]) != 0)
+				++mode;
+			if (mode == num_simulation_modes)
+			{
+				printf("Error: --sim-mode must be cpu, feedback, compute or analytic :(\n");
+				return false;
+			}
+			requested_sim_mode = simulation_mode(mode);
+			sim_mode_chosen = true;
+			++i;
+		}
+		else if (strcmp(option, "--benchmark") == 0 && value)
+		{
+			long frames = strtol(value, &value_end, 10);
+			if (*value_end != '\0' || frames < 1)
+			{
+				printf("Error: --benchmark must be a positive number of frames :(\n");
+				return false;
+			}
+			benchmark_frames = int(frames);
+			++i;
+		}
+		else if (strcmp(option, "--benchmark-output") == 0 && value)
+		{
+			benchmark_output = value;
+			++i;
+		}
+		else if (strcmp(option, "--raytrace-budget") == 0 && value)
+		{
+			double budget = strtod(value, &value_end);
+			if (*value_end != '\0' || !(budget >= 0.0))
+			{
+				printf("Error: --raytrace-budget must be a number of milliseconds, or 0 for full resolution :(\n");
+				return false;
+			}
+			raytrace_budget_ms = float(budget);
+			++i;
+		}
+		else if (strcmp(option, "--gpu-memory-budget") == 0 && value)
+		{
+			double megabytes = strtod(value, &value_end);
+			if (*value_end != '\0' || !(megabytes >= 0.0))
+			{
+				printf("Error: --gpu-memory-budget must be a number of megabytes, or 0 to go by the driver :(\n");
+				return false;
+			}
+			gpu_memory_budget_bytes = int64_t(megabytes * 1024.0 * 1024.0);
+			++i;
+		}
+		else if (strcmp(option, "--threads") == 0 && value)
+		{
+			if (!parse_thread_config(value))
+				return false;
+			++i;
+		}
+		else if (strcmp(option, "--threads-file") == 0 && value)
+		{
+			if (!load_thread_config(value))
+				return false;
+			++i;
+		}
+		else if (strcmp(option, "--dedicated-render-core") == 0)
+		{
+			parse_thread_config("render=dedicated");
+		}
+		else if (strcmp(option, "--all-monitors") == 0)
+		{
+			use_all_monitors = true;
+		}
+		else if (strcmp(option, "--cpu-raytrace") == 0)
+		{
+			use_cpu_raytrace = true;
+		}
+		else if (strcmp(option, "--cpu-raytrace-output") == 0 && value)
+		{
+			use_cpu_raytrace = true;
+			cpu_raytrace_output = value;
+			++i;
+		}
+		else if (strcmp(option, "--particle-resolution") == 0 && value)
+		{
+			int mode = 0;
+			while (mode < num_particle_resolution_modes && strcmp(value, particle_resolution_names[mode]) != 0)
+				++mode;
+			if (mode == num_particle_resolution_modes)
+			{
+				printf("Error: --particle-resolution must be full, half, quarter or auto :(\n");
+				return false;
+			}
+			particle_resolution = particle_resolution_mode(mode);
+			++i;
+		}
+		else if (strcmp(option, "--particle-budget") == 0 && value)
+		{
+			double budget = strtod(value, &value_end);
+			if (*value_end != '\0' || !(budget > 0.0))
+			{
+				printf("Error: --particle-budget must be a number of milliseconds :(\n");
+				return false;
+			}
+			particle_budget_ms = float(budget);
+			++i;
+		}
+		else if (strcmp(option, "--upload") == 0 && value)
+		{
+			int strategy = 0;
+			while (strategy < num_upload_strategies && strcmp(value, upload_strategy_names[strategy]) != 0)
+				++strategy;
+			if (strategy == num_upload_strategies)
+			{
+				printf("Error: --upload must be one of persistent, unsynchronized, invalidate, orphan or subdata :(\n");
+				return false;
+			}
+			frame_upload_strategy = upload_strategy(strategy);
+			upload_strategy_chosen = true;
+			++i;
+		}
+		else if (strcmp(option, "--no-shader-cache") == 0)
+		{
+			use_shader_cache = false;
+		}
+		else if (strcmp(option, "--capture") == 0 && value)
+		{
+			capture_filename = value;
+			render_on_demand = false;
+			++i;
+		}
+		else if (strcmp(option, "--continuous") == 0)
+		{
+			render_on_demand = false;
+		}
+		else if (strcmp(option, "--renderer") == 0 && value)
+		{
+			if (strcmp(value, "gl") != 0 && strcmp(value, "vulkan") != 0)
+			{
+				printf("Error: --renderer must be gl or vulkan :(\n");
+				return false;
+			}
+			use_vulkan = (strcmp(value, "vulkan") == 0);
+#if !VULKAN_RENDERER
+			if (use_vulkan)
+			{
+				printf("Error: --renderer vulkan needs a build with WORKSHOP01_VULKAN turned on :(\n");
+				return false;
+			}
+#endif
+			++i;
+		}
+		else if (strcmp(option, "--cpu-trace") == 0 && value)
+		{
+			cpu_trace_filename = value;
+			write_cpu_trace_at_exit = true;
+			++i;
+		}
+		else if (strcmp(option, "--save-snapshot") == 0 && value)
+		{
+			snapshot_save_filename = value;
+			save_snapshot_at_exit = true;
+			++i;
+		}
+		else if (strcmp(option, "--load-snapshot") == 0 && value)
+		{
+			snapshot_load_filename = value;
+			++i;
+		}
+		else if (strcmp(option, "--record") == 0 && value)
+		{
+			replay_record_filename = value;
+			++i;
+		}
+		else if (strcmp(option, "--replay") == 0 && value)
+		{
+			replay_play_filename = value;
+			++i;
+		}
+		else if (strcmp(option, "--counters") == 0 && value)
+		{
+			counters_csv_filename = value;
+			++i;
+		}
+		else if (strcmp(option, "--counters-shm") == 0 && value)
+		{
+			counters_shared_memory_name = value;
+			++i;
+		}
+		else
+		{
+			printf("Error: unrecognized option %s :(\n", option);
+			printf("Usage: workshop01 [--particles <capacity>] [--rate <particles per second>] [--emitters <count>] [--sim-rate <steps per second>] [--seed <n>] [--packed-instances] [--no-sim-thread] [--sort none|age|size] [--sim-mode cpu|feedback|compute|analytic] [--benchmark <frames>] [--benchmark-output <file>] [--raytrace-budget <ms>] [--gpu-memory-budget <MB>] [--threads <settings>] [--threads-file <file>] [--dedicated-render-core] [--cpu-raytrace] [--cpu-raytrace-output <file>] [--particle-resolution full|half|quarter|auto] [--particle-budget <ms>] [--no-sim-lod] [--no-occlusion-culling] [--weighted-transparency] [--views <1-4>] [--all-monitors] [--no-shader-cache] [--continuous] [--capture <file>] [--renderer gl|vulkan] [--cpu-trace <file>] [--save-snapshot <file>] [--load-snapshot <file>] [--record <file>] [--replay <file>] [--counters <file>] [--counters-shm <name>]\n");
+			return false;
+		}
+	}
+	return true;
+}
+
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-	float window_size[2];		// window size in world space
-	float window_center[2];		// window center in world space
-	float light_dir[3];			// direction of a moving light source
-	float time;					// current simulation time in seconds
-};
-
-// Global variables
-static const int	num_particles = 1000;
-particle_data		particles[num_particles] = {};
-int					num_vertices_per_particle = 0;
-
-GLFWwindow*			window = nullptr;
-GLuint				quad_vertex_buffer = 0;
-GLuint				vertex_buffer = 0;
-GLuint				particle_buffer = 0;
-GLuint				uniform_buffer = 0;
-
-GLuint				particle_shader_program = 0;
-GLuint				raytrace_shader_program = 0;
-time_t				vertex_shader_mtime = 0;
-time_t				fragment_shader_mtime = 0;
-time_t				quad_vertex_shader_mtime = 0;
-time_t				raytrace_shader_mtime = 0;
-
-bool raytrace_mode = false;
-
-// Pre-declare functions we'll use later
-void init_graphics();
-void render_frame();
-void generate_particles(float timestep);
-void simulate_particles(float timestep);
-void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
-void window_resize_callback(GLFWwindow* window, int width, int height);
-void APIENTRY debug_message_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* msg, const void* data);
-void load_all_shaders();
-void load_shaders(const char* vertex_shader_file, const char* fragment_shader_file, time_t* vertex_shader_time_ptr, time_t* fragment_shader_time_ptr, GLuint* out_program);
-void reload_shaders_if_changed();
-
-
+	// Playing back, only the recording's keys count, but Escape still stops it
+	if (replay.playing && !dispatching_replayed_keys && key != GLFW_KEY_ESCAPE)
+		return;
+	record_replay_key_event(&replay, key, scancode, action, mods);
 
-// Everything starts here!
-int main (int, const char **)
-{
-	printf("Starting up!\n");
+	// Most keys change something on screen, even if it's only in the overlay
+	redraw_requested = true;
 
-	// Initialize the library
-	if (!glfwInit())
+	// Close the window when the user presses Escape
+	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 	{
-		printf("Error: couldn't initialize GLFW :(\n");
-		return -1;
+		glfwSetWindowShouldClose(window, true);
 	}
 
-	// Tell GLFW we want debugging support enabled
-	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
-
-	// Tell GLFW we want at least an OpenGL 4.1 core profile context
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	// Vulkan only has the one scene, of CPU-simulated particles in the full format, in buffers
+	// sized for the capacity it started with
+	if (use_vulkan && (key == GLFW_KEY_R || key == GLFW_KEY_H || key == GLFW_KEY_P || key == GLFW_KEY_G || key == GLFW_KEY_I || key == GLFW_KEY_EQUAL || key == GLFW_KEY_MINUS))
+		return;
 
-	// Create a windowed mode window and its OpenGL context
-	window = glfwCreateWindow(1280, 720, "OpenGL Particle System", NULL, NULL);
-	if (!window)
+	if (key == GLFW_KEY_R && action == GLFW_PRESS)
 	{
-		printf("Error: couldn't create window with GLFW :(\n");
-		glfwTerminate();
-		return -1;
+		scene_render_mode = render_mode((scene_render_mode + 1) % num_render_modes);
+		printf("Rendering the %s scene\n", render_mode_names[scene_render_mode]);
+		if ((scene_render_mode == render_mode_raytrace || scene_render_mode == render_mode_progressive) && sim_mode != simulation_mode_cpu)
+			printf("Warning: the raytracer only sees particles simulated on the CPU (--sim-mode cpu)!\n");
 	}
 
-	// Set up event-handling callbacks
-	glfwSetKeyCallback(window, &key_callback);
-	glfwSetWindowSizeCallback(window, &window_resize_callback);
-
-	// Make the window's context current
-	glfwMakeContextCurrent(window);
-
-	// Now that we have a context, load all OpenGL functions
-	if (!gladLoadGL())
+	if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
 	{
-		printf("Error: couldn't load OpenGL functions :(\n");
-		return -1;
+		bool paused = !simulation_paused.load();
+		simulation_paused.store(paused);
+		printf("%s the simulation\n", paused ? "Paused" : "Unpaused");
 	}
-	printf("Got OpenGL version %d.%d\n", GLVersion.major, GLVersion.minor);
-
-	// Initialize all our graphics resources such as buffers, shaders, etc
-	init_graphics();
 
-	// Loop until the user closes the window
-	double prev_time = 0.0;
-	double prev_shader_load_time = 0.0;
-	while (!glfwWindowShouldClose(window))
+	if (key == GLFW_KEY_K && action == GLFW_PRESS)
 	{
-		double cur_time = glfwGetTime();
-		float timestep = float(cur_time - prev_time);
-		prev_time = cur_time;
-
-		// Generate new particles
-		generate_particles(timestep);
-
-		// Simulate particles' forward in time using physics
-		simulate_particles(timestep);
-
-		// Check shaders for modifications every 0.5 second to allow live editing
-		if (cur_time > prev_shader_load_time + 0.5)
-		{
-			reload_shaders_if_changed();
-			prev_shader_load_time = cur_time;
-		}
-
-		// Render a new frame
-		render_frame();
-
-		// Swap front and back buffers
-		glfwSwapBuffers(window);
-
-		// Poll for and process events
-		glfwPollEvents();
+		// The GPU simulations carry on without them
+		bool colliding = !particle_collisions.load();
+		particle_collisions.store(colliding);
+		printf("%s particle collisions%s\n", colliding ? "Turned on" : "Turned off",
+			(colliding && sim_mode != simulation_mode_cpu) ? ", for when the simulation's back on the CPU" : "");
 	}
 
-	printf("Shutting down!\n");
-	glfwTerminate();
-	return 0;
-}
-
-void init_graphics()
-{
-	// Configure OpenGL debug messages (assuming it's supported)
-	if (GLAD_GL_KHR_debug)
+	if (key == GLFW_KEY_F && action == GLFW_PRESS)
 	{
-		glDebugMessageCallback(&debug_message_callback, nullptr);
+		bool enabled = !colliders_enabled.load() && colliders.distances;
+		colliders_enabled.store(enabled);
+		printf("%s the colliders%s\n", enabled ? "Turned on" : "Turned off",
+			(enabled && sim_mode == simulation_mode_analytic) ? ", for when the simulation isn't analytic" : "");
 	}
-	else
+
+	if (key == GLFW_KEY_L && action == GLFW_PRESS)
 	{
-		printf("Warning: OpenGL debug messages not available!\n");
+		light_moving = !light_moving;
+		printf("%s the light\n", light_moving ? "Moving" : "Stopped");
 	}
 
-	// Load the vertex and fragment shaders
-	load_all_shaders();
-
-	// Set up various buffers that we'll pass to the shaders running on the GPU.
-	// 1. The vertex buffer will define the shape of an individual particle.
-	// 2. The particle buffer defines the positions and other properties of the particles.
-	// 3. The uniform buffer is a set of global variables accessible to all particles' shaders.
-
-	// Generate some vertices. Use math to generate a star shape made out of triangles, just for fun!
-	static const int star_points = 5;
-	static const int num_vertices = 6 * star_points;
-	particle_vertex vertices[num_vertices] = {};
-	for (int i = 0; i < star_points; ++i)
+	if (key == GLFW_KEY_W && action == GLFW_PRESS)
 	{
-		float angle_left   = two_pi * float(2*i + 1) / float(2*star_points);
-		float angle_middle = two_pi * float(i) / float(star_points);
-		float angle_right  = two_pi * float(2*i - 1) / float(2*star_points);
-
-		static const float inner_radius = 0.5f;
-		static const float outer_radius = 1.0f;
-		vertices[6*i + 0] = particle_vertex{0.0f, 0.0f};
-		vertices[6*i + 1] = particle_vertex{(float)(-sin(angle_right) * inner_radius), (float)(cos(angle_right) * inner_radius)};
-		vertices[6*i + 2] = particle_vertex{(float)(-sin(angle_middle) * outer_radius), (float)(cos(angle_middle) * outer_radius)};
-		vertices[6*i + 3] = vertices[6*i + 0];
-		vertices[6*i + 4] = vertices[6*i + 2];
-		vertices[6*i + 5] = particle_vertex{(float)(-sin(angle_left) * inner_radius), (float)(cos(angle_left) * inner_radius)};
+		bool enabled = !turbulence_enabled.load() && turbulence.forces;
+		turbulence_enabled.store(enabled);
+		printf("%s the turbulence%s\n", enabled ? "Turned on" : "Turned off",
+			(enabled && sim_mode == simulation_mode_analytic) ? ", for when the simulation isn't analytic" : "");
 	}
 
-	// Generate two triangles that make up a screen-space quad
-	quad_vertex quad_vertices[6] = 
+	if (key == GLFW_KEY_H && action == GLFW_PRESS)
 	{
-		-1.0f, -1.0f,
-		1.0f, -1.0f,
-		-1.0f, 1.0f,
-		1.0f, -1.0f,
-		1.0f, 1.0f,
-		-1.0f, 1.0f,
-	};
-
-	// Record how many vertices we created in a global variable,
-	// so later code will know how many vertices to draw.
-	num_vertices_per_particle = num_vertices;
-
-	// Upload this buffer to the GPU, where we'll re-use it each time we draw.
-	glGenBuffers(1, &vertex_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-	// Screen space quad buffer
-	glGenBuffers(1, &quad_vertex_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, quad_vertex_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), quad_vertices, GL_STATIC_DRAW);
-
-	// Now create the particle buffer. We're going to update this each frame, so we won't put any data in it yet.
-	glGenBuffers(1, &particle_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, particle_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(particles), nullptr, GL_DYNAMIC_DRAW);
-
-	// Now create the uniform buffer. Again, this will be updated each frame.
-	glGenBuffers(1, &uniform_buffer);
-	glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(uniform_data), nullptr, GL_DYNAMIC_DRAW);
-
-	// Create a dummy VAO, since one is required by the OpenGL core profile.
-	GLuint vao;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-}
-
-void render_frame()
-{
-	// Set the rendering viewport to match the current size of the framebuffer
-	// Note that framebuffer size may differ from "window size" due to DPI shenanigans.
-	int framebuffer_width, framebuffer_height;
-	glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
-	glViewport(0, 0, framebuffer_width, framebuffer_height);
-
-	// Get time
-	float time = float(glfwGetTime());
-
-	// Calculate a moving light source
-	float light_dir[3] = { (float)cos(time) * 0.7f, 0.5f, (float)sin(time) * 0.7f };
+		particle_resolution = particle_resolution_mode((particle_resolution + 1) % num_particle_resolution_modes);
+		particle_resolution_held_frames = 0;
+		printf("Drawing the particles at %s resolution%s\n", particle_resolution_names[particle_resolution],
+			(!composite_shader_program || !render_format_renderable(&frame_graph, GL_RGBA8)) ? ", though they can't be composited, so they're at full" : "");
+	}
 
-	// Calculate the uniform buffer parameters
-	static const float world_size = 30.0f;		// how many world units across should we be able to see in the window
-	float pixels_to_world_scale = world_size / float(std::min(framebuffer_width, framebuffer_height));
-	uniform_data uniforms =
+	if (key == GLFW_KEY_P && action == GLFW_PRESS)
 	{
-		pixels_to_world_scale * float(framebuffer_width),	// window_size.x
-		pixels_to_world_scale * float(framebuffer_height),	// window_size.y
-		0.0f, 0.4f * world_size,							// window_center
-		light_dir[0], light_dir[1], light_dir[2],			// light_dir
-		time,												// time
-	};
+		packed_instances = !packed_instances;
+		printf("%s particle instances%s\n", packed_instances ? "Packed" : "Full-precision",
+			(packed_instances && pull_instances) ? ", once the shader's not pulling them" : "");
+	}
 
-	// Send this frame's uniform data to the GPU. Using INVALIDATE_BUFFER_BIT means that
-	// any old data in the buffer is no longer relevant and can be discarded. This allows the
-	// GPU and driver to optimize the memory access under the hood.
-	glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer);	
-	if (void* mapped_buffer = glMapBufferRange(GL_UNIFORM_BUFFER, 0, sizeof(uniforms), GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_WRITE_BIT))
+	if (key == GLFW_KEY_V && action == GLFW_PRESS)
 	{
-		memcpy(mapped_buffer, &uniforms, sizeof(uniforms));
-		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		pull_instances = !pull_instances;
+		printf("%s particle instances%s\n", pull_instances ? "Pulling" : "Stopped pulling",
+			(pull_instances && !pulled_instances_usable()) ? ", though the GPU can't, so they're still attributes" : "");
 	}
-	else
+
+	if (key == GLFW_KEY_I && action == GLFW_PRESS)
 	{
-		printf("Warning: couldn't map uniform buffer!\n");
+		weighted_transparency = !weighted_transparency;
+		printf("%s%s\n", weighted_transparency ? "Drawing the particles with weighted transparency, unsorted" : "Drawing the particles opaque",
+			(weighted_transparency && (!transparency_shader_program || !render_format_renderable(&frame_graph, GL_RGBA16F) || !render_format_renderable(&frame_graph, GL_R16F))) ?
+				", though the GPU can't draw into float textures, so they're still opaque" : "");
 	}
 
-	// Send this frame's particle data to the GPU.
-	glBindBuffer(GL_ARRAY_BUFFER, particle_buffer);
-	if (void* mapped_buffer = glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(particles), GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_WRITE_BIT))
+	if (key == GLFW_KEY_M && action == GLFW_PRESS)
 	{
-		memcpy(mapped_buffer, &particles, sizeof(particles));
-		glUnmapBuffer(GL_ARRAY_BUFFER);
-		mapped_buffer = nullptr;
+		motion_trails = !motion_trails;
+		printf("Motion trails %s\n", motion_trails ? "on" : "off");
 	}
-	else
+
+	if (key == GLFW_KEY_O && action == GLFW_PRESS)
 	{
-		printf("Warning: couldn't map particle buffer!\n");
+		// Only the CPU simulation, and the GPU ones with compute shaders, can sort the particles
+		sort_order = particle_sort_order((sort_order + 1) % num_particle_sort_orders);
+		if (sort_order == particle_sort_none)
+			printf("Not sorting particles\n");
+		else
+			printf("Sorting particles by %s\n", sort_order_names[sort_order]);
 	}
 
-	// Render a nice sky blue background
-	glClearColor(0.0f, 0.6f, 1.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT);
-
-	// Set up the uniform buffer to be loaded by the shaders
-	glBindBufferRange(GL_UNIFORM_BUFFER, 0, uniform_buffer, 0, sizeof(uniform_data));
-	
-	if (!raytrace_mode)
+	if (key == GLFW_KEY_T && action == GLFW_PRESS)
 	{
-		// Rasterized scene
-
-		// Set up vertex attributes to be loaded from the vertex buffer by the GPU
-		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(particle_vertex), (const void *)offsetof(particle_vertex, position));
-
-		// Set up vertex attributes to be loaded from the particle buffer by the GPU
-		glBindBuffer(GL_ARRAY_BUFFER, particle_buffer);
+		show_gpu_timings = !show_gpu_timings;
+	}
 
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 2, GL_FLOAT, false, sizeof(particle_data), (const void *)offsetof(particle_data, position));
-		glVertexAttribDivisor(1, 1);
+	if (key == GLFW_KEY_B && action == GLFW_PRESS)
+	{
+		printf("Last frame made %d binding changes, and skipped %d redundant ones\n", last_frame_gl_stats.issued, last_frame_gl_stats.elided);
+	}
 
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(particle_data), (const void *)offsetof(particle_data, velocity));
-		glVertexAttribDivisor(2, 1);
+	if (key == GLFW_KEY_C && action == GLFW_PRESS)
+	{
+		save_cpu_trace();
+	}
 
-		// Angle, spin, size, creation_time all packed into a single vec4 attribute, to save space
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 4, GL_FLOAT, false, sizeof(particle_data), (const void *)offsetof(particle_data, angle));
-		glVertexAttribDivisor(3, 1);
+	if (key == GLFW_KEY_S && action == GLFW_PRESS)
+	{
+		save_snapshot();
+	}
 
-		// Draw the particles
-		glUseProgram(particle_shader_program);
-		glDrawArraysInstanced(GL_TRIANGLES, 0, num_vertices_per_particle, num_particles);
+	if (key == GLFW_KEY_G && action == GLFW_PRESS)
+	{
+		// Cycle through the simulation modes, skipping compute if the GPU can't do it
+		simulation_mode next_mode = simulation_mode((sim_mode + 1) % num_simulation_modes);
+		if (next_mode == simulation_mode_compute && !compute_simulation_usable())
+			next_mode = simulation_mode_analytic;
+		set_simulation_mode(next_mode);
 	}
-	else
+
+	// Double or halve the particle capacity
+	if (key == GLFW_KEY_EQUAL && action == GLFW_PRESS)
 	{
-		// Raytraced scene
-		// Set up vertex attributes to be loaded from the quad buffer by the GPU
-		glBindBuffer(GL_ARRAY_BUFFER, quad_vertex_buffer);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(quad_vertex), (const void *)offsetof(particle_vertex, position));
+		set_particle_capacity(num_particles * 2);
+	}
 
-		// Draw only a screenspace quad.  Fragment shader does the rest!
-		glUseProgram(raytrace_shader_program);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
+	if (key == GLFW_KEY_MINUS && action == GLFW_PRESS)
+	{
+		set_particle_capacity(num_particles / 2);
 	}
 }
 
-float random_in_range(float min, float max)
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	// Xorshift random number algorithm invented by George Marsaglia
-	static uint32_t rng_state = 0xf2eec0de;
-	rng_state ^= (rng_state << 13);
-    rng_state ^= (rng_state >> 17);
-    rng_state ^= (rng_state << 5);
-	float random_0_to_1 = float(rng_state) * (1.0f/4294967296.0f);
-	return min + (max - min) * random_0_to_1;
+	// Just note the new size; the next frame picks it up
+	framebuffer_width = width;
+	framebuffer_height = height;
+	framebuffer_size_changed = true;
+	set_simulation_view(width, height);
+	redraw_requested = true;
 }
 
-void generate_particles(float timestep)
+// The world's always world_size across the window's shorter side, around the same center. Split
+// into views, the simulation sees a box around that center big enough for all of them.
+void set_simulation_view(int width, int height)
 {
-	static int next_particle_index = 0;
-	static float particle_generation_accumulator = 0.0f;
-
-	// Calculate how many particles to generate based on a time emission rate
-	static const float particles_per_second = 50.0f;
-	particle_generation_accumulator += particles_per_second * timestep;
-	int particles_to_generate = int(floor(particle_generation_accumulator));
-	particle_generation_accumulator -= particles_to_generate;
-
-	float time = float(glfwGetTime());
+	if (width <= 0 || height <= 0)
+		return;
+	view_data views[max_views];
+	float bounds_min[2], bounds_max[2];
+	get_views(width, height, num_views, views);
+	get_views_bounds(views, num_views, bounds_min, bounds_max);
+	float center[2] = { 0.0f, 0.4f * world_size };
+	for (int axis = 0; axis < 2; ++axis)
+		sim_view_size[axis].store(2.0f * std::max(center[axis] - bounds_min[axis], bounds_max[axis] - center[axis]), std::memory_order_relaxed);
+}
 
-	// Generate the particles by writing into the particles data array
-	for (int i = 0; i < particles_to_generate; ++i)
+// Where each of 'count' views of a width x height window looks, and where it goes: side by side
+// for two, or in a grid, top left first, for three or four. Each has its framing's share of the
+// world across its shorter side, so with one, it's the whole window's view.
+void get_views(int width, int height, int count, view_data o_views[max_views])
+{
+	int columns = (count > 1) ? 2 : 1;
+	int rows = (count > 2) ? 2 : 1;
+	float view_width = float(width) / float(columns);
+	float view_height = float(height) / float(rows);
+	float window_pixels_to_world_scale = world_size / float(std::max(std::min(width, height), 1));
+	for (int i = 0; i < count; ++i)
 	{
-		// Set up a particle with random starting values
-		particles[next_particle_index] = particle_data
-		{
-			0.0f, 0.0f,								// position
-			random_in_range(-12.0f, 12.0f),			// velocity.x
-			random_in_range(24.0f, 48.0f),			// velocity.y
-			random_in_range(0.0f, two_pi),			// angle
-			random_in_range(-5.0f, 5.0f),			// spin
-			(float)exp2(random_in_range(-2.0f, 0.5f)),		// size
-			time,									// creation_time
-		};
-
-		// Increment to the next particle, wrapping around to the beginning
-		// of the buffer once we've gone through the whole thing.
-		next_particle_index = (next_particle_index + 1) % num_particles;
+		const float* framing = view_framings[i];
+		float pixels_to_world_scale = framing[0] * world_size / std::max(std::min(view_width, view_height), 1.0f);
+		view_data& view = o_views[i];
+		view = view_data{};
+		view.window_size[0] = pixels_to_world_scale * view_width;
+		view.window_size[1] = pixels_to_world_scale * view_height;
+		view.window_center[0] = framing[1] * world_size;
+		view.window_center[1] = framing[2] * world_size;
+		view.viewport[0] = -1.0f + 2.0f * float(i % columns) / float(columns);
+		view.viewport[1] = 1.0f - 2.0f * float(i / columns + 1) / float(rows);
+		view.viewport[2] = 2.0f / float(columns);
+		view.viewport[3] = 2.0f / float(rows);
+		view.zoom = window_pixels_to_world_scale / pixels_to_world_scale;
 	}
 }
 
-void simulate_particles(float timestep)
+// The world space box around everything the views can see
+void get_views_bounds(const view_data* views, int count, float o_min[2], float o_max[2])
 {
-	static const float gravity = -40.0f;
-
-	for (int i = 0; i < num_particles; ++i)
+	for (int axis = 0; axis < 2; ++axis)
 	{
-		// Update position using the velocity vector
-		particles[i].position[0] += timestep * particles[i].velocity[0];
-		particles[i].position[1] += timestep * particles[i].velocity[1];
-
-		// Update velocity using gravity
-		particles[i].velocity[1] += timestep * gravity;
-
-		// Update angle using the spin speed, but keep it within [-two_pi, two_pi]
-		particles[i].angle = fmod(particles[i].angle + timestep * particles[i].spin, two_pi);
+		o_min[axis] = views[0].window_center[axis] - 0.5f * views[0].window_size[axis];
+		o_max[axis] = views[0].window_center[axis] + 0.5f * views[0].window_size[axis];
+		for (int i = 1; i < count; ++i)
+		{
+			o_min[axis] = std::min(o_min[axis], views[i].window_center[axis] - 0.5f * views[i].window_size[axis]);
+			o_max[axis] = std::max(o_max[axis], views[i].window_center[axis] + 0.5f * views[i].window_size[axis]);
+		}
 	}
 }
 
-void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+// The parts of the frame the output windows show, in turn: each of the views, when the scene's
+// split into them, or else the whole frame
+int get_output_regions(int width, int height, output_region o_regions[max_views])
 {
-	// Close the window when the user presses Escape
-	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+	int frame_views = (scene_render_mode == render_mode_raster) ? num_views : 1;
+	if (frame_views == 1)
 	{
-		glfwSetWindowShouldClose(window, true);
+		o_regions[0] = output_region{ 0, 0, width, height };
+		return 1;
 	}
 
-	if (key == GLFW_KEY_R && action == GLFW_PRESS)
+	view_data views[max_views];
+	get_views(width, height, frame_views, views);
+	for (int i = 0; i < frame_views; ++i)
 	{
-		raytrace_mode = !raytrace_mode;
+		const float* viewport = views[i].viewport;
+		output_region& region = o_regions[i];
+		region.x = int((viewport[0] * 0.5f + 0.5f) * float(width) + 0.5f);
+		region.y = int((viewport[1] * 0.5f + 0.5f) * float(height) + 0.5f);
+		region.width = int(viewport[2] * 0.5f * float(width) + 0.5f);
+		region.height = int(viewport[3] * 0.5f * float(height) + 0.5f);
 	}
+	return frame_views;
 }
 
-void window_resize_callback(GLFWwindow* window, int width, int height)
+void window_refresh_callback(GLFWwindow* window)
 {
-	// Re-render the scene so that it responds continuously while user is resizing.
-	// (Ordinarily, GLFW doesn't resume rendering until the resize is finished.)
-	render_frame();
-	glfwSwapBuffers(window);
+	// While the user is resizing the window, some platforms don't return from glfwPollEvents()
+	// until they're done, so run whole frames from here to keep the simulation and rendering
+	// going. Every resize event asks for a refresh, but a frame's only worth running once the
+	// size has actually changed, which coalesces the rest. The main loop is never mid-frame
+	// while polling, so this doesn't re-enter one.
+	if (polling_events && framebuffer_size_changed)
+	{
+		redraw_requested = false;
+		run_frame();
+		++frames_run_while_polling;
+	}
+	else
+	{
+		// Otherwise the window's been uncovered, or the like, so the next frame redraws it
+		redraw_requested = true;
+	}
 }
 
 void APIENTRY debug_message_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* msg, const void* data)
@@ -449,208 +5303,247 @@ void APIENTRY debug_message_callback(GLenum source, GLenum type, GLuint id, GLen
 	if (severity == GL_DEBUG_SEVERITY_NOTIFICATION)
 		return;
 
-	// If we get any debug messages from OpenGL, print them out to the terminal
-	printf("[GL] %s\n", msg);
+	// If we get any debug messages from OpenGL, log them. This is called inside the driver, on
+	// whichever thread made the call, so it mustn't wait on the console. GL's ids are only unique
+	// within each source and type, so they go into ours too.
+	log_severity log_level = (severity == GL_DEBUG_SEVERITY_HIGH) ? log_error : log_warning;
+	log_message(log_level, uint32_t(source) * 961u + uint32_t(type) * 31u + id, "[GL] %s", msg);
 }
 
 
 
 // Infrastructure for shader loading and compilation
 
-void print_shader_info_log(GLuint shader, const char* filename)
+// Each stage's type goes into the key along with its source, so a vertex-only program can't match
+// a compute one. The includes have been spliced in, so the source is everything the compiler sees.
+void add_shader_to_program_cache_key(program_cache_key* key, GLenum shader_type, const std::string& source)
 {
-	int info_log_length = 0;
-	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_log_length);
-
-	// If the info log is empty, don't print anything.
-	if (!info_log_length)
-		return;
-
-	// Allocate enough memory in a string to hold the info log.
-	std::string info_log;
-	info_log.resize(info_log_length);
-
-	// Read the info log into the string.
-	glGetShaderInfoLog(shader, info_log_length, nullptr, &info_log[0]);
-
-	printf(
-		"----- Info log for: %s -----\n"
-		"%s"
-		"----------------------------------------------\n",
-		filename,
-		info_log.c_str());
+	uint32_t type = shader_type;
+	add_to_program_cache_key(key, &type, sizeof(type));
+	add_to_program_cache_key(key, source);
 }
 
-GLuint try_load_shader(GLenum shader_type, const char* filename, time_t* o_mtime)
+// Finish setting up a linked program, whether linked from source or loaded from the cache, and
+// put it in place of the old one
+void replace_program(GLuint new_program, GLuint* out_program)
 {
-	// Try to find the shader file. It could be at different relative
-	// paths depending on which directory we started the app from.
-	struct stat file_stat = {};
-	FILE * file = nullptr;
-	if (stat(filename, &file_stat) == 0)
-	{
-		file = fopen(filename, "rb");
-	}
-	else
+	// Set up uniform block binding (OpenGL 4.1 doesn't support explicit bindings in the shader)
+	GLuint uniform_block_index = glGetUniformBlockIndex(new_program, "uniform_data");
+	if (uniform_block_index != GL_INVALID_INDEX)
 	{
-		std::string prefixed_filename = "../";
-		prefixed_filename += filename;
-		stat(prefixed_filename.c_str(), &file_stat);
-		file = fopen(prefixed_filename.c_str(), "rb");
+		glUniformBlockBinding(new_program, uniform_block_index, 0);
 	}
-	
-	if (!file)
+	GLuint view_block_index = glGetUniformBlockIndex(new_program, "view_data");
+	if (view_block_index != GL_INVALID_INDEX)
 	{
-		printf("Warning: couldn't find shader source file %s!\n", filename);
-		return 0;
+		glUniformBlockBinding(new_program, view_block_index, 1);
 	}
 
-	// Store the file's modification time for later use
-	*o_mtime = file_stat.st_mtime;
-
-	// Allocate enough memory in a string to hold the shader file.
-	fseek(file, 0, SEEK_END);
-	int file_size = int(ftell(file));
-	std::string shader_source;
-	shader_source.resize(file_size);
-
-	// Read the file into memory
-	fseek(file, 0, SEEK_SET);
-	fread(&shader_source[0], file_size, 1, file);
-	fclose(file);
+	// Replace the old program
+	glDeleteProgram(*out_program);
+	*out_program = new_program;
+}
 
-	// Got the source code, now try to compile it.
-	GLuint shader = glCreateShader(shader_type);
-	const char* source_pointer = shader_source.c_str();
-	int source_length = int(shader_source.size());
-	glShaderSource(shader, 1, &source_pointer, &source_length);
-	glCompileShader(shader);
+// Start building a program from its stages' source, unless it's in the cache, in which case it's
+// put straight into use. Either way, any build still going for the same program is superseded.
+void load_program(const char* label, const shader_stage_source* stages, int num_stages, const char** feedback_varyings, int num_feedback_varyings, GLuint* out_program)
+{
+	for (pending_program& pending : pending_programs)
+	{
+		if (pending.out_program == out_program)
+			pending.superseded = true;
+	}
 
-	// Print the shader info log (we always do this, even if compilation succeeded,
-	// in order to display any warnings that may have been generated).
-	print_shader_info_log(shader, filename);
+	// If we've linked exactly this program before, on this driver, we can skip straight to using it
+	program_cache_key key = begin_program_cache_key(shader_cache);
+	for (int i = 0; i < num_stages; ++i)
+		add_shader_to_program_cache_key(&key, stages[i].type, stages[i].source);
+	for (int i = 0; i < num_feedback_varyings; ++i)
+		add_to_program_cache_key(&key, feedback_varyings[i]);
 
-	// Check for compilation errors
-	int compiled = 0;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-	if (!compiled)
+	GLuint cached_program = load_cached_program(shader_cache, key);
+	if (cached_program)
 	{
-		printf("Warning: %s did not compile!\n", filename);
-		glDeleteShader(shader);
-		return 0;
+		printf("%s loaded from the shader cache!\n", label);
+		replace_program(cached_program, out_program);
+		label_gl_object(GL_PROGRAM, cached_program, label);
+		return;
 	}
 
-	printf("%s compiled successfully!\n", filename);
-	return shader;
+	// Otherwise, hand it to the shader builder; finish_pending_programs() puts it into use
+	pending_programs.emplace_back();
+	pending_program& pending = pending_programs.back();
+	pending.label = label;
+	pending.key = key;
+	pending.out_program = out_program;
+	pending.superseded = false;
+	pending.build.stages.assign(stages, stages + num_stages);
+	pending.build.feedback_varyings.assign(feedback_varyings, feedback_varyings + num_feedback_varyings);
+	start_program_build(&pending.build);
 }
 
-void print_program_info_log(GLuint program)
+void finish_pending_programs(bool wait)
 {
-	int info_log_length = 0;
-	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_log_length);
-
-	// If the info log is empty, don't print anything.
-	if (!info_log_length)
-		return;
-
-	// Allocate enough memory in a string to hold the info log.
-	std::string info_log;
-	info_log.resize(info_log_length);
+	// Builds finish in the order they were started, so that if a program was reloaded twice, the
+	// later one wins
+	while (!pending_programs.empty())
+	{
+		pending_program& pending = pending_programs.front();
+		if (!wait && !is_program_build_ready(&pending.build))
+			break;
 
-	// Read the info log into the string.
-	glGetProgramInfoLog(program, info_log_length, nullptr, &info_log[0]);
+		GLuint new_program = finish_program_build(&pending.build);
+		if (new_program && pending.superseded)
+		{
+			glDeleteProgram(new_program);
+		}
+		else if (new_program)
+		{
+			replace_program(new_program, pending.out_program);
+			label_gl_object(GL_PROGRAM, new_program, pending.label.c_str());
+			save_cached_program(shader_cache, pending.key, new_program);
+		}
+		pending_programs.pop_front();
+	}
+}
 
-	printf(
-		"----- Info log for shader linking -----\n"
-		"%s"
-		"---------------------------------------\n",
-		info_log.c_str());
+bool shader_program_supported(const shader_program& program)
+{
+	// The compute simulation needs GL 4.3; don't even try to compile its shaders otherwise
+	return !program.compute_file || compute_simulation_supported;
 }
 
 void load_all_shaders()
 {
-	load_shaders("vertex_shader.glsl", "fragment_shader.glsl", &vertex_shader_mtime, &fragment_shader_mtime, &particle_shader_program);
-	load_shaders("vertex_shader_quad.glsl", "fragment_shader_raytrace.glsl", &quad_vertex_shader_mtime, &raytrace_shader_mtime, &raytrace_shader_program);
+	for (shader_program& program : shader_programs)
+	{
+		if (shader_program_supported(program))
+			load_shader_program(&program);
+	}
 }
 
-void load_shaders(const char* vertex_shader_file, const char* fragment_shader_file, time_t* vertex_shader_time_ptr, time_t* fragment_shader_time_ptr, GLuint* out_program )
+// Build one program, or one variant of it, into 'out_program'
+void load_shader_variant(shader_program* program, uint32_t key, GLuint* out_program)
 {
-	// Try to load and compile the individual shaders
-	GLuint vertex_shader = try_load_shader(GL_VERTEX_SHADER, vertex_shader_file, vertex_shader_time_ptr);
-	GLuint fragment_shader = try_load_shader(GL_FRAGMENT_SHADER, fragment_shader_file, fragment_shader_time_ptr);
-	if (!vertex_shader || !fragment_shader)
+	// The variant's features go ahead of the source, and in its label. A variant can be asked for
+	// mid-frame, so these come from the frame arena.
+	frame_string defines;
+	frame_string label = program->fragment_file ? program->fragment_file : (program->vertex_file ? program->vertex_file : program->compute_file);
+	bool first_feature = true;
+	for (int feature = 0; feature < program->num_variant_features; ++feature)
 	{
-		glDeleteShader(vertex_shader);
-		glDeleteShader(fragment_shader);
-		return;
+		if (key & (1u << feature))
+		{
+			defines += "#define ";
+			defines += program->variant_features[feature];
+			defines += " 1\n";
+			label += first_feature ? " [" : " ";
+			label += program->variant_features[feature];
+			first_feature = false;
+		}
 	}
+	if (!first_feature)
+		label += "]";
 
-	// Link all the shaders together into a program object
-	GLuint new_program = glCreateProgram();
-	glAttachShader(new_program, vertex_shader);
-	glAttachShader(new_program, fragment_shader);
-	glLinkProgram(new_program);
+	// Read the shaders' source, noting every file that goes into it
+	shader_stage_source stages[2];
+	const char* stage_files[2] = { program->vertex_file, program->fragment_file };
+	GLenum stage_types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	if (program->compute_file)
+	{
+		stage_files[0] = program->compute_file;
+		stage_files[1] = nullptr;
+		stage_types[0] = GL_COMPUTE_SHADER;
+	}
 
-	// The individual shader objects are no longer needed now that the program is linked
-	glDeleteShader(vertex_shader);
-	glDeleteShader(fragment_shader);
+	program->dependencies.clear();
+	int num_stages = 0;
+	bool read = true;
+	for (int i = 0; i < 2 && stage_files[i]; ++i)
+	{
+		shader_stage_source& stage = stages[num_stages++];
+		std::vector<shader_dependency> stage_dependencies;
+		stage.type = stage_types[i];
+		stage.filename = stage_files[i];
+		read = read_shader_source(stage_files[i], defines.c_str(), &stage.source, &stage_dependencies, &stage.source_names) && read;
+		program->dependencies.insert(program->dependencies.end(), stage_dependencies.begin(), stage_dependencies.end());
+	}
+	if (!read)
+		return;
 
-	// Print the program info log (we always do this, even if linking succeeded,
-	// in order to display any warnings that may have been generated).
-	print_program_info_log(new_program);
+	load_program(label.c_str(), stages, num_stages, program->feedback_varyings, program->num_feedback_varyings, out_program);
+}
 
-	// Check for linking errors
-	int linked = 0;
-	glGetProgramiv(new_program, GL_LINK_STATUS, &linked);
-	if (!linked)
+// (Re)build a program, or every variant of it that's been built before
+void load_shader_program(shader_program* program)
+{
+	if (program->num_variant_features == 0)
 	{
-		printf("Warning: shaders did not link!\n");
-		glDeleteProgram(new_program);
-		new_program = 0;
+		load_shader_variant(program, 0, program->program);
 		return;
 	}
+	for (std::map<uint32_t, GLuint>::value_type& variant : program->variants)
+		load_shader_variant(program, variant.first, &variant.second);
+}
 
-	printf("Shaders linked successfully!\n");
-
-	// Set up uniform block binding (OpenGL 4.1 doesn't support explicit bindings in the shader)
-	GLuint uniform_block_index = glGetUniformBlockIndex(new_program, "uniform_data");
-	if (uniform_block_index != GL_INVALID_INDEX)
+// The program for a variant, building it if it's the first time it's been asked for. There's
+// no older version of it to use in the meantime, so this waits for it. Returns 0 if it didn't
+// build; it's tried again when its files change.
+GLuint get_shader_variant(shader_program* program, uint32_t key)
+{
+	std::map<uint32_t, GLuint>::iterator variant = program->variants.find(key);
+	if (variant == program->variants.end())
 	{
-		glUniformBlockBinding(new_program, uniform_block_index, 0);
+		variant = program->variants.insert(std::make_pair(key, GLuint(0))).first;
+		load_shader_variant(program, key, &variant->second);
+		finish_pending_programs(true);
 	}
+	return variant->second;
+}
 
-	// Replace the old program
-	glDeleteProgram(*out_program);
-	*out_program = new_program;
+bool shader_program_uses(const shader_program& program, const std::string& filename)
+{
+	// Count the files it's made from directly too, in case they weren't there last time
+	if ((program.vertex_file && filename == program.vertex_file) ||
+		(program.fragment_file && filename == program.fragment_file) ||
+		(program.compute_file && filename == program.compute_file))
+	{
+		return true;
+	}
+	for (const shader_dependency& dependency : program.dependencies)
+	{
+		if (dependency.filename == filename)
+			return true;
+	}
+	return false;
 }
 
-bool check_shader_changed(const char* filename, time_t prev_mtime)
+void reload_shaders_using(const std::vector<std::string>& changed_files, bool all_changed)
 {
-	// Try to find the shader file. It could be at different relative
-	// paths depending on which directory we started the app from.
-	struct stat file_stat = {};
-	if (stat(filename, &file_stat) != 0)
+	for (shader_program& program : shader_programs)
 	{
-		std::string prefixed_filename = "../";
-		prefixed_filename += filename;
-		if (stat(prefixed_filename.c_str(), &file_stat) != 0)
+		if (!shader_program_supported(program))
+			continue;
+
+		bool changed = all_changed;
+		for (size_t i = 0; i < changed_files.size() && !changed; ++i)
+			changed = shader_program_uses(program, changed_files[i]);
+		if (changed)
 		{
-			// Couldn't find the file - treat it as unmodified
-			return false;
+			printf("Shader source files for %s updated; recompiling\n", program.compute_file ? program.compute_file : program.vertex_file);
+			load_shader_program(&program);
 		}
 	}
-
-	return (file_stat.st_mtime > prev_mtime);
 }
 
 void reload_shaders_if_changed()
 {
-	if (check_shader_changed("vertex_shader.glsl", vertex_shader_mtime) ||
-		check_shader_changed("fragment_shader.glsl", fragment_shader_mtime) ||
-		check_shader_changed("vertex_shader_quad.glsl", quad_vertex_shader_mtime) ||
-		check_shader_changed("fragment_shader_raytrace.glsl", raytrace_shader_mtime))
+	for (shader_program& program : shader_programs)
 	{
-		printf("Shader source files updated; recompiling\n");
-		load_all_shaders();
+		if (shader_program_supported(program) && shader_dependencies_changed(program.dependencies))
+		{
+			printf("Shader source files for %s updated; recompiling\n", program.compute_file ? program.compute_file : program.vertex_file);
+			load_shader_program(&program);
+		}
 	}
 }